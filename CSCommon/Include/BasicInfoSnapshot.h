@@ -0,0 +1,112 @@
+#pragma once
+
+#include <vector>
+#include "GlobalTypes.h"
+#include "MUID.h"
+#include "BasicInfo.h"
+#include "MMatchUtil.h"
+
+// Writes values of arbitrary bit widths into a byte buffer, least significant bit first.
+class MBitWriter
+{
+public:
+	void Write(u32 Value, int Bits);
+	void Write64(u64 Value, int Bits);
+	void WriteBool(bool Value) { Write(u32(Value), 1); }
+
+	const std::vector<u8>& GetData() const { return Data; }
+	size_t GetBitSize() const { return BitSize; }
+
+private:
+	std::vector<u8> Data;
+	size_t BitSize = 0;
+};
+
+class MBitReader
+{
+public:
+	MBitReader(const void* Data, size_t Size)
+		: Data(static_cast<const u8*>(Data)), Size(Size) {}
+
+	u32 Read(int Bits);
+	u64 Read64(int Bits);
+	bool ReadBool() { return Read(1) != 0; }
+
+	// Set if a read went past the end of the data. The reads return 0 from then on.
+	bool HasError() const { return Error; }
+
+private:
+	const u8* Data;
+	size_t Size;
+	size_t BitPos = 0;
+	bool Error = false;
+};
+
+// A player's basic info, quantized to the precision it's sent with.
+struct QuantizedBasicInfo
+{
+	// Sender's time, in milliseconds.
+	i32 Time;
+	// Whole units, like MShortVector, but without the range limit.
+	i32 Pos[3];
+	i32 Vel[3];
+	PackedDirection Dir;
+	PackedDirection CamDir;
+	bool HasCamDir;
+	u8 LowerAni;
+	u8 UpperAni;
+	u8 Slot;
+};
+
+bool operator==(const QuantizedBasicInfo& a, const QuantizedBasicInfo& b);
+inline bool operator!=(const QuantizedBasicInfo& a, const QuantizedBasicInfo& b) { return !(a == b); }
+
+QuantizedBasicInfo QuantizeBasicInfo(const CharacterInfo& Info, float Time);
+void DequantizeBasicInfo(const QuantizedBasicInfo& Src, CharacterInfo& Info, float& Time);
+
+// The basic info of every player in a stage at one point in time, as sent to one client.
+struct BasicInfoSnapshot
+{
+	struct Entry
+	{
+		MUID UID;
+		QuantizedBasicInfo State;
+	};
+
+	// Starts at 1. 0 means no snapshot.
+	u32 ID;
+	std::vector<Entry> Entries;
+};
+
+// The last few snapshots sent to or received by a client, which later snapshots can be encoded
+// against.
+class BasicInfoSnapshotHistory
+{
+public:
+	// Snapshots older than this many can't be used as a baseline anymore.
+	static constexpr size_t Size = 32;
+
+	void Add(BasicInfoSnapshot Snapshot);
+	const BasicInfoSnapshot* Find(u32 ID) const;
+	void Clear();
+
+private:
+	BasicInfoSnapshot Snapshots[Size]{};
+};
+
+// Encodes Current as a delta against Baseline, or in full if Baseline is null.
+//
+// Players that were in the baseline are referred to by their position in it and only cost a bit
+// if they haven't changed. For the rest, the fields are delta-encoded with just enough bits for the
+// largest difference, and the directions, animations and slot are only sent if they've changed.
+//
+// The entries of Current are reordered to match the order the decoder reconstructs them in, so
+// that Current can be stored as a baseline for the next snapshot.
+void EncodeBasicInfoSnapshot(BasicInfoSnapshot& Current, const BasicInfoSnapshot* Baseline,
+	MBitWriter& Writer);
+
+// Decodes a snapshot encoded by EncodeBasicInfoSnapshot. Changed receives the indices of the
+// entries of Out that were sent, as opposed to carried over from the baseline unchanged. Returns
+// false if the data is malformed or the baseline isn't in History.
+bool DecodeBasicInfoSnapshot(MBitReader& Reader, const BasicInfoSnapshotHistory& History,
+	BasicInfoSnapshot& Out, std::vector<size_t>* Changed = nullptr);
@@ -68,6 +68,8 @@ public:
 	const MCommandDesc*			m_pCommandDesc;
 	std::vector<MCommandParameter*>	m_Params;
 	unsigned char				m_nSerialNumber;
+	// The next command in the MCommandQueue this one is in.
+	MCommand*					m_pNextInQueue = nullptr;
 	void ClearParam(int i);
 	void Reset();
 
@@ -254,6 +256,53 @@ bool MCommand::SetData(const char* pData, MCommandManager* pCM, unsigned short n
 }
 
 
+// A FIFO of commands linked through MCommand::m_pNextInQueue, so that queueing them doesn't
+// allocate. A command can only be in one of these at a time. Deletes what's left in it.
+class MCommandQueue
+{
+public:
+	MCommandQueue() = default;
+	MCommandQueue(const MCommandQueue&) = delete;
+	MCommandQueue& operator=(const MCommandQueue&) = delete;
+	~MCommandQueue() { clear(); }
+
+	void push(MCommand* pCmd)
+	{
+		pCmd->m_pNextInQueue = nullptr;
+		*m_ppTail = pCmd;
+		m_ppTail = &pCmd->m_pNextInQueue;
+		++m_nSize;
+	}
+
+	MCommand* pop()
+	{
+		MCommand* pCmd = m_pHead;
+		if (!pCmd)
+			return nullptr;
+
+		m_pHead = pCmd->m_pNextInQueue;
+		if (!m_pHead)
+			m_ppTail = &m_pHead;
+		pCmd->m_pNextInQueue = nullptr;
+		--m_nSize;
+		return pCmd;
+	}
+
+	void clear()
+	{
+		while (MCommand* pCmd = pop())
+			delete pCmd;
+	}
+
+	bool empty() const { return m_pHead == nullptr; }
+	size_t size() const { return m_nSize; }
+
+private:
+	MCommand* m_pHead = nullptr;
+	MCommand** m_ppTail = &m_pHead;
+	size_t m_nSize = 0;
+};
+
 class MCommandSNChecker
 {
 private:
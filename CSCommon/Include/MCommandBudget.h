@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include "GlobalTypes.h"
+
+class MCommandDesc;
+
+// Holds up to Burst tokens, and gains Rate of them per second.
+struct MTokenBucket
+{
+	bool Consume(float Cost, float Rate, float Burst, u64 Now);
+	void Refill(float Rate, float Burst, u64 Now);
+
+	// Negative until the first refill, which fills it up.
+	float Tokens = -1;
+	u64 LastTime = 0;
+};
+
+enum class MCommandBudgetCategory
+{
+	Other,
+	Chat,
+	// Peer commands relayed through the server.
+	Peer,
+	Count,
+};
+
+MCommandBudgetCategory GetCommandBudgetCategory(int nCommandID, const MCommandDesc* pDesc);
+
+// How much a single connection may send to a server, checked in the I/O thread before the
+// commands are decoded.
+struct MCommandBudgetParams
+{
+	struct Rate
+	{
+		u32 PerSecond;
+		u32 Burst;
+	};
+
+	bool Enabled = true;
+	// Disconnects a connection that goes over a command budget. Otherwise, the commands over it
+	// are dropped.
+	bool Disconnect = false;
+	// Going over this always disconnects, since a TCP stream can't be cut in the middle of a
+	// packet.
+	Rate Bytes{128 * 1024, 512 * 1024};
+	Rate Commands{300, 600};
+	Rate Categories[size_t(MCommandBudgetCategory::Count)]{
+		{300, 600},
+		{4, 10},
+		{200, 400},
+	};
+};
+
+// What the budgets of all connections to a server have rejected.
+struct MCommandBudgetStats
+{
+	std::atomic<u64> DroppedCommands{};
+	std::atomic<u64> DroppedByCategory[size_t(MCommandBudgetCategory::Count)]{};
+	std::atomic<u64> Disconnects{};
+};
+
+// The budgets of a single connection. Only used by the I/O thread reading from it.
+class MCommandBudget
+{
+public:
+	enum class Result
+	{
+		Accept,
+		Drop,
+		Disconnect,
+	};
+
+	MCommandBudget(const MCommandBudgetParams& Params, MCommandBudgetStats& Stats)
+		: Params(Params), Stats(Stats) {}
+
+	// Called with each chunk read from the socket. Returns false if the connection should be
+	// dropped.
+	bool ConsumeBytes(int nSize, u64 Now);
+	// Called with each command's ID before its parameters are decoded.
+	Result ConsumeCommand(int nCommandID, const MCommandDesc* pDesc, u64 Now);
+
+	// For connections that are trusted after they've connected, e.g. agents.
+	void Disable() { Enabled = false; }
+
+	u64 GetDroppedCommands() const { return DroppedCommands; }
+
+private:
+	const MCommandBudgetParams& Params;
+	MCommandBudgetStats& Stats;
+	std::atomic<bool> Enabled{true};
+
+	MTokenBucket Bytes;
+	MTokenBucket Commands;
+	MTokenBucket Categories[size_t(MCommandBudgetCategory::Count)];
+	std::atomic<u64> DroppedCommands{};
+};
@@ -4,32 +4,47 @@
 #include "MPacket.h"
 #include "MDebug.h"
 #include "MPacketCrypter.h"
+#include "MCommandBudget.h"
+#include <deque>
+#include <memory>
 
+// Turns the bytes read from a connection into commands.
+//
+// Whole packets are parsed in place in the caller's buffer. A packet split across reads is kept
+// in m_pPending, which is only given the bytes it's missing, so that the rest of a read is again
+// parsed in place. Nothing is moved to the front of a buffer, and no packet a header can
+// describe is too large to span reads.
 class MCommandBuilder {	
 protected:
 	MUID					m_uidSender;	// client
 	MUID					m_uidReceiver;	// server
 	MCommandManager*		m_pCommandManager;
 
-	#define COMMAND_BUFFER_LEN	16384
+	// More than a single packet only waits here while it can't be sized, i.e. for encrypted
+	// packets that come before the key is set.
+	#define COMMAND_PENDING_MAX_LEN	(128 * 1024)
 
-	char					m_Buffer[COMMAND_BUFFER_LEN];
-	int						m_nBufferNext;
+	std::unique_ptr<char[]>	m_pPending;
+	int						m_nPendingSize = 0;
+	int						m_nPendingCapacity = 0;
 
-	MCommandList			m_CommandList;
-	std::list<MPacketHeader*>	m_NetCmdList;
+	MCommandQueue			m_CommandQueue;
+	std::deque<MPacketHeader*>	m_NetCmdQueue;
 
 	MPacketCrypter*			m_pPacketCrypter;
 	MCommandSNChecker		m_CommandSNChecker;
 	bool					m_bCheckCommandSN;
+
+	std::unique_ptr<MCommandBudget>	m_pBudget;
 protected:
-	bool CheckBufferEmpty();
-	bool EstimateBufferToCmd();
-	void AddBuffer(char* pBuffer, int nLen);
-	bool MoveBufferToFront(int nStart, int nLen);
+	void AddPending(const char* pBuffer, int nLen);
+	void RemovePending(int nLen);
+	int GetPendingMissing(int nAvailable);
+	bool ParsePacket(MPacketHeader* pPacket, int nPacketSize);
 	int MakeCommand(char* pBuffer, int nBufferLen);
 	void Clear();
 	int _CalcPacketSize(MPacketHeader* pPacket);
+	MCommandBudget::Result ConsumeBudget(const char* pCmdData, int nCmdSize);
 public:
 	MCommandBuilder(MUID uidSender, MUID uidReceiver, MCommandManager*	pCmdMgr);
 	virtual ~MCommandBuilder();
@@ -37,6 +52,12 @@ public:
 	void InitCrypt(MPacketCrypter* pPacketCrypter, bool bCheckCommandSerialNumber);
 	bool Read(char* pBuffer, int nBufferLen);
 	void SetCheckCommandSN(bool bCheck) { m_bCheckCommandSN = bCheck; }
+	// Limits what Read accepts before decoding it. Without a budget, everything is accepted.
+	void SetBudget(std::unique_ptr<MCommandBudget> pBudget) { m_pBudget = std::move(pBudget); }
+	MCommandBudget* GetBudget() { return m_pBudget.get(); }
+
+	// Bytes received that aren't a whole packet yet.
+	int GetPendingSize() const { return m_nPendingSize; }
 
 	MCommand* GetCommand();
 	MPacketHeader* GetNetCommand();
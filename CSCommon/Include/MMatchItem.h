@@ -6,6 +6,7 @@
 #include "MBaseItem.h"
 #include <map>
 #include <list>
+#include <memory>
 #include <vector>
 #include <algorithm>
 
@@ -373,8 +374,26 @@ protected:
 	bool					m_bDoneDbAccess;
 
 	bool					m_bHasRentItem;			
+
+	struct ItemStorage { alignas(MMatchItem) unsigned char Data[sizeof(MMatchItem)]; };
+	struct ItemBlock
+	{
+		std::unique_ptr<ItemStorage[]> Items;
+		size_t Size;
+	};
+	std::vector<ItemBlock>	m_Blocks;
+	// Unused slots in m_Blocks.
+	std::vector<ItemStorage*>	m_FreeSlots;
+
+	MMatchItem* AllocItem();
+	void FreeItem(MMatchItem* pItem);
 public:
 	MMatchItemMap();
+	// The map owns its items, so it can be moved but not copied.
+	MMatchItemMap(const MMatchItemMap&) = delete;
+	MMatchItemMap& operator=(const MMatchItemMap&) = delete;
+	MMatchItemMap(MMatchItemMap&&) = default;
+	MMatchItemMap& operator=(MMatchItemMap&&) = default;
 	virtual ~MMatchItemMap();
 	bool IsEmpty() { return empty(); }
 	int GetCount() { return (int)size(); }
@@ -385,6 +404,9 @@ public:
 	bool RemoveItem(MUID& uidItem);
 	virtual void Clear();
 	MMatchItem* GetItem(MUID& uidItem);
+	// Allocates room for Count more items in a single contiguous block, which CreateItem uses
+	// before allocating items one at a time. Used to load a whole inventory at once.
+	void Reserve(size_t Count);
 	bool IsDoneDbAccess() { return m_bDoneDbAccess; }
 	void SetDbAccess() { m_bDoneDbAccess = true; }
 	bool HasRentItem() { return m_bHasRentItem; }
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "GlobalTypes.h"
+
+// Returns true if sequence number a comes after b, allowing for the counter wrapping around.
+inline bool IsNewerSequence(u32 a, u32 b)
+{
+	return static_cast<i32>(a - b) > 0;
+}
+
+// Filters the sequence numbers of packets from one sender on an unreliable channel, where packets
+// can be lost, duplicated or arrive out of order.
+//
+// State that supersedes itself, like positions, should only be accepted if it's newer than
+// anything accepted so far, since applying an older one would move the player back in time.
+// Events, like shots, should be accepted once each, in whatever order they arrive, as long as
+// they're not too old to matter anymore.
+class MSequenceWindow
+{
+public:
+	// Number of sequence numbers before the newest one that are remembered.
+	static constexpr u32 Size = 64;
+
+	// Accepts the packet if it's newer than any seen before.
+	bool AcceptLatest(u32 Seq)
+	{
+		if (HasSeen && !IsNewerSequence(Seq, Newest))
+			return false;
+		Mark(Seq);
+		return true;
+	}
+
+	// Accepts the packet if it hasn't been seen before and is within the window.
+	bool AcceptUnique(u32 Seq)
+	{
+		if (HasSeen && !IsNewerSequence(Seq, Newest))
+		{
+			auto Age = Newest - Seq;
+			if (Age >= Size || (Seen & (u64(1) << Age)))
+				return false;
+			Seen |= u64(1) << Age;
+			return true;
+		}
+		Mark(Seq);
+		return true;
+	}
+
+	void Reset() { *this = MSequenceWindow{}; }
+
+private:
+	void Mark(u32 Seq)
+	{
+		if (HasSeen)
+		{
+			auto Shift = Seq - Newest;
+			Seen = Shift >= Size ? 0 : Seen << Shift;
+		}
+		Seen |= 1;
+		Newest = Seq;
+		HasSeen = true;
+	}
+
+	// Bit n is set if Newest - n has been seen.
+	u64 Seen = 0;
+	u32 Newest = 0;
+	bool HasSeen = false;
+};
@@ -5,6 +5,7 @@
 #include "MDebug.h"
 #include <list>
 #include "NetIO.h"
+#include "MCommandBudget.h"
 
 class MCommand;
 
@@ -24,6 +25,9 @@ protected:
 	void LockCommList() { m_csCommList.lock(); }
 	void UnlockCommList() { m_csCommList.unlock(); }
 
+	MCommandBudgetParams		m_CommandBudgetParams;
+	MCommandBudgetStats			m_CommandBudgetStats;
+
 	MCommandList				m_SafeCmdQueue;
 	MCriticalSection			m_csSafeCmdQueue;
 	void LockSafeCmdQueue() { m_csSafeCmdQueue.lock(); }
@@ -72,6 +76,10 @@ public:
 	void Destroy();
 	int GetCommObjCount();
 
+	// Must be set before Create, since the I/O threads read them without a lock.
+	void SetCommandBudgetParams(const MCommandBudgetParams& Params) { m_CommandBudgetParams = Params; }
+	const MCommandBudgetStats& GetCommandBudgetStats() const { return m_CommandBudgetStats; }
+
 	virtual int Connect(MCommObject* pCommObj);
 	int ReplyConnect(MUID* pTargetUID, MUID* pAllocUID, unsigned int nTimeStamp, MCommObject* pCommObj);
 	virtual int OnAccept(MCommObject* pCommObj);
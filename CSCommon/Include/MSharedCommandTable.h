@@ -502,6 +502,10 @@ enum Type : uint32_t
 #define MC_PEER_TUNNEL_BOT_COMMAND 8019
 #define MC_MATCH_REQUEST_SPEC 8020
 #define MC_MATCH_RESPONSE_SPEC 8021
+#define MC_MATCH_P2P_COMMAND_UDP 8022
+#define MC_MATCH_BASICINFO_SNAPSHOT 8023
+#define MC_MATCH_BASICINFO_SNAPSHOT_ACK 8024
+#define MC_MATCH_UDP_SESSION_KEY 8025
 
 //
 // 10000-19999: Ingame peer-to-peer commands
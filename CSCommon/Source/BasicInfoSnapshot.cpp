@@ -0,0 +1,356 @@
+#include "stdafx.h"
+#include "BasicInfoSnapshot.h"
+#include <algorithm>
+#include <cmath>
+
+void MBitWriter::Write(u32 Value, int Bits)
+{
+	Write64(Value, Bits);
+}
+
+void MBitWriter::Write64(u64 Value, int Bits)
+{
+	for (int i = 0; i < Bits; ++i)
+	{
+		if (BitSize % 8 == 0)
+			Data.push_back(0);
+		if ((Value >> i) & 1)
+			Data.back() |= u8(1 << (BitSize % 8));
+		++BitSize;
+	}
+}
+
+u32 MBitReader::Read(int Bits)
+{
+	return static_cast<u32>(Read64(Bits));
+}
+
+u64 MBitReader::Read64(int Bits)
+{
+	if (Error || BitPos + Bits > Size * 8)
+	{
+		Error = true;
+		return 0;
+	}
+
+	u64 Value = 0;
+	for (int i = 0; i < Bits; ++i, ++BitPos)
+		if (Data[BitPos / 8] & (1 << (BitPos % 8)))
+			Value |= u64(1) << i;
+	return Value;
+}
+
+bool operator==(const QuantizedBasicInfo& a, const QuantizedBasicInfo& b)
+{
+	auto SameDir = [](const PackedDirection& x, const PackedDirection& y) {
+		return x.Yaw == y.Yaw && x.Pitch == y.Pitch;
+	};
+	return a.Time == b.Time &&
+		std::equal(std::begin(a.Pos), std::end(a.Pos), std::begin(b.Pos)) &&
+		std::equal(std::begin(a.Vel), std::end(a.Vel), std::begin(b.Vel)) &&
+		SameDir(a.Dir, b.Dir) &&
+		a.HasCamDir == b.HasCamDir && (!a.HasCamDir || SameDir(a.CamDir, b.CamDir)) &&
+		a.LowerAni == b.LowerAni && a.UpperAni == b.UpperAni && a.Slot == b.Slot;
+}
+
+QuantizedBasicInfo QuantizeBasicInfo(const CharacterInfo& Info, float Time)
+{
+	QuantizedBasicInfo Ret{};
+	Ret.Time = static_cast<i32>(std::lround(Time * 1000.0));
+	for (int i = 0; i < 3; ++i)
+	{
+		Ret.Pos[i] = static_cast<i32>(std::lround(Info.Pos[i]));
+		Ret.Vel[i] = static_cast<i32>(std::lround(Info.Vel[i]));
+	}
+	Ret.Dir = PackDirection(Info.Dir);
+	Ret.HasCamDir = Info.HasCamDir;
+	if (Info.HasCamDir)
+		Ret.CamDir = PackDirection(Info.CamDir);
+	Ret.LowerAni = static_cast<u8>(Info.LowerAni);
+	Ret.UpperAni = static_cast<u8>(Info.UpperAni);
+	Ret.Slot = static_cast<u8>(Info.Slot);
+	return Ret;
+}
+
+void DequantizeBasicInfo(const QuantizedBasicInfo& Src, CharacterInfo& Info, float& Time)
+{
+	Time = Src.Time / 1000.f;
+	Info.Pos = v3(float(Src.Pos[0]), float(Src.Pos[1]), float(Src.Pos[2]));
+	Info.Vel = v3(float(Src.Vel[0]), float(Src.Vel[1]), float(Src.Vel[2]));
+	Info.Dir = UnpackDirection(Src.Dir);
+	Info.HasCamDir = Src.HasCamDir;
+	Info.CamDir = Src.HasCamDir ? UnpackDirection(Src.CamDir) : Info.Dir;
+	Info.LowerAni = static_cast<ZC_STATE_LOWER>(Src.LowerAni);
+	Info.UpperAni = static_cast<ZC_STATE_UPPER>(Src.UpperAni);
+	Info.Slot = static_cast<MMatchCharItemParts>(Src.Slot);
+}
+
+void BasicInfoSnapshotHistory::Add(BasicInfoSnapshot Snapshot)
+{
+	auto& Slot = Snapshots[Snapshot.ID % Size];
+	Slot = std::move(Snapshot);
+}
+
+const BasicInfoSnapshot* BasicInfoSnapshotHistory::Find(u32 ID) const
+{
+	auto& Slot = Snapshots[ID % Size];
+	if (ID == 0 || Slot.ID != ID)
+		return nullptr;
+	return &Slot;
+}
+
+void BasicInfoSnapshotHistory::Clear()
+{
+	for (auto&& Snapshot : Snapshots)
+	{
+		Snapshot.ID = 0;
+		Snapshot.Entries.clear();
+	}
+}
+
+// Deltas are computed with wrapping arithmetic, so that they always round trip.
+static i32 Delta(i32 a, i32 b) { return static_cast<i32>(u32(a) - u32(b)); }
+static i32 ApplyDelta(i32 Base, i32 d) { return static_cast<i32>(u32(Base) + u32(d)); }
+
+static u32 Magnitude(i32 x) { return x < 0 ? 0u - u32(x) : u32(x); }
+
+static int BitWidth(u32 x)
+{
+	int Bits = 0;
+	for (; x; x >>= 1)
+		++Bits;
+	return Bits;
+}
+
+// Writes the values with a shared width, which is enough for the largest magnitude. A vector
+// that hasn't changed costs only the width.
+static constexpr int WidthBits = 6;
+
+template <size_t N>
+static void WriteDeltas(MBitWriter& Writer, const i32 (&Values)[N])
+{
+	int Width = 0;
+	for (auto x : Values)
+		Width = (std::max)(Width, BitWidth(Magnitude(x)));
+	Writer.Write(u32(Width), WidthBits);
+	if (Width == 0)
+		return;
+	for (auto x : Values)
+	{
+		Writer.WriteBool(x < 0);
+		Writer.Write(Magnitude(x), Width);
+	}
+}
+
+template <size_t N>
+static void ReadDeltas(MBitReader& Reader, i32 (&Values)[N])
+{
+	int Width = static_cast<int>(Reader.Read(WidthBits));
+	for (auto& x : Values)
+	{
+		if (Width == 0 || Width > 32)
+		{
+			x = 0;
+			continue;
+		}
+		auto Negative = Reader.ReadBool();
+		auto Mag = Reader.Read(Width);
+		x = static_cast<i32>(Negative ? 0u - Mag : Mag);
+	}
+}
+
+static void WriteDirection(MBitWriter& Writer, const PackedDirection& Dir)
+{
+	Writer.Write(u32(u8(Dir.Yaw)), 8);
+	Writer.Write(u32(u8(Dir.Pitch)), 8);
+}
+
+static PackedDirection ReadDirection(MBitReader& Reader)
+{
+	PackedDirection Dir;
+	Dir.Yaw = static_cast<int8_t>(Reader.Read(8));
+	Dir.Pitch = static_cast<int8_t>(Reader.Read(8));
+	return Dir;
+}
+
+static bool SameDirection(const PackedDirection& a, const PackedDirection& b)
+{
+	return a.Yaw == b.Yaw && a.Pitch == b.Pitch;
+}
+
+static void EncodeState(MBitWriter& Writer, const QuantizedBasicInfo& State,
+	const QuantizedBasicInfo& Base)
+{
+	i32 Time[] = {Delta(State.Time, Base.Time)};
+	WriteDeltas(Writer, Time);
+
+	i32 Pos[3], Vel[3];
+	for (int i = 0; i < 3; ++i)
+	{
+		Pos[i] = Delta(State.Pos[i], Base.Pos[i]);
+		Vel[i] = Delta(State.Vel[i], Base.Vel[i]);
+	}
+	WriteDeltas(Writer, Pos);
+	WriteDeltas(Writer, Vel);
+
+	auto DirChanged = !SameDirection(State.Dir, Base.Dir);
+	Writer.WriteBool(DirChanged);
+	if (DirChanged)
+		WriteDirection(Writer, State.Dir);
+
+	Writer.WriteBool(State.HasCamDir);
+	if (State.HasCamDir)
+	{
+		auto CamDirChanged = !Base.HasCamDir || !SameDirection(State.CamDir, Base.CamDir);
+		Writer.WriteBool(CamDirChanged);
+		if (CamDirChanged)
+			WriteDirection(Writer, State.CamDir);
+	}
+
+	auto AnimChanged = State.LowerAni != Base.LowerAni || State.UpperAni != Base.UpperAni;
+	Writer.WriteBool(AnimChanged);
+	if (AnimChanged)
+	{
+		Writer.Write(State.LowerAni, 8);
+		Writer.Write(State.UpperAni, 8);
+	}
+
+	auto SlotChanged = State.Slot != Base.Slot;
+	Writer.WriteBool(SlotChanged);
+	if (SlotChanged)
+		Writer.Write(State.Slot, 4);
+}
+
+static QuantizedBasicInfo DecodeState(MBitReader& Reader, const QuantizedBasicInfo& Base)
+{
+	QuantizedBasicInfo State{};
+
+	i32 Time[1];
+	ReadDeltas(Reader, Time);
+	State.Time = ApplyDelta(Base.Time, Time[0]);
+
+	i32 Pos[3], Vel[3];
+	ReadDeltas(Reader, Pos);
+	ReadDeltas(Reader, Vel);
+	for (int i = 0; i < 3; ++i)
+	{
+		State.Pos[i] = ApplyDelta(Base.Pos[i], Pos[i]);
+		State.Vel[i] = ApplyDelta(Base.Vel[i], Vel[i]);
+	}
+
+	State.Dir = Reader.ReadBool() ? ReadDirection(Reader) : Base.Dir;
+
+	State.HasCamDir = Reader.ReadBool();
+	if (State.HasCamDir)
+		State.CamDir = Reader.ReadBool() ? ReadDirection(Reader) : Base.CamDir;
+
+	if (Reader.ReadBool())
+	{
+		State.LowerAni = static_cast<u8>(Reader.Read(8));
+		State.UpperAni = static_cast<u8>(Reader.Read(8));
+	}
+	else
+	{
+		State.LowerAni = Base.LowerAni;
+		State.UpperAni = Base.UpperAni;
+	}
+
+	State.Slot = Reader.ReadBool() ? static_cast<u8>(Reader.Read(4)) : Base.Slot;
+
+	return State;
+}
+
+static constexpr int NewCountBits = 8;
+
+void EncodeBasicInfoSnapshot(BasicInfoSnapshot& Current, const BasicInfoSnapshot* Baseline,
+	MBitWriter& Writer)
+{
+	Writer.Write(Current.ID, 32);
+	Writer.Write(Baseline ? Baseline->ID : 0, 32);
+
+	std::vector<BasicInfoSnapshot::Entry> Ordered;
+	Ordered.reserve(Current.Entries.size());
+	std::vector<bool> Written(Current.Entries.size());
+
+	if (Baseline)
+	{
+		for (auto&& BaseEntry : Baseline->Entries)
+		{
+			auto it = std::find_if(Current.Entries.begin(), Current.Entries.end(), [&](auto&& x) {
+				return x.UID == BaseEntry.UID;
+			});
+			auto Present = it != Current.Entries.end();
+			Writer.WriteBool(Present);
+			if (!Present)
+				continue;
+
+			Written[it - Current.Entries.begin()] = true;
+			auto Changed = it->State != BaseEntry.State;
+			Writer.WriteBool(Changed);
+			if (Changed)
+				EncodeState(Writer, it->State, BaseEntry.State);
+			Ordered.push_back(*it);
+		}
+	}
+
+	auto NewCount = std::count(Written.begin(), Written.end(), false);
+	assert(NewCount < (1 << NewCountBits));
+	Writer.Write(u32(NewCount), NewCountBits);
+	for (size_t i = 0; i < Current.Entries.size(); ++i)
+	{
+		if (Written[i])
+			continue;
+
+		auto&& Entry = Current.Entries[i];
+		Writer.Write64(Entry.UID.AsU64(), 64);
+		EncodeState(Writer, Entry.State, QuantizedBasicInfo{});
+		Ordered.push_back(Entry);
+	}
+
+	Current.Entries = std::move(Ordered);
+}
+
+bool DecodeBasicInfoSnapshot(MBitReader& Reader, const BasicInfoSnapshotHistory& History,
+	BasicInfoSnapshot& Out, std::vector<size_t>* Changed)
+{
+	Out.ID = Reader.Read(32);
+	auto BaselineID = Reader.Read(32);
+	Out.Entries.clear();
+	if (Changed)
+		Changed->clear();
+
+	if (BaselineID != 0)
+	{
+		auto Baseline = History.Find(BaselineID);
+		if (!Baseline)
+			return false;
+
+		for (auto&& BaseEntry : Baseline->Entries)
+		{
+			if (!Reader.ReadBool())
+				continue;
+
+			if (Reader.ReadBool())
+			{
+				if (Changed)
+					Changed->push_back(Out.Entries.size());
+				Out.Entries.push_back({BaseEntry.UID, DecodeState(Reader, BaseEntry.State)});
+			}
+			else
+			{
+				Out.Entries.push_back(BaseEntry);
+			}
+		}
+	}
+
+	auto NewCount = Reader.Read(NewCountBits);
+	for (u32 i = 0; i < NewCount && !Reader.HasError(); ++i)
+	{
+		MUID UID{Reader.Read64(64)};
+		if (Changed)
+			Changed->push_back(Out.Entries.size());
+		Out.Entries.push_back({UID, DecodeState(Reader, QuantizedBasicInfo{})});
+	}
+
+	return Out.ID != 0 && !Reader.HasError();
+}
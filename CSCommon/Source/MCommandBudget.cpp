@@ -0,0 +1,101 @@
+#include "stdafx.h"
+#include "MCommandBudget.h"
+#include "MCommand.h"
+#include "MSharedCommandTable.h"
+#include <algorithm>
+
+void MTokenBucket::Refill(float Rate, float Burst, u64 Now)
+{
+	if (Tokens < 0)
+	{
+		Tokens = Burst;
+		LastTime = Now;
+		return;
+	}
+
+	if (Now <= LastTime)
+		return;
+
+	Tokens = (std::min)(Burst, Tokens + (Now - LastTime) * Rate / 1000);
+	LastTime = Now;
+}
+
+bool MTokenBucket::Consume(float Cost, float Rate, float Burst, u64 Now)
+{
+	Refill(Rate, Burst, Now);
+	if (Tokens < Cost)
+		return false;
+
+	Tokens -= Cost;
+	return true;
+}
+
+MCommandBudgetCategory GetCommandBudgetCategory(int nCommandID, const MCommandDesc* pDesc)
+{
+	switch (nCommandID)
+	{
+	case MC_MATCH_CHANNEL_REQUEST_CHAT:
+	case MC_MATCH_STAGE_CHAT:
+	case MC_MATCH_USER_WHISPER:
+	case MC_MATCH_CHATROOM_CREATE:
+	case MC_MATCH_CHATROOM_JOIN:
+	case MC_MATCH_CHATROOM_INVITE:
+	case MC_MATCH_CHATROOM_CHAT:
+	case MC_MATCH_CLAN_REQUEST_MSG:
+	case MC_PEER_CHAT:
+		return MCommandBudgetCategory::Chat;
+
+	// Only carries peer commands, like MCDT_PEER2PEER ones.
+	case MC_MATCH_P2P_COMMAND_UDP:
+		return MCommandBudgetCategory::Peer;
+	}
+
+	if (pDesc && pDesc->IsFlag(MCDT_PEER2PEER))
+		return MCommandBudgetCategory::Peer;
+
+	return MCommandBudgetCategory::Other;
+}
+
+bool MCommandBudget::ConsumeBytes(int nSize, u64 Now)
+{
+	if (!Enabled)
+		return true;
+
+	if (Bytes.Consume(float(nSize), float(Params.Bytes.PerSecond), float(Params.Bytes.Burst), Now))
+		return true;
+
+	++Stats.Disconnects;
+	return false;
+}
+
+MCommandBudget::Result MCommandBudget::ConsumeCommand(int nCommandID, const MCommandDesc* pDesc,
+	u64 Now)
+{
+	if (!Enabled)
+		return Result::Accept;
+
+	const auto Category = size_t(GetCommandBudgetCategory(nCommandID, pDesc));
+	auto& CategoryRate = Params.Categories[Category];
+	auto& CategoryBucket = Categories[Category];
+
+	// Both buckets need a token before either is spent, so that a command dropped for one budget
+	// doesn't count against the other.
+	CategoryBucket.Refill(float(CategoryRate.PerSecond), float(CategoryRate.Burst), Now);
+	Commands.Refill(float(Params.Commands.PerSecond), float(Params.Commands.Burst), Now);
+	if (CategoryBucket.Tokens >= 1 && Commands.Tokens >= 1)
+	{
+		CategoryBucket.Tokens -= 1;
+		Commands.Tokens -= 1;
+		return Result::Accept;
+	}
+
+	++DroppedCommands;
+	++Stats.DroppedCommands;
+	++Stats.DroppedByCategory[Category];
+
+	if (!Params.Disconnect)
+		return Result::Drop;
+
+	++Stats.Disconnects;
+	return Result::Disconnect;
+}
@@ -1,6 +1,7 @@
 #include "stdafx.h"
 #include "MCommandBuilder.h"
 #include "MMatchUtil.h"
+#include "MTime.h"
 
 MCommandBuilder::MCommandBuilder(MUID uidSender, MUID uidReceiver, MCommandManager*	pCmdMgr) 
 {	
@@ -9,7 +10,6 @@ MCommandBuilder::MCommandBuilder(MUID uidSender, MUID uidReceiver, MCommandManag
 	m_uidReceiver = uidReceiver;
 	m_pCommandManager = pCmdMgr;
 
-	m_nBufferNext = 0;
 	m_bCheckCommandSN = true;
 }
 
@@ -18,73 +18,52 @@ MCommandBuilder::~MCommandBuilder()
 	Clear();
 }
 
-bool MCommandBuilder::CheckBufferEmpty() 
-{
-	if (m_nBufferNext == 0) return true;
-	else return false;
-}
-
-bool MCommandBuilder::EstimateBufferToCmd() 
+int MCommandBuilder::_CalcPacketSize(MPacketHeader* pPacket)
 {
-	if (m_nBufferNext < sizeof(MPacketHeader))
-		return false;
-	MPacketHeader* pPacket = (MPacketHeader*)m_Buffer;
-	if (m_nBufferNext < _CalcPacketSize(pPacket))
-		return false;
-	return true;
+	return pPacket->CalcPacketSize(m_pPacketCrypter);
 }
 
-void MCommandBuilder::AddBuffer(char* pBuffer, int nLen) 
+MCommandBudget::Result MCommandBuilder::ConsumeBudget(const char* pCmdData, int nCmdSize)
 {
-	if (nLen <= 0) return;
-	if ((m_nBufferNext + nLen) >= COMMAND_BUFFER_LEN) {
-		_ASSERT(false);
-		return;
-	}
-	memcpy(m_Buffer+m_nBufferNext, pBuffer, nLen);
-	m_nBufferNext += nLen;
-}
+	if (!m_pBudget)
+		return MCommandBudget::Result::Accept;
 
-bool MCommandBuilder::MoveBufferToFront(int nStart, int nLen) 
-{
-	if (nStart+nLen > m_nBufferNext) 
-		return false;
-	memcpy(m_Buffer, m_Buffer+nStart, nLen);
-	m_nBufferNext = nLen;
-	return true;
-}
+	// The total size comes before the ID. Anything shorter fails in MCommand::SetData anyway.
+	unsigned short nCommandID = 0;
+	if (nCmdSize < int(sizeof(unsigned short) + sizeof(nCommandID)))
+		return MCommandBudget::Result::Accept;
+	memcpy(&nCommandID, pCmdData + sizeof(unsigned short), sizeof(nCommandID));
 
-int MCommandBuilder::_CalcPacketSize(MPacketHeader* pPacket)
-{
-	return pPacket->CalcPacketSize(m_pPacketCrypter);
+	return m_pBudget->ConsumeCommand(nCommandID, m_pCommandManager->GetCommandDescByID(nCommandID),
+		GetGlobalTimeMS());
 }
 
-int MCommandBuilder::MakeCommand(char* pBuffer, int nBufferLen) 
+bool MCommandBuilder::ParsePacket(MPacketHeader* pPacket, int nPacketSize)
 {
-	unsigned int nOffset = 0;
-	int nLen = nBufferLen;
-	MPacketHeader* pPacket = (MPacketHeader*)(pBuffer+nOffset);
-	int nCmdCount = 0;
-	int nPacketSize = 0;
+	// Too short to hold its own header, which would make the size of the command negative.
+	if (nPacketSize < int(sizeof(MPacketHeader)))
+		return false;
 
-	while (nLen >= sizeof(MPacketHeader))
+	if (pPacket->nMsg == MSGID_RAWCOMMAND)
 	{
-		int nPacketSize = _CalcPacketSize(pPacket);
-		if ((nPacketSize > nLen) || (nPacketSize <= 0)) break;
-
-		if (pPacket->nMsg == MSGID_RAWCOMMAND)
+		unsigned short nCheckSum = MBuildCheckSum(pPacket, nPacketSize);
+		if (pPacket->nCheckSum != nCheckSum) {
+			return false;
+		} else if (nPacketSize > MAX_PACKET_SIZE)
 		{
-			unsigned short nCheckSum = MBuildCheckSum(pPacket, nPacketSize);
-			if (pPacket->nCheckSum != nCheckSum) {
-				return -1;
-			} else if (nPacketSize > MAX_PACKET_SIZE)
-			{
-				return -1;
-			}
-			else 
+			return false;
+		}
+		else 
+		{
+			int nCmdSize = nPacketSize - sizeof(MPacketHeader);
+			// Dropped commands are skipped, and the rest of the buffer still read.
+			const auto Result = ConsumeBudget(((MCommandMsg*)pPacket)->Buffer, nCmdSize);
+			if (Result == MCommandBudget::Result::Disconnect)
+				return false;
+
+			if (Result == MCommandBudget::Result::Accept)
 			{
 				MCommand* pCmd = new MCommand();
-				int nCmdSize = nPacketSize - sizeof(MPacketHeader);
 				if (pCmd->SetData(((MCommandMsg*)pPacket)->Buffer, m_pCommandManager,
 					(unsigned short)nCmdSize))
 				{
@@ -93,45 +72,49 @@ int MCommandBuilder::MakeCommand(char* pBuffer, int nBufferLen)
 						if (!m_CommandSNChecker.CheckValidate(pCmd->m_nSerialNumber))
 						{
 							delete pCmd; pCmd = NULL;
-							return -1;
+							return false;
 						}
 					}
 
 					pCmd->m_Sender = m_uidSender;
 					pCmd->m_Receiver = m_uidReceiver;
-					m_CommandList.push_back(pCmd);
+					m_CommandQueue.push(pCmd);
 				}
 				else
 				{
 					delete pCmd; pCmd = NULL;
-					return -1;
+					return false;
 				}
 			}
 		}
-		else if (pPacket->nMsg == MSGID_COMMAND) 
+	}
+	else if (pPacket->nMsg == MSGID_COMMAND) 
+	{
+		unsigned short nCheckSum = MBuildCheckSum(pPacket, nPacketSize);
+		if (pPacket->nCheckSum != nCheckSum) {
+			return false;
+		} 
+		else if (nPacketSize > MAX_PACKET_SIZE)
+		{
+			return false;
+		}
+		else 
 		{
-			unsigned short nCheckSum = MBuildCheckSum(pPacket, nPacketSize);
-			if (pPacket->nCheckSum != nCheckSum) {
-				return -1;
-			} 
-			else if (nPacketSize > MAX_PACKET_SIZE)
+			int nCmdSize = nPacketSize - sizeof(MPacketHeader);
+			if (m_pPacketCrypter)
 			{
-				return -1;
+				if (!m_pPacketCrypter->Decrypt((char*)((MCommandMsg*)pPacket)->Buffer, nCmdSize))
+					return false;
 			}
-			else 
-			{
-				MCommand* pCmd = new MCommand();
 
-				int nCmdSize = nPacketSize - sizeof(MPacketHeader);
-				if (m_pPacketCrypter)
-				{
-					if (!m_pPacketCrypter->Decrypt((char*)((MCommandMsg*)pPacket)->Buffer, nCmdSize))
-					{
-						delete pCmd; pCmd = NULL;
-						return -1;
-					}
-				}
+			// The ID is only readable after decrypting, but the parameters aren't decoded yet.
+			const auto Result = ConsumeBudget(((MCommandMsg*)pPacket)->Buffer, nCmdSize);
+			if (Result == MCommandBudget::Result::Disconnect)
+				return false;
 
+			if (Result == MCommandBudget::Result::Accept)
+			{
+				MCommand* pCmd = new MCommand();
 				if (pCmd->SetData((char*)((MCommandMsg*)pPacket)->Buffer,
 					m_pCommandManager, (unsigned short)nCmdSize))
 				{
@@ -140,120 +123,163 @@ int MCommandBuilder::MakeCommand(char* pBuffer, int nBufferLen)
 						if (!m_CommandSNChecker.CheckValidate(pCmd->m_nSerialNumber))
 						{
 							delete pCmd; pCmd = NULL;
-							return -1;
+							return false;
 						}
 					}
 
 					pCmd->m_Sender = m_uidSender;
 					pCmd->m_Receiver = m_uidReceiver;
-					m_CommandList.push_back(pCmd);
+					m_CommandQueue.push(pCmd);
 				}
 				else
 				{
 					delete pCmd; pCmd = NULL;
-					return -1;
+					return false;
 				}
 			}
-		} 
-		else if (pPacket->nMsg == MSGID_REPLYCONNECT) {
-			if (nPacketSize == sizeof(MReplyConnectMsg))
-			{
-				MPacketHeader* pNewPacket = (MPacketHeader*)malloc(nPacketSize);
-				memcpy(pNewPacket, pPacket, nPacketSize);
-				m_NetCmdList.push_back(pNewPacket);
-			}
-			else
-			{
-				return -1;
-			}
 		}
-		else {
-			return -1;
+	} 
+	else if (pPacket->nMsg == MSGID_REPLYCONNECT) {
+		if (nPacketSize == sizeof(MReplyConnectMsg))
+		{
+			MPacketHeader* pNewPacket = (MPacketHeader*)malloc(nPacketSize);
+			memcpy(pNewPacket, pPacket, nPacketSize);
+			m_NetCmdQueue.push_back(pNewPacket);
 		}
+		else
+		{
+			return false;
+		}
+	}
+	else {
+		return false;
+	}
+
+	return true;
+}
+
+int MCommandBuilder::MakeCommand(char* pBuffer, int nBufferLen) 
+{
+	unsigned int nOffset = 0;
+	int nLen = nBufferLen;
+	MPacketHeader* pPacket = (MPacketHeader*)(pBuffer+nOffset);
+
+	while (nLen >= sizeof(MPacketHeader))
+	{
+		int nPacketSize = _CalcPacketSize(pPacket);
+		if ((nPacketSize > nLen) || (nPacketSize <= 0)) break;
+
+		if (!ParsePacket(pPacket, nPacketSize))
+			return -1;
 
 		nOffset += nPacketSize;
 		nLen -= nPacketSize;			
-		nCmdCount++;
 
 		pPacket = (MPacketHeader*)(pBuffer+nOffset);
 	}
 
-
 	return nLen;
 }
 
 void MCommandBuilder::Clear()
 {
-	if (!m_CommandList.empty())
-	{
-		for (MCommandList::iterator itorCmd = m_CommandList.begin(); itorCmd != m_CommandList.end(); ++itorCmd)
-		{
-			MCommand* pCmd = (*itorCmd);
-			delete pCmd;
-		}
-		m_CommandList.clear();
-	}
+	m_CommandQueue.clear();
+
+	for (MPacketHeader* pNetCmd : m_NetCmdQueue)
+		free(pNetCmd);
+	m_NetCmdQueue.clear();
+}
 
-	if (!m_NetCmdList.empty())
+void MCommandBuilder::AddPending(const char* pBuffer, int nLen)
+{
+	if (m_nPendingSize + nLen > m_nPendingCapacity)
 	{
-		for (auto itorNetCmd = m_NetCmdList.begin(); itorNetCmd != m_NetCmdList.end(); ++itorNetCmd)
-		{
-			MPacketHeader* pNetCmd = (*itorNetCmd);
-			free(pNetCmd);
-		}
-		m_NetCmdList.clear();
+		int nCapacity = (std::max)(m_nPendingCapacity, 1024);
+		while (nCapacity < m_nPendingSize + nLen)
+			nCapacity *= 2;
+
+		std::unique_ptr<char[]> pPending{new char[nCapacity]};
+		memcpy(pPending.get(), m_pPending.get(), m_nPendingSize);
+		m_pPending = std::move(pPending);
+		m_nPendingCapacity = nCapacity;
 	}
+
+	memcpy(m_pPending.get() + m_nPendingSize, pBuffer, nLen);
+	m_nPendingSize += nLen;
+}
+
+void MCommandBuilder::RemovePending(int nLen)
+{
+	if (nLen == 0)
+		return;
+
+	// Only moves anything when packets waited for the key.
+	m_nPendingSize -= nLen;
+	if (m_nPendingSize > 0)
+		memmove(m_pPending.get(), m_pPending.get() + nLen, m_nPendingSize);
+}
+
+int MCommandBuilder::GetPendingMissing(int nAvailable)
+{
+	if (m_nPendingSize < int(sizeof(MPacketHeader)))
+		return int(sizeof(MPacketHeader)) - m_nPendingSize;
+
+	// A packet that can't be sized yet takes everything after it until it can.
+	const int nPacketSize = _CalcPacketSize((MPacketHeader*)m_pPending.get());
+	if (nPacketSize <= 0)
+		return nAvailable;
+
+	return (std::max)(nPacketSize - m_nPendingSize, 0);
 }
 
 bool MCommandBuilder::Read(char* pBuffer, int nBufferLen) 
 {
-	MPacketHeader* pPacket = (MPacketHeader*)pBuffer;
-
-	if (CheckBufferEmpty() == true)  {
-		if ( (nBufferLen < sizeof(MPacketHeader)) || (nBufferLen < _CalcPacketSize(pPacket)) ) {	
-			AddBuffer(pBuffer, nBufferLen);
-		} else {
-			int nSpareData = MakeCommand(pBuffer, nBufferLen);
-			if (nSpareData > 0) {
-				AddBuffer(pBuffer+(nBufferLen-nSpareData), nSpareData);
-			}
-			else if (nSpareData < 0) return false;
-		}
-	} else {
-		AddBuffer(pBuffer, nBufferLen);
-		if (EstimateBufferToCmd() == true) {
-			int nSpareData = MakeCommand(m_Buffer, m_nBufferNext);	// m_nBufferNext == nBufferSize
-			if (nSpareData >= 0)
-				MoveBufferToFront(m_nBufferNext-nSpareData, nSpareData);
-			else return false;
-		}
+	if (m_pBudget && !m_pBudget->ConsumeBytes(nBufferLen, GetGlobalTimeMS()))
+		return false;
+
+	// Complete what's left of earlier reads with only the bytes it's missing, so that the rest
+	// can be parsed in place.
+	while (m_nPendingSize > 0 && nBufferLen > 0)
+	{
+		const int nMissing = GetPendingMissing(nBufferLen);
+		const int nTake = (std::min)(nMissing, nBufferLen);
+		AddPending(pBuffer, nTake);
+		pBuffer += nTake;
+		nBufferLen -= nTake;
+		if (nTake < nMissing)
+			break;
+
+		const int nSpareData = MakeCommand(m_pPending.get(), m_nPendingSize);
+		if (nSpareData < 0)
+			return false;
+		RemovePending(m_nPendingSize - nSpareData);
 	}
-	return true;
+
+	if (nBufferLen > 0)
+	{
+		const int nSpareData = MakeCommand(pBuffer, nBufferLen);
+		if (nSpareData < 0)
+			return false;
+		AddPending(pBuffer + nBufferLen - nSpareData, nSpareData);
+	}
+
+	return m_nPendingSize <= COMMAND_PENDING_MAX_LEN;
 }
 
 MCommand* MCommandBuilder::GetCommand() 
 {
-	MCommandList::iterator itorCmd = m_CommandList.begin();
-	if (itorCmd != m_CommandList.end()) {
-		MCommand* pCmd = (*itorCmd);
-		m_CommandList.pop_front();
-		return (pCmd);
-	} else {
-		return NULL;
-	}
+	return m_CommandQueue.pop();
 }
 
 
 MPacketHeader* MCommandBuilder::GetNetCommand() 
 {
-	auto itorCmd = m_NetCmdList.begin();
-	if (itorCmd != m_NetCmdList.end()) {
-		MPacketHeader* pTestCmd = (*itorCmd);
-		m_NetCmdList.pop_front();
-		return (pTestCmd);
-	} else {
+	if (m_NetCmdQueue.empty())
 		return NULL;
-	}
+
+	MPacketHeader* pNetCmd = m_NetCmdQueue.front();
+	m_NetCmdQueue.pop_front();
+	return pNetCmd;
 }
 
 
@@ -630,12 +630,7 @@ bool MMatchItemMap::CreateItem(MUID& uid, int nCIID, int nItemDescID, bool bRent
 		return false;
 	}
 
-	MMatchItem* pNewItem = new MMatchItem();
-	if (pNewItem == NULL) 
-	{
-		_ASSERT(0);
-		return false;
-	}
+	MMatchItem* pNewItem = AllocItem();
 	pNewItem->Create(uid, pDesc);
 	pNewItem->SetCIID(nCIID);
 
@@ -657,8 +652,7 @@ bool MMatchItemMap::RemoveItem(MUID& uidItem)
 	iterator itor = find(uidItem);
 	if (itor != end())
 	{
-		MMatchItem* pItem = (*itor).second;
-		delete pItem; pItem = NULL;
+		FreeItem((*itor).second);
 		erase(itor);
 	}
 	else
@@ -685,12 +679,50 @@ void MMatchItemMap::Clear()
 	m_bDoneDbAccess = false;
 	m_bHasRentItem = false;
 
-	while(!empty())
+	for (auto&& Pair : *this)
+		FreeItem(Pair.second);
+	clear();
+	m_FreeSlots.clear();
+	m_Blocks.clear();
+}
+
+void MMatchItemMap::Reserve(size_t Count)
+{
+	if (m_FreeSlots.size() >= Count)
+		return;
+
+	Count -= m_FreeSlots.size();
+	ItemBlock Block{std::make_unique<ItemStorage[]>(Count), Count};
+	// Taken from the back, so this hands out the slots in order.
+	for (size_t i = Count; i-- > 0; )
+		m_FreeSlots.push_back(&Block.Items[i]);
+	m_Blocks.push_back(std::move(Block));
+}
+
+MMatchItem* MMatchItemMap::AllocItem()
+{
+	if (m_FreeSlots.empty())
+		return new MMatchItem;
+
+	auto* Slot = m_FreeSlots.back();
+	m_FreeSlots.pop_back();
+	return new (Slot) MMatchItem;
+}
+
+void MMatchItemMap::FreeItem(MMatchItem* pItem)
+{
+	auto* Slot = reinterpret_cast<ItemStorage*>(pItem);
+	for (auto&& Block : m_Blocks)
 	{
-		MMatchItem* pItem = (*begin()).second;
-		delete pItem; pItem = NULL;
-		erase(begin());
+		if (std::less_equal<ItemStorage*>{}(Block.Items.get(), Slot) &&
+			std::less<ItemStorage*>{}(Slot, Block.Items.get() + Block.Size))
+		{
+			pItem->~MMatchItem();
+			m_FreeSlots.push_back(Slot);
+			return;
+		}
 	}
+	delete pItem;
 }
 
 
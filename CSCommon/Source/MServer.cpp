@@ -422,6 +422,9 @@ void MServer::RCPCallback(void* pCallbackContext, NetIO::IOOperation Op, NetIO::
 		GetIPv4String(addr, IPString);
 		pCommObj->SetAddress(IPString, AData->Port);
 		pCommObj->SetUserContext(Handle);
+		if (pServer->m_CommandBudgetParams.Enabled)
+			pCommObj->GetCommandBuilder()->SetBudget(std::make_unique<MCommandBudget>(
+				pServer->m_CommandBudgetParams, pServer->m_CommandBudgetStats));
 
 		pServer->OnAccept(pCommObj);
 			
@@ -94,6 +94,33 @@ void MAddSharedCommandTable(MCommandManager* CommandManager, MSharedCommandType:
 	C(MC_MATCH_RESPONSE_SPEC, "", "", MCDT_MACHINE2MACHINE);
 		P(MPT_UID, "Target player");
 		P(MPT_UINT, "Team");
+	// Like MC_MATCH_P2P_COMMAND, but sent over UDP for the game state that doesn't need to be
+	// reliable (basic info and shots). The sequence number increases for every packet a client
+	// sends, and for every packet the server relays from a player, so that receivers can drop
+	// packets that arrive late.
+	C(MC_MATCH_P2P_COMMAND_UDP, "Match.P2PCommandUDP", "Forwards Peer to Peer commands over UDP",
+		MCDT_MACHINE2MACHINE | MCCT_NON_ENCRYPTED);
+		// Client -> Server = Receiver
+		// Server -> Client = Sender
+		P(MPT_UID, "Sender/Receiver");
+		P(MPT_UINT, "Sequence");
+		P(MPT_BLOB, "Data");
+		// The client's MC_MATCH_UDP_SESSION_KEY, both ways.
+		P(MPT_UINT64, "Key");
+	// The basic info of all the other players in the battle, delta-encoded against the last
+	// snapshot the client acknowledged. See BasicInfoSnapshot.h.
+	C(MC_MATCH_BASICINFO_SNAPSHOT, "Match.BasicInfoSnapshot", "Basic info snapshot",
+		MCDT_MACHINE2MACHINE | MCCT_NON_ENCRYPTED);
+		P(MPT_BLOB, "Snapshot");
+	// Acknowledges a snapshot, so that the following ones can be encoded against it.
+	// 0 asks the server to start sending snapshots from scratch.
+	C(MC_MATCH_BASICINFO_SNAPSHOT_ACK, "Match.BasicInfoSnapshotAck", "Basic info snapshot ack",
+		MCDT_MACHINE2MACHINE);
+		P(MPT_UINT, "SnapshotID");
+	// Sent over TCP after login. The client includes the key in MC_MATCH_BRIDGEPEER and
+	// MC_MATCH_P2P_COMMAND_UDP, which ties the UDP address to the TCP session.
+	C(MC_MATCH_UDP_SESSION_KEY, "Match.UDPSessionKey", "UDP session key", MCDT_MACHINE2MACHINE);
+		P(MPT_UINT64, "Key");
 
 
 	// Freestyle Gunz commands
@@ -207,6 +234,7 @@ void MAddSharedCommandTable(MCommandManager* CommandManager, MSharedCommandType:
 			P(MPT_UID, "uidPlayer");
 			P(MPT_UINT, "dwIP");
 			P(MPT_UINT, "nPort");
+			P(MPT_UINT64, "Key");
 		C(MC_MATCH_BRIDGEPEER_ACK, "Match.BridgePeerACK", "ACK for BridgePeer", MCDT_MACHINE2MACHINE);
 			P(MPT_UID, "uidPlayer");
 			P(MPT_INT, "nCode");
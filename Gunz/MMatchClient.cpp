@@ -273,6 +273,56 @@ bool MMatchClient::OnCommand(MCommand* pCommand)
 		if (pCmd->GetID() != MC_PEER_BASICINFO_RG)
 			DMLog("Received tunnelled P2P command ID %x\n", pCmd->GetID());
 	}
+	break;
+	case MC_MATCH_P2P_COMMAND_UDP:
+	{
+		// Only the server relays these, and the sender UID it carries is trusted below.
+		if (pCommand->GetSenderUID() != GetServerUID()) break;
+
+		MUID Sender;
+		u32 Sequence;
+		if (!pCommand->GetParameter(&Sender, 0, MPT_UID)) break;
+		if (!pCommand->GetParameter(&Sequence, 1, MPT_UINT)) break;
+		MCommandParameter* pParam = pCommand->GetParameter(2);
+		if (!pParam || pParam->GetType() != MPT_BLOB) break;
+		u64 Key;
+		if (!pCommand->GetParameter(&Key, 3, MPT_UINT64) || Key != UDPSessionKey) break;
+		void* Blob = pParam->GetPointer();
+		auto Size = ((MCmdParamBlob*)pParam)->GetPayloadSize();
+
+		MCommand* pCmd = MakeCmdFromSaneTunnelingBlob(Sender, m_This, Blob, Size);
+		if (pCmd == nullptr) break;
+
+		// Drop basic info that's older than what we already have, and shots we've already seen.
+		auto& Windows = UDPGameStateReceived[Sender];
+		auto Accepted = pCmd->GetID() == MC_PEER_SHOT ?
+			Windows.Shot.AcceptUnique(Sequence) :
+			Windows.BasicInfo.AcceptLatest(Sequence);
+		if (!Accepted)
+		{
+			delete pCmd;
+			break;
+		}
+
+		LockRecv();
+		m_CommandManager.Post(pCmd);
+		UnlockRecv();
+	}
+	break;
+	case MC_MATCH_UDP_SESSION_KEY:
+	{
+		if (pCommand->GetSenderUID() != GetServerUID()) break;
+		pCommand->GetParameter(&UDPSessionKey, 0, MPT_UINT64);
+	}
+	break;
+	case MC_MATCH_BASICINFO_SNAPSHOT:
+	{
+		if (pCommand->GetSenderUID() != GetServerUID()) break;
+
+		MCommandParameter* pParam = pCommand->GetParameter(0);
+		if (!pParam || pParam->GetType() != MPT_BLOB) break;
+		OnBasicInfoSnapshot(pParam->GetPointer(), ((MCmdParamBlob*)pParam)->GetPayloadSize());
+	}
 	break;
 		case MC_MATCH_RESPONSE_LOGIN:
 			{
@@ -505,6 +555,7 @@ void MMatchClient::CastStageBridgePeer(const MUID& uidChar, const MUID& uidStage
 	pCmd->AddParameter(new MCommandParameterUID(uidChar));
 	pCmd->AddParameter(new MCommandParameterUInt(0)); // IP
 	pCmd->AddParameter(new MCommandParameterUInt(0)); // Port
+	pCmd->AddParameter(new MCommandParameterUInt64(UDPSessionKey));
 	
 	SendCommandByUDP(pCmd, GetServerIP(), GetServerPeerPort());
 
@@ -680,7 +731,12 @@ void MMatchClient::SendCommand(MCommand* pCommand)
 		} else {
 			if (!PeerToPeer)
 			{
-				SendCommandByMatchServerTunneling(pCommand);
+				auto ID = pCommand->GetID();
+				if (pCommand->GetReceiverUID() == MUID(0, 0) &&
+					(ID == MC_PEER_BASICINFO || ID == MC_PEER_BASICINFO_RG || ID == MC_PEER_SHOT))
+					SendCommandByMatchServerUDP(pCommand);
+				else
+					SendCommandByMatchServerTunneling(pCommand);
 			}
 			else
 			{
@@ -877,6 +933,75 @@ void MMatchClient::SendCommandByMatchServerTunneling(MCommand* pCommand)
 	SendCommandByMatchServerTunneling(pCommand, pCommand->GetReceiverUID());
 }
 
+void MMatchClient::SendCommandByMatchServerUDP(MCommand* pCommand)
+{
+	MCommand* pCmd = CreateCommand(MC_MATCH_P2P_COMMAND_UDP, GetServerUID());
+	pCmd->AddParameter(new MCmdParamUID(pCommand->GetReceiverUID()));
+	pCmd->AddParameter(new MCmdParamUInt(++UDPGameStateSequence));
+
+	if (!MakeSaneTunnelingCommandBlob(pCmd, pCommand))
+	{
+		delete pCmd; pCmd = NULL; return;
+	}
+	pCmd->AddParameter(new MCmdParamUInt64(UDPSessionKey));
+
+	SendCommandByUDP(pCmd, GetServerIP(), GetServerPeerPort());
+	delete pCmd;
+}
+
+void MMatchClient::RequestBasicInfoSnapshots()
+{
+	ReceivedSnapshots.Clear();
+	SnapshotBasicInfoTimes.clear();
+
+	auto* pCmd = CreateCommand(MC_MATCH_BASICINFO_SNAPSHOT_ACK, GetServerUID());
+	pCmd->AddParameter(new MCmdParamUInt(0));
+	Post(pCmd);
+}
+
+void MMatchClient::OnBasicInfoSnapshot(const void* Data, size_t Size)
+{
+	MBitReader Reader{Data, Size};
+	BasicInfoSnapshot Snapshot;
+	std::vector<size_t> Changed;
+	if (!DecodeBasicInfoSnapshot(Reader, ReceivedSnapshots, Snapshot, &Changed))
+		return;
+
+	// The players' basic info is handed to the game as if it had been relayed from each of them.
+	for (auto Index : Changed)
+	{
+		auto&& Entry = Snapshot.Entries[Index];
+
+		auto it = SnapshotBasicInfoTimes.find(Entry.UID);
+		if (it != SnapshotBasicInfoTimes.end() && !IsNewerSequence(u32(Entry.State.Time), u32(it->second)))
+			continue;
+		SnapshotBasicInfoTimes[Entry.UID] = Entry.State.Time;
+
+		CharacterInfo Info;
+		float Time;
+		DequantizeBasicInfo(Entry.State, Info, Time);
+
+		BasicInfoNetState ThrowawayState;
+		auto Blob = PackNewBasicInfo(Info, ThrowawayState, Time);
+		if (!Blob)
+			continue;
+
+		auto* pCmd = CreateCommand(MC_PEER_BASICINFO_RG, m_This);
+		pCmd->SetSenderUID(Entry.UID);
+		pCmd->AddParameter(Blob);
+
+		LockRecv();
+		m_CommandManager.Post(pCmd);
+		UnlockRecv();
+	}
+
+	auto* pAck = CreateCommand(MC_MATCH_BASICINFO_SNAPSHOT_ACK, GetServerUID());
+	pAck->AddParameter(new MCmdParamUInt(Snapshot.ID));
+	Post(pAck);
+
+	ReceivedSnapshots.Add(std::move(Snapshot));
+}
+
 bool MMatchClient::UDPSocketRecvEvent(u32 dwIP, WORD wRawPort, char* pPacket, u32 dwSize)
 {
 	if (GetMainMatchClient() == NULL) return false;
@@ -1038,6 +1163,11 @@ void MMatchClient::ParseUDPPacket(char* pData, MPacketHeader* pPacketHeader, u32
 					{
 						pCmd->m_Sender = GetAgentServerUID();
 					}
+					else if ((pCmd->GetID() == MC_MATCH_P2P_COMMAND_UDP ||
+						pCmd->GetID() == MC_MATCH_BASICINFO_SNAPSHOT) && IP == GetServerIP())
+					{
+						pCmd->m_Sender = GetServerUID();
+					}
 					else if( (MC_RESPONSE_SERVER_LIST_INFO == pCmd->GetID()) ||
 						(MC_RESPONSE_BLOCK_COUNTRY_CODE_IP == pCmd->GetID()) )
 					{
@@ -11,6 +11,8 @@
 #include "MMatchGlobal.h"
 #include "MPacketCrypter.h"
 #include "MTCPSocket.h"
+#include "MSequenceWindow.h"
+#include "BasicInfoSnapshot.h"
 
 #define MATCHCLIENT_DEFAULT_UDP_PORT	10000
 #define MAX_PING						999
@@ -153,6 +155,32 @@ protected:
 
 	bool PeerToPeer = true;
 
+	// Sequence number of the last packet sent on the UDP game state channel.
+	u32 UDPGameStateSequence = 0;
+	// Sent by the server at login. Ties our UDP packets to the TCP session.
+	u64 UDPSessionKey = 0;
+	struct UDPGameStateWindows
+	{
+		MSequenceWindow BasicInfo;
+		MSequenceWindow Shot;
+	};
+	// The sequence numbers of the packets the server has relayed from each player over UDP.
+	std::unordered_map<MUID, UDPGameStateWindows> UDPGameStateReceived;
+
+	// The basic info snapshots received from the server, which the following ones are encoded
+	// against.
+	BasicInfoSnapshotHistory ReceivedSnapshots;
+	// The time of the newest basic info applied from a snapshot for each player, since snapshots
+	// can arrive out of order.
+	std::unordered_map<MUID, i32> SnapshotBasicInfoTimes;
+
+	void OnBasicInfoSnapshot(const void* Data, size_t Size);
+
+public:
+	// Asks the server to send the other players' basic info as snapshots, starting from scratch.
+	void RequestBasicInfoSnapshots();
+protected:
+
 public:
 	MCommand* MakeCmdFromTunnelingBlob(const MUID& uidSender, void* pBlob, int nBlobArrayCount);
 	bool MakeTunnelingCommandBlob(MCommand* pWrappingCmd, MCommand* pSrcCmd);
@@ -204,6 +232,9 @@ protected:
 	void SendCommandByTunneling(MCommand* pCommand);
 	void SendCommandByMatchServerTunneling(MCommand* pCommand, const MUID& Receiver);
 	void SendCommandByMatchServerTunneling(MCommand* pCommand);
+	// Sends basic info and shots to the server over UDP instead of TCP, where a lost packet
+	// doesn't hold up the ones after it.
+	void SendCommandByMatchServerUDP(MCommand* pCommand);
 	void ParseUDPPacket(char* pData,MPacketHeader* pPacketHeader,u32 dwIP,unsigned int nPort);
 public:
 	void SendCommandByUDP(MCommand* pCommand, const char* szIP, int nPort);
@@ -72,7 +72,7 @@ bool ZConfiguration::Load()
 	bool retValue;
 
 #if defined(_PUBLISH) && defined(ONLY_LOAD_MRS_FILES)
-   		MZFile::SetReadMode( MZIPREADFLAG_ZIP | MZIPREADFLAG_MRS | MZIPREADFLAG_MRS2 | MZIPREADFLAG_FILE );
+   		MZFile::SetReadMode( MZIPREADFLAG_ZIP | MZIPREADFLAG_MRS | MZIPREADFLAG_MRS2 | MZIPREADFLAG_MRS3 | MZIPREADFLAG_FILE );
 #endif
 
 	if ( !LoadLocale(FILENAME_LOCALE) )
@@ -90,7 +90,7 @@ bool ZConfiguration::Load()
 	retValue = LoadConfig(FILENAME_CONFIG);
 
 #if defined(_PUBLISH) && defined(ONLY_LOAD_MRS_FILES)
-		MZFile::SetReadMode( MZIPREADFLAG_MRS2 );
+		MZFile::SetReadMode( MZIPREADFLAG_MRS2 | MZIPREADFLAG_MRS3 );
 #endif
 
 	if (!LoadSystem(FILENAME_SYSTEM))
@@ -55,7 +55,7 @@ bool ZEmblemInterface::ReloadClanInfo(UINT nClanID)
 	SAFE_DELETE(EmblemNode.m_pBitmapEmblem);
 
 #if defined(_PUBLISH) && defined(ONLY_LOAD_MRS_FILES)
-	MZFile::SetReadMode( MZIPREADFLAG_ZIP | MZIPREADFLAG_MRS | MZIPREADFLAG_MRS2 | MZIPREADFLAG_FILE );
+	MZFile::SetReadMode( MZIPREADFLAG_ZIP | MZIPREADFLAG_MRS | MZIPREADFLAG_MRS2 | MZIPREADFLAG_MRS3 | MZIPREADFLAG_FILE );
 #endif
 
 	MBitmapR2 *pBitmap = new MBitmapR2;
@@ -63,7 +63,7 @@ bool ZEmblemInterface::ReloadClanInfo(UINT nClanID)
 	EmblemNode.m_pBitmapEmblem = pBitmap;
 
 #if defined(_PUBLISH) && defined(ONLY_LOAD_MRS_FILES)
-	MZFile::SetReadMode( MZIPREADFLAG_MRS2 );
+	MZFile::SetReadMode( MZIPREADFLAG_MRS2 | MZIPREADFLAG_MRS3 );
 #endif
 
 	return true;
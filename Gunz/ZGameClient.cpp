@@ -433,7 +433,10 @@ void ZGameClient::OnStageEnterBattle(const MUID& uidChar, MCmdEnterBattleParam n
 	if (uidChar == GetPlayerUID())
 	{
 		if (GetMatchStageSetting()->GetNetcode() == NetcodeType::ServerBased)
+		{
 			PeerToPeer = false;
+			RequestBasicInfoSnapshots();
+		}
 		else
 			PeerToPeer = true;
 
@@ -104,7 +104,7 @@ static StringView GetAliasName(const StringView& Path, bool AddDir)
 static void AddBitmap(const StringView& Path, bool AddDirToAliasName)
 {
 #if defined(_PUBLISH) && defined(ONLY_LOAD_MRS_FILES)
-	MZFile::SetReadMode(MZIPREADFLAG_ZIP | MZIPREADFLAG_MRS | MZIPREADFLAG_MRS2 | MZIPREADFLAG_FILE);
+	MZFile::SetReadMode(MZIPREADFLAG_ZIP | MZIPREADFLAG_MRS | MZIPREADFLAG_MRS2 | MZIPREADFLAG_MRS3 | MZIPREADFLAG_FILE);
 #endif
 
 	auto MBitmapR2Create = MBeginProfile("ZGameInterface::LoadBitmaps - MBitmapR2::Create");
@@ -118,7 +118,7 @@ static void AddBitmap(const StringView& Path, bool AddDirToAliasName)
 	MEndProfile(MBitmapR2Create);
 
 #if defined(_PUBLISH) && defined(ONLY_LOAD_MRS_FILES)
-	MZFile::SetReadMode(MZIPREADFLAG_MRS2);
+	MZFile::SetReadMode(MZIPREADFLAG_MRS2 | MZIPREADFLAG_MRS3);
 #endif
 }
 
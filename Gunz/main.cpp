@@ -678,7 +678,7 @@ int PASCAL GunzMain(HINSTANCE this_inst, HINSTANCE prev_inst, LPSTR cmdline, int
 	g_App.InitFileSystem();
 
 #if defined(_PUBLISH) && defined(ONLY_LOAD_MRS_FILES)
-	MZFile::SetReadMode( MZIPREADFLAG_MRS2 );
+	MZFile::SetReadMode( MZIPREADFLAG_MRS2 | MZIPREADFLAG_MRS3 );
 #endif
 
 	CreateRGMain();
@@ -2,6 +2,7 @@
 #include "MCountryCodeFilter.h"
 #include "MDebug.h"
 #include <algorithm>
+#include <numeric>
 #include "MTime.h"
 #include "MSocket.h"
 
@@ -29,28 +30,154 @@ bool MCountryCodeFilter::Create( const BlockCountryCodeInfoList& rfBlockCountryC
 }
 
 
-bool MCountryCodeFilter::AddIPtoCountry( const u32 dwIPFrom, const u32 dwIPTo, const string& strCode )
+static u32 PackCountryCode( const string& strCode )
+{
+	u32 nPacked = 0;
+	for( size_t i = 0; i < strCode.length(); ++i )
+		nPacked |= static_cast< u32 >( static_cast< unsigned char >(strCode[i]) ) << (i * 8);
+	return nPacked;
+}
+
+
+bool IPtoCountryIndex::InternCountryCode( const string& strCode, u16& nOutCodeIndex )
 {
-	if( CheckIsInverseRange(dwIPFrom, dwIPTo) )
+	if( 3 < strCode.length() )
 		return false;
 
-	if( CheckIsDuplicatedRange(dwIPFrom, dwIPTo, m_IPtoCountryList) )
+	const u32 nPacked = PackCountryCode( strCode );
+	auto itFind = m_CodeIndexMap.find( nPacked );
+	if( m_CodeIndexMap.end() != itFind )
+	{
+		nOutCodeIndex = itFind->second;
+		return true;
+	}
+
+	if( 0xFFFF <= m_Codes.size() )
 		return false;
 
-	IPtoCountry ipc;
+	CountryCode3 Code{};
+	memcpy( Code.szCode, strCode.data(), strCode.length() );
+
+	nOutCodeIndex = static_cast< u16 >( m_Codes.size() );
+	m_Codes.push_back( Code );
+	m_CodeIndexMap.emplace( nPacked, nOutCodeIndex );
+	return true;
+}
 
-	ipc.nIPFrom			= dwIPFrom;
-	ipc.nIPTo			= dwIPTo;
-	ipc.strCountryCode3 = strCode; 
 
-	m_IPtoCountryList.push_back( ipc );
+bool IPtoCountryIndex::Build( const IPtoCountryList& rfIPtoCountryList )
+{
+	clear();
 
-	sort( m_IPtoCountryList.begin(), m_IPtoCountryList.end(), SortCmp() );
+	// Sort indices instead of the entries, so that the strings aren't copied around.
+	vector< u32 > Order( rfIPtoCountryList.size() );
+	std::iota( Order.begin(), Order.end(), 0 );
+	std::sort( Order.begin(), Order.end(), [&]( u32 a, u32 b ) {
+		return rfIPtoCountryList[ a ].nIPFrom < rfIPtoCountryList[ b ].nIPFrom;
+	} );
+
+	m_IPFrom.reserve( Order.size() );
+	m_IPTo.reserve( Order.size() );
+	m_CodeIndex.reserve( Order.size() );
+
+	for( auto i : Order )
+	{
+		const IPtoCountry& ipc = rfIPtoCountryList[ i ];
+
+		// Sorted by the first IP, so a range can only overlap the one before it.
+		u16 nCodeIndex;
+		if( (ipc.nIPFrom > ipc.nIPTo) ||
+			(!m_IPTo.empty() && (m_IPTo.back() >= ipc.nIPFrom)) ||
+			!InternCountryCode(ipc.strCountryCode3, nCodeIndex) )
+		{
+			mlog( "IPtoCountryIndex::Build - invalid range. IPFrom:%u, IPTo:%u, Code:%s\n",
+				ipc.nIPFrom, ipc.nIPTo, ipc.strCountryCode3.c_str() );
+			clear();
+			return false;
+		}
+
+		m_IPFrom.push_back( ipc.nIPFrom );
+		m_IPTo.push_back( ipc.nIPTo );
+		m_CodeIndex.push_back( nCodeIndex );
+	}
 
 	return true;
 }
 
 
+bool IPtoCountryIndex::Insert( const u32 dwIPFrom, const u32 dwIPTo, const string& strCode )
+{
+	if( dwIPFrom > dwIPTo )
+		return false;
+
+	const auto nPos = std::upper_bound( m_IPFrom.begin(), m_IPFrom.end(), dwIPFrom ) - m_IPFrom.begin();
+	if( (0 < nPos) && (m_IPTo[ nPos - 1 ] >= dwIPFrom) )
+		return false;
+	if( (m_IPFrom.size() > static_cast<size_t>(nPos)) && (m_IPFrom[ nPos ] <= dwIPTo) )
+		return false;
+
+	u16 nCodeIndex;
+	if( !InternCountryCode(strCode, nCodeIndex) )
+		return false;
+
+	m_IPFrom.insert( m_IPFrom.begin() + nPos, dwIPFrom );
+	m_IPTo.insert( m_IPTo.begin() + nPos, dwIPTo );
+	m_CodeIndex.insert( m_CodeIndex.begin() + nPos, nCodeIndex );
+
+	return true;
+}
+
+
+int IPtoCountryIndex::Find( const u32 dwIP ) const
+{
+	const auto it = std::upper_bound( m_IPFrom.begin(), m_IPFrom.end(), dwIP );
+	if( m_IPFrom.begin() == it )
+		return -1;
+
+	const auto nIndex = static_cast< int >( it - m_IPFrom.begin() ) - 1;
+	if( m_IPTo[ nIndex ] < dwIP )
+		return -1;
+
+	return nIndex;
+}
+
+
+string IPtoCountryIndex::GetCountryCode( const int nIndex ) const
+{
+	const CountryCode3& Code = m_Codes[ m_CodeIndex[ nIndex ] ];
+	size_t nLength = 0;
+	while( (sizeof(Code.szCode) > nLength) && (0 != Code.szCode[ nLength ]) )
+		++nLength;
+	return string( Code.szCode, nLength );
+}
+
+
+void IPtoCountryIndex::clear()
+{
+	m_IPFrom.clear();
+	m_IPTo.clear();
+	m_CodeIndex.clear();
+	m_Codes.clear();
+	m_CodeIndexMap.clear();
+}
+
+
+void IPtoCountryIndex::swap( IPtoCountryIndex& rfOther )
+{
+	m_IPFrom.swap( rfOther.m_IPFrom );
+	m_IPTo.swap( rfOther.m_IPTo );
+	m_CodeIndex.swap( rfOther.m_CodeIndex );
+	m_Codes.swap( rfOther.m_Codes );
+	m_CodeIndexMap.swap( rfOther.m_CodeIndexMap );
+}
+
+
+bool MCountryCodeFilter::AddIPtoCountry( const u32 dwIPFrom, const u32 dwIPTo, const string& strCode )
+{
+	return m_IPtoCountryIndex.Insert( dwIPFrom, dwIPTo, strCode );
+}
+
+
 bool MCountryCodeFilter::InitContryCodeTableList( const BlockCountryCodeInfoList& rfBlockCountryCodeInfoList )
 {
 	if( rfBlockCountryCodeInfoList.empty() ) return false;
@@ -116,20 +243,10 @@ bool MCountryCodeFilter::InitIPtoCountryList( const IPtoCountryList& rfIPtoCount
 	if( rfIPtoCountryList.empty() )
 		return false;
 
-	m_IPtoCountryList.clear();
-
-	IPtoCountryList::const_iterator it, end;
-
-	end = rfIPtoCountryList.end();
-	for( it = rfIPtoCountryList.begin(); it != end; ++it )
+	if( !m_IPtoCountryIndex.Build(rfIPtoCountryList) )
 	{
-		if( !CheckIPtoCountryRange(it->nIPFrom, it->nIPTo, m_IPtoCountryList) )
-		{
-			ASSERT( 0 && "ߺǴ  .\n" );
-			return false;
-		}
-
-		m_IPtoCountryList.push_back( (*it) );
+		ASSERT( 0 && "MCountryCodeFilter::InitIPtoCountryList - overlapping ranges" );
+		return false;
 	}
 
 	return true;
@@ -150,51 +267,10 @@ const int MCountryCodeFilter::GetIPCountryCode( const string& strIP, string& str
 	if( 0 == dwIP )
 		return false;
 
-	m_IPCountryCodeSearch.SetIP( dwIP );
-	const int idx = m_IPCountryCodeSearch.BinarySearch( m_IPtoCountryList );
+	const int idx = m_IPtoCountryIndex.Find( dwIP );
 	if( -1 != idx )
-		strOutCountryCode = m_IPtoCountryList[ idx ].strCountryCode3;
+		strOutCountryCode = m_IPtoCountryIndex.GetCountryCode( idx );
 	return idx;
-/*
-	size_t nHead = 0;
-	size_t nTail = m_IPtoCountryList.size() - 1;
-	size_t nMiddle = nTail / 2;
-
-	u32 dwIPFrom;
-	u32 dwIPTo;
-
-	while( true )
-	{
-		dwIPFrom = m_IPtoCountryList[ nMiddle ].nIPFrom;
-		dwIPTo   = m_IPtoCountryList[ nMiddle ].nIPTo;
-
-		if( dwIPFrom <= dwIP && dwIPTo >= dwIP )
-		{
-			strOutCountryCode = m_IPtoCountryList[ nMiddle ].strCountryCode3;
-#ifdef _LOCATOR_TEST
-			if( -1 == idx ) 
-				mlog( " Ʋ...(%u)\n", dwIP );
-#endif
-			return true;
-		}
-		else if( (0 == nMiddle) || (nHead == nTail) || (nHead > nTail) )
-		{
-			break;;
-		}
-		else if( dwIPFrom < dwIP )
-		{
-			nHead = nMiddle + 1;
-			nMiddle = (nHead + nTail) / 2;
-		}
-		else if( dwIPFrom > dwIP )
-		{
-			nTail = nMiddle - 1;
-			nMiddle = (nHead + nTail) / 2;
-		}
-	}
-
-	return false;
-	*/
 }
 
 
@@ -216,66 +292,6 @@ const int MCountryCodeFilter::GetCustomIP( const string& strIP, string& strOutCo
 }
 
 
-bool MCountryCodeFilter::CheckIPtoCountryRange( const u32 dwIPFrom, const u32 dwIPTo, const IPtoCountryList& icl )
-{
-	if( CheckIsInverseRange(dwIPFrom, dwIPTo) )
-		return false;
-
-	if( !CheckIsLast(dwIPFrom, dwIPTo, icl) )
-		return false;
-
-	if( CheckIsDuplicatedRange(dwIPFrom, dwIPTo, icl) )
-		return false;
-	
-	return true;
-}
-
-
-bool MCountryCodeFilter::CheckIsInverseRange( const u32 dwIPFrom, const u32 dwIPTo )
-{
-	return (dwIPFrom > dwIPTo) ;
-}
-
-
-bool MCountryCodeFilter::CheckIsLast( const u32 dwIPFrom, const u32 dwIPTo, const IPtoCountryList& icl )
-{
-	if( !icl.empty() )
-	{
-		size_t idx = icl.size();
-		IPtoCountry itc = icl[ idx - 1 ];
-		if( itc.nIPTo >= dwIPFrom )
-			return false;
-	}
-
-	return true;
-}
-
-
-bool MCountryCodeFilter::CheckIsDuplicatedRange( const u32 dwIPFrom, const u32 dwIPTo, const IPtoCountryList& icl )
-{
-	IPtoCountryList::const_iterator it, end;
-	end = icl.end();
-	for( it = icl.begin(); it != end; ++it )
-	{
-		if( it->nIPFrom <= dwIPFrom )
-		{
-			if( it->nIPFrom <= dwIPFrom && it->nIPTo >= dwIPFrom )
-				return true;
-			break;
-		}
-
-		if( it->nIPTo >= dwIPTo )
-		{
-			if( it->nIPFrom <= dwIPTo && it->nIPTo >= dwIPTo )
-				return true;
-			break;
-		}
-	}
-
-	return false;
-}
-
-
 bool MCountryCodeFilter::Update( const BlockCountryCodeInfoList& rfBlockCountryCodeInfoList, 
 								const IPtoCountryList& rfIPtoCountryList )
 {
@@ -331,34 +347,17 @@ bool MCountryCodeFilter::UpdateCountryCodeTableList( const BlockCountryCodeInfoL
 
 bool MCountryCodeFilter::UpdateIPtoCountryList( const IPtoCountryList& rfIPtoCountryList )
 {
-	IPtoCountryList icl;
-
-	try
-	{
-		if( rfIPtoCountryList.empty() )
-			return false;
-
-		IPtoCountryList::const_iterator it, end;
-
-		end = rfIPtoCountryList.end();
-		for( it = rfIPtoCountryList.begin(); it != end; ++it )
-		{
-			if( !CheckIPtoCountryRange(it->nIPFrom, it->nIPTo, icl) )
-			{
-				ASSERT( 0 && "ߺǴ  .\n" );
-				return false;
-			}
+	if( rfIPtoCountryList.empty() )
+		return false;
 
-			icl.push_back( (*it) );
-		}
-	}
-	catch( ... )
+	IPtoCountryIndex Index;
+	if( !Index.Build(rfIPtoCountryList) )
 	{
+		ASSERT( 0 && "MCountryCodeFilter::UpdateIPtoCountryList - overlapping ranges" );
 		return false;
 	}
 
-	m_IPtoCountryList.swap( icl );
-	icl.clear();
+	m_IPtoCountryIndex.swap( Index );
 	return true;
 }
 
@@ -435,16 +434,13 @@ void MCountryCodeFilter::TestAddIPtoCountry( const IPtoCountryList& rfIPtoCountr
 
 bool MCountryCodeFilter::FindEqual( const u32 dwIPFrom, const u32 dwIPTo, const string& strCode )
 {
-	IPtoCountryList::iterator it, end;
-
-	end = m_IPtoCountryList.end();
-	for( it = m_IPtoCountryList.begin(); it != end; ++it )
-	{
-		if( (dwIPFrom == it->nIPFrom ) && (dwIPTo == it->nIPTo) && (strCode == it->strCountryCode3) )
-			return true;
-	}
+	const int idx = m_IPtoCountryIndex.Find( dwIPFrom );
+	if( -1 == idx )
+		return false;
 
-	return false;
+	return (dwIPFrom == m_IPtoCountryIndex.GetIPFrom(idx)) &&
+		(dwIPTo == m_IPtoCountryIndex.GetIPTo(idx)) &&
+		(strCode == m_IPtoCountryIndex.GetCountryCode(idx));
 }
 #endif
 
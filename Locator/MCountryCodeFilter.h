@@ -9,6 +9,7 @@
 
 #include <map>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <utility>
 
@@ -63,13 +64,46 @@ private :
 	string m_strSrc;
 };
 
-class SortCmp
+// A country code without a terminator, padded with zeros if it's shorter than three characters.
+struct CountryCode3
+{
+	char szCode[ 3 ];
+};
+
+// Maps IPs to the country of the range they're in.
+//
+// The ranges are sorted by their first IP and split into flat arrays, and the country codes are
+// interned, so that a lookup is a binary search over an array of u32s and two more loads.
+class IPtoCountryIndex
 {
 public :
-	bool operator () ( const IPtoCountry& ipc1, const IPtoCountry& ipc2 )
-	{
-		return ipc1.nIPFrom > ipc2.nIPFrom;
-	}
+	// Sorts the ranges once and checks them for inverted and overlapping ranges in a single pass.
+	// Leaves the index empty if any are found.
+	bool Build( const IPtoCountryList& rfIPtoCountryList );
+	// Inserts one range where it belongs. Fails if it's inverted or overlaps another range.
+	bool Insert( const u32 dwIPFrom, const u32 dwIPTo, const string& strCode );
+
+	// Returns the index of the range dwIP is in, or -1 if there is none.
+	int Find( const u32 dwIP ) const;
+
+	u32 GetIPFrom( const int nIndex ) const	{ return m_IPFrom[ nIndex ]; }
+	u32 GetIPTo( const int nIndex ) const	{ return m_IPTo[ nIndex ]; }
+	string GetCountryCode( const int nIndex ) const;
+
+	size_t size() const	{ return m_IPFrom.size(); }
+	bool empty() const	{ return m_IPFrom.empty(); }
+	void clear();
+	void swap( IPtoCountryIndex& rfOther );
+
+private :
+	bool InternCountryCode( const string& strCode, u16& nOutCodeIndex );
+
+	vector< u32 >			m_IPFrom;
+	vector< u32 >			m_IPTo;
+	vector< u16 >			m_CodeIndex;
+	vector< CountryCode3 >	m_Codes;
+	// Maps the codes packed into a u32 to their index in m_Codes.
+	std::unordered_map< u32, u16 >	m_CodeIndexMap;
 };
 
 #ifdef _FILTER_TEST
@@ -206,10 +240,6 @@ private :
 	bool InitContryCodeTableList( const BlockCountryCodeInfoList& rfBlockCountryCodeInfoList );
 	bool InitIPtoCountryList( const IPtoCountryList& rfIPtoCountryList );
 
-	bool CheckIPtoCountryRange( const u32 dwIPFrom, const u32 dwIPTo, const IPtoCountryList& icl );
-	bool CheckIsLast( const u32 dwIPFrom, const u32 dwIPTo, const IPtoCountryList& icl );
-	bool CheckIsDuplicatedRange( const u32 dwIPFrom, const u32 dwIPTo, const IPtoCountryList& icl );
-	bool CheckIsInverseRange( const u32 dwIPFrom, const u32 dwIPTo );
 	bool IsValidContryCode( const string& strCountryCode, string& strOutRoutingURL,
 		BlockCountryCodeInfoList& bcil );
 
@@ -228,12 +258,11 @@ public :
 
 private :
     BlockCountryCodeInfoList	m_BlockCountryCodeInfoList;
-	IPtoCountryList				m_IPtoCountryList;
+	IPtoCountryIndex			m_IPtoCountryIndex;
 	CustomIPList				m_CustomIPList;
 
 	u64 m_dwLastUpdatedTime;
 
-	IPRangeBinarySearch< IPtoCountryList >	m_IPCountryCodeSearch;
 	IPRangeBinarySearch< CustomIPList >			m_CustomIPSearch;
 };
 
@@ -9,7 +9,7 @@
 #include "MSharedCommandTable.h"
 #include "MBlobArray.h"
 #include "MLocatorConfig.h"
-#include "MLocatorUDP.h"
+#include "MLocatorRateLimiter.h"
 #include "MCommandCommunicator.h"
 #include "MErrorTable.h"
 #include "MCommandBuilder.h"
@@ -36,7 +36,7 @@ MLocator::MLocator()
 {
 	auto time = GetGlobalTimeMS();
 	m_dwLastServerStatusUpdatedTime = time;
-	m_dwLastUDPManagerUpdateTime = time;
+	m_dwLastRateLimiterUpdateTime = time;
 	m_dwLastLocatorStatusUpdatedTime = time;
 
 	m_This = GetLocatorConfig()->GetLocatorUID();
@@ -76,9 +76,9 @@ bool MLocator::Create()
 		return false;
 	}
 
-	if( !InitUDPManager() )
+	if( !InitRateLimiter() )
 	{
-		mlog( "MLocator::Create - UDP Manager  ʱȭ .\n" );
+		mlog( "MLocator::Create - RateLimiter  ʱȭ .\n" );
 		return false;
 	}
 
@@ -96,10 +96,6 @@ bool MLocator::Create()
 		return false;
 	}
 
-#ifdef _DEBUG
-	InitDebug();
-#endif
-
 	return true;
 }
 
@@ -175,30 +171,11 @@ bool MLocator::InitServerStatusMgr()
 	return false;
 }
 
-bool MLocator::InitUDPManager()
+bool MLocator::InitRateLimiter()
 {
-	bool bRet = true;
-	m_pRecvUDPManager = new MUDPManager;
-	if( (0 == m_pRecvUDPManager) && (bRet) ) bRet = false;
-	m_pSendUDPManager = new MUDPManager;
-	if( (0 == m_pSendUDPManager) && (bRet) ) bRet = false;
-	m_pBlockUDPManager = new MUDPManager;
-	if( (0 == m_pBlockUDPManager) && (bRet) ) bRet = false;
-
-	if( !bRet )
-	{
-		delete m_pRecvUDPManager;
-		delete m_pSendUDPManager;
-		delete m_pBlockUDPManager;
-
-		m_pRecvUDPManager = 0;
-		m_pSendUDPManager = 0;
-		m_pBlockUDPManager = 0;
-
-		return false;
-	}
-
-	InitMemPool( MLocatorUDPInfo );
+	m_pRateLimiter = std::make_unique<MLocatorRateLimiter>( GetLocatorConfig()->GetRequestRate(),
+		GetLocatorConfig()->GetRequestBurst(),
+		GetLocatorConfig()->GetBlockTime() );
 
 	return true;
 }
@@ -209,7 +186,7 @@ void MLocator::Destroy()
 	ReleaseDBMgr();
 #endif
 	ReleaseSafeUDP();
-	ReleaseUDPManager();
+	ReleaseRateLimiter();
 	ReleaseServerStatusMgr();
 	ReleaseServerStatusInfoBlob();
 }
@@ -259,32 +236,9 @@ void MLocator::ReleaseServerStatusInfoBlob()
 }
 
 
-void MLocator::ReleaseUDPManager()
+void MLocator::ReleaseRateLimiter()
 {
-	if( 0 != m_pRecvUDPManager )
-	{
-		m_pRecvUDPManager->SafeDestroy();
-		delete m_pRecvUDPManager;
-		m_pRecvUDPManager = 0;
-	}
-
-	if( 0 != m_pSendUDPManager )
-	{
-		m_pSendUDPManager->SafeDestroy();
-		delete m_pSendUDPManager;
-		m_pSendUDPManager = 0;
-	}
-
-	if( 0 != m_pBlockUDPManager )
-	{
-		m_pBlockUDPManager->SafeDestroy();
-		delete m_pBlockUDPManager;
-		m_pBlockUDPManager = 0;
-	}
-
-	ReleaseMemPool( MLocatorUDPInfo );
-
-	UninitMemPool( MLocatorUDPInfo );
+	m_pRateLimiter.reset();
 }
 
 void MLocator::ReleaseCommand()
@@ -345,8 +299,10 @@ void MLocator::GetDBServerStatus(u64 dwEventTime, const bool bIsWithoutDelayUpda
 		m_pServerStatusMgr->CheckDeadServerByLastUpdatedTime(GetLocatorConfig()->GetMarginOfErrorMin(),
 			m_pServerStatusMgr->CalcuMaxCmpCustomizeMin());
 
+		bool bChanged = false;
 		if (m_nLastGetServerStatusCount != m_pServerStatusMgr->GetSize())
 		{
+			bChanged = true;
 			MEraseBlobArray(m_vpServerStatusInfoBlob);
 
 			m_nLastGetServerStatusCount = m_pServerStatusMgr->GetSize();
@@ -356,18 +312,27 @@ void MLocator::GetDBServerStatus(u64 dwEventTime, const bool bIsWithoutDelayUpda
 
 		if (0 != m_vpServerStatusInfoBlob)
 		{
-			MTD_ServerStatusInfo* pMTDss;
 			for (int i = 0; i < m_nLastGetServerStatusCount; ++i)
 			{
-				pMTDss = (MTD_ServerStatusInfo*)MGetBlobArrayElement(m_vpServerStatusInfoBlob, i);
-
-				pMTDss->m_dwIP = (*m_pServerStatusMgr)[i].GetIP();
-				pMTDss->m_nPort = (*m_pServerStatusMgr)[i].GetPort();
-				pMTDss->m_nServerID = static_cast<unsigned char>((*m_pServerStatusMgr)[i].GetID());
-				pMTDss->m_nCurPlayer = (*m_pServerStatusMgr)[i].GetCurPlayer();
-				pMTDss->m_nMaxPlayer = (*m_pServerStatusMgr)[i].GetMaxPlayer();
-				pMTDss->m_nType = (*m_pServerStatusMgr)[i].GetType();
-				pMTDss->m_bIsLive = (*m_pServerStatusMgr)[i].IsLive();
+				// Filled in separately, with the padding zeroed, so that it can be compared with
+				// what's in the blob already.
+				MTD_ServerStatusInfo Info;
+				memset(&Info, 0, sizeof(Info));
+
+				Info.m_dwIP = (*m_pServerStatusMgr)[i].GetIP();
+				Info.m_nPort = (*m_pServerStatusMgr)[i].GetPort();
+				Info.m_nServerID = static_cast<unsigned char>((*m_pServerStatusMgr)[i].GetID());
+				Info.m_nCurPlayer = (*m_pServerStatusMgr)[i].GetCurPlayer();
+				Info.m_nMaxPlayer = (*m_pServerStatusMgr)[i].GetMaxPlayer();
+				Info.m_nType = (*m_pServerStatusMgr)[i].GetType();
+				Info.m_bIsLive = (*m_pServerStatusMgr)[i].IsLive();
+
+				auto* pMTDss = (MTD_ServerStatusInfo*)MGetBlobArrayElement(m_vpServerStatusInfoBlob, i);
+				if (memcmp(pMTDss, &Info, sizeof(Info)) != 0)
+				{
+					memcpy(pMTDss, &Info, sizeof(Info));
+					bChanged = true;
+				}
 			}
 
 			UpdateLastServerStatusUpdatedTime(dwEventTime);
@@ -376,6 +341,9 @@ void MLocator::GetDBServerStatus(u64 dwEventTime, const bool bIsWithoutDelayUpda
 		{
 			m_nLastGetServerStatusCount = -1;
 		}
+
+		if (bChanged)
+			UpdateServerStatusInfoPacket();
 	}
 	else
 	{
@@ -391,77 +359,6 @@ bool MLocator::IsElapedServerStatusUpdatedTime(u64 dwEventTime)
 }
 
 
-bool MLocator::IsLiveBlockUDP(const MLocatorUDPInfo* pBlkRecvUDPInfo, u64 dwEventTime)
-{
-	if( 0 == pBlkRecvUDPInfo ) return false;
-
-	if( GetLocatorConfig()->GetBlockTime() > (dwEventTime - pBlkRecvUDPInfo->GetUseStartTime()) )
-		return true;
-
-	return false;
-}
-
-
-bool MLocator::IsBlocker(u32 dwIPKey, u64 dwEventTime)
-{
-	MUDPManager& rfBlkUDPMgr = GetBlockUDPManager();
-
-	rfBlkUDPMgr.Lock();
-
-	MLocatorUDPInfo* pBlkRecvUDPInfo = rfBlkUDPMgr.Find( dwIPKey );
-	if( 0 != pBlkRecvUDPInfo )
-	{
-		if (!IsLiveBlockUDP(pBlkRecvUDPInfo, dwEventTime))
-		{
-			rfBlkUDPMgr.Delete( dwIPKey );
-			rfBlkUDPMgr.Unlock();
-			return false;
-		}
-
-		pBlkRecvUDPInfo->IncreaseUseCount();
-
-		if( IsOverflowedNormalUseCount(pBlkRecvUDPInfo) )
-		{
-			pBlkRecvUDPInfo->SetUseStartTime( dwEventTime );
-			pBlkRecvUDPInfo->SetUseCount( 1 );
-		}
-
-#ifdef _DEBUG
-		mlog( "MLocator::IsBlocker - Block! time. dwIP:%u, UseCount:%d, LimitUseCount:%d, DbgInfo:%s\n",
-			dwIPKey, 
-			pBlkRecvUDPInfo->GetUseCount(), 
-			GetLocatorConfig()->GetMaxFreeUseCountPerLiveTime(), 
-			rfBlkUDPMgr.m_strExDbgInfo.c_str() );
-#endif
-
-		rfBlkUDPMgr.Unlock();
-		return true;
-	}
-
-	rfBlkUDPMgr.Unlock();
-
-	return false;
-}// IsBlocker
-
-
-bool MLocator::IsDuplicatedUDP(u32 dwIPKey, MUDPManager& rfCheckUDPManager, u64 dwEventTime)
-{
-	rfCheckUDPManager.Lock();
-
-	MLocatorUDPInfo* pRecvUDPInfo = rfCheckUDPManager.Find( dwIPKey );
-	if( 0 != pRecvUDPInfo )
-	{
-		pRecvUDPInfo->IncreaseUseCount();
-		rfCheckUDPManager.Unlock();
-		return false;
-	}
-
-	rfCheckUDPManager.Unlock();
-
-	return true;
-}
-
-
 bool MLocator::UDPSocketRecvEvent(u32 dwIP, u16 wRawPort, char* pPacket, u32 dwSize)
 {
 	if( NULL == GetMainLocator() ) return false;
@@ -471,18 +368,17 @@ bool MLocator::UDPSocketRecvEvent(u32 dwIP, u16 wRawPort, char* pPacket, u32 dwS
 
 	MLocator* pLocator = GetMainLocator();
 	
-	if( pLocator->IsBlocker(dwIP, dwEventTime ) ) 
-		return false;
-	
 #ifdef _LOCATOR_TEST
 	if( 400 < GetMainLocator()->GetRecvCount() ) 
 		return true;
 #endif
-	
-	if( !pLocator->IsDuplicatedUDP(dwIP, pLocator->GetRecvUDPManager(), dwEventTime) ) 
+
+	// Dropped requests are still reported as handled, so that SafeUDP doesn't go on to look at
+	// them too.
+	if( !pLocator->GetRateLimiter().Consume(dwIP, dwEventTime) )
 	{
-		GetMainLocator()->IncreaseDuplicatedCount();
-		return false;
+		pLocator->IncreaseDuplicatedCount();
+		return true;
 	}
 
 	MPacketHeader* pPacketHeader = (MPacketHeader*)pPacket;
@@ -514,26 +410,18 @@ void MLocator::ParseUDPPacket( char* pData, MPacketHeader* pPacketHeader, u32 dw
 				}
 				return;
 			} else {
-				MCommand* pCmd = new MCommand();
-				if (!pCmd->SetData(pData, &m_CommandManager))
+				MCommand Cmd;
+				if (!Cmd.SetData(pData, &m_CommandManager))
 				{
 					char szLog[ 128 ] = {0,};
 					sprintf_safe( szLog, "MLocator::ParseUDPPacket -> SetData Error\n" );
 					GetLogManager().SafeInsertLog( szLog );
-					
-					delete pCmd;
 					return;
 				}
 
-				if( MC_REQUEST_SERVER_LIST_INFO == pCmd->GetID() )
+				if( MC_REQUEST_SERVER_LIST_INFO == Cmd.GetID() )
 				{
-					if( !GetRecvUDPManager().SafeInsert(dwIP, nPort, GetGlobalTimeMS()) )
-					{
-						char szLog[ 1024 ] = {0,};
-						sprintf_safe(szLog, "fail to insert new IP(%u,%d) Time:%s\n",
-							dwIP, nPort, MGetStrLocalTime().c_str() );
-						GetLogManager().SafeInsertLog( szLog );
-					}
+					ResponseServerStatusInfoList( dwIP, nPort );
 				}
 				else
 				{
@@ -541,14 +429,12 @@ void MLocator::ParseUDPPacket( char* pData, MPacketHeader* pPacketHeader, u32 dw
 
 					char szLog[ 1024 ] = {0,};
 					sprintf_safe(szLog, "invalide command(%u) Time:%s, dwIP:%u\n",
-						pCmd->GetID(), MGetStrLocalTime().c_str(), dwIP );
+						Cmd.GetID(), MGetStrLocalTime().c_str(), dwIP );
 					GetLogManager().SafeInsertLog( szLog );
 
-					GetBlockUDPManager().SafeInsert( dwIP, nPort, GetGlobalTimeMS() );
+					GetRateLimiter().Block( dwIP, GetGlobalTimeMS() );
 					GetLocatorStatistics().IncreaseBlockCount();
 				}
-
-				delete pCmd;
 			}
 		}
 		break;
@@ -560,7 +446,7 @@ void MLocator::ParseUDPPacket( char* pData, MPacketHeader* pPacketHeader, u32 dw
 				MGetStrLocalTime().c_str(), dwIP );
 			GetLogManager().SafeInsertLog( szLog );
 
-			GetBlockUDPManager().SafeInsert( dwIP, nPort, GetGlobalTimeMS() );
+			GetRateLimiter().Block( dwIP, GetGlobalTimeMS() );
 			GetLocatorStatistics().IncreaseBlockCount();
 
 			unsigned short nCheckSum = MBuildCheckSum(pPacketHeader, pPacketHeader->nSize);
@@ -589,8 +475,7 @@ void MLocator::Run()
 {
 	const auto dwEventTime = GetGlobalTimeMS();
 	GetDBServerStatus( dwEventTime );
-	FlushRecvQueue( dwEventTime );
-	UpdateUDPManager( dwEventTime );
+	UpdateRateLimiter( dwEventTime );
 #ifdef LOCATOR_FREESTANDING
 	UpdateLocatorStatus( dwEventTime );
 	UpdateLocatorLog( dwEventTime );
@@ -601,16 +486,48 @@ void MLocator::Run()
 
 void MLocator::ResponseServerStatusInfoList( u32 dwIP, int nPort )
 {
+	char* pszPacketBuf;
+	int nPacketSize;
+	{
+		std::lock_guard<MCriticalSection> Lock{ m_csServerStatusInfoPacket };
+		if( m_ServerStatusInfoPacket.empty() )
+			return;
+
+		nPacketSize = static_cast<int>( m_ServerStatusInfoPacket.size() );
+		pszPacketBuf = new char[ nPacketSize ];
+		memcpy( pszPacketBuf, m_ServerStatusInfoPacket.data(), nPacketSize );
+	}
+
+	if( !m_pSafeUDP->Send(dwIP, nPort, pszPacketBuf, nPacketSize) )
+	{
+		delete [] pszPacketBuf;
+		return;
+	}
+
+	IncreaseSendCount();
+}
+
+
+void MLocator::UpdateServerStatusInfoPacket()
+{
+	std::vector<char> Packet;
 	if( 0 < m_nLastGetServerStatusCount )
 	{
 		MCommand* pCmd = CreateCommand( MC_RESPONSE_SERVER_LIST_INFO, MUID(0, 0) );
-		if( 0 != pCmd )
+		pCmd->AddParameter( new MCommandParameterBlob(m_vpServerStatusInfoBlob, m_nServerStatusInfoBlobSize) );
+
+		Packet.resize( CalcPacketSize(pCmd) );
+		if( MakeCmdPacket(Packet.data(), static_cast<int>(Packet.size()), pCmd) != static_cast<int>(Packet.size()) )
 		{
-			pCmd->AddParameter( new MCommandParameterBlob(m_vpServerStatusInfoBlob, m_nServerStatusInfoBlobSize) );
-			SendCommandByUDP( dwIP, nPort, pCmd );
-			delete pCmd;
+			ASSERT( 0 && "MLocator::UpdateServerStatusInfoPacket - MakeCmdPacket failed" );
+			Packet.clear();
 		}
+
+		delete pCmd;
 	}
+
+	std::lock_guard<MCriticalSection> Lock{ m_csServerStatusInfoPacket };
+	m_ServerStatusInfoPacket.swap( Packet );
 }
 
 
@@ -627,28 +544,6 @@ void MLocator::ResponseBlockCountryCodeIP( u32 dwIP, int nPort, const string& st
 }
 
 
-bool MLocator::IsLiveUDP( const MLocatorUDPInfo* pRecvUDPInfo, u64 dwEventTime )
-{
-	if( 0 == pRecvUDPInfo ) return false;
-
-	if( GetLocatorConfig()->GetUDPLiveTime() > (dwEventTime - pRecvUDPInfo->GetUseStartTime()) )
-		return true;
-
-	return false;
-}
-
-
-bool MLocator::IsOverflowedNormalUseCount( const MLocatorUDPInfo* pRecvUDPInfo )
-{
-	if( 0 == pRecvUDPInfo ) return false;
-
-	if( GetLocatorConfig()->GetMaxFreeUseCountPerLiveTime() > pRecvUDPInfo->GetTotalUseCount() )
-		return false;
-	
-	return true;
-}
-
-
 const int MLocator::MakeCmdPacket( char* pOutPacket, const int nMaxSize, MCommand* pCmd )
 {
 	if( (0 == pOutPacket) || (0 > nMaxSize) || (0 == pCmd) ) 
@@ -713,14 +608,13 @@ void MLocator::OnRegisterCommand(MCommandManager* pCommandManager)
 }
 
 
-void MLocator::UpdateUDPManager(u64 dwEventTime )
+void MLocator::UpdateRateLimiter(u64 dwEventTime )
 {
-	if( GetLocatorConfig()->GetUpdateUDPManagerElapsedTime() < (dwEventTime - GetLastUDPManagerUpdateTime()) )
+	if( GetLocatorConfig()->GetUpdateUDPManagerElapsedTime() < (dwEventTime - GetLastRateLimiterUpdateTime()) )
 	{
-		GetSendUDPManager().SafeClearElapsedLiveTimeUDP( GetLocatorConfig()->GetUpdateUDPManagerElapsedTime(), dwEventTime );
-		GetBlockUDPManager().SafeClearElapsedLiveTimeUDP( GetLocatorConfig()->GetBlockTime(), dwEventTime );
+		GetRateLimiter().ClearIdle( dwEventTime );
 
-		UpdateLastUDPManagerUpdateTime( dwEventTime );
+		UpdateLastRateLimiterUpdateTime( dwEventTime );
 	}
 }
 
@@ -758,66 +652,6 @@ void MLocator::UpdateLogManager()
 }
 
 
-void MLocator::FlushRecvQueue(u64 dwEventTime)
-{
-	MUDPManager& RecvUDPMgr = GetRecvUDPManager();
-	MUDPManager& SendUDPMgr = GetSendUDPManager();
-
-	MLocatorUDPInfo* pRecvUDPInfo;
-	MLocatorUDPInfo* pSendUDPInfo;
-
-	string	strCountryCode;
-	string	strRoutingURL;
-	string	strComment;
-
-    RecvUDPMgr.Lock();
-	while( 0 != (pRecvUDPInfo = RecvUDPMgr.SafePopFirst()) )
-	{
-		if( !SendUDPMgr.Insert(pRecvUDPInfo->GetIP(), pRecvUDPInfo) )
-		{
-			pSendUDPInfo = SendUDPMgr.Find( pRecvUDPInfo->GetIP() );
-			if( 0 != pSendUDPInfo )
-				pSendUDPInfo->IncreaseUseCount( pRecvUDPInfo->GetUseCount() );
-			delete pRecvUDPInfo;
-		}
-	}
-	RecvUDPMgr.Unlock();
-
-	for( SendUDPMgr.SetBegin(); 0 != (pSendUDPInfo = SendUDPMgr.GetCurPosUDP()); )
-	{
-		if( 0 < pSendUDPInfo->GetUseCount() )
-		{
-			if( IsOverflowedNormalUseCount(pSendUDPInfo) )
-			{
-				if( !IsBlocker(pSendUDPInfo->GetIP(), dwEventTime) )
-				{
-					pSendUDPInfo->SetUseCount( 0 );
-
-					if( !GetBlockUDPManager().SafeInsert(pSendUDPInfo->GetIP(), pSendUDPInfo->GetPort(), dwEventTime) )
-					{
-						mlog( "fail to block udp(%s) time:%s\n", 
-							pSendUDPInfo->GetStrIP().c_str(), MGetStrLocalTime().c_str() );
-					}
-
-					GetLocatorStatistics().IncreaseBlockCount();
-					mlog( "Block. IP(%s), time:%s\n", pSendUDPInfo->GetStrIP().c_str(), MGetStrLocalTime().c_str() );
-				}
-				SendUDPMgr.MoveNext();
-				continue;
-			}
-
-			ResponseServerStatusInfoList(pSendUDPInfo->GetIP(), pSendUDPInfo->GetPort());
-
-			pSendUDPInfo->IncreaseUsedCount( pSendUDPInfo->GetUseCount() );
-			pSendUDPInfo->SetUseCount( 0 );
-			IncreaseSendCount();
-
-			
-		}
-		SendUDPMgr.MoveNext();
-	}
-}
-
 MCommand* MLocator::CreateCommand(int nCmdID, const MUID& TargetUID)
 {
 	return new MCommand(m_CommandManager.GetCommandDescByID(nCmdID), TargetUID, m_This);
@@ -828,21 +662,10 @@ void MLocator::DumpLocatorStatusInfo()
 	mlog( "\n======================================================\n" );
 	mlog( "Locator Status Info.\n" );
 
-	mlog( "Recv UDP Manager Status Info\n" );
-	GetRecvUDPManager().Lock();
-	GetRecvUDPManager().DumpStatusInfo();
-	GetRecvUDPManager().Unlock();
-
-	mlog( "Send UDP Manager Status Info\n" );
-	GetSendUDPManager().Lock();
-	GetSendUDPManager().DumpStatusInfo();
-	GetSendUDPManager().Unlock();
-
-	mlog( "Block UDP Manager Status Info\n" );
-	GetBlockUDPManager().Lock();
-	GetBlockUDPManager().DumpStatusInfo();
-	GetBlockUDPManager().DumpUDPInfo();
-	GetBlockUDPManager().Unlock();
+	const auto dwTime = GetGlobalTimeMS();
+	mlog( "Rate limiter: %d IPs, %d blocked\n",
+		static_cast<int>(GetRateLimiter().size()),
+		static_cast<int>(GetRateLimiter().GetBlockedCount(dwTime)) );
 	mlog( "======================================================\n\n" );
 }
 
@@ -859,7 +682,7 @@ void MLocator::UpdateLocatorStatus(u64 dwEventTime)
 		if( !m_pDBMgr->UpdateLocaterStatus( GetLocatorConfig()->GetLocatorID(), 
 			GetRecvCount(), 
 			GetSendCount(), 
-			static_cast<u32>(GetBlockUDPManager().size()), 
+			static_cast<u32>(GetRateLimiter().GetBlockedCount(dwEventTime)), 
 			GetDuplicatedCount() ) )
 		{
 			mlog( "fail to update locator status.\n" );
@@ -876,14 +699,6 @@ void MLocator::UpdateLocatorStatus(u64 dwEventTime)
 
 #ifdef _DEBUG
 
-void MLocator::InitDebug()
-{
-	GetRecvUDPManager().m_strExDbgInfo = "Name:RecvUDPManager";
-	GetSendUDPManager().m_strExDbgInfo = "Name:SendUDPManager";
-	GetBlockUDPManager().m_strExDbgInfo = "Name:BlockUDPManager";
-}
-
-
 void MLocator::TestDo()
 {
 	if( 0 != m_pDBMgr )
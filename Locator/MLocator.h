@@ -3,14 +3,16 @@
 #include "MUID.h"
 #include "MCommandManager.h"
 #include "MSync.h"
+#include <atomic>
+#include <memory>
+#include <vector>
 
 class MCommand;
 class MCommandManager;
 class MLocatorDBMgr;
 class MSafeUDP;
 class MServerStatusMgr;
-class MLocatorUDPInfo;
-class MUDPManager;
+class MLocatorRateLimiter;
 class MCountryFilter;
 
 struct MPacketHeader;
@@ -24,11 +26,6 @@ public:
 	bool Create();
 	void Destroy();
 
-	bool IsBlocker(const u32 dwIPKey, const u64 dwEventTime);
-	bool IsDuplicatedUDP(const u32 dwIPKey,
-		MUDPManager& rfCheckUDPManager,
-		const u64 dwEventTime);
-
 	void IncreaseRecvCount() { ++m_nRecvCount; }
 	void IncreaseSendCount() { ++m_nSendCount; }
 	void IncreaseDuplicatedCount() { ++m_nDuplicatedCount; }
@@ -48,7 +45,6 @@ public:
 
 #ifdef _DEBUG
 	void TestDo();
-	void InitDebug();
 	void DebugOutput(void* vp);
 #endif
 
@@ -56,23 +52,21 @@ private:
 	bool InitDBMgr();
 	bool InitSafeUDP();
 	bool InitServerStatusMgr();
-	bool InitUDPManager();
+	bool InitRateLimiter();
 
 	MLocatorDBMgr* GetLocatorDBMgr() { return m_pDBMgr; }
 
 	bool GetServerStatus();
 	void GetDBServerStatus(u64 dwEventTime, const bool bIsWithoutDelayUpdate = false);
 	auto GetUpdatedServerStatusTime() { return m_dwLastServerStatusUpdatedTime; }
-	auto GetLastUDPManagerUpdateTime() { return m_dwLastUDPManagerUpdateTime; }
+	auto GetLastRateLimiterUpdateTime() { return m_dwLastRateLimiterUpdateTime; }
 	auto GetLastLocatorStatusUpdatedTime() { return m_dwLastLocatorStatusUpdatedTime; }
 
-	MUDPManager& GetRecvUDPManager() { return *m_pRecvUDPManager; }
-	MUDPManager& GetSendUDPManager() { return *m_pSendUDPManager; }
-	MUDPManager& GetBlockUDPManager() { return *m_pBlockUDPManager; }
+	MLocatorRateLimiter& GetRateLimiter() { return *m_pRateLimiter; }
 
-	auto GetRecvCount() const { return m_nRecvCount; }
-	auto GetSendCount() const { return m_nSendCount; }
-	auto GetDuplicatedCount() const { return m_nDuplicatedCount; }
+	u32 GetRecvCount() const { return m_nRecvCount; }
+	u32 GetSendCount() const { return m_nSendCount; }
+	u32 GetDuplicatedCount() const { return m_nDuplicatedCount; }
 
 	void ResetRecvCount() { m_nRecvCount = 0; }
 	void ResetSendCount() { m_nSendCount = 0; }
@@ -82,12 +76,12 @@ private:
 	void ReleaseSafeUDP();
 	void ReleaseServerStatusMgr();
 	void ReleaseServerStatusInfoBlob();
-	void ReleaseUDPManager();
+	void ReleaseRateLimiter();
 	void ReleaseCommand();
 
 	bool IsElapedServerStatusUpdatedTime(u64 dwEventTime);
 	void UpdateLastServerStatusUpdatedTime(u64 dwTime) { m_dwLastServerStatusUpdatedTime = dwTime; }
-	void UpdateLastUDPManagerUpdateTime(u64 dwTime) { m_dwLastUDPManagerUpdateTime = dwTime; }
+	void UpdateLastRateLimiterUpdateTime(u64 dwTime) { m_dwLastRateLimiterUpdateTime = dwTime; }
 	void UpdateLastLocatorStatusUpdatedTime(u64 dwTime) { m_dwLastLocatorStatusUpdatedTime = dwTime; }
 
 	void ParseUDPPacket(char* pData,
@@ -105,15 +99,12 @@ private:
 		const std::string& strCountryCode,
 		const std::string& strRoutingURL);
 
-	bool IsLiveUDP(const MLocatorUDPInfo* pRecvUDPInfo, u64 dwEventTime);
-	bool IsLiveBlockUDP(const MLocatorUDPInfo* pBlkRecvUDPInfo, u64 dwEventTime);
-	bool IsOverflowedNormalUseCount(const MLocatorUDPInfo* pRecvUDPInfo);
-
 	const int	MakeCmdPacket(char* pOutPacket, const int nMaxSize, MCommand* pCmd);
 	void		SendCommandByUDP(u32 dwIP, int nPort, MCommand* pCmd);
+	void		SendPacketByUDP(u32 dwIP, int nPort, const char* pPacket, int nPacketSize);
 
-	void UpdateUDPManager(u64 dwEventTime);
-	void FlushRecvQueue(u64 dwEventTime);
+	void UpdateServerStatusInfoPacket();
+	void UpdateRateLimiter(u64 dwEventTime);
 	void UpdateLocatorStatus(u64 dwEventTime);
 	void UpdateLocatorLog(u64 dwEventTime);
 	void UpdateCountryCodeFilter(u64 dwEventTime);
@@ -138,18 +129,23 @@ private:
 
 	MCriticalSection m_csCommandQueueLock{};
 
-	MUDPManager* m_pRecvUDPManager{};
-	MUDPManager* m_pSendUDPManager{};
-	MUDPManager* m_pBlockUDPManager{};
-	u64 m_dwLastUDPManagerUpdateTime{};
+	std::unique_ptr<MLocatorRateLimiter> m_pRateLimiter;
+	u64 m_dwLastRateLimiterUpdateTime{};
 
-	u32 m_nRecvCount{};
-	u32 m_nSendCount{};
-	u32 m_nDuplicatedCount{};
+	// Requests are answered on the socket threads, so these are counted there.
+	std::atomic<u32> m_nRecvCount{};
+	std::atomic<u32> m_nSendCount{};
+	// Requests dropped by the rate limiter.
+	std::atomic<u32> m_nDuplicatedCount{};
 
 	MLocatorDBMgr*	m_pDBMgr{};
 
 	void*		m_vpServerStatusInfoBlob{};
 	int			m_nLastGetServerStatusCount{};
 	int			m_nServerStatusInfoBlobSize{};
+
+	// The MC_RESPONSE_SERVER_LIST_INFO datagram, serialized and checksummed whenever the server
+	// status changes, so that answering a request is only a copy.
+	std::vector<char>	m_ServerStatusInfoPacket;
+	MCriticalSection	m_csServerStatusInfoPacket;
 };
\ No newline at end of file
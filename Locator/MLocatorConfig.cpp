@@ -70,7 +70,9 @@ bool MLocatorConfig::LoadEnvConfig(const IniParser& ini)
 	m_dwUDPLiveTime = ini.GetInt("ENV", "UDP_LIVE_TIME", 10000000);
 	m_dwMaxFreeUseCountPerLiveTime = ini.GetInt("ENV", "MAX_FREE_RECV_COUNT_PER_LIVE_TIME", 9);
 	m_dwBlockTime = ini.GetInt("ENV", "BLOCK_TIME", 0);
-	m_dwUpdateUDPManagerElapsedTime = ini.GetInt("ENV", "UPDATE_UDP_MANAGER_ELAPSED_TIME", 3);
+	m_dwRequestRate = ini.GetInt("ENV", "REQUEST_RATE", 10);
+	m_dwRequestBurst = ini.GetInt("ENV", "REQUEST_BURST", m_dwMaxFreeUseCountPerLiveTime);
+	m_dwUpdateUDPManagerElapsedTime = ini.GetInt("ENV", "UPDATE_UDP_MANAGER_ELAPSED_TIME", 1000);
 	m_dwMarginOfErrorMin = ini.GetInt("ENV", "MARGIN_OF_ERROR_MIN", 500000);
 	m_dwElapsedTimeUpdateLocatorLog = ini.GetInt("ENV", "ELAPSED_TIME_UPDATE_LOCATOR_LOG", 10000);
 	m_bIsUseCountryCodeFilter = ini.GetInt<bool>("ENV", "USE_COUNTRY_CODE_FILTER", 0);
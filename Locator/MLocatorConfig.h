@@ -26,6 +26,8 @@ public:
 	auto GetUDPLiveTime() const							{ return m_dwUDPLiveTime; }
 	auto GetMaxFreeUseCountPerLiveTime() const			{ return m_dwMaxFreeUseCountPerLiveTime; }
 	auto GetBlockTime() const							{ return m_dwBlockTime; }
+	auto GetRequestRate() const							{ return m_dwRequestRate; }
+	auto GetRequestBurst() const						{ return m_dwRequestBurst; }
 	auto GetUpdateUDPManagerElapsedTime() const			{ return m_dwUpdateUDPManagerElapsedTime; }
 	auto GetMarginOfErrorMin() const					{ return m_dwMarginOfErrorMin; }
 	auto GetElapsedTimeUpdateLocatorLog() const			{ return m_dwElapsedTimeUpdateLocatorLog; }
@@ -51,6 +53,9 @@ private:
 	u32	m_dwUDPLiveTime;
 	u32	m_dwMaxFreeUseCountPerLiveTime;
 	u32	m_dwBlockTime;
+	// Requests per second each IP may make, and how many it may make at once.
+	u32	m_dwRequestRate;
+	u32	m_dwRequestBurst;
 	u32	m_dwUpdateUDPManagerElapsedTime;
 	u32	m_dwMarginOfErrorMin;
 	u32	m_dwGMTDiff;
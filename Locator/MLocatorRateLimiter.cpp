@@ -0,0 +1,106 @@
+#include "stdafx.h"
+#include "MLocatorRateLimiter.h"
+#include <algorithm>
+#include <mutex>
+
+MLocatorRateLimiter::MLocatorRateLimiter(u32 Rate, u32 Burst, u32 BlockTime)
+	: Rate(float(Rate)), Burst(float((std::max)(Burst, 1u))), BlockTime(BlockTime)
+{
+}
+
+void MLocatorRateLimiter::Refill(Bucket& Bucket, u64 Now) const
+{
+	// The socket threads read the time before taking the lock, so it can go back a bit.
+	if (Now <= Bucket.LastTime)
+		return;
+
+	Bucket.Tokens = (std::min)(Burst, Bucket.Tokens + (Now - Bucket.LastTime) * Rate / 1000);
+	Bucket.LastTime = Now;
+}
+
+bool MLocatorRateLimiter::Consume(u32 IP, u64 Now)
+{
+	auto& Shard = GetShard(IP);
+	std::lock_guard<MCriticalSection> Lock{ Shard.Mutex };
+
+	auto it = Shard.Buckets.find(IP);
+	if (it == Shard.Buckets.end())
+	{
+		Shard.Buckets.emplace(IP, Bucket{ Burst - 1, Now, 0 });
+		return true;
+	}
+
+	auto& Bucket = it->second;
+	if (Now < Bucket.BlockedUntil)
+		return false;
+
+	Refill(Bucket, Now);
+	if (Bucket.Tokens < 1)
+	{
+		Bucket.BlockedUntil = Now + BlockTime;
+		return false;
+	}
+
+	Bucket.Tokens -= 1;
+	return true;
+}
+
+void MLocatorRateLimiter::Block(u32 IP, u64 Now)
+{
+	auto& Shard = GetShard(IP);
+	std::lock_guard<MCriticalSection> Lock{ Shard.Mutex };
+
+	auto& Bucket = Shard.Buckets.emplace(IP, MLocatorRateLimiter::Bucket{ Burst, Now, 0 }).first->second;
+	Bucket.Tokens = 0;
+	Bucket.BlockedUntil = Now + BlockTime;
+}
+
+bool MLocatorRateLimiter::IsBlocked(u32 IP, u64 Now)
+{
+	auto& Shard = GetShard(IP);
+	std::lock_guard<MCriticalSection> Lock{ Shard.Mutex };
+
+	auto it = Shard.Buckets.find(IP);
+	return it != Shard.Buckets.end() && Now < it->second.BlockedUntil;
+}
+
+void MLocatorRateLimiter::ClearIdle(u64 Now)
+{
+	for (auto&& Shard : Shards)
+	{
+		std::lock_guard<MCriticalSection> Lock{ Shard.Mutex };
+		for (auto it = Shard.Buckets.begin(); it != Shard.Buckets.end();)
+		{
+			auto& Bucket = it->second;
+			Refill(Bucket, Now);
+			if (Now >= Bucket.BlockedUntil && Bucket.Tokens >= Burst)
+				it = Shard.Buckets.erase(it);
+			else
+				++it;
+		}
+	}
+}
+
+size_t MLocatorRateLimiter::GetBlockedCount(u64 Now)
+{
+	size_t Count = 0;
+	for (auto&& Shard : Shards)
+	{
+		std::lock_guard<MCriticalSection> Lock{ Shard.Mutex };
+		for (auto&& Pair : Shard.Buckets)
+			if (Now < Pair.second.BlockedUntil)
+				++Count;
+	}
+	return Count;
+}
+
+size_t MLocatorRateLimiter::size()
+{
+	size_t Count = 0;
+	for (auto&& Shard : Shards)
+	{
+		std::lock_guard<MCriticalSection> Lock{ Shard.Mutex };
+		Count += Shard.Buckets.size();
+	}
+	return Count;
+}
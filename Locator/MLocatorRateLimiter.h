@@ -0,0 +1,54 @@
+#pragma once
+
+#include <unordered_map>
+#include "GlobalTypes.h"
+#include "MSync.h"
+
+// Per-IP token buckets for the requests the locator receives.
+//
+// Each IP starts with Burst tokens, gets Rate more per second up to Burst, and spends one per
+// request. An IP that runs out is blocked for BlockTime ms on top of that. The buckets are split
+// into shards that each have their own lock, so that the socket threads rarely wait for each other.
+class MLocatorRateLimiter
+{
+public:
+	MLocatorRateLimiter(u32 Rate, u32 Burst, u32 BlockTime);
+
+	// Returns whether a request from IP at Now is allowed.
+	bool Consume(u32 IP, u64 Now);
+	void Block(u32 IP, u64 Now);
+	bool IsBlocked(u32 IP, u64 Now);
+
+	// Removes the buckets that have refilled and aren't blocked, since they're the same as no
+	// bucket at all.
+	void ClearIdle(u64 Now);
+
+	size_t GetBlockedCount(u64 Now);
+	size_t size();
+
+private:
+	struct Bucket
+	{
+		float Tokens;
+		u64 LastTime;
+		u64 BlockedUntil;
+	};
+
+	struct alignas(64) Shard
+	{
+		MCriticalSection Mutex;
+		std::unordered_map<u32, Bucket> Buckets;
+	};
+
+	static constexpr size_t ShardCount = 16;
+
+	Shard& GetShard(u32 IP) { return Shards[(IP * 0x9E3779B1u) >> 28]; }
+	void Refill(Bucket& Bucket, u64 Now) const;
+
+	static_assert(ShardCount == 16, "GetShard takes the top four bits of the hash");
+
+	float Rate;
+	float Burst;
+	u32 BlockTime;
+	Shard Shards[ShardCount];
+};
@@ -1,7 +1,9 @@
 #pragma once
 
 #include <cassert>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <exception>
 #include "variant.h"
@@ -68,6 +70,55 @@ struct SQLHandle
 template <SQLSMALLINT HandleTypeParam>
 SQLSMALLINT const SQLHandle<HandleTypeParam>::HandleType;
 
+// Rows of parameters for a single statement, sent to the server with ODBC array binding so that
+// inserting N rows is one round trip instead of N.
+class MDatabaseBatch
+{
+public:
+	// The parameters are declared once, in order, before any rows are added. Strings are bound
+	// as fixed-width columns, so MaxLength is the longest value the parameter can hold.
+	MDatabaseBatch& AddIntParam();
+	MDatabaseBatch& AddBigIntParam();
+	MDatabaseBatch& AddStringParam(size_t MaxLength);
+
+	// Appends a row. The values must match the declared parameters in order and type. Strings
+	// longer than the declared maximum are truncated.
+	template <typename... T>
+	void AddRow(const T&... Values)
+	{
+		assert(sizeof...(Values) == Params.size());
+		size_t i = 0;
+		using Expander = int[];
+		(void)Expander{(SetValue(Params[i++], Values), 0)...};
+		++RowCount;
+	}
+
+	size_t GetRowCount() const { return RowCount; }
+	bool IsEmpty() const { return RowCount == 0; }
+	void Clear();
+
+private:
+	friend struct MDatabase;
+
+	enum class ParamType { Int, BigInt, String };
+
+	struct Param
+	{
+		ParamType Type;
+		// Size of each element in Data, including the null terminator for strings.
+		size_t Width;
+		std::vector<char> Data;
+		std::vector<SQLLEN> LenOrInd;
+	};
+
+	void SetValue(Param& Dest, int Value);
+	void SetValue(Param& Dest, long long Value);
+	void SetValue(Param& Dest, StringView Value);
+
+	std::vector<Param> Params;
+	size_t RowCount = 0;
+};
+
 struct MDatabase
 {
 	enum class DBDriver { ODBC, SQLServer, Max };
@@ -98,6 +149,12 @@ struct MDatabase
 	void Disconnect();
 	bool IsOpen() const;
 	void ExecuteSQL(StringView SQL);
+	// Executes SQL once for every row in the batch. Throws CDBException* on failure, like
+	// ExecuteSQL. The batch is left as is, so the caller decides whether to retry or clear it.
+	void ExecuteBatch(StringView SQL, MDatabaseBatch& Batch);
+	// Returns a statement handle for SQL, preparing it on first use. Prepared statements are
+	// kept per connection and are released when it's closed.
+	SQLHandle<SQLHandleTypes::Stmt>& Prepare(StringView SQL);
 	void SetLogCallback(LOGCALLBACK* fnLogCallback) { m_fnLogCallback = fnLogCallback; }
 	SQLHANDLE GetConn() const { return Conn; }
 
@@ -106,6 +163,8 @@ private:
 
 	SQLHandle<SQLHandleTypes::Env> Env;
 	SQLHandle<SQLHandleTypes::DBC> Conn;
+	// Declared after Conn so that the statements are freed before the connection.
+	std::unordered_map<std::string, SQLHandle<SQLHandleTypes::Stmt>> PreparedStatements;
 	CString ConnectString;
 	LOGCALLBACK* m_fnLogCallback = nullptr;
 };
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "GlobalTypes.h"
+#include "MDatabase.h"
+
+// A fixed number of connections shared between threads. A connection is checked before it's
+// handed out, and reconnected if it has died, was marked as broken by its last user, or has been
+// open for longer than the maximum lifetime.
+class MDatabasePool
+{
+	struct Connection;
+
+public:
+	struct Options
+	{
+		size_t Size = 8;
+		// Milliseconds until a connection is closed and reopened, regardless of its state.
+		// 0 means connections are never recycled.
+		u64 MaxLifetime = 60 * 60 * 1000;
+		// Milliseconds a connection can go without being checked for liveness.
+		u64 HealthCheckInterval = 30 * 1000;
+		// Milliseconds Acquire waits for a connection to be released before giving up.
+		// 0 means it waits indefinitely.
+		u64 AcquireTimeout = 30 * 1000;
+	};
+
+	struct Stats
+	{
+		u64 Acquires;
+		// Number of acquires that had to wait for a connection to be released.
+		u64 Waits;
+		// Number of acquires that gave up waiting.
+		u64 Timeouts;
+		u64 Reconnects;
+		u64 FailedConnects;
+	};
+
+	// Owns a connection until it's destroyed, at which point the connection goes back to the
+	// pool.
+	class Lease
+	{
+	public:
+		Lease() = default;
+		Lease(Lease&& src) : Pool(src.Pool), Conn(src.Conn) { src.Pool = nullptr; src.Conn = nullptr; }
+		Lease& operator=(Lease&& src);
+		~Lease() { Release(); }
+
+		MDatabase* get() const;
+		MDatabase* operator->() const { return get(); }
+		MDatabase& operator*() const { return *get(); }
+		explicit operator bool() const { return Conn != nullptr; }
+
+		// Makes the pool reconnect this connection before it's handed out again.
+		void MarkBroken();
+		void Release();
+
+	private:
+		friend class MDatabasePool;
+		Lease(MDatabasePool* Pool, Connection* Conn) : Pool(Pool), Conn(Conn) {}
+
+		MDatabasePool* Pool = nullptr;
+		Connection* Conn = nullptr;
+	};
+
+	MDatabasePool(const MDatabase::ConnectionDetails& Details, const Options& Opts,
+		MDatabase::LOGCALLBACK* LogCallback = nullptr);
+	MDatabasePool(const MDatabasePool&) = delete;
+	MDatabasePool& operator=(const MDatabasePool&) = delete;
+	~MDatabasePool();
+
+	// Blocks until a connection is available. The lease is empty if none was released within the
+	// timeout, or if the connection couldn't be opened.
+	Lease Acquire();
+
+	size_t GetSize() const { return Connections.size(); }
+	Stats GetStats() const;
+
+private:
+	using clock = std::chrono::steady_clock;
+
+	struct Connection
+	{
+		MDatabase DB;
+		clock::time_point ConnectTime;
+		clock::time_point LastCheckTime;
+		bool Connected = false;
+		bool Broken = false;
+		bool InUse = false;
+	};
+
+	bool Prepare(Connection& Conn);
+	void Release(Connection& Conn);
+
+	// The connection details point into these, so that the pool doesn't depend on the lifetime
+	// of the strings the caller passed in.
+	std::string Server, Database, DSN, Username, Password;
+	MDatabase::ConnectionDetails Details;
+	Options Opts;
+
+	mutable std::mutex Mutex;
+	std::condition_variable Available;
+	std::vector<std::unique_ptr<Connection>> Connections;
+	Stats Counters{};
+};
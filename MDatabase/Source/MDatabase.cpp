@@ -36,6 +36,8 @@ bool MDatabase::CheckOpen()
 {
 	if (!IsOpen())
 	{
+		// The statements were prepared on the dead connection.
+		PreparedStatements.clear();
 		SQLSMALLINT Len;
 		CALL_NOTHROW(SQLDriverConnect, Conn, GetHwnd(), SQLData(ConnectString), SQLSize(ConnectString),
 			nullptr, 0, &Len, SQL_DRIVER_COMPLETE);
@@ -79,6 +81,7 @@ bool MDatabase::Connect(const ConnectionDetails& cd)
 		append(buf, "Trusted_Connection=yes");
 	}
 
+	PreparedStatements.clear();
 	CALL_NOTHROW(SQLAlloc, Env, static_cast<SQLHANDLE>(SQL_NULL_HANDLE));
 	CALL_NOTHROW(SQLSetEnvAttr, Env, SQL_ATTR_ODBC_VERSION, reinterpret_cast<SQLPOINTER*>(SQL_OV_ODBC3), 0);
 	CALL_NOTHROW(SQLAlloc, Conn, Env);
@@ -107,7 +110,11 @@ bool MDatabase::Connect(const ConnectionDetails& cd)
 	return true;
 }
 
-void MDatabase::Disconnect() { Conn.Handle.reset(); }
+void MDatabase::Disconnect()
+{
+	PreparedStatements.clear();
+	Conn.Handle.reset();
+}
 
 bool MDatabase::IsOpen() const
 {
@@ -123,4 +130,132 @@ void MDatabase::ExecuteSQL(StringView SQL)
 	CALL(SQLExecDirect, Statement, SQLData(SQL), SQLSize(SQL));
 }
 
+SQLHandle<SQLHandleTypes::Stmt>& MDatabase::Prepare(StringView SQL)
+{
+	auto it = PreparedStatements.find(SQL.str());
+	if (it != PreparedStatements.end())
+		return it->second;
+
+	SQLHandle<SQLHandleTypes::Stmt> Statement;
+	CALL(SQLAlloc, Statement, Conn);
+	CALL(SQLPrepare, Statement, SQLData(SQL), SQLSize(SQL));
+	return PreparedStatements.emplace(SQL.str(), std::move(Statement)).first->second;
+}
+
+void MDatabase::ExecuteBatch(StringView SQL, MDatabaseBatch& Batch)
+{
+	if (Batch.IsEmpty())
+		return;
+
+	auto& Statement = Prepare(SQL);
+
+	// Unbind the arrays and reset the set size even if the execution throws, since the
+	// statement is reused by later calls.
+	struct ResetGuard
+	{
+		SQLHANDLE Statement;
+		~ResetGuard()
+		{
+			SQLFreeStmt(Statement, SQL_CLOSE);
+			SQLFreeStmt(Statement, SQL_RESET_PARAMS);
+			SQLSetStmtAttr(Statement, SQL_ATTR_PARAMSET_SIZE, reinterpret_cast<SQLPOINTER>(1), 0);
+		}
+	} Guard{Statement};
+
+	CALL(SQLSetStmtAttr, Statement, SQL_ATTR_PARAM_BIND_TYPE,
+		reinterpret_cast<SQLPOINTER>(SQL_PARAM_BIND_BY_COLUMN), 0);
+	CALL(SQLSetStmtAttr, Statement, SQL_ATTR_PARAMSET_SIZE,
+		reinterpret_cast<SQLPOINTER>(static_cast<SQLULEN>(Batch.RowCount)), 0);
+
+	for (size_t i = 0; i < Batch.Params.size(); ++i)
+	{
+		auto&& Param = Batch.Params[i];
+		SQLSMALLINT CType, SQLType;
+		SQLULEN ColumnSize = 0;
+		switch (Param.Type)
+		{
+		case MDatabaseBatch::ParamType::Int:
+			CType = SQL_C_LONG;
+			SQLType = SQL_INTEGER;
+			break;
+		case MDatabaseBatch::ParamType::BigInt:
+			CType = SQL_C_SBIGINT;
+			SQLType = SQL_BIGINT;
+			break;
+		case MDatabaseBatch::ParamType::String:
+		default:
+			CType = SQL_C_CHAR;
+			SQLType = SQL_VARCHAR;
+			ColumnSize = Param.Width - 1;
+			break;
+		}
+		CALL(SQLBindParameter, Statement, static_cast<SQLUSMALLINT>(i + 1), SQL_PARAM_INPUT,
+			CType, SQLType, ColumnSize, 0, Param.Data.data(), static_cast<SQLLEN>(Param.Width),
+			Param.LenOrInd.data());
+	}
+
+	CALL(SQLExecute, Statement);
+}
+
+MDatabaseBatch& MDatabaseBatch::AddIntParam()
+{
+	assert(RowCount == 0);
+	Params.push_back({ParamType::Int, sizeof(SQLINTEGER), {}, {}});
+	return *this;
+}
+
+MDatabaseBatch& MDatabaseBatch::AddBigIntParam()
+{
+	assert(RowCount == 0);
+	Params.push_back({ParamType::BigInt, sizeof(SQLBIGINT), {}, {}});
+	return *this;
+}
+
+MDatabaseBatch& MDatabaseBatch::AddStringParam(size_t MaxLength)
+{
+	assert(RowCount == 0);
+	Params.push_back({ParamType::String, MaxLength + 1, {}, {}});
+	return *this;
+}
+
+void MDatabaseBatch::SetValue(Param& Dest, int Value)
+{
+	assert(Dest.Type == ParamType::Int);
+	auto Offset = Dest.Data.size();
+	Dest.Data.resize(Offset + Dest.Width);
+	auto IntValue = static_cast<SQLINTEGER>(Value);
+	memcpy(&Dest.Data[Offset], &IntValue, sizeof(IntValue));
+	Dest.LenOrInd.push_back(0);
+}
+
+void MDatabaseBatch::SetValue(Param& Dest, long long Value)
+{
+	assert(Dest.Type == ParamType::BigInt);
+	auto Offset = Dest.Data.size();
+	Dest.Data.resize(Offset + Dest.Width);
+	auto IntValue = static_cast<SQLBIGINT>(Value);
+	memcpy(&Dest.Data[Offset], &IntValue, sizeof(IntValue));
+	Dest.LenOrInd.push_back(0);
+}
+
+void MDatabaseBatch::SetValue(Param& Dest, StringView Value)
+{
+	assert(Dest.Type == ParamType::String);
+	auto Offset = Dest.Data.size();
+	Dest.Data.resize(Offset + Dest.Width);
+	auto Length = (std::min)(Value.size(), Dest.Width - 1);
+	memcpy(&Dest.Data[Offset], Value.data(), Length);
+	Dest.LenOrInd.push_back(static_cast<SQLLEN>(Length));
+}
+
+void MDatabaseBatch::Clear()
+{
+	for (auto&& Param : Params)
+	{
+		Param.Data.clear();
+		Param.LenOrInd.clear();
+	}
+	RowCount = 0;
+}
+
 #undef CALL_NOTHROW
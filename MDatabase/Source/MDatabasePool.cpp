@@ -0,0 +1,148 @@
+#include "MDatabasePool.h"
+#include "MDatabaseInternal.h"
+#include <algorithm>
+
+MDatabasePool::MDatabasePool(const MDatabase::ConnectionDetails& src, const Options& Opts,
+	MDatabase::LOGCALLBACK* LogCallback)
+	: Server(src.Server.str()), Database(src.Database.str()), DSN(src.DSN.str()),
+	Username(src.Username.str()), Password(src.Password.str()),
+	Details{src.Driver, src.Auth, Server, Database, DSN, Username, Password},
+	Opts(Opts)
+{
+	Connections.resize((std::max)(Opts.Size, size_t(1)));
+	for (auto&& Conn : Connections)
+	{
+		Conn = std::make_unique<Connection>();
+		Conn->DB.SetLogCallback(LogCallback);
+	}
+}
+
+MDatabasePool::~MDatabasePool()
+{
+#ifdef _DEBUG
+	std::lock_guard<std::mutex> Lock{Mutex};
+	for (auto&& Conn : Connections)
+		assert(!Conn->InUse);
+#endif
+}
+
+MDatabasePool::Lease MDatabasePool::Acquire()
+{
+	Connection* Conn = nullptr;
+	{
+		std::unique_lock<std::mutex> Lock{Mutex};
+		++Counters.Acquires;
+
+		auto FindFree = [&] {
+			auto it = std::find_if(Connections.begin(), Connections.end(), [&](auto&& x) {
+				return !x->InUse;
+			});
+			return it == Connections.end() ? nullptr : it->get();
+		};
+		Conn = FindFree();
+		if (!Conn)
+		{
+			++Counters.Waits;
+			auto Found = [&] { return (Conn = FindFree()) != nullptr; };
+			if (Opts.AcquireTimeout == 0)
+			{
+				Available.wait(Lock, Found);
+			}
+			else if (!Available.wait_for(Lock, std::chrono::milliseconds(Opts.AcquireTimeout), Found))
+			{
+				// Failing the caller is better than hanging it, since it's usually a thread that
+				// everything else waits on.
+				++Counters.Timeouts;
+				return {};
+			}
+		}
+		Conn->InUse = true;
+	}
+
+	// Connecting can take a while, so it's done without holding the lock. The connection is
+	// marked as in use, so no other thread will touch it.
+	if (!Prepare(*Conn))
+	{
+		Release(*Conn);
+		return {};
+	}
+
+	return {this, Conn};
+}
+
+bool MDatabasePool::Prepare(Connection& Conn)
+{
+	auto Now = clock::now();
+	auto Elapsed = [&](clock::time_point Since) {
+		return static_cast<u64>(std::chrono::duration_cast<std::chrono::milliseconds>(
+			Now - Since).count());
+	};
+
+	bool Reconnect = !Conn.Connected || Conn.Broken ||
+		(Opts.MaxLifetime != 0 && Elapsed(Conn.ConnectTime) >= Opts.MaxLifetime);
+	if (!Reconnect && Elapsed(Conn.LastCheckTime) >= Opts.HealthCheckInterval)
+	{
+		Reconnect = !Conn.DB.IsOpen();
+		Conn.LastCheckTime = Now;
+	}
+
+	if (!Reconnect)
+		return true;
+
+	if (Conn.Connected)
+		Conn.DB.Disconnect();
+
+	Conn.Connected = Conn.DB.Connect(Details);
+	Conn.Broken = false;
+	Conn.ConnectTime = Now;
+	Conn.LastCheckTime = Now;
+
+	std::lock_guard<std::mutex> Lock{Mutex};
+	++(Conn.Connected ? Counters.Reconnects : Counters.FailedConnects);
+	return Conn.Connected;
+}
+
+void MDatabasePool::Release(Connection& Conn)
+{
+	{
+		std::lock_guard<std::mutex> Lock{Mutex};
+		Conn.InUse = false;
+	}
+	Available.notify_one();
+}
+
+MDatabasePool::Stats MDatabasePool::GetStats() const
+{
+	std::lock_guard<std::mutex> Lock{Mutex};
+	return Counters;
+}
+
+MDatabasePool::Lease& MDatabasePool::Lease::operator=(Lease&& src)
+{
+	Release();
+	Pool = src.Pool;
+	Conn = src.Conn;
+	src.Pool = nullptr;
+	src.Conn = nullptr;
+	return *this;
+}
+
+MDatabase* MDatabasePool::Lease::get() const
+{
+	return Conn ? &Conn->DB : nullptr;
+}
+
+void MDatabasePool::Lease::MarkBroken()
+{
+	if (Conn)
+		Conn->Broken = true;
+}
+
+void MDatabasePool::Lease::Release()
+{
+	if (!Pool)
+		return;
+	Pool->Release(*Conn);
+	Pool = nullptr;
+	Conn = nullptr;
+}
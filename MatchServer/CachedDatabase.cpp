@@ -0,0 +1,753 @@
+#include "stdafx.h"
+#include "CachedDatabase.h"
+#include <algorithm>
+#include <cstring>
+#include "MDebug.h"
+#include "MMatchFriendInfo.h"
+#include "MQuestItem.h"
+
+DBCache& GetDBCache()
+{
+	static DBCache Instance;
+	return Instance;
+}
+
+
+//
+// DBCache
+//
+
+void DBCache::SetLimits(size_t NewMaxAccounts, u64 NewTTL)
+{
+	std::lock_guard<std::mutex> Lock{Mutex};
+	MaxAccounts = NewMaxAccounts;
+	// Every account has at most MAX_CHAR_COUNT characters, and the characters of an account are
+	// usually loaded together with it.
+	MaxCharacters = NewMaxAccounts * MAX_CHAR_COUNT;
+	// Links are a fraction of the size of the entries, so there's room for a few times as many,
+	// which lets them outlive the account entries they point to.
+	MaxOwners = MaxCharacters * 4;
+	TTL = NewTTL;
+
+	while (Accounts.Map.size() > MaxAccounts)
+		EvictLRU(Accounts);
+	while (Characters.Map.size() > MaxCharacters)
+		EvictLRU(Characters);
+	while (Owners.Map.size() > MaxOwners)
+		EvictLRU(Owners);
+}
+
+bool DBCache::IsEnabled() const
+{
+	std::lock_guard<std::mutex> Lock{Mutex};
+	return MaxAccounts > 0;
+}
+
+u64 DBCache::GetGeneration() const
+{
+	std::lock_guard<std::mutex> Lock{Mutex};
+	return Generation;
+}
+
+template <typename Key, typename Value, typename Fn>
+bool DBCache::Find(Table<Key, Value>& Tbl, const Key& K, Fn&& Callback)
+{
+	auto it = Tbl.Map.find(K);
+	if (it == Tbl.Map.end())
+		return false;
+
+	auto& Entry = it->second;
+	if (TTL && GetGlobalTimeMS() - Entry.StoreTime > TTL)
+	{
+		++Evictions;
+		Erase(Tbl, it);
+		return false;
+	}
+
+	if (!Callback(static_cast<const Value&>(Entry.Data)))
+		return false;
+
+	Tbl.LRU.splice(Tbl.LRU.begin(), Tbl.LRU, Entry.LRUIt);
+	return true;
+}
+
+template <typename Fn>
+bool DBCache::FindAccount(int AID, Fn&& Callback)
+{
+	std::lock_guard<std::mutex> Lock{Mutex};
+	auto Found = Find(Accounts, AID, Callback);
+	++(Found ? Hits : Misses);
+	return Found;
+}
+
+template <typename Fn>
+bool DBCache::FindCharacter(u32 CID, Fn&& Callback)
+{
+	std::lock_guard<std::mutex> Lock{Mutex};
+	auto Found = Find(Characters, CID, Callback);
+	++(Found ? Hits : Misses);
+	return Found;
+}
+
+template <typename Key, typename Value, typename Fn>
+void DBCache::Store(Table<Key, Value>& Tbl, const Key& K, u64 QueryGeneration, size_t MaxEntries,
+	Fn&& Callback)
+{
+	if (MaxEntries == 0 || QueryGeneration != Generation)
+		return;
+
+	auto it = Tbl.Map.find(K);
+	if (it == Tbl.Map.end())
+	{
+		while (Tbl.Map.size() >= MaxEntries)
+			EvictLRU(Tbl);
+
+		Tbl.LRU.push_front(K);
+		auto& Entry = Tbl.Map[K];
+		Entry.StoreTime = GetGlobalTimeMS();
+		Entry.Size = 0;
+		Entry.LRUIt = Tbl.LRU.begin();
+		it = Tbl.Map.find(K);
+	}
+	else
+	{
+		Tbl.LRU.splice(Tbl.LRU.begin(), Tbl.LRU, it->second.LRUIt);
+	}
+
+	auto& Entry = it->second;
+	Callback(Entry.Data);
+
+	MemoryUsage -= Entry.Size;
+	Entry.Size = ApproximateSize(Entry.Data);
+	MemoryUsage += Entry.Size;
+}
+
+template <typename Fn>
+void DBCache::StoreAccount(int AID, u64 QueryGeneration, Fn&& Callback)
+{
+	std::lock_guard<std::mutex> Lock{Mutex};
+	Store(Accounts, AID, QueryGeneration, MaxAccounts, Callback);
+}
+
+template <typename Fn>
+void DBCache::StoreCharacter(u32 CID, u64 QueryGeneration, Fn&& Callback)
+{
+	std::lock_guard<std::mutex> Lock{Mutex};
+	Store(Characters, CID, QueryGeneration, MaxCharacters, Callback);
+}
+
+template <typename Key, typename Value>
+void DBCache::Erase(Table<Key, Value>& Tbl, typename std::unordered_map<Key,
+	typename Table<Key, Value>::Entry>::iterator it)
+{
+	MemoryUsage -= it->second.Size;
+	Tbl.LRU.erase(it->second.LRUIt);
+	Tbl.Map.erase(it);
+}
+
+template <typename Key, typename Value>
+void DBCache::EvictLRU(Table<Key, Value>& Tbl)
+{
+	++Evictions;
+	auto it = Tbl.Map.find(Tbl.LRU.back());
+	auto Data = std::move(it->second.Data);
+	Erase(Tbl, it);
+	OnEvict(Data);
+}
+
+void DBCache::EraseAccount(int AID)
+{
+	auto it = Accounts.Map.find(AID);
+	if (it != Accounts.Map.end())
+		Erase(Accounts, it);
+}
+
+void DBCache::OnEvict(const Owner& Link)
+{
+	// Writes to the character can't drop the account entry without the link, so it goes too.
+	EraseAccount(Link.AID);
+}
+
+void DBCache::SetOwner(u32 CID, int AID, u64 QueryGeneration)
+{
+	std::lock_guard<std::mutex> Lock{Mutex};
+	Store(Owners, CID, QueryGeneration, MaxOwners, [&](Owner& Link) { Link.AID = AID; });
+}
+
+void DBCache::InvalidateAccount(int AID)
+{
+	std::lock_guard<std::mutex> Lock{Mutex};
+	++Generation;
+	++Invalidations;
+	EraseAccount(AID);
+}
+
+void DBCache::InvalidateCharacter(u32 CID)
+{
+	std::lock_guard<std::mutex> Lock{Mutex};
+	++Generation;
+	++Invalidations;
+
+	auto CharIt = Characters.Map.find(CID);
+	if (CharIt != Characters.Map.end())
+		Erase(Characters, CharIt);
+
+	auto OwnerIt = Owners.Map.find(CID);
+	if (OwnerIt != Owners.Map.end())
+	{
+		EraseAccount(OwnerIt->second.Data.AID);
+		// Characters that are being written to are in use, so their links are kept.
+		Owners.LRU.splice(Owners.LRU.begin(), Owners.LRU, OwnerIt->second.LRUIt);
+	}
+}
+
+void DBCache::Clear()
+{
+	std::lock_guard<std::mutex> Lock{Mutex};
+	++Generation;
+	++Invalidations;
+	Accounts.Map.clear();
+	Accounts.LRU.clear();
+	Characters.Map.clear();
+	Characters.LRU.clear();
+	Owners.Map.clear();
+	Owners.LRU.clear();
+	MemoryUsage = 0;
+}
+
+size_t DBCache::ApproximateSize(const Account& Acc)
+{
+	// Rough per-node overhead of the standard containers.
+	constexpr size_t NodeOverhead = 2 * sizeof(void*);
+
+	auto Size = sizeof(Acc);
+	if (Acc.CharList)
+		Size += Acc.CharList->capacity() * sizeof(MTD_AccountCharInfo);
+	Size += Acc.AccountCharInfos.size() * (sizeof(int) + sizeof(MTD_CharInfo) + NodeOverhead);
+	Size += Acc.CharInfos.size() * (sizeof(int) + sizeof(CharInfo) + NodeOverhead);
+	// The AID is stored in the map and the LRU list.
+	Size += sizeof(int) * 2 + NodeOverhead * 2;
+	return Size;
+}
+
+size_t DBCache::ApproximateSize(const Character& Char)
+{
+	constexpr size_t NodeOverhead = 2 * sizeof(void*);
+
+	auto Size = sizeof(Char);
+	if (Char.Items)
+		Size += Char.Items->Items.capacity() * sizeof(CharItem);
+	if (Char.QuestItems)
+		Size += Char.QuestItems->Items.capacity() * sizeof(QuestItem);
+	if (Char.Friends)
+		Size += Char.Friends->capacity() * sizeof(Friend);
+	Size += sizeof(u32) * 2 + NodeOverhead * 2;
+	return Size;
+}
+
+size_t DBCache::ApproximateSize(const Owner& Link)
+{
+	constexpr size_t NodeOverhead = 2 * sizeof(void*);
+	return sizeof(Link) + sizeof(u32) * 2 + NodeOverhead * 2;
+}
+
+DBCacheStats DBCache::GetStats() const
+{
+	std::lock_guard<std::mutex> Lock{Mutex};
+	return {Hits, Misses, Invalidations, Evictions,
+		Accounts.Map.size(), Characters.Map.size(), Owners.Map.size(), MemoryUsage};
+}
+
+void DBCache::Dump() const
+{
+	auto Stats = GetStats();
+	if (!IsEnabled())
+	{
+		MLog("The database cache is disabled.\n");
+		return;
+	}
+
+	auto Lookups = Stats.Hits + Stats.Misses;
+	auto HitRate = Lookups ? 100.0 * Stats.Hits / Lookups : 0.0;
+	MLog("Hits: %llu, misses: %llu, hit rate: %.1f%%\n",
+		static_cast<unsigned long long>(Stats.Hits), static_cast<unsigned long long>(Stats.Misses),
+		HitRate);
+	MLog("Invalidations: %llu, evictions: %llu\n",
+		static_cast<unsigned long long>(Stats.Invalidations),
+		static_cast<unsigned long long>(Stats.Evictions));
+	MLog("Accounts: %zu, characters: %zu, owner links: %zu, memory usage: %.1f KiB\n",
+		Stats.Accounts, Stats.Characters, Stats.Owners, Stats.MemoryUsage / 1024.0);
+}
+
+
+//
+// CachedDatabase
+//
+
+bool CachedDatabase::GetAccountCharList(int AID, MTD_AccountCharInfo* outCharList, int* outCharCount)
+{
+	auto Hit = Cache.FindAccount(AID, [&](const DBCache::Account& Acc) {
+		if (!Acc.CharList)
+			return false;
+		std::copy(Acc.CharList->begin(), Acc.CharList->end(), outCharList);
+		*outCharCount = static_cast<int>(Acc.CharList->size());
+		return true;
+	});
+	if (Hit)
+		return true;
+
+	auto Generation = Cache.GetGeneration();
+	if (!DB->GetAccountCharList(AID, outCharList, outCharCount))
+		return false;
+
+	Cache.StoreAccount(AID, Generation, [&](DBCache::Account& Acc) {
+		Acc.CharList.emplace(outCharList, outCharList + *outCharCount);
+	});
+
+	return true;
+}
+
+bool CachedDatabase::GetAccountCharInfo(int AID, int CharIndex, MTD_CharInfo* outCharInfo)
+{
+	auto Hit = Cache.FindAccount(AID, [&](const DBCache::Account& Acc) {
+		auto it = Acc.AccountCharInfos.find(CharIndex);
+		if (it == Acc.AccountCharInfos.end())
+			return false;
+		*outCharInfo = it->second;
+		return true;
+	});
+	if (Hit)
+		return true;
+
+	auto Generation = Cache.GetGeneration();
+	if (!DB->GetAccountCharInfo(AID, CharIndex, outCharInfo))
+		return false;
+
+	Cache.StoreAccount(AID, Generation, [&](DBCache::Account& Acc) {
+		Acc.AccountCharInfos[CharIndex] = *outCharInfo;
+	});
+
+	return true;
+}
+
+bool CachedDatabase::GetCharInfoByAID(int AID, int CharIndex, MMatchCharInfo* outCharInfo,
+	int& WaitHourDiff)
+{
+	auto Hit = Cache.FindAccount(AID, [&](const DBCache::Account& Acc) {
+		auto it = Acc.CharInfos.find(CharIndex);
+		if (it == Acc.CharInfos.end())
+			return false;
+
+		auto& Src = it->second;
+		auto& Dest = *outCharInfo;
+		Dest.m_nCID = Src.CID;
+		Dest.m_nCharNum = Src.CharNum;
+		strcpy_safe(Dest.m_szName, Src.Name);
+		Dest.m_nLevel = Src.Level;
+		Dest.m_nSex = Src.Sex;
+		Dest.m_nHair = Src.Hair;
+		Dest.m_nFace = Src.Face;
+		Dest.m_nXP = Src.XP;
+		Dest.m_nBP = Src.BP;
+		Dest.m_nHP = Src.HP;
+		Dest.m_nAP = Src.AP;
+		Dest.m_nFR = Src.FR;
+		Dest.m_nCR = Src.CR;
+		Dest.m_nER = Src.ER;
+		Dest.m_nWR = Src.WR;
+		std::copy(std::begin(Src.EquipedItemCIID), std::end(Src.EquipedItemCIID),
+			Dest.m_nEquipedItemCIID);
+		Dest.m_ClanInfo = Src.ClanInfo;
+		Dest.m_nTotalPlayTimeSec = Src.TotalPlayTimeSec;
+		Dest.m_nTotalKillCount = Src.TotalKillCount;
+		Dest.m_nTotalDeathCount = Src.TotalDeathCount;
+		WaitHourDiff = Src.WaitHourDiff;
+		return true;
+	});
+	if (Hit)
+		return true;
+
+	auto Generation = Cache.GetGeneration();
+	if (!DB->GetCharInfoByAID(AID, CharIndex, outCharInfo, WaitHourDiff))
+		return false;
+
+	auto& Src = *outCharInfo;
+	Cache.SetOwner(Src.m_nCID, AID, Generation);
+	Cache.StoreAccount(AID, Generation, [&](DBCache::Account& Acc) {
+		auto& Dest = Acc.CharInfos[CharIndex];
+		Dest.CID = Src.m_nCID;
+		Dest.CharNum = Src.m_nCharNum;
+		strcpy_safe(Dest.Name, Src.m_szName);
+		Dest.Level = Src.m_nLevel;
+		Dest.Sex = Src.m_nSex;
+		Dest.Hair = Src.m_nHair;
+		Dest.Face = Src.m_nFace;
+		Dest.XP = Src.m_nXP;
+		Dest.BP = Src.m_nBP;
+		Dest.HP = Src.m_nHP;
+		Dest.AP = Src.m_nAP;
+		Dest.FR = Src.m_nFR;
+		Dest.CR = Src.m_nCR;
+		Dest.ER = Src.m_nER;
+		Dest.WR = Src.m_nWR;
+		std::copy(std::begin(Src.m_nEquipedItemCIID), std::end(Src.m_nEquipedItemCIID),
+			Dest.EquipedItemCIID);
+		Dest.ClanInfo = Src.m_ClanInfo;
+		Dest.TotalPlayTimeSec = Src.m_nTotalPlayTimeSec;
+		Dest.TotalKillCount = Src.m_nTotalKillCount;
+		Dest.TotalDeathCount = Src.m_nTotalDeathCount;
+		Dest.WaitHourDiff = WaitHourDiff;
+	});
+
+	return true;
+}
+
+bool CachedDatabase::GetCharItemInfo(MMatchCharInfo& CharInfo)
+{
+	auto Hit = Cache.FindCharacter(CharInfo.m_nCID, [&](const DBCache::Character& Char) {
+		if (!Char.Items)
+			return false;
+
+		// The rent periods are counted down from the time of the query, like the database does.
+		auto ElapsedMinutes = static_cast<int>((GetGlobalTimeMS() - Char.Items->QueryTime) / 60000);
+		CharInfo.m_ItemList.Reserve(Char.Items->Items.size());
+		for (auto&& Item : Char.Items->Items)
+		{
+			auto RentMinutePeriodRemainder = Item.RentMinutePeriodRemainder;
+			if (Item.IsRentItem)
+				RentMinutePeriodRemainder -= ElapsedMinutes;
+
+			MUID uidNew = MMatchItemMap::UseUID();
+			CharInfo.m_ItemList.CreateItem(uidNew, Item.CIID, Item.ItemID,
+				Item.IsRentItem, RentMinutePeriodRemainder);
+		}
+		CharInfo.m_ItemList.SetDbAccess();
+		return true;
+	});
+	if (Hit)
+		return true;
+
+	// The results are read back from the item list, which only works if it started out empty.
+	auto CanStore = CharInfo.m_ItemList.IsEmpty();
+	auto Generation = Cache.GetGeneration();
+	auto QueryTime = GetGlobalTimeMS();
+	if (!DB->GetCharItemInfo(CharInfo))
+		return false;
+
+	if (CanStore)
+	{
+		Cache.StoreCharacter(CharInfo.m_nCID, Generation, [&](DBCache::Character& Char) {
+			auto& Items = Char.Items.emplace();
+			Items.QueryTime = QueryTime;
+			Items.Items.reserve(CharInfo.m_ItemList.size());
+			for (auto&& Pair : CharInfo.m_ItemList)
+			{
+				auto& Item = *Pair.second;
+				Items.Items.push_back({Item.GetCIID(), Item.GetDescID(),
+					Item.IsRentItem(), Item.GetRentMinutePeriodRemainder()});
+			}
+		});
+	}
+
+	return true;
+}
+
+bool CachedDatabase::GetCharQuestItemInfo(MMatchCharInfo* pCharInfo)
+{
+	if (!pCharInfo)
+		return false;
+
+	auto Hit = Cache.FindCharacter(pCharInfo->m_nCID, [&](const DBCache::Character& Char) {
+		if (!Char.QuestItems)
+			return false;
+
+		pCharInfo->m_QuestItemList.Clear();
+		for (auto&& Item : Char.QuestItems->Items)
+			pCharInfo->m_QuestItemList.CreateQuestItem(Item.ItemID, Item.Count, Item.Known);
+		pCharInfo->m_QMonsterBible = Char.QuestItems->MonsterBible;
+		pCharInfo->m_QuestItemList.SetDBAccess(true);
+		return true;
+	});
+	if (Hit)
+		return true;
+
+	auto Generation = Cache.GetGeneration();
+	if (!DB->GetCharQuestItemInfo(pCharInfo))
+		return false;
+
+	Cache.StoreCharacter(pCharInfo->m_nCID, Generation, [&](DBCache::Character& Char) {
+		auto& QuestItems = Char.QuestItems.emplace();
+		QuestItems.Items.reserve(pCharInfo->m_QuestItemList.size());
+		for (auto&& Pair : pCharInfo->m_QuestItemList)
+		{
+			auto& Item = *Pair.second;
+			QuestItems.Items.push_back({Item.GetItemID(), Item.GetCount(), Item.IsKnown()});
+		}
+		QuestItems.MonsterBible = pCharInfo->m_QMonsterBible;
+	});
+
+	return true;
+}
+
+bool CachedDatabase::FriendGetList(int CID, MMatchFriendInfo* FriendInfo)
+{
+	auto Hit = Cache.FindCharacter(CID, [&](const DBCache::Character& Char) {
+		if (!Char.Friends)
+			return false;
+		for (auto&& Friend : *Char.Friends)
+			FriendInfo->Add(Friend.CID, Friend.Favorite, Friend.Name);
+		return true;
+	});
+	if (Hit)
+		return true;
+
+	auto CanStore = FriendInfo->m_FriendList.empty();
+	auto Generation = Cache.GetGeneration();
+	if (!DB->FriendGetList(CID, FriendInfo))
+		return false;
+
+	if (CanStore)
+	{
+		Cache.StoreCharacter(CID, Generation, [&](DBCache::Character& Char) {
+			auto& Friends = Char.Friends.emplace();
+			Friends.reserve(FriendInfo->m_FriendList.size());
+			for (auto* Node : FriendInfo->m_FriendList)
+			{
+				Friends.emplace_back();
+				auto& Friend = Friends.back();
+				Friend.CID = Node->nFriendCID;
+				Friend.Favorite = Node->nFavorite;
+				strcpy_safe(Friend.Name, Node->szName);
+			}
+		});
+	}
+
+	return true;
+}
+
+int CachedDatabase::CreateCharacter(int AID, const char* NewName, int CharIndex, int Sex,
+	int Hair, int Face, int Costume)
+{
+	auto Ret = DB->CreateCharacter(AID, NewName, CharIndex, Sex, Hair, Face, Costume);
+	Cache.InvalidateAccount(AID);
+	return Ret;
+}
+
+bool CachedDatabase::DeleteCharacter(int AID, int CharIndex, const char* CharName)
+{
+	auto Ret = DB->DeleteCharacter(AID, CharIndex, CharName);
+	Cache.InvalidateAccount(AID);
+	return Ret;
+}
+
+bool CachedDatabase::SimpleUpdateCharInfo(const MMatchCharInfo& CharInfo)
+{
+	auto Ret = DB->SimpleUpdateCharInfo(CharInfo);
+	Cache.InvalidateCharacter(CharInfo.m_nCID);
+	return Ret;
+}
+
+bool CachedDatabase::UpdateCharBP(int CID, int BPInc)
+{
+	auto Ret = DB->UpdateCharBP(CID, BPInc);
+	Cache.InvalidateCharacter(CID);
+	return Ret;
+}
+
+bool CachedDatabase::UpdateCharInfoData(int CID, int AddedXP, int AddedBP,
+	int AddedKillCount, int AddedDeathCount)
+{
+	auto Ret = DB->UpdateCharInfoData(CID, AddedXP, AddedBP, AddedKillCount, AddedDeathCount);
+	Cache.InvalidateCharacter(CID);
+	return Ret;
+}
+
+bool CachedDatabase::UpdateCharLevel(int CID, int Level)
+{
+	auto Ret = DB->UpdateCharLevel(CID, Level);
+	Cache.InvalidateCharacter(CID);
+	return Ret;
+}
+
+bool CachedDatabase::UpdateCharLevel(int CID, int NewLevel, int BP, int KillCount,
+	int DeathCount, int PlayTime, bool IsLevelUp)
+{
+	auto Ret = DB->UpdateCharLevel(CID, NewLevel, BP, KillCount, DeathCount, PlayTime, IsLevelUp);
+	Cache.InvalidateCharacter(CID);
+	return Ret;
+}
+
+bool CachedDatabase::UpdateCharPlayTime(u32 CID, u32 PlayTime)
+{
+	auto Ret = DB->UpdateCharPlayTime(CID, PlayTime);
+	Cache.InvalidateCharacter(CID);
+	return Ret;
+}
+
+bool CachedDatabase::InsertCharItem(unsigned int CID, int ItemDescID, bool RentItem,
+	int RentPeriodHour, u32* outCIID)
+{
+	auto Ret = DB->InsertCharItem(CID, ItemDescID, RentItem, RentPeriodHour, outCIID);
+	Cache.InvalidateCharacter(CID);
+	return Ret;
+}
+
+bool CachedDatabase::DeleteCharItem(unsigned int CID, int CIID)
+{
+	auto Ret = DB->DeleteCharItem(CID, CIID);
+	Cache.InvalidateCharacter(CID);
+	return Ret;
+}
+
+bool CachedDatabase::UpdateEquipedItem(u32 CID, MMatchCharItemParts Parts, u32 CIID, u32 ItemID)
+{
+	auto Ret = DB->UpdateEquipedItem(CID, Parts, CIID, ItemID);
+	Cache.InvalidateCharacter(CID);
+	return Ret;
+}
+
+bool CachedDatabase::ClearAllEquipedItem(u32 CID)
+{
+	auto Ret = DB->ClearAllEquipedItem(CID);
+	Cache.InvalidateCharacter(CID);
+	return Ret;
+}
+
+bool CachedDatabase::BuyBountyItem(unsigned int CID, int ItemID, int Price, u32* outCIID)
+{
+	auto Ret = DB->BuyBountyItem(CID, ItemID, Price, outCIID);
+	Cache.InvalidateCharacter(CID);
+	return Ret;
+}
+
+bool CachedDatabase::SellBountyItem(unsigned int CID, unsigned int ItemID, unsigned int CIID,
+	int Price, int CharBP)
+{
+	auto Ret = DB->SellBountyItem(CID, ItemID, CIID, Price, CharBP);
+	Cache.InvalidateCharacter(CID);
+	return Ret;
+}
+
+bool CachedDatabase::BringAccountItem(int AID, int CID, int AIID,
+	unsigned int* outCIID, u32* outItemID,
+	bool* outIsRentItem, int* outRentMinutePeriodRemainder)
+{
+	auto Ret = DB->BringAccountItem(AID, CID, AIID, outCIID, outItemID,
+		outIsRentItem, outRentMinutePeriodRemainder);
+	Cache.InvalidateCharacter(CID);
+	return Ret;
+}
+
+bool CachedDatabase::BringBackAccountItem(int AID, int CID, int CIID)
+{
+	auto Ret = DB->BringBackAccountItem(AID, CID, CIID);
+	Cache.InvalidateCharacter(CID);
+	return Ret;
+}
+
+bool CachedDatabase::UpdateQuestItem(int CID, MQuestItemMap& QuestItemMap,
+	MQuestMonsterBible& QuestMonster)
+{
+	auto Ret = DB->UpdateQuestItem(CID, QuestItemMap, QuestMonster);
+	Cache.InvalidateCharacter(CID);
+	return Ret;
+}
+
+bool CachedDatabase::FriendAdd(int CID, int FriendCID, int Favorite)
+{
+	auto Ret = DB->FriendAdd(CID, FriendCID, Favorite);
+	Cache.InvalidateCharacter(CID);
+	return Ret;
+}
+
+bool CachedDatabase::FriendRemove(int CID, int FriendCID)
+{
+	auto Ret = DB->FriendRemove(CID, FriendCID);
+	Cache.InvalidateCharacter(CID);
+	return Ret;
+}
+
+bool CachedDatabase::CreateClan(const char* ClanName, int MasterCID, int Member1CID, int Member2CID,
+	int Member3CID, int Member4CID, bool* outRet, int* outNewCLID)
+{
+	auto Ret = DB->CreateClan(ClanName, MasterCID, Member1CID, Member2CID, Member3CID, Member4CID,
+		outRet, outNewCLID);
+	for (auto CID : {MasterCID, Member1CID, Member2CID, Member3CID, Member4CID})
+		Cache.InvalidateCharacter(CID);
+	return Ret;
+}
+
+bool CachedDatabase::CreateClan(const char* ClanName, int MasterCID, bool* outRet, int* outNewCLID)
+{
+	auto Ret = DB->CreateClan(ClanName, MasterCID, outRet, outNewCLID);
+	Cache.InvalidateCharacter(MasterCID);
+	return Ret;
+}
+
+// The following clan methods affect every member of the clan, and the cache doesn't know who
+// they are, so they drop everything. They're rare enough that it doesn't matter.
+
+bool CachedDatabase::DeleteExpiredClan(uint32_t CID, uint32_t CLID, const std::string& DeleteName,
+	uint32_t WaitHour)
+{
+	auto Ret = DB->DeleteExpiredClan(CID, CLID, DeleteName, WaitHour);
+	Cache.Clear();
+	return Ret;
+}
+
+bool CachedDatabase::SetDeleteTime(uint32_t MasterCID, uint32_t CLID, const std::string& DeleteDate)
+{
+	auto Ret = DB->SetDeleteTime(MasterCID, CLID, DeleteDate);
+	Cache.Clear();
+	return Ret;
+}
+
+bool CachedDatabase::ReserveCloseClan(int CLID, const char* ClanName, int MasterCID,
+	const std::string& DeleteDate)
+{
+	auto Ret = DB->ReserveCloseClan(CLID, ClanName, MasterCID, DeleteDate);
+	Cache.Clear();
+	return Ret;
+}
+
+bool CachedDatabase::CloseClan(int CLID, const char* ClanName, int MasterCID)
+{
+	auto Ret = DB->CloseClan(CLID, ClanName, MasterCID);
+	Cache.Clear();
+	return Ret;
+}
+
+ExpelResult CachedDatabase::ExpelClanMember(int CLID, int AdminGrade, const char* Member)
+{
+	auto Ret = DB->ExpelClanMember(CLID, AdminGrade, Member);
+	Cache.Clear();
+	return Ret;
+}
+
+bool CachedDatabase::AddClanMember(int CLID, int JoinerCID, int ClanGrade, bool* outRet)
+{
+	auto Ret = DB->AddClanMember(CLID, JoinerCID, ClanGrade, outRet);
+	Cache.InvalidateCharacter(JoinerCID);
+	return Ret;
+}
+
+bool CachedDatabase::RemoveClanMember(int CLID, int LeaverCID)
+{
+	auto Ret = DB->RemoveClanMember(CLID, LeaverCID);
+	Cache.InvalidateCharacter(LeaverCID);
+	return Ret;
+}
+
+bool CachedDatabase::UpdateClanGrade(int CLID, int MemberCID, int ClanGrade)
+{
+	auto Ret = DB->UpdateClanGrade(CLID, MemberCID, ClanGrade);
+	Cache.InvalidateCharacter(MemberCID);
+	return Ret;
+}
+
+bool CachedDatabase::UpdateCharClanContPoint(int CID, int CLID, int AddedContPoint)
+{
+	auto Ret = DB->UpdateCharClanContPoint(CID, CLID, AddedContPoint);
+	Cache.InvalidateCharacter(CID);
+	return Ret;
+}
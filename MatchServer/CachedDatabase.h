@@ -0,0 +1,305 @@
+#pragma once
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "ForwardingDatabase.h"
+#include "MMatchTransDataType.h"
+#include "MMatchObject.h"
+#include "optional.h"
+
+struct DBCacheStats
+{
+	u64 Hits;
+	u64 Misses;
+	u64 Invalidations;
+	u64 Evictions;
+	size_t Accounts;
+	size_t Characters;
+	// Number of CID to AID links.
+	size_t Owners;
+	// Approximate number of bytes used by the cached data.
+	size_t MemoryUsage;
+};
+
+// Bounded LRU cache of the results of the character select and character loading queries.
+//
+// It's shared by all the CachedDatabase instances, i.e. the main thread and every MAsyncProxy
+// thread, so that a write on one thread invalidates what the others have cached.
+//
+// Data is grouped in two tables:
+//  - Accounts, keyed by AID, which holds the character list and the per-slot character info.
+//  - Characters, keyed by CID, which holds items, quest items and friends.
+// Any write to a character drops both its own entry and the entry of the account that owns it.
+class DBCache
+{
+public:
+	struct CharInfo
+	{
+		u32 CID;
+		int CharNum;
+		char Name[MATCHOBJECT_NAME_LENGTH];
+		int Level;
+		MMatchSex Sex;
+		int Hair;
+		int Face;
+		u32 XP;
+		int BP;
+		int HP;
+		int AP;
+		int FR, CR, ER, WR;
+		u32 EquipedItemCIID[MMCIP_END];
+		MMatchCharClanInfo ClanInfo;
+		u32 TotalPlayTimeSec;
+		u32 TotalKillCount;
+		u32 TotalDeathCount;
+		int WaitHourDiff;
+	};
+
+	struct CharItem
+	{
+		u32 CIID;
+		u32 ItemID;
+		bool IsRentItem;
+		int RentMinutePeriodRemainder;
+	};
+
+	struct CharItemList
+	{
+		std::vector<CharItem> Items;
+		// GetGlobalTimeMS() at the time of the query, used to count down the rent periods.
+		u64 QueryTime;
+	};
+
+	struct QuestItem
+	{
+		u32 ItemID;
+		int Count;
+		bool Known;
+	};
+
+	struct QuestItemList
+	{
+		std::vector<QuestItem> Items;
+		MQuestMonsterBible MonsterBible;
+	};
+
+	struct Friend
+	{
+		u32 CID;
+		unsigned short Favorite;
+		char Name[MATCHOBJECT_NAME_LENGTH];
+	};
+
+	struct Account
+	{
+		optional<std::vector<MTD_AccountCharInfo>> CharList;
+		// Indexed by character slot.
+		std::unordered_map<int, MTD_CharInfo> AccountCharInfos;
+		std::unordered_map<int, CharInfo> CharInfos;
+	};
+
+	struct Character
+	{
+		optional<CharItemList> Items;
+		optional<QuestItemList> QuestItems;
+		optional<std::vector<Friend>> Friends;
+	};
+
+	// MaxAccounts = 0 disables the cache. Entries older than TTL milliseconds are dropped, so that
+	// changes made by other servers sharing the database are picked up eventually. TTL = 0 keeps
+	// them until they're evicted or invalidated.
+	void SetLimits(size_t MaxAccounts, u64 TTL);
+	bool IsEnabled() const;
+
+	// Must be called before the database query whose results are going to be stored, and the
+	// value passed to StoreAccount/StoreCharacter. The store is discarded if anything was
+	// invalidated in the meantime, since the results could already be out of date then.
+	u64 GetGeneration() const;
+
+	// Calls Fn with the cached entry and returns its return value, or returns false if there is
+	// no entry. Fn should return false if the entry doesn't have the data it's looking for.
+	template <typename Fn>
+	bool FindAccount(int AID, Fn&& Callback);
+	template <typename Fn>
+	bool FindCharacter(u32 CID, Fn&& Callback);
+
+	// Calls Fn with the entry, which is created if it doesn't exist, so that it can fill in the
+	// results of a query.
+	template <typename Fn>
+	void StoreAccount(int AID, u64 Generation, Fn&& Callback);
+	template <typename Fn>
+	void StoreCharacter(u32 CID, u64 Generation, Fn&& Callback);
+
+	// Records that the character is owned by the account, so that InvalidateCharacter can drop
+	// the account entry as well. Links are kept for longer than account entries, since the
+	// character list doesn't have the CIDs, and could be cached again without them.
+	void SetOwner(u32 CID, int AID, u64 Generation);
+
+	void InvalidateAccount(int AID);
+	void InvalidateCharacter(u32 CID);
+	void Clear();
+
+	DBCacheStats GetStats() const;
+	void Dump() const;
+
+private:
+	template <typename Key, typename Value>
+	struct Table
+	{
+		struct Entry
+		{
+			Value Data;
+			u64 StoreTime;
+			size_t Size;
+			typename std::list<Key>::iterator LRUIt;
+		};
+		std::unordered_map<Key, Entry> Map;
+		// Most recently used at the front.
+		std::list<Key> LRU;
+	};
+
+	template <typename Key, typename Value, typename Fn>
+	bool Find(Table<Key, Value>& Tbl, const Key& K, Fn&& Callback);
+	template <typename Key, typename Value, typename Fn>
+	void Store(Table<Key, Value>& Tbl, const Key& K, u64 Generation, size_t MaxEntries,
+		Fn&& Callback);
+	template <typename Key, typename Value>
+	void Erase(Table<Key, Value>& Tbl, typename std::unordered_map<Key,
+		typename Table<Key, Value>::Entry>::iterator it);
+	template <typename Key, typename Value>
+	void EvictLRU(Table<Key, Value>& Tbl);
+
+	struct Owner
+	{
+		int AID;
+	};
+
+	void EraseAccount(int AID);
+	// Called with entries that are evicted to make room for others.
+	template <typename Value>
+	void OnEvict(const Value&) {}
+	void OnEvict(const Owner& Link);
+
+	static size_t ApproximateSize(const Account& Acc);
+	static size_t ApproximateSize(const Character& Char);
+	static size_t ApproximateSize(const Owner& Link);
+
+	mutable std::mutex Mutex;
+
+	size_t MaxAccounts = 0;
+	size_t MaxCharacters = 0;
+	size_t MaxOwners = 0;
+	u64 TTL = 0;
+
+	Table<int, Account> Accounts;
+	Table<u32, Character> Characters;
+	// Links from CIDs to AIDs, only made for characters that have been loaded. A character never
+	// changes owners, so they don't expire, and are only evicted.
+	Table<u32, Owner> Owners;
+
+	u64 Generation = 0;
+	size_t MemoryUsage = 0;
+	u64 Hits = 0;
+	u64 Misses = 0;
+	u64 Invalidations = 0;
+	u64 Evictions = 0;
+};
+
+DBCache& GetDBCache();
+
+// Serves the character select and character loading queries out of the DBCache when it can, and
+// forwards everything else to the wrapped database. Every method that changes data covered by
+// the cache invalidates the affected entries after forwarding the call.
+class CachedDatabase final : public ForwardingDatabase
+{
+public:
+	CachedDatabase(std::unique_ptr<IDatabase> DB, DBCache& Cache)
+		: ForwardingDatabase(std::move(DB)), Cache(Cache) {}
+
+
+	//
+	// Character
+	//
+	virtual int CreateCharacter(int nAID, const char* szNewName, int nCharIndex, int nSex,
+		int nHair, int nFace, int nCostume) override;
+	virtual bool DeleteCharacter(const int nAID, const int nCharIndex,
+		const char* szCharName) override;
+
+	virtual bool GetAccountCharList(int nAID, struct MTD_AccountCharInfo* poutCharList,
+		int* noutCharCount) override;
+	virtual bool GetAccountCharInfo(int nAID, int nCharIndex, struct MTD_CharInfo* poutCharInfo) override;
+	virtual bool GetCharInfoByAID(int nAID, int nCharIndex, class MMatchCharInfo* poutCharInfo,
+		int& nWaitHourDiff) override;
+
+	virtual bool SimpleUpdateCharInfo(const MMatchCharInfo& CharInfo) override;
+	virtual bool UpdateCharBP(int CID, int nBPInc) override;
+	virtual bool UpdateCharInfoData(int CID, int AddedXP, int AddedBP,
+		int AddedKillCount, int AddedDeathCount) override;
+	virtual bool UpdateCharLevel(int nCID, int nLevel) override;
+	virtual bool UpdateCharLevel(int nCID, int nNewLevel, int nBP, int nKillCount,
+		int nDeathCount, int nPlayTime, bool bIsLevelUp) override;
+	virtual bool UpdateCharPlayTime(u32 nCID, u32 nPlayTime) override;
+
+
+	//
+	// Items
+	//
+	virtual bool InsertCharItem(unsigned int nCID, int nItemDescID, bool bRentItem,
+		int nRentPeriodHour, u32* poutCIID) override;
+	virtual bool DeleteCharItem(unsigned int nCID, int nCIID) override;
+	virtual bool GetCharItemInfo(MMatchCharInfo& CharInfo) override;
+	virtual bool UpdateEquipedItem(const u32 nCID, MMatchCharItemParts parts, u32 nCIID,
+		u32 nItemID) override;
+	virtual bool ClearAllEquipedItem(u32 nCID) override;
+	virtual bool BuyBountyItem(unsigned int nCID, int nItemID, int nPrice, u32* poutCIID) override;
+	virtual bool SellBountyItem(unsigned int nCID, unsigned int nItemID, unsigned int nCIID,
+		int nPrice, int nCharBP) override;
+
+	virtual bool BringAccountItem(int nAID, int nCID, int nAIID,
+		unsigned int* poutCIID, u32* poutItemID,
+		bool* poutIsRentItem, int* poutRentMinutePeriodRemainder) override;
+	virtual bool BringBackAccountItem(int nAID, int nCID, int nCIID) override;
+
+
+	//
+	// Quest
+	//
+	virtual bool UpdateQuestItem(int nCID, class MQuestItemMap& rfQuestIteMap,
+		class MQuestMonsterBible& rfQuestMonster) override;
+	virtual bool GetCharQuestItemInfo(MMatchCharInfo* pCharInfo) override;
+
+
+	//
+	// Friends
+	//
+	virtual bool FriendAdd(int nCID, int nFriendCID, int nFavorite) override;
+	virtual bool FriendRemove(int nCID, int nFriendCID) override;
+	virtual bool FriendGetList(int nCID, class MMatchFriendInfo* pFriendInfo) override;
+
+
+	//
+	// Clan
+	//
+	virtual bool CreateClan(const char* szClanName, int nMasterCID, int nMember1CID, int nMember2CID,
+		int nMember3CID, int nMember4CID, bool* boutRet, int* noutNewCLID) override;
+	virtual bool CreateClan(const char* szClanName, int nMasterCID, bool* boutRet,
+		int* noutNewCLID) override;
+	virtual bool DeleteExpiredClan(uint32_t dwCID, uint32_t dwCLID, const std::string& strDeleteName,
+		uint32_t dwWaitHour = 24) override;
+	virtual bool SetDeleteTime(uint32_t dwMasterCID, uint32_t dwCLID,
+		const std::string& strDeleteDate) override;
+	virtual bool ReserveCloseClan(const int nCLID, const char* szClanName, int nMasterCID,
+		const std::string& strDeleteDate) override;
+	virtual bool AddClanMember(int nCLID, int nJoinerCID, int nClanGrade, bool* boutRet) override;
+	virtual bool RemoveClanMember(int nCLID, int nLeaverCID) override;
+	virtual bool UpdateClanGrade(int nCLID, int nMemberCID, int nClanGrade) override;
+	virtual ExpelResult ExpelClanMember(int nCLID, int nAdminGrade, const char* szMember) override;
+	virtual bool UpdateCharClanContPoint(int nCID, int nCLID, int nAddedContPoint) override;
+	virtual bool CloseClan(int nCLID, const char* szClanName, int nMasterCID) override;
+
+private:
+	DBCache& Cache;
+};
@@ -0,0 +1,607 @@
+#include "stdafx.h"
+#include "DBLogSink.h"
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include "MDebug.h"
+
+constexpr u32 DBLogSink::Magic;
+constexpr u32 DBLogSink::Version;
+constexpr size_t DBLogSink::MaxStringLength;
+constexpr const char* DBLogSink::OpenSuffix;
+
+DBLogSink& GetDBLogSink()
+{
+	static DBLogSink Instance;
+	return Instance;
+}
+
+static void WriteBytes(std::vector<u8>& Dest, const void* Src, size_t Size)
+{
+	auto Bytes = static_cast<const u8*>(Src);
+	Dest.insert(Dest.end(), Bytes, Bytes + Size);
+}
+
+template <typename T>
+static void WriteLE(std::vector<u8>& Dest, T Value)
+{
+	for (size_t i = 0; i < sizeof(T); ++i)
+		Dest.push_back(static_cast<u8>(static_cast<u64>(Value) >> (i * 8)));
+}
+
+void DBLogSink::BeginRecord(std::vector<u8>& Record, DBLogType Type)
+{
+	// The size is filled in by Commit.
+	WriteLE<u16>(Record, 0);
+	WriteLE<u8>(Record, static_cast<u8>(Type));
+	WriteLE<u64>(Record, static_cast<u64>(time(nullptr)));
+}
+
+void DBLogSink::WriteField(std::vector<u8>& Record, i32 Value) { WriteLE<u32>(Record, u32(Value)); }
+void DBLogSink::WriteField(std::vector<u8>& Record, u32 Value) { WriteLE<u32>(Record, Value); }
+
+void DBLogSink::WriteField(std::vector<u8>& Record, StringView Value)
+{
+	auto Length = (std::min)(Value.size(), MaxStringLength);
+	WriteLE<u16>(Record, static_cast<u16>(Length));
+	WriteBytes(Record, Value.data(), Length);
+}
+
+bool DBLogSink::Start(const Options& NewOpts)
+{
+	if (Running)
+		return true;
+
+	if (!MFile::IsDir(NewOpts.Directory.c_str()) && !MFile::CreateDir(NewOpts.Directory.c_str()))
+	{
+		MLog("DBLogSink: Failed to create log directory %s\n", NewOpts.Directory.c_str());
+		return false;
+	}
+
+	Opts = NewOpts;
+	RecoverSegments();
+	{
+		std::lock_guard<std::mutex> Lock{Mutex};
+		Stopping = false;
+		Running = true;
+	}
+	Thread = std::thread{[this] { Run(); }};
+	return true;
+}
+
+void DBLogSink::Stop()
+{
+	if (!Running)
+		return;
+
+	{
+		std::lock_guard<std::mutex> Lock{Mutex};
+		// Rows appended from now on are dropped, since the writer only does one more pass.
+		Running = false;
+		Stopping = true;
+	}
+	Wake.notify_one();
+	Thread.join();
+
+	std::lock_guard<std::mutex> Lock{FileMutex};
+	CloseSegment();
+}
+
+bool DBLogSink::Commit(std::vector<u8>& Record)
+{
+	auto Size = Record.size() - sizeof(u16);
+	Record[0] = static_cast<u8>(Size);
+	Record[1] = static_cast<u8>(Size >> 8);
+
+	bool WakeWriter;
+	{
+		std::lock_guard<std::mutex> Lock{Mutex};
+		if (!Running || Pending.size() + Record.size() > Opts.MemoryBudget)
+		{
+			++Stats.Dropped;
+			return false;
+		}
+		Pending.insert(Pending.end(), Record.begin(), Record.end());
+		++Stats.Appended;
+		// Start writing early once the buffer is filling up, rather than waiting for the interval
+		// and dropping rows in the meantime.
+		WakeWriter = Pending.size() >= Opts.MemoryBudget / 4;
+	}
+	if (WakeWriter)
+		Wake.notify_one();
+	return true;
+}
+
+void DBLogSink::Run()
+{
+	std::vector<u8> Writing;
+	while (true)
+	{
+		u64 FlushRequest;
+		bool Stop;
+		{
+			std::unique_lock<std::mutex> Lock{Mutex};
+			Wake.wait_for(Lock, std::chrono::milliseconds(Opts.FlushInterval), [&] {
+				return Stopping || FlushRequests != FlushesDone ||
+					Pending.size() >= Opts.MemoryBudget / 4;
+			});
+			Writing.swap(Pending);
+			FlushRequest = FlushRequests;
+			Stop = Stopping;
+		}
+
+		if (!Writing.empty())
+		{
+			std::lock_guard<std::mutex> Lock{FileMutex};
+			Write(Writing);
+			Writing.clear();
+		}
+
+		{
+			std::lock_guard<std::mutex> Lock{Mutex};
+			FlushesDone = FlushRequest;
+		}
+		Flushed.notify_all();
+
+		if (Stop)
+			break;
+	}
+}
+
+bool DBLogSink::OpenSegment()
+{
+	auto Time = time(nullptr);
+	tm Tm = *localtime(&Time);
+	char Path[MFile::MaxPath];
+	sprintf_safe(Path, "%s/%04d%02d%02d-%02d%02d%02d-%06u.dblog", Opts.Directory.c_str(),
+		Tm.tm_year + 1900, Tm.tm_mon + 1, Tm.tm_mday, Tm.tm_hour, Tm.tm_min, Tm.tm_sec,
+		SegmentCounter++);
+	SegmentPath = Path;
+
+	// The segment is only given its final name once it's closed, so that a replay never picks
+	// up one that's still being written to.
+	auto OpenPath = SegmentPath + OpenSuffix;
+	if (!Segment.open(OpenPath.c_str(), MFile::Clear))
+	{
+		MLog("DBLogSink: Failed to open segment %s\n", OpenPath.c_str());
+		return false;
+	}
+
+	std::vector<u8> Header;
+	WriteLE<u32>(Header, Magic);
+	WriteLE<u32>(Header, Version);
+	Segment.write(Header.data(), Header.size());
+	SegmentBytes = Header.size();
+
+	std::lock_guard<std::mutex> Lock{Mutex};
+	++Stats.Segments;
+	return true;
+}
+
+void DBLogSink::Write(const std::vector<u8>& Data)
+{
+	size_t Offset = 0;
+	while (Offset < Data.size())
+	{
+		if (!Segment.is_open() && !OpenSegment())
+		{
+			std::lock_guard<std::mutex> Lock{Mutex};
+			++Stats.WriteErrors;
+			return;
+		}
+
+		// Take whole records until the segment is full. A segment always gets at least one, so
+		// that a record larger than the segment size still gets written.
+		auto ChunkEnd = Offset;
+		while (ChunkEnd < Data.size())
+		{
+			auto RecordSize = sizeof(u16) + (Data[ChunkEnd] | (Data[ChunkEnd + 1] << 8));
+			if (ChunkEnd != Offset &&
+				SegmentBytes + (ChunkEnd - Offset) + RecordSize > Opts.SegmentSize)
+				break;
+			ChunkEnd += RecordSize;
+		}
+
+		auto ChunkSize = ChunkEnd - Offset;
+		auto Written = Segment.write(Data.data() + Offset, ChunkSize);
+		Segment.flush();
+		SegmentBytes += Written;
+		Offset = ChunkEnd;
+
+		{
+			std::lock_guard<std::mutex> Lock{Mutex};
+			Stats.BytesWritten += Written;
+			if (Written != ChunkSize)
+				++Stats.WriteErrors;
+		}
+
+		if (Offset < Data.size() || SegmentBytes >= Opts.SegmentSize)
+			CloseSegment();
+	}
+}
+
+void DBLogSink::CloseSegment()
+{
+	if (!Segment.is_open())
+		return;
+
+	Segment.close();
+	auto OpenPath = SegmentPath + OpenSuffix;
+	if (!MFile::Move(OpenPath.c_str(), SegmentPath.c_str()))
+		MLog("DBLogSink: Failed to rename %s\n", OpenPath.c_str());
+}
+
+void DBLogSink::RecoverSegments()
+{
+	// Segments left open by a crash are complete up to their last record, so they're renamed to
+	// be replayed like any other.
+	char Pattern[MFile::MaxPath];
+	sprintf_safe(Pattern, "%s/*.dblog%s", Opts.Directory.c_str(), OpenSuffix);
+	for (auto&& File : MFile::Glob(Pattern))
+	{
+		std::string OpenPath = Opts.Directory + "/" + File.Name;
+		auto Path = OpenPath.substr(0, OpenPath.size() - strlen(OpenSuffix));
+		if (!MFile::Move(OpenPath.c_str(), Path.c_str()))
+			MLog("DBLogSink: Failed to rename %s\n", OpenPath.c_str());
+	}
+}
+
+void DBLogSink::Flush()
+{
+	if (!Running)
+		return;
+
+	std::unique_lock<std::mutex> Lock{Mutex};
+	auto Request = ++FlushRequests;
+	Wake.notify_one();
+	Flushed.wait(Lock, [&] { return FlushesDone >= Request || !Running; });
+}
+
+void DBLogSink::FinishSegment()
+{
+	Flush();
+	std::lock_guard<std::mutex> Lock{FileMutex};
+	CloseSegment();
+}
+
+DBLogSinkStats DBLogSink::GetStats() const
+{
+	std::lock_guard<std::mutex> Lock{Mutex};
+	auto Ret = Stats;
+	Ret.BufferedBytes = Pending.size();
+	return Ret;
+}
+
+void DBLogSink::Dump() const
+{
+	if (!Running)
+	{
+		MLog("The database log sink is not running.\n");
+		return;
+	}
+
+	auto Stats = GetStats();
+	MLog("Directory: %s\n", Opts.Directory.c_str());
+	MLog("Rows appended: %llu\nRows dropped: %llu\n",
+		static_cast<unsigned long long>(Stats.Appended),
+		static_cast<unsigned long long>(Stats.Dropped));
+	MLog("Buffered: %zu / %zu bytes\n", Stats.BufferedBytes, Opts.MemoryBudget);
+	MLog("Written: %llu bytes in %llu segments, %llu write errors\n",
+		static_cast<unsigned long long>(Stats.BytesWritten),
+		static_cast<unsigned long long>(Stats.Segments),
+		static_cast<unsigned long long>(Stats.WriteErrors));
+}
+
+namespace
+{
+struct RecordReader
+{
+	const u8* Ptr;
+	const u8* End;
+	bool Error = false;
+
+	template <typename T>
+	T ReadLE()
+	{
+		if (size_t(End - Ptr) < sizeof(T))
+		{
+			Error = true;
+			Ptr = End;
+			return T{};
+		}
+		u64 Value = 0;
+		for (size_t i = 0; i < sizeof(T); ++i)
+			Value |= u64(Ptr[i]) << (i * 8);
+		Ptr += sizeof(T);
+		return static_cast<T>(Value);
+	}
+
+	i32 Int() { return static_cast<i32>(ReadLE<u32>()); }
+	u32 UInt() { return ReadLE<u32>(); }
+
+	std::string String()
+	{
+		auto Length = ReadLE<u16>();
+		if (size_t(End - Ptr) < Length)
+		{
+			Error = true;
+			Ptr = End;
+			return{};
+		}
+		std::string Ret{reinterpret_cast<const char*>(Ptr), Length};
+		Ptr += Length;
+		return Ret;
+	}
+};
+}
+
+// Reads the fields of a record in the order LogSinkDatabase wrote them, and inserts the row,
+// dated at Time. Returns false if the record is malformed or the database rejected the row.
+// Kill logs are batched by ReplayDBLogs instead.
+static bool ReplayRecord(DBLogType Type, u64 Time, RecordReader& R, IDatabase& DB,
+	bool& Malformed)
+{
+	Malformed = false;
+	auto Done = [&](auto&& Insert) {
+		if (R.Error || R.Ptr != R.End)
+		{
+			Malformed = true;
+			return false;
+		}
+		DB.SetLogTime(Time);
+		return Insert();
+	};
+
+	switch (Type)
+	{
+	case DBLogType::Conn:
+	{
+		auto AID = R.Int();
+		auto IP = R.String();
+		auto CountryCode3 = R.String();
+		return Done([&] { return DB.InsertConnLog(AID, IP.c_str(), CountryCode3); });
+	}
+	case DBLogType::Game:
+	{
+		auto GameName = R.String();
+		auto Map = R.String();
+		auto GameType = R.String();
+		auto Round = R.Int();
+		auto MasterCID = R.UInt();
+		auto PlayerCount = R.Int();
+		auto Players = R.String();
+		return Done([&] { return DB.InsertGameLog(GameName.c_str(), Map.c_str(),
+			GameType.c_str(), Round, MasterCID, PlayerCount, Players.c_str()); });
+	}
+	case DBLogType::Server:
+	{
+		auto ServerID = R.Int();
+		auto PlayerCount = R.Int();
+		auto GameCount = R.Int();
+		auto BlockCount = R.UInt();
+		auto NonBlockCount = R.UInt();
+		return Done([&] { return DB.InsertServerLog(ServerID, PlayerCount, GameCount,
+			BlockCount, NonBlockCount); });
+	}
+	case DBLogType::Player:
+	{
+		auto CID = R.UInt();
+		auto PlayTime = R.Int();
+		auto KillCount = R.Int();
+		auto DeathCount = R.Int();
+		auto XP = R.Int();
+		auto TotalXP = R.Int();
+		return Done([&] { return DB.InsertPlayerLog(CID, PlayTime, KillCount, DeathCount,
+			XP, TotalXP); });
+	}
+	case DBLogType::LevelUp:
+	{
+		auto CID = R.Int();
+		auto Level = R.Int();
+		auto BP = R.Int();
+		auto KillCount = R.Int();
+		auto DeathCount = R.Int();
+		auto PlayTime = R.Int();
+		return Done([&] { return DB.InsertLevelUpLog(CID, Level, BP, KillCount, DeathCount,
+			PlayTime); });
+	}
+	case DBLogType::ItemPurchase:
+	{
+		auto ItemID = R.UInt();
+		auto CID = R.UInt();
+		auto Bounty = R.Int();
+		auto CharBP = R.Int();
+		auto PurchaseType = static_cast<ItemPurchaseType>(R.Int());
+		return Done([&] { return DB.InsertItemPurchaseLogByBounty(ItemID, CID, Bounty, CharBP,
+			PurchaseType); });
+	}
+	case DBLogType::CharMaking:
+	{
+		auto AID = R.UInt();
+		auto CharName = R.String();
+		auto MakingType = static_cast<CharMakingType>(R.Int());
+		return Done([&] { return DB.InsertCharMakingLog(AID, CharName.c_str(), MakingType); });
+	}
+	case DBLogType::Block:
+	{
+		auto AID = R.UInt();
+		auto CID = R.UInt();
+		auto BlockType = static_cast<u8>(R.Int());
+		auto Comment = R.String();
+		auto IP = R.String();
+		return Done([&] { return DB.InsertBlockLog(AID, CID, BlockType, Comment, IP); });
+	}
+	case DBLogType::Kill:
+		// Batched by ReplayDBLogs, which never passes them here.
+		assert(false);
+		break;
+	}
+
+	Malformed = true;
+	return false;
+}
+
+static constexpr size_t MaxKillBatchSize = 1000;
+
+DBLogReplayResult ReplayDBLogs(const char* Directory, IDatabase& DB)
+{
+	DBLogReplayResult Result{};
+
+	char Pattern[MFile::MaxPath];
+	sprintf_safe(Pattern, "%s/*.dblog", Directory);
+	std::vector<std::string> Names;
+	for (auto&& File : MFile::Glob(Pattern))
+		Names.emplace_back(File.Name);
+	// The names start with the creation time, so this is the order they were written in.
+	std::sort(Names.begin(), Names.end());
+
+	for (auto&& Name : Names)
+	{
+		char Path[MFile::MaxPath];
+		sprintf_safe(Path, "%s/%s", Directory, Name.c_str());
+
+		MFile::File File{Path};
+		if (!File.is_open())
+		{
+			MLog("ReplayDBLogs: Failed to open %s\n", Path);
+			++Result.DamagedSegments;
+			continue;
+		}
+		std::vector<u8> Data(static_cast<size_t>(File.size()));
+		Data.resize(File.read(Data.data(), Data.size()));
+		File.close();
+
+		RecordReader Header{Data.data(), Data.data() + Data.size()};
+		if (Header.ReadLE<u32>() != DBLogSink::Magic || Header.ReadLE<u32>() != DBLogSink::Version)
+		{
+			MLog("ReplayDBLogs: %s is not a log segment\n", Path);
+			++Result.DamagedSegments;
+			continue;
+		}
+
+		bool Damaged = false;
+		// The header followed by the records the database rejected.
+		const auto HeaderSize = size_t(Header.Ptr - Data.data());
+		std::vector<u8> Failed(Data.begin(), Data.begin() + HeaderSize);
+
+		// Runs of kill logs, which are most of the rows, are inserted in batches.
+		std::vector<KillLogRow> Kills;
+		std::vector<std::pair<const u8*, const u8*>> KillRecords;
+		auto FlushKills = [&] {
+			if (Kills.empty())
+				return;
+			if (DB.InsertKillLogs(Kills))
+			{
+				Result.Rows += Kills.size();
+			}
+			else
+			{
+				// None of the batch was inserted, so the rows are retried one at a time to find
+				// the ones the database rejects.
+				for (size_t i = 0; i < Kills.size(); ++i)
+				{
+					DB.SetLogTime(Kills[i].Time);
+					if (DB.InsertKillLog(Kills[i].AttackerCID, Kills[i].VictimCID))
+					{
+						++Result.Rows;
+					}
+					else
+					{
+						++Result.FailedRows;
+						Failed.insert(Failed.end(), KillRecords[i].first, KillRecords[i].second);
+					}
+				}
+			}
+			Kills.clear();
+			KillRecords.clear();
+		};
+
+		auto Ptr = Header.Ptr;
+		auto End = Data.data() + Data.size();
+		while (Ptr != End)
+		{
+			RecordReader Prefix{Ptr, End};
+			auto Size = Prefix.ReadLE<u16>();
+			auto Type = static_cast<DBLogType>(Prefix.ReadLE<u8>());
+			auto Time = Prefix.ReadLE<u64>();
+			if (Prefix.Error || size_t(End - Ptr) < sizeof(u16) + Size)
+			{
+				Damaged = true;
+				break;
+			}
+
+			auto RecordEnd = Ptr + sizeof(u16) + Size;
+			RecordReader Fields{Prefix.Ptr, RecordEnd};
+			if (Type == DBLogType::Kill)
+			{
+				auto AttackerCID = Fields.UInt();
+				auto VictimCID = Fields.UInt();
+				if (Fields.Error || Fields.Ptr != Fields.End)
+				{
+					Damaged = true;
+				}
+				else
+				{
+					Kills.push_back({AttackerCID, VictimCID, Time});
+					KillRecords.emplace_back(Ptr, RecordEnd);
+					if (Kills.size() == MaxKillBatchSize)
+						FlushKills();
+				}
+				Ptr = RecordEnd;
+				continue;
+			}
+
+			// Keeps the rows in order.
+			FlushKills();
+			bool Malformed;
+			if (ReplayRecord(Type, Time, Fields, DB, Malformed))
+				++Result.Rows;
+			else if (Malformed)
+				Damaged = true;
+			else
+			{
+				++Result.FailedRows;
+				Failed.insert(Failed.end(), Ptr, RecordEnd);
+			}
+			Ptr = RecordEnd;
+		}
+		FlushKills();
+		DB.SetLogTime(0);
+
+		if (Damaged)
+		{
+			MLog("ReplayDBLogs: %s is damaged, replayed what could be read\n", Path);
+			++Result.DamagedSegments;
+		}
+		++Result.Segments;
+
+		if (Failed.size() == HeaderSize)
+		{
+			char DonePath[MFile::MaxPath];
+			sprintf_safe(DonePath, "%s.replayed", Path);
+			if (!MFile::Move(Path, DonePath))
+				MLog("ReplayDBLogs: Failed to rename %s\n", Path);
+			continue;
+		}
+
+		// The segment is replaced with just the rows that failed, so that the next replay only
+		// retries those. The new contents are written next to it first, so that a crash can't
+		// lose them.
+		char RetryPath[MFile::MaxPath];
+		sprintf_safe(RetryPath, "%s.retry", Path);
+		{
+			MFile::RWFile Retry{RetryPath, MFile::Clear};
+			if (!Retry.is_open() || Retry.write(Failed.data(), Failed.size()) != Failed.size())
+			{
+				MLog("ReplayDBLogs: Failed to write %s, keeping all of %s\n", RetryPath, Path);
+				Retry.close();
+				MFile::Delete(RetryPath);
+				continue;
+			}
+		}
+		if (!MFile::Delete(Path) || !MFile::Move(RetryPath, Path))
+			MLog("ReplayDBLogs: Failed to replace %s with %s\n", Path, RetryPath);
+	}
+
+	return Result;
+}
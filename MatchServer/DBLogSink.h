@@ -0,0 +1,204 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "ForwardingDatabase.h"
+#include "MFile.h"
+#include "StringView.h"
+
+// The log tables that can be deferred through the DBLogSink. The values are stored in the
+// segment files, so existing ones must not be changed.
+enum class DBLogType : u8
+{
+	Conn = 1,
+	Game,
+	Kill,
+	Server,
+	Player,
+	LevelUp,
+	ItemPurchase,
+	CharMaking,
+	Block,
+};
+
+struct DBLogSinkStats
+{
+	u64 Appended;
+	// Rows that didn't fit in the memory budget.
+	u64 Dropped;
+	u64 BytesWritten;
+	u64 Segments;
+	u64 WriteErrors;
+	size_t BufferedBytes;
+};
+
+// Append-only sink for the log tables. Rows are serialized into a bounded memory buffer, and a
+// background thread writes the buffer out in bulk to segment files, so logging never waits on
+// the database and never competes with gameplay queries for connections. Rows that would exceed
+// the memory budget are dropped and counted.
+//
+// The segments are loaded into a database afterwards with ReplayDBLogs.
+//
+// Segment format: an 8 byte header (magic and version), followed by records of
+//   u16 Size (of everything after this field), u8 DBLogType, u64 unix time, fields...
+// where integers are little-endian 32-bit values and strings are a u16 length followed by
+// the characters. A record is always written whole, so a crash can at most truncate the last
+// one. The segment being written has an extra ".open" suffix until it's closed.
+class DBLogSink
+{
+public:
+	struct Options
+	{
+		std::string Directory;
+		// Bytes of rows that can be waiting to be written.
+		size_t MemoryBudget = 4 * 1024 * 1024;
+		// Bytes after which a new segment file is started.
+		u64 SegmentSize = 64 * 1024 * 1024;
+		// Milliseconds between writes when the buffer isn't filling up.
+		u64 FlushInterval = 1000;
+	};
+
+	static constexpr u32 Magic = 0x4C424447; // "GDBL"
+	static constexpr u32 Version = 1;
+	static constexpr size_t MaxStringLength = 1024;
+
+	~DBLogSink() { Stop(); }
+
+	bool Start(const Options& Opts);
+	// Writes everything that's buffered and stops the writer thread.
+	void Stop();
+	bool IsRunning() const { return Running; }
+
+	// Serializes a row and queues it to be written. Returns false if it was dropped.
+	// Fields can be integers, enums, or strings.
+	template <typename... T>
+	bool Append(DBLogType Type, const T&... Fields)
+	{
+		std::vector<u8> Record;
+		Record.reserve(64);
+		BeginRecord(Record, Type);
+		using Expander = int[];
+		(void)Expander{(WriteField(Record, Fields), 0)...};
+		return Commit(Record);
+	}
+
+	// Blocks until everything appended so far has been written.
+	void Flush();
+	// Flushes and closes the current segment, so that it can be replayed. The next write starts
+	// a new one.
+	void FinishSegment();
+
+	DBLogSinkStats GetStats() const;
+	void Dump() const;
+
+private:
+	static void BeginRecord(std::vector<u8>& Record, DBLogType Type);
+	static void WriteField(std::vector<u8>& Record, i32 Value);
+	static void WriteField(std::vector<u8>& Record, u32 Value);
+	static void WriteField(std::vector<u8>& Record, StringView Value);
+	static void WriteField(std::vector<u8>& Record, const char* Value) {
+		WriteField(Record, StringView{Value ? Value : ""}); }
+	static void WriteField(std::vector<u8>& Record, const std::string& Value) {
+		WriteField(Record, StringView{Value}); }
+	template <typename T>
+	static std::enable_if_t<std::is_enum<T>::value> WriteField(std::vector<u8>& Record, T Value) {
+		WriteField(Record, static_cast<i32>(Value)); }
+
+	bool Commit(std::vector<u8>& Record);
+	void Run();
+	void Write(const std::vector<u8>& Data);
+	bool OpenSegment();
+	void CloseSegment();
+	void RecoverSegments();
+
+	static constexpr const char* OpenSuffix = ".open";
+
+	Options Opts;
+	std::atomic<bool> Running{false};
+	std::thread Thread;
+
+	mutable std::mutex Mutex;
+	std::condition_variable Wake;
+	std::condition_variable Flushed;
+	std::vector<u8> Pending;
+	bool Stopping = false;
+	u64 FlushRequests = 0;
+	u64 FlushesDone = 0;
+	DBLogSinkStats Stats{};
+
+	// Only touched by the thread that's writing, which holds FileMutex.
+	std::mutex FileMutex;
+	MFile::RWFile Segment;
+	std::string SegmentPath;
+	u64 SegmentBytes = 0;
+	u32 SegmentCounter = 0;
+};
+
+DBLogSink& GetDBLogSink();
+
+// Sends the rows of the log tables to a DBLogSink instead of the wrapped database. Batches of kill
+// logs still go to the database, since they're already a single round trip.
+class LogSinkDatabase final : public ForwardingDatabase
+{
+public:
+	LogSinkDatabase(std::unique_ptr<IDatabase> DB, DBLogSink& Sink)
+		: ForwardingDatabase(std::move(DB)), Sink(Sink) {}
+
+	virtual bool InsertLevelUpLog(int nCID, int nLevel, int nBP,
+		int nKillCount, int nDeathCount, int nPlayTime) override {
+		return Sink.Append(DBLogType::LevelUp, nCID, nLevel, nBP, nKillCount, nDeathCount,
+			nPlayTime); }
+	virtual bool InsertConnLog(int nAID, const char* szIP,
+		const std::string& strCountryCode3) override {
+		return Sink.Append(DBLogType::Conn, nAID, szIP, strCountryCode3); }
+	virtual bool InsertGameLog(const char* szGameName, const char* szMap, const char* GameType,
+		int nRound, unsigned int nMasterCID, int nPlayerCount, const char* szPlayers) override {
+		return Sink.Append(DBLogType::Game, szGameName, szMap, GameType, nRound, nMasterCID,
+			nPlayerCount, szPlayers); }
+	virtual bool InsertKillLog(unsigned int nAttackerCID, unsigned int nVictimCID) override {
+		return Sink.Append(DBLogType::Kill, nAttackerCID, nVictimCID); }
+	virtual bool InsertServerLog(int nServerID, int nPlayerCount, int nGameCount,
+		uint32_t dwBlockCount, uint32_t dwNonBlockCount) override {
+		return Sink.Append(DBLogType::Server, nServerID, nPlayerCount, nGameCount,
+			dwBlockCount, dwNonBlockCount); }
+	virtual bool InsertPlayerLog(u32 nCID, int nPlayTime, int nKillCount, int nDeathCount,
+		int nXP, int nTotalXP) override {
+		return Sink.Append(DBLogType::Player, nCID, nPlayTime, nKillCount, nDeathCount,
+			nXP, nTotalXP); }
+	virtual bool InsertItemPurchaseLogByBounty(u32 nItemID, u32 nCID,
+		int nBounty, int nCharBP, ItemPurchaseType nType) override {
+		return Sink.Append(DBLogType::ItemPurchase, nItemID, nCID, nBounty, nCharBP, nType); }
+	virtual bool InsertCharMakingLog(unsigned int nAID, const char* szCharName,
+		CharMakingType nType) override {
+		return Sink.Append(DBLogType::CharMaking, nAID, szCharName, nType); }
+	virtual bool InsertBlockLog(uint32_t dwAID, uint32_t dwCID, uint8_t btBlockType,
+		const std::string& strComment, const std::string& strIP) override {
+		return Sink.Append(DBLogType::Block, dwAID, dwCID, i32(btBlockType), strComment, strIP); }
+
+private:
+	DBLogSink& Sink;
+};
+
+struct DBLogReplayResult
+{
+	u32 Segments;
+	u64 Rows;
+	// Rows the database rejected.
+	u64 FailedRows;
+	// Segments with a bad header or a truncated record. Everything before the damage is still
+	// replayed.
+	u32 DamagedSegments;
+};
+
+// Inserts the rows of every segment in Directory into DB, oldest first, dated at the time they
+// were appended where the database supports it. MSSQL only does for kill logs, since the other
+// log procedures date their rows themselves. Segments that have been replayed are renamed with a
+// ".replayed" suffix so that running it again doesn't insert them twice. Segments with rows the
+// database rejected are cut down to those rows instead, so that they're retried the next time.
+DBLogReplayResult ReplayDBLogs(const char* Directory, IDatabase& DB);
@@ -0,0 +1,85 @@
+#include "stdafx.h"
+#include "DBProfiler.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "MDebug.h"
+
+DBProfiler& GetDBProfiler()
+{
+	static DBProfiler Instance;
+	return Instance;
+}
+
+DBMethodStats& DBProfiler::GetStats(const char* MethodName)
+{
+	std::lock_guard<std::mutex> Lock{Mutex};
+
+	auto it = std::find_if(Methods.begin(), Methods.end(), [&](auto&& Stats) {
+		return strcmp(Stats.Name, MethodName) == 0;
+	});
+	if (it != Methods.end())
+		return *it;
+
+	Methods.emplace_back(MethodName);
+	return Methods.back();
+}
+
+void DBProfiler::Record(DBMethodStats& Stats, u64 Microseconds)
+{
+	Stats.Calls.fetch_add(1, std::memory_order_relaxed);
+	Stats.TotalTime.fetch_add(Microseconds, std::memory_order_relaxed);
+
+	auto Max = Stats.MaxTime.load(std::memory_order_relaxed);
+	while (Microseconds > Max &&
+		!Stats.MaxTime.compare_exchange_weak(Max, Microseconds, std::memory_order_relaxed))
+		;
+}
+
+void DBProfiler::Dump() const
+{
+	struct Row
+	{
+		const char* Name;
+		unsigned long long Calls, TotalTime, MaxTime;
+	};
+	std::vector<Row> Rows;
+
+	{
+		std::lock_guard<std::mutex> Lock{Mutex};
+		for (auto&& Stats : Methods)
+		{
+			auto Calls = Stats.Calls.load(std::memory_order_relaxed);
+			if (Calls == 0)
+				continue;
+			Rows.push_back({Stats.Name, Calls,
+				Stats.TotalTime.load(std::memory_order_relaxed),
+				Stats.MaxTime.load(std::memory_order_relaxed)});
+		}
+	}
+
+	std::sort(Rows.begin(), Rows.end(), [](auto&& a, auto&& b) {
+		return a.TotalTime > b.TotalTime;
+	});
+
+	MLog("%-32s %10s %12s %10s %10s\n", "Method", "Calls", "Total (ms)", "Avg (us)", "Max (us)");
+	for (auto&& Row : Rows)
+	{
+		MLog("%-32s %10llu %12.3f %10llu %10llu\n",
+			Row.Name, Row.Calls, Row.TotalTime / 1000.0,
+			Row.TotalTime / Row.Calls, Row.MaxTime);
+	}
+	if (Rows.empty())
+		MLog("No database calls have been recorded.\n");
+}
+
+void DBProfiler::Reset()
+{
+	std::lock_guard<std::mutex> Lock{Mutex};
+	for (auto&& Stats : Methods)
+	{
+		Stats.Calls.store(0, std::memory_order_relaxed);
+		Stats.TotalTime.store(0, std::memory_order_relaxed);
+		Stats.MaxTime.store(0, std::memory_order_relaxed);
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include "GlobalTypes.h"
+
+// Accumulated timings for one IDatabase method. The counters are atomic since the main thread
+// and every MAsyncProxy thread each own a database instance, and all of them report here.
+struct DBMethodStats
+{
+	DBMethodStats(const char* Name) : Name(Name) {}
+
+	const char* Name;
+	std::atomic<u64> Calls{};
+	// All times are in microseconds.
+	std::atomic<u64> TotalTime{};
+	std::atomic<u64> MaxTime{};
+};
+
+class DBProfiler
+{
+public:
+	// Returns the stats entry for the method with the given name, creating it if it doesn't
+	// exist. The returned reference is valid for the lifetime of the profiler.
+	DBMethodStats& GetStats(const char* MethodName);
+
+	void Record(DBMethodStats& Stats, u64 Microseconds);
+
+	// Outputs the latency table to the log, sorted by total time spent.
+	void Dump() const;
+	void Reset();
+
+private:
+	mutable std::mutex Mutex;
+	// Deque so that references to the elements stay valid when new methods are added.
+	std::deque<DBMethodStats> Methods;
+};
+
+DBProfiler& GetDBProfiler();
+
+class DBProfileScope
+{
+public:
+	DBProfileScope(DBMethodStats& Stats) : Stats(Stats), Start(clock::now()) {}
+	~DBProfileScope()
+	{
+		using namespace std::chrono;
+		auto Elapsed = duration_cast<microseconds>(clock::now() - Start).count();
+		GetDBProfiler().Record(Stats, static_cast<u64>(Elapsed));
+	}
+
+	DBProfileScope(const DBProfileScope&) = delete;
+	DBProfileScope& operator=(const DBProfileScope&) = delete;
+
+private:
+	using clock = std::chrono::steady_clock;
+
+	DBMethodStats& Stats;
+	clock::time_point Start;
+};
+
+// Times the rest of the enclosing function and records it under the function's name.
+// The stats lookup only happens the first time the function is called.
+#define DB_PROFILE_METHOD() \
+	static auto& DBProfileStats_ = GetDBProfiler().GetStats(__func__); \
+	DBProfileScope DBProfileScope_{DBProfileStats_}
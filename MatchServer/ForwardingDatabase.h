@@ -0,0 +1,276 @@
+#pragma once
+
+#include <memory>
+#include "IDatabase.h"
+
+// Forwards every call to another IDatabase. Base class for the database decorators, which
+// override only the methods they're interested in.
+class ForwardingDatabase : public IDatabase
+{
+public:
+	ForwardingDatabase(std::unique_ptr<IDatabase> DB) : DB(std::move(DB)) {}
+
+	virtual bool IsOpen() override { return DB->IsOpen(); }
+
+
+	//
+	// Account creation and login
+	//
+	virtual bool GetLoginInfo(const char* szUserID, unsigned int* poutnAID, char* poutPassword,
+		size_t maxlen) override {
+		return DB->GetLoginInfo(szUserID, poutnAID, poutPassword, maxlen); }
+	virtual bool UpdateLastConnDate(const char* szUserID, const char* szIP) override {
+		return DB->UpdateLastConnDate(szUserID, szIP); }
+	virtual bool CreateAccount(const char* szUserID, const char* szPassword, int nCert,
+		const char* szName, int nAge, int nSex) override {
+		return DB->CreateAccount(szUserID, szPassword, nCert, szName, nAge, nSex); }
+	virtual AccountCreationResult CreateAccountNew(const char *Username,
+		const char *PasswordData, size_t PasswordSize, const char *Email) override {
+		return DB->CreateAccountNew(Username, PasswordData, PasswordSize, Email); }
+	virtual bool BanPlayer(int nAID, const char *szReason, const time_t &UnbanTime) override {
+		return DB->BanPlayer(nAID, szReason, UnbanTime); }
+
+
+	//
+	// Character
+	//
+	virtual int CreateCharacter(int nAID, const char* szNewName, int nCharIndex, int nSex,
+		int nHair, int nFace, int nCostume) override {
+		return DB->CreateCharacter(nAID, szNewName, nCharIndex, nSex, nHair, nFace, nCostume); }
+	virtual bool DeleteCharacter(const int nAID, const int nCharIndex,
+		const char* szCharName) override {
+		return DB->DeleteCharacter(nAID, nCharIndex, szCharName); }
+
+	virtual bool GetAccountCharList(int nAID, struct MTD_AccountCharInfo* poutCharList,
+		int* noutCharCount) override {
+		return DB->GetAccountCharList(nAID, poutCharList, noutCharCount); }
+	virtual bool GetAccountCharInfo(int nAID, int nCharIndex,
+		struct MTD_CharInfo* poutCharInfo) override {
+		return DB->GetAccountCharInfo(nAID, nCharIndex, poutCharInfo); }
+	virtual bool GetAccountInfo(int AID, struct MMatchAccountInfo* outAccountInfo) override {
+		return DB->GetAccountInfo(AID, outAccountInfo); }
+	virtual bool GetCharInfoByAID(int nAID, int nCharIndex, class MMatchCharInfo* poutCharInfo,
+		int& nWaitHourDiff) override {
+		return DB->GetCharInfoByAID(nAID, nCharIndex, poutCharInfo, nWaitHourDiff); }
+	virtual bool GetCharCID(const char* pszName, int* poutCID) override {
+		return DB->GetCharCID(pszName, poutCID); }
+
+	virtual bool SimpleUpdateCharInfo(const MMatchCharInfo& CharInfo) override {
+		return DB->SimpleUpdateCharInfo(CharInfo); }
+	virtual bool UpdateCharBP(int CID, int nBPInc) override {
+		return DB->UpdateCharBP(CID, nBPInc); }
+	virtual bool UpdateCharInfoData(int CID, int AddedXP, int AddedBP,
+		int AddedKillCount, int AddedDeathCount) override {
+		return DB->UpdateCharInfoData(CID, AddedXP, AddedBP, AddedKillCount, AddedDeathCount); }
+	virtual bool UpdateCharLevel(int nCID, int nLevel) override {
+		return DB->UpdateCharLevel(nCID, nLevel); }
+	virtual bool UpdateCharLevel(int nCID, int nNewLevel, int nBP, int nKillCount,
+		int nDeathCount, int nPlayTime, bool bIsLevelUp) override {
+		return DB->UpdateCharLevel(nCID, nNewLevel, nBP, nKillCount, nDeathCount, nPlayTime,
+			bIsLevelUp); }
+	virtual bool UpdateCharPlayTime(u32 nCID, u32 nPlayTime) override {
+		return DB->UpdateCharPlayTime(nCID, nPlayTime); }
+	virtual bool GetCID(const char* pszCharName, int& outCID) override {
+		return DB->GetCID(pszCharName, outCID); }
+	virtual bool GetCharName(const int nCID, std::string& outCharName) override {
+		return DB->GetCharName(nCID, outCharName); }
+
+
+	//
+	// Items
+	//
+	virtual bool InsertCharItem(unsigned int nCID, int nItemDescID, bool bRentItem,
+		int nRentPeriodHour, u32* poutCIID) override {
+		return DB->InsertCharItem(nCID, nItemDescID, bRentItem, nRentPeriodHour, poutCIID); }
+	virtual bool DeleteCharItem(unsigned int nCID, int nCIID) override {
+		return DB->DeleteCharItem(nCID, nCIID); }
+	virtual bool GetCharItemInfo(MMatchCharInfo& CharInfo) override {
+		return DB->GetCharItemInfo(CharInfo); }
+	virtual bool GetAccountItemInfo(int nAID, struct MAccountItemNode* pOut, int* poutNodeCount,
+		int nMaxNodeCount, MAccountItemNode* pOutExpiredItemList, int* poutExpiredItemCount,
+		int nMaxExpiredItemCount) override {
+		return DB->GetAccountItemInfo(nAID, pOut, poutNodeCount, nMaxNodeCount,
+			pOutExpiredItemList, poutExpiredItemCount, nMaxExpiredItemCount); }
+	virtual bool UpdateEquipedItem(const u32 nCID, MMatchCharItemParts parts, u32 nCIID,
+		u32 nItemID) override {
+		return DB->UpdateEquipedItem(nCID, parts, nCIID, nItemID); }
+	virtual bool ClearAllEquipedItem(u32 nCID) override {
+		return DB->ClearAllEquipedItem(nCID); }
+	virtual bool DeleteExpiredAccountItem(int nAIID) override {
+		return DB->DeleteExpiredAccountItem(nAIID); }
+	virtual bool BuyBountyItem(unsigned int nCID, int nItemID, int nPrice, u32* poutCIID) override {
+		return DB->BuyBountyItem(nCID, nItemID, nPrice, poutCIID); }
+	virtual bool SellBountyItem(unsigned int nCID, unsigned int nItemID, unsigned int nCIID,
+		int nPrice, int nCharBP) override {
+		return DB->SellBountyItem(nCID, nItemID, nCIID, nPrice, nCharBP); }
+
+	virtual bool BringAccountItem(int nAID, int nCID, int nAIID,
+		unsigned int* poutCIID, u32* poutItemID,
+		bool* poutIsRentItem, int* poutRentMinutePeriodRemainder) override {
+		return DB->BringAccountItem(nAID, nCID, nAIID, poutCIID, poutItemID, poutIsRentItem,
+			poutRentMinutePeriodRemainder); }
+	virtual bool BringBackAccountItem(int nAID, int nCID, int nCIID) override {
+		return DB->BringBackAccountItem(nAID, nCID, nCIID); }
+
+
+	//
+	// Quest
+	//
+	virtual bool UpdateQuestItem(int nCID, class MQuestItemMap& rfQuestIteMap,
+		class MQuestMonsterBible& rfQuestMonster) override {
+		return DB->UpdateQuestItem(nCID, rfQuestIteMap, rfQuestMonster); }
+	virtual bool GetCharQuestItemInfo(MMatchCharInfo* pCharInfo) override {
+		return DB->GetCharQuestItemInfo(pCharInfo); }
+
+
+	//
+	// Logging
+	//
+	virtual bool InsertLevelUpLog(int nCID, int nLevel, int nBP,
+		int nKillCount, int nDeathCount, int nPlayTime) override {
+		return DB->InsertLevelUpLog(nCID, nLevel, nBP, nKillCount, nDeathCount, nPlayTime); }
+	virtual bool InsertQuestGameLog(const char* pszStageName, int nScenarioID,
+		int nMasterCID, int nPlayer1, int nPlayer2, int nPlayer3,
+		int nTotalRewardQItemCount, int nElapsedPlayTime, int& outQGLID) override {
+		return DB->InsertQuestGameLog(pszStageName, nScenarioID, nMasterCID, nPlayer1, nPlayer2,
+			nPlayer3, nTotalRewardQItemCount, nElapsedPlayTime, outQGLID); }
+	virtual bool InsertQUniqueGameLog(int nQGLID, int nCID, int nQIID) override {
+		return DB->InsertQUniqueGameLog(nQGLID, nCID, nQIID); }
+	virtual void SetLogTime(u64 UnixTime) override { DB->SetLogTime(UnixTime); }
+	virtual bool InsertConnLog(int nAID, const char* szIP,
+		const std::string& strCountryCode3) override {
+		return DB->InsertConnLog(nAID, szIP, strCountryCode3); }
+	virtual bool InsertGameLog(const char* szGameName, const char* szMap, const char* GameType,
+		int nRound, unsigned int nMasterCID, int nPlayerCount, const char* szPlayers) override {
+		return DB->InsertGameLog(szGameName, szMap, GameType, nRound, nMasterCID,
+			nPlayerCount, szPlayers); }
+	virtual bool InsertKillLog(unsigned int nAttackerCID, unsigned int nVictimCID) override {
+		return DB->InsertKillLog(nAttackerCID, nVictimCID); }
+	virtual bool InsertKillLogs(ArrayView<const KillLogRow> Rows) override {
+		return DB->InsertKillLogs(Rows); }
+	virtual bool InsertChatLog(u32 nCID, const char* szMsg, u64 nTime) override {
+		return DB->InsertChatLog(nCID, szMsg, nTime); }
+	virtual bool InsertServerLog(int nServerID, int nPlayerCount, int nGameCount,
+		uint32_t dwBlockCount, uint32_t dwNonBlockCount) override {
+		return DB->InsertServerLog(nServerID, nPlayerCount, nGameCount,
+			dwBlockCount, dwNonBlockCount); }
+	virtual bool InsertPlayerLog(u32 nCID, int nPlayTime, int nKillCount, int nDeathCount,
+		int nXP, int nTotalXP) override {
+		return DB->InsertPlayerLog(nCID, nPlayTime, nKillCount, nDeathCount, nXP, nTotalXP); }
+	virtual bool InsertItemPurchaseLogByBounty(u32 nItemID, u32 nCID,
+		int nBounty, int nCharBP, ItemPurchaseType nType) override {
+		return DB->InsertItemPurchaseLogByBounty(nItemID, nCID, nBounty, nCharBP, nType); }
+	virtual bool InsertCharMakingLog(unsigned int nAID, const char* szCharName,
+		CharMakingType nType) override {
+		return DB->InsertCharMakingLog(nAID, szCharName, nType); }
+
+
+	//
+	// Locator
+	//
+	virtual bool UpdateServerStatus(int nServerID, int nPlayerCount) override {
+		return DB->UpdateServerStatus(nServerID, nPlayerCount); }
+	virtual bool UpdateMaxPlayer(int nServerID, int nMaxPlayer) override {
+		return DB->UpdateMaxPlayer(nServerID, nMaxPlayer); }
+	virtual bool UpdateServerInfo(int nServerID, int nMaxPlayer, const char* szServerName) override {
+		return DB->UpdateServerInfo(nServerID, nMaxPlayer, szServerName); }
+
+
+	//
+	// Friends
+	//
+	virtual bool FriendAdd(int nCID, int nFriendCID, int nFavorite) override {
+		return DB->FriendAdd(nCID, nFriendCID, nFavorite); }
+	virtual bool FriendRemove(int nCID, int nFriendCID) override {
+		return DB->FriendRemove(nCID, nFriendCID); }
+	virtual bool FriendGetList(int nCID, class MMatchFriendInfo* pFriendInfo) override {
+		return DB->FriendGetList(nCID, pFriendInfo); }
+
+
+	//
+	// Clan
+	//
+	virtual bool GetCharClan(int nCID, int* poutClanID, char* poutClanName, int maxlen) override {
+		return DB->GetCharClan(nCID, poutClanID, poutClanName, maxlen); }
+	virtual bool GetClanIDFromName(const char* szClanName, int* poutCLID) override {
+		return DB->GetClanIDFromName(szClanName, poutCLID); }
+	virtual bool CreateClan(const char* szClanName, int nMasterCID, int nMember1CID, int nMember2CID,
+		int nMember3CID, int nMember4CID, bool* boutRet, int* noutNewCLID) override {
+		return DB->CreateClan(szClanName, nMasterCID, nMember1CID, nMember2CID,
+			nMember3CID, nMember4CID, boutRet, noutNewCLID); }
+	virtual bool CreateClan(const char* szClanName, int nMasterCID, bool* boutRet,
+		int* noutNewCLID) override {
+		return DB->CreateClan(szClanName, nMasterCID, boutRet, noutNewCLID); }
+	virtual bool DeleteExpiredClan(uint32_t dwCID, uint32_t dwCLID, const std::string& strDeleteName,
+		uint32_t dwWaitHour = 24) override {
+		return DB->DeleteExpiredClan(dwCID, dwCLID, strDeleteName, dwWaitHour); }
+	virtual bool SetDeleteTime(uint32_t dwMasterCID, uint32_t dwCLID,
+		const std::string& strDeleteDate) override {
+		return DB->SetDeleteTime(dwMasterCID, dwCLID, strDeleteDate); }
+	virtual bool ReserveCloseClan(const int nCLID, const char* szClanName, int nMasterCID,
+		const std::string& strDeleteDate) override {
+		return DB->ReserveCloseClan(nCLID, szClanName, nMasterCID, strDeleteDate); }
+	virtual bool AddClanMember(int nCLID, int nJoinerCID, int nClanGrade, bool* boutRet) override {
+		return DB->AddClanMember(nCLID, nJoinerCID, nClanGrade, boutRet); }
+	virtual bool RemoveClanMember(int nCLID, int nLeaverCID) override {
+		return DB->RemoveClanMember(nCLID, nLeaverCID); }
+	virtual bool UpdateClanGrade(int nCLID, int nMemberCID, int nClanGrade) override {
+		return DB->UpdateClanGrade(nCLID, nMemberCID, nClanGrade); }
+	virtual ExpelResult ExpelClanMember(int nCLID, int nAdminGrade, const char* szMember) override {
+		return DB->ExpelClanMember(nCLID, nAdminGrade, szMember); }
+	virtual bool GetClanInfo(int nCLID, MDB_ClanInfo* poutClanInfo) override {
+		return DB->GetClanInfo(nCLID, poutClanInfo); }
+	virtual bool UpdateCharClanContPoint(int nCID, int nCLID, int nAddedContPoint) override {
+		return DB->UpdateCharClanContPoint(nCID, nCLID, nAddedContPoint); }
+	virtual bool CloseClan(int nCLID, const char* szClanName, int nMasterCID) override {
+		return DB->CloseClan(nCLID, szClanName, nMasterCID); }
+
+
+	//
+	// Clan war
+	//
+	virtual bool GetLadderTeamID(const int nTeamTableIndex, const int* pnMemberCIDArray,
+		int nMemberCount, int* pnoutTID) override {
+		return DB->GetLadderTeamID(nTeamTableIndex, pnMemberCIDArray, nMemberCount, pnoutTID); }
+	virtual bool LadderTeamWinTheGame(int nTeamTableIndex, int nWinnerTID, int nLoserTID,
+		bool bIsDrawGame, int nWinnerPoint, int nLoserPoint, int nDrawPoint) override {
+		return DB->LadderTeamWinTheGame(nTeamTableIndex, nWinnerTID, nLoserTID, bIsDrawGame,
+			nWinnerPoint, nLoserPoint, nDrawPoint); }
+	virtual bool GetLadderTeamMemberByCID(const int nCID, int* poutTeamID, char** ppoutCharArray,
+		int maxlen, int nCount) override {
+		return DB->GetLadderTeamMemberByCID(nCID, poutTeamID, ppoutCharArray, maxlen, nCount); }
+	virtual bool WinTheClanGame(int nWinnerCLID, int nLoserCLID, bool bIsDrawGame,
+		int nWinnerPoint, int nLoserPoint, const char* szWinnerClanName,
+		const char* szLoserClanName, int nRoundWins, int nRoundLosses,
+		int nMapID, int nGameType,
+		const char* szWinnerMembers, const char* szLoserMembers) override {
+		return DB->WinTheClanGame(nWinnerCLID, nLoserCLID, bIsDrawGame, nWinnerPoint, nLoserPoint,
+			szWinnerClanName, szLoserClanName, nRoundWins, nRoundLosses, nMapID, nGameType,
+			szWinnerMembers, szLoserMembers); }
+
+
+	//
+	// Admin
+	//
+	virtual bool EventJjangUpdate(int nAID, bool bJjang) override {
+		return DB->EventJjangUpdate(nAID, bJjang); }
+	virtual bool CheckPremiumIP(const char* szIP, bool& outbResult) override {
+		return DB->CheckPremiumIP(szIP, outbResult); }
+	virtual bool InsertEvent(uint32_t dwAID, uint32_t dwCID, const std::string& strEventName) override {
+		return DB->InsertEvent(dwAID, dwCID, strEventName); }
+	virtual bool SetBlockAccount(uint32_t dwAID, uint32_t dwCID, uint8_t btBlockType,
+		const std::string& strComment, const std::string& strIP,
+		const std::string& strEndHackBlockerDate) override {
+		return DB->SetBlockAccount(dwAID, dwCID, btBlockType, strComment, strIP,
+			strEndHackBlockerDate); }
+	virtual bool ResetAccountBlock(uint32_t dwAID, uint8_t btBlockType) override {
+		return DB->ResetAccountBlock(dwAID, btBlockType); }
+	virtual bool InsertBlockLog(uint32_t dwAID, uint32_t dwCID, uint8_t btBlockType,
+		const std::string& strComment, const std::string& strIP) override {
+		return DB->InsertBlockLog(dwAID, dwCID, btBlockType, strComment, strIP); }
+	virtual bool AdminResetAllHackingBlock() override {
+		return DB->AdminResetAllHackingBlock(); }
+
+protected:
+	std::unique_ptr<IDatabase> DB;
+};
@@ -2,6 +2,7 @@
 
 #include <cstdint>
 #include <string>
+#include "ArrayView.h"
 #include "MMatchGlobal.h"
 #include "MMatchItem.h"
 #include "MErrorTable.h"
@@ -42,6 +43,14 @@ enum class CharMakingType
 	Delete,
 };
 
+struct KillLogRow
+{
+	u32 AttackerCID;
+	u32 VictimCID;
+	// Unix time.
+	u64 Time;
+};
+
 enum class ExpelResult
 {
 	OK,
@@ -70,6 +79,8 @@ struct MDB_ClanInfo
 class IDatabase
 {
 public:
+	virtual ~IDatabase() = default;
+
 	virtual bool IsOpen() = 0;
 
 	template <size_t size>
@@ -158,11 +169,17 @@ public:
 	virtual bool InsertQUniqueGameLog(int nQGLID, int nCID, int nQIID) = 0;
 
 
+	// Dates the rows the log methods insert at UnixTime instead of the current time, until it's
+	// called again with 0, for the logs the backend inserts with an explicit time. Used to replay
+	// rows that were written down earlier.
+	virtual void SetLogTime(u64 UnixTime) = 0;
 	virtual bool InsertConnLog(int nAID, const char* szIP, const std::string& strCountryCode3) = 0;
 	virtual bool InsertGameLog(const char* szGameName, const char* szMap, const char* GameType,
 		int nRound, unsigned int nMasterCID,
 		int nPlayerCount, const char* szPlayers) = 0;
 	virtual bool InsertKillLog(unsigned int nAttackerCID, unsigned int nVictimCID) = 0;
+	// Inserts every row, dated at its own time, or none of them.
+	virtual bool InsertKillLogs(ArrayView<const KillLogRow> Rows) = 0;
 	virtual bool InsertChatLog(u32 nCID, const char* szMsg, u64 nTime) = 0;
 	virtual bool InsertServerLog(int nServerID, int nPlayerCount, int nGameCount,
 		uint32_t dwBlockCount, uint32_t dwNonBlockCount) = 0;
@@ -8,10 +8,19 @@
 #include "MMatchConfig.h"
 #include "MMatchServer.h"
 #include "RBspObject.h"
+#include "MStartupTasks.h"
 
 static auto Log = [](auto&&... Args) {
 	MGetMatchServer()->LogF(MMatchServer::LOG_ALL, std::forward<decltype(Args)>(Args)...); };
 
+LagCompManager::~LagCompManager()
+{
+	using namespace RealSpace2;
+	// The file system outlives this, so it can't keep pointing at the cache.
+	if (g_pFileSystem && g_pFileSystem->GetFileCache() == &FileCache)
+		g_pFileSystem->SetFileCache(nullptr);
+}
+
 bool LagCompManager::Create()
 {
 	using namespace RealSpace2;
@@ -30,38 +39,51 @@ bool LagCompManager::Create()
 		return false;
 	}
 
-	bool ret = false;
-	
-	ret = LoadAnimations("model/man/man01.xml", 0);
-	if (!ret)
+	// Servers on the same host load the same maps, so only the first one has to inflate them.
+	auto& FileCacheDir = MGetServerConfig()->GetFileCacheDirectory();
+	if (!FileCacheDir.empty())
 	{
-		Log("LoadAnimations0 failed!");
-		return false;
+		if (FileCache.Create(FileCacheDir, MGetServerConfig()->GetFileCacheSize()))
+			g_pFileSystem->SetFileCache(&FileCache);
+		else
+			Log("Failed to create the file cache in %s", FileCacheDir.c_str());
 	}
-	Log("Loaded male animations");
 
-	ret = LoadAnimations("model/woman/woman01.xml", 1);
-	if (!ret)
+	// The animation sets and the maps don't share anything but the file system, so they're all
+	// loaded at once.
+	MStartupTasks Tasks;
+	const MStartupTasks::TaskID AniTasks[] = {
+		Tasks.Add("Male animations", [&] { return LoadAnimations("model/man/man01.xml", 0); }),
+		Tasks.Add("Female animations", [&] { return LoadAnimations("model/woman/woman01.xml", 1); }),
+	};
+
+	for (auto& Map : g_MapDesc)
 	{
-		Log("LoadAnimations1 failed!");
-		return false;
+		// Inserted up front, so that the tasks never modify Maps.
+		auto& Bsp = Maps[Map.szMapName];
+		Tasks.Add(Map.szMapName, [&Bsp, &Map] {
+			char Path[128];
+			sprintf_safe(Path, "maps/%s/%s.rs", Map.szMapName, Map.szMapName);
+			return Bsp.Open(Path, RBspObject::ROpenMode::Runtime, nullptr, nullptr, true);
+		});
 	}
-	Log("Loaded female animations");
 
-	SetAnimationMgr(MMS_MALE, &AniMgrs[MMS_MALE]);
-	SetAnimationMgr(MMS_FEMALE, &AniMgrs[MMS_FEMALE]);
+	Tasks.Run(MGetServerConfig()->GetStartupThreadCount());
+	Tasks.Report([&](const char* Line) { Log("%s", Line); });
 
-	for (auto& Map : g_MapDesc)
+	for (auto ID : AniTasks)
 	{
-		char Path[128];
-		sprintf_safe(Path, "maps/%s/%s.rs", Map.szMapName, Map.szMapName);
-		ret = Maps[Map.szMapName].Open(Path, RBspObject::ROpenMode::Runtime, nullptr, nullptr, true);
-		if (!ret)
-			Log("Failed to load map %s!", Map.szMapName);
-		else
-			Log("Loaded map %s", Map.szMapName);
+		auto& Task = Tasks.GetTasks()[ID];
+		if (Task.State != MStartupTasks::TaskState::Succeeded)
+		{
+			Log("Loading %s failed!", Task.Name.c_str());
+			return false;
+		}
 	}
 
+	SetAnimationMgr(MMS_MALE, &AniMgrs[MMS_MALE]);
+	SetAnimationMgr(MMS_FEMALE, &AniMgrs[MMS_FEMALE]);
+
 	//for (int AniIdx = 0; AniIdx < ZC_STATE_LOWER_END; AniIdx++)
 	//{
 	//	auto& AniItem = g_AnimationInfoTableLower[AniIdx];
@@ -3,10 +3,13 @@
 #include <unordered_map>
 #include "RAnimationMgr.h"
 #include "RBspObject.h"
+#include "MZFileCache.h"
 
 class LagCompManager
 {
 public:
+	~LagCompManager();
+
 	bool Create();
 
 	RealSpace2::RBspObject* GetBspObject(const char* MapName);
@@ -15,5 +18,6 @@ private:
 	bool LoadAnimations(const char* filename, int Index);
 
 	RealSpace2::RAnimationMgr AniMgrs[2]; // 0 = male, 1 = female
+	MZFileCache FileCache;
 	std::unordered_map<std::string, RealSpace2::RBspObject> Maps;
 };
\ No newline at end of file
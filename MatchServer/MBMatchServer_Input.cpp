@@ -1,6 +1,11 @@
 #include "stdafx.h"
 #include "MBMatchServer.h"
 #include "MMatchConfig.h"
+#include "DBProfiler.h"
+#include "CachedDatabase.h"
+#include "DBLogSink.h"
+#include <atomic>
+#include <thread>
 
 static std::string Line;
 static std::vector<std::string> Splits;
@@ -373,6 +378,134 @@ void MBMatchServer::InitConsoleCommands()
 		ResponseMySimpleCharInfo(MUID(*UID));
 	});
 
+	AddConsoleCommand("dbprofile", 0, 1,
+		"Prints database call timings.",
+		"dbprofile [reset]",
+		"Prints the number of calls and the total, average and maximum time spent in each\n"
+		"database method since the server started or the timings were last reset.\n"
+		"\"dbprofile reset\" clears the timings.",
+		[] {
+		if (NumArguments == 0)
+		{
+			GetDBProfiler().Dump();
+			return;
+		}
+
+		if (Splits[1] != "reset")
+		{
+			MLog("Unknown argument \"%s\"\n", Splits[1].c_str());
+			return;
+		}
+
+		GetDBProfiler().Reset();
+		MLog("Database timings reset\n");
+	});
+
+	AddConsoleCommand("dbcache", 0, 1,
+		"Prints database cache statistics.",
+		"dbcache [clear]",
+		"Prints the hit rate, number of entries and memory usage of the database cache.\n"
+		"\"dbcache clear\" drops everything in the cache.",
+		[] {
+		if (NumArguments == 0)
+		{
+			GetDBCache().Dump();
+			return;
+		}
+
+		if (Splits[1] != "clear")
+		{
+			MLog("Unknown argument \"%s\"\n", Splits[1].c_str());
+			return;
+		}
+
+		GetDBCache().Clear();
+		MLog("Database cache cleared\n");
+	});
+
+	AddConsoleCommand("dbpool", 0, 0,
+		"Prints database connection pool statistics.",
+		"dbpool",
+		"Prints how often connections were acquired, had to be waited for, timed out and were\n"
+		"reopened.\n"
+		"Only applies to MSSQL.",
+		[] {
+		if (MGetServerConfig()->GetDatabaseType() != DatabaseType::MSSQL)
+		{
+			MLog("The connection pool is only used with MSSQL\n");
+			return;
+		}
+
+		auto Pool = GetMSSQLPool();
+		auto Stats = Pool->GetStats();
+		MLog("Connections: %zu\nAcquires: %llu\nWaits: %llu\nTimeouts: %llu\nReconnects: %llu\n"
+			"Failed connects: %llu\n",
+			Pool->GetSize(),
+			static_cast<unsigned long long>(Stats.Acquires),
+			static_cast<unsigned long long>(Stats.Waits),
+			static_cast<unsigned long long>(Stats.Timeouts),
+			static_cast<unsigned long long>(Stats.Reconnects),
+			static_cast<unsigned long long>(Stats.FailedConnects));
+	});
+
+	AddConsoleCommand("dblog", 0, 2,
+		"Prints log sink statistics, or replays log segments into the database.",
+		"dblog [replay [directory]]",
+		"Without arguments, prints how many log rows were written and dropped.\n"
+		"With replay, closes the current segment and inserts the rows of every segment in the\n"
+		"directory into the database on a background thread, and prints the totals when done.\n"
+		"The directory defaults to log_dir in the config.",
+		[] {
+		if (NumArguments == 0)
+		{
+			GetDBLogSink().Dump();
+			return;
+		}
+
+		if (Splits[1] != "replay")
+		{
+			MLog("dblog: Unknown subcommand \"%s\"\n", Splits[1].c_str());
+			return;
+		}
+
+		auto& Directory = NumArguments >= 2 ? Splits[2] : MGetServerConfig()->GetDBLogDirectory();
+		if (Directory.empty())
+		{
+			MLog("dblog: No directory given, and log_dir isn't set\n");
+			return;
+		}
+
+		// Replaying can take minutes, so it runs on its own thread with its own connection
+		// instead of stalling the game loop.
+		static std::atomic<bool> Replaying{false};
+		if (Replaying.exchange(true))
+		{
+			MLog("dblog: A replay is already running\n");
+			return;
+		}
+
+		if (GetDBLogSink().IsRunning())
+			GetDBLogSink().FinishSegment();
+
+		auto DB = MakeUnwrappedDatabaseFromConfig();
+		if (!DB)
+		{
+			Replaying = false;
+			return;
+		}
+
+		MLog("dblog: Replaying %s\n", Directory.c_str());
+		std::thread{[Directory = Directory, DB = std::move(DB)] {
+			auto Result = ReplayDBLogs(Directory.c_str(), *DB);
+			MLog("Replayed %u segments, %llu rows (%llu failed), %u damaged segments\n",
+				Result.Segments,
+				static_cast<unsigned long long>(Result.Rows),
+				static_cast<unsigned long long>(Result.FailedRows),
+				Result.DamagedSegments);
+			Replaying = false;
+		}}.detach();
+	});
+
 	AddConsoleCommand("quit", 0, 0, "", "", "", [] { exit(0); });
 	AddConsoleCommand("exit", 0, 0, "", "", "", [] { exit(0); });
 }
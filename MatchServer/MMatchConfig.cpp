@@ -152,6 +152,52 @@ bool MMatchConfig::Create()
 	if (!SetEnum(ini, DBType, "DB", "database_type"))
 		return false;
 
+	DBCacheSize = ini.GetInt<size_t>("DB", "cache_size", DBCacheSize);
+	DBCacheTTL = ini.GetInt<u64>("DB", "cache_ttl", DBCacheTTL / 1000) * 1000;
+	DBPoolSize = ini.GetInt<size_t>("DB", "pool_size", DBPoolSize);
+	// The main thread, every async thread and a log replay can all hold a connection at once.
+	constexpr size_t MinDBPoolSize = DEFAULT_ASYNCPROXY_THREADPOOL + 2;
+	if (DBPoolSize < MinDBPoolSize)
+	{
+		MLog("[DB] pool_size = %zu is too small for the threads that use it, using %zu instead\n",
+			DBPoolSize, MinDBPoolSize);
+		DBPoolSize = MinDBPoolSize;
+	}
+	DBConnectionLifetime = ini.GetInt<u64>("DB", "connection_lifetime",
+		DBConnectionLifetime / 1000) * 1000;
+	DBLogDirectory = ini.GetString("DB", "log_dir", "").str();
+	DBLogBufferSize = ini.GetInt<size_t>("DB", "log_buffer_size", DBLogBufferSize / 1024) * 1024;
+	DBLogSegmentSize = ini.GetInt<u64>("DB", "log_segment_size",
+		DBLogSegmentSize / (1024 * 1024)) * 1024 * 1024;
+
+	Relevancy.Enabled = ini.GetInt<bool>("SERVER", "relevancy", Relevancy.Enabled);
+	Relevancy.NearDistance = ini.GetInt<float>("SERVER", "relevancy_near", Relevancy.NearDistance);
+	Relevancy.FarDistance = ini.GetInt<float>("SERVER", "relevancy_far", Relevancy.FarDistance);
+	Relevancy.CheckVisibility = ini.GetInt<bool>("SERVER", "relevancy_visibility",
+		Relevancy.CheckVisibility);
+	UDPThreadCount = ini.GetInt<int>("SERVER", "udp_threads", UDPThreadCount);
+	StartupThreadCount = ini.GetInt<int>("SERVER", "startup_threads", StartupThreadCount);
+	FileCacheDirectory = ini.GetString("SERVER", "file_cache_dir", "").str();
+	FileCacheSize = ini.GetInt<u64>("SERVER", "file_cache_size",
+		FileCacheSize / (1024 * 1024)) * 1024 * 1024;
+
+	auto ReadBudgetRate = [&](const char* Name, MCommandBudgetParams::Rate& Rate) {
+		char Key[64];
+		sprintf_safe(Key, "%s_per_sec", Name);
+		Rate.PerSecond = ini.GetInt<u32>("SERVER", Key, Rate.PerSecond);
+		sprintf_safe(Key, "%s_burst", Name);
+		Rate.Burst = ini.GetInt<u32>("SERVER", Key, Rate.Burst);
+	};
+	CommandBudget.Enabled = ini.GetInt<bool>("SERVER", "cmd_budget", CommandBudget.Enabled);
+	CommandBudget.Disconnect = ini.GetInt<bool>("SERVER", "cmd_budget_disconnect",
+		CommandBudget.Disconnect);
+	ReadBudgetRate("cmd_budget_bytes", CommandBudget.Bytes);
+	ReadBudgetRate("cmd_budget", CommandBudget.Commands);
+	ReadBudgetRate("cmd_budget_chat",
+		CommandBudget.Categories[size_t(MCommandBudgetCategory::Chat)]);
+	ReadBudgetRate("cmd_budget_peer",
+		CommandBudget.Categories[size_t(MCommandBudgetCategory::Peer)]);
+
 	if (DBType == DatabaseType::MSSQL)
 	{
 		MDatabase::ConnectionDetails ConnDetails;
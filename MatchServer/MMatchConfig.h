@@ -8,6 +8,8 @@
 #include "MMatchGlobal.h"
 #include "IDatabase.h"
 #include "MDatabase.h"
+#include "Relevancy.h"
+#include "MCommandBudget.h"
 
 bool GetDBConnDetails(const struct IniParser& ini, MDatabase::ConnectionDetails& Output);
 
@@ -58,6 +60,29 @@ private:
 	std::string GameDirectory = "";
 	bool bIsMasterServer = true;
 	DatabaseType DBType = DatabaseType::SQLite;
+	// Maximum number of accounts kept in the database cache. 0 disables it.
+	size_t DBCacheSize = 2048;
+	// Milliseconds until a database cache entry is dropped.
+	u64 DBCacheTTL = 60 * 1000;
+	// Number of MSSQL connections shared by the main thread and the async threads. Raised to the
+	// number of threads that can use one at once if it's lower.
+	size_t DBPoolSize = 8;
+	// Milliseconds until a pooled connection is reopened. 0 keeps connections open indefinitely.
+	u64 DBConnectionLifetime = 60 * 60 * 1000;
+	// Directory the log tables are written to instead of the database. Empty disables it.
+	std::string DBLogDirectory;
+	size_t DBLogBufferSize = 4 * 1024 * 1024;
+	u64 DBLogSegmentSize = 64 * 1024 * 1024;
+	RelevancyParams Relevancy;
+	// Number of UDP sockets sharing the port with SO_REUSEPORT, each with its own thread.
+	int UDPThreadCount = 1;
+	// Number of threads the data files are loaded on at startup. 0 uses one per core.
+	int StartupThreadCount = 0;
+	// Directory of the decompressed file cache shared with the other servers on the host.
+	// Empty disables it.
+	std::string FileCacheDirectory;
+	u64 FileCacheSize = 512 * 1024 * 1024;
+	MCommandBudgetParams CommandBudget;
 
 	bool				m_bIsComplete;
 
@@ -121,6 +146,19 @@ public:
 	bool IsMasterServer() const { return bIsMasterServer; }
 	auto GetPort() const { return 6000; }
 	auto GetDatabaseType() const { return DBType; }
+	auto GetDBCacheSize() const { return DBCacheSize; }
+	auto GetDBCacheTTL() const { return DBCacheTTL; }
+	auto GetDBPoolSize() const { return DBPoolSize; }
+	auto GetDBConnectionLifetime() const { return DBConnectionLifetime; }
+	auto& GetDBLogDirectory() const { return DBLogDirectory; }
+	auto GetDBLogBufferSize() const { return DBLogBufferSize; }
+	auto GetDBLogSegmentSize() const { return DBLogSegmentSize; }
+	auto& GetRelevancyParams() const { return Relevancy; }
+	auto GetUDPThreadCount() const { return UDPThreadCount; }
+	auto GetStartupThreadCount() const { return StartupThreadCount; }
+	auto& GetFileCacheDirectory() const { return FileCacheDirectory; }
+	auto GetFileCacheSize() const { return FileCacheSize; }
+	auto& GetCommandBudgetParams() const { return CommandBudget; }
 
 	struct VersionType {
 		u32 Major, Minor, Patch, Revision;
@@ -279,6 +279,8 @@ void MMatchObject::OnLeaveBattle()
 	SetStageState(MOSS_NONREADY);
 	SetLaunchedGame(false);
 	BasicInfoHistory.clear();
+	HasLatestBasicInfo = false;
+	Relevancy.Clear();
 }
 
 
@@ -17,6 +17,9 @@
 #include "MMatchAntiHack.h"
 #include "GlobalTypes.h"
 #include "BasicInfoHistory.h"
+#include "MSequenceWindow.h"
+#include "BasicInfoSnapshot.h"
+#include "Relevancy.h"
 #include "HitRegistration.h"
 #include "DBQuestCachingData.h"
 
@@ -575,6 +578,43 @@ public:
 
 	BasicInfoHistoryManager BasicInfoHistory;
 
+	// Random key sent to the client at login (MC_MATCH_UDP_SESSION_KEY), and the IP of its TCP
+	// connection. The UDP packets of this player have to carry the key, and come from that IP.
+	u64 UDPSessionKey = 0;
+	u32 SessionIP = 0;
+
+	// State of the UDP game state channel (MC_MATCH_P2P_COMMAND_UDP).
+	struct UDPGameStateChannel
+	{
+		// Set once the client has sent a packet over the channel, which shows that it
+		// understands the command and that the server's packets can reach it.
+		bool Active = false;
+		MSequenceWindow BasicInfoWindow;
+		MSequenceWindow ShotWindow;
+		// Sequence number of the last packet relayed from this player.
+		u32 RelaySequence = 0;
+	} UDPChannel;
+
+	// The latest basic info received from this player, with the fields that the packets leave out
+	// when they haven't changed filled in from earlier ones.
+	QuantizedBasicInfo LatestBasicInfo{};
+	bool HasLatestBasicInfo = false;
+
+	// The basic info snapshots (MC_MATCH_BASICINFO_SNAPSHOT) sent to this client.
+	struct BasicInfoSnapshotState
+	{
+		// Set once the client has asked for snapshots. Until then it gets every player's basic
+		// info relayed as it arrives.
+		bool Enabled = false;
+		u32 NextID = 1;
+		// The newest snapshot the client has acknowledged, which the next one is encoded against.
+		u32 AckedID = 0;
+		BasicInfoSnapshotHistory Sent;
+	} Snapshots;
+
+	// How often this player gets the basic info of each of the others.
+	RelevancyAccumulator Relevancy;
+
 	auto GetSelectedSlot() const
 	{
 		if (BasicInfoHistory.empty())
@@ -35,9 +35,12 @@
 #include "MSacrificeQItemTable.h"
 #include "MMatchPremiumIPCache.h"
 #include "MCommandBuilder.h"
+#include "MStartupTasks.h"
 #include "MMatchLocale.h"
 #include "MMatchEvent.h"
 #include "MMatchEventManager.h"
+#include "CachedDatabase.h"
+#include "DBLogSink.h"
 #include "MMatchEventFactory.h"
 #include "HitRegistration.h"
 #include "MUtil.h"
@@ -50,7 +53,6 @@
 
 #define DEFAULT_REQUEST_UID_SIZE		4200000000
 #define DEFAULT_REQUEST_UID_SPARE_SIZE	10000
-#define DEFAULT_ASYNCPROXY_THREADPOOL	6
 #define MAXUSER_WEIGHT					30
 
 #define MAX_DB_QUERY_COUNT_OUT			5
@@ -238,19 +240,41 @@ bool IsExpiredBlockEndTime( const tm& st )
 	return tie_tm(st) <= tie_tm(*localtime(&unmove(time(0))));
 }
 
-IDatabase* MakeDatabaseFromConfig()
+std::unique_ptr<IDatabase> MakeUnwrappedDatabaseFromConfig()
 {
 	switch (MGetServerConfig()->GetDatabaseType())
 	{
 		case DatabaseType::SQLite:
-			return new SQLiteDatabase;
+			return std::make_unique<SQLiteDatabase>();
 		case DatabaseType::MSSQL:
-			return new MSSQLDatabase;
+			return std::make_unique<MSSQLDatabase>();
 	}
-	MLog("Invalid db config\n");
 	return nullptr;
 }
 
+IDatabase* MakeDatabaseFromConfig()
+{
+	auto* Config = MGetServerConfig();
+
+	auto DB = MakeUnwrappedDatabaseFromConfig();
+	if (!DB)
+	{
+		MLog("Invalid db config\n");
+		return nullptr;
+	}
+
+	if (GetDBLogSink().IsRunning())
+		DB = std::make_unique<LogSinkDatabase>(std::move(DB), GetDBLogSink());
+
+	if (Config->GetDBCacheSize() == 0)
+		return DB.release();
+
+	// Every thread gets its own database instance, but they all share the same cache.
+	auto& Cache = GetDBCache();
+	Cache.SetLimits(Config->GetDBCacheSize(), Config->GetDBCacheTTL());
+	return new CachedDatabase(std::move(DB), Cache);
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 MMatchServer::MMatchServer() : m_pScheduler( 0 )
@@ -302,87 +326,57 @@ bool MMatchServer::LoadInitFile()
 		LOG(LOG_ALL, szText);
 	}
 
-	if (!MMatchFormula::Create()) 
-	{
-		LOG(LOG_ALL, "Open Formula Table FAILED");
-		return false;
-	}
-	if (!MQuestFormula::Create()) 
-	{
-		LOG(LOG_ALL, "Open Quest Formula Table FAILED");
-		return false;
-	}
-
-	if (!MGetMatchWorldItemDescMgr()->ReadXml(FILENAME_WORLDITEM_DESC))
-	{
-		Log(LOG_ALL, "Read World Item Desc Failed");
-		return false;
-	}
-
-#ifdef _QUEST_ITEM
-	if( !GetQuestItemDescMgr().ReadXml(QUEST_ITEM_FILE_NAME) )
-	{
-		Log( LOG_ALL, "Load quest item xml file failed." );
-		return false;
-	}
-	if( !MSacrificeQItemTable::GetInst().ReadXML(SACRIFICE_TABLE_XML) )
-	{
-		Log( LOG_ALL, "Load sacrifice quest item table failed." );
-		return false;
-	}
-#endif
 	if (MGetServerConfig()->GetServerMode() == MSM_CLAN)
 	{
 		GetLadderMgr()->Init();
 	}
 
-	if (!MGetMapsWorldItemSpawnInfo()->Read())
-	{
-		Log(LOG_ALL, "Read World Item Spawn Failed");
-		return false;
-	}
-
-	if (!MGetMatchItemDescMgr()->ReadXml(FILENAME_ITEM_DESC))
-	{
-		Log(LOG_ALL, "Read Item Descriptor Failed");
-		return false;
-	}
-
-	if(!GetQuest()->Create())
-	{
-		Log(LOG_ALL, "Read Quest Desc Failed");
+	// The asset files only depend on each other through the descriptions they look up, so each
+	// one is loaded in parallel as soon as what it looks up has been.
+	MStartupTasks Tasks;
+	Tasks.Add("Formula table", [] { return MMatchFormula::Create(); });
+	Tasks.Add("Quest formula table", [] { return MQuestFormula::Create(); });
+	const auto WorldItems = Tasks.Add(FILENAME_WORLDITEM_DESC, [] {
+		return MGetMatchWorldItemDescMgr()->ReadXml(FILENAME_WORLDITEM_DESC); });
+	Tasks.Add("World item spawns", [] { return MGetMapsWorldItemSpawnInfo()->Read(); }, {WorldItems});
+	const auto Items = Tasks.Add(FILENAME_ITEM_DESC, [] {
+		return MGetMatchItemDescMgr()->ReadXml(FILENAME_ITEM_DESC); });
+#ifdef _QUEST_ITEM
+	const auto QuestItems = Tasks.Add(QUEST_ITEM_FILE_NAME, [] {
+		return GetQuestItemDescMgr().ReadXml(QUEST_ITEM_FILE_NAME); });
+	Tasks.Add(SACRIFICE_TABLE_XML, [] {
+		return MSacrificeQItemTable::GetInst().ReadXML(SACRIFICE_TABLE_XML); }, {QuestItems});
+	// The drop tables and the shop look up both kinds of items.
+	const std::initializer_list<MStartupTasks::TaskID> ItemDeps = {Items, QuestItems};
+#else
+	const std::initializer_list<MStartupTasks::TaskID> ItemDeps = {Items};
+#endif
+	Tasks.Add("Quest descriptions", [this] { return GetQuest()->Create(); }, ItemDeps);
+	Tasks.Add(FILENAME_SHOP, [] { return MGetMatchShop()->Create(FILENAME_SHOP); }, ItemDeps);
+	Tasks.Add(FILENAME_SHUTDOWN_NOTIFY, [this] {
+		return m_MatchShutdown.LoadXML_ShutdownNotify(FILENAME_SHUTDOWN_NOTIFY); });
+	Tasks.Add(FILENAME_CHANNELRULE, [] {
+		return MGetChannelRuleMgr()->ReadXml(FILENAME_CHANNELRULE); });
+	Tasks.Add("gungame.xml", [] { return MGetGunGame()->ReadXML("gungame.xml"); });
+	Tasks.Add("Item checksum", [this] {
+		SetItemFileChecksum(MGetMZFileChecksum(FILENAME_ITEM_DESC));
+		return true;
+	});
+
+	const auto Loaded = Tasks.Run(MGetServerConfig()->GetStartupThreadCount());
+	Tasks.Report([&](const char* Line) { Log(LOG_ALL, Line); });
+	if (!Loaded)
+	{
+		Log(LOG_ALL, "Loading the server's data files failed");
 		return false;
 	}
 
-	if (!MGetMatchShop()->Create(FILENAME_SHOP))
-	{
-		Log(LOG_ALL, "Read Shop Item Failed");
-		return false;
-	}
+	// Adds channels to the server, so it's done after the loading threads are done.
 	if (!LoadChannelPreset()) 
 	{
 		Log(LOG_ALL, "Load Channel preset Failed");
 		return false;
 	}
-	if (!m_MatchShutdown.LoadXML_ShutdownNotify(FILENAME_SHUTDOWN_NOTIFY))
-	{
-		Log(LOG_ALL, "Load Shutdown Notify Failed");
-		return false;
-	}
-	if (!MGetChannelRuleMgr()->ReadXml(FILENAME_CHANNELRULE))
-	{
-		Log(LOG_ALL, "Load ChannelRule.xml Failed");
-		return false;
-	}
-
-	if (!MGetGunGame()->ReadXML("gungame.xml"))
-	{
-		Log(LOG_ALL, "Load GunGame.xml Failed.\n");
-		return false;
-	}
-
-	u32 nItemChecksum = MGetMZFileChecksum(FILENAME_ITEM_DESC);
-	SetItemFileChecksum(nItemChecksum);
 
 	if( !InitEvent() )
 	{
@@ -459,6 +453,17 @@ bool MMatchServer::LoadChannelPreset()
 
 bool MMatchServer::InitDB()
 {
+	auto* Config = MGetServerConfig();
+	if (!Config->GetDBLogDirectory().empty() && !GetDBLogSink().IsRunning())
+	{
+		DBLogSink::Options Opts;
+		Opts.Directory = Config->GetDBLogDirectory();
+		Opts.MemoryBudget = Config->GetDBLogBufferSize();
+		Opts.SegmentSize = Config->GetDBLogSegmentSize();
+		if (!GetDBLogSink().Start(Opts))
+			return false;
+	}
+
 	Database = MakeDatabaseFromConfig();
 	return bool(Database);
 }
@@ -477,21 +482,26 @@ bool MMatchServer::Create(int nPort)
 	Net.SetLogLevel(0);
 #endif
 
-	if (m_SafeUDP.Create(true, MATCHSERVER_DEFAULT_UDP_PORT)==false) {
+	// Loaded first, since the config decides how many UDP threads to create.
+	if (!LoadInitFile()) return false;
+
+	if (m_SafeUDP.Create(true, MATCHSERVER_DEFAULT_UDP_PORT, true,
+		MGetServerConfig()->GetUDPThreadCount())==false) {
 		LOG(LOG_ALL, "Match Server SafeUDP Create FAILED (Port:%d)", MATCHSERVER_DEFAULT_UDP_PORT);
 		return false;
 	}
 
 	m_SafeUDP.SetCustomRecvCallback(UDPSocketRecvEvent);
 
-	if (!LoadInitFile()) return false;
-
 	if (!InitDB()) return false;
 
 	m_AsyncProxy.Create(DEFAULT_ASYNCPROXY_THREADPOOL);
 
 	m_Admin.Create(this);
 
+	SetCommandBudgetParams(MGetServerConfig()->GetCommandBudgetParams());
+	UDPBudgetParams = MGetServerConfig()->GetCommandBudgetParams();
+	UDPBudgetParams.Disconnect = false;
 	if(MServer::Create(nPort)==false) return false;
 
 	GetDBMgr()->UpdateServerInfo(MGetServerConfig()->GetServerID(), MGetServerConfig()->GetMaxUser(),
@@ -540,6 +550,7 @@ void MMatchServer::Destroy()
 	m_ChannelMap.Destroy();
 	m_Admin.Destroy();
 	m_AsyncProxy.Destroy();
+	GetDBLogSink().Stop();
 	MGetMatchShop()->Destroy();
 	m_SafeUDP.Destroy();
 	MServer::Destroy();
@@ -729,6 +740,13 @@ void MMatchServer::OnRun(void)
 
 		LOG(LOG_ALL, "ClientCount=%d, SessionCount=%d, AgentCount=%d", 
 			GetClientCount(), GetCommObjCount(), GetAgentCount());
+
+		auto&& Budget = GetCommandBudgetStats();
+		LOG(LOG_ALL, "Command budget: DroppedCommands=%llu (Chat=%llu, Peer=%llu), Disconnects=%llu",
+			static_cast<unsigned long long>(Budget.DroppedCommands),
+			static_cast<unsigned long long>(Budget.DroppedByCategory[size_t(MCommandBudgetCategory::Chat)]),
+			static_cast<unsigned long long>(Budget.DroppedByCategory[size_t(MCommandBudgetCategory::Peer)]),
+			static_cast<unsigned long long>(Budget.Disconnects));
 		MCommand* pNew = CreateCommand(MC_NET_PING, MUID(0,0));
 		pNew->AddParameter(new MCmdParamUInt(static_cast<u32>(GetGlobalClockCount())));
 		RouteToAllConnection(pNew);
@@ -824,7 +842,9 @@ void MMatchServer::UpdateServerStatusDB()
 		{
 			LOG(LOG_ALL, "[CRITICAL ERROR] DB Connection Lost. ");
 
-			if (auto DB = dynamic_cast<MSSQLDatabase*>(GetDBMgr()))
+			// The database may be wrapped in a cache or a log sink, so this goes by the config
+			// rather than the type of GetDBMgr().
+			if (MGetServerConfig()->GetDatabaseType() == DatabaseType::MSSQL)
 			{
 				InitDB();
 			}
@@ -1048,6 +1068,19 @@ static int GetBlobCmdID(const char* Data)
 	return *(u16*)(Data + 2);
 }
 
+static u64 MakeUDPPeerKey(u32 IP, u16 Port)
+{
+	return (u64(Port) << 32) | IP;
+}
+
+// The commands that are sent over the UDP game state channel. Basic info is state, where a newer
+// one replaces an older one, while shots are events.
+static bool IsUDPGameStateCommand(int CommandID)
+{
+	return CommandID == MC_PEER_BASICINFO || CommandID == MC_PEER_BASICINFO_RG ||
+		CommandID == MC_PEER_SHOT;
+}
+
 void MMatchServer::OnTunnelledP2PCommand(const MUID & Sender, const MUID & Receiver, const char * Blob, size_t BlobSize)
 {
 	auto SenderObj = GetObject(Sender);
@@ -1103,6 +1136,28 @@ void MMatchServer::OnTunnelledP2PCommand(const MUID & Sender, const MUID & Recei
 			nbi.bi.RecvTime = MGetMatchServer()->GetGlobalClockCount() / 1000.0;
 			SenderObj->BasicInfoHistory.AddBasicInfo(nbi.bi);
 
+			CharacterInfo Info;
+			Info.Pos = nbi.bi.position;
+			Info.Vel = nbi.bi.velocity;
+			Info.Dir = nbi.bi.direction;
+			Info.CamDir = nbi.bi.cameradir;
+			Info.HasCamDir = (nbi.Flags & BasicInfoFlags::CameraDir) != 0;
+			Info.LowerAni = nbi.bi.lowerstate;
+			Info.UpperAni = nbi.bi.upperstate;
+			Info.Slot = nbi.bi.SelectedSlot;
+			auto State = QuantizeBasicInfo(Info, nbi.Time);
+			// The animations and slot are left out when they haven't changed.
+			auto& Latest = SenderObj->LatestBasicInfo;
+			if (!(nbi.Flags & BasicInfoFlags::Animations))
+			{
+				State.LowerAni = Latest.LowerAni;
+				State.UpperAni = Latest.UpperAni;
+			}
+			if (!(nbi.Flags & BasicInfoFlags::SelItem))
+				State.Slot = Latest.Slot;
+			Latest = State;
+			SenderObj->HasLatestBasicInfo = true;
+
 			TrySuicide(nbi.bi.position.z, Sender);
 		}
 		break;
@@ -1159,6 +1214,13 @@ void MMatchServer::OnTunnelledP2PCommand(const MUID & Sender, const MUID & Recei
 		};
 	}
 
+	if (Receiver == MUID{0, 0} && Netcode == NetcodeType::ServerBased &&
+		IsUDPGameStateCommand(CommandID))
+	{
+		RouteGameStateToBattle(*SenderObj, uidStage, Blob, BlobSize);
+		return;
+	}
+
 	MCommand* pCmd = CreateCommand(MC_MATCH_P2P_COMMAND, MUID(0, 0));
 	pCmd->AddParameter(new MCmdParamUID(Sender));
 	pCmd->AddParameter(new MCmdParamBlob(Blob, BlobSize));
@@ -1172,6 +1234,221 @@ void MMatchServer::OnTunnelledP2PCommand(const MUID & Sender, const MUID & Recei
 	}
 }
 
+void MMatchServer::OnUDPP2PCommand(const MUID& Sender, const MUID& Receiver, u32 Sequence,
+	const char* Blob, size_t BlobSize)
+{
+	auto SenderObj = GetObject(Sender);
+	if (!SenderObj)
+		return;
+
+	// The packets come from the network unauthenticated apart from the address, so the blob is
+	// checked to be large enough for what OnTunnelledP2PCommand reads from it.
+	constexpr size_t BlobHeaderSize = 2 + 2 + 1 + 4;
+	if (BlobSize < BlobHeaderSize)
+		return;
+
+	auto CommandID = GetBlobCmdID(Blob);
+	auto MinSize = BlobHeaderSize;
+	switch (CommandID)
+	{
+	case MC_PEER_BASICINFO: MinSize += sizeof(ZPACKEDBASICINFO); break;
+	case MC_PEER_BASICINFO_RG: break;
+	case MC_PEER_SHOT: MinSize += sizeof(ZPACKEDSHOTINFO); break;
+	default: return;
+	}
+	if (BlobSize < MinSize)
+		return;
+
+	auto Stage = FindStage(SenderObj->GetStageUID());
+	if (!Stage || Stage->GetStageSetting()->GetNetcode() != NetcodeType::ServerBased)
+		return;
+
+	auto& Channel = SenderObj->UDPChannel;
+	Channel.Active = true;
+
+	auto Accepted = CommandID == MC_PEER_SHOT ?
+		Channel.ShotWindow.AcceptUnique(Sequence) :
+		Channel.BasicInfoWindow.AcceptLatest(Sequence);
+	if (!Accepted)
+		return;
+
+	OnTunnelledP2PCommand(Sender, Receiver, Blob, BlobSize);
+}
+
+void MMatchServer::RouteGameStateToBattle(MMatchObject& SenderObj, const MUID& uidStage,
+	const char* Blob, size_t BlobSize)
+{
+	auto Stage = FindStage(uidStage);
+	if (!Stage)
+		return;
+
+	auto&& SenderUID = SenderObj.GetUID();
+	auto Sequence = ++SenderObj.UDPChannel.RelaySequence;
+	auto CommandID = GetBlobCmdID(Blob);
+	auto IsBasicInfoRG = CommandID == MC_PEER_BASICINFO_RG;
+
+	// Basic info can be skipped for the players it isn't relevant to, since the next one replaces
+	// it. Shots can't, and neither can RG basic info that carries animation or slot changes, since
+	// the following ones leave those out.
+	constexpr size_t BlobHeaderSize = 2 + 2 + 1 + 4;
+	auto CanSkip = CommandID == MC_PEER_BASICINFO ||
+		(IsBasicInfoRG && BlobSize > BlobHeaderSize &&
+			!(u8(Blob[BlobHeaderSize]) & (BasicInfoFlags::Animations | BasicInfoFlags::SelItem)));
+
+	// The commands are only built for the kind of receivers that are there.
+	std::unique_ptr<MCommand> UDPCmd, TCPCmd;
+	for (auto i = Stage->GetObjBegin(); i != Stage->GetObjEnd(); ++i)
+	{
+		if (i->first == SenderUID)
+			continue;
+
+		auto Obj = GetObject(i->first);
+		if (!Obj || !Obj->GetEnterBattle())
+			continue;
+
+		// Players that get snapshots get this basic info in the next one instead.
+		if (IsBasicInfoRG && Obj->Snapshots.Enabled)
+			continue;
+
+		if (CanSkip && !IsRelevantUpdate(*Obj, SenderObj, *Stage))
+			continue;
+
+		if (Obj->UDPChannel.Active && Obj->GetBridgePeer())
+		{
+			if (!UDPCmd)
+			{
+				UDPCmd.reset(CreateCommand(MC_MATCH_P2P_COMMAND_UDP, MUID(0, 0)));
+				UDPCmd->AddParameter(new MCmdParamUID(SenderUID));
+				UDPCmd->AddParameter(new MCmdParamUInt(Sequence));
+				UDPCmd->AddParameter(new MCmdParamBlob(Blob, BlobSize));
+				UDPCmd->AddParameter(new MCmdParamUInt64(0));
+			}
+			// The receiver checks that the key is its own.
+			static_cast<MCmdParamUInt64*>(UDPCmd->GetParameter(3))->m_Value = Obj->UDPSessionKey;
+			if (SendRawCommandByUDP(*UDPCmd, *Obj))
+				continue;
+		}
+
+		if (!TCPCmd)
+		{
+			TCPCmd.reset(CreateCommand(MC_MATCH_P2P_COMMAND, MUID(0, 0)));
+			TCPCmd->AddParameter(new MCmdParamUID(SenderUID));
+			TCPCmd->AddParameter(new MCmdParamBlob(Blob, BlobSize));
+		}
+		RouteToListener(Obj, TCPCmd->Clone());
+	}
+}
+
+void MMatchServer::SendBasicInfoSnapshots(MMatchStage& Stage)
+{
+	std::vector<MMatchObject*> Players;
+	for (auto i = Stage.GetObjBegin(); i != Stage.GetObjEnd(); ++i)
+	{
+		auto Obj = GetObject(i->first);
+		if (Obj && Obj->GetEnterBattle() && Obj->IsAlive() && Obj->HasLatestBasicInfo)
+			Players.push_back(Obj);
+	}
+
+	for (auto i = Stage.GetObjBegin(); i != Stage.GetObjEnd(); ++i)
+	{
+		auto Obj = GetObject(i->first);
+		if (!Obj || !Obj->GetEnterBattle() || !Obj->Snapshots.Enabled)
+			continue;
+
+		auto& Snapshots = Obj->Snapshots;
+
+		BasicInfoSnapshot Snapshot;
+		Snapshot.ID = Snapshots.NextID++;
+		if (Snapshots.NextID == 0)
+			Snapshots.NextID = 1;
+		// Players that aren't relevant enough to be updated this time keep the state they had in
+		// the last snapshot, which costs a bit if it has been acknowledged.
+		auto Previous = Snapshots.Sent.Find(Snapshot.ID - 1);
+		auto FindPrevious = [&](const MUID& UID) -> const QuantizedBasicInfo* {
+			if (!Previous)
+				return nullptr;
+			for (auto&& Entry : Previous->Entries)
+				if (Entry.UID == UID)
+					return &Entry.State;
+			return nullptr;
+		};
+		for (auto Player : Players)
+		{
+			auto&& UID = Player->GetUID();
+			if (UID == Obj->GetUID())
+				continue;
+
+			const QuantizedBasicInfo* State = &Player->LatestBasicInfo;
+			if (!IsRelevantUpdate(*Obj, *Player, Stage))
+				if (auto PreviousState = FindPrevious(UID))
+					State = PreviousState;
+			Snapshot.Entries.push_back({UID, *State});
+		}
+
+		auto Baseline = Snapshots.Sent.Find(Snapshots.AckedID);
+		MBitWriter Writer;
+		EncodeBasicInfoSnapshot(Snapshot, Baseline, Writer);
+		Snapshots.Sent.Add(std::move(Snapshot));
+
+		auto&& Data = Writer.GetData();
+		std::unique_ptr<MCommand> Cmd{CreateCommand(MC_MATCH_BASICINFO_SNAPSHOT, MUID(0, 0))};
+		Cmd->AddParameter(new MCmdParamBlob(Data.data(), int(Data.size())));
+
+		// Snapshots supersede each other, so ones that are lost don't need to be resent, as long
+		// as the client keeps acknowledging the ones it does get.
+		if (Obj->UDPChannel.Active && Obj->GetBridgePeer() && SendRawCommandByUDP(*Cmd, *Obj))
+			continue;
+		RouteToListener(Obj, Cmd.release());
+	}
+}
+
+bool MMatchServer::IsRelevantUpdate(MMatchObject& Viewer, MMatchObject& Subject, MMatchStage& Stage)
+{
+	auto&& Params = MGetServerConfig()->GetRelevancyParams();
+	if (!Params.Enabled)
+		return true;
+
+	// Dead players and spectators watch through someone else's eyes, so everyone is as relevant
+	// to them as to whoever they're watching.
+	auto Priority = 1.f;
+	if (Viewer.IsAlive())
+	{
+		auto&& ViewerPos = Viewer.GetPosition();
+		auto&& SubjectPos = Subject.GetPosition();
+		auto Visible = true;
+		if (Params.CheckVisibility && Stage.BspObject &&
+			RealSpace2::Magnitude(SubjectPos - ViewerPos) > Params.NearDistance)
+		{
+			Visible = Viewer.Relevancy.IsVisible(Subject.GetUID(), GetGlobalClockCount(), [&] {
+				return IsVisibleFrom(Stage.BspObject, ViewerPos, SubjectPos);
+			});
+		}
+		Priority = GetRelevancy(Params, ViewerPos, SubjectPos, Visible);
+	}
+
+	return Viewer.Relevancy.Update(Subject.GetUID(), Priority);
+}
+
+void MMatchServer::OnBasicInfoSnapshotAck(const MUID& uidPlayer, u32 SnapshotID)
+{
+	auto Obj = GetObject(uidPlayer);
+	if (!Obj)
+		return;
+
+	auto& Snapshots = Obj->Snapshots;
+	if (SnapshotID == 0)
+	{
+		Snapshots.Enabled = true;
+		Snapshots.AckedID = 0;
+		Snapshots.Sent.Clear();
+		return;
+	}
+
+	if (Snapshots.Sent.Find(SnapshotID) &&
+		(Snapshots.AckedID == 0 || IsNewerSequence(SnapshotID, Snapshots.AckedID)))
+		Snapshots.AckedID = SnapshotID;
+}
+
 void MMatchServer::OnPeerShot(MMatchObject& SenderObj, MMatchStage& Stage, const ZPACKEDSHOTINFO& psi)
 {
 	if (!SenderObj.IsAlive())
@@ -1645,6 +1922,12 @@ int MMatchServer::ObjectRemove(const MUID& uid, MMatchObjectList::iterator* pNex
 	// m_ClanMap 
 	m_ClanMap.RemoveObject(pObj->GetUID(), pObj);
 
+	if (pObj->GetBridgePeer())
+	{
+		std::lock_guard<std::mutex> Lock{UDPPeerMutex};
+		UDPPeers.erase(MakeUDPPeerKey(pObj->GetIP(), pObj->GetPort()));
+	}
+
 	delete pObj;
 	pObj = NULL;
 
@@ -1745,16 +2028,39 @@ void MMatchServer::AnnounceErrorMsg(MObject* pObj, const int nErrorCode)
 
 
 
-void MMatchServer::OnBridgePeer(const MUID& uidChar, u32 dwIP, u32 nPort)
+void MMatchServer::OnBridgePeer(const MUID& uidChar, u32 dwIP, u32 nPort, u64 Key)
 {
 	auto* pObj = GetObject(uidChar);
 	if (!pObj)
 		return;
 
+	// The UID is taken from an unauthenticated datagram, so the key and the IP of the TCP
+	// connection have to match before the address is trusted with the player's game state.
+	if (Key != pObj->UDPSessionKey || dwIP != pObj->SessionIP)
+		return;
+
 	MSocket::in_addr addr;
 	addr.s_addr = dwIP;
 	auto IP = GetIPv4String(addr);
 
+	{
+		std::lock_guard<std::mutex> Lock{UDPPeerMutex};
+		// The budget carries over to the new address, so that bridging again doesn't refill it.
+		std::unique_ptr<MCommandBudget> Budget;
+		if (pObj->GetBridgePeer())
+		{
+			auto it = UDPPeers.find(MakeUDPPeerKey(pObj->GetIP(), pObj->GetPort()));
+			if (it != UDPPeers.end())
+			{
+				Budget = std::move(it->second.Budget);
+				UDPPeers.erase(it);
+			}
+		}
+		if (!Budget && UDPBudgetParams.Enabled)
+			Budget = std::make_unique<MCommandBudget>(UDPBudgetParams, m_CommandBudgetStats);
+		UDPPeers[MakeUDPPeerKey(dwIP, static_cast<u16>(nPort))] = {uidChar, Key, std::move(Budget)};
+	}
+
 	pObj->SetPeerAddr(dwIP, IP.c_str(), static_cast<unsigned short>(nPort));
 	pObj->SetBridgePeer(true);
 	pObj->SetPlayerFlag(MTD_PlayerFlags_BridgePeer, true);
@@ -1817,6 +2123,28 @@ void MMatchServer::SendCommandByUDP(MCommand* pCommand, char* szIP, int nPort)
 	bool bRet = m_SafeUDP.Send(szIP, nPort, szBuf, size);
 }
 
+bool MMatchServer::SendRawCommandByUDP(MCommand& Command, MMatchObject& Receiver)
+{
+	auto Size = CalcPacketSize(&Command);
+	if (Size > MAX_PACKET_SIZE)
+		return false;
+
+	auto* Buffer = new char[Size];
+	auto* Msg = reinterpret_cast<MCommandMsg*>(Buffer);
+	Msg->nMsg = MSGID_RAWCOMMAND;
+	Msg->nSize = static_cast<unsigned short>(Size);
+	Msg->nCheckSum = 0;
+	Command.GetData(Msg->Buffer, Size - sizeof(MPacketHeader));
+	Msg->nCheckSum = MBuildCheckSum(Msg, Size);
+
+	if (!m_SafeUDP.Send(Receiver.GetIP(), Receiver.GetPort(), Buffer, Size))
+	{
+		delete[] Buffer;
+		return false;
+	}
+	return true;
+}
+
 bool MMatchServer::UDPSocketRecvEvent(u32 dwIP, u16 wRawPort, char* pPacket, u32 dwSize)
 {
 	if (dwSize < sizeof(MPacketHeader)) return false;
@@ -1850,7 +2178,34 @@ void MMatchServer::ParseUDPPacket(char* pData, MPacketHeader* pPacketHeader, u32
 				MCommand* pCmd = new MCommand();
 				pCmd->SetData(pData, &m_CommandManager);
 
-				if (pCmd->GetID() == MC_MATCH_BRIDGEPEER) {
+				if (pCmd->GetID() == MC_MATCH_P2P_COMMAND_UDP) {
+					// The sender is whoever bridged the address the packet came from, if the packet
+					// carries that player's session key and fits in their budget.
+					MUID Sender;
+					u64 Key;
+					if (pCmd->GetParameter(&Key, 3, MPT_UINT64))
+					{
+						std::lock_guard<std::mutex> Lock{UDPPeerMutex};
+						auto it = UDPPeers.find(MakeUDPPeerKey(dwIP, MSocket::ntohs(wRawPort)));
+						if (it != UDPPeers.end() && it->second.Key == Key)
+						{
+							auto* Budget = it->second.Budget.get();
+							if (!Budget || Budget->ConsumeCommand(pCmd->GetID(), pCmd->m_pCommandDesc,
+								GetGlobalTimeMS()) == MCommandBudget::Result::Accept)
+								Sender = it->second.UID;
+						}
+					}
+					if (Sender == MUID(0, 0))
+					{
+						delete pCmd;
+						break;
+					}
+
+					pCmd->m_Sender = Sender;
+					pCmd->m_Receiver = m_This;
+					PostSafeQueue(pCmd);
+				}
+				else if (pCmd->GetID() == MC_MATCH_BRIDGEPEER) {
 					pCmd->m_Sender = MUID(0,0);
 					pCmd->m_Receiver = m_This;
 
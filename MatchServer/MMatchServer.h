@@ -23,6 +23,7 @@
 #include "MMatchEventManager.h"
 #include "GlobalTypes.h"
 #include <queue>
+#include <mutex>
 #include <unordered_map>
 #include "LagCompensation.h"
 #include "SQLiteDatabase.h"
@@ -34,6 +35,7 @@ class MNJ_DBAgentClient;
 
 #define MATCHSERVER_UID		MUID(0, 2)
 #define CHECKMEMORYNUMBER	888888
+#define DEFAULT_ASYNCPROXY_THREADPOOL	6
 
 enum CUSTOM_IP_STATUS
 {
@@ -180,6 +182,9 @@ public:
 	void StageList(const MUID& uidPlayer, int nStageStartIndex, bool bCacheUpdate);
 	void StageLaunch(const MUID& uidStage);
 	void StageFinishGame(const MUID& uidStage);
+	// Sends each player in the battle that has asked for them a snapshot of everyone else's basic
+	// info. Called by the stage every BASICINFO_INTERVAL.
+	void SendBasicInfoSnapshots(MMatchStage& Stage);
 
 	void StandbyClanList(const MUID& uidPlayer, int nClanListStartIndex, bool bCacheUpdate);
 
@@ -240,7 +245,7 @@ protected:
 	void OnMatchLoginFromDBAgent(const MUID& CommUID, const char* szLoginID,
 		const char* szName, int nSex, bool bFreeLoginIP, u32 nChecksumPack);
 	void OnMatchLoginFailedFromDBAgent(const MUID& CommUID, int nResult);
-	void OnBridgePeer(const MUID& uidChar, u32 dwIP, u32 nPort);
+	void OnBridgePeer(const MUID& uidChar, u32 dwIP, u32 nPort, u64 Key);
 	bool AddObjectOnMatchLogin(const MUID& uidComm,
 		MMatchAccountInfo* pSrcAccountInfo,
 		bool bFreeLoginIP,
@@ -266,6 +271,9 @@ protected:
 	void ParsePacket(char* pData, MPacketHeader* pPacketHeader, u32 dwIP, u16 wRawPort);
 	static bool UDPSocketRecvEvent(u32 dwIP, u16 wRawPort, char* pPacket, u32 dwSize);
 	void ParseUDPPacket(char* pData, MPacketHeader* pPacketHeader, u32 dwIP, u16 wRawPort);
+	// Sends a command to the client's UDP address, as a raw command packet. Returns false if the
+	// packet couldn't be queued.
+	bool SendRawCommandByUDP(MCommand& Command, MMatchObject& Receiver);
 
 	// Async DB
 	void ProcessAsyncJob();
@@ -617,6 +625,16 @@ protected:
 
 	void OnTunnelledP2PCommand(const MUID& Sender, const MUID& Receiver,
 		const char* Blob, size_t BlobSize);
+	void OnUDPP2PCommand(const MUID& Sender, const MUID& Receiver, u32 Sequence,
+		const char* Blob, size_t BlobSize);
+	// Relays a basic info or shot command to everyone else in the battle, over UDP to the players
+	// that use the UDP channel and over TCP to the rest.
+	void RouteGameStateToBattle(MMatchObject& SenderObj, const MUID& uidStage,
+		const char* Blob, size_t BlobSize);
+	void OnBasicInfoSnapshotAck(const MUID& uidPlayer, u32 SnapshotID);
+	// Returns whether Viewer should get this update of Subject's basic info, or skip it because
+	// Subject is far away or out of sight.
+	bool IsRelevantUpdate(MMatchObject& Viewer, MMatchObject& Subject, MMatchStage& Stage);
 
 	void OnPeerShot(MMatchObject& SenderObj, MMatchStage& Stage, const struct ZPACKEDSHOTINFO& psi);
 
@@ -679,6 +697,22 @@ protected:
 	MAgentObjectMap		m_AgentMap;
 
 	MSafeUDP			m_SafeUDP;
+	// Maps the UDP address of each client that has bridged its peer to its UID and session key,
+	// so that packets on the UDP game state channel can be attributed to a player. It's read on
+	// the UDP thread.
+	struct UDPPeer
+	{
+		MUID UID;
+		u64 Key;
+		// The packets come in on the UDP thread, not their connection's I/O thread, so they're
+		// charged to a budget of their own. Null if budgets are disabled.
+		std::unique_ptr<MCommandBudget> Budget;
+	};
+	std::mutex UDPPeerMutex;
+	std::unordered_map<u64, UDPPeer> UDPPeers;
+	// The command budget parameters of UDPPeers, which can only drop packets since the UDP thread
+	// can't disconnect anyone.
+	MCommandBudgetParams UDPBudgetParams;
 	IDatabase*			Database{};
 
 	MAsyncProxy			m_AsyncProxy;
@@ -727,6 +761,8 @@ inline const char* MErrStr(const int nID)
 
 bool IsExpiredBlockEndTime(const tm& st);
 
+// Makes the database named in the config, without the cache and the log sink in front of it.
+std::unique_ptr<IDatabase> MakeUnwrappedDatabaseFromConfig();
 IDatabase* MakeDatabaseFromConfig();
 
 void _CheckValidPointer(void* pPointer1, void* pPointer2, void* pPointer3, int nState, int nValue);
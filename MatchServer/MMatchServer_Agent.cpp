@@ -121,6 +121,9 @@ void MMatchServer::OnRegisterAgent(const MUID& uidComm, char* szIP, int nTCPPort
 	if (pCommObj)
 	{
 		pCommObj->GetCommandBuilder()->SetCheckCommandSN(false);
+		// Agents relay the peer traffic of whole stages.
+		if (auto* pBudget = pCommObj->GetCommandBuilder()->GetBudget())
+			pBudget->Disable();
 	}
 
 	MAgentObject* pAgent = GetAgent(uidComm);
@@ -319,7 +319,9 @@ bool MMatchServer::AddObjectOnMatchLogin(const MUID& uidComm,
 	if (pCommObj != NULL)
 	{
 		pObj->SetPeerAddr(pCommObj->GetIP(), pCommObj->GetIPString(), pCommObj->GetPort());
+		pObj->SessionIP = pCommObj->GetIP();
 	}
+	randombytes_buf(&pObj->UDPSessionKey, sizeof(pObj->UDPSessionKey));
 	
 	SetClientClockSynchronize(uidComm);
 
@@ -357,6 +359,10 @@ bool MMatchServer::AddObjectOnMatchLogin(const MUID& uidComm,
 												   pObj->GetAntiHackInfo()->m_szRandomValue);
 	Post(pCmd);	
 
+	pCmd = CreateCommand(MC_MATCH_UDP_SESSION_KEY, uidComm);
+	pCmd->AddParameter(new MCmdParamUInt64(pObj->UDPSessionKey));
+	Post(pCmd);
+
 	MAsyncDBJob_InsertConnLog* pNewJob = new MAsyncDBJob_InsertConnLog();
 	pNewJob->Input(pObj->GetAccountInfo()->m_nAID, pObj->GetIPString(), "" );
 	PostAsyncJob(pNewJob);
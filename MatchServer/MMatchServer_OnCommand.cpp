@@ -104,6 +104,29 @@ _STATUS_CMD_START;
 			OnTunnelledP2PCommand(Sender, Receiver, (char*)BlobPtr, Blob->GetPayloadSize());
 		}
 		break;
+		case MC_MATCH_P2P_COMMAND_UDP:
+		{
+			auto Sender = pCommand->GetSenderUID();
+			MUID Receiver;
+			u32 Sequence;
+			if (!pCommand->GetParameter(&Receiver, 0, MPT_UID)) break;
+			if (!pCommand->GetParameter(&Sequence, 1, MPT_UINT)) break;
+			auto Param = pCommand->GetParameter(2);
+			if (!Param || Param->GetType() != MPT_BLOB) break;
+			auto Blob = (MCmdParamBlob*)Param;
+
+			OnUDPP2PCommand(Sender, Receiver, Sequence,
+				(char*)Blob->GetPointer(), Blob->GetPayloadSize());
+		}
+		break;
+		case MC_MATCH_BASICINFO_SNAPSHOT_ACK:
+		{
+			u32 SnapshotID;
+			if (!pCommand->GetParameter(&SnapshotID, 0, MPT_UINT)) break;
+
+			OnBasicInfoSnapshotAck(pCommand->GetSenderUID(), SnapshotID);
+		}
+		break;
 		case MC_MATCH_UPDATE_CLIENT_SETTINGS:
 		{
 			auto Param = pCommand->GetParameter(0);
@@ -167,11 +190,14 @@ _STATUS_CMD_START;
 			{
 				MUID uidChar;
 				u32 dwIP, nPort;
+				u64 Key;
 
 				pCommand->GetParameter(&uidChar,	0, MPT_UID);
 				pCommand->GetParameter(&dwIP,		1, MPT_UINT);
 				pCommand->GetParameter(&nPort,		2, MPT_UINT);
-				OnBridgePeer(uidChar, dwIP, nPort);
+				if (!pCommand->GetParameter(&Key, 3, MPT_UINT64))
+					break;
+				OnBridgePeer(uidChar, dwIP, nPort, Key);
 			}
 			break;
 		case MC_MATCH_REQUEST_RECOMMANDED_CHANNEL:
@@ -330,6 +330,14 @@ void MMatchStage::Tick(u64 nClock)
 		UpdateWorldItems();
 	}
 
+	if (GetState() == STAGE_STATE_RUN &&
+		GetStageSetting()->GetNetcode() == NetcodeType::ServerBased &&
+		nClock - LastBasicInfoSnapshotTick >= BASICINFO_INTERVAL)
+	{
+		LastBasicInfoSnapshotTick = nClock;
+		MGetMatchServer()->SendBasicInfoSnapshots(*this);
+	}
+
 	m_VoteMgr.Tick(nClock);
 
 	if (IsChecksumUpdateTime(nClock))
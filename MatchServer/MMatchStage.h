@@ -93,6 +93,7 @@ private:
 	char					m_szFirstMasterName[MATCHOBJECT_NAME_LENGTH];
 
 	u64 LastPhysicsTick = 0;
+	u64 LastBasicInfoSnapshotTick = 0;
 
 	void SetMasterUID(const MUID& uid)	{ m_StageSetting.SetMasterUID(uid);}
 	MMatchRule* CreateRule(MMATCH_GAMETYPE nGameType);
@@ -10,6 +10,7 @@
 #include "MErrorTable.h"
 #include "MDebug.h"
 #include "MMatchStatus.h"
+#include "DBProfiler.h"
 #include "MMatchFriendInfo.h"
 #include "MMatchClan.h"
 #include "MInetUtil.h"
@@ -42,7 +43,13 @@ static char g_szDB_SELL_BOUNTY_ITEM[] = "{CALL spSellBountyItem (%d, %d, %d, %d,
 static char g_szDB_UPDATE_EQUIPITEM[] = "{CALL spUpdateEquipItem (%d, %d, %d, %d)}";
 static char g_szDB_INSERT_CONN_LOG[] = "{CALL spInsertConnLog (%d, %d, %d, %d, %d, '%s')}";
 static char g_szDB_INSERT_GAME_LOG[] = "{CALL spInsertGameLog ('%s', '%s', '%s', %d, %d, %d, '%s')}";
-static char g_szDB_INSERT_KILL_LOG[] = "{CALL spInsertKillLog (%d, %d)}";
+// Takes the row's unix time instead of using GETDATE() like spInsertKillLog, and is prepared once
+// per connection and bound to arrays of rows.
+// The time is in local seconds since 1970, split into days and seconds since DATEADD only takes ints.
+static char g_szDB_INSERT_KILL_LOGS[] = "INSERT INTO KillLog (AttackerCID, VictimCID, Time) "
+	"SELECT AttackerCID, VictimCID, DATEADD(second, CAST(LocalTime % 86400 AS int), "
+	"DATEADD(day, CAST(LocalTime / 86400 AS int), '19700101')) "
+	"FROM (SELECT ? AS AttackerCID, ? AS VictimCID, ? AS LocalTime) AS Src";
 static char g_szDB_INSERT_ITEM_PURCHASE_BY_BOUNTY_LOG[] = "{CALL spInsertItemPurchaseLogByBounty (%d, %d, %d, %d, '%s')}";
 static char g_szDB_INSERT_CHAR_MAKING_LOG[] = "{CALL spInsertCharMakingLog (%d, '%s', '%s')}";
 static char g_szDB_INSERT_SERVER_LOG[] = "{CALL spInsertServerLog (%d, %d, %d, %u, %u)}";
@@ -131,19 +138,46 @@ static std::string FilterSQL(std::string str)
 	return str;
 }
 
+std::shared_ptr<MDatabasePool> GetMSSQLPool()
+{
+	static std::mutex Mutex;
+	static std::weak_ptr<MDatabasePool> Pool;
+
+	std::lock_guard<std::mutex> Lock{Mutex};
+	auto Ret = Pool.lock();
+	if (!Ret)
+	{
+		auto* Config = MGetServerConfig();
+		MDatabasePool::Options Opts;
+		Opts.Size = Config->GetDBPoolSize();
+		Opts.MaxLifetime = Config->GetDBConnectionLifetime();
+		Ret = std::make_shared<MDatabasePool>(Config->GetDBConnectionDetails(), Opts,
+			MSSQLDatabase::LogCallback);
+		Pool = Ret;
+	}
+	return Ret;
+}
+
 MSSQLDatabase::MSSQLDatabase()
-	: MSSQLDatabase(MGetServerConfig()->GetDBConnectionDetails())
+	: MSSQLDatabase(GetMSSQLPool())
 {}
 
 MSSQLDatabase::MSSQLDatabase(const MDatabase::ConnectionDetails& Details)
-{
-	m_DB.SetLogCallback(LogCallback);
+	: MSSQLDatabase(std::make_shared<MDatabasePool>(Details, MDatabasePool::Options{1},
+		LogCallback))
+{}
 
+MSSQLDatabase::MSSQLDatabase(std::shared_ptr<MDatabasePool> Pool)
+	: Pool(std::move(Pool))
+{
 	std::ostringstream ss;
 	ss << std::this_thread::get_id();
 	auto Str = ss.str();
 	auto ThreadID = Str.c_str();
-	if (m_DB.Connect(Details))
+
+	// Open a connection up front, so that configuration errors show up at startup.
+	ConnectionScope Connection{*this};
+	if (m_DB)
 	{
 		Log("DBMS connected @ thread ID %s\n", ThreadID);
 	}
@@ -155,17 +189,39 @@ MSSQLDatabase::MSSQLDatabase(const MDatabase::ConnectionDetails& Details)
 
 MSSQLDatabase::~MSSQLDatabase() {}
 
+MSSQLDatabase::ConnectionScope::ConnectionScope(MSSQLDatabase& DB)
+	: DB(DB), Owner(!DB.Lease)
+{
+	if (!Owner)
+		return;
+	DB.Lease = DB.Pool->Acquire();
+	DB.m_DB = DB.Lease.get();
+}
+
+MSSQLDatabase::ConnectionScope::~ConnectionScope()
+{
+	if (!Owner)
+		return;
+	DB.m_DB = nullptr;
+	DB.Lease.Release();
+}
+
 bool MSSQLDatabase::DeleteAllRows()
 {
+	DB_PROFILE_METHOD();
 	auto Query =
 		"EXEC sp_MSForEachTable 'DISABLE TRIGGER ALL ON ?'\n"
 		"EXEC sp_MSForEachTable 'ALTER TABLE ? NOCHECK CONSTRAINT ALL'\n"
 		"EXEC sp_MSForEachTable 'DELETE FROM ?'\n"
 		"EXEC sp_MSForEachTable 'ALTER TABLE ? CHECK CONSTRAINT ALL'\n"
 		"EXEC sp_MSForEachTable 'ENABLE TRIGGER ALL ON ?'"_sv;
+	ConnectionScope Connection{*this};
+	if (!CheckOpen())
+		return false;
+
 	try
 	{
-		m_DB.ExecuteSQL(Query);
+		m_DB->ExecuteSQL(Query);
 	}
 	catch (CDBException* e)
 	{
@@ -175,9 +231,21 @@ bool MSSQLDatabase::DeleteAllRows()
 	return true;
 }
 
+bool MSSQLDatabase::IsOpen()
+{
+	ConnectionScope Connection{*this};
+	return CheckOpen();
+}
+
 bool MSSQLDatabase::CheckOpen()
 {
-	return m_DB.CheckOpen();
+	if (!m_DB)
+		return false;
+	if (m_DB->CheckOpen())
+		return true;
+	// Let the pool reopen it from scratch next time.
+	Lease.MarkBroken();
+	return false;
 }
 
 void MSSQLDatabase::Log(const char *pFormat, ...)
@@ -200,7 +268,7 @@ void MSSQLDatabase::LogCallback(const std::string& strLog)
 }
 
 
-#define _STATUS_DB_START	auto nStatusStartTime = GetGlobalTimeMS();
+#define _STATUS_DB_START	DB_PROFILE_METHOD(); ConnectionScope DBConnection_{*this}; auto nStatusStartTime = GetGlobalTimeMS();
 #define _STATUS_DB_END(nID) MGetServerStatusSingleton()->AddDBQuery(nID, GetGlobalTimeMS()-nStatusStartTime);
 
 bool MSSQLDatabase::GetLoginInfo(const char* szUserID, unsigned int* poutnAID, char* poutPassword, size_t maxlen)
@@ -215,7 +283,7 @@ bool MSSQLDatabase::GetLoginInfo(const char* szUserID, unsigned int* poutnAID, c
 	CString strSQL;
 	strSQL.Format(g_szDB_GET_LOGININFO, szUserID);
 
-	CODBCRecordset rs(&m_DB);
+	CODBCRecordset rs(m_DB);
 
 	bool bException = false;
 	try
@@ -263,7 +331,7 @@ bool MSSQLDatabase::CreateAccount(const char* szUserID,
 		CString strSQL;
 		strSQL.Format(g_szDB_CREATE_ACCOUNT, temp1.c_str(), temp2.c_str(), nCert, szName, nAge, nSex);
 
-		m_DB.ExecuteSQL(strSQL);
+		m_DB->ExecuteSQL(strSQL);
 	}
 	catch (CDBException* e)
 	{
@@ -282,7 +350,7 @@ AccountCreationResult MSSQLDatabase::CreateAccountNew(const char *szUsername,
 	_STATUS_DB_START
 		if (!CheckOpen()) return AccountCreationResult::DBError;
 
-	CODBCRecordset rs(&m_DB);
+	CODBCRecordset rs(m_DB);
 
 	std::string Username = FilterSQL(szUsername), Email = FilterSQL(szEmail);
 
@@ -307,7 +375,7 @@ AccountCreationResult MSSQLDatabase::CreateAccountNew(const char *szUsername,
 		sprintf_safe(sql, "INSERT INTO Account (UserID, UGradeID, PGradeID, RegDate, Email, Age, Name) VALUES ('%s', '0', '0', GETDATE(), '%s', %d, '%s')",
 			szUsername, szEmail, 0, "");
 
-		m_DB.ExecuteSQL(sql);
+		m_DB->ExecuteSQL(sql);
 
 		rs.Close();
 
@@ -325,7 +393,7 @@ AccountCreationResult MSSQLDatabase::CreateAccountNew(const char *szUsername,
 
 		sprintf_safe(sql, "INSERT INTO Login(UserID, AID, PasswordData) VALUES('%s', %d, '%s')", szUsername, AID, szPasswordData);
 
-		m_DB.ExecuteSQL(sql);
+		m_DB->ExecuteSQL(sql);
 	}
 	catch (CDBException* e)
 	{
@@ -352,6 +420,10 @@ AccountCreationResult MSSQLDatabase::CreateAccountNew(const char *szUsername,
 
 bool MSSQLDatabase::BanPlayer(int nAID, const char *szReason, const time_t &UnbanTime)
 {
+	DB_PROFILE_METHOD();
+	ConnectionScope Connection{*this};
+	if (!CheckOpen()) return false;
+
 	auto temp = FilterSQL(szReason);
 
 	char szTime[128];
@@ -366,12 +438,12 @@ bool MSSQLDatabase::BanPlayer(int nAID, const char *szReason, const time_t &Unba
 
 		sprintf_safe(sql, "UPDATE Account SET UGradeID = %d WHERE AID = %d", MMUG_BLOCKED, nAID);
 
-		m_DB.ExecuteSQL(sql);
+		m_DB->ExecuteSQL(sql);
 
 		sprintf_safe(sql, "INSERT INTO Blocks (AID, Type, Reason, EndDate) VALUES (%d, %d, '%s', '%s')",
 			nAID, MMBT_BANNED, temp.c_str(), szTime);
 
-		m_DB.ExecuteSQL(sql);
+		m_DB->ExecuteSQL(sql);
 	}
 	catch (CDBException* e)
 	{
@@ -389,7 +461,7 @@ int MSSQLDatabase::CreateCharacter(int nAID, const char* szNewName, int nCharInd
 		if (!CheckOpen()) return false;
 
 
-	CODBCRecordset rs(&m_DB);
+	CODBCRecordset rs(m_DB);
 
 
 	try
@@ -424,7 +496,7 @@ int MSSQLDatabase::CreateCharacter(int nAID, const char* szNewName, int nCharInd
 		auto temp = FilterSQL(szNewName);
 
 		strSQL.Format(g_szDB_CREATE_CHAR, nAID, nCharIndex, temp.c_str(), nSex, nHair, nFace, nCostume);
-		m_DB.ExecuteSQL(strSQL);
+		m_DB->ExecuteSQL(strSQL);
 	}
 	catch (CDBException* e)
 	{
@@ -445,7 +517,7 @@ bool MSSQLDatabase::GetAccountCharList(const int nAID, MTD_AccountCharInfo* pout
 
 	CString strSQL;
 	strSQL.Format(g_szDB_GET_CHARLIST, nAID);
-	CODBCRecordset rs(&m_DB);
+	CODBCRecordset rs(m_DB);
 
 	bool bException = false;
 	try
@@ -494,7 +566,7 @@ bool MSSQLDatabase::GetAccountCharInfo(const int nAID, const int nCharIndex, MTD
 	CString strSQL;
 
 	strSQL.Format(g_szDB_GET_ACCOUNT_CHARINFO, nAID, nCharIndex);
-	CODBCRecordset rs(&m_DB);
+	CODBCRecordset rs(m_DB);
 
 	bool bException = false;
 	try
@@ -560,7 +632,7 @@ bool MSSQLDatabase::GetCharInfoByAID(const int nAID, const int nCharIndex, MMatc
 	CString strSQL;
 
 	strSQL.Format(g_szDB_GET_CHARINFO_BY_AID, nAID, nCharIndex);
-	CODBCRecordset rs(&m_DB);
+	CODBCRecordset rs(m_DB);
 
 	bool bException = false;
 	try
@@ -647,7 +719,7 @@ bool MSSQLDatabase::GetAccountInfo(int nAID, MMatchAccountInfo* poutAccountInfo)
 	CString strSQL;
 	strSQL.Format(g_szDB_GET_ACCOUNTINFO, nAID);
 
-	CODBCRecordset rs(&m_DB);
+	CODBCRecordset rs(m_DB);
 
 	bool bException = false;
 	try
@@ -702,7 +774,7 @@ bool MSSQLDatabase::DeleteCharacter(const int nAID, const int nCharIndex, const
 	CString strSQL;
 	strSQL.Format(g_szDB_DELETE_CHAR, nAID, nCharIndex, FilterSQL(szCharName).c_str());
 
-	CODBCRecordset rs(&m_DB);
+	CODBCRecordset rs(m_DB);
 
 	try
 	{
@@ -741,7 +813,7 @@ bool MSSQLDatabase::SimpleUpdateCharInfo(const MMatchCharInfo& CharInfo)
 		strSQL.Format(g_szDB_SIMPLE_UPDATE_CHARINFO, CharInfo.m_nCID, FilterSQL(CharInfo.m_szName).c_str(),
 			CharInfo.m_nLevel, CharInfo.m_nXP, CharInfo.m_nBP);
 
-		m_DB.ExecuteSQL(strSQL);
+		m_DB->ExecuteSQL(strSQL);
 	}
 	catch (CDBException* e)
 	{
@@ -764,7 +836,7 @@ bool MSSQLDatabase::InsertCharItem(const unsigned int nCID, int nItemDescID, boo
 
 	CString strSQL;
 	strSQL.Format(g_szDB_INSERT_CHAR_ITEM, nCID, nItemDescID);
-	CODBCRecordset rs(&m_DB);
+	CODBCRecordset rs(m_DB);
 
 	bool bException = false;
 	try
@@ -799,7 +871,7 @@ bool MSSQLDatabase::BuyBountyItem(const unsigned int nCID, int nItemID, int nPri
 
 	CString strSQL;
 	strSQL.Format(g_szDB_BUY_BOUNTY_ITEM, nCID, nItemID, nPrice);
-	CODBCRecordset rs(&m_DB);
+	CODBCRecordset rs(m_DB);
 
 	bool bException = false;
 	try
@@ -832,7 +904,7 @@ bool MSSQLDatabase::SellBountyItem(const unsigned int nCID, unsigned int nItemID
 
 	CString strSQL;
 	strSQL.Format(g_szDB_SELL_BOUNTY_ITEM, nCID, nItemID, nCIID, nPrice, nCharBP);
-	CODBCRecordset rs(&m_DB);
+	CODBCRecordset rs(m_DB);
 
 	bool bException = false;
 	try
@@ -871,7 +943,7 @@ bool MSSQLDatabase::DeleteCharItem(const unsigned int nCID, int nCIID)
 	{
 		CString strSQL;
 		strSQL.Format(g_szDB_DELETE_CHAR_ITEM, nCID, nCIID);
-		m_DB.ExecuteSQL(strSQL);
+		m_DB->ExecuteSQL(strSQL);
 	}
 	catch (CDBException* e)
 	{
@@ -891,7 +963,7 @@ bool MSSQLDatabase::GetCharItemInfo(MMatchCharInfo& CharInfo)
 
 	CString strSQL;
 	strSQL.Format(g_szDB_SELECT_CHAR_ITEM, CharInfo.m_nCID);
-	CODBCRecordset rs(&m_DB);
+	CODBCRecordset rs(m_DB);
 
 	bool bException = false;
 	try
@@ -951,7 +1023,7 @@ bool MSSQLDatabase::GetAccountItemInfo(const int nAID, MAccountItemNode* pOut, i
 
 	CString strSQL;
 	strSQL.Format(g_szDB_SELECT_ACCOUNT_ITEM, nAID);
-	CODBCRecordset rs(&m_DB);
+	CODBCRecordset rs(m_DB);
 
 	bool bException = false;
 	try
@@ -1025,7 +1097,7 @@ bool MSSQLDatabase::UpdateEquipedItem(const u32 nCID, MMatchCharItemParts parts,
 
 	CString strSQL;
 	strSQL.Format(g_szDB_UPDATE_EQUIPITEM, (int)nCID, (int)parts, (int)nCIID, (int)nItemID);
-	CODBCRecordset rs(&m_DB);
+	CODBCRecordset rs(m_DB);
 
 	int nRet = 0;
 	try
@@ -1082,7 +1154,7 @@ bool MSSQLDatabase::InsertConnLog(const int nAID, const char* szIP, const string
 		CString strSQL;
 		strSQL.Format(g_szDB_INSERT_CONN_LOG, nAID, nIP[0], nIP[1], nIP[2], nIP[3], temp.c_str());
 
-		m_DB.ExecuteSQL(strSQL);
+		m_DB->ExecuteSQL(strSQL);
 	}
 	catch (CDBException* e)
 	{
@@ -1109,7 +1181,7 @@ bool MSSQLDatabase::InsertGameLog(const char* szGameName, const char* szMap, con
 		strSQL.Format(g_szDB_INSERT_GAME_LOG, &strStageName[0], szMap, szGameType, nRound, nMasterCID,
 			nPlayerCount, szPlayers);
 
-		m_DB.ExecuteSQL(strSQL);
+		m_DB->ExecuteSQL(strSQL);
 	}
 	catch (CDBException* e)
 	{
@@ -1124,18 +1196,70 @@ bool MSSQLDatabase::InsertGameLog(const char* szGameName, const char* szMap, con
 
 bool MSSQLDatabase::InsertKillLog(const unsigned int nAttackerCID, const unsigned int nVictimCID)
 {
+	DB_PROFILE_METHOD();
+	const KillLogRow Row{nAttackerCID, nVictimCID, LogTime ? LogTime : u64(time(nullptr))};
+	return InsertKillLogs({&Row, 1});
+}
+
+// Converts a Unix time to seconds since 1970 in local time, with the UTC offset that was in effect
+// at that time, so that it's dated like GETDATE() would have dated it then.
+static i64 ToLocalSeconds(u64 UnixTime)
+{
+	auto t = static_cast<time_t>(UnixTime);
+	tm Tm;
+#ifdef _MSC_VER
+	localtime_s(&Tm, &t);
+#else
+	localtime_r(&t, &Tm);
+#endif
+
+	// Days since 1970-01-01 in the proleptic Gregorian calendar, counting years from March so
+	// that the leap day is at the end.
+	i64 Year = Tm.tm_year + 1900 - (Tm.tm_mon < 2);
+	const i64 Era = (Year >= 0 ? Year : Year - 399) / 400;
+	const i64 YearOfEra = Year - Era * 400;
+	const i64 DayOfYear = (153 * ((Tm.tm_mon + 10) % 12) + 2) / 5 + Tm.tm_mday - 1;
+	const i64 DayOfEra = YearOfEra * 365 + YearOfEra / 4 - YearOfEra / 100 + DayOfYear;
+	const i64 Days = Era * 146097 + DayOfEra - 719468;
+
+	return Days * 86400 + Tm.tm_hour * 3600 + Tm.tm_min * 60 + Tm.tm_sec;
+}
+
+bool MSSQLDatabase::InsertKillLogs(ArrayView<const KillLogRow> Rows)
+{
+	DB_PROFILE_METHOD();
+	ConnectionScope Connection{*this};
 	if (!CheckOpen()) return false;
 
+	MDatabaseBatch Batch;
+	Batch.AddIntParam().AddIntParam().AddBigIntParam();
+	for (auto&& Row : Rows)
+		Batch.AddRow(int(Row.AttackerCID), int(Row.VictimCID),
+			static_cast<long long>(ToLocalSeconds(Row.Time)));
+
+	// The rows of an array execution are committed one by one, so a batch that fails partway
+	// would leave the rows before the failure in the table.
+	const bool Transaction = Rows.size() > 1;
 	try
 	{
-		CString strSQL;
-		strSQL.Format(g_szDB_INSERT_KILL_LOG, nAttackerCID, nVictimCID);
-
-		m_DB.ExecuteSQL(strSQL);
+		if (Transaction)
+			m_DB->ExecuteSQL("BEGIN TRANSACTION");
+		try
+		{
+			m_DB->ExecuteBatch(g_szDB_INSERT_KILL_LOGS, Batch);
+		}
+		catch (CDBException*)
+		{
+			if (Transaction)
+				m_DB->ExecuteSQL("IF @@TRANCOUNT > 0 ROLLBACK TRANSACTION");
+			throw;
+		}
+		if (Transaction)
+			m_DB->ExecuteSQL("COMMIT TRANSACTION");
 	}
 	catch (CDBException* e)
 	{
-		Log("MSSQLDatabase::InsertKillLog - %s\n", e->m_strError);
+		Log("MSSQLDatabase::InsertKillLogs - %s\n", e->m_strError);
 		return false;
 	}
 
@@ -1144,8 +1268,10 @@ bool MSSQLDatabase::InsertKillLog(const unsigned int nAttackerCID, const unsigne
 
 bool MSSQLDatabase::InsertChatLog(const u32 nCID, const char* szMsg, u64 nTime)
 {
+	DB_PROFILE_METHOD();
 	return true;
 
+	ConnectionScope Connection{*this};
 	if (!CheckOpen()) return false;
 
 	try
@@ -1153,7 +1279,7 @@ bool MSSQLDatabase::InsertChatLog(const u32 nCID, const char* szMsg, u64 nTime)
 		auto temp = FilterSQL(szMsg);
 		CString strSQL;
 		strSQL.Format("INSERT Into ChatLog (CID, Msg, Time) Values (%u, '%s', GETDATE())", nCID, temp.c_str());
-		m_DB.ExecuteSQL(strSQL);
+		m_DB->ExecuteSQL(strSQL);
 	}
 	catch (CDBException* e)
 	{
@@ -1173,7 +1299,7 @@ bool MSSQLDatabase::UpdateCharLevel(const int nCID, const int nLevel)
 		CString strSQL;
 		strSQL.Format(g_szDB_UPDATE_CHAR_LEVEL, nLevel, nCID);
 
-		m_DB.ExecuteSQL(strSQL);
+		m_DB->ExecuteSQL(strSQL);
 	}
 	catch (CDBException* e)
 	{
@@ -1199,7 +1325,7 @@ bool MSSQLDatabase::UpdateCharBP(const int nCID, const int nBPInc)
 		CString strSQL;
 		strSQL.Format(g_szDB_UPDATE_CHAR_BP, nBPInc, nCID);
 
-		m_DB.ExecuteSQL(strSQL);
+		m_DB->ExecuteSQL(strSQL);
 	}
 	catch (CDBException* e)
 	{
@@ -1230,7 +1356,7 @@ bool MSSQLDatabase::InsertItemPurchaseLogByBounty(const u32 nItemID, const u32 n
 		CString strSQL;
 		strSQL.Format(g_szDB_INSERT_ITEM_PURCHASE_BY_BOUNTY_LOG, nItemID, nCID, nBounty, nCharBP, szType);
 
-		m_DB.ExecuteSQL(strSQL);
+		m_DB->ExecuteSQL(strSQL);
 	}
 	catch (CDBException* e)
 	{
@@ -1264,7 +1390,7 @@ bool MSSQLDatabase::InsertCharMakingLog(const unsigned int nAID, const char* szC
 		CString strSQL;
 		strSQL.Format(g_szDB_INSERT_CHAR_MAKING_LOG, nAID, temp.c_str(), szType);
 
-		m_DB.ExecuteSQL(strSQL);
+		m_DB->ExecuteSQL(strSQL);
 	}
 	catch (CDBException* e)
 	{
@@ -1288,7 +1414,7 @@ bool MSSQLDatabase::InsertServerLog(const int nServerID, const int nPlayerCount,
 		CString strSQL;
 		strSQL.Format(g_szDB_INSERT_SERVER_LOG, nServerID, nPlayerCount, nGameCount, dwBlockCount, dwNonBlockCount);
 
-		m_DB.ExecuteSQL(strSQL);
+		m_DB->ExecuteSQL(strSQL);
 	}
 	catch (CDBException* e)
 	{
@@ -1310,7 +1436,7 @@ bool MSSQLDatabase::UpdateServerStatus(const int nServerID, const int nCurrPlaye
 		CString strSQL;
 		strSQL.Format(g_szDB_UPDATE_SERVER_STATUS, nCurrPlayer, nServerID);
 
-		m_DB.ExecuteSQL(strSQL);
+		m_DB->ExecuteSQL(strSQL);
 	}
 	catch (CDBException* e)
 	{
@@ -1334,7 +1460,7 @@ bool MSSQLDatabase::UpdateServerInfo(const int nServerID, const int nMaxPlayer,
 		CString strSQL;
 		strSQL.Format(g_szDB_UPDATE_SERVER_INFO, nMaxPlayer, temp.c_str(), nServerID);
 
-		m_DB.ExecuteSQL(strSQL);
+		m_DB->ExecuteSQL(strSQL);
 	}
 	catch (CDBException* e)
 	{
@@ -1357,7 +1483,7 @@ bool MSSQLDatabase::InsertPlayerLog(const u32 nCID,
 		CString strSQL;
 		strSQL.Format(g_szDB_INSERT_PLAYER_LOG, nCID, nPlayTime, nKillCount, nDeathCount, nXP, nTotalXP);
 
-		m_DB.ExecuteSQL(strSQL);
+		m_DB->ExecuteSQL(strSQL);
 	}
 	catch (CDBException* e)
 	{
@@ -1380,7 +1506,7 @@ bool MSSQLDatabase::InsertLevelUpLog(const int nCID, const int nLevel, const int
 		CString strSQL;
 		strSQL.Format(g_szDB_INSERT_LEVELUP_LOG, nCID, nLevel, nBP, nKillCount, nDeathCount, nPlayTime);
 
-		m_DB.ExecuteSQL(strSQL);
+		m_DB->ExecuteSQL(strSQL);
 	}
 	catch (CDBException* e)
 	{
@@ -1403,7 +1529,7 @@ bool MSSQLDatabase::UpdateCharPlayTime(const u32 nCID, const u32 nPlayTime)
 		CString strSQL;
 		strSQL.Format(g_szDB_UPDATE_CHAR_PLAYTIME, nPlayTime, nCID);
 
-		m_DB.ExecuteSQL(strSQL);
+		m_DB->ExecuteSQL(strSQL);
 	}
 	catch (CDBException* e)
 	{
@@ -1427,7 +1553,7 @@ bool MSSQLDatabase::UpdateCharInfoData(const int nCID, const int nAddedXP, const
 		strSQL.Format(g_szDB_UPDATE_CHAR_INFO_DATA, nAddedXP, nAddedBP,
 			nAddedKillCount, nAddedDeathCount, nCID);
 
-		m_DB.ExecuteSQL(strSQL);
+		m_DB->ExecuteSQL(strSQL);
 	}
 	catch (CDBException* e)
 	{
@@ -1451,7 +1577,7 @@ bool MSSQLDatabase::UpdateLastConnDate(const char* szUserID, const char* szIP)
 		CString strSQL;
 		strSQL.Format(g_szDB_UPDATE_LAST_CONNDATE, temp.c_str(), szUserID);
 
-		m_DB.ExecuteSQL(strSQL);
+		m_DB->ExecuteSQL(strSQL);
 	}
 	catch (CDBException* e)
 	{
@@ -1472,7 +1598,7 @@ bool MSSQLDatabase::BringAccountItem(const int nAID, const int nCID, const int n
 
 	CString strSQL;
 	strSQL.Format(g_szDB_BRING_ACCOUNTITEM, nAID, nCID, nAIID);
-	CODBCRecordset rs(&m_DB);
+	CODBCRecordset rs(m_DB);
 
 	try
 	{
@@ -1517,7 +1643,7 @@ bool MSSQLDatabase::BringBackAccountItem(const int nAID, const int nCID, const i
 		CString strSQL;
 		strSQL.Format(g_szDB_BRING_BACK_ACCOUNTITEM, nAID, nCID, nCIID);
 
-		m_DB.ExecuteSQL(strSQL);
+		m_DB->ExecuteSQL(strSQL);
 	}
 	catch (CDBException* e)
 	{
@@ -1539,7 +1665,7 @@ bool MSSQLDatabase::ClearAllEquipedItem(const u32 nCID)
 		CString strSQL;
 		strSQL.Format(g_szDB_CLEARALL_EQUIPEDITEM, nCID);
 
-		m_DB.ExecuteSQL(strSQL);
+		m_DB->ExecuteSQL(strSQL);
 	}
 	catch (CDBException* e)
 	{
@@ -1556,7 +1682,7 @@ bool MSSQLDatabase::GetCharCID(const char* pszName, int* poutCID)
 	_STATUS_DB_START
 
 	if (!CheckOpen()) return false;
-	CODBCRecordset rs(&m_DB);
+	CODBCRecordset rs(m_DB);
 
 	try
 	{
@@ -1588,7 +1714,7 @@ bool MSSQLDatabase::FriendAdd(const int nCID, const int nFriendCID, const int nF
 	_STATUS_DB_START
 
 	if (!CheckOpen()) return false;
-	CODBCRecordset rs(&m_DB);
+	CODBCRecordset rs(m_DB);
 
 	CString strSQL;
 	strSQL.Format(g_szDB_ADD_FRIEND, nCID, nFriendCID, nFavorite);
@@ -1618,7 +1744,7 @@ bool MSSQLDatabase::FriendRemove(const int nCID, const int nFriendCID)
 	{
 		CString strSQL;
 		strSQL.Format(g_szDB_REMOVE_FRIEND, nCID, nFriendCID);
-		m_DB.ExecuteSQL(strSQL);
+		m_DB->ExecuteSQL(strSQL);
 	}
 	catch (CDBException* e)
 	{
@@ -1639,7 +1765,7 @@ bool MSSQLDatabase::FriendGetList(const int nCID, MMatchFriendInfo* pFriendInfo)
 
 	CString strSQL;
 	strSQL.Format(g_szDB_GET_FRIEND_LIST, nCID);
-	CODBCRecordset rs(&m_DB);
+	CODBCRecordset rs(m_DB);
 
 	bool bException = false;
 	try
@@ -1684,7 +1810,7 @@ bool MSSQLDatabase::GetCharClan(const int nCID, int* poutClanID, char* poutClanN
 	CString strSQL;
 	strSQL.Format(g_szDB_GET_CHAR_CLAN, nCID);
 
-	CODBCRecordset rs(&m_DB);
+	CODBCRecordset rs(m_DB);
 
 	bool bException = false;
 	try
@@ -1721,7 +1847,7 @@ bool MSSQLDatabase::GetClanIDFromName(const char* szClanName, int* poutCLID)
 	CString strSQL;
 	strSQL.Format(g_szDB_GET_CLID_FROM_CLANNAME, temp.c_str());
 
-	CODBCRecordset rs(&m_DB);
+	CODBCRecordset rs(m_DB);
 
 	bool bException = false;
 	try
@@ -1761,7 +1887,7 @@ bool MSSQLDatabase::CreateClan(const char* szClanName, const int nMasterCID, con
 	CString strSQL;
 	strSQL.Format(g_szDB_CREATE_CLAN, temp.c_str(), nMasterCID, nMember1CID, nMember2CID, nMember3CID, nMember4CID);
 
-	CODBCRecordset rs(&m_DB);
+	CODBCRecordset rs(m_DB);
 
 
 	bool bException = false;
@@ -1801,7 +1927,7 @@ bool MSSQLDatabase::CreateClan(const char* szClanName, const int nMasterCID, boo
 	CString strSQL;
 	strSQL.Format(g_szDB_CREATE_CLAN2, temp.c_str(), nMasterCID);
 
-	CODBCRecordset rs(&m_DB);
+	CODBCRecordset rs(m_DB);
 
 
 	bool bException = false;
@@ -1843,7 +1969,7 @@ bool MSSQLDatabase::ReserveCloseClan(const int nCLID, const char* szClanName, co
 
 		CString strSQL;
 		strSQL.Format(g_szDB_RESERVE_CLOSE_CLAN, nCLID, temp1.c_str(), nMasterCID, temp2.c_str());
-		m_DB.ExecuteSQL(strSQL);
+		m_DB->ExecuteSQL(strSQL);
 	}
 	catch (CDBException* e)
 	{
@@ -1866,7 +1992,7 @@ bool MSSQLDatabase::CloseClan(int nCLID, const char* szClanName, int nMasterCID)
 
 		CString strSQL;
 		strSQL.Format(g_szDB_DELETE_CLAN, nCLID, temp1.c_str());
-		m_DB.ExecuteSQL(strSQL);
+		m_DB->ExecuteSQL(strSQL);
 	}
 	catch (CDBException* e)
 	{
@@ -1887,7 +2013,7 @@ bool MSSQLDatabase::AddClanMember(const int nCLID, const int nJoinerCID, const i
 	CString strSQL;
 	strSQL.Format(g_szDB_ADD_CLAN_MEMBER, nCLID, nJoinerCID, nClanGrade);
 
-	CODBCRecordset rs(&m_DB);
+	CODBCRecordset rs(m_DB);
 
 
 	bool bException = false;
@@ -1927,7 +2053,7 @@ bool MSSQLDatabase::RemoveClanMember(const int nCLID, const int nLeaverCID)
 	{
 		CString strSQL;
 		strSQL.Format(g_szDB_REMOVE_CLAN_MEMBER, nCLID, nLeaverCID);
-		m_DB.ExecuteSQL(strSQL);
+		m_DB->ExecuteSQL(strSQL);
 	}
 	catch (CDBException* e)
 	{
@@ -1951,7 +2077,7 @@ bool MSSQLDatabase::UpdateClanGrade(const int nCLID, const int nMemberCID, const
 	{
 		CString strSQL;
 		strSQL.Format(g_szDB_UPDATE_CLAN_GRADE, nCLID, nMemberCID, nClanGrade);
-		m_DB.ExecuteSQL(strSQL);
+		m_DB->ExecuteSQL(strSQL);
 	}
 	catch (CDBException* e)
 	{
@@ -1974,7 +2100,7 @@ ExpelResult MSSQLDatabase::ExpelClanMember(const int nCLID, const int nAdminGrad
 	CString strSQL;
 	strSQL.Format(g_szDB_EXPEL_CLAN_MEMBER, nCLID, nAdminGrade, temp.c_str());
 
-	CODBCRecordset rs(&m_DB);
+	CODBCRecordset rs(m_DB);
 
 	bool bException = false;
 	try
@@ -2050,7 +2176,7 @@ bool MSSQLDatabase::GetLadderTeamID(const int nTeamTableIndex, const int* pnMemb
 		return false;
 	}
 
-	CODBCRecordset rs(&m_DB);
+	CODBCRecordset rs(m_DB);
 
 
 	try
@@ -2102,7 +2228,7 @@ bool MSSQLDatabase::LadderTeamWinTheGame(const int nTeamTableIndex, const int nW
 		CString strSQL;
 
 		strSQL.Format(g_szDB_TEAM4_WIN_THE_GAME, nWinnerTID, nLoserTID, nDrawGame, nWinnerPoint, nLoserPoint, nDrawPoint);
-		m_DB.ExecuteSQL(strSQL);
+		m_DB->ExecuteSQL(strSQL);
 	}
 	catch (CDBException* e)
 	{
@@ -2119,7 +2245,7 @@ bool MSSQLDatabase::GetLadderTeamMemberByCID(const int nCID, int* poutTeamID, ch
 	_STATUS_DB_START
 		if (!CheckOpen()) return false;
 
-	CODBCRecordset rs(&m_DB);
+	CODBCRecordset rs(m_DB);
 
 	try
 	{
@@ -2164,6 +2290,7 @@ bool MSSQLDatabase::GetLadderTeamMemberByCID(const int nCID, int* poutTeamID, ch
 bool MSSQLDatabase::UpdateCharLevel(const int nCID, const int nNewLevel, const int nBP, const int nKillCount,
 	const int nDeathCount, const int nPlayTime, bool bIsLevelUp)
 {
+	DB_PROFILE_METHOD();
 	bool ret = UpdateCharLevel(nCID, nNewLevel);
 
 	if ((ret == true) && (bIsLevelUp) && (nNewLevel >= 10))		// 10̻  ø α׸ .
@@ -2181,7 +2308,7 @@ bool MSSQLDatabase::GetClanInfo(const int nCLID, MDB_ClanInfo* poutClanInfo)
 	_STATUS_DB_START
 
 		if (!CheckOpen()) return false;
-	CODBCRecordset rs(&m_DB);
+	CODBCRecordset rs(m_DB);
 
 	try
 	{
@@ -2247,7 +2374,7 @@ bool MSSQLDatabase::WinTheClanGame(const int nWinnerCLID, const int nLoserCLID,
 			temp[0].c_str(), temp[1].c_str(), nRoundWins, nRoundLosses, nMapID, nGameType,
 			temp[2].c_str(), temp[3].c_str());
 
-		m_DB.ExecuteSQL(strSQL);
+		m_DB->ExecuteSQL(strSQL);
 	}
 	catch (CDBException* e)
 	{
@@ -2269,7 +2396,7 @@ bool MSSQLDatabase::UpdateCharClanContPoint(const int nCID, const int nCLID, con
 		CString strSQL;
 
 		strSQL.Format(g_szDB_UPDATE_CHAR_CLAN_CONTPOINT, nCID, nCLID, nAddedContPoint);
-		m_DB.ExecuteSQL(strSQL);
+		m_DB->ExecuteSQL(strSQL);
 	}
 	catch (CDBException* e)
 	{
@@ -2292,7 +2419,7 @@ bool MSSQLDatabase::EventJjangUpdate(const int nAID, bool bJjang)
 
 		MMatchUserGradeID nGrade = bJjang ? MMUG_STAR : MMUG_FREE;
 		strSQL.Format(g_szDB_EVENT_JJANG_UPDATE, nGrade, nAID);
-		m_DB.ExecuteSQL(strSQL);
+		m_DB->ExecuteSQL(strSQL);
 	}
 	catch (CDBException* e)
 	{
@@ -2315,7 +2442,7 @@ bool MSSQLDatabase::DeleteExpiredAccountItem(const int nAIID)
 		CString strSQL;
 
 		strSQL.Format(g_szDB_DELETE_EXPIRED_ACCOUNT_ITEM, nAIID);
-		m_DB.ExecuteSQL(strSQL);
+		m_DB->ExecuteSQL(strSQL);
 	}
 	catch (CDBException* e)
 	{
@@ -2400,7 +2527,7 @@ bool MSSQLDatabase::UpdateQuestItem(int nCID, MQuestItemMap& rfQuestIteMap, MQue
 		CString strQuery;
 		strQuery.Format("UPDATE Character SET QuestItemInfo = (?) WHERE CID = %d", nCID);
 
-		CODBCRecordset rs(&m_DB);
+		CODBCRecordset rs(m_DB);
 		if (!rs.InsertBinary(strQuery, szData, MCRC32::CRC::SIZE + MAX_DB_QUEST_ITEM_SIZE + MAX_DB_MONSTERBIBLE_SIZE))
 		{
 			Log("MSSQLDatabase::UpdateQuestItem - Querry fail.");
@@ -2429,7 +2556,7 @@ bool MSSQLDatabase::GetCharQuestItemInfo(MMatchCharInfo* pCharInfo)
 		if (0 == pCharInfo)
 			return false;
 
-		CODBCRecordset rs(&m_DB);
+		CODBCRecordset rs(m_DB);
 
 		CString strQuery;
 		strQuery.Format(g_szDB_SELECT_QUEST_ITEM_INFO_BY_CID, pCharInfo->m_nCID);
@@ -2535,7 +2662,7 @@ bool MSSQLDatabase::InsertQuestGameLog(const char* pszStageName,
 			return false;
 
 	CString strQuery;
-	CODBCRecordset rs(&m_DB);
+	CODBCRecordset rs(m_DB);
 
 	try
 	{
@@ -2576,7 +2703,7 @@ bool MSSQLDatabase::InsertQUniqueGameLog(const int nQGLID, const int nCID, const
 	try
 	{
 		strQuery.Format(g_szDB_INSERT_QUINQUEITEMLOG, nQGLID, nCID, nQIID);
-		m_DB.ExecuteSQL(strQuery);
+		m_DB->ExecuteSQL(strQuery);
 	}
 	catch (CDBException* e)
 	{
@@ -2591,14 +2718,19 @@ bool MSSQLDatabase::InsertQUniqueGameLog(const int nQGLID, const int nCID, const
 
 bool MSSQLDatabase::GetCID(const char* pszCharName, int& outCID)
 {
+	DB_PROFILE_METHOD();
 	if (0 == pszCharName)
 		return false;
 
+	ConnectionScope Connection{*this};
+	if (!CheckOpen())
+		return false;
+
 	CString strQuery;
 	strQuery.Format("SELECT CID FROM Character (UPDLOCK) WHERE Name LIKE '%s'",
 		pszCharName);
 
-	CODBCRecordset rs(&m_DB);
+	CODBCRecordset rs(m_DB);
 	try
 	{
 		rs.Open(strQuery, CRecordset::forwardOnly, CRecordset::readOnly);
@@ -2617,13 +2749,15 @@ bool MSSQLDatabase::GetCID(const char* pszCharName, int& outCID)
 
 bool MSSQLDatabase::GetCharName(const int nCID, string& outCharName)
 {
+	DB_PROFILE_METHOD();
+	ConnectionScope Connection{*this};
 	if (!CheckOpen())
 		return false;
 
 	CString strQuery;
 	strQuery.Format("SELECT Name FROM Character (NOLOCK) WHERE CID = %u", nCID);
 
-	CODBCRecordset rs(&m_DB);
+	CODBCRecordset rs(m_DB);
 	try
 	{
 		rs.Open(strQuery, CRecordset::forwardOnly, CRecordset::readOnly);
@@ -2650,7 +2784,7 @@ bool MSSQLDatabase::CheckPremiumIP(const char* szIP, bool& outbResult)
 	CString strSQL;
 	strSQL.Format(g_szDB_CHECK_PREMIUM_IP, temp.c_str());
 
-	CODBCRecordset rs(&m_DB);
+	CODBCRecordset rs(m_DB);
 
 	bool bException = false;
 	try
@@ -2696,7 +2830,7 @@ bool MSSQLDatabase::InsertEvent(const uint32_t dwAID, const uint32_t dwCID, cons
 	strSQL.Format(g_szInsertEvent, dwAID, dwCID, temp.c_str());
 	try
 	{
-		m_DB.ExecuteSQL(strSQL);
+		m_DB->ExecuteSQL(strSQL);
 	}
 	catch (CDBException* e)
 	{
@@ -2721,7 +2855,7 @@ bool MSSQLDatabase::SetBlockAccount(const uint32_t dwAID, const uint32_t dwCID,
 	strSQL.Format(g_szSetBlockAccount, dwAID, dwCID, btBlockType, strComment.c_str(), strIP.c_str(), strEndHackBlockerDate.c_str());
 	try
 	{
-		m_DB.ExecuteSQL(strSQL);
+		m_DB->ExecuteSQL(strSQL);
 	}
 	catch (CDBException* e)
 	{
@@ -2746,7 +2880,7 @@ bool MSSQLDatabase::ResetAccountBlock(const uint32_t dwAID, const uint8_t btBloc
 	strSQL.Format(g_szResetAccountBlock, dwAID, btBlockType);
 	try
 	{
-		m_DB.ExecuteSQL(strSQL);
+		m_DB->ExecuteSQL(strSQL);
 	}
 	catch (CDBException* e)
 	{
@@ -2772,7 +2906,7 @@ bool MSSQLDatabase::InsertBlockLog(const uint32_t dwAID, const uint32_t dwCID, c
 	strSQL.Format(g_szInsertBlockLog, dwAID, dwCID, btBlockType, strComment.c_str(), strIP.c_str());
 	try
 	{
-		m_DB.ExecuteSQL(strSQL);
+		m_DB->ExecuteSQL(strSQL);
 	}
 	catch (CDBException* e)
 	{
@@ -2797,7 +2931,7 @@ bool MSSQLDatabase::DeleteExpiredClan(const uint32_t dwCID, const uint32_t dwCLI
 	strSQL.Format(g_szDeleteExpiredClan, dwCLID, dwCID, strDeleteName.c_str(), dwWaitHour);
 	try
 	{
-		m_DB.ExecuteSQL(strSQL);
+		m_DB->ExecuteSQL(strSQL);
 	}
 	catch (CDBException* e)
 	{
@@ -2824,7 +2958,7 @@ bool MSSQLDatabase::SetDeleteTime(const uint32_t dwMasterCID, const uint32_t dwC
 	strSQL.Format(g_szSetClanDeleteDate, dwMasterCID, dwCLID, strDeleteDate.c_str());
 	try
 	{
-		m_DB.ExecuteSQL(strSQL);
+		m_DB->ExecuteSQL(strSQL);
 	}
 	catch (CDBException* e)
 	{
@@ -2846,7 +2980,7 @@ bool MSSQLDatabase::AdminResetAllHackingBlock()
 
 	try
 	{
-		m_DB.ExecuteSQL(g_szAdminResetAllHackingBlock);
+		m_DB->ExecuteSQL(g_szAdminResetAllHackingBlock);
 	}
 	catch (CDBException* e)
 	{
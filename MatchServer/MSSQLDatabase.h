@@ -2,20 +2,26 @@
 
 #include "IDatabase.h"
 #include "MDatabase.h"
+#include "MDatabasePool.h"
 #include <memory>
 
 class MSSQLDatabase final : public IDatabase
 {
 public:
+	// Uses the pool shared by every instance made from the server config.
 	MSSQLDatabase();
+	// Uses a private pool with a single connection.
 	MSSQLDatabase(const MDatabase::ConnectionDetails&);
+	MSSQLDatabase(std::shared_ptr<MDatabasePool> Pool);
 	MSSQLDatabase(const MSSQLDatabase&) = delete;
 	MSSQLDatabase& operator=(const MSSQLDatabase&) = delete;
 	~MSSQLDatabase();
 
 	bool DeleteAllRows();
 
-	virtual bool IsOpen() override { return CheckOpen(); }
+	MDatabasePool& GetPool() { return *Pool; }
+
+	virtual bool IsOpen() override;
 
 	virtual bool GetLoginInfo(const char* szUserID, unsigned int* poutnAID,
 		char* poutPassword, size_t maxlen) override;
@@ -101,11 +107,13 @@ public:
 	virtual bool InsertQUniqueGameLog(int nQGLID, int nCID, int nQIID) override;
 
 
+	virtual void SetLogTime(u64 UnixTime) override { LogTime = UnixTime; }
 	virtual bool InsertConnLog(int nAID, const char* szIP, const std::string& strCountryCode3) override;
 	virtual bool InsertGameLog(const char* szGameName, const char* szMap, const char* GameType,
 		int nRound, unsigned int nMasterCID,
 		int nPlayerCount, const char* szPlayers) override;
 	virtual bool InsertKillLog(unsigned int nAttackerCID, unsigned int nVictimCID) override;
+	virtual bool InsertKillLogs(ArrayView<const KillLogRow> Rows) override;
 	virtual bool InsertChatLog(u32 nCID, const char* szMsg, u64 nTime) override;
 	virtual bool InsertServerLog(int nServerID, int nPlayerCount, int nGameCount,
 		uint32_t dwBlockCount, uint32_t dwNonBlockCount) override;
@@ -204,8 +212,33 @@ public:
 private:
 	void Log(const char *pFormat, ...);
 	static void LogCallback(const std::string& strLog);
+	friend std::shared_ptr<MDatabasePool> GetMSSQLPool();
 
 	bool CheckOpen();
 
-	MDatabase m_DB;
-};
\ No newline at end of file
+	// Holds a connection from the pool for the duration of a method call, and points m_DB at
+	// it. Methods that call other methods keep using the outer call's connection.
+	class ConnectionScope
+	{
+	public:
+		ConnectionScope(MSSQLDatabase& DB);
+		~ConnectionScope();
+		ConnectionScope(const ConnectionScope&) = delete;
+		ConnectionScope& operator=(const ConnectionScope&) = delete;
+
+	private:
+		MSSQLDatabase& DB;
+		bool Owner;
+	};
+
+	std::shared_ptr<MDatabasePool> Pool;
+	MDatabasePool::Lease Lease;
+	// Null outside of a method call, or if no connection could be opened.
+	MDatabase* m_DB = nullptr;
+	// Only used for kill logs, which are inserted directly. The other log procedures date their
+	// rows themselves.
+	u64 LogTime = 0;
+};
+
+// The pool used by MSSQLDatabase instances created from the server config.
+std::shared_ptr<MDatabasePool> GetMSSQLPool();
\ No newline at end of file
@@ -0,0 +1,145 @@
+#include "stdafx.h"
+#include "MStartupTasks.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include "SafeString.h"
+
+MStartupTasks::TaskID MStartupTasks::Add(std::string Name, std::function<bool()> Fn,
+	std::initializer_list<TaskID> Deps)
+{
+	const auto ID = TaskID(Tasks.size());
+	Tasks.emplace_back();
+	auto& NewTask = Tasks.back();
+	NewTask.Name = std::move(Name);
+	NewTask.Fn = std::move(Fn);
+	for (auto Dep : Deps)
+	{
+		assert(Dep >= 0 && Dep < ID);
+		Tasks[Dep].Dependents.push_back(ID);
+		++NewTask.UnfinishedDeps;
+	}
+	return ID;
+}
+
+void MStartupTasks::Skip(TaskID ID, size_t& Remaining)
+{
+	auto& SkippedTask = Tasks[ID];
+	if (SkippedTask.State != TaskState::Pending)
+		return;
+
+	SkippedTask.State = TaskState::Skipped;
+	--Remaining;
+	for (auto Dependent : SkippedTask.Dependents)
+		Skip(Dependent, Remaining);
+}
+
+bool MStartupTasks::Run(int ThreadCountArg)
+{
+	using Clock = std::chrono::steady_clock;
+
+	ThreadCount = ThreadCountArg > 0 ? ThreadCountArg :
+		(std::max)(1, int(std::thread::hardware_concurrency()));
+
+	std::mutex Mutex;
+	std::condition_variable ReadyCV;
+	std::deque<TaskID> Ready;
+	size_t Remaining = Tasks.size();
+	for (TaskID ID = 0; ID < TaskID(Tasks.size()); ++ID)
+		if (Tasks[ID].UnfinishedDeps == 0)
+			Ready.push_back(ID);
+
+	const auto Start = Clock::now();
+	auto ToMS = [&](Clock::time_point Time) {
+		return std::chrono::duration<double, std::milli>(Time - Start).count();
+	};
+
+	auto Worker = [&](int Thread) {
+		std::unique_lock<std::mutex> Lock{Mutex};
+		while (true)
+		{
+			ReadyCV.wait(Lock, [&] { return !Ready.empty() || Remaining == 0; });
+			if (Ready.empty())
+				return;
+
+			const auto ID = Ready.front();
+			Ready.pop_front();
+			auto& RunningTask = Tasks[ID];
+
+			Lock.unlock();
+			const auto TaskStart = Clock::now();
+			const auto Succeeded = RunningTask.Fn();
+			const auto TaskEnd = Clock::now();
+			Lock.lock();
+
+			RunningTask.StartMS = ToMS(TaskStart);
+			RunningTask.DurationMS = ToMS(TaskEnd) - RunningTask.StartMS;
+			RunningTask.Thread = Thread;
+			RunningTask.State = Succeeded ? TaskState::Succeeded : TaskState::Failed;
+			--Remaining;
+
+			for (auto Dependent : RunningTask.Dependents)
+			{
+				if (!Succeeded)
+					Skip(Dependent, Remaining);
+				else if (--Tasks[Dependent].UnfinishedDeps == 0 &&
+					Tasks[Dependent].State == TaskState::Pending)
+					Ready.push_back(Dependent);
+			}
+
+			ReadyCV.notify_all();
+		}
+	};
+
+	std::vector<std::thread> Threads;
+	const auto ExtraThreads = (std::min)(ThreadCount, int(Tasks.size())) - 1;
+	for (int i = 0; i < ExtraThreads; ++i)
+		Threads.emplace_back(Worker, i + 1);
+	Worker(0);
+	for (auto&& Thread : Threads)
+		Thread.join();
+
+	ElapsedMS = ToMS(Clock::now());
+
+	return std::all_of(Tasks.begin(), Tasks.end(), [&](const Task& t) {
+		return t.State == TaskState::Succeeded; });
+}
+
+void MStartupTasks::Report(const std::function<void(const char*)>& Log) const
+{
+	std::vector<const Task*> Sorted;
+	for (auto&& t : Tasks)
+		Sorted.push_back(&t);
+	std::stable_sort(Sorted.begin(), Sorted.end(), [&](const Task* a, const Task* b) {
+		// Tasks that never ran go last.
+		if ((a->Thread == -1) != (b->Thread == -1))
+			return b->Thread == -1;
+		return a->StartMS < b->StartMS;
+	});
+
+	double WorkMS = 0;
+	char Line[256];
+	for (auto* t : Sorted)
+	{
+		WorkMS += t->DurationMS;
+		if (t->State == TaskState::Skipped)
+		{
+			sprintf_safe(Line, "Startup: %-28s skipped", t->Name.c_str());
+		}
+		else
+		{
+			sprintf_safe(Line, "Startup: %-28s %9.1f ms, started at %9.1f ms on thread %d%s",
+				t->Name.c_str(), t->DurationMS, t->StartMS, t->Thread,
+				t->State == TaskState::Failed ? ", FAILED" : "");
+		}
+		Log(Line);
+	}
+
+	sprintf_safe(Line, "Startup: %d tasks took %.1f ms on %d threads, %.1f ms of work",
+		int(Tasks.size()), ElapsedMS, ThreadCount, WorkMS);
+	Log(Line);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <functional>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+// Runs the loading steps of a server's startup on a pool of threads.
+// Each task starts once all the tasks it depends on have succeeded, and is skipped if any of them
+// failed, so independent assets are parsed in parallel while e.g. the shop still waits for the
+// items it sells.
+class MStartupTasks
+{
+public:
+	using TaskID = int;
+
+	enum class TaskState
+	{
+		Pending,
+		Succeeded,
+		Failed,
+		Skipped,
+	};
+
+	struct Task
+	{
+		std::string Name;
+		std::function<bool()> Fn;
+		std::vector<TaskID> Dependents;
+		int UnfinishedDeps = 0;
+		TaskState State = TaskState::Pending;
+		// Relative to the start of Run.
+		double StartMS = 0;
+		double DurationMS = 0;
+		int Thread = -1;
+	};
+
+	// Deps must have been added before the task that depends on them.
+	TaskID Add(std::string Name, std::function<bool()> Fn, std::initializer_list<TaskID> Deps = {});
+
+	// Runs every task on ThreadCount threads, counting the calling one, and returns once all of
+	// them are done or skipped. Returns true if all of them succeeded.
+	// A ThreadCount of 0 or less uses one thread per core.
+	bool Run(int ThreadCount);
+
+	const std::vector<Task>& GetTasks() const { return Tasks; }
+	double GetElapsedMS() const { return ElapsedMS; }
+	int GetThreadCount() const { return ThreadCount; }
+
+	// Calls Log with a line per task, in the order they were started, and then a summary.
+	void Report(const std::function<void(const char*)>& Log) const;
+
+private:
+	void Skip(TaskID ID, size_t& Remaining);
+
+	std::vector<Task> Tasks;
+	double ElapsedMS = 0;
+	int ThreadCount = 0;
+};
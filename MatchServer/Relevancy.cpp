@@ -0,0 +1,49 @@
+#include "stdafx.h"
+#include "Relevancy.h"
+#include "RBspObject.h"
+#include <algorithm>
+
+float GetRelevancy(const RelevancyParams& Params, const v3& ViewerPos, const v3& SubjectPos,
+	bool Visible)
+{
+	auto Distance = RealSpace2::Magnitude(SubjectPos - ViewerPos);
+	if (Distance <= Params.NearDistance)
+		return 1;
+
+	auto Range = (std::max)(Params.FarDistance - Params.NearDistance, 1.f);
+	auto t = (std::min)((Distance - Params.NearDistance) / Range, 1.f);
+	auto Priority = 1 - t * (1 - Params.MinPriority);
+
+	if (!Visible)
+		Priority *= Params.OccludedScale;
+
+	return (std::max)(Priority, Params.MinPriority);
+}
+
+bool IsVisibleFrom(RealSpace2::RBspObject* Bsp, const v3& ViewerPos, const v3& SubjectPos)
+{
+	if (!Bsp)
+		return true;
+
+	// Roughly the eye height of a standing character.
+	const v3 EyeOffset{0, 0, 160};
+	const u32 PassFlag = RM_FLAG_ADDITIVE | RM_FLAG_HIDE | RM_FLAG_PASSROCKET | RM_FLAG_PASSBULLET;
+	RealSpace2::RBSPPICKINFO PickInfo;
+	return !Bsp->PickTo(ViewerPos + EyeOffset, SubjectPos + EyeOffset, &PickInfo, PassFlag);
+}
+
+bool RelevancyAccumulator::Update(const MUID& Subject, float Priority)
+{
+	auto& Entry = Entries[Subject];
+	if (!Entry.Sent)
+	{
+		Entry.Sent = true;
+		return true;
+	}
+
+	Entry.Accumulated += Priority;
+	if (Entry.Accumulated < 1)
+		return false;
+	Entry.Accumulated -= 1;
+	return true;
+}
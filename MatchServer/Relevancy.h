@@ -0,0 +1,72 @@
+#pragma once
+
+#include <unordered_map>
+#include "GlobalTypes.h"
+#include "MUID.h"
+#include "RTypes.h"
+
+namespace RealSpace2 { class RBspObject; }
+
+// Controls how often a player gets the basic info of the other players in a server-based battle,
+// depending on how much it matters to them.
+struct RelevancyParams
+{
+	bool Enabled = true;
+	// Players closer than this are always sent at the full rate.
+	float NearDistance = 1500;
+	// Players further than this are sent at MinPriority.
+	float FarDistance = 6000;
+	float MinPriority = 0.25f;
+	// Checks line of sight against the map, and sends players that can't be seen at a lower rate.
+	bool CheckVisibility = true;
+	float OccludedScale = 0.5f;
+};
+
+// Returns the fraction of a player's basic info updates that a viewer should get, from
+// Params.MinPriority to 1. Visible is ignored within Params.NearDistance.
+float GetRelevancy(const RelevancyParams& Params, const v3& ViewerPos, const v3& SubjectPos,
+	bool Visible);
+
+// Returns whether the head of a player at SubjectPos can be seen from the head of one at ViewerPos.
+// Always true if Bsp is null.
+bool IsVisibleFrom(RealSpace2::RBspObject* Bsp, const v3& ViewerPos, const v3& SubjectPos);
+
+// Spreads a viewer's updates of each other player according to their relevancy, so that a
+// player with a relevancy of 0.25 gets every fourth one.
+class RelevancyAccumulator
+{
+public:
+	// Visibility is only rechecked this often, in milliseconds, since it's the expensive part.
+	static constexpr u64 VisibilityInterval = 100;
+
+	// Returns whether this update of Subject should be sent. The first one always is.
+	bool Update(const MUID& Subject, float Priority);
+
+	// Returns whether Subject was visible the last time it was checked, calling Check to check
+	// again if that was more than VisibilityInterval ago.
+	template <typename CheckType>
+	bool IsVisible(const MUID& Subject, u64 Time, CheckType&& Check)
+	{
+		auto& Entry = Entries[Subject];
+		if (!Entry.VisibilityChecked || Time - Entry.VisibilityTime >= VisibilityInterval)
+		{
+			Entry.Visible = Check();
+			Entry.VisibilityChecked = true;
+			Entry.VisibilityTime = Time;
+		}
+		return Entry.Visible;
+	}
+
+	void Clear() { Entries.clear(); }
+
+private:
+	struct Entry
+	{
+		float Accumulated = 0;
+		bool Sent = false;
+		bool Visible = true;
+		bool VisibilityChecked = false;
+		u64 VisibilityTime = 0;
+	};
+	std::unordered_map<MUID, Entry> Entries;
+};
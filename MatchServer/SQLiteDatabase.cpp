@@ -1,12 +1,16 @@
 #include "stdafx.h"
 #include "SQLiteDatabase.h"
 #include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <vector>
 #include "MDebug.h"
 #include "MMatchObject.h"
 #include "MErrorTable.h"
 #include "MMatchTransDataType.h"
 #include <cstdarg>
 #include "MCRC32.h"
+#include "DBProfiler.h"
 
 
 //
@@ -172,7 +176,9 @@ public:
 private:
 	void Move(SQLiteStatement&& src)
 	{
-		Reset();
+		// Both sides can refer to the same prepared statement, which must not be reset then.
+		if (stmt != src.stmt)
+			Reset();
 		stmt = src.stmt;
 		col = src.col;
 		bHasRow = src.bHasRow;
@@ -205,6 +211,12 @@ StringView SQLiteStatement::Get<StringView>(int Column)
 	};
 }
 
+template <>
+i64 SQLiteStatement::Get<i64>(int Column)
+{
+	return sqlite3_column_int64(stmt, Column);
+}
+
 template <>
 Blob SQLiteStatement::Get<Blob>(int Column)
 {
@@ -224,31 +236,361 @@ int SQLiteStatement::Step()
 	return ret;
 }
 
-template <size_t size>
-SQLiteDatabase::SQLiteStatementPtr SQLiteDatabase::PrepareStatement(const char(&sql)[size])
-{
-	SQLiteDatabase::SQLiteStatementPtr stmt;
-	const char* tail = nullptr;
+//
+// Statement registry
+//
+
+// Every statement the database uses. They are all prepared once when the connection is opened,
+// and are executed through ExecuteSQL by their ID.
+enum class SQLiteStatementID
+{
+	BeginTransaction,
+	RollbackTransaction,
+	CommitTransaction,
+
+	// Account
+	GetLoginInfo,
+	GetAIDByUserID,
+	InsertAccount,
+	InsertLogin,
+	UpdateLastConnDate,
+	GetAccountInfo,
+	UpdateUGradeID,
+	InsertBlock,
+
+	// Character
+	CountCharsWithName,
+	InsertCharacter,
+	GetCharForDeletion,
+	MarkCharDeleted,
+	InsertCharMakingLog,
+	GetAccountCharList,
+	GetAccountCharInfo,
+	GetCharInfoByAID,
+	GetCIDByName,
+	GetCharName,
+	SimpleUpdateCharInfo,
+	UpdateCharLevel,
+	AddCharBP,
+	SubtractCharBP,
+	GetCharBP,
+	UpdateCharInfoData,
+	UpdateCharPlayTime,
+
+	// Items
+	InsertCharItem,
+	InsertInitialCharItem,
+	DeleteCharItem,
+	GetCharItems,
+	GetInventory,
+	UpdateInventory,
+	GetEquippedItems,
+	UpdateEquippedItems,
+	ClearEquippedItems,
+	GetAccountItems,
+	GetAccountItem,
+	DeleteAccountItem,
+	DeleteExpiredAccountItem,
+	InsertAccountItem,
+	InsertCharItemFromAccountItem,
+	GetCharItemForAccountItem,
+
+	// Quest
+	UpdateQuestItemInfo,
+	GetQuestItemInfo,
+
+	// Friends
+	FriendAdd,
+	FriendRemove,
+	FriendGetList,
+
+	// Clan
+	GetCharClan,
+	GetCLIDByName,
+	CountClanMemberships,
+	CountClanMembershipsOf5,
+	InsertClan,
+	InsertClanMember,
+	ReserveCloseClan,
+	DeleteAllClanMembers,
+	CloseClan,
+	RemoveClanMember,
+	UpdateClanGrade,
+	GetClanMemberByName,
+	GetClanInfo,
+	UpdateCharClanContPoint,
+	AddClanWin,
+	AddClanLoss,
+	InsertClanGameLog,
+
+	Max,
+};
+
+using StatementID = SQLiteStatementID;
+
+static const struct
+{
+	StatementID ID;
+	const char* SQL;
+} StatementTable[] = {
+	{StatementID::BeginTransaction, "BEGIN TRANSACTION"},
+	{StatementID::RollbackTransaction, "ROLLBACK TRANSACTION"},
+	{StatementID::CommitTransaction, "COMMIT TRANSACTION"},
+
+	{StatementID::GetLoginInfo,
+		"SELECT AID, PasswordData FROM Login WHERE UserID = ?"},
+	{StatementID::GetAIDByUserID,
+		"SELECT AID FROM Account WHERE UserID = ?"},
+	{StatementID::InsertAccount,
+		"INSERT INTO Account (UserID, UGradeID, PGradeID, RegDate, Email) "
+		"VALUES (?, 0, 0, date('now'), ?)"},
+	{StatementID::InsertLogin,
+		"INSERT INTO Login(UserID, AID, PasswordData) VALUES(?, ?, ?)"},
+	{StatementID::UpdateLastConnDate,
+		"UPDATE Login SET LastConnDate = date('now'), "
+		"LastIP = ? WHERE UserID = ?"},
+	{StatementID::GetAccountInfo,
+		"SELECT UserID, UGradeID "
+		"FROM Account WHERE AID = ?"},
+	{StatementID::UpdateUGradeID,
+		"UPDATE Account SET UGradeID = ? WHERE AID = ?"},
+	{StatementID::InsertBlock,
+		"INSERT INTO Blocks (AID, Type, Reason, EndDate) VALUES (?, ?, ?, ?)"},
+
+	{StatementID::CountCharsWithName,
+		"SELECT COUNT(*) AS NUM FROM Character WHERE Name = ?"},
+	{StatementID::InsertCharacter,
+		"INSERT INTO Character (AID, Name, CharNum, Level, Sex, Hair, Face, XP, BP, "
+		"GameCount, KillCount, DeathCount, RegDate, PlayTime, DeleteFlag) "
+		"Values(?, ?, ?, 1, ?, ?, ?, 0, 0, "
+		"0, 0, 0, date('now'), 0, 0)"},
+	{StatementID::GetCharForDeletion,
+		"SELECT c.CID, "
+		"(SELECT COUNT(*) FROM CharacterItem ci WHERE ci.CID = c.CID AND ci.ItemID >= 500000) "
+		"AS CashItemCount "
+		"FROM Character c "
+		"WHERE c.AID = ? AND c.CharNum = ?"},
+	{StatementID::MarkCharDeleted,
+		"UPDATE Character SET CharNum = -1, DeleteFlag = 1, Name = '', DeleteName = ? "
+		"WHERE AID = ? AND CharNum = ?"},
+	{StatementID::InsertCharMakingLog,
+		"INSERT INTO CharacterMakingLog(AID, CharName, Type, Date) "
+		"VALUES(?, ?, ?, date('now'))"},
+	{StatementID::GetAccountCharList,
+		"SELECT Name, CharNum, Level "
+		"FROM Character "
+		"WHERE AID = ? AND DeleteFlag = 0"},
+	{StatementID::GetAccountCharInfo,
+		"SELECT c.Name, c.CharNum, c.Level, c.Sex, c.Hair, c.Face, c.XP, c.BP, "
+		"cl.Name AS ClanName, c.Items "
+		"FROM Character c "
+		"LEFT JOIN ClanMember cm ON cm.CID = c.CID "
+		"LEFT JOIN Clan cl ON cl.CLID = cm.CLID "
+		"WHERE c.AID = ? AND c.CharNum = ?"},
+	{StatementID::GetCharInfoByAID,
+		"SELECT c.CID, c.Name, c.Level, c.Sex, c.CharNum, c.Hair, c.Face, "
+		"c.XP, c.BP, c.GameCount, c.KillCount, c.DeathCount, c.PlayTime, c.Items, "
+		"cl.CLID, cl.Name, cm.Grade, cm.ContPoint "
+		"FROM Character c "
+		"LEFT JOIN ClanMember cm ON cm.CID = c.CID "
+		"LEFT JOIN Clan cl ON cl.CLID = cm.CLID "
+		"WHERE c.AID = ? AND c.CharNum = ?"},
+	{StatementID::GetCIDByName,
+		"SELECT CID "
+		"FROM Character "
+		"WHERE Name = ?"},
+	{StatementID::GetCharName,
+		"SELECT Name FROM Character WHERE CID = ?"},
+	{StatementID::SimpleUpdateCharInfo,
+		"UPDATE Character "
+		"SET Level = ?, XP = ?, BP = ? "
+		"WHERE CID = ?"},
+	{StatementID::UpdateCharLevel,
+		"UPDATE Character SET Level = ? WHERE CID = ?"},
+	{StatementID::AddCharBP,
+		"UPDATE Character "
+		"SET BP = BP + ? "
+		"WHERE CID = ?"},
+	{StatementID::SubtractCharBP,
+		"UPDATE Character SET BP = BP - ? WHERE CID = ?"},
+	{StatementID::GetCharBP,
+		"SELECT BP FROM Character WHERE CID = ?"},
+	{StatementID::UpdateCharInfoData,
+		"UPDATE Character "
+		"SET XP = XP + ?, BP = BP + ?, KillCount = KillCount + ?, DeathCount = DeathCount + ? "
+		"WHERE CID = ?"},
+	{StatementID::UpdateCharPlayTime,
+		"UPDATE Character SET PlayTime = PlayTime + ?, LastTime = date('now') WHERE CID = ?"},
+
+	{StatementID::InsertCharItem,
+		"INSERT INTO CharacterItem (CID, ItemID, RegDate) "
+		"Values (?, ?, date('now'))"},
+	{StatementID::InsertInitialCharItem,
+		"INSERT INTO CharacterItem (CID, ItemID) VALUES (?, ?)"},
+	{StatementID::DeleteCharItem,
+		"UPDATE CharacterItem SET CID = NULL "
+		"WHERE CID = ? AND CIID = ?"},
+	{StatementID::GetCharItems,
+		"SELECT CIID, ItemID, CAST(strftime('%s', RentDate) AS INTEGER), RentHourPeriod "
+		"FROM CharacterItem "
+		"WHERE CID = ? ORDER BY CIID"},
+	{StatementID::GetInventory,
+		"SELECT Inventory, InventoryVersion FROM Character WHERE CID = ?"},
+	// Only stores the inventory if no item has changed since InventoryVersion was read.
+	{StatementID::UpdateInventory,
+		"UPDATE Character SET Inventory = ? WHERE CID = ? AND InventoryVersion = ?"},
+	{StatementID::GetEquippedItems,
+		"SELECT Items FROM Character WHERE CID = ?"},
+	{StatementID::UpdateEquippedItems,
+		"UPDATE Character SET Items = ? WHERE CID = ?"},
+	{StatementID::ClearEquippedItems,
+		"UPDATE Character SET Items = NULL WHERE CID = ?"},
+	{StatementID::GetAccountItems,
+		"SELECT AIID, ItemID, "
+		"(RentHourPeriod*60) - CAST((JulianDay(datetime('now')) - JulianDay(RentDate)) * 24 * 60 As Integer) "
+		" AS RentPeriodRemainder "
+		"FROM AccountItem "
+		"WHERE AID = ? ORDER BY AIID"},
+	{StatementID::GetAccountItem,
+		"SELECT ItemID, RentDate, RentHourPeriod, Cnt "
+		"FROM AccountItem WHERE AIID = ?"},
+	{StatementID::DeleteAccountItem,
+		"DELETE FROM AccountItem WHERE AIID = ?"},
+	{StatementID::DeleteExpiredAccountItem,
+		"DELETE FROM AccountItem WHERE AIID = ? AND RentDate IS NOT NULL"},
+	{StatementID::InsertAccountItem,
+		"INSERT INTO AccountItem(AID, ItemID, RentDate, RentHourPeriod, Cnt) "
+		"VALUES(?, ?, ?, ?, ?)"},
+	{StatementID::InsertCharItemFromAccountItem,
+		"INSERT INTO CharacterItem(CID, ItemID, RegDate, RentDate, RentHourPeriod, Cnt) "
+		"VALUES(?, ?, date('now'), ?, ?, ?)"},
+	{StatementID::GetCharItemForAccountItem,
+		"SELECT ItemID, RentDate, RentHourPeriod, Cnt "
+		"FROM CharacterItem WHERE CIID = ? AND CID = ?"},
+
+	{StatementID::UpdateQuestItemInfo,
+		"UPDATE Character SET QuestItemInfo = ? WHERE CID = ?"},
+	{StatementID::GetQuestItemInfo,
+		"SELECT QuestItemInfo FROM Character WHERE CID = ?"},
+
+	{StatementID::FriendAdd,
+		"INSERT INTO Friend(CID, FriendCID, Favorite, DeleteFlag, Type) "
+		"Values (?, ?, ?, 0, 1)"},
+	{StatementID::FriendRemove,
+		"UPDATE Friend "
+		"SET DeleteFlag = 1 "
+		"WHERE CID = ? AND FriendCID = ?"},
+	{StatementID::FriendGetList,
+		"SELECT f.FriendCID, f.Favorite, c.Name "
+		"FROM Friend f, Character c "
+		"WHERE f.CID = ? AND f.FriendCID = c.CID AND f.DeleteFlag = 0 AND f.Type = 1"},
 
+	{StatementID::GetCharClan,
+		"SELECT cl.CLID AS CLID, cl.Name AS ClanName "
+		"FROM ClanMember cm, Clan cl "
+		"WHERE cm.cid = ? AND cm.CLID = cl.CLID"},
+	{StatementID::GetCLIDByName,
+		"SELECT CLID FROM Clan WHERE Name = ?"},
+	{StatementID::CountClanMemberships,
+		"SELECT COUNT(*) FROM ClanMember cm, Character c "
+		"WHERE cm.CID = ? AND cm.CID = c.CID AND c.DeleteFlag = 0"},
+	{StatementID::CountClanMembershipsOf5,
+		"SELECT COUNT(*) FROM ClanMember cm, Character c "
+		"WHERE((cm.CID = ?) OR(cm.CID = ?) OR(cm.CID = ?) OR(cm.CID = ?) OR "
+		"(cm.CID = ?)) AND cm.CID = c.CID AND c.DeleteFlag = 0"},
+	{StatementID::InsertClan,
+		"INSERT INTO Clan(Name, MasterCID, RegDate, Exp, Level, Point, Wins, Losses, "
+		"Draws, Ranking, TotalPoint, RankIncrease, EmblemChecksum, LastDayRanking, "
+		"LastMonthRanking, EmblemUrl) "
+		"VALUES(?, ?, date('now'), 0, 0, 0, 0, 0, "
+		"0, 0, 0, 0, 0, 0, "
+		"0, '')"},
+	{StatementID::InsertClanMember,
+		"INSERT INTO ClanMember(CLID, CID, Grade, RegDate, ContPoint) VALUES(?, ?, ?, date('now'), 0)"},
+	{StatementID::ReserveCloseClan,
+		"UPDATE Clan SET DeleteFlag = 2 WHERE CLID = ? AND Name = ? AND MasterCID = ?"},
+	{StatementID::DeleteAllClanMembers,
+		"DELETE FROM ClanMember WHERE CLID = ?"},
+	{StatementID::CloseClan,
+		"UPDATE Clan SET DeleteFlag = 1, MasterCID = NULL, DeleteName = ?, Name = NULL "
+		"WHERE CLID = ? AND Name = ? AND MasterCID = ?"},
+	{StatementID::RemoveClanMember,
+		"DELETE FROM ClanMember WHERE CLID = ? AND CID = ? AND Grade != 1"},
+	{StatementID::UpdateClanGrade,
+		"UPDATE ClanMember SET Grade = ? WHERE CLID = ? AND CID = ?"},
+	{StatementID::GetClanMemberByName,
+		"SELECT c.cid, cm.Grade FROM Character c, ClanMember cm "
+		"WHERE cm.clid = ? AND c.cid = cm.cid AND c.Name = ? AND DeleteFlag = 0"},
+	{StatementID::GetClanInfo,
+		"SELECT cl.Name AS Name, cl.TotalPoint AS TotalPoint, "
+		"cl.Level AS Level, cl.Ranking AS Ranking, "
+		"cl.Point AS Point, cl.Wins AS Wins, cl.Losses AS Losses, cl.Draws AS Draws, "
+		"c.Name AS ClanMaster, "
+		"(SELECT COUNT(*) FROM ClanMember WHERE CLID = ?1) AS MemberCount, "
+		"cl.EmblemUrl AS EmblemUrl, cl.EmblemChecksum AS EmblemChecksum "
+		"FROM Clan cl, Character c "
+		"WHERE cl.CLID = ?1 and cl.MasterCID = c.CID"},
+	{StatementID::UpdateCharClanContPoint,
+		"UPDATE ClanMember SET ContPoint = ContPoint + ? WHERE CID = ? AND CLID = ?"},
+	{StatementID::AddClanWin,
+		"UPDATE Clan SET Wins = Wins + 1, Point = Point + ?1, TotalPoint = TotalPoint + ?1 "
+		"WHERE CLID = ?2"},
+	{StatementID::AddClanLoss,
+		"UPDATE Clan SET Losses = Losses + 1, Point = max(0, Point + ?) WHERE CLID = ?"},
+	{StatementID::InsertClanGameLog,
+		"INSERT INTO ClanGameLog(WinnerCLID, LoserCLID, WinnerClanName, LoserClanName, "
+		"RoundWins, RoundLosses, "
+		"MapID, GameType, RegDate, WinnerMembers, LoserMembers, WinnerPoint, LoserPoint) "
+		"VALUES(?, ?, ?, ?, ?, ?, "
+		"?, ?, date('now'), ?, ?, ?, ?)"},
+};
+
+static_assert(std::size(StatementTable) == size_t(StatementID::Max),
+	"StatementTable must have exactly one entry per StatementID");
+
+SQLiteDatabase::SQLiteStatementPtr SQLiteDatabase::PrepareStatement(const char* sql)
+{
 	sqlite3_stmt* temp_ptr = nullptr;
-	auto err_code = sqlite3_prepare_v2(sqlite.get(), sql, size, &temp_ptr, &tail);
+	auto err_code = sqlite3_prepare_v2(sqlite.get(), sql, -1, &temp_ptr, nullptr);
 	if (err_code != SQLITE_OK)
 		throw SQLiteError(err_code, std::string("Prepare threw ") + std::to_string(err_code) + ": "
 			+ sqlite3_errmsg(sqlite.get()) + " on " + sql);
 
-	stmt = decltype(stmt)(temp_ptr);
+	return SQLiteStatementPtr{ temp_ptr };
+}
 
-	return stmt;
+void SQLiteDatabase::PrepareStatements()
+{
+	PreparedStatements.resize(size_t(StatementID::Max));
+
+	for (auto&& Entry : StatementTable)
+	{
+		auto& Statement = PreparedStatements[size_t(Entry.ID)];
+		assert(!Statement);
+
+		// A statement that fails to prepare is left null, and executing it will report the error.
+		try
+		{
+			Statement = PrepareStatement(Entry.SQL);
+		}
+		catch (const SQLiteError& e)
+		{
+			Log("Failed to prepare statement %d: %s\n", int(Entry.ID), e.what());
+		}
+	}
 }
 
-template <size_t size, typename... Args>
-SQLiteStatement SQLiteDatabase::ExecuteSQL(const char(&sql)[size], Args&&... args)
+template <typename... Args>
+SQLiteStatement SQLiteDatabase::ExecuteSQL(StatementID ID, Args&&... args)
 {
-	auto it = PreparedStatements.find(sql);
-	if (it == PreparedStatements.end())
-		it = PreparedStatements.emplace(sql, PrepareStatement(sql)).first;
+	auto* PreparedStatement = PreparedStatements[size_t(ID)].get();
+	if (!PreparedStatement)
+		throw SQLiteError(SQLITE_ERROR, "Statement " + std::to_string(int(ID)) + " is not prepared");
 
-	auto stmt = SQLiteStatement{ it->second.get() };
+	// The statement may still be stepping through the rows of a previous execution.
+	sqlite3_reset(PreparedStatement);
+
+	auto stmt = SQLiteStatement{ PreparedStatement };
 
 	BindParameter(stmt, 1, std::forward<Args>(args)...);
 	auto err_code = stmt.Step();
@@ -264,6 +606,69 @@ struct ItemBlob
 	int32_t ItemIDs[MMCIP_END];
 };
 
+// Packed copy of a character's CharacterItem rows, stored in Character.Inventory so that the
+// whole inventory can be loaded with a single read. It's a header followed by Count items.
+//
+// The CharacterItem triggers increment Character.InventoryVersion whenever an item changes, and
+// the blob is only used if it was made from that version. The methods that change items update
+// the blob along with it, and GetCharItemInfo rebuilds it from the rows after any other change.
+struct InventoryBlobHeader
+{
+	static constexpr u32 CurrentVersion = 2;
+
+	u32 Version;
+	u32 Count;
+	// The Character.InventoryVersion the items are a copy of.
+	i64 InventoryVersion;
+};
+
+struct InventoryBlobItem
+{
+	i32 CIID;
+	i32 ItemID;
+	// Unix time the rent started.
+	i64 RentDate;
+	// Negative if it isn't a rent item.
+	i32 RentHourPeriod;
+	i32 Padding;
+};
+
+static_assert(sizeof(InventoryBlobHeader) == 16, "Inventory blob layout changed");
+static_assert(sizeof(InventoryBlobItem) == 24, "Inventory blob layout changed");
+
+// Returns false if the blob is malformed or isn't a copy of InventoryVersion.
+static bool ReadInventoryBlob(const Blob& Src, i64 InventoryVersion,
+	std::vector<InventoryBlobItem>& Items)
+{
+	InventoryBlobHeader Header;
+	if (Src.Size < sizeof(Header))
+		return false;
+
+	memcpy(&Header, Src.Ptr, sizeof(Header));
+	if (Header.Version != InventoryBlobHeader::CurrentVersion ||
+		Header.InventoryVersion != InventoryVersion ||
+		Src.Size != sizeof(Header) + Header.Count * sizeof(InventoryBlobItem))
+		return false;
+
+	Items.resize(Header.Count);
+	if (Header.Count)
+		memcpy(Items.data(), static_cast<const u8*>(Src.Ptr) + sizeof(Header),
+			Header.Count * sizeof(InventoryBlobItem));
+	return true;
+}
+
+static std::vector<u8> WriteInventoryBlob(const std::vector<InventoryBlobItem>& Items,
+	i64 InventoryVersion)
+{
+	InventoryBlobHeader Header{InventoryBlobHeader::CurrentVersion, static_cast<u32>(Items.size()),
+		InventoryVersion};
+	std::vector<u8> Ret(sizeof(Header) + Items.size() * sizeof(InventoryBlobItem));
+	memcpy(Ret.data(), &Header, sizeof(Header));
+	if (!Items.empty())
+		memcpy(Ret.data() + sizeof(Header), Items.data(), Items.size() * sizeof(InventoryBlobItem));
+	return Ret;
+}
+
 
 //
 // SQLiteDatabase definitions
@@ -331,7 +736,9 @@ SQLiteDatabase::SQLiteDatabase(const char* Filename)
 		"DeathCount integer NULL, "
 		"DeleteFlag integer NULL, "
 		"DeleteName text NULL, "
-		"QuestItemInfo blob NULL)");
+		"QuestItemInfo blob NULL, "
+		"Inventory blob NULL, "
+		"InventoryVersion integer NOT NULL DEFAULT 0)");
 
 	exec("CREATE TABLE IF NOT EXISTS CharacterMakingLog( "
 		"id integer PRIMARY KEY NOT NULL, "
@@ -390,6 +797,80 @@ SQLiteDatabase::SQLiteDatabase(const char* Filename)
 		"Type integer NOT NULL, "
 		"Favorite integer NULL, "
 		"DeleteFlag integer NULL)");
+
+	exec("CREATE TABLE IF NOT EXISTS AccountItem( "
+		"AIID integer PRIMARY KEY NOT NULL, "
+		"AID integer NOT NULL, "
+		"ItemID integer NOT NULL, "
+		"RentDate integer NULL, "
+		"RentHourPeriod integer NULL, "
+		"Cnt integer NULL)");
+
+	exec("CREATE TABLE IF NOT EXISTS Blocks( "
+		"id integer PRIMARY KEY NOT NULL, "
+		"AID integer NOT NULL, "
+		"Type integer NOT NULL, "
+		"Reason text NULL, "
+		"EndDate integer NULL)");
+
+	exec("CREATE TABLE IF NOT EXISTS ClanGameLog( "
+		"id integer PRIMARY KEY NOT NULL, "
+		"WinnerCLID integer NOT NULL, "
+		"LoserCLID integer NOT NULL, "
+		"WinnerClanName text NULL, "
+		"LoserClanName text NULL, "
+		"RoundWins integer NOT NULL, "
+		"RoundLosses integer NOT NULL, "
+		"MapID integer NOT NULL, "
+		"GameType integer NOT NULL, "
+		"RegDate text NOT NULL, "
+		"WinnerMembers text NULL, "
+		"LoserMembers text NULL, "
+		"WinnerPoint integer NOT NULL, "
+		"LoserPoint integer NOT NULL)");
+
+	// Databases created before the inventory blob was added don't have its columns. Existing
+	// characters start out without a blob, and get one the first time they're loaded.
+	auto HasColumn = [&](const char* Table, const char* Column) {
+		auto stmt = PrepareStatement(("PRAGMA table_info(" + std::string(Table) + ")").c_str());
+		while (sqlite3_step(stmt.get()) == SQLITE_ROW)
+		{
+			// The second column is the name.
+			auto Name = reinterpret_cast<const char*>(sqlite3_column_text(stmt.get(), 1));
+			if (Name && strcmp(Name, Column) == 0)
+				return true;
+		}
+		return false;
+	};
+
+	if (!HasColumn("Character", "Inventory"))
+	{
+		exec("ALTER TABLE Character ADD COLUMN Inventory blob NULL");
+		exec("ALTER TABLE Character ADD COLUMN InventoryVersion integer NOT NULL DEFAULT 0");
+	}
+
+	// Any change to a character's items invalidates its inventory blob. The first version of
+	// these triggers cleared the blob as well.
+	for (auto Name : {"CharacterItemInsert", "CharacterItemUpdate", "CharacterItemDelete"})
+		exec(("DROP TRIGGER IF EXISTS " + std::string{Name}).c_str());
+	exec("CREATE TRIGGER IF NOT EXISTS CharacterItemInsertVersion AFTER INSERT ON CharacterItem "
+		"BEGIN "
+		"UPDATE Character SET InventoryVersion = InventoryVersion + 1 "
+		"WHERE CID = NEW.CID; "
+		"END");
+	exec("CREATE TRIGGER IF NOT EXISTS CharacterItemUpdateVersion AFTER UPDATE ON CharacterItem "
+		"BEGIN "
+		"UPDATE Character SET InventoryVersion = InventoryVersion + 1 "
+		"WHERE CID = OLD.CID OR CID = NEW.CID; "
+		"END");
+	exec("CREATE TRIGGER IF NOT EXISTS CharacterItemDeleteVersion AFTER DELETE ON CharacterItem "
+		"BEGIN "
+		"UPDATE Character SET InventoryVersion = InventoryVersion + 1 "
+		"WHERE CID = OLD.CID; "
+		"END");
+
+	// The tables have to exist before the statements that refer to them can be prepared.
+	PrepareStatements();
 }
 
 void SQLiteDatabase::HandleException(const SQLiteError & e)
@@ -403,7 +884,7 @@ void SQLiteDatabase::HandleException(const SQLiteError & e)
 SQLiteDatabase::Transaction SQLiteDatabase::BeginTransaction()
 {
 	assert(!InTransaction);
-	ExecuteSQL("BEGIN TRANSACTION");
+	ExecuteSQL(StatementID::BeginTransaction);
 	InTransaction = true;
 	return Transaction(*this);
 }
@@ -411,14 +892,14 @@ SQLiteDatabase::Transaction SQLiteDatabase::BeginTransaction()
 void SQLiteDatabase::RollbackTransaction()
 {
 	assert(InTransaction);
-	ExecuteSQL("ROLLBACK TRANSACTION");
+	ExecuteSQL(StatementID::RollbackTransaction);
 	InTransaction = false;
 }
 
 void SQLiteDatabase::CommitTransaction()
 {
 	assert(InTransaction);
-	ExecuteSQL("COMMIT TRANSACTION");
+	ExecuteSQL(StatementID::CommitTransaction);
 	InTransaction = false;
 }
 
@@ -462,7 +943,8 @@ void SQLiteDatabase::Log(const char * Format, ...)
 bool SQLiteDatabase::GetLoginInfo(const char * UserID, unsigned int * outAID, char * outPassword, size_t maxlen)
 try
 {
-	auto stmt = ExecuteSQL("SELECT AID, PasswordData FROM Login WHERE UserID = ?", UserID);
+	DB_PROFILE_METHOD();
+	auto stmt = ExecuteSQL(StatementID::GetLoginInfo, UserID);
 
 	if (!stmt.HasRow())
 		return false;
@@ -484,24 +966,20 @@ AccountCreationResult SQLiteDatabase::CreateAccountNew(const char * Username,
 	const char * PasswordData, size_t PasswordSize, const char * Email)
 try
 {
-	auto stmt = ExecuteSQL("SELECT AID FROM Account WHERE UserID = ?", Username);
+	DB_PROFILE_METHOD();
+	auto stmt = ExecuteSQL(StatementID::GetAIDByUserID, Username);
 
 	if (stmt.HasRow())
 		return AccountCreationResult::UsernameAlreadyExists;
 
 	auto Trans = BeginTransaction();
 
-	stmt = ExecuteSQL("INSERT INTO Account (UserID, UGradeID, PGradeID, RegDate, Email) "
-		"VALUES (?, 0, 0, date('now'), ?)",
+	ExecuteSQL(StatementID::InsertAccount,
 		Username, Email);
-	stmt = ExecuteSQL("SELECT AID FROM Account WHERE UserID = ?",
-		Username);
-
-	if (!stmt.HasRow())
-		return AccountCreationResult::DBError;
 
-	auto AID = stmt.Get<int>(0);
-	stmt = ExecuteSQL("INSERT INTO Login(UserID, AID, PasswordData) VALUES(?, ?, ?)",
+	// AID is the rowid of the Account table.
+	auto AID = static_cast<int>(LastInsertedRowID());
+	ExecuteSQL(StatementID::InsertLogin,
 		Username, AID, StringView{ PasswordData, PasswordSize });
 
 	CommitTransaction();
@@ -517,7 +995,8 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::UpdateCharLevel(int CID, int Level)
 try
 {
-	auto stmt = ExecuteSQL("UPDATE Character SET Level = ? WHERE CID = ?", Level, CID);
+	DB_PROFILE_METHOD();
+	auto stmt = ExecuteSQL(StatementID::UpdateCharLevel, Level, CID);
 
 	return true;
 }
@@ -529,14 +1008,15 @@ catch (const SQLiteError& e)
 
 bool SQLiteDatabase::InsertLevelUpLog(int nCID, int nLevel, int nBP, int nKillCount, int nDeathCount, int nPlayTime)
 {
+	DB_PROFILE_METHOD();
 	return true;
 }
 
 bool SQLiteDatabase::UpdateLastConnDate(const char * UserID, const char * IP)
 try
 {
-	auto stmt = ExecuteSQL("UPDATE Login SET LastConnDate = date('now'), "
-		"LastIP = ? WHERE UserID = ?", IP, UserID);
+	DB_PROFILE_METHOD();
+	auto stmt = ExecuteSQL(StatementID::UpdateLastConnDate, IP, UserID);
 
 	return true;
 }
@@ -549,10 +1029,11 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::BanPlayer(int nAID, const char* Reason, const time_t& UnbanTime)
 try
 {
+	DB_PROFILE_METHOD();
 	auto Trans = BeginTransaction();
 
-	auto stmt = ExecuteSQL("UPDATE Account SET UGradeID = ? WHERE AID = ?", MMUG_BLOCKED, nAID);
-	ExecuteSQL("INSERT INTO Blocks (AID, Type, Reason, EndDate) VALUES (?, ?, ?, ?)",
+	auto stmt = ExecuteSQL(StatementID::UpdateUGradeID, MMUG_BLOCKED, nAID);
+	ExecuteSQL(StatementID::InsertBlock,
 		nAID, MMBT_BANNED, Reason, UnbanTime);
 
 	CommitTransaction();
@@ -568,8 +1049,9 @@ catch (const SQLiteError& e)
 int SQLiteDatabase::CreateCharacter(int AID, const char * NewName, int CharIndex, int Sex, int Hair, int Face, int Costume)
 try
 {
+	DB_PROFILE_METHOD();
 
-	auto stmt = ExecuteSQL("SELECT COUNT(*) AS NUM FROM Character WHERE Name = ?", NewName);
+	auto stmt = ExecuteSQL(StatementID::CountCharsWithName, NewName);
 
 	if (!stmt.HasRow())
 		return MERR_UNKNOWN;
@@ -579,10 +1061,7 @@ try
 
 	auto Trans = BeginTransaction();
 
-	ExecuteSQL("INSERT INTO Character (AID, Name, CharNum, Level, Sex, Hair, Face, XP, BP, "
-		"GameCount, KillCount, DeathCount, RegDate, PlayTime, DeleteFlag) "
-		"Values(?, ?, ?, 1, ?, ?, ?, 0, 0, "
-		"0, 0, 0, date('now'), 0, 0)",
+	ExecuteSQL(StatementID::InsertCharacter,
 		AID, NewName, CharIndex, Sex, Hair, Face);
 
 	auto CID = LastInsertedRowID();
@@ -598,7 +1077,7 @@ try
 		size_t Index = Parts.first;
 		auto ItemID = Parts.second;
 		Items.ItemIDs[Index] = ItemID;
-		ExecuteSQL("INSERT INTO CharacterItem (CID, ItemID) VALUES (?, ?)", CID, ItemID);
+		ExecuteSQL(StatementID::InsertInitialCharItem, CID, ItemID);
 		auto CIID = static_cast<i32>(LastInsertedRowID());
 		Items.CIIDs[Index] = CIID;
 	};
@@ -608,8 +1087,8 @@ try
 	for (auto& Pair : Weapons)
 		SetItem(Pair);
 
-	ExecuteSQL("UPDATE Character SET Items = ? WHERE AID = ? AND CID = ?",
-		Blob{ &Items, sizeof(Items) }, AID, CID);
+	ExecuteSQL(StatementID::UpdateEquippedItems,
+		Blob{ &Items, sizeof(Items) }, CID);
 
 	CommitTransaction();
 
@@ -624,26 +1103,19 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::DeleteCharacter(int AID, int CharIndex, const char * CharName)
 try
 {
-	auto stmt = ExecuteSQL("SELECT CID FROM Character WHERE AID = ? AND CharNum = ?", AID, CharIndex);
+	DB_PROFILE_METHOD();
+	auto stmt = ExecuteSQL(StatementID::GetCharForDeletion, AID, CharIndex);
 
 	if (!stmt.HasRow())
 		return false;
 
-	auto CID = stmt.Get<int>();
-
-	stmt = ExecuteSQL("SELECT COUNT(*) AS CashItemCount FROM CharacterItem "
-		"WHERE CID = ? AND ItemID >= 500000", CID);
+	stmt.NextColumn(); // CID
+	auto CashItemCount = stmt.Get<int>();
 
-	if (stmt.HasRow())
-	{
-		auto CashItemCount = stmt.Get<int>();
-
-		if (CashItemCount > 0)
-			return false;
-	}
+	if (CashItemCount > 0)
+		return false;
 
-	stmt = ExecuteSQL("UPDATE Character SET CharNum = -1, DeleteFlag = 1, Name = '', DeleteName = ?"
-		"WHERE AID = ? AND CharNum = ?",
+	stmt = ExecuteSQL(StatementID::MarkCharDeleted,
 		CharName, AID, CharIndex);
 
 	InsertCharMakingLog(AID, CharName, CharMakingType::Delete);
@@ -659,8 +1131,8 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::InsertCharMakingLog(unsigned int AID, const char * CharName, CharMakingType Type)
 try
 {
-	ExecuteSQL("INSERT INTO CharacterMakingLog(AID, CharName, Type, Date) "
-		"VALUES(?, ?, ?, date('now'))",
+	DB_PROFILE_METHOD();
+	ExecuteSQL(StatementID::InsertCharMakingLog,
 		AID, CharName, Type);
 
 	return true;
@@ -674,9 +1146,8 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::GetAccountCharList(int AID, MTD_AccountCharInfo * outCharList, int * outCharCount)
 try
 {
-	auto stmt = ExecuteSQL("SELECT Name, CharNum, Level "
-		"FROM Character "
-		"WHERE AID = ? AND DeleteFlag = 0",
+	DB_PROFILE_METHOD();
+	auto stmt = ExecuteSQL(StatementID::GetAccountCharList,
 		AID);
 
 	int i = 0;
@@ -702,24 +1173,13 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::GetAccountCharInfo(int AID, int CharIndex, MTD_CharInfo * outCharInfo)
 try
 {
-	auto stmt = ExecuteSQL("SELECT CID FROM Character WHERE AID = ? and CharNum = ?",
+	DB_PROFILE_METHOD();
+	auto stmt = ExecuteSQL(StatementID::GetAccountCharInfo,
 		AID, CharIndex);
 
 	if (!stmt.HasRow())
 		return false;
 
-	auto CID = stmt.Get<int>();
-
-	stmt = ExecuteSQL("SELECT Name, CharNum, Level, Sex, Hair, Face, XP, BP, "
-		"(SELECT cl.Name FROM Clan cl, ClanMember cm WHERE cm.cid = ?1 AND cm.CLID = cl.CLID) AS ClanName, "
-		"Items "
-		"FROM Character "
-		"WHERE CID = ?1",
-		CID);
-
-	if (!stmt.HasRow())
-		return false;
-
 	strcpy_safe(outCharInfo->szName, stmt.Get<StringView>());
 	outCharInfo->nCharNum = stmt.Get<int>();
 	outCharInfo->nLevel = stmt.Get<int>();
@@ -764,8 +1224,8 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::GetAccountInfo(int AID, MMatchAccountInfo * outAccountInfo)
 try
 {
-	auto stmt = ExecuteSQL("SELECT UserID, UGradeID "
-		"FROM Account WHERE AID = ?",
+	DB_PROFILE_METHOD();
+	auto stmt = ExecuteSQL(StatementID::GetAccountInfo,
 		AID);
 
 	if (!stmt.HasRow())
@@ -786,24 +1246,14 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::GetCharInfoByAID(int AID, int CharIndex, MMatchCharInfo * outCharInfo, int & nWaitHourDiff)
 try
 {
-	auto stmt = ExecuteSQL("SELECT CID FROM Character WHERE AID = ? and CharNum = ?",
+	DB_PROFILE_METHOD();
+	auto stmt = ExecuteSQL(StatementID::GetCharInfoByAID,
 		AID, CharIndex);
 
 	if (!stmt.HasRow())
 		return false;
 
-	auto CID = stmt.Get<int>();
-
-	stmt = ExecuteSQL("SELECT Name, Level, Sex, CharNum, Hair, Face, "
-		"XP, BP, GameCount, KillCount, DeathCount, PlayTime, Items "
-		"FROM Character "
-		"WHERE CID = ?",
-		CID);
-
-	if (!stmt.HasRow())
-		return false;
-
-	outCharInfo->m_nCID = CID;
+	outCharInfo->m_nCID = stmt.Get<int>();
 	if (!stmt.IsNull())
 		strcpy_safe(outCharInfo->m_szName, stmt.Get<StringView>());
 	else
@@ -832,12 +1282,8 @@ try
 		stmt.NextColumn();
 	}
 
-	stmt = ExecuteSQL("SELECT cl.CLID, cl.Name, cm.Grade, cm.ContPoint "
-		"FROM ClanMember cm, Clan cl "
-		"WHERE cm.cid = ? AND cm.CLID = cl.CLID",
-		CID);
-
-	if (stmt.HasRow())
+	// The clan columns come from a left join, so they're all null if the character isn't in a clan.
+	if (!stmt.IsNull())
 	{
 		outCharInfo->m_ClanInfo.m_nClanID = stmt.Get<int>();
 		if (!stmt.IsNull())
@@ -873,9 +1319,8 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::GetCharCID(const char * Name, int * outCID)
 try
 {
-	auto stmt = ExecuteSQL("SELECT CID "
-		"FROM Character "
-		"WHERE Name = ?",
+	DB_PROFILE_METHOD();
+	auto stmt = ExecuteSQL(StatementID::GetCIDByName,
 		Name);
 
 	if (!stmt.HasRow())
@@ -894,9 +1339,8 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::SimpleUpdateCharInfo(const MMatchCharInfo& CharInfo)
 try
 {
-	ExecuteSQL("UPDATE Character "
-		"SET Level = ?, XP = ?, BP = ? "
-		"WHERE CID = ?",
+	DB_PROFILE_METHOD();
+	ExecuteSQL(StatementID::SimpleUpdateCharInfo,
 		CharInfo.m_nLevel, CharInfo.m_nXP, CharInfo.m_nBP,
 		CharInfo.m_nCID);
 
@@ -911,9 +1355,8 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::UpdateCharBP(int CID, int BPInc)
 try
 {
-	ExecuteSQL("UPDATE Character "
-		"SET BP = BP + ? "
-		"WHERE CID = ?",
+	DB_PROFILE_METHOD();
+	ExecuteSQL(StatementID::AddCharBP,
 		BPInc, CID);
 
 	return true;
@@ -927,9 +1370,8 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::UpdateCharInfoData(int CID, int AddedXP, int AddedBP, int AddedKillCount, int AddedDeathCount)
 try
 {
-	ExecuteSQL("UPDATE Character "
-		"SET XP = XP + ?, BP = BP + ?, KillCount = KillCount + ?, DeathCount = DeathCount + ? "
-		"WHERE CID = ?",
+	DB_PROFILE_METHOD();
+	ExecuteSQL(StatementID::UpdateCharInfoData,
 		AddedXP, AddedBP, AddedKillCount, AddedDeathCount,
 		CID);
 
@@ -941,15 +1383,65 @@ catch (const SQLiteError& e)
 	return false;
 }
 
+// The change must have gone through the CharacterItem triggers exactly once, so the blob is only
+// patched if it was a copy of the version before it. Otherwise it's left for GetCharItemInfo to
+// rebuild.
+template <typename Fn>
+void SQLiteDatabase::PatchInventory(u32 CID, Fn&& Patch)
+{
+	assert(InTransaction);
+
+	std::vector<InventoryBlobItem> Items;
+	i64 InventoryVersion;
+	{
+		auto stmt = ExecuteSQL(StatementID::GetInventory, CID);
+		if (!stmt.HasRow() || stmt.IsNull())
+			return;
+		auto Data = stmt.Get<Blob>();
+		InventoryVersion = stmt.Get<i64>();
+		if (!ReadInventoryBlob(Data, InventoryVersion - 1, Items))
+			return;
+	}
+
+	Patch(Items);
+
+	auto Data = WriteInventoryBlob(Items, InventoryVersion);
+	ExecuteSQL(StatementID::UpdateInventory,
+		Blob{ Data.data(), Data.size() }, CID, InventoryVersion);
+}
+
+// Items inserted by InsertCharItem have the highest CIID so far, and aren't rent items.
+static void AddInventoryItem(std::vector<InventoryBlobItem>& Items, i64 CIID, int ItemID)
+{
+	InventoryBlobItem Item{};
+	Item.CIID = static_cast<i32>(CIID);
+	Item.ItemID = ItemID;
+	Item.RentHourPeriod = -1;
+	Items.push_back(Item);
+}
+
+static void RemoveInventoryItem(std::vector<InventoryBlobItem>& Items, int CIID)
+{
+	Items.erase(std::remove_if(Items.begin(), Items.end(), [&](auto&& Item) {
+		return Item.CIID == CIID; }), Items.end());
+}
+
 bool SQLiteDatabase::InsertCharItem(unsigned int CID, int ItemID, bool RentItem, int RentPeriodHour,
 	u32 * outCIID)
 try
 {
-	ExecuteSQL("INSERT INTO CharacterItem (CID, ItemID, RegDate) "
-		"Values (?, ?, date('now'))",
+	DB_PROFILE_METHOD();
+	auto Trans = BeginTransaction();
+
+	ExecuteSQL(StatementID::InsertCharItem,
 		CID, ItemID);
 
-	*outCIID = static_cast<u32>(LastInsertedRowID());
+	auto CIID = LastInsertedRowID();
+	*outCIID = static_cast<u32>(CIID);
+
+	PatchInventory(CID, [&](auto& Items) { AddInventoryItem(Items, CIID, ItemID); });
+
+	CommitTransaction();
 
 	return true;
 }
@@ -962,9 +1454,15 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::DeleteCharItem(unsigned int CID, int CIID)
 try
 {
-	ExecuteSQL("UPDATE CharacterItem SET CID = NULL "
-		"WHERE CID = ? AND CIID = ?",
+	DB_PROFILE_METHOD();
+	auto Trans = BeginTransaction();
+
+	ExecuteSQL(StatementID::DeleteCharItem,
 		CID, CIID);
+	if (RowsModified() != 0)
+		PatchInventory(CID, [&](auto& Items) { RemoveInventoryItem(Items, CIID); });
+
+	CommitTransaction();
 
 	return true;
 }
@@ -977,34 +1475,69 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::GetCharItemInfo(MMatchCharInfo& CharInfo)
 try
 {
-	auto stmt = ExecuteSQL("SELECT CIID, ItemID, "
-		"(RentHourPeriod*60) - CAST((JulianDay(datetime('now')) - JulianDay(RentDate)) * 24 * 60 As Integer) "
-		"AS RentPeriodRemainder "
-		"FROM CharacterItem "
-		"WHERE CID = ? ORDER BY CIID",
-		CharInfo.m_nCID);
+	DB_PROFILE_METHOD();
+	std::vector<InventoryBlobItem> Items;
+	auto HaveItems = false;
+	i64 InventoryVersion = 0;
 
-	while (stmt.HasRow())
 	{
-		auto CIID = stmt.Get<int>();
-		auto ItemDescID = stmt.Get<int>();
+		auto stmt = ExecuteSQL(StatementID::GetInventory,
+			CharInfo.m_nCID);
 
-		auto IsRentItem = !stmt.IsNull();
-		auto RentMinutePeriodRemainder = 0;
-		if (IsRentItem)
+		if (stmt.HasRow())
 		{
-			RentMinutePeriodRemainder = stmt.Get<int>();
+			// NULL for characters that haven't been loaded since the column was added.
+			auto HaveBlob = !stmt.IsNull();
+			Blob Data{};
+			if (HaveBlob)
+				Data = stmt.Get<Blob>();
+			else
+				stmt.NextColumn();
+			InventoryVersion = stmt.Get<i64>();
+			HaveItems = HaveBlob && ReadInventoryBlob(Data, InventoryVersion, Items);
 		}
-		else
+	}
+
+	if (!HaveItems)
+	{
+		auto stmt = ExecuteSQL(StatementID::GetCharItems,
+			CharInfo.m_nCID);
+
+		while (stmt.HasRow())
 		{
-			RentMinutePeriodRemainder = RENT_MINUTE_PERIOD_UNLIMITED;
-			stmt.NextColumn();
+			InventoryBlobItem Item{};
+			Item.CIID = stmt.Get<int>();
+			Item.ItemID = stmt.Get<int>();
+			auto IsRentItem = !stmt.IsNull(2) && !stmt.IsNull(3);
+			Item.RentDate = IsRentItem ? stmt.Get<i64>(2) : 0;
+			Item.RentHourPeriod = IsRentItem ? stmt.Get<int>(3) : -1;
+			Items.push_back(Item);
+
+			stmt.Step();
 		}
 
-		MUID uidNew = MMatchItemMap::UseUID();
-		CharInfo.m_ItemList.CreateItem(uidNew, CIID, ItemDescID, IsRentItem, RentMinutePeriodRemainder);
+		// If an item changed after the version was read, the update doesn't match any rows
+		// and the next load tries again.
+		auto Data = WriteInventoryBlob(Items, InventoryVersion);
+		ExecuteSQL(StatementID::UpdateInventory,
+			Blob{ Data.data(), Data.size() }, CharInfo.m_nCID, InventoryVersion);
+	}
 
-		stmt.Step();
+	CharInfo.m_ItemList.Reserve(Items.size());
+	const auto Now = static_cast<i64>(time(nullptr));
+	for (auto&& Item : Items)
+	{
+		auto IsRentItem = Item.RentHourPeriod >= 0;
+		auto RentMinutePeriodRemainder = RENT_MINUTE_PERIOD_UNLIMITED;
+		if (IsRentItem)
+		{
+			// Same as (RentHourPeriod*60) - CAST((JulianDay('now') - JulianDay(RentDate)) * 24 * 60 As Integer).
+			RentMinutePeriodRemainder = Item.RentHourPeriod * 60 -
+				static_cast<int>((Now - Item.RentDate) / 60);
+		}
+
+		MUID uidNew = MMatchItemMap::UseUID();
+		CharInfo.m_ItemList.CreateItem(uidNew, Item.CIID, Item.ItemID, IsRentItem, RentMinutePeriodRemainder);
 	}
 
 	CharInfo.m_ItemList.SetDbAccess();
@@ -1022,11 +1555,8 @@ bool SQLiteDatabase::GetAccountItemInfo(int AID, MAccountItemNode * outItemNode,
 	int * outExpiredItemCount, int MaxExpiredItemCount)
 try
 {
-	auto stmt = ExecuteSQL("SELECT AIID, ItemID, "
-		"(RentHourPeriod*60) - CAST((JulianDay(datetime('now')) - JulianDay(RentDate)) * 24 * 60 As Integer) "
-		" AS RentPeriodRemainder "
-		"FROM AccountItem "
-		"WHERE AID = ? ORDER BY AIID",
+	DB_PROFILE_METHOD();
+	auto stmt = ExecuteSQL(StatementID::GetAccountItems,
 		AID);
 
 	int NodeCount;
@@ -1086,7 +1616,8 @@ bool SQLiteDatabase::UpdateEquipedItem(u32 CID, MMatchCharItemParts parts, u32 C
 	u32 ItemID)
 try
 {
-	auto stmt = ExecuteSQL("SELECT Items FROM Character WHERE CID = ?", CID);
+	DB_PROFILE_METHOD();
+	auto stmt = ExecuteSQL(StatementID::GetEquippedItems, CID);
 
 	ItemBlob Items;
 
@@ -1112,7 +1643,7 @@ try
 	Items.CIIDs[parts] = CIID;
 	Items.ItemIDs[parts] = ItemID;
 
-	ExecuteSQL("UPDATE Character SET Items = ? WHERE CID = ?", Blob{ &Items, sizeof(Items) }, CID);
+	ExecuteSQL(StatementID::UpdateEquippedItems, Blob{ &Items, sizeof(Items) }, CID);
 
 	return true;
 }
@@ -1125,7 +1656,8 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::ClearAllEquipedItem(u32 CID)
 try
 {
-	ExecuteSQL("UPDATE Character SET Items = NULL WHERE CID = ?", CID);
+	DB_PROFILE_METHOD();
+	ExecuteSQL(StatementID::ClearEquippedItems, CID);
 	return true;
 }
 catch (const SQLiteError& e)
@@ -1137,7 +1669,8 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::DeleteExpiredAccountItem(int AIID)
 try
 {
-	ExecuteSQL("DELETE FROM AccountItem WHERE AIID = ? AND RentDate IS NOT NULL", AIID);
+	DB_PROFILE_METHOD();
+	ExecuteSQL(StatementID::DeleteExpiredAccountItem, AIID);
 	return true;
 }
 catch (const SQLiteError& e)
@@ -1149,22 +1682,26 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::BuyBountyItem(unsigned int CID, int ItemID, int Price, u32 * outCIID)
 try
 {
-	auto stmt = ExecuteSQL("SELECT BP FROM Character WHERE CID = ?", CID);
+	DB_PROFILE_METHOD();
+	auto stmt = ExecuteSQL(StatementID::GetCharBP, CID);
 	if (!stmt.HasRow() || stmt.IsNull() || stmt.Get<int>() < Price)
 		return false;
 
 	auto Trans = BeginTransaction();
 
-	ExecuteSQL("UPDATE Character SET BP = BP - ? WHERE CID = ?", Price, CID);
+	ExecuteSQL(StatementID::SubtractCharBP, Price, CID);
 	if (RowsModified() == 0)
 		return false;
 
-	ExecuteSQL("INSERT INTO CharacterItem (CID, ItemID, RegDate) Values (?, ?, date('now'))",
+	ExecuteSQL(StatementID::InsertCharItem,
 		CID, ItemID);
 	if (RowsModified() == 0)
 		return false;
 
-	*outCIID = static_cast<u32>(LastInsertedRowID());
+	auto CIID = LastInsertedRowID();
+	*outCIID = static_cast<u32>(CIID);
+
+	PatchInventory(CID, [&](auto& Items) { AddInventoryItem(Items, CIID, ItemID); });
 
 	CommitTransaction();
 
@@ -1181,13 +1718,16 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::SellBountyItem(unsigned int CID, unsigned int ItemID, unsigned int CIID, int Price, int CharBP)
 try
 {
+	DB_PROFILE_METHOD();
 	auto Trans = BeginTransaction();
 
-	ExecuteSQL("UPDATE CharacterItem SET CID = NULL WHERE CID = ? AND CIID = ?", CID, CIID);
+	ExecuteSQL(StatementID::DeleteCharItem, CID, CIID);
 	if (RowsModified() == 0)
 		return false;
 
-	ExecuteSQL("UPDATE Character SET BP = BP + ? WHERE CID = ?", Price, CID);
+	PatchInventory(CID, [&](auto& Items) { RemoveInventoryItem(Items, CIID); });
+
+	ExecuteSQL(StatementID::AddCharBP, Price, CID);
 	if (RowsModified() == 0)
 		return false;
 
@@ -1206,6 +1746,7 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::UpdateQuestItem(int nCID, MQuestItemMap& rfQuestIteMap, MQuestMonsterBible& rfQuestMonster)
 try
 {
+	DB_PROFILE_METHOD();
 	constexpr auto ActualQuestDataSize = MCRC32::SIZE + MAX_DB_QUEST_ITEM_SIZE + MAX_DB_MONSTERBIBLE_SIZE;
 	static_assert(QUEST_DATA >= ActualQuestDataSize, "Invalid constants");
 
@@ -1249,7 +1790,7 @@ try
 
 	memcpy(QuestData, &CRC32, MCRC32::CRC::SIZE);
 
-	ExecuteSQL("UPDATE Character SET QuestItemInfo = ? WHERE CID = ?",
+	ExecuteSQL(StatementID::UpdateQuestItemInfo,
 		Blob{ QuestData, ActualQuestDataSize }, nCID);
 
 	ASSERT_ROWS_MODIFIED_NOT_ZERO();
@@ -1265,13 +1806,14 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::GetCharQuestItemInfo(MMatchCharInfo * pCharInfo)
 try
 {
+	DB_PROFILE_METHOD();
 	if (!pCharInfo)
 		return false;
 
 	pCharInfo->m_QuestItemList.Clear();
 	pCharInfo->m_QMonsterBible.Clear();
 
-	auto stmt = ExecuteSQL("SELECT QuestItemInfo FROM Character WHERE CID = ?",
+	auto stmt = ExecuteSQL(StatementID::GetQuestItemInfo,
 		pCharInfo->m_nCID);
 	
 	if (!stmt.HasRow())
@@ -1353,11 +1895,13 @@ catch (const SQLiteError& e)
 
 bool SQLiteDatabase::InsertQuestGameLog(const char * pszStageName, int nScenarioID, int nMasterCID, int nPlayer1, int nPlayer2, int nPlayer3, int nTotalRewardQItemCount, int nElapsedPlayTime, int & outQGLID)
 {
+	DB_PROFILE_METHOD();
 	return true;
 }
 
 bool SQLiteDatabase::InsertQUniqueGameLog(int nQGLID, int nCID, int nQIID)
 {
+	DB_PROFILE_METHOD();
 	// TODO: Implement
 
 	return true;
@@ -1365,6 +1909,7 @@ bool SQLiteDatabase::InsertQUniqueGameLog(int nQGLID, int nCID, int nQIID)
 
 bool SQLiteDatabase::InsertConnLog(int nAID, const char * szIP, const std::string & strCountryCode3)
 {
+	DB_PROFILE_METHOD();
 	// TODO: Implement
 
 	return true;
@@ -1372,6 +1917,7 @@ bool SQLiteDatabase::InsertConnLog(int nAID, const char * szIP, const std::strin
 
 bool SQLiteDatabase::InsertGameLog(const char * szGameName, const char * szMap, const char * GameType, int nRound, unsigned int nMasterCID, int nPlayerCount, const char * szPlayers)
 {
+	DB_PROFILE_METHOD();
 	// TODO: Implement
 
 	return true;
@@ -1379,6 +1925,7 @@ bool SQLiteDatabase::InsertGameLog(const char * szGameName, const char * szMap,
 
 bool SQLiteDatabase::InsertKillLog(unsigned int nAttackerCID, unsigned int nVictimCID)
 {
+	DB_PROFILE_METHOD();
 	// TODO: Implement
 
 	return true;
@@ -1386,6 +1933,7 @@ bool SQLiteDatabase::InsertKillLog(unsigned int nAttackerCID, unsigned int nVict
 
 bool SQLiteDatabase::InsertChatLog(u32 nCID, const char * szMsg, u64 nTime)
 {
+	DB_PROFILE_METHOD();
 	// TODO: Implement
 
 	return true;
@@ -1393,6 +1941,7 @@ bool SQLiteDatabase::InsertChatLog(u32 nCID, const char * szMsg, u64 nTime)
 
 bool SQLiteDatabase::InsertServerLog(int nServerID, int nPlayerCount, int nGameCount, uint32_t dwBlockCount, uint32_t dwNonBlockCount)
 {
+	DB_PROFILE_METHOD();
 	// TODO: Implement
 
 	return true;
@@ -1400,6 +1949,7 @@ bool SQLiteDatabase::InsertServerLog(int nServerID, int nPlayerCount, int nGameC
 
 bool SQLiteDatabase::InsertPlayerLog(u32 nCID, int nPlayTime, int nKillCount, int nDeathCount, int nXP, int nTotalXP)
 {
+	DB_PROFILE_METHOD();
 	// TODO: Implement
 
 	return true;
@@ -1408,7 +1958,8 @@ bool SQLiteDatabase::InsertPlayerLog(u32 nCID, int nPlayTime, int nKillCount, in
 bool SQLiteDatabase::UpdateCharPlayTime(u32 CID, u32 PlayTime)
 try
 {
-	ExecuteSQL("UPDATE Character SET PlayTime = PlayTime + ?, LastTime = date('now') WHERE CID = ?", CID);
+	DB_PROFILE_METHOD();
+	ExecuteSQL(StatementID::UpdateCharPlayTime, PlayTime, CID);
 	return true;
 }
 catch (const SQLiteError& e)
@@ -1420,8 +1971,8 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::BringAccountItem(int AID, int CID, int AIID, unsigned int * outCIID, u32 * outItemID, bool * outIsRentItem, int * outRentMinutePeriodRemainder)
 try
 {
-	auto stmt = ExecuteSQL("SELECT ItemID, RentDate, RentHourPeriod, Cnt "
-		"FROM AccountItem WHERE AIID = ?", AIID);
+	DB_PROFILE_METHOD();
+	auto stmt = ExecuteSQL(StatementID::GetAccountItem, AIID);
 	if (!stmt.HasRow())
 		return false;
 
@@ -1432,10 +1983,9 @@ try
 
 	auto Trans = BeginTransaction();
 
-	ExecuteSQL("DELETE FROM AccountItem WHERE AIID = ?", AIID);
+	ExecuteSQL(StatementID::DeleteAccountItem, AIID);
 
-	ExecuteSQL("INSERT INTO CharacterItem(CID, ItemID, RegDate, RentDate, RentHourPeriod, Cnt) "
-		"VALUES(?, ?, date('now'), ?, ?, ?)",
+	ExecuteSQL(StatementID::InsertCharItemFromAccountItem,
 		CID, ItemID, RentDate, RentHourPeriod, Cnt);
 
 
@@ -1453,12 +2003,12 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::BringBackAccountItem(int AID, int CID, int CIID)
 try
 {
+	DB_PROFILE_METHOD();
 	auto Trans = BeginTransaction();
 
 	// TODO: Check that the item isn't equipped
 
-	auto stmt = ExecuteSQL("SELECT ItemID, RentDate, @RentHourPeriod=RentHourPeriod, Cnt "
-		"FROM CharacterItem WHERE CIID = ? AND CID = ?", CIID, CID);
+	auto stmt = ExecuteSQL(StatementID::GetCharItemForAccountItem, CIID, CID);
 
 	if (!stmt.HasRow())
 		return false;
@@ -1468,10 +2018,9 @@ try
 	auto RentHourPeriod = stmt.Get<int>();
 	auto Cnt = stmt.Get<int>();
 
-	ExecuteSQL("UPDATE CharacterItem SET CID = NULL WHERE CIID = ? AND CID = ?", CIID, CID);
+	ExecuteSQL(StatementID::DeleteCharItem, CID, CIID);
 
-	ExecuteSQL("INSERT INTO AccountItem(AID, ItemID, RentDate, RentHourPeriod, Cnt) "
-		"VALUES(?, ?, ?, ?, ?)",
+	ExecuteSQL(StatementID::InsertAccountItem,
 		AID, ItemID, RentDate, RentHourPeriod, Cnt);
 
 	CommitTransaction();
@@ -1486,8 +2035,8 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::FriendAdd(int CID, int FriendCID, int Favorite)
 try
 {
-	ExecuteSQL("INSERT INTO Friend(CID, FriendCID, Favorite, DeleteFlag, Type) "
-		"Values (?, ?, ?, 0, 1)",
+	DB_PROFILE_METHOD();
+	ExecuteSQL(StatementID::FriendAdd,
 		CID, FriendCID, Favorite);
 
 	return true;
@@ -1501,9 +2050,8 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::FriendRemove(int CID, int FriendCID)
 try
 {
-	ExecuteSQL("UPDATE Friend "
-		"SET DeleteFlag = 1 "
-		"WHERE CID = ? AND FriendCID = ?",
+	DB_PROFILE_METHOD();
+	ExecuteSQL(StatementID::FriendRemove,
 		CID, FriendCID);
 
 	return true;
@@ -1517,9 +2065,8 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::FriendGetList(int CID, MMatchFriendInfo * FriendInfo)
 try
 {
-	auto stmt = ExecuteSQL("SELECT f.FriendCID, f.Favorite, c.Name "
-		"FROM Friend f, Character c "
-		"WHERE f.CID = ? AND f.FriendCID = c.CID AND f.DeleteFlag = 0 AND f.Type = 1",
+	DB_PROFILE_METHOD();
+	auto stmt = ExecuteSQL(StatementID::FriendGetList,
 		CID);
 
 	while (stmt.HasRow())
@@ -1542,9 +2089,8 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::GetCharClan(int CID, int * outClanID, char * outClanName, int maxlen)
 try
 {
-	auto stmt = ExecuteSQL("SELECT cl.CLID AS CLID, cl.Name AS ClanName "
-		"FROM ClanMember cm, Clan cl "
-		"WHERE cm.cid = ? AND cm.CLID = cl.CLID",
+	DB_PROFILE_METHOD();
+	auto stmt = ExecuteSQL(StatementID::GetCharClan,
 		CID);
 
 	if (!stmt.HasRow())
@@ -1564,7 +2110,8 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::GetClanIDFromName(const char * ClanName, int * outCLID)
 try
 {
-	auto stmt = ExecuteSQL("SELECT CLID FROM Clan WHERE Name = ?", ClanName);
+	DB_PROFILE_METHOD();
+	auto stmt = ExecuteSQL(StatementID::GetCLIDByName, ClanName);
 
 	if (!stmt.HasRow())
 		return false;
@@ -1582,43 +2129,37 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::CreateClan(const char * ClanName, int MasterCID, int Member1CID, int Member2CID, int Member3CID, int Member4CID, bool * outRet, int * outNewCLID)
 try
 {
+	DB_PROFILE_METHOD();
 	*outRet = false;
 	
-	auto stmt = ExecuteSQL("SELECT CLID FROM Clan WHERE Name = ?",
+	auto stmt = ExecuteSQL(StatementID::GetCLIDByName,
 		ClanName);
 
 	if (stmt.HasRow())
 		return false;
 
-	stmt = ExecuteSQL("SELECT COUNT(*) FROM ClanMember cm, Character c "
-		"WHERE((cm.CID = ?) OR(cm.CID = ?) OR(cm.CID = ?) OR(cm.CID = ?) OR "
-		"(cm.CID = ?)) AND cm.CID = c.CID AND c.DeleteFlag = 0",
+	stmt = ExecuteSQL(StatementID::CountClanMembershipsOf5,
 		MasterCID, Member1CID, Member2CID, Member3CID, Member4CID);
 
-	if (stmt.HasRow())
+	if (!stmt.HasRow() || stmt.Get<int>() > 0)
 		return false;
 
 	auto Trans = BeginTransaction();
 
-	ExecuteSQL("INSERT INTO Clan(Name, MasterCID, RegDate) VALUES(?, ?, date('now'))",
+	ExecuteSQL(StatementID::InsertClan,
 		ClanName, MasterCID);
 
-	stmt = ExecuteSQL("SELECT CLID FROM Clan WHERE MasterCID = ?",
-		MasterCID);
-
-	if (!stmt.HasRow())
-		return false;
-
-	auto CLID = stmt.Get<int>();
+	// CLID is the rowid of the Clan table.
+	auto CLID = static_cast<int>(LastInsertedRowID());
 
-	ExecuteSQL("INSERT INTO ClanMember(CLID, CID, Grade, RegDate) VALUES(?, ?, 1, date('now'))",
-		CLID, MasterCID);
+	ExecuteSQL(StatementID::InsertClanMember,
+		CLID, MasterCID, int(MCG_MASTER));
 
 	int MemberCIDs[] = { Member1CID, Member2CID, Member3CID, Member4CID };
 
 	for (auto CID : MemberCIDs)
-		ExecuteSQL("INSERT INTO ClanMember(CLID, CID, Grade, RegDate) VALUES(?, ?, 9, date('now'))",
-			CLID, CID);
+		ExecuteSQL(StatementID::InsertClanMember,
+			CLID, CID, int(MCG_MEMBER));
 
 	CommitTransaction();
 
@@ -1636,16 +2177,16 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::CreateClan(const char * ClanName, int MasterCID, bool * outRet, int * outNewCLID)
 try
 {
+	DB_PROFILE_METHOD();
 	*outRet = false;
 
-	auto stmt = ExecuteSQL("SELECT CLID FROM Clan WHERE Name = ?",
+	auto stmt = ExecuteSQL(StatementID::GetCLIDByName,
 		ClanName);
 
 	if (stmt.HasRow())
 		return false;
 
-	stmt = ExecuteSQL("SELECT COUNT(*) FROM ClanMember cm, Character c "
-		"WHERE cm.CID = ? AND cm.CID = c.CID AND c.DeleteFlag = 0",
+	stmt = ExecuteSQL(StatementID::CountClanMemberships,
 		MasterCID);
 
 	if (!stmt.HasRow() || stmt.Get<int>() > 0)
@@ -1653,25 +2194,14 @@ try
 
 	auto Trans = BeginTransaction();
 
-	ExecuteSQL("INSERT INTO Clan(Name, MasterCID, RegDate, Exp, Level, Point, Wins, Losses, "
-		"Draws, Ranking, TotalPoint, RankIncrease, EmblemChecksum, LastDayRanking, "
-		"LastMonthRanking, EmblemUrl) "
-		"VALUES(?, ?, date('now'), 0, 0, 0, 0, 0, "
-		"0, 0, 0, 0, 0, 0, "
-		"0, '')",
+	ExecuteSQL(StatementID::InsertClan,
 		ClanName, MasterCID);
 
-	stmt = ExecuteSQL("SELECT CLID FROM Clan WHERE MasterCID = ?",
-		MasterCID);
+	// CLID is the rowid of the Clan table.
+	auto CLID = static_cast<int>(LastInsertedRowID());
 
-	if (!stmt.HasRow())
-		return false;
-
-	auto CLID = stmt.Get<int>();
-
-	ExecuteSQL("INSERT INTO ClanMember(CLID, CID, Grade, RegDate, ContPoint) "
-		"VALUES(?, ?, 1, date('now'), 0)",
-		CLID, MasterCID);
+	ExecuteSQL(StatementID::InsertClanMember,
+		CLID, MasterCID, int(MCG_MASTER));
 
 	CommitTransaction();
 
@@ -1689,6 +2219,7 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::DeleteExpiredClan(uint32_t dwCID, uint32_t dwCLID, const std::string & strDeleteName, uint32_t dwWaitHour)
 try
 {
+	DB_PROFILE_METHOD();
 	// Unimplemented in MSSQL
 
 	return true;
@@ -1702,6 +2233,7 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::SetDeleteTime(uint32_t dwMasterCID, uint32_t dwCLID, const std::string & strDeleteDate)
 try
 {
+	DB_PROFILE_METHOD();
 	// Unimplemented in MSSQL
 
 	return true;
@@ -1715,7 +2247,8 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::ReserveCloseClan(int CLID, const char * ClanName, int MasterCID, const std::string & strDeleteDate)
 try
 {
-	ExecuteSQL("UPDATE Clan SET DeleteFlag = 2 WHERE CLID = ? AND Name = ? AND MasterCID = ?",
+	DB_PROFILE_METHOD();
+	ExecuteSQL(StatementID::ReserveCloseClan,
 		CLID, ClanName, MasterCID);
 	return true;
 }
@@ -1728,12 +2261,12 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::CloseClan(int CLID, const char * ClanName, int MasterCID)
 try
 {
+	DB_PROFILE_METHOD();
 	auto Trans = BeginTransaction();
 
-	ExecuteSQL("DELETE FROM ClanMember WHERE CLID = ?", CLID);
+	ExecuteSQL(StatementID::DeleteAllClanMembers, CLID);
 
-	ExecuteSQL("UPDATE Clan SET DeleteFlag = 1, MasterCID = NULL, DeleteName = ?, Name = NULL "
-		"WHERE CLID = ? AND Name = ? AND MasterCID = ?",
+	ExecuteSQL(StatementID::CloseClan,
 		ClanName, CLID, ClanName, MasterCID);
 
 	CommitTransaction();
@@ -1749,7 +2282,8 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::AddClanMember(int CLID, int JoinerCID, int ClanGrade, bool * outRet)
 try
 {
-	ExecuteSQL("INSERT INTO ClanMember(CLID, CID, Grade, RegDate, ContPoint) VALUES(?, ?, ?, date('now'), 0)",
+	DB_PROFILE_METHOD();
+	ExecuteSQL(StatementID::InsertClanMember,
 		CLID, JoinerCID, ClanGrade);
 	*outRet = true;
 	return true;
@@ -1763,7 +2297,8 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::RemoveClanMember(int CLID, int LeaverCID)
 try
 {
-	ExecuteSQL("DELETE FROM ClanMember WHERE CLID = ? AND CID = ? AND Grade != 1", CLID, LeaverCID);
+	DB_PROFILE_METHOD();
+	ExecuteSQL(StatementID::RemoveClanMember, CLID, LeaverCID);
 
 	return true;
 }
@@ -1776,7 +2311,8 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::UpdateClanGrade(int CLID, int MemberCID, int ClanGrade)
 try
 {
-	ExecuteSQL("UPDATE ClanMember SET Grade = ? WHERE CLID = ? AND CID = ?", ClanGrade, CLID, MemberCID);
+	DB_PROFILE_METHOD();
+	ExecuteSQL(StatementID::UpdateClanGrade, ClanGrade, CLID, MemberCID);
 	return true;
 }
 catch (const SQLiteError& e)
@@ -1788,8 +2324,8 @@ catch (const SQLiteError& e)
 ExpelResult SQLiteDatabase::ExpelClanMember(int CLID, int AdminGrade, const char * MemberName)
 try
 {
-	auto stmt = ExecuteSQL("SELECT c.cid, cm.Grade FROM Character c, ClanMember cm "
-		"WHERE cm.clid = ? AND c.cid = cm.cid AND c.Name = ? AND DeleteFlag = 0",
+	DB_PROFILE_METHOD();
+	auto stmt = ExecuteSQL(StatementID::GetClanMemberByName,
 		CLID, MemberName);
 
 	if (!stmt.HasRow())
@@ -1804,7 +2340,7 @@ try
 	if (AdminGrade >= Grade)
 		return ExpelResult::TooLowGrade;
 
-	ExecuteSQL("DELETE FROM ClanMember WHERE CLID = ? AND CID = ? AND Grade != 1", CLID, CID);
+	ExecuteSQL(StatementID::RemoveClanMember, CLID, CID);
 
 	return ExpelResult::OK;
 }
@@ -1817,14 +2353,8 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::GetClanInfo(int CLID, MDB_ClanInfo * outClanInfo)
 try
 {
-	auto stmt = ExecuteSQL("SELECT cl.Name AS Name, cl.TotalPoint AS TotalPoint, "
-		"cl.Level AS Level, cl.Ranking AS Ranking, "
-		"cl.Point AS Point, cl.Wins AS Wins, cl.Losses AS Losses, cl.Draws AS Draws, "
-		"c.Name AS ClanMaster, "
-		"(SELECT COUNT(*) FROM ClanMember WHERE CLID = ?1) AS MemberCount, "
-		"cl.EmblemUrl AS EmblemUrl, cl.EmblemChecksum AS EmblemChecksum "
-		"FROM Clan cl, Character c "
-		"WHERE cl.CLID = ?1 and cl.MasterCID = c.CID",
+	DB_PROFILE_METHOD();
+	auto stmt = ExecuteSQL(StatementID::GetClanInfo,
 		CLID);
 
 	if (!stmt.HasRow())
@@ -1855,7 +2385,8 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::UpdateCharClanContPoint(int CID, int CLID, int AddedContPoint)
 try
 {
-	ExecuteSQL("UPDATE ClanMember SET ContPoint = ContPoint + ? WHERE CID = ? AND CLID = ?",
+	DB_PROFILE_METHOD();
+	ExecuteSQL(StatementID::UpdateCharClanContPoint,
 		AddedContPoint, CID, CLID);
 
 	return true;
@@ -1869,6 +2400,7 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::GetLadderTeamID(const int nTeamTableIndex, const int * pnMemberCIDArray, int nMemberCount, int * pnoutTID)
 try
 {
+	DB_PROFILE_METHOD();
 	// Unimplemented in MSSQL
 
 	return false;
@@ -1882,6 +2414,7 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::LadderTeamWinTheGame(int nTeamTableIndex, int nWinnerTID, int nLoserTID, bool bIsDrawGame, int nWinnerPoint, int nLoserPoint, int nDrawPoint)
 try
 {
+	DB_PROFILE_METHOD();
 	// Unimplemented in MSSQL
 
 	return false;
@@ -1895,6 +2428,7 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::GetLadderTeamMemberByCID(const int nCID, int * poutTeamID, char ** ppoutCharArray, int maxlen, int nCount)
 try
 {
+	DB_PROFILE_METHOD();
 	// Unimplemented in MSSQL
 
 	return false;
@@ -1910,20 +2444,16 @@ bool SQLiteDatabase::WinTheClanGame(int WinnerCLID, int LoserCLID, bool IsDrawGa
 	int GameType, const char * WinnerMembers, const char * LoserMembers)
 	try
 {
+	DB_PROFILE_METHOD();
 	if (IsDrawGame)
 		return true;
 
 	auto Trans = BeginTransaction();
 
-	ExecuteSQL("UPDATE Clan SET Wins = Wins + 1, Point = Point + ?1, TotalPoint = TotalPoint + ?1 "
-		"WHERE CLID = ?2", WinnerPoint, WinnerCLID);
-	ExecuteSQL("UPDATE Clan SET Losses = Losses + 1, Point = max(0, Point + ?) WHERE CLID = ?",
+	ExecuteSQL(StatementID::AddClanWin, WinnerPoint, WinnerCLID);
+	ExecuteSQL(StatementID::AddClanLoss,
 		LoserPoint, LoserCLID);
-	ExecuteSQL("INSERT INTO ClanGameLog(WinnerCLID, LoserCLID, WinnerClanName, LoserClanName, "
-		"RoundWins, RoundLosses, "
-		"MapID, GameType, RegDate, WinnerMembers, LoserMembers, WinnerPoint, LoserPoint) "
-		"VALUES(?, ?, ?, ?, ?, ?, "
-		"?, ?, date('now'), ?, ?, ?, ?)",
+	ExecuteSQL(StatementID::InsertClanGameLog,
 		WinnerCLID, LoserCLID, WinnerClanName, LoserClanName, RoundWins, RoundLosses,
 		MapID, GameType, WinnerMembers, LoserMembers, WinnerPoint, LoserPoint);
 
@@ -1939,7 +2469,8 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::UpdateCharLevel(int CID, int NewLevel, int BP, int KillCount, int DeathCount, int PlayTime, bool IsLevelUp)
 try
 {
-	ExecuteSQL("UPDATE Character SET Level = ? WHERE CID = ?", NewLevel, CID);
+	DB_PROFILE_METHOD();
+	ExecuteSQL(StatementID::UpdateCharLevel, NewLevel, CID);
 	return true;
 }
 catch (const SQLiteError& e)
@@ -1951,8 +2482,9 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::EventJjangUpdate(int AID, bool Jjang)
 try
 {
+	DB_PROFILE_METHOD();
 	auto UGradeID = Jjang ? MMUG_STAR : MMUG_FREE;
-	ExecuteSQL("UPDATE Account SET UGradeID = ? WHERE AID = ?", UGradeID, AID);
+	ExecuteSQL(StatementID::UpdateUGradeID, UGradeID, AID);
 	return true;
 }
 catch (const SQLiteError& e)
@@ -1964,6 +2496,7 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::CheckPremiumIP(const char * szIP, bool & outbResult)
 try
 {
+	DB_PROFILE_METHOD();
 	// Unimplemented in MSSQL
 
 	return true;
@@ -1977,7 +2510,8 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::GetCID(const char * CharName, int & outCID)
 try
 {
-	auto stmt = ExecuteSQL("SELECT CID FROM Character WHERE Name = ?", CharName);
+	DB_PROFILE_METHOD();
+	auto stmt = ExecuteSQL(StatementID::GetCIDByName, CharName);
 
 	if (!stmt.HasRow())
 		return false;
@@ -1995,7 +2529,8 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::GetCharName(int CID, std::string & outCharName)
 try
 {
-	auto stmt = ExecuteSQL("SELECT Name FROM Character WHERE CID = ?", CID);
+	DB_PROFILE_METHOD();
+	auto stmt = ExecuteSQL(StatementID::GetCharName, CID);
 
 	if (!stmt.HasRow() || stmt.IsNull())
 		return false;
@@ -2013,6 +2548,7 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::InsertEvent(uint32_t dwAID, uint32_t dwCID, const std::string & strEventName)
 try
 {
+	DB_PROFILE_METHOD();
 	return true;
 }
 catch (const SQLiteError& e)
@@ -2024,6 +2560,7 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::SetBlockAccount(uint32_t dwAID, uint32_t dwCID, uint8_t btBlockType, const std::string & strComment, const std::string & strIP, const std::string & strEndHackBlockerDate)
 try
 {
+	DB_PROFILE_METHOD();
 	return true;
 }
 catch (const SQLiteError& e)
@@ -2035,6 +2572,7 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::ResetAccountBlock(uint32_t dwAID, uint8_t btBlockType)
 try
 {
+	DB_PROFILE_METHOD();
 	return true;
 }
 catch (const SQLiteError& e)
@@ -2046,6 +2584,7 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::InsertBlockLog(uint32_t dwAID, uint32_t dwCID, uint8_t btBlockType, const std::string & strComment, const std::string & strIP)
 try
 {
+	DB_PROFILE_METHOD();
 	return true;
 }
 catch (const SQLiteError& e)
@@ -2057,6 +2596,7 @@ catch (const SQLiteError& e)
 bool SQLiteDatabase::AdminResetAllHackingBlock()
 try
 {
+	DB_PROFILE_METHOD();
 	return true;
 }
 catch (const SQLiteError& e)
@@ -3,12 +3,13 @@
 #include <utility>
 #include <stdexcept>
 #include <string>
-#include <unordered_map>
+#include <vector>
 #include <memory>
 #include "IDatabase.h"
 #include "sqlite3.h"
 
 class SQLiteStatement;
+enum class SQLiteStatementID;
 
 class SQLiteDatabase final : public IDatabase
 {
@@ -108,11 +109,14 @@ public:
 		int nElapsedPlayTime,
 		int& outQGLID) override;
 	virtual bool InsertQUniqueGameLog(int nQGLID, int nCID, int nQIID) override;
+	// The log tables aren't implemented, so there's nothing to date.
+	virtual void SetLogTime(u64 UnixTime) override {}
 	virtual bool InsertConnLog(int nAID, const char* szIP, const std::string& strCountryCode3) override;
 	virtual bool InsertGameLog(const char* szGameName, const char* szMap, const char* GameType,
 		int nRound, unsigned int nMasterCID,
 		int nPlayerCount, const char* szPlayers) override;
 	virtual bool InsertKillLog(unsigned int nAttackerCID, unsigned int nVictimCID) override;
+	virtual bool InsertKillLogs(ArrayView<const KillLogRow> Rows) override { return true; }
 	virtual bool InsertChatLog(u32 nCID, const char* szMsg, u64 nTime) override;
 	virtual bool InsertServerLog(int nServerID, int nPlayerCount, int nGameCount,
 		uint32_t dwBlockCount, uint32_t dwNonBlockCount) override;
@@ -236,14 +240,20 @@ private:
 	using SQLitePtr = unique_ptr_deleter<sqlite3, sqlite3_close>;
 	using SQLiteStatementPtr = unique_ptr_deleter<sqlite3_stmt, sqlite3_finalize>;
 
-	template <size_t size>
-	SQLiteStatementPtr PrepareStatement(const char(&sql)[size]);
+	SQLiteStatementPtr PrepareStatement(const char* sql);
+	// Prepares every statement in the registry. Called once when the database is opened.
+	void PrepareStatements();
 
-	template <size_t size, typename... Args>
-	SQLiteStatement ExecuteSQL(const char(&sql)[size], Args&&... args);
+	template <typename... Args>
+	SQLiteStatement ExecuteSQL(SQLiteStatementID ID, Args&&... args);
 
 	void HandleException(const class SQLiteError& e);
 
+	// Applies a change to the character's items, made earlier in the current transaction, to
+	// its inventory blob, so that the next load doesn't have to rebuild it from the rows.
+	template <typename Fn>
+	void PatchInventory(u32 CID, Fn&& Patch);
+
 	class Transaction
 	{
 	public:
@@ -285,5 +295,6 @@ private:
 	bool InTransaction = false;
 
 	SQLitePtr sqlite;
-	std::unordered_map<const char*, SQLiteStatementPtr> PreparedStatements;
+	// Indexed by SQLiteStatementID.
+	std::vector<SQLiteStatementPtr> PreparedStatements;
 };
\ No newline at end of file
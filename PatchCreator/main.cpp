@@ -6,12 +6,19 @@
 #include "Hash.h"
 #include "Log.h"
 #include "Sync.h"
+#include "FileCache.h"
 
 #include "rapidxml.hpp"
 #include "rapidxml_print.hpp"
 
 #include "sodium.h"
 
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
 static bool ExcludeFile(const StringView& Path)
 {
 	return iequals(Path, "PatchCreator.exe") ||
@@ -108,51 +115,31 @@ static u64 TryGetFileSize(const char* Path)
 	return MaybeAttributes.value().Size;
 }
 
-static void AppendFile(rapidxml::xml_document<>& doc,
-	rapidxml::xml_node<>& ParentNode,
-	PathPair& Paths,
-	const StringView& Filename)
+// A file in the client directory that goes into the patch.
+struct PatchFile
 {
-	if (ExcludeFile(Filename))
-		return;
-
-	const auto End = Paths.AppendFile(Filename);
-	DEFER([&] { Paths.Revert(End); });
-
-	char HashString[Hash::Strong::MinimumStringSize];
-
-	if (!TryHashFile(HashString, Paths.CWD()))
-		return;
-
-	u64 FileSize = TryGetFileSize(Paths.CWD());
-	if (FileSize == u64(-1))
-		return;
-
-	// allocate_node can never return null.
-	auto&& node = *doc.allocate_node(rapidxml::node_element, "file");
-	AppendAttribute(doc, node, "name", AllocateString(doc, Paths.Base()));
-	AppendAttribute(doc, node, "size", FileSize);
-	AppendAttribute(doc, node, "hash", AllocateString(doc, HashString));
-	ParentNode.append_node(&node);
-
-	Log(LogLevel::Info, "Hashed file %s (size: %llu) -> %s\n",
-		Paths.Base(), FileSize, HashString);
-
-	// Make the .sync file.
-	char SyncFilename[16 * 1024];
-	sprintf_safe(SyncFilename, "sync/%s.sync", Paths.Base());
+	// Relative to the current working directory.
+	std::string Path;
+	// Path.c_str() + BaseOffset is relative to the base directory.
+	size_t BaseOffset;
+	u64 Size;
+	char Hash[Hash::Strong::MinimumStringSize];
+	// Set if the hash is known, either from the cache or from hashing the file.
+	bool Hashed = false;
+	// Set if the hash was taken from the cache.
+	bool Cached = false;
+	// Set if the file was hashed and its .sync file was written, so it can go into the cache.
+	bool Synced = false;
+
+	const char* Base() const { return Path.c_str() + BaseOffset; }
+};
 
-	const auto Success = Sync::MakeSyncFile(SyncFilename, Paths.CWD());
-	if (!Success)
-	{
-		Log(LogLevel::Error, "Failed to create sync file %s -> %s\n",
-			Paths.CWD(), SyncFilename);
-	}
+static void MakeSyncFilename(ArrayView<char> Output, const PatchFile& File)
+{
+	sprintf_safe(Output, "sync/%s.sync", File.Base());
 }
 
-static bool AppendFileNodes(rapidxml::xml_document<>& doc,
-	rapidxml::xml_node<>& ParentNode,
-	PathPair& Paths)
+static bool CollectFiles(std::vector<PatchFile>& Files, PathPair& Paths)
 {
 	char SearchPattern[MFile::MaxPath];
 	sprintf_safe(SearchPattern, "%s*", Paths.CWD());
@@ -164,12 +151,25 @@ static bool AppendFileNodes(rapidxml::xml_document<>& doc,
 		{
 			// Recurse into the subdirectory.
 			const auto End = Paths.AppendDir(FileData.Name);
-			AppendFileNodes(doc, ParentNode, Paths);
+			CollectFiles(Files, Paths);
 			Paths.Revert(End);
 			continue;
 		}
 
-		AppendFile(doc, ParentNode, Paths, FileData.Name);
+		if (ExcludeFile(FileData.Name))
+			continue;
+
+		const auto End = Paths.AppendFile(FileData.Name);
+		DEFER([&] { Paths.Revert(End); });
+
+		PatchFile File;
+		File.Path = Paths.CWD();
+		File.BaseOffset = Paths.Base() - Paths.CWD();
+		File.Size = TryGetFileSize(Paths.CWD());
+		if (File.Size == u64(-1))
+			continue;
+
+		Files.push_back(std::move(File));
 	}
 	if (Range.error())
 	{
@@ -183,6 +183,104 @@ static bool AppendFileNodes(rapidxml::xml_document<>& doc,
 	return true;
 }
 
+// Takes the hashes of files that haven't changed since the last run from the cache, as long as
+// their .sync files are still there.
+static void LoadCachedHashes(std::vector<PatchFile>& Files, const FileCacheType& Cache)
+{
+	for (auto&& File : Files)
+	{
+		const auto Cached = Cache.GetCachedFileData(File.Path.c_str());
+		if (Cached.Result != FileQueryResult::Found)
+			continue;
+
+		char SyncFilename[16 * 1024];
+		MakeSyncFilename(SyncFilename, File);
+		if (!MFile::Exists(SyncFilename))
+			continue;
+
+		strcpy_safe(File.Hash, Cached.FileData.Hash);
+		File.Hashed = true;
+		File.Cached = true;
+	}
+}
+
+// Hashes a file and writes its .sync file, reading the file once for both.
+static void HashFile(PatchFile& File, Sync::Format SyncFormat)
+{
+	char SyncFilename[16 * 1024];
+	MakeSyncFilename(SyncFilename, File);
+
+	Hash::Strong Hash;
+	if (Sync::MakeSyncFile(SyncFilename, File.Path.c_str(), &Hash, SyncFormat))
+	{
+		Hash.ToString(File.Hash);
+		File.Hashed = true;
+		File.Synced = true;
+		return;
+	}
+
+	Log(LogLevel::Error, "Failed to create sync file %s -> %s\n",
+		File.Path.c_str(), SyncFilename);
+
+	// The file still goes into the patch without a .sync file, like before.
+	File.Hashed = TryHashFile(File.Hash, File.Path.c_str());
+}
+
+// Hashes every file that wasn't in the cache on one thread per core.
+static void HashFiles(std::vector<PatchFile>& Files, Sync::Format SyncFormat)
+{
+	std::vector<PatchFile*> Uncached;
+	for (auto&& File : Files)
+		if (!File.Hashed)
+			Uncached.push_back(&File);
+
+	const auto ThreadCount = int(std::min(size_t(std::max(1u, std::thread::hardware_concurrency())),
+		std::max(Uncached.size(), size_t(1))));
+
+	Log(LogLevel::Info, "Hashing %zu files on %d threads, %zu unchanged files were cached\n",
+		Uncached.size(), ThreadCount, Files.size() - Uncached.size());
+
+	std::atomic<size_t> NextFile{0};
+	auto Worker = [&] {
+		while (true)
+		{
+			const auto Index = NextFile++;
+			if (Index >= Uncached.size())
+				break;
+
+			HashFile(*Uncached[Index], SyncFormat);
+		}
+	};
+
+	std::vector<std::thread> Threads;
+	for (int i = 1; i < ThreadCount; ++i)
+		Threads.emplace_back(Worker);
+	Worker();
+	for (auto&& Thread : Threads)
+		Thread.join();
+}
+
+static void AppendFileNodes(rapidxml::xml_document<>& doc,
+	rapidxml::xml_node<>& ParentNode,
+	const std::vector<PatchFile>& Files)
+{
+	for (auto&& File : Files)
+	{
+		if (!File.Hashed)
+			continue;
+
+		// allocate_node can never return null.
+		auto&& node = *doc.allocate_node(rapidxml::node_element, "file");
+		AppendAttribute(doc, node, "name", AllocateString(doc, File.Base()));
+		AppendAttribute(doc, node, "size", File.Size);
+		AppendAttribute(doc, node, "hash", AllocateString(doc, File.Hash));
+		ParentNode.append_node(&node);
+
+		Log(LogLevel::Info, "%s file %s (size: %llu) -> %s\n",
+			File.Cached ? "Cached" : "Hashed", File.Base(), File.Size, File.Hash);
+	}
+}
+
 static bool SaveDocumentToFile(rapidxml::xml_document<>& doc, const char* Filename)
 {
 	MFile::RWFile File{ Filename, MFile::Clear};
@@ -204,16 +302,49 @@ static bool SaveDocumentToFile(rapidxml::xml_document<>& doc, const char* Filena
 	return true;
 }
 
-int main()
+int main(int argc, char** argv)
 {
 	Log.Init("", LogTo::Stdout);
 
+	// --chunked writes .sync files in the content-defined chunk format instead of the block one.
+	auto SyncFormat = Sync::Format::Blocks;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "--chunked"))
+		{
+			SyncFormat = Sync::Format::Chunks;
+		}
+		else
+		{
+			Log(LogLevel::Fatal, "Unknown argument %s\n", argv[i]);
+			return -1;
+		}
+	}
+
+	std::vector<PatchFile> Files;
+	PathPair Paths{ "client/" };
+	if (!CollectFiles(Files, Paths))
+		return -1;
+
+	// Each format has its own cache, so that switching formats rewrites every .sync file.
+	const auto Chunked = SyncFormat == Sync::Format::Chunks;
+	FileCacheType Cache{ Chunked ? "patch_cache_chunked.bin" : "patch_cache.bin",
+		Chunked ? "patch_cache_chunked.xml" : "patch_cache.xml" };
+	Cache.Load();
+	LoadCachedHashes(Files, Cache);
+
+	HashFiles(Files, SyncFormat);
+
+	for (auto&& File : Files)
+		if (File.Synced)
+			Cache.Add(File.Path.c_str(), File.Hash);
+	Cache.Save();
+
 	rapidxml::xml_document<> doc;
 
 	auto&& FilesNode = AppendNode(doc, doc, "files");
+	AppendFileNodes(doc, FilesNode, Files);
 
-	PathPair Paths{ "client/" };
-	if (!AppendFileNodes(doc, FilesNode, Paths) ||
-	    !SaveDocumentToFile(doc, "patch.xml"))
+	if (!SaveDocumentToFile(doc, "patch.xml"))
 		return -1;
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <mutex>
 #include "RAnimation.h"
 
 _NAMESPACE_REALSPACE2_BEGIN
@@ -26,6 +27,10 @@ public:
 	RAnimationFile* Get(const char* filename);
 
 	RAnimationFileHashList m_list;
+
+private:
+	// Guards m_list in Add, which may be called from several threads.
+	std::mutex Mutex;
 };
 
 inline RAnimationFileMgr* RGetAnimationFileMgr() { return RAnimationFileMgr::GetInstance(); }
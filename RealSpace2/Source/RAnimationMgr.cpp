@@ -32,19 +32,29 @@ RAnimationFileMgr* RAnimationFileMgr::GetInstance()
 
 RAnimationFile* RAnimationFileMgr::Add(const char* filename)
 {
-	RAnimationFile* pFile = Get(filename);
-
-	if( pFile ) {
-		pFile->AddRef();
-		return pFile;
+	{
+		std::lock_guard<std::mutex> Lock{ Mutex };
+		if (auto pFile = Get(filename)) {
+			pFile->AddRef();
+			return pFile;
+		}
 	}
 
-	pFile = new RAnimationFile;
+	// Loaded outside the lock, so that animation sets can be loaded on several threads at once.
+	auto pFile = new RAnimationFile;
 
 	pFile->LoadAni( filename );
 
 	pFile->SetName(filename);
 
+	std::lock_guard<std::mutex> Lock{ Mutex };
+	if (auto pLoaded = Get(filename)) {
+		// Another thread loaded the same file meanwhile.
+		delete pFile;
+		pLoaded->AddRef();
+		return pLoaded;
+	}
+
 	m_list.PushBack( pFile );
 
 	return pFile;
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vector>
+#include "GlobalTypes.h"
+#include "MSync.h"
+
+class MNetLink;
+
+// Maps MNetLink::GetMapKey to net links.
+//
+// Split into shards that each have their own lock, so that the socket threads and the threads
+// sending to links only wait for each other when they work on links in the same shard. Each shard
+// is an open addressing hash table with linear probing.
+class MNetLinkTable
+{
+public:
+	class Shard
+	{
+	public:
+		// All of these must be called with Mutex locked.
+		MNetLink* Find(i64 Key) const;
+		// Key mustn't be in the shard already.
+		void Insert(i64 Key, MNetLink* Link);
+		// Returns the link that was removed, or null if there was none.
+		MNetLink* Erase(i64 Key);
+		void Clear();
+		size_t size() const { return Count; }
+
+		template <typename F>
+		void ForEach(F&& Func) const {
+			for (auto&& Slot : Slots)
+				if (Slot.Link)
+					Func(Slot.Link);
+		}
+
+		MCriticalSection Mutex;
+
+	private:
+		struct SlotType
+		{
+			i64 Key;
+			MNetLink* Link;
+		};
+
+		size_t GetHome(i64 Key) const { return size_t(Hash(Key)) & (Slots.size() - 1); }
+		bool FindSlot(i64 Key, size_t& Index) const;
+		void Grow();
+
+		std::vector<SlotType> Slots;
+		size_t Count = 0;
+	};
+
+	static constexpr size_t ShardCount = 16;
+
+	Shard& GetShard(i64 Key) { return Shards[Hash(Key) >> 60]; }
+
+	template <typename F>
+	void ForEachShard(F&& Func) {
+		for (auto&& Shard : Shards)
+			Func(Shard);
+	}
+
+	static u64 Hash(i64 Key);
+
+private:
+	static_assert(ShardCount == 16, "GetShard takes the top four bits of the hash");
+
+	Shard Shards[ShardCount];
+};
@@ -17,7 +17,13 @@
 #include "MBasePacket.h"
 #include "MTrafficLog.h"
 #include "MInetUtil.h"
+#include "RingBuffer.h"
+#include "MTimerWheel.h"
+#include "MNetLinkTable.h"
+#include <mutex>
 #include <memory>
+#include <vector>
+#include <atomic>
 
 #ifdef WIN32
 #pragma comment(lib, "ws2_32.lib")
@@ -25,6 +31,10 @@
 
 class MSafeUDP;
 
+#define SAFEUDP_MAX_SENDQUEUE_LENGTH		5120
+#define SAFEUDP_MAX_ACKQUEUE_LENGTH			5120
+#define SAFEUDP_TIMER_TICK					10
+
 // INNER CLASS //////////////////////////////////////////////////////////////////////////
 struct MSendQueueItem {
 	u32 dwIP;
@@ -40,11 +50,28 @@ struct MACKQueueItem {
 };
 
 struct MACKWaitItem {
-	std::unique_ptr<MSafePacket> pPacket;
+	// A copy of the packet, since the one in the send queue is deleted once it's sent.
+	std::unique_ptr<char[]> pPacket;
 	u32 dwPacketSize;
-	MTime::timeval tvFirstSent;
-	MTime::timeval tvLastSent;
+	u64 nFirstSentTime;
 	u8 nSendCount;
+	// Tells the retransmit timers of this item apart from those of earlier items with the same
+	// safe index.
+	u32 nTimerID;
+};
+
+// A retransmit or idle check, scheduled in MSafeUDP::m_Timers.
+struct MSafeUDPTimer {
+	enum TYPE : u8 {
+		RETRANSMIT,
+		IDLE_CHECK,
+	};
+
+	i64 nLinkKey;
+	u32 nLinkSerial;
+	TYPE nType;
+	u8 nSafeIndex;
+	u32 nTimerID;
 };
 
 // OUTER CLASS //////////////////////////////////////////////////////////////////////////
@@ -59,9 +86,6 @@ public:
 		LINKSTATE_FIN_RCVD
 	};
 
-	typedef std::list<MACKWaitItem*>		ACKWaitList;
-	typedef ACKWaitList::iterator	ACKWaitListItor;
-
 private:
 	MSafeUDP*		m_pSafeUDP{};
 	bool			m_bConnected{};
@@ -72,13 +96,24 @@ private:
 
 	u32				m_dwAuthKey{};
 	void*			m_pUserData{};
+	// Tells this link apart from earlier ones with the same address.
+	u32				m_nSerial{};
+
+	// Smoothed round trip time and its variation, in milliseconds, as in RFC 6298. Negative
+	// until the first sample.
+	float			m_fSRTT = -1;
+	float			m_fRTTVar{};
+	u32				m_nRetransmitTimeout;
 
 public:
 	MTime::timeval			m_tvConnectedTime{};
 	MTime::timeval			m_tvLastPacketRecvTime{};
 
 public:
-	ACKWaitList		m_ACKWaitQueue;	// Safe Sent queue, Wait for ACK
+	// Safe packets waiting for an ACK, indexed by their safe index.
+	MACKWaitItem	m_ACKWaits[256];
+	int				m_nACKWaitCount{};
+	u32				m_nNextTimerID{};
 
 private:
 	void Setconnected(bool bConnected)	{ m_bConnected = bConnected; }
@@ -97,6 +132,13 @@ public:
 
 	bool SetACKWait(MSafePacket* pPacket, u32 dwPacketSize);
 	bool ClearACKWait(u8 nSafeIndex);
+	// Updates the round trip time estimate with a sample in milliseconds.
+	void OnRTTSample(u32 nRTT);
+	// The time to wait for an ACK before the first retransmit. Doubled for every retransmit after.
+	u32 GetRetransmitTimeout() const	{ return m_nRetransmitTimeout; }
+	float GetSmoothedRTT() const		{ return m_fSRTT; }
+	u32 GetSerial() const				{ return m_nSerial; }
+	void SetSerial(u32 nSerial)			{ m_nSerial = nSerial; }
 
 	void SetSafeUDP(MSafeUDP* pSafeUDP)	{ m_pSafeUDP = pSafeUDP; }
 	MSafeUDP* GetSafeUDP()				{ return m_pSafeUDP; }
@@ -113,6 +155,7 @@ public:
 	MSocket::sockaddr_in* GetSockAddr()			{ return &m_Address; }
 	i64 GetMapKey();
 	static i64 GetMapKey(MSocket::sockaddr_in* pSockAddr);
+	static i64 GetMapKey(u32 dwIP, u16 wRawPort);
 	MTime::timeval GetLastPacketRecvTime()		{ return m_tvLastPacketRecvTime; }
 
 	u32 GetAuthKey() const			{ return m_dwAuthKey; }
@@ -120,11 +163,6 @@ public:
 	void* GetUserData() const			{ return m_pUserData; }
 };
 
-typedef std::map<i64, MNetLink*>	NetLinkMap;
-typedef NetLinkMap::value_type	NetLinkType;
-typedef NetLinkMap::iterator	NetLinkItor;
-
-
 // INNER CLASS //////////////////////////////////////////////////////////////////////////
 typedef void(MNETLINKSTATECALLBACK)(MNetLink* pNetLink, MNetLink::LINKSTATE nState);
 typedef bool(MCUSTOMRECVCALLBACK)(u32 dwIP, u16 wRawPort, char* pPacket, u32 dwSize);	// Real UDP Packet
@@ -135,10 +173,9 @@ class MSafeUDP;
 class MSocketThread : public MThread
 {
 public:
-	typedef std::list<MACKQueueItem*>	ACKSendList;
-	typedef ACKSendList::iterator	ACKSendListItor;
-	typedef std::list<MSendQueueItem*>	SendList;
-	typedef SendList::iterator		SendListItor;
+	// Preallocated, so that queueing a packet doesn't allocate.
+	typedef RingBuffer<MACKQueueItem, SAFEUDP_MAX_ACKQUEUE_LENGTH>	ACKSendList;
+	typedef RingBuffer<MSendQueueItem, SAFEUDP_MAX_SENDQUEUE_LENGTH>	SendList;
 
 	MCUSTOMRECVCALLBACK*	m_fnCustomRecvCallback{};
 	MLIGHTRECVCALLBACK*		m_fnLightRecvCallback{};
@@ -152,6 +189,12 @@ public:
 
 	MSafeUDP* GetSafeUDP() const { return m_pSafeUDP; }
 	void SetSafeUDP(MSafeUDP* pSafeUDP)	{ m_pSafeUDP = pSafeUDP; }
+	SOCKET GetSocket() const { return m_Socket; }
+	void SetSocket(SOCKET Socket) { m_Socket = Socket; }
+	// Only one of the threads of an MSafeUDP retransmits and times out the net links.
+	void SetManageNetLinks(bool Value) { m_bManageNetLinks = Value; }
+	// Sends and receives up to SAFEUDP_IO_BATCH_SIZE datagrams per system call where supported.
+	void SetBatchedIO(bool Value) { m_bBatchedIO = Value; }
 
 	bool PushSend(MNetLink* pNetLink, MBasePacket* pPacket, u32 dwpPacketSize, bool bRetransmit);	
 	bool PushSend(const char* pszIP, int nPort, char* pPacket, u32 dwPacketSize);
@@ -169,12 +212,24 @@ private:
 	void UnlockSend() { m_csSendLock.unlock(); }
 
 	bool PushACK(MNetLink* pNetLink, MSafePacket* pPacket);
+	bool PushSend(const MSendQueueItem& Item);
 	bool FlushACK();
 	bool FlushSend();
 
 	bool SafeSendManage();
+	void OnIdleCheck(MNetLink* pNetLink, const MSafeUDPTimer& Timer, u64 Now);
+	void OnRetransmitTimer(MNetLink* pNetLink, const MSafeUDPTimer& Timer, u64 Now);
 
 	bool Recv();
+	bool RecvBatched();
+	void OnRecv(u32 dwIP, u16 wRawPort, char* pPacket, u32 dwSize);
+	struct Datagram {
+		u32 dwIP;
+		u16 wRawPort;
+		const void* Data;
+		u32 Size;
+	};
+	void SendDatagrams(const Datagram* Datagrams, size_t Count);
 	bool OnCustomRecv(u32 dwIP, u16 wRawPort, char* pPacket, u32 dwSize);
 	bool OnControlRecv(u32 dwIP, u16 wRawPort, MBasePacket* pPacket, u32 dwSize);
 	bool OnLightRecv(u32 dwIP, u16 wRawPort, MLightPacket* pPacket, u32 dwSize);
@@ -185,16 +240,20 @@ private:
 	bool SendPacket(const T& DestAddr, const void* Data, size_t DataSize);
 
 	MSafeUDP*				m_pSafeUDP{};
+	SOCKET					m_Socket{};
+	bool					m_bManageNetLinks = true;
+	bool					m_bBatchedIO = true;
+	// The receive buffers for RecvBatched, allocated on first use.
+	std::vector<char>		m_RecvBuffers;
+	std::vector<MSafeUDPTimer>	m_ExpiredTimers;
 	MSignalEvent			m_ACKEvent;
 	MSignalEvent			m_SendEvent;
 	MSignalEvent			m_KillEvent;
 
 	ACKSendList				m_ACKSendList;		// Sending priority High
-	ACKSendList				m_TempACKSendList;	// Temporary ACK List for Sync
 	MCriticalSection		m_csACKLock;
 
 	SendList				m_SendList;			// Sending priority Low	(Safe|Normal) Packet
-	SendList				m_TempSendList;		// Temporary Send List for Sync
 	MCriticalSection		m_csSendLock;
 
 	u32						m_nTotalSend{};
@@ -206,14 +265,26 @@ private:
 class MSafeUDP
 {
 public:
-	bool Create(bool bBindWinsockDLL, int nPort, bool bReuse = true);
+	// nThreadCount > 1 opens that many sockets on the same port with SO_REUSEPORT, each with its
+	// own thread, and lets the kernel spread the peers between them. The receive callbacks are
+	// then called from several threads at once. Only supported on Linux; elsewhere it's always 1.
+	bool Create(bool bBindWinsockDLL, int nPort, bool bReuse = true, int nThreadCount = 1);
 	void Destroy();
 
-	void SetNetLinkStateCallback(MNETLINKSTATECALLBACK pCallback) { m_fnNetLinkStateCallback = pCallback; }
-	void SetLightRecvCallback(MLIGHTRECVCALLBACK pCallback) { m_SocketThread.m_fnLightRecvCallback = pCallback; }
-	void SetGenericRecvCallback(MGENERICRECVCALLBACK pCallback) { m_SocketThread.m_fnGenericRecvCallback = pCallback; }
-	void SetCustomRecvCallback(MCUSTOMRECVCALLBACK pCallback) { m_SocketThread.m_fnCustomRecvCallback = pCallback; }
+	// Must be called before Create.
+	void SetBatchedIO(bool Value) { m_bBatchedIO = Value; }
 
+	void SetNetLinkStateCallback(MNETLINKSTATECALLBACK pCallback) { m_fnNetLinkStateCallback = pCallback; }
+	void SetLightRecvCallback(MLIGHTRECVCALLBACK pCallback) {
+		ForEachThread([&](auto& Thread) { Thread.m_fnLightRecvCallback = pCallback; }); }
+	void SetGenericRecvCallback(MGENERICRECVCALLBACK pCallback) {
+		ForEachThread([&](auto& Thread) { Thread.m_fnGenericRecvCallback = pCallback; }); }
+	void SetCustomRecvCallback(MCUSTOMRECVCALLBACK pCallback) {
+		ForEachThread([&](auto& Thread) { Thread.m_fnCustomRecvCallback = pCallback; }); }
+
+	// A net link can be closed by the socket threads at any time, so pointers to one are only
+	// valid while the lock returned by LockNetLink is held. OpenNetLink and Connect return links
+	// that may already be gone.
 	MNetLink* OpenNetLink(char* szIP, int nPort);
 	bool CloseNetLink(MNetLink* pNetLink);
 
@@ -231,31 +302,79 @@ public:
 	u32 GetLocalIP() const { return m_LocalAddress.sin_addr.S_un.S_addr; }
 	u16 GetLocalPort() const { return m_LocalAddress.sin_port; }
 
+	// The lock of the shard of the link must be held.
 	MNetLink* FindNetLink(u32 dwIP, u16 wRawPort);
 	MNetLink* FindNetLink(i64 nMapKey);
 
-	void GetTraffic(int* nSendTraffic, int* nRecvTraffic) const {
-		*nSendTraffic = m_SocketThread.GetSendTraffic();
-		*nRecvTraffic = m_SocketThread.GetRecvTraffic();
+	// Locks the links that share a shard with nMapKey.
+	std::unique_lock<MCriticalSection> LockNetLink(i64 nMapKey) {
+		return std::unique_lock<MCriticalSection>{ m_NetLinks.GetShard(nMapKey).Mutex }; }
+
+	// Calls Func(MNetLink*) for every link, with the lock of its shard held.
+	template <typename F>
+	void ForEachNetLink(F&& Func) {
+		m_NetLinks.ForEachShard([&](MNetLinkTable::Shard& Shard) {
+			std::lock_guard<MCriticalSection> Lock{ Shard.Mutex };
+			Shard.ForEach(Func);
+		});
 	}
 
-	void LockNetLink() { m_csNetLink.lock(); }
-	void UnlockNetLink() { m_csNetLink.unlock(); }
+	void AddTimer(u64 nDeadline, const MSafeUDPTimer& Timer) {
+		std::lock_guard<MCriticalSection> Lock{ m_csTimers };
+		m_Timers.Add(nDeadline, Timer);
+	}
 
-	MCriticalSection			m_csNetLink;
+	void GetTraffic(int* nSendTraffic, int* nRecvTraffic) const {
+		*nSendTraffic = 0;
+		*nRecvTraffic = 0;
+		ForEachThread([&](auto& Thread) {
+			*nSendTraffic += Thread.GetSendTraffic();
+			*nRecvTraffic += Thread.GetRecvTraffic();
+		});
+	}
 
-	NetLinkMap					m_NetLinkMap;
 	MNETLINKSTATECALLBACK*		m_fnNetLinkStateCallback;
 
 private:
-	bool OpenSocket(int nPort, bool bReuse = true);
-	void CloseSocket();
+	friend class MSocketThread;
+
+	// Must be called with the lock of the shard of the address held.
+	MNetLink* OpenNetLink(MNetLinkTable::Shard& Shard, MNetLink* pNewNetLink);
+	// Returns the timers due by nNow.
+	void TakeExpiredTimers(u64 nNow, std::vector<MSafeUDPTimer>& Out);
+
+	bool OpenSocket(int nPort, bool bReuse, bool bReusePort, SOCKET& Socket);
+	void CloseSocket(SOCKET Socket);
 	void OnConnect(MNetLink* pNetLink);
 	void OnDisconnect(MNetLink* pNetLink);
 
+	template <typename F>
+	void ForEachThread(F&& Func) {
+		Func(m_SocketThread);
+		for (auto&& Thread : m_ExtraSocketThreads)
+			Func(*Thread);
+	}
+	template <typename F>
+	void ForEachThread(F&& Func) const {
+		Func(m_SocketThread);
+		for (auto&& Thread : m_ExtraSocketThreads)
+			Func(static_cast<const MSocketThread&>(*Thread));
+	}
+	// Packets to the same address are always sent from the same thread, so that they stay in order.
+	MSocketThread& GetSendThread(u32 dwIP, u16 wRawPort);
+
 	bool						m_bBindWinsockDLL;	// Socket DLL Load
 	SOCKET						m_Socket;			// My Socket
 	MSocket::sockaddr_in		m_LocalAddress;		// My IP and Port
+	bool						m_bBatchedIO = true;
+
+	MNetLinkTable				m_NetLinks;
+	std::atomic<u32>			m_nNextLinkSerial{};
+	// The retransmits and idle checks of the net links. Only taken after a shard lock, if any.
+	MCriticalSection			m_csTimers;
+	MTimerWheel<MSafeUDPTimer>	m_Timers{ SAFEUDP_TIMER_TICK, GetGlobalTimeMS() };
 
 	MSocketThread				m_SocketThread;
+	// The threads of the other SO_REUSEPORT sockets, if nThreadCount > 1.
+	std::vector<std::unique_ptr<MSocketThread>> m_ExtraSocketThreads;
 };
\ No newline at end of file
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include "GlobalTypes.h"
+
+// A hierarchical timer wheel. Adding a timer is O(1), and advancing the time is O(1) per tick
+// plus the timers that expire or move down a level.
+//
+// Timers can't be cancelled. Instead, the callback is expected to check whether the timer still
+// means anything when it expires.
+template <typename T>
+class MTimerWheel
+{
+public:
+	static constexpr int SlotBits = 6;
+	static constexpr u64 SlotCount = 1 << SlotBits;
+	static constexpr int LevelCount = 4;
+
+	MTimerWheel(u32 TickMS, u64 Now) : TickMS(TickMS), NextTick(Now / TickMS + 1) {}
+
+	// Timers further in the future than the wheel covers (SlotCount^LevelCount ticks) expire at
+	// the end of its range, and timers in the past expire on the next tick.
+	void Add(u64 Deadline, T Value)
+	{
+		Insert((Deadline + TickMS - 1) / TickMS, std::move(Value));
+		++Count;
+	}
+
+	// Calls Callback(T&) for every timer with a deadline up to Now, in order of deadline, down to
+	// the tick. The callback may add more timers.
+	template <typename F>
+	void Advance(u64 Now, F&& Callback)
+	{
+		const auto LastTick = Now / TickMS;
+		while (NextTick <= LastTick)
+		{
+			if (Count == 0)
+			{
+				NextTick = LastTick + 1;
+				break;
+			}
+
+			const auto Tick = NextTick;
+
+			// Move the timers in the higher level slots that start at this tick down, highest level
+			// first, so that they end up in the level 0 slot for this tick if they're due now.
+			for (int Level = LevelCount - 1; Level > 0; --Level)
+			{
+				const auto Shift = SlotBits * Level;
+				if (Tick & ((u64(1) << Shift) - 1))
+					continue;
+
+				auto& Slot = Slots[Level][(Tick >> Shift) & (SlotCount - 1)];
+				Scratch.clear();
+				std::swap(Scratch, Slot);
+				for (auto&& Entry : Scratch)
+					Insert(Entry.Tick, std::move(Entry.Value));
+			}
+
+			auto& Slot = Slots[0][Tick & (SlotCount - 1)];
+			Expired.clear();
+			std::swap(Expired, Slot);
+			Count -= Expired.size();
+			// Only the last tick is passed, so that timers added by the callbacks end up after it.
+			NextTick = Tick + 1;
+			for (auto&& Entry : Expired)
+				Callback(Entry.Value);
+		}
+	}
+
+	size_t size() const { return Count; }
+
+private:
+	struct Entry
+	{
+		u64 Tick;
+		T Value;
+	};
+
+	void Insert(u64 Tick, T&& Value)
+	{
+		Tick = (std::max)(Tick, NextTick);
+		const auto MaxTick = NextTick + (u64(1) << (SlotBits * LevelCount)) - 1;
+		Tick = (std::min)(Tick, MaxTick);
+
+		const auto Delta = Tick - NextTick;
+		int Level = 0;
+		while (Level < LevelCount - 1 && Delta >= (u64(1) << (SlotBits * (Level + 1))))
+			++Level;
+
+		Slots[Level][(Tick >> (SlotBits * Level)) & (SlotCount - 1)].push_back({Tick, std::move(Value)});
+	}
+
+	u32 TickMS;
+	// The first tick whose timers haven't expired yet.
+	u64 NextTick;
+	size_t Count = 0;
+	std::vector<Entry> Slots[LevelCount][SlotCount];
+	std::vector<Entry> Scratch;
+	std::vector<Entry> Expired;
+};
@@ -0,0 +1,103 @@
+#include "stdafx.h"
+#include "MNetLinkTable.h"
+#include <algorithm>
+
+u64 MNetLinkTable::Hash(i64 Key)
+{
+	// The splitmix64 finalizer. The keys are an IP and port, which are far from uniform.
+	auto x = u64(Key);
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ull;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebull;
+	x ^= x >> 31;
+	return x;
+}
+
+bool MNetLinkTable::Shard::FindSlot(i64 Key, size_t& Index) const
+{
+	if (Slots.empty())
+		return false;
+
+	const auto Mask = Slots.size() - 1;
+	for (auto i = GetHome(Key); Slots[i].Link; i = (i + 1) & Mask)
+	{
+		if (Slots[i].Key == Key)
+		{
+			Index = i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+MNetLink* MNetLinkTable::Shard::Find(i64 Key) const
+{
+	size_t Index;
+	if (!FindSlot(Key, Index))
+		return nullptr;
+	return Slots[Index].Link;
+}
+
+void MNetLinkTable::Shard::Insert(i64 Key, MNetLink* Link)
+{
+	// Keep the load factor at or below a half.
+	if ((Count + 1) * 2 > Slots.size())
+		Grow();
+
+	const auto Mask = Slots.size() - 1;
+	auto i = GetHome(Key);
+	while (Slots[i].Link)
+		i = (i + 1) & Mask;
+
+	Slots[i] = { Key, Link };
+	++Count;
+}
+
+MNetLink* MNetLinkTable::Shard::Erase(i64 Key)
+{
+	size_t Hole;
+	if (!FindSlot(Key, Hole))
+		return nullptr;
+
+	auto* Link = Slots[Hole].Link;
+	Slots[Hole] = {};
+	--Count;
+
+	// Move the entries after the hole back into it if their probe sequence passes over it, so that
+	// lookups don't stop at the hole before reaching them.
+	const auto Mask = Slots.size() - 1;
+	for (auto i = (Hole + 1) & Mask; Slots[i].Link; i = (i + 1) & Mask)
+	{
+		const auto Home = GetHome(Slots[i].Key);
+		const auto DistanceToHole = (Hole - Home) & Mask;
+		const auto DistanceToSlot = (i - Home) & Mask;
+		if (DistanceToHole < DistanceToSlot)
+		{
+			Slots[Hole] = Slots[i];
+			Slots[i] = {};
+			Hole = i;
+		}
+	}
+
+	return Link;
+}
+
+void MNetLinkTable::Shard::Clear()
+{
+	Slots.clear();
+	Count = 0;
+}
+
+void MNetLinkTable::Shard::Grow()
+{
+	auto OldSlots = std::move(Slots);
+	Slots.clear();
+	Slots.resize((std::max)(OldSlots.size() * 2, size_t(16)));
+	Count = 0;
+
+	for (auto&& Slot : OldSlots)
+		if (Slot.Link)
+			Insert(Slot.Key, Slot.Link);
+}
@@ -2,18 +2,26 @@
 #include "MSafeUDP.h"
 #include "MBasePacket.h"
 #include <mutex>
+#include <cmath>
 #include "MDebug.h"
 #include "MUtil.h"
 #include "MFile.h"
 
+#ifdef __linux__
+#include <sys/socket.h>
+#include <netinet/in.h>
+#endif
+
 #define MAX_RECVBUF_LEN		65535
 
-#define SAFEUDP_MAX_SENDQUEUE_LENGTH		5120
-#define SAFEUDP_MAX_ACKQUEUE_LENGTH			5120
 #define SAFEUDP_MAX_ACKWAITQUEUE_LENGTH		64
 
-#define SAFEUDP_SAFE_MANAGE_TIME			100		// WSA_INFINITE for debug
-#define SAFEUDP_SAFE_RETRANS_TIME			500
+// Number of datagrams sent or received per sendmmsg/recvmmsg call.
+#define SAFEUDP_IO_BATCH_SIZE				32
+
+#define SAFEUDP_SAFE_MANAGE_TIME			SAFEUDP_TIMER_TICK
+#define SAFEUDP_SAFE_RETRANS_TIME			500		// Until there's an RTT sample
+#define SAFEUDP_MIN_SAFE_RETRANS_TIME		100
 #define SAFEUDP_MAX_SAFE_RETRANS_TIME		5000
 
 
@@ -35,18 +43,13 @@ MNetLink::MNetLink()
 	m_nNextWriteIndex = 0;
 	m_dwAuthKey = 0;
 	m_pUserData = NULL;
+	m_nRetransmitTimeout = SAFEUDP_SAFE_RETRANS_TIME;
 
 	MTime::GetTime(&m_tvConnectedTime);
 	MTime::GetTime(&m_tvLastPacketRecvTime);
 }
 
-MNetLink::~MNetLink()
-{
-	for (ACKWaitListItor itor = m_ACKWaitQueue.begin(); itor != m_ACKWaitQueue.end(); ) {
-		delete (*itor);
-		itor = m_ACKWaitQueue.erase(itor);
-	}
-}
+MNetLink::~MNetLink() = default;
 
 void MNetLink::SetLinkState(MNetLink::LINKSTATE nState) 
 { 
@@ -129,9 +132,14 @@ i64 MNetLink::GetMapKey()
 
 i64 MNetLink::GetMapKey(MSocket::sockaddr_in* pSockAddr)
 {
-	i64 nKey = pSockAddr->sin_port;
+	return GetMapKey(pSockAddr->sin_addr.S_un.S_addr, pSockAddr->sin_port);
+}
+
+i64 MNetLink::GetMapKey(u32 dwIP, u16 wRawPort)
+{
+	i64 nKey = wRawPort;
 	nKey = nKey << 32;
-	nKey += pSockAddr->sin_addr.S_un.S_addr;
+	nKey += dwIP;
 	return nKey;
 }
 
@@ -214,34 +222,59 @@ bool MNetLink::OnRecvControl(MControlPacket* pPacket)
 
 bool MNetLink::SetACKWait(MSafePacket* pPacket, u32 dwPacketSize)
 {
-	if (m_ACKWaitQueue.size() > SAFEUDP_MAX_ACKWAITQUEUE_LENGTH)
+	if (m_nACKWaitCount >= SAFEUDP_MAX_ACKWAITQUEUE_LENGTH)
 		return false;
 
 	pPacket->nSafeIndex = GetNextWriteIndex();
-	MACKWaitItem* pACKWaitItem = new MACKWaitItem;
-	pACKWaitItem->pPacket = std::unique_ptr<MSafePacket>{ pPacket };
-	pACKWaitItem->dwPacketSize = dwPacketSize;
-	pACKWaitItem->nSendCount = 1;		// SendQueue
-	MTime::GetTime(&pACKWaitItem->tvFirstSent);
-	MTime::GetTime(&pACKWaitItem->tvLastSent);
-	m_ACKWaitQueue.push_back(pACKWaitItem);
+
+	auto& Item = m_ACKWaits[pPacket->nSafeIndex];
+	// If a packet is still here, it's gone unacknowledged through a whole cycle of safe indices,
+	// and an ACK for the index couldn't be told apart from one for the new packet anyway.
+	if (!Item.pPacket)
+		++m_nACKWaitCount;
+	Item.pPacket.reset(new char[dwPacketSize]);
+	memcpy(Item.pPacket.get(), pPacket, dwPacketSize);
+	Item.dwPacketSize = dwPacketSize;
+	Item.nFirstSentTime = GetGlobalTimeMS();
+	Item.nSendCount = 1;		// SendQueue
+	Item.nTimerID = m_nNextTimerID++;
+
+	m_pSafeUDP->AddTimer(Item.nFirstSentTime + m_nRetransmitTimeout,
+		{ GetMapKey(), m_nSerial, MSafeUDPTimer::RETRANSMIT, pPacket->nSafeIndex, Item.nTimerID });
 
 	return true;
 }
 
 bool MNetLink::ClearACKWait(u8 nSafeIndex)
 {
-	for (ACKWaitListItor itor = m_ACKWaitQueue.begin(); itor != m_ACKWaitQueue.end(); ) {
-		MACKWaitItem* pACKWaitItem = *itor;
-		if (pACKWaitItem->pPacket->nSafeIndex == nSafeIndex) {
-			delete pACKWaitItem;	// pACKWaitItem->pPacket will Delete too
-			itor = m_ACKWaitQueue.erase(itor);
-			return true;
-		} else {
-			++itor;
-		}
+	auto& Item = m_ACKWaits[nSafeIndex];
+	if (!Item.pPacket)
+		return false;
+
+	// The ACK of a retransmitted packet could be for any of the copies, so only the ones sent
+	// once are measured (Karn's algorithm).
+	if (Item.nSendCount == 1)
+		OnRTTSample(u32(GetGlobalTimeMS() - Item.nFirstSentTime));
+
+	Item.pPacket.reset();
+	--m_nACKWaitCount;
+	return true;
+}
+
+void MNetLink::OnRTTSample(u32 nRTT)
+{
+	const auto RTT = float(nRTT);
+	if (m_fSRTT < 0) {
+		m_fSRTT = RTT;
+		m_fRTTVar = RTT / 2;
+	} else {
+		m_fRTTVar = 0.75f * m_fRTTVar + 0.25f * fabs(m_fSRTT - RTT);
+		m_fSRTT = 0.875f * m_fSRTT + 0.125f * RTT;
 	}
-	return false;
+
+	const auto Timeout = m_fSRTT + (std::max)(float(SAFEUDP_TIMER_TICK), 4 * m_fRTTVar);
+	m_nRetransmitTimeout = u32((std::min)((std::max)(Timeout, float(SAFEUDP_MIN_SAFE_RETRANS_TIME)),
+		float(SAFEUDP_MAX_SAFE_RETRANS_TIME)));
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////
@@ -290,9 +323,10 @@ void MSocketThread::Run()
 	{
 		using namespace MSocket::FD;
 		const auto Flags = READ | WRITE;
-		MSocket::EventSelect(m_pSafeUDP->GetLocalSocket(), SocketEvent, Flags);
+		MSocket::EventSelect(m_Socket, SocketEvent, Flags);
 	}
 
+	u64 NextManageTime = 0;
 	while (true)
 	{
 		auto WaitResult = WaitForMultipleEvents(EventArray, SAFEUDP_SAFE_MANAGE_TIME);
@@ -308,27 +342,38 @@ void MSocketThread::Run()
 		case 0:
 		{
 			MSocket::NetworkEvents NetEvent;
-			EnumNetworkEvents(m_pSafeUDP->GetLocalSocket(), SocketEvent, &NetEvent);
+			EnumNetworkEvents(m_Socket, SocketEvent, &NetEvent);
 			if (MSocket::IsNetworkEventSet(NetEvent, MSocket::FD::READ))
 			{
-				m_pSafeUDP->LockNetLink();
-				Recv();
-				m_pSafeUDP->UnlockNetLink();
+#ifdef __linux__
+				if (m_bBatchedIO)
+					RecvBatched();
+				else
+#endif
+					Recv();
 			}
 			if (MSocket::IsNetworkEventSet(NetEvent, MSocket::FD::WRITE))
 			{
 				bSendable = true;
+#ifndef _WIN32
+				// Like FD_WRITE on Windows, only wait for the first one. A UDP socket is nearly
+				// always writable, so select would otherwise return right away every time.
+				SocketEvent.Events &= ~MSignalEvent::Write;
+#endif
 			}
 		}
 			break;
 
 			// ACK Send Event
 		case 1:
+			// The events only reset themselves on Windows.
+			m_ACKEvent.ResetEvent();
 			FlushACK();
 			break;
 
 			// Packet Send Event
 		case 2:
+			m_SendEvent.ResetEvent();
 			if (bSendable == true)
 				FlushSend();
 			break;
@@ -339,60 +384,38 @@ void MSocketThread::Run()
 			goto end_thread; // Stop Thread
 
 		default:
-			m_pSafeUDP->LockNetLink();
-			SafeSendManage();
-			m_pSafeUDP->UnlockNetLink();
 			break;
 		}
+
+		// Checked after every event, so that a busy socket doesn't hold up the retransmits.
+		if (m_bManageNetLinks && GetGlobalTimeMS() >= NextManageTime)
+		{
+			NextManageTime = GetGlobalTimeMS() + SAFEUDP_SAFE_MANAGE_TIME;
+			SafeSendManage();
+		}
 	}
 
 end_thread:
 
 	// Clear Queues
 	LockSend();
-	{
-		for (SendListItor itor = m_SendList.begin(); itor != m_SendList.end(); ) {
-			delete (*itor);
-			itor = m_SendList.erase(itor);
-		}
-	}
-	{
-		for (SendListItor itor = m_TempSendList.begin(); itor != m_TempSendList.end(); ) {
-			delete (*itor);
-			itor = m_TempSendList.erase(itor);
-		}
-	}
+	m_SendList.clear();
 	UnlockSend();
 
 	LockACK();
-	{
-		for (ACKSendListItor itor = m_ACKSendList.begin(); itor != m_ACKSendList.end(); ) {
-			delete (*itor);
-			itor = m_ACKSendList.erase(itor);
-		}
-	}
-	{
-		for (ACKSendListItor itor = m_TempACKSendList.begin(); itor != m_TempACKSendList.end(); ) {
-			delete (*itor);
-			itor = m_TempACKSendList.erase(itor);
-		}
-	}
+	m_ACKSendList.clear();
 	UnlockACK();
 }
 
 bool MSocketThread::PushACK(MNetLink* pNetLink, MSafePacket* pPacket)
 {
-	if (m_ACKSendList.size() > SAFEUDP_MAX_ACKQUEUE_LENGTH)
-		return false;
-
-	MACKQueueItem* pACKItem = new MACKQueueItem;
-	pACKItem->dwIP = pNetLink->GetIP();
-	pACKItem->wRawPort = pNetLink->GetRawPort();
-	pACKItem->nSafeIndex = pPacket->nSafeIndex;
+	{
+		std::lock_guard<MCriticalSection> lock{ m_csACKLock };
+		if (m_ACKSendList.size() == m_ACKSendList.max_size())
+			return false;
 
-	LockACK();
-	m_TempACKSendList.push_back(pACKItem);
-	UnlockACK();
+		m_ACKSendList.push_back({ pNetLink->GetIP(), pNetLink->GetRawPort(), pPacket->nSafeIndex });
+	}
 
 	m_ACKEvent.SetEvent();
 
@@ -401,89 +424,58 @@ bool MSocketThread::PushACK(MNetLink* pNetLink, MSafePacket* pPacket)
 
 bool MSocketThread::PushSend(MNetLink* pNetLink, MBasePacket* pPacket, u32 dwPacketSize, bool bRetransmit)
 {
-	if (!pNetLink || m_SendList.size() > SAFEUDP_MAX_SENDQUEUE_LENGTH)
+	if (!pNetLink)
 		return false;
 
-	MSendQueueItem* pSendItem = new MSendQueueItem;
-	pSendItem->dwIP = pNetLink->GetIP();
-	pSendItem->wRawPort = pNetLink->GetRawPort();
-	pSendItem->pPacket = pPacket;
-	pSendItem->dwPacketSize = dwPacketSize;
+	{
+		std::lock_guard<MCriticalSection> lock{ m_csSendLock };
+		if (m_SendList.size() == m_SendList.max_size())
+			return false;
+	}
 
 	if (pPacket->GetFlag(SAFEUDP_FLAG_SAFE_PACKET) != false && bRetransmit == false) {
 		pNetLink->SetACKWait((MSafePacket*)pPacket, dwPacketSize);
 	}
 
-	LockSend();
-	m_TempSendList.push_back(pSendItem);
-	UnlockSend();
-
-	m_SendEvent.SetEvent();
-
-	return true;
+	return PushSend({ pNetLink->GetIP(), pNetLink->GetRawPort(), pPacket, dwPacketSize });
 }
 
 bool MSocketThread::PushSend(const char* pszIP, int nPort, char* pPacket, u32 dwPacketSize)
 {
-	if (m_SendList.size() > SAFEUDP_MAX_SENDQUEUE_LENGTH)
-		return false;
-
 	MSocket::sockaddr_in Addr;
 	if (MNetLink::MakeSockAddr(pszIP, nPort, &Addr) == false)
 		return false;
 
-	MSendQueueItem* pSendItem = new MSendQueueItem;
-	pSendItem->dwIP = Addr.sin_addr.S_un.S_addr;
-	pSendItem->wRawPort = Addr.sin_port;
-	pSendItem->pPacket = (MBasePacket*)pPacket;
-	pSendItem->dwPacketSize = dwPacketSize;
-
-	LockSend();
-	m_TempSendList.push_back(pSendItem);
-	UnlockSend();
-
-	m_SendEvent.SetEvent();
-
-	return true;
+	return PushSend({ Addr.sin_addr.S_un.S_addr, Addr.sin_port, (MBasePacket*)pPacket, dwPacketSize });
 }
 
 bool MSocketThread::PushSend(u32 dwIP, int nPort, char* pPacket, u32 dwPacketSize)
 {
-	if (SAFEUDP_MAX_SENDQUEUE_LENGTH < m_SendList.size() ||
-		MSocket::in_addr::None == dwIP)
+	if (MSocket::in_addr::None == dwIP)
 	 	return false;
 
-	MSocket::sockaddr_in Addr{};
-
-	//	Set Dest IP and Port 
-	Addr.sin_family = MSocket::AF::INET;
-	Addr.sin_port = MSocket::htons(nPort);
-	memcpy(&(Addr.sin_addr), &dwIP, 4);
+	return PushSend({ dwIP, MSocket::htons(nPort), (MBasePacket*)pPacket, dwPacketSize });
+}
 
-	MSendQueueItem* pSendItem = new MSendQueueItem;
-	if( 0 != pSendItem )
+bool MSocketThread::PushSend(const MSendQueueItem& Item)
+{
 	{
-		pSendItem->dwIP = dwIP;
-		pSendItem->wRawPort = Addr.sin_port;
-		pSendItem->pPacket = (MBasePacket*)pPacket;
-		pSendItem->dwPacketSize = dwPacketSize;
-
-		LockSend();
-		m_TempSendList.push_back( pSendItem );
-		UnlockSend();
-
-		m_SendEvent.SetEvent();
+		std::lock_guard<MCriticalSection> lock{ m_csSendLock };
+		if (m_SendList.size() == m_SendList.max_size())
+			return false;
 
-		return true;
+		m_SendList.push_back(Item);
 	}
 
-	return false;
+	m_SendEvent.SetEvent();
+
+	return true;
 }
 
 template <typename T>
 bool MSocketThread::SendPacket(const T& DestAddr, const void* Data, size_t DataSize)
 {
-	auto SendToResult = MSocket::sendto(m_pSafeUDP->GetLocalSocket(),
+	auto SendToResult = MSocket::sendto(m_Socket,
 		static_cast<const char*>(Data),
 		DataSize,
 		0,
@@ -504,127 +496,194 @@ bool MSocketThread::SendPacket(const T& DestAddr, const void* Data, size_t DataS
 	return true;
 }
 
-bool MSocketThread::FlushACK()
+// Takes up to Count items off the front of Queue.
+template <typename QueueType, typename ItemType>
+static size_t PopBatch(QueueType& Queue, MCriticalSection& Lock, ItemType* Items, size_t Count)
 {
+	std::lock_guard<MCriticalSection> lock{ Lock };
+	size_t Popped = 0;
+	for (; Popped < Count && !Queue.empty(); ++Popped)
 	{
-		std::lock_guard<MCriticalSection> lock{ m_csACKLock };
-		while (m_TempACKSendList.size() > 0) {
-			ACKSendListItor itor = m_TempACKSendList.begin();
-			m_ACKSendList.push_back(*itor);
-			m_TempACKSendList.erase(itor);
-		}
+		Items[Popped] = Queue.front();
+		Queue.pop_front();
 	}
+	return Popped;
+}
 
-	while (m_ACKSendList.size() > 0)
+void MSocketThread::SendDatagrams(const Datagram* Datagrams, size_t Count)
+{
+#ifdef __linux__
+	if (m_bBatchedIO)
 	{
-		auto itor = m_ACKSendList.begin();
-		auto* pACKItem = *itor;
+		mmsghdr Msgs[SAFEUDP_IO_BATCH_SIZE];
+		iovec Iovs[SAFEUDP_IO_BATCH_SIZE];
+		::sockaddr_in Addrs[SAFEUDP_IO_BATCH_SIZE];
+
+		size_t Sent = 0;
+		while (Sent < Count)
+		{
+			const auto BatchSize = (std::min)(Count - Sent, size_t(SAFEUDP_IO_BATCH_SIZE));
+			for (size_t i = 0; i < BatchSize; ++i)
+			{
+				auto& Dgram = Datagrams[Sent + i];
+				Addrs[i] = {};
+				Addrs[i].sin_family = AF_INET;
+				Addrs[i].sin_addr.s_addr = Dgram.dwIP;
+				Addrs[i].sin_port = Dgram.wRawPort;
+				Iovs[i].iov_base = const_cast<void*>(Dgram.Data);
+				Iovs[i].iov_len = Dgram.Size;
+				Msgs[i] = {};
+				Msgs[i].msg_hdr.msg_name = &Addrs[i];
+				Msgs[i].msg_hdr.msg_namelen = sizeof(Addrs[i]);
+				Msgs[i].msg_hdr.msg_iov = &Iovs[i];
+				Msgs[i].msg_hdr.msg_iovlen = 1;
+			}
+
+			auto SendResult = sendmmsg(int(m_Socket), Msgs, unsigned(BatchSize), 0);
+			if (SendResult < 0)
+			{
+				// The first datagram failed. Drop it like sendto would, and go on with the rest.
+				LOG_SOCKET_ERROR("sendmmsg", SendResult);
+				++Sent;
+				continue;
+			}
 
-		MACKPacket ACKPacket{};
-		ACKPacket.nSafeIndex = pACKItem->nSafeIndex;
+			for (int i = 0; i < SendResult; ++i)
+				m_nTotalSend += Msgs[i].msg_len;
+			m_SendTrafficLog.Record(m_nTotalSend);
+			Sent += SendResult;
+		}
+		return;
+	}
+#endif
 
+	for (size_t i = 0; i < Count; ++i)
+	{
 		MSocket::sockaddr_in DestAddr{};
 		DestAddr.sin_family = MSocket::AF::INET;
-		DestAddr.sin_addr.S_un.S_addr = pACKItem->dwIP;
-		DestAddr.sin_port = pACKItem->wRawPort;
+		DestAddr.sin_addr.S_un.S_addr = Datagrams[i].dwIP;
+		DestAddr.sin_port = Datagrams[i].wRawPort;
 
-		SendPacket(DestAddr, &ACKPacket, sizeof(ACKPacket));
-
-		delete pACKItem;
-		m_ACKSendList.erase(itor);
+		SendPacket(DestAddr, Datagrams[i].Data, Datagrams[i].Size);
 	}
-
-	return true;
 }
 
-bool MSocketThread::FlushSend()
+bool MSocketThread::FlushACK()
 {
+	MACKQueueItem Items[SAFEUDP_IO_BATCH_SIZE];
+	MACKPacket Packets[SAFEUDP_IO_BATCH_SIZE];
+	Datagram Datagrams[SAFEUDP_IO_BATCH_SIZE];
+
+	while (auto Count = PopBatch(m_ACKSendList, m_csACKLock, Items, std::size(Items)))
 	{
-		std::lock_guard<MCriticalSection> lock{ m_csSendLock };
-		while (m_TempSendList.size() > 0) {
-			auto itor = m_TempSendList.begin();
-			m_SendList.push_back(*itor);
-			m_TempSendList.erase(itor);
+		for (size_t i = 0; i < Count; ++i)
+		{
+			Packets[i] = MACKPacket{};
+			Packets[i].nSafeIndex = Items[i].nSafeIndex;
+			Datagrams[i] = { Items[i].dwIP, Items[i].wRawPort, &Packets[i], u32(sizeof(MACKPacket)) };
 		}
+
+		SendDatagrams(Datagrams, Count);
 	}
 
-	MSendQueueItem* pSendItem{};
-	MSocket::sockaddr_in DestAddr{};
+	return true;
+}
+
+bool MSocketThread::FlushSend()
+{
+	MSendQueueItem Items[SAFEUDP_IO_BATCH_SIZE];
+	Datagram Datagrams[SAFEUDP_IO_BATCH_SIZE];
 
-	while(m_SendList.size() > 0)
+	while (auto Count = PopBatch(m_SendList, m_csSendLock, Items, std::size(Items)))
 	{
-		auto itor = m_SendList.begin();
-		pSendItem = *itor;
+		for (size_t i = 0; i < Count; ++i)
+			Datagrams[i] = { Items[i].dwIP, Items[i].wRawPort, Items[i].pPacket, Items[i].dwPacketSize };
 
-		DestAddr.sin_family = MSocket::AF::INET;
-		DestAddr.sin_addr.S_un.S_addr = pSendItem->dwIP;
-		DestAddr.sin_port = pSendItem->wRawPort;
+		SendDatagrams(Datagrams, Count);
 
-		SendPacket(DestAddr, pSendItem->pPacket, pSendItem->dwPacketSize);
-		
+		for (size_t i = 0; i < Count; ++i)
+		{
 		#ifdef _OLD_SAFEUDP
-			if (pSendItem->pPacket->GetFlag(SAFEUDP_FLAG_SAFE_PACKET) != false) {
-				// Don't Delete SafePacket (pSendItem->pPacket)
-				delete pSendItem;
-				m_SendList.erase(itor);
-			} else {	// Means Normal Packet
-				delete pSendItem->pPacket;
-				delete pSendItem;
-				m_SendList.erase(itor);
-			}
-		#else
-			delete pSendItem->pPacket;
-			delete pSendItem;
-			m_SendList.erase(itor);
+			// Don't Delete SafePacket
+			if (Items[i].pPacket->GetFlag(SAFEUDP_FLAG_SAFE_PACKET) != false)
+				continue;
 		#endif
-
+			delete Items[i].pPacket;
+		}
 	}
 	return true;
 }
 
 bool MSocketThread::SafeSendManage()
 {
-	int nCnt = m_pSafeUDP->m_NetLinkMap.size();
-	for (NetLinkItor itorLink = m_pSafeUDP->m_NetLinkMap.begin(); itorLink != m_pSafeUDP->m_NetLinkMap.end(); ) {
-		MNetLink* pNetLink = (*itorLink).second;
+	const auto Now = GetGlobalTimeMS();
 
-		MTime::timeval tvNow;
-		MTime::GetTime(&tvNow);
+	// Taken out first, since the timer lock is only taken after the shard locks.
+	m_ExpiredTimers.clear();
+	m_pSafeUDP->TakeExpiredTimers(Now, m_ExpiredTimers);
 
-		// Closed Idle time check
-		auto tvIdleDiff = MTime::TimeSub(tvNow, pNetLink->m_tvLastPacketRecvTime);
-		if ( (pNetLink->GetLinkState() != MNetLink::LINKSTATE_ESTABLISHED) &&
-			 ((tvIdleDiff.tv_sec*1000 + tvIdleDiff.tv_usec) > SAFEUDP_MAX_SAFE_RETRANS_TIME) ) {
-			MTRACE("SUDP> Idle Control Timeout \n");
-			pNetLink->SetLinkState(MNetLink::LINKSTATE_CLOSED);
+	for (auto&& Timer : m_ExpiredTimers)
+	{
+		auto Lock = m_pSafeUDP->LockNetLink(Timer.nLinkKey);
 
-			delete (*itorLink).second;
-			m_pSafeUDP->m_NetLinkMap.erase(itorLink++);
+		// The link may have been closed, or closed and opened again, since the timer was added.
+		auto* pNetLink = m_pSafeUDP->FindNetLink(Timer.nLinkKey);
+		if (pNetLink == NULL || pNetLink->GetSerial() != Timer.nLinkSerial)
 			continue;
-		} else {
-			++itorLink;
-		}
 
-		for (MNetLink::ACKWaitListItor itorACK = pNetLink->m_ACKWaitQueue.begin(); itorACK != pNetLink->m_ACKWaitQueue.end(); ++itorACK) {
-			MACKWaitItem* pACKWaitItem = *itorACK;
+		if (Timer.nType == MSafeUDPTimer::IDLE_CHECK)
+			OnIdleCheck(pNetLink, Timer, Now);
+		else
+			OnRetransmitTimer(pNetLink, Timer, Now);
+	}
 
-			auto tvDiff = MTime::TimeSub(tvNow, pACKWaitItem->tvFirstSent);
-			if ((tvDiff.tv_sec*1000 + tvDiff.tv_usec) > SAFEUDP_MAX_SAFE_RETRANS_TIME) {
-				// Disconnect....
-				MTRACE("SUDP> Retransmit Timeout \n");
-				pNetLink->SetLinkState(MNetLink::LINKSTATE_CLOSED);
-				break;
-			}
+	return true;
+}
 
-			tvDiff = MTime::TimeSub(tvNow, pACKWaitItem->tvLastSent);
-			if ((tvDiff.tv_sec*1000 + tvDiff.tv_usec) > SAFEUDP_SAFE_RETRANS_TIME) {
-				PushSend(pNetLink, pACKWaitItem->pPacket.get(), pACKWaitItem->dwPacketSize, true);
-				pACKWaitItem->tvLastSent = tvNow;
-				pACKWaitItem->nSendCount++;
-			}
-		}
+void MSocketThread::OnIdleCheck(MNetLink* pNetLink, const MSafeUDPTimer& Timer, u64 Now)
+{
+	// Closed Idle time check
+	auto& tvLastRecv = pNetLink->m_tvLastPacketRecvTime;
+	const auto LastRecvTime = u64(tvLastRecv.tv_sec) * 1000 + tvLastRecv.tv_usec;
+	if ((pNetLink->GetLinkState() != MNetLink::LINKSTATE_ESTABLISHED) &&
+		Now > LastRecvTime + SAFEUDP_MAX_SAFE_RETRANS_TIME) {
+		MTRACE("SUDP> Idle Control Timeout \n");
+		pNetLink->SetLinkState(MNetLink::LINKSTATE_CLOSED);
+
+		m_pSafeUDP->CloseNetLink(pNetLink);
+		return;
 	}
-	return true;
+
+	m_pSafeUDP->AddTimer(Now + SAFEUDP_MAX_SAFE_RETRANS_TIME, Timer);
+}
+
+void MSocketThread::OnRetransmitTimer(MNetLink* pNetLink, const MSafeUDPTimer& Timer, u64 Now)
+{
+	auto& Item = pNetLink->m_ACKWaits[Timer.nSafeIndex];
+	// Acknowledged already.
+	if (!Item.pPacket || Item.nTimerID != Timer.nTimerID)
+		return;
+
+	if (Now - Item.nFirstSentTime > SAFEUDP_MAX_SAFE_RETRANS_TIME) {
+		// Disconnect....
+		MTRACE("SUDP> Retransmit Timeout \n");
+		pNetLink->SetLinkState(MNetLink::LINKSTATE_CLOSED);
+		return;
+	}
+
+	auto* pCopy = new char[Item.dwPacketSize];
+	memcpy(pCopy, Item.pPacket.get(), Item.dwPacketSize);
+	if (!PushSend(pNetLink, reinterpret_cast<MBasePacket*>(pCopy), Item.dwPacketSize, true))
+		delete[] pCopy;
+
+	if (Item.nSendCount < 0xFF)
+		Item.nSendCount++;
+
+	// Back off exponentially, in case the timeout is too short or the link is congested.
+	const auto Backoff = (std::min)(Item.nSendCount - 1, 16);
+	const auto Timeout = (std::min)(u64(pNetLink->GetRetransmitTimeout()) << Backoff,
+		u64(SAFEUDP_MAX_SAFE_RETRANS_TIME));
+	m_pSafeUDP->AddTimer(Now + Timeout, Timer);
 }
 
 bool MSocketThread::Recv()
@@ -635,7 +694,7 @@ bool MSocketThread::Recv()
 
 	while (true)
 	{
-		const auto nRecv = MSocket::recvfrom(m_pSafeUDP->GetLocalSocket(),
+		const auto nRecv = MSocket::recvfrom(m_Socket,
 			RecvBuf,
 			MAX_RECVBUF_LEN,
 			0, 
@@ -649,26 +708,79 @@ bool MSocketThread::Recv()
 
 		if (nRecv <= 0) break;
 
-		if (m_fnCustomRecvCallback &&
-			OnCustomRecv(AddrFrom.sin_addr.S_un.S_addr, AddrFrom.sin_port, RecvBuf, nRecv) == true) {
-			continue;
-		} else if (((MBasePacket*)RecvBuf)->GetFlag(SAFEUDP_FLAG_CONTROL_PACKET) != false) {
-			OnControlRecv(AddrFrom.sin_addr.S_un.S_addr, AddrFrom.sin_port, (MBasePacket*)RecvBuf, nRecv);
-			continue;
-		} else if (((MBasePacket*)RecvBuf)->GetFlag(SAFEUDP_FLAG_LIGHT_PACKET) != false) {
-			OnLightRecv(AddrFrom.sin_addr.S_un.S_addr, AddrFrom.sin_port, (MLightPacket*)RecvBuf, nRecv);
-			continue;
-		} else if (((MBasePacket*)RecvBuf)->GetFlag(SAFEUDP_FLAG_ACK_PACKET) != false) {
-			OnACKRecv(AddrFrom.sin_addr.S_un.S_addr, AddrFrom.sin_port, (MACKPacket*)RecvBuf);
-			continue;
-		} else {
-			OnGenericRecv(AddrFrom.sin_addr.S_un.S_addr, AddrFrom.sin_port, (MBasePacket*)RecvBuf, nRecv);
-			continue;
+		OnRecv(AddrFrom.sin_addr.S_un.S_addr, AddrFrom.sin_port, RecvBuf, nRecv);
+	}
+
+	return true;
+}
+
+#ifdef __linux__
+bool MSocketThread::RecvBatched()
+{
+	if (m_RecvBuffers.empty())
+		m_RecvBuffers.resize(SAFEUDP_IO_BATCH_SIZE * MAX_RECVBUF_LEN);
+
+	mmsghdr Msgs[SAFEUDP_IO_BATCH_SIZE];
+	iovec Iovs[SAFEUDP_IO_BATCH_SIZE];
+	::sockaddr_in Addrs[SAFEUDP_IO_BATCH_SIZE];
+
+	while (true)
+	{
+		for (int i = 0; i < SAFEUDP_IO_BATCH_SIZE; ++i)
+		{
+			Iovs[i].iov_base = &m_RecvBuffers[i * MAX_RECVBUF_LEN];
+			Iovs[i].iov_len = MAX_RECVBUF_LEN;
+			Msgs[i] = {};
+			Msgs[i].msg_hdr.msg_name = &Addrs[i];
+			Msgs[i].msg_hdr.msg_namelen = sizeof(Addrs[i]);
+			Msgs[i].msg_hdr.msg_iov = &Iovs[i];
+			Msgs[i].msg_hdr.msg_iovlen = 1;
 		}
+
+		const auto nRecv = recvmmsg(int(m_Socket), Msgs, SAFEUDP_IO_BATCH_SIZE, MSG_DONTWAIT, nullptr);
+		if (nRecv <= 0) break;
+
+		for (int i = 0; i < nRecv; ++i)
+			m_nTotalRecv += Msgs[i].msg_len;
+		m_RecvTrafficLog.Record(m_nTotalRecv);
+
+		for (int i = 0; i < nRecv; ++i)
+		{
+			if (Msgs[i].msg_len == 0)
+				continue;
+			OnRecv(Addrs[i].sin_addr.s_addr, Addrs[i].sin_port,
+				static_cast<char*>(Iovs[i].iov_base), Msgs[i].msg_len);
+		}
+
+		if (nRecv < SAFEUDP_IO_BATCH_SIZE) break;
 	}
 
 	return true;
 }
+#endif
+
+void MSocketThread::OnRecv(u32 dwIP, u16 wRawPort, char* pPacket, u32 dwSize)
+{
+	if (m_fnCustomRecvCallback && OnCustomRecv(dwIP, wRawPort, pPacket, dwSize) == true)
+		return;
+
+	auto* pBasePacket = reinterpret_cast<MBasePacket*>(pPacket);
+	if (pBasePacket->GetFlag(SAFEUDP_FLAG_LIGHT_PACKET) != false &&
+		pBasePacket->GetFlag(SAFEUDP_FLAG_CONTROL_PACKET) == false) {
+		OnLightRecv(dwIP, wRawPort, (MLightPacket*)pPacket, dwSize);
+		return;
+	}
+
+	// The rest look up the net links.
+	auto Lock = m_pSafeUDP->LockNetLink(MNetLink::GetMapKey(dwIP, wRawPort));
+	if (pBasePacket->GetFlag(SAFEUDP_FLAG_CONTROL_PACKET) != false) {
+		OnControlRecv(dwIP, wRawPort, pBasePacket, dwSize);
+	} else if (pBasePacket->GetFlag(SAFEUDP_FLAG_ACK_PACKET) != false) {
+		OnACKRecv(dwIP, wRawPort, (MACKPacket*)pPacket);
+	} else {
+		OnGenericRecv(dwIP, wRawPort, pBasePacket, dwSize);
+	}
+}
 
 bool MSocketThread::OnCustomRecv(u32 dwIP, u16 wRawPort, char* pPacket, u32 dwSize)
 {
@@ -692,7 +804,12 @@ bool MSocketThread::OnControlRecv(u32 dwIP, u16 wRawPort, MBasePacket* pPacket,
 
 			auto HostOrderPort = MSocket::ntohs(wRawPort);
 
-			pNetLink = m_pSafeUDP->OpenNetLink(ip_string, HostOrderPort);
+			// The shard is locked by OnRecv.
+			auto* pNewNetLink = new MNetLink;
+			pNewNetLink->SetSafeUDP(m_pSafeUDP);
+			pNewNetLink->SetAddress(ip_string, HostOrderPort);
+			auto& Shard = m_pSafeUDP->m_NetLinks.GetShard(pNewNetLink->GetMapKey());
+			pNetLink = m_pSafeUDP->OpenNetLink(Shard, pNewNetLink);
 			pNetLink->OnRecvControl(pControlPacket);
 		} 
 	} else {
@@ -741,7 +858,7 @@ bool MSocketThread::OnGenericRecv(u32 dwIP, u16 wRawPort, MBasePacket* pPacket,
 
 ////////////////////////////////////////////////////////////////////////////////////////////
 // MSafeUDP class //////////////////////////////////////////////////////////////////////////
-bool MSafeUDP::Create(bool BindWinsockDLL, int Port, bool ReusePort)
+bool MSafeUDP::Create(bool BindWinsockDLL, int Port, bool ReusePort, int ThreadCount)
 {
 	m_bBindWinsockDLL = BindWinsockDLL;
 
@@ -751,13 +868,40 @@ bool MSafeUDP::Create(bool BindWinsockDLL, int Port, bool ReusePort)
 			return false;
 	}
 
-	if (OpenSocket(Port, ReusePort) == false) {
+#ifndef __linux__
+	ThreadCount = 1;
+#endif
+	// An ephemeral port would give each socket a different one.
+	if (Port == 0)
+		ThreadCount = 1;
+	ThreadCount = (std::max)(ThreadCount, 1);
+
+	if (OpenSocket(Port, ReusePort, ThreadCount > 1, m_Socket) == false) {
 		MLog("MSafeUDP::Create -- OpenSocket failed\n");
 		return false;
 	}
 
 	m_SocketThread.SetSafeUDP(this);
-	m_SocketThread.Create();
+	m_SocketThread.SetSocket(m_Socket);
+	m_SocketThread.SetBatchedIO(m_bBatchedIO);
+
+	for (int i = 1; i < ThreadCount; ++i)
+	{
+		SOCKET Socket;
+		if (OpenSocket(Port, ReusePort, true, Socket) == false) {
+			MLog("MSafeUDP::Create -- OpenSocket failed, using %d socket threads\n", i);
+			break;
+		}
+
+		auto Thread = std::make_unique<MSocketThread>();
+		Thread->SetSafeUDP(this);
+		Thread->SetSocket(Socket);
+		Thread->SetBatchedIO(m_bBatchedIO);
+		Thread->SetManageNetLinks(false);
+		m_ExtraSocketThreads.push_back(std::move(Thread));
+	}
+
+	ForEachThread([&](auto& Thread) { Thread.Create(); });
 	return true;
 }
 
@@ -768,8 +912,12 @@ void MSafeUDP::Destroy()
 
 	DisconnectAll();
 
-	m_SocketThread.Destroy();
-	CloseSocket();
+	ForEachThread([&](auto& Thread) {
+		Thread.Destroy();
+		CloseSocket(Thread.GetSocket());
+	});
+	m_ExtraSocketThreads.clear();
+	m_Socket = 0;
 
 	if (m_bBindWinsockDLL) {
 		MSocket::Cleanup();
@@ -777,7 +925,7 @@ void MSafeUDP::Destroy()
 	}
 }
 
-bool MSafeUDP::OpenSocket(int nPort, bool bReuse)
+bool MSafeUDP::OpenSocket(int nPort, bool bReuse, bool bReusePort, SOCKET& Socket)
 {
 	SOCKET sockfd = MSocket::socket(MSocket::AF::INET, MSocket::SOCK::DGRAM, 0);
 	if (sockfd == MSocket::InvalidSocket)
@@ -793,6 +941,16 @@ bool MSafeUDP::OpenSocket(int nPort, bool bReuse)
 	}
 #endif
 
+#ifdef __linux__
+	if (bReusePort) {
+		int opt = 1;
+		if (::setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) != 0) {
+			MSocket::closesocket(sockfd);
+			return false;
+		}
+	}
+#endif
+
 	MSocket::sockaddr_in LocalAddress;
 	LocalAddress.sin_family			= MSocket::AF::INET;
 	LocalAddress.sin_addr.s_addr	= MSocket::htonl(MSocket::in_addr::Any);
@@ -805,53 +963,60 @@ bool MSafeUDP::OpenSocket(int nPort, bool bReuse)
 		return false;
 	}
 
-	m_Socket = sockfd;
+	Socket = sockfd;
 	m_LocalAddress = LocalAddress;
 
 	return true;
 }
 
-void MSafeUDP::CloseSocket()
+void MSafeUDP::CloseSocket(SOCKET Socket)
 {
-	MSocket::shutdown(m_Socket, MSocket::SD::SEND);
-	MSocket::closesocket(m_Socket);
-	m_Socket = 0;
+	MSocket::shutdown(Socket, MSocket::SD::SEND);
+	MSocket::closesocket(Socket);
+}
+
+MSocketThread& MSafeUDP::GetSendThread(u32 dwIP, u16 wRawPort)
+{
+	if (m_ExtraSocketThreads.empty())
+		return m_SocketThread;
+
+	const auto Index = (dwIP ^ wRawPort) % (m_ExtraSocketThreads.size() + 1);
+	if (Index == 0)
+		return m_SocketThread;
+	return *m_ExtraSocketThreads[Index - 1];
 }
 
 bool MSafeUDP::Send(MNetLink* pNetLink, MBasePacket* pPacket, u32 dwPacketSize)
 {
-	return m_SocketThread.PushSend(pNetLink, pPacket, dwPacketSize, false);
+	if (!pNetLink)
+		return false;
+	return GetSendThread(pNetLink->GetIP(), pNetLink->GetRawPort()).PushSend(pNetLink, pPacket,
+		dwPacketSize, false);
 }
 
 bool MSafeUDP::Send(const char* pszIP, int nPort, char* pPacket, u32 dwSize)
 {
-	return m_SocketThread.PushSend(pszIP, nPort, pPacket, dwSize);
+	// Resolved here so that the packet goes through the same thread as the other overloads.
+	MSocket::sockaddr_in Addr;
+	if (MNetLink::MakeSockAddr(pszIP, nPort, &Addr) == false)
+		return false;
+
+	return Send(Addr.sin_addr.S_un.S_addr, nPort, pPacket, dwSize);
 }
 
 bool MSafeUDP::Send(u32 dwIP, int nPort, char* pPacket, u32 dwSize )
 {
-	return m_SocketThread.PushSend( dwIP, nPort, pPacket, dwSize );
+	return GetSendThread(dwIP, MSocket::htons(nPort)).PushSend( dwIP, nPort, pPacket, dwSize );
 }
 
 MNetLink* MSafeUDP::FindNetLink(u32 dwIP, u16 wRawPort)
 {
-	i64 nKey = wRawPort;
-	nKey = nKey << 32;
-	nKey += dwIP;
-
-	NetLinkItor pos = m_NetLinkMap.find(nKey);
-	if (pos != m_NetLinkMap.end())
-		return (*pos).second;
-
-	return NULL;
+	return FindNetLink(MNetLink::GetMapKey(dwIP, wRawPort));
 }
 
 MNetLink* MSafeUDP::FindNetLink(i64 nMapKey)
 {
-	NetLinkItor pos = m_NetLinkMap.find(nMapKey);
-	if (pos != m_NetLinkMap.end())
-		return (*pos).second;
-	return NULL;
+	return m_NetLinks.GetShard(nMapKey).Find(nMapKey);
 }
 
 MNetLink* MSafeUDP::OpenNetLink(char* szIP, int nPort)
@@ -859,38 +1024,52 @@ MNetLink* MSafeUDP::OpenNetLink(char* szIP, int nPort)
 	MNetLink* pNetLink = new MNetLink;
 	pNetLink->SetSafeUDP(this);
 	pNetLink->SetAddress(szIP, nPort);
-	
-	auto nKey = pNetLink->GetMapKey();
-	
-	auto pos = m_NetLinkMap.find(nKey);
-	if (pos != m_NetLinkMap.end()) {
-		Reconnect((*pos).second);
-		delete pNetLink;
-		pNetLink = (*pos).second;
-	} else {
-		m_NetLinkMap.insert(NetLinkType(nKey, pNetLink));
+
+	auto& Shard = m_NetLinks.GetShard(pNetLink->GetMapKey());
+	std::lock_guard<MCriticalSection> Lock{ Shard.Mutex };
+	return OpenNetLink(Shard, pNetLink);
+}
+
+MNetLink* MSafeUDP::OpenNetLink(MNetLinkTable::Shard& Shard, MNetLink* pNewNetLink)
+{
+	auto nKey = pNewNetLink->GetMapKey();
+
+	if (auto* pNetLink = Shard.Find(nKey)) {
+		Reconnect(pNetLink);
+		delete pNewNetLink;
+		return pNetLink;
 	}
 
-	return pNetLink;
+	pNewNetLink->SetSerial(++m_nNextLinkSerial);
+	Shard.Insert(nKey, pNewNetLink);
+	AddTimer(GetGlobalTimeMS() + SAFEUDP_MAX_SAFE_RETRANS_TIME,
+		{ nKey, pNewNetLink->GetSerial(), MSafeUDPTimer::IDLE_CHECK, 0, 0 });
+
+	return pNewNetLink;
 }
 
 bool MSafeUDP::CloseNetLink(MNetLink* pNetLink)
 {
 	auto nKey = pNetLink->GetMapKey();
 
-	auto pos = m_NetLinkMap.find(nKey);
-	if (pos == m_NetLinkMap.end())
+	auto* pErased = m_NetLinks.GetShard(nKey).Erase(nKey);
+	if (pErased == NULL)
 		return false;
 
-	delete (*pos).second;
-	m_NetLinkMap.erase(pos);
+	delete pErased;
 
 	return true;
 }
 
 MNetLink* MSafeUDP::Connect(char* szIP, int nPort)
 {
-	auto* pNetLink = OpenNetLink(szIP, nPort);
+	MNetLink* pNetLink = new MNetLink;
+	pNetLink->SetSafeUDP(this);
+	pNetLink->SetAddress(szIP, nPort);
+
+	auto& Shard = m_NetLinks.GetShard(pNetLink->GetMapKey());
+	std::lock_guard<MCriticalSection> Lock{ Shard.Mutex };
+	pNetLink = OpenNetLink(Shard, pNetLink);
 	pNetLink->SendControl(MControlPacket::CONTROL_SYN);
 
 	return pNetLink;
@@ -910,14 +1089,19 @@ bool MSafeUDP::Disconnect(MNetLink* pNetLink)
 
 int MSafeUDP::DisconnectAll()
 {
-	LockNetLink();
 	int nCount = 0;
-	for (NetLinkItor itor = m_NetLinkMap.begin(); itor != m_NetLinkMap.end(); ) {
-		delete (*itor).second;
-		m_NetLinkMap.erase(itor++);
-		++nCount;
-	}
-	UnlockNetLink();
+	m_NetLinks.ForEachShard([&](MNetLinkTable::Shard& Shard) {
+		std::lock_guard<MCriticalSection> Lock{ Shard.Mutex };
+		Shard.ForEach([&](MNetLink* pNetLink) { delete pNetLink; });
+		nCount += int(Shard.size());
+		Shard.Clear();
+	});
 	return nCount;
 }
 
+void MSafeUDP::TakeExpiredTimers(u64 nNow, std::vector<MSafeUDPTimer>& Out)
+{
+	std::lock_guard<MCriticalSection> Lock{ m_csTimers };
+	m_Timers.Advance(nNow, [&](const MSafeUDPTimer& Timer) { Out.push_back(Timer); });
+}
+
@@ -0,0 +1,325 @@
+#include <vector>
+#include <random>
+#include <deque>
+#include <memory>
+#include <cmath>
+#include "BasicInfoSnapshot.h"
+#include "MSequenceWindow.h"
+#include "MCommandParameter.h"
+#include "MPacket.h"
+#include "Config.h"
+#include "TestAssert.h"
+
+namespace {
+
+void TestBits()
+{
+	MBitWriter Writer;
+	Writer.WriteBool(true);
+	Writer.Write(5, 3);
+	Writer.Write(0xDEADBEEF, 32);
+	Writer.Write64(0x123456789ABCDEF0, 64);
+	Writer.Write(0, 0);
+	Writer.Write(0x7F, 7);
+	TestAssert(Writer.GetBitSize() == 1 + 3 + 32 + 64 + 7);
+	TestAssert(Writer.GetData().size() == (Writer.GetBitSize() + 7) / 8);
+
+	auto&& Data = Writer.GetData();
+	MBitReader Reader{Data.data(), Data.size()};
+	TestAssert(Reader.ReadBool());
+	TestAssert(Reader.Read(3) == 5);
+	TestAssert(Reader.Read(32) == 0xDEADBEEF);
+	TestAssert(Reader.Read64(64) == 0x123456789ABCDEF0);
+	TestAssert(Reader.Read(7) == 0x7F);
+	TestAssert(!Reader.HasError());
+
+	// Reading past the end fails, including in the padding of the last byte.
+	Reader.Read(8);
+	TestAssert(Reader.HasError());
+	TestAssert(Reader.Read(1) == 0);
+}
+
+QuantizedBasicInfo MakeState(i32 Time, i32 x, i32 y, i32 z)
+{
+	QuantizedBasicInfo State{};
+	State.Time = Time;
+	State.Pos[0] = x;
+	State.Pos[1] = y;
+	State.Pos[2] = z;
+	State.Vel[0] = 300;
+	State.Dir.Yaw = 10;
+	State.LowerAni = 1;
+	State.UpperAni = 0;
+	State.Slot = 2;
+	return State;
+}
+
+bool SameEntries(const BasicInfoSnapshot& a, const BasicInfoSnapshot& b)
+{
+	if (a.ID != b.ID || a.Entries.size() != b.Entries.size())
+		return false;
+	for (size_t i = 0; i < a.Entries.size(); ++i)
+		if (a.Entries[i].UID != b.Entries[i].UID || a.Entries[i].State != b.Entries[i].State)
+			return false;
+	return true;
+}
+
+// Encodes Current against Baseline, decodes it with History and checks that it comes out the same.
+bool RoundTrip(BasicInfoSnapshot& Current, const BasicInfoSnapshot* Baseline,
+	const BasicInfoSnapshotHistory& History, std::vector<size_t>& Changed, size_t* Bytes = nullptr)
+{
+	MBitWriter Writer;
+	EncodeBasicInfoSnapshot(Current, Baseline, Writer);
+	if (Bytes)
+		*Bytes = Writer.GetData().size();
+
+	MBitReader Reader{Writer.GetData().data(), Writer.GetData().size()};
+	BasicInfoSnapshot Decoded;
+	Changed.clear();
+	if (!DecodeBasicInfoSnapshot(Reader, History, Decoded, &Changed))
+		return false;
+	return SameEntries(Current, Decoded);
+}
+
+void TestSnapshots()
+{
+	BasicInfoSnapshotHistory History;
+	std::vector<size_t> Changed;
+
+	BasicInfoSnapshot First;
+	First.ID = 1;
+	First.Entries.push_back({MUID(0, 1), MakeState(1000, 100, 200, 0)});
+	First.Entries.push_back({MUID(0, 2), MakeState(1000, -5000, 70000, -300)});
+	First.Entries.push_back({MUID(0, 3), MakeState(1000, 0, 0, 0)});
+	TestAssert(RoundTrip(First, nullptr, History, Changed));
+	TestAssert(Changed.size() == 3);
+	History.Add(First);
+
+	// Player 2 is gone, player 4 is new, player 1 moved and player 3 didn't.
+	BasicInfoSnapshot Second;
+	Second.ID = 2;
+	Second.Entries.push_back({MUID(0, 4), MakeState(1033, 1, 2, 3)});
+	Second.Entries.push_back({MUID(0, 3), First.Entries[2].State});
+	auto Moved = MakeState(1033, 110, 190, 5);
+	Moved.LowerAni = 7;
+	Moved.HasCamDir = true;
+	Moved.CamDir.Pitch = -20;
+	Second.Entries.push_back({MUID(0, 1), Moved});
+
+	size_t DeltaBytes, FullBytes;
+	{
+		auto Copy = Second;
+		std::vector<size_t> Unused;
+		TestAssert(RoundTrip(Copy, nullptr, History, Unused, &FullBytes));
+	}
+	TestAssert(RoundTrip(Second, History.Find(1), History, Changed, &DeltaBytes));
+	TestAssert(DeltaBytes < FullBytes);
+
+	// The entries are reordered to match the baseline, and only the ones that changed are
+	// reported.
+	TestAssert(Second.Entries.size() == 3);
+	TestAssert(Second.Entries[0].UID == MUID(0, 1));
+	TestAssert(Second.Entries[1].UID == MUID(0, 3));
+	TestAssert(Second.Entries[2].UID == MUID(0, 4));
+	TestAssert(Changed.size() == 2);
+	TestAssert(Changed[0] == 0 && Changed[1] == 2);
+
+	// A baseline the decoder doesn't have can't be decoded.
+	BasicInfoSnapshot Third = Second;
+	Third.ID = 3;
+	BasicInfoSnapshot Unknown = First;
+	Unknown.ID = 100;
+	TestAssert(!RoundTrip(Third, &Unknown, History, Changed));
+
+	// Neither can truncated data.
+	MBitWriter Writer;
+	EncodeBasicInfoSnapshot(Third, nullptr, Writer);
+	for (size_t Size = 0; Size < Writer.GetData().size(); ++Size)
+	{
+		MBitReader Reader{Writer.GetData().data(), Size};
+		BasicInfoSnapshot Decoded;
+		TestAssert(!DecodeBasicInfoSnapshot(Reader, History, Decoded));
+	}
+
+	// Old snapshots fall out of the history.
+	for (u32 ID = 2; ID < 2 + BasicInfoSnapshotHistory::Size; ++ID)
+	{
+		auto Snapshot = First;
+		Snapshot.ID = ID;
+		History.Add(Snapshot);
+	}
+	TestAssert(!History.Find(1));
+	TestAssert(History.Find(2 + BasicInfoSnapshotHistory::Size - 1));
+	TestAssert(!History.Find(0));
+}
+
+// Simulates a 16 player battle in server-based netcode and measures the bytes each client
+// receives per second, once with every player's basic info relayed to everyone else as it
+// arrives, and once with a snapshot per client per tick.
+struct SimPlayer
+{
+	MUID UID;
+	float Pos[3];
+	float Vel[3];
+	float Yaw;
+	float YawSpeed;
+	QuantizedBasicInfo State;
+};
+
+constexpr int PlayerCount = 16;
+constexpr int TickRate = 1000 / BASICINFO_INTERVAL;
+constexpr int Seconds = 10;
+
+// The UDP and IPv4 headers, which every datagram pays for.
+constexpr size_t DatagramOverhead = 8 + 20;
+// The packet header, and the command's size, ID and serial number.
+constexpr size_t CommandOverhead = sizeof(MPacketHeader) + 2 + 2 + 1;
+
+void UpdatePlayer(SimPlayer& Player, std::mt19937& rng, int Tick)
+{
+	std::uniform_real_distribution<float> Uniform{0, 1};
+	constexpr auto dt = BASICINFO_INTERVAL / 1000.f;
+
+	// Running around, turning now and then, and jumping every few seconds.
+	if (Uniform(rng) < 0.05f)
+		Player.YawSpeed = (Uniform(rng) - 0.5f) * 6;
+	Player.Yaw += Player.YawSpeed * dt;
+	Player.Vel[0] = cos(Player.Yaw) * 500;
+	Player.Vel[1] = sin(Player.Yaw) * 500;
+	if (Player.Pos[2] <= 0 && Uniform(rng) < 0.01f)
+		Player.Vel[2] = 600;
+	else if (Player.Pos[2] > 0)
+		Player.Vel[2] -= 1500 * dt;
+	for (int i = 0; i < 3; ++i)
+		Player.Pos[i] += Player.Vel[i] * dt;
+	if (Player.Pos[2] < 0)
+	{
+		Player.Pos[2] = 0;
+		Player.Vel[2] = 0;
+	}
+
+	CharacterInfo Info;
+	Info.Pos = v3(Player.Pos[0], Player.Pos[1], Player.Pos[2]);
+	Info.Vel = v3(Player.Vel[0], Player.Vel[1], Player.Vel[2]);
+	Info.Dir = v3(cos(Player.Yaw), sin(Player.Yaw), 0);
+	Info.CamDir = Info.Dir;
+	Info.HasCamDir = false;
+	Info.LowerAni = Player.Pos[2] > 0 ? ZC_STATE_LOWER_JUMP_UP : ZC_STATE_LOWER_RUN_FORWARD;
+	Info.UpperAni = ZC_STATE_UPPER_NONE;
+	Info.Slot = Tick % (TickRate * 4) < TickRate ? MMCIP_MELEE : MMCIP_PRIMARY;
+	Player.State = QuantizeBasicInfo(Info, Tick * dt);
+}
+
+void TestBandwidth()
+{
+	std::mt19937 rng{4321};
+	std::uniform_real_distribution<float> Uniform{0, 1};
+
+	std::vector<SimPlayer> Players(PlayerCount);
+	for (int i = 0; i < PlayerCount; ++i)
+	{
+		auto& Player = Players[i];
+		Player.UID = MUID(0, 100 + i);
+		Player.Pos[0] = (Uniform(rng) - 0.5f) * 6000;
+		Player.Pos[1] = (Uniform(rng) - 0.5f) * 6000;
+		Player.Pos[2] = 0;
+		Player.Yaw = Uniform(rng) * 6.28f;
+		Player.YawSpeed = 0;
+	}
+
+	// Each client's snapshot state, with 5% of the snapshots lost and the acks taking three ticks
+	// to get back to the server.
+	constexpr float Loss = 0.05f;
+	constexpr int AckDelay = 3;
+	struct Client
+	{
+		BasicInfoSnapshotHistory ServerSent;
+		BasicInfoSnapshotHistory Received;
+		u32 AckedID = 0;
+		std::deque<std::pair<int, u32>> AcksInFlight;
+	};
+	std::vector<Client> Clients(PlayerCount);
+
+	size_t LegacyBytes = 0, SnapshotBytes = 0;
+	bool AllDecoded = true;
+
+	for (int Tick = 0; Tick < TickRate * Seconds; ++Tick)
+	{
+		for (auto&& Player : Players)
+			UpdatePlayer(Player, rng, Tick);
+
+		// Relays, where each player's packet reaches the other 15 as its own datagram.
+		for (auto&& Player : Players)
+		{
+			CharacterInfo Info;
+			float Time;
+			DequantizeBasicInfo(Player.State, Info, Time);
+			BasicInfoNetState NetState;
+			std::unique_ptr<MCommandParameterBlob> Blob{PackNewBasicInfo(Info, NetState, Time)};
+			// The UID and blob parameters of MC_MATCH_P2P_COMMAND, around the tunnelled
+			// MC_PEER_BASICINFO_RG command.
+			auto RelaySize = DatagramOverhead + CommandOverhead + 8 + 4 +
+				CommandOverhead - sizeof(MPacketHeader) + 4 + Blob->GetPayloadSize();
+			LegacyBytes += RelaySize * (PlayerCount - 1);
+		}
+
+		// Snapshots, where each client gets one datagram with everyone else.
+		for (int i = 0; i < PlayerCount; ++i)
+		{
+			auto& Client = Clients[i];
+
+			while (!Client.AcksInFlight.empty() && Client.AcksInFlight.front().first <= Tick)
+			{
+				auto ID = Client.AcksInFlight.front().second;
+				if (Client.AckedID == 0 || IsNewerSequence(ID, Client.AckedID))
+					Client.AckedID = ID;
+				Client.AcksInFlight.pop_front();
+			}
+
+			BasicInfoSnapshot Snapshot;
+			Snapshot.ID = u32(Tick + 1);
+			for (int j = 0; j < PlayerCount; ++j)
+				if (j != i)
+					Snapshot.Entries.push_back({Players[j].UID, Players[j].State});
+
+			MBitWriter Writer;
+			EncodeBasicInfoSnapshot(Snapshot, Client.ServerSent.Find(Client.AckedID), Writer);
+			Client.ServerSent.Add(Snapshot);
+			// The blob parameter of MC_MATCH_BASICINFO_SNAPSHOT.
+			SnapshotBytes += DatagramOverhead + CommandOverhead + 4 + Writer.GetData().size();
+
+			if (Uniform(rng) < Loss)
+				continue;
+
+			MBitReader Reader{Writer.GetData().data(), Writer.GetData().size()};
+			BasicInfoSnapshot Decoded;
+			if (!DecodeBasicInfoSnapshot(Reader, Client.Received, Decoded) ||
+				!SameEntries(Snapshot, Decoded))
+			{
+				AllDecoded = false;
+				continue;
+			}
+			Client.Received.Add(std::move(Decoded));
+			Client.AcksInFlight.emplace_back(Tick + AckDelay, Snapshot.ID);
+		}
+	}
+
+	auto PerPlayerSecond = [&](size_t Bytes) { return double(Bytes) / PlayerCount / Seconds; };
+	auto Legacy = PerPlayerSecond(LegacyBytes);
+	auto Snapshots = PerPlayerSecond(SnapshotBytes);
+	MLog("Basic info received per player per second with %d players at %d Hz: "
+		"relayed %.0f bytes, snapshots %.0f bytes (%.0f%%)\n",
+		PlayerCount, TickRate, Legacy, Snapshots, Snapshots / Legacy * 100);
+
+	TestAssert(AllDecoded);
+	TestAssert(Snapshots < Legacy / 2);
+}
+
+}
+
+void TestBasicInfoSnapshot()
+{
+	TestBits();
+	TestSnapshots();
+	TestBandwidth();
+}
@@ -0,0 +1,278 @@
+#include <chrono>
+#include <random>
+#include <vector>
+#include "MCommandBuilder.h"
+#include "MCommandBudget.h"
+#include "MSharedCommandTable.h"
+#include "MTime.h"
+#include "MDebug.h"
+#include "TestAssert.h"
+
+namespace {
+
+constexpr auto ChatCategory = size_t(MCommandBudgetCategory::Chat);
+
+void TestBudgetBuckets()
+{
+	MCommandBudgetParams Params;
+	// No refill of the total, to count exactly what's spent of it.
+	Params.Commands = {0, 20};
+	Params.Categories[ChatCategory] = {2, 5};
+	Params.Bytes = {1000, 2000};
+	MCommandBudgetStats Stats;
+	MCommandBudget Budget{Params, Stats};
+	u64 Now = 1000000;
+
+	// The chat burst goes through, then only the chat rate, while other commands still do.
+	for (int i = 0; i < 5; ++i)
+		TestAssert(Budget.ConsumeCommand(MC_MATCH_STAGE_CHAT, nullptr, Now) ==
+			MCommandBudget::Result::Accept);
+	TestAssert(Budget.ConsumeCommand(MC_MATCH_STAGE_CHAT, nullptr, Now) ==
+		MCommandBudget::Result::Drop);
+	TestAssert(Budget.ConsumeCommand(MC_NET_ECHO, nullptr, Now) == MCommandBudget::Result::Accept);
+	TestAssert(Budget.ConsumeCommand(MC_MATCH_STAGE_CHAT, nullptr, Now + 499) ==
+		MCommandBudget::Result::Drop);
+	TestAssert(Budget.ConsumeCommand(MC_MATCH_STAGE_CHAT, nullptr, Now + 500) ==
+		MCommandBudget::Result::Accept);
+
+	// Dropped chat didn't spend the total budget, so 20 - 7 are left of it.
+	for (int i = 0; i < 13; ++i)
+		TestAssert(Budget.ConsumeCommand(MC_NET_ECHO, nullptr, Now + 500) ==
+			MCommandBudget::Result::Accept);
+	TestAssert(Budget.ConsumeCommand(MC_NET_ECHO, nullptr, Now + 500) ==
+		MCommandBudget::Result::Drop);
+
+	TestAssert(Budget.GetDroppedCommands() == 3);
+	TestAssert(Stats.DroppedCommands == 3);
+	TestAssert(Stats.DroppedByCategory[ChatCategory] == 2);
+	TestAssert(Stats.Disconnects == 0);
+
+	TestAssert(Budget.ConsumeBytes(2000, Now));
+	TestAssert(!Budget.ConsumeBytes(1, Now));
+	TestAssert(Budget.ConsumeBytes(1000, Now + 1000));
+	TestAssert(Stats.Disconnects == 1);
+
+	TestAssert(GetCommandBudgetCategory(MC_MATCH_P2P_COMMAND_UDP, nullptr) ==
+		MCommandBudgetCategory::Peer);
+
+	// Disabled budgets accept anything.
+	Budget.Disable();
+	TestAssert(Budget.ConsumeBytes(1000000, Now + 1000));
+	TestAssert(Budget.ConsumeCommand(MC_MATCH_STAGE_CHAT, nullptr, Now + 1000) ==
+		MCommandBudget::Result::Accept);
+
+	Params.Disconnect = true;
+	MCommandBudget Strict{Params, Stats};
+	for (int i = 0; i < 5; ++i)
+		Strict.ConsumeCommand(MC_PEER_CHAT, nullptr, Now);
+	TestAssert(Strict.ConsumeCommand(MC_PEER_CHAT, nullptr, Now) ==
+		MCommandBudget::Result::Disconnect);
+	TestAssert(Stats.Disconnects == 2);
+}
+
+void AppendRawCommand(std::vector<char>& Stream, MCommand& Cmd)
+{
+	char Data[MAX_PACKET_SIZE];
+	const int nSize = Cmd.GetData(Data, sizeof(Data));
+	const auto Offset = Stream.size();
+	Stream.resize(Offset + sizeof(MPacketHeader) + nSize);
+
+	auto* pMsg = reinterpret_cast<MCommandMsg*>(Stream.data() + Offset);
+	pMsg->nMsg = MSGID_RAWCOMMAND;
+	pMsg->nSize = u16(sizeof(MPacketHeader) + nSize);
+	memcpy(pMsg->Buffer, Data, nSize);
+	pMsg->nCheckSum = MBuildCheckSum(pMsg, pMsg->nSize);
+}
+
+// A stream of CommandCount commands, one in ChatEvery of which are chat.
+std::vector<char> MakeFloodStream(MCommandManager& CM, int CommandCount, int ChatEvery)
+{
+	std::vector<char> Stream;
+	for (int i = 0; i < CommandCount; ++i)
+	{
+		if (i % ChatEvery == 0)
+		{
+			MCommand Cmd{MC_MATCH_STAGE_CHAT, MUID(0, 1), MUID(0, 2), &CM};
+			Cmd.AddParameter(new MCmdParamUID(MUID(0, 1)));
+			Cmd.AddParameter(new MCmdParamUID(MUID(0, 2)));
+			Cmd.AddParameter(new MCmdParamStr("flood flood flood"));
+			AppendRawCommand(Stream, Cmd);
+		}
+		else
+		{
+			MCommand Cmd{MC_NET_ECHO, MUID(0, 1), MUID(0, 2), &CM};
+			Cmd.AddParameter(new MCmdParamStr("echo"));
+			AppendRawCommand(Stream, Cmd);
+		}
+	}
+	return Stream;
+}
+
+struct FloodResult
+{
+	bool Connected;
+	int Commands;
+	int ChatCommands;
+	size_t MaxTickCommands;
+	double MaxTickMS;
+	double Seconds;
+};
+
+// Feeds a stream to a command builder in socket-sized reads, and drains what it decodes every few
+// reads like a server tick would, deleting the commands in place of handling them.
+FloodResult Flood(MCommandManager& CM, const std::vector<char>& Stream,
+	const MCommandBudgetParams* Params, MCommandBudgetStats& Stats)
+{
+	constexpr size_t ReadSize = 4096;
+	constexpr int ReadsPerTick = 16;
+
+	MCommandBuilder Builder{MUID(0, 1), MUID(0, 2), &CM};
+	Builder.SetCheckCommandSN(false);
+	if (Params)
+		Builder.SetBudget(std::make_unique<MCommandBudget>(*Params, Stats));
+
+	FloodResult Result{true, 0, 0, 0, 0, 0};
+	const auto Start = std::chrono::steady_clock::now();
+	for (size_t Offset = 0, Reads = 0; Offset < Stream.size(); Offset += ReadSize)
+	{
+		const auto Size = (std::min)(ReadSize, Stream.size() - Offset);
+		if (!Builder.Read(const_cast<char*>(Stream.data() + Offset), int(Size)))
+		{
+			Result.Connected = false;
+			break;
+		}
+
+		if (++Reads % ReadsPerTick != 0 && Offset + Size < Stream.size())
+			continue;
+
+		const auto TickStart = std::chrono::steady_clock::now();
+		size_t TickCommands = 0;
+		while (MCommand* pCmd = Builder.GetCommand())
+		{
+			++TickCommands;
+			if (pCmd->GetID() == MC_MATCH_STAGE_CHAT)
+				++Result.ChatCommands;
+			delete pCmd;
+		}
+		const auto TickTime = std::chrono::duration<double, std::milli>(
+			std::chrono::steady_clock::now() - TickStart).count();
+		Result.Commands += int(TickCommands);
+		Result.MaxTickCommands = (std::max)(Result.MaxTickCommands, TickCommands);
+		Result.MaxTickMS = (std::max)(Result.MaxTickMS, TickTime);
+	}
+	Result.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+
+	while (MCommand* pCmd = Builder.GetCommand())
+		delete pCmd;
+
+	return Result;
+}
+
+void LogFlood(const char* Name, const FloodResult& Result)
+{
+	MLog("Command budget flood, %s: %d commands (%d chat) accepted in %.3f s, "
+		"at most %zu commands and %.3f ms per tick%s\n",
+		Name, Result.Commands, Result.ChatCommands, Result.Seconds,
+		Result.MaxTickCommands, Result.MaxTickMS, Result.Connected ? "" : ", disconnected");
+}
+
+void TestBuilderFlood()
+{
+	constexpr int CommandCount = 200000;
+	constexpr int ChatEvery = 4;
+
+	MCommandManager CM;
+	MAddSharedCommandTable(&CM, MSharedCommandType::MatchServer);
+	const auto Stream = MakeFloodStream(CM, CommandCount, ChatEvery);
+
+	MCommandBudgetStats Stats;
+	const auto Unlimited = Flood(CM, Stream, nullptr, Stats);
+	LogFlood("unlimited", Unlimited);
+	TestAssert(Unlimited.Connected);
+	TestAssert(Unlimited.Commands == CommandCount);
+
+	// Only the bytes are unlimited, so that the command budgets are what's measured.
+	MCommandBudgetParams Params;
+	Params.Bytes = {u32(Stream.size()), u32(Stream.size())};
+	const auto Limited = Flood(CM, Stream, &Params, Stats);
+	LogFlood("limited", Limited);
+	TestAssert(Limited.Connected);
+	auto MaxAccepted = [&](const MCommandBudgetParams::Rate& Rate) {
+		return int(Rate.Burst + Rate.PerSecond * (Limited.Seconds + 0.1));
+	};
+	TestAssert(Limited.Commands <= MaxAccepted(Params.Commands));
+	TestAssert(Limited.ChatCommands >= int(Params.Categories[ChatCategory].Burst));
+	TestAssert(Limited.ChatCommands <= MaxAccepted(Params.Categories[ChatCategory]));
+	TestAssert(Stats.DroppedCommands == u64(CommandCount - Limited.Commands));
+	TestAssert(Stats.Disconnects == 0);
+
+	// Going over the budget disconnects on the first command over it.
+	Params.Disconnect = true;
+	const auto Disconnected = Flood(CM, Stream, &Params, Stats);
+	LogFlood("disconnecting", Disconnected);
+	TestAssert(!Disconnected.Connected);
+	TestAssert(Stats.Disconnects == 1);
+
+	// And so does going over the byte budget, before anything in the read is decoded.
+	Params = MCommandBudgetParams{};
+	Params.Bytes = {1024, 4096};
+	const auto OverBytes = Flood(CM, Stream, &Params, Stats);
+	TestAssert(!OverBytes.Connected);
+	TestAssert(OverBytes.Commands == 0);
+	TestAssert(Stats.Disconnects == 2);
+}
+
+// Streams split into reads of random sizes, so that commands straddle reads, are budgeted the same
+// as whole ones.
+void TestBuilderSplitReads()
+{
+	constexpr int Rounds = 200;
+
+	MCommandManager CM;
+	MAddSharedCommandTable(&CM, MSharedCommandType::MatchServer);
+	const auto Stream = MakeFloodStream(CM, 2000, 2);
+
+	std::mt19937 rng{9876};
+	MCommandBudgetParams Params;
+	MCommandBudgetStats Stats;
+	for (int Round = 0; Round < Rounds; ++Round)
+	{
+		MCommandBuilder Builder{MUID(0, 1), MUID(0, 2), &CM};
+		Builder.SetCheckCommandSN(false);
+		Builder.SetBudget(std::make_unique<MCommandBudget>(Params, Stats));
+
+		int Commands = 0;
+		int ChatCommands = 0;
+		const auto Start = GetGlobalTimeMS();
+		for (size_t Offset = 0; Offset < Stream.size();)
+		{
+			const auto Size = (std::min)(size_t(1 + rng() % 2048), Stream.size() - Offset);
+			TestAssert(Builder.Read(const_cast<char*>(Stream.data() + Offset), int(Size)));
+			Offset += Size;
+			while (MCommand* pCmd = Builder.GetCommand())
+			{
+				++Commands;
+				if (pCmd->GetID() == MC_MATCH_STAGE_CHAT)
+					++ChatCommands;
+				delete pCmd;
+			}
+		}
+
+		const auto Seconds = (GetGlobalTimeMS() - Start + 1) / 1000.0;
+		auto& Chat = Params.Categories[ChatCategory];
+		TestAssert(Commands <= int(Params.Commands.Burst + Params.Commands.PerSecond * Seconds));
+		TestAssert(ChatCommands >= int(Chat.Burst));
+		TestAssert(ChatCommands <= int(Chat.Burst + Chat.PerSecond * Seconds));
+	}
+
+	TestAssert(Stats.Disconnects == 0);
+}
+
+}
+
+void TestCommandBudget()
+{
+	TestBudgetBuckets();
+	TestBuilderFlood();
+	TestBuilderSplitReads();
+}
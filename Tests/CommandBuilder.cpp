@@ -0,0 +1,270 @@
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "MCommandBuilder.h"
+#include "MSharedCommandTable.h"
+#include "MMatchUtil.h"
+#include "MDebug.h"
+#include "TestAssert.h"
+
+namespace {
+
+// Appends a command as a packet, encrypted if pKey is set.
+void AppendCommandPacket(std::vector<char>& Stream, const MCommand& Cmd, MPacketCrypterKey* pKey)
+{
+	char Data[MAX_PACKET_SIZE];
+	const int nSize = Cmd.GetData(Data, sizeof(Data));
+	const auto Offset = Stream.size();
+	Stream.resize(Offset + sizeof(MPacketHeader) + nSize);
+
+	auto* pMsg = reinterpret_cast<MCommandMsg*>(Stream.data() + Offset);
+	pMsg->nMsg = pKey ? MSGID_COMMAND : MSGID_RAWCOMMAND;
+	pMsg->nSize = u16(sizeof(MPacketHeader) + nSize);
+	memcpy(pMsg->Buffer, Data, nSize);
+	if (pKey)
+	{
+		MPacketCrypter::Encrypt(reinterpret_cast<char*>(&pMsg->nSize), sizeof(pMsg->nSize), pKey);
+		MPacketCrypter::Encrypt(pMsg->Buffer, nSize, pKey);
+	}
+	pMsg->nCheckSum = MBuildCheckSum(pMsg, int(sizeof(MPacketHeader) + nSize));
+}
+
+void AppendReplyConnect(std::vector<char>& Stream, u32 nTimeStamp)
+{
+	MReplyConnectMsg Msg;
+	Msg.nMsg = MSGID_REPLYCONNECT;
+	Msg.nSize = sizeof(Msg);
+	Msg.nHostHigh = 0;
+	Msg.nHostLow = 1;
+	Msg.nAllocHigh = 0;
+	Msg.nAllocLow = 2;
+	Msg.nTimeStamp = nTimeStamp;
+	const auto* p = reinterpret_cast<const char*>(&Msg);
+	Stream.insert(Stream.end(), p, p + sizeof(Msg));
+}
+
+struct CommandStream
+{
+	std::vector<char> Bytes;
+	// GetData of each command, to compare the decoded ones to.
+	std::vector<std::vector<char>> Commands;
+	int ReplyConnects = 0;
+};
+
+// Mostly small commands, with blobs of up to nearly the largest packet size in between, and
+// every ReplyConnectEvery commands a reply connect message.
+CommandStream MakeCommandStream(MCommandManager& CM, int CommandCount, MPacketCrypterKey* pKey,
+	int ReplyConnectEvery, u32 Seed)
+{
+	std::mt19937 rng{Seed};
+	CommandStream Stream;
+	std::vector<char> Blob(MAX_PACKET_SIZE);
+	for (auto&& c : Blob)
+		c = char(rng());
+
+	for (int i = 0; i < CommandCount; ++i)
+	{
+		MCommand Cmd;
+		if (i % 16 == 15)
+		{
+			Cmd.SetID(MC_MATCH_SEND_VOICE_CHAT, &CM);
+			const auto Size = 1 + rng() % (MAX_PACKET_SIZE - 64);
+			Cmd.AddParameter(new MCmdParamBlob(Blob.data(), int(Size)));
+		}
+		else
+		{
+			Cmd.SetID(MC_NET_ECHO, &CM);
+			char Message[64];
+			sprintf_safe(Message, "echo %d", i);
+			Cmd.AddParameter(new MCmdParamStr(Message));
+		}
+		Cmd.m_nSerialNumber = u8(i);
+
+		AppendCommandPacket(Stream.Bytes, Cmd, pKey);
+		Stream.Commands.emplace_back(Cmd.GetSize());
+		Cmd.GetData(Stream.Commands.back().data(), int(Stream.Commands.back().size()));
+
+		if (ReplyConnectEvery && i % ReplyConnectEvery == 0)
+		{
+			AppendReplyConnect(Stream.Bytes, u32(i));
+			++Stream.ReplyConnects;
+		}
+	}
+	return Stream;
+}
+
+// Reads the stream in fragments of random sizes up to MaxFragment, and checks that exactly the
+// commands in it come out, in order.
+void CheckFragmentedRead(MCommandManager& CM, const CommandStream& Stream, MPacketCrypter* pCrypter,
+	int MaxFragment, std::mt19937& rng)
+{
+	auto Bytes = Stream.Bytes;
+	MCommandBuilder Builder{MUID(0, 1), MUID(0, 2), &CM};
+	Builder.SetCheckCommandSN(false);
+	if (pCrypter)
+		Builder.InitCrypt(pCrypter, false);
+
+	size_t Decoded = 0;
+	int ReplyConnects = 0;
+	std::vector<char> Data;
+	for (size_t Offset = 0; Offset < Bytes.size();)
+	{
+		const auto Size = (std::min)(size_t(1 + rng() % MaxFragment), Bytes.size() - Offset);
+		TestAssert(Builder.Read(Bytes.data() + Offset, int(Size)));
+		Offset += Size;
+
+		while (MCommand* pCmd = Builder.GetCommand())
+		{
+			TestAssert(Decoded < Stream.Commands.size());
+			auto& Expected = Stream.Commands[Decoded];
+			Data.resize(pCmd->GetSize());
+			pCmd->GetData(Data.data(), int(Data.size()));
+			TestAssert(Data == Expected);
+			TestAssert(pCmd->m_Sender == MUID(0, 1) && pCmd->m_Receiver == MUID(0, 2));
+			++Decoded;
+			delete pCmd;
+		}
+		while (MPacketHeader* pNetCmd = Builder.GetNetCommand())
+		{
+			TestAssert(pNetCmd->nMsg == MSGID_REPLYCONNECT);
+			TestAssert(reinterpret_cast<MReplyConnectMsg*>(pNetCmd)->nAllocLow == 2);
+			++ReplyConnects;
+			free(pNetCmd);
+		}
+	}
+
+	TestAssert(Decoded == Stream.Commands.size());
+	TestAssert(ReplyConnects == Stream.ReplyConnects);
+	TestAssert(Builder.GetPendingSize() == 0);
+}
+
+void TestFragmentedReads()
+{
+	MCommandManager CM;
+	MAddSharedCommandTable(&CM, MSharedCommandType::MatchServer);
+
+	MPacketCrypterKey Key;
+	MMakeSeedKey(&Key, MUID(0, 1), MUID(0, 2), 12345);
+	MPacketCrypter Crypter;
+	Crypter.InitKey(&Key);
+
+	const auto Raw = MakeCommandStream(CM, 500, nullptr, 50, 1);
+	const auto Encrypted = MakeCommandStream(CM, 500, &Key, 0, 2);
+
+	std::mt19937 rng{4444};
+	for (int MaxFragment : {1, 5, 100, 1460, 20000, 100000})
+	{
+		CheckFragmentedRead(CM, Raw, nullptr, MaxFragment, rng);
+		CheckFragmentedRead(CM, Encrypted, &Crypter, MaxFragment, rng);
+	}
+}
+
+// Encrypted packets that arrive before the key is set wait until it is, like the commands a
+// server sends right after its reply connect message.
+void TestPacketsBeforeKey()
+{
+	MCommandManager CM;
+	MAddSharedCommandTable(&CM, MSharedCommandType::MatchServer);
+
+	MPacketCrypterKey Key;
+	MMakeSeedKey(&Key, MUID(0, 1), MUID(0, 2), 6789);
+	MPacketCrypter Crypter;
+	Crypter.InitKey(&Key);
+	auto Stream = MakeCommandStream(CM, 20, &Key, 0, 3);
+
+	MCommandBuilder Builder{MUID(0, 1), MUID(0, 2), &CM};
+	Builder.SetCheckCommandSN(false);
+	const auto Half = Stream.Bytes.size() / 2;
+	TestAssert(Builder.Read(Stream.Bytes.data(), int(Half)));
+	TestAssert(Builder.GetCommand() == nullptr);
+	TestAssert(size_t(Builder.GetPendingSize()) == Half);
+
+	Builder.InitCrypt(&Crypter, false);
+	TestAssert(Builder.Read(Stream.Bytes.data() + Half, int(Stream.Bytes.size() - Half)));
+	size_t Decoded = 0;
+	while (MCommand* pCmd = Builder.GetCommand())
+	{
+		++Decoded;
+		delete pCmd;
+	}
+	TestAssert(Decoded == Stream.Commands.size());
+
+	// Without the key ever coming, the stream is dropped instead of buffered without bound.
+	MCommandBuilder Stalled{MUID(0, 1), MUID(0, 2), &CM};
+	bool Connected = true;
+	for (int i = 0; i < 100 && Connected; ++i)
+		Connected = Stalled.Read(Stream.Bytes.data(), int(Stream.Bytes.size()));
+	TestAssert(!Connected);
+}
+
+void TestMalformedPackets()
+{
+	MCommandManager CM;
+	MAddSharedCommandTable(&CM, MSharedCommandType::MatchServer);
+
+	// A packet too short for its own header.
+	MPacketHeader Header;
+	Header.nMsg = MSGID_RAWCOMMAND;
+	Header.nSize = 2;
+	Header.nCheckSum = MBuildCheckSum(&Header, Header.nSize);
+	char Bytes[sizeof(Header) * 2]{};
+	memcpy(Bytes, &Header, sizeof(Header));
+	MCommandBuilder Builder{MUID(0, 1), MUID(0, 2), &CM};
+	TestAssert(!Builder.Read(Bytes, sizeof(Bytes)));
+
+	// An unknown message type.
+	Header.nMsg = 12345;
+	Header.nSize = sizeof(Header);
+	memcpy(Bytes, &Header, sizeof(Header));
+	MCommandBuilder Unknown{MUID(0, 1), MUID(0, 2), &CM};
+	TestAssert(!Unknown.Read(Bytes, sizeof(Header)));
+}
+
+// Reads a stream of mostly small commands split into fragments of one size, like a TCP stream
+// cut up by the network, and returns the MB/s decoded.
+double MeasureFragmentedRead(MCommandManager& CM, const CommandStream& Stream, int Fragment)
+{
+	constexpr int Repeats = 5;
+
+	auto Bytes = Stream.Bytes;
+	size_t Decoded = 0;
+	const auto Start = std::chrono::steady_clock::now();
+	for (int i = 0; i < Repeats; ++i)
+	{
+		MCommandBuilder Builder{MUID(0, 1), MUID(0, 2), &CM};
+		Builder.SetCheckCommandSN(false);
+		for (size_t Offset = 0; Offset < Bytes.size(); Offset += Fragment)
+		{
+			const auto Size = (std::min)(size_t(Fragment), Bytes.size() - Offset);
+			TestAssert(Builder.Read(Bytes.data() + Offset, int(Size)));
+			while (MCommand* pCmd = Builder.GetCommand())
+			{
+				++Decoded;
+				delete pCmd;
+			}
+		}
+	}
+	const auto Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+	TestAssert(Decoded == Stream.Commands.size() * Repeats);
+
+	const auto MBps = Bytes.size() * Repeats / Seconds / (1024 * 1024);
+	MLog("Command builder, %d byte reads: %.1f MB/s, %.0f commands/s\n",
+		Fragment, MBps, Decoded / Seconds);
+	return MBps;
+}
+
+}
+
+void TestCommandBuilder()
+{
+	TestFragmentedReads();
+	TestPacketsBeforeKey();
+	TestMalformedPackets();
+
+	MCommandManager CM;
+	MAddSharedCommandTable(&CM, MSharedCommandType::MatchServer);
+	const auto Stream = MakeCommandStream(CM, 20000, nullptr, 0, 4);
+	for (int Fragment : {7, 64, 536, 1460, 8192, 65536})
+		MeasureFragmentedRead(CM, Stream, Fragment);
+}
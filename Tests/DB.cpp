@@ -3,9 +3,15 @@
 #include <random>
 #include <array>
 #include <chrono>
+#include <ctime>
+#include <thread>
 #include "IDatabase.h"
 #include "SQLiteDatabase.h"
 #include "MSSQLDatabase.h"
+#include "CachedDatabase.h"
+#include "DBLogSink.h"
+#include "MDatabasePool.h"
+#include "ODBCRecordset.h"
 #include "MMatchConfig.h"
 #include "MMatchGlobal.h"
 #include "MMatchObject.h"
@@ -176,9 +182,8 @@ void CheckCharInfo(IDatabase* DB, u32 AID, int CharIndex, const MMatchCharInfo&
 }
 
 void TestCharAttributes(IDatabase* DB, u32 AID, int CharIndex, int CID,
-	const MMatchCharInfo& InitialAttributes)
+	MMatchCharInfo ExpectedAttributes)
 {
-	auto ExpectedAttributes = InitialAttributes;
 	auto CheckCharInfo = [&] {
 		return TestDBInternal::CheckCharInfo(DB, AID, CharIndex, ExpectedAttributes);
 	};
@@ -600,13 +605,410 @@ void TestDB(IDatabase* DB)
 	auto CharInfo = CreateChar(DB, AID, Attr);
 	auto CID = CharInfo.m_nCID;
 	const int CharIndex = 0;
-	TestCharAttributes(DB, AID, Attr.CharIndex, CID, CharInfo);
+	char CharName[MATCHOBJECT_NAME_LENGTH];
+	strcpy_safe(CharName, CharInfo.m_szName);
+	TestCharAttributes(DB, AID, Attr.CharIndex, CID, std::move(CharInfo));
 	TestItems(DB, AID, Attr.CharIndex, CID);
 	auto Chars = TestFriends(DB, CID);
 	TestClan(DB, Chars);
 	for (auto&& Char : Chars)
 		TestDeleteChar(DB, Char.AID, Char.CharIndex, Char.Name);
-	TestDeleteChar(DB, AID, Attr.CharIndex, CharInfo.m_szName);
+	TestDeleteChar(DB, AID, Attr.CharIndex, CharName);
+}
+
+// Character writes must drop the owning account's entry even after it was evicted and cached again
+// by a query that doesn't return the CIDs.
+void TestCacheOwnership()
+{
+	DBCache Cache;
+	Cache.SetLimits(1, 0);
+	CachedDatabase DB{std::make_unique<SQLiteDatabase>(":memory:"), Cache};
+
+	auto AID = CreateAccount(&DB);
+	auto CharInfo = CreateChar(&DB, AID, RandomCharAttributes());
+	// Only has room for one account, so this evicts the first one.
+	CreateAccount(&DB);
+
+	auto List = GetCharList(&DB, AID);
+	TestAssert(List && List->CharCount == 1);
+	TestAssert(List->CharList[0].nLevel == CharInfo.m_nLevel);
+	TestAssert(DB.UpdateCharLevel(CharInfo.m_nCID, CharInfo.m_nLevel + 1));
+	List = GetCharList(&DB, AID);
+	TestAssert(List && List->CharList[0].nLevel == CharInfo.m_nLevel + 1);
+
+	// The links are bounded like everything else, and count towards the memory usage.
+	constexpr int CharCount = 64;
+	for (int i = 0; i < CharCount; ++i)
+		CreateChar(&DB, CreateAccount(&DB), RandomCharAttributes());
+	auto Stats = Cache.GetStats();
+	TestAssert(Stats.Owners > 0 && Stats.Owners < CharCount);
+	TestAssert(Stats.MemoryUsage > 0);
+	Cache.Clear();
+	TestAssert(Cache.GetStats().Owners == 0 && Cache.GetStats().MemoryUsage == 0);
+}
+
+// Loads a character with a large inventory repeatedly. On SQLite, the first load after the items
+// change reads every CharacterItem row, and the following ones read the packed inventory blob.
+void BenchmarkInventory(IDatabase* DB)
+{
+	constexpr int ItemCount = 500;
+	constexpr int LoadCount = 100;
+
+	auto AID = CreateAccount(DB);
+	auto CID = CreateChar(DB, AID, RandomCharAttributes()).m_nCID;
+
+	using namespace std::chrono;
+	std::vector<u32> CIIDs;
+	auto Load = [&](size_t& Count) {
+		MMatchCharInfo CharInfo;
+		CharInfo.m_nCID = CID;
+		auto Start = steady_clock::now();
+		TestAssert(DB->GetCharItemInfo(CharInfo));
+		auto Elapsed = duration<double, std::micro>(steady_clock::now() - Start).count();
+		Count = CharInfo.m_ItemList.size();
+		CIIDs.clear();
+		for (auto&& Pair : CharInfo.m_ItemList)
+			CIIDs.push_back(Pair.second->GetCIID());
+		return Elapsed;
+	};
+	auto LoadExpecting = [&](size_t ExpectedCount) {
+		size_t Count;
+		auto Elapsed = Load(Count);
+		TestAssert(Count == ExpectedCount);
+		return Elapsed;
+	};
+	auto Loaded = [&](u32 CIID) {
+		return std::find(CIIDs.begin(), CIIDs.end(), CIID) != CIIDs.end(); };
+
+	// New characters start out with their initial costume.
+	size_t InitialCount;
+	Load(InitialCount);
+
+	// The items need descriptions to be created, which are removed again at the end.
+	std::vector<std::unique_ptr<MMatchItemDesc>> Descs;
+	auto AddDesc = [&] {
+		while (true)
+		{
+			auto ItemID = RandomNumber(1, INT_MAX);
+			auto Desc = std::make_unique<MMatchItemDesc>();
+			Desc->m_nID = ItemID;
+			if (MGetMatchItemDescMgr()->insert({ItemID, Desc.get()}).second)
+			{
+				Descs.push_back(std::move(Desc));
+				return ItemID;
+			}
+		}
+	};
+
+	u32 CIID{};
+	for (int i = 0; i < ItemCount; ++i)
+		TestAssert(DB->InsertCharItem(CID, AddDesc(), false, 0, &CIID));
+
+	auto FirstLoadTime = LoadExpecting(InitialCount + ItemCount);
+	double LoadTime = 0;
+	for (int i = 0; i < LoadCount; ++i)
+		LoadTime += LoadExpecting(InitialCount + ItemCount);
+	LoadTime /= LoadCount;
+
+	MLog("Loading %d items: first load %.1f us, average of the next %d loads %.1f us\n",
+		int(InitialCount + ItemCount), FirstLoadTime, LoadCount, LoadTime);
+
+	// Changing an item updates the blob along with the rows.
+	TestAssert(DB->DeleteCharItem(CID, CIID));
+	LoadExpecting(InitialCount + ItemCount - 1);
+	TestAssert(!Loaded(CIID));
+	TestAssert(DB->InsertCharItem(CID, Descs.front()->m_nID, false, 0, &CIID));
+	LoadExpecting(InitialCount + ItemCount);
+	TestAssert(Loaded(CIID));
+	auto PatchedLoadTime = LoadExpecting(InitialCount + ItemCount);
+
+	MLog("Loading %d items after changing one: %.1f us\n",
+		int(InitialCount + ItemCount), PatchedLoadTime);
+
+	for (auto&& Desc : Descs)
+		MGetMatchItemDescMgr()->erase(Desc->m_nID);
+}
+
+// Only uses plain SQL, so that it also runs against a SQLite ODBC driver.
+void TestPool(const MDatabase::ConnectionDetails& ConnDetails)
+{
+	MDatabasePool::Options Opts;
+	Opts.Size = 2;
+	MDatabasePool Pool{ConnDetails, Opts};
+
+	{
+		auto First = Pool.Acquire();
+		auto Second = Pool.Acquire();
+		TestAssert(First && Second && First.get() != Second.get());
+
+		// The pool is exhausted, so this has to wait until Second is released.
+		MDatabase* Acquired = nullptr;
+		std::thread Thread{[&] { Acquired = Pool.Acquire().get(); }};
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		auto SecondDB = Second.get();
+		Second.Release();
+		Thread.join();
+		TestAssert(Acquired == SecondDB);
+		TestAssert(Pool.GetStats().Waits == 1);
+
+		// It gives up if nothing is released in time.
+		MDatabasePool::Options TimeoutOpts;
+		TimeoutOpts.Size = 1;
+		TimeoutOpts.AcquireTimeout = 50;
+		MDatabasePool TimeoutPool{ConnDetails, TimeoutOpts};
+		auto Held = TimeoutPool.Acquire();
+		TestAssert(Held && !TimeoutPool.Acquire());
+		TestAssert(TimeoutPool.GetStats().Timeouts == 1);
+
+		// A broken connection is reopened before it's handed out again.
+		auto Reconnects = Pool.GetStats().Reconnects;
+		First.MarkBroken();
+		First.Release();
+		auto Third = Pool.Acquire();
+		Third.Release();
+		auto Fourth = Pool.Acquire();
+		TestAssert(Pool.GetStats().Reconnects == Reconnects + 1);
+	}
+
+	constexpr int RowCount = 1000;
+	auto DB = Pool.Acquire();
+	TestAssert(DB);
+	try { DB->ExecuteSQL("DROP TABLE PoolTest"); } catch (CDBException*) {}
+	DB->ExecuteSQL("CREATE TABLE PoolTest (ID int, Name varchar(24))");
+
+	auto Count = [&] {
+		CODBCRecordset rs{DB.get()};
+		rs.Open("SELECT COUNT(*) AS Count FROM PoolTest");
+		return rs.Field("Count").AsInt();
+	};
+
+	using namespace std::chrono;
+	auto Start = steady_clock::now();
+	for (int i = 0; i < RowCount; ++i)
+		DB->ExecuteSQL(strprintf("INSERT INTO PoolTest (ID, Name) VALUES (%d, 'Row%d')", i, i));
+	auto SingleTime = duration<double, std::milli>(steady_clock::now() - Start).count();
+	TestAssert(Count() == RowCount);
+
+	MDatabaseBatch Batch;
+	Batch.AddIntParam().AddStringParam(24);
+	for (int i = 0; i < RowCount; ++i)
+		Batch.AddRow(i, strprintf("Row%d", i));
+	Start = steady_clock::now();
+	DB->ExecuteBatch("INSERT INTO PoolTest (ID, Name) VALUES (?, ?)", Batch);
+	auto BatchTime = duration<double, std::milli>(steady_clock::now() - Start).count();
+	TestAssert(Count() == RowCount * 2);
+
+	// The prepared statement is reused.
+	Batch.Clear();
+	Batch.AddRow(RowCount, "Last");
+	DB->ExecuteBatch("INSERT INTO PoolTest (ID, Name) VALUES (?, ?)", Batch);
+	TestAssert(Count() == RowCount * 2 + 1);
+
+	// 64-bit values aren't truncated.
+	DB->ExecuteSQL("ALTER TABLE PoolTest ADD Big bigint");
+	MDatabaseBatch BigBatch;
+	BigBatch.AddIntParam().AddBigIntParam();
+	BigBatch.AddRow(RowCount + 1, 1LL << 40);
+	DB->ExecuteBatch("INSERT INTO PoolTest (ID, Big) VALUES (?, ?)", BigBatch);
+	{
+		CODBCRecordset rs{DB.get()};
+		rs.Open("SELECT COUNT(*) AS Count FROM PoolTest WHERE Big = 1099511627776");
+		TestAssert(rs.Field("Count").AsInt() == 1);
+	}
+
+	DB->ExecuteSQL("DROP TABLE PoolTest");
+
+	// The same rows through a prepared statement in SQLite, which is what the SQLite backend
+	// does, for comparison.
+	sqlite3* SQLite;
+	TestAssert(sqlite3_open(":memory:", &SQLite) == SQLITE_OK);
+	TestAssert(sqlite3_exec(SQLite, "CREATE TABLE PoolTest (ID int, Name varchar(24))",
+		nullptr, nullptr, nullptr) == SQLITE_OK);
+	sqlite3_stmt* Statement;
+	TestAssert(sqlite3_prepare_v2(SQLite, "INSERT INTO PoolTest (ID, Name) VALUES (?, ?)", -1,
+		&Statement, nullptr) == SQLITE_OK);
+	Start = steady_clock::now();
+	sqlite3_exec(SQLite, "BEGIN", nullptr, nullptr, nullptr);
+	for (int i = 0; i < RowCount; ++i)
+	{
+		auto Name = strprintf("Row%d", i);
+		sqlite3_bind_int(Statement, 1, i);
+		sqlite3_bind_text(Statement, 2, Name.c_str(), int(Name.size()), SQLITE_TRANSIENT);
+		TestAssert(sqlite3_step(Statement) == SQLITE_DONE);
+		sqlite3_reset(Statement);
+	}
+	sqlite3_exec(SQLite, "COMMIT", nullptr, nullptr, nullptr);
+	auto SQLiteTime = duration<double, std::milli>(steady_clock::now() - Start).count();
+	sqlite3_finalize(Statement);
+	sqlite3_close(SQLite);
+
+	MLog("Inserting %d rows: one statement per row %.1f ms, batched %.1f ms, "
+		"SQLite %.1f ms\n", RowCount, SingleTime, BatchTime, SQLiteTime);
+}
+
+// Inserts the same kill logs one at a time and in one batch, compares the times, and then deletes
+// them again through a separate connection.
+void BenchmarkKillLogs(IDatabase* DB, const MDatabase::ConnectionDetails& ConnDetails)
+{
+	MDatabasePool::Options Opts;
+	Opts.Size = 1;
+	MDatabasePool Pool{ConnDetails, Opts};
+	auto Raw = Pool.Acquire();
+	TestAssert(Raw);
+	int FirstID;
+	{
+		CODBCRecordset rs{Raw.get()};
+		rs.Open("SELECT ISNULL(MAX(id), 0) AS MaxID FROM KillLog");
+		FirstID = rs.Field("MaxID").AsInt();
+	}
+
+	constexpr int RowCount = 1000;
+	std::vector<KillLogRow> Rows;
+	for (int i = 0; i < RowCount; ++i)
+		Rows.push_back({u32(i), u32(i + 1), u64(time(nullptr))});
+
+	using namespace std::chrono;
+	auto Start = steady_clock::now();
+	for (auto&& Row : Rows)
+		TestAssert(DB->InsertKillLog(Row.AttackerCID, Row.VictimCID));
+	auto SingleTime = duration<double, std::milli>(steady_clock::now() - Start).count();
+
+	Start = steady_clock::now();
+	TestAssert(DB->InsertKillLogs(Rows));
+	auto BatchTime = duration<double, std::milli>(steady_clock::now() - Start).count();
+
+	MLog("Inserting %d kill logs: one at a time %.1f ms, batched %.1f ms\n",
+		RowCount, SingleTime, BatchTime);
+
+	Raw->ExecuteSQL(strprintf("DELETE FROM KillLog WHERE id > %d", FirstID));
+}
+
+// Records the kill logs it's given, and the time they're dated at, on top of inserting them.
+struct KillLogRecorder final : ForwardingDatabase
+{
+	using ForwardingDatabase::ForwardingDatabase;
+
+	virtual void SetLogTime(u64 UnixTime) override {
+		LogTime = UnixTime;
+		DB->SetLogTime(UnixTime);
+	}
+	virtual bool InsertKillLog(unsigned int nAttackerCID, unsigned int nVictimCID) override {
+		if (nAttackerCID == RejectedAttackerCID)
+			return false;
+		Kills.emplace_back(nAttackerCID, nVictimCID);
+		KillTimes.push_back(LogTime);
+		return DB->InsertKillLog(nAttackerCID, nVictimCID);
+	}
+	virtual bool InsertKillLogs(ArrayView<const KillLogRow> Rows) override {
+		++Batches;
+		for (auto&& Row : Rows)
+			if (Row.AttackerCID == RejectedAttackerCID)
+				return false;
+		for (auto&& Row : Rows)
+		{
+			Kills.emplace_back(Row.AttackerCID, Row.VictimCID);
+			KillTimes.push_back(Row.Time);
+		}
+		return DB->InsertKillLogs(Rows);
+	}
+
+	u64 LogTime = 0;
+	int Batches = 0;
+	u32 RejectedAttackerCID = u32(-1);
+	std::vector<std::pair<u32, u32>> Kills;
+	std::vector<u64> KillTimes;
+};
+
+void TestLogSink()
+{
+	constexpr auto Directory = "DBLogTest";
+	auto DeleteSegments = [&] {
+		for (auto Pattern : {"*.dblog", "*.dblog.open", "*.dblog.replayed", "*.dblog.retry"})
+			for (auto&& File : MFile::Glob(strprintf("%s/%s", Directory, Pattern).c_str()))
+				MFile::Delete(strprintf("%s/%s", Directory, File.Name).c_str());
+	};
+	auto CountSegments = [&](const char* Pattern) {
+		u64 Count = 0;
+		for (auto&& File : MFile::Glob(strprintf("%s/%s", Directory, Pattern).c_str()))
+			(void)File, ++Count;
+		return Count;
+	};
+	DeleteSegments();
+
+	const auto StartTime = u64(time(nullptr));
+	DBLogSink Sink;
+	DBLogSink::Options Opts;
+	Opts.Directory = Directory;
+	// Small enough that the rows span several segments.
+	Opts.SegmentSize = 4096;
+	TestAssert(Sink.Start(Opts));
+
+	LogSinkDatabase DB{std::make_unique<SQLiteDatabase>(":memory:"), Sink};
+	constexpr int KillCount = 1000;
+	for (int i = 0; i < KillCount; ++i)
+		TestAssert(DB.InsertKillLog(i, i + 1));
+	TestAssert(DB.InsertConnLog(1, "127.0.0.1", "KOR"));
+	TestAssert(DB.InsertCharMakingLog(1, "Name", CharMakingType::Create));
+
+	// Nothing has been replayable until the segment being written is finished.
+	Sink.Flush();
+	TestAssert(CountSegments("*.dblog.open") == 1);
+	Sink.FinishSegment();
+	TestAssert(CountSegments("*.dblog.open") == 0);
+
+	auto Stats = Sink.GetStats();
+	TestAssert(Stats.Appended == KillCount + 2);
+	TestAssert(Stats.Dropped == 0);
+	TestAssert(Stats.Segments > 1);
+	TestAssert(Stats.WriteErrors == 0);
+
+	KillLogRecorder Target{std::make_unique<SQLiteDatabase>(":memory:")};
+	constexpr u32 RejectedCID = KillCount / 2;
+	Target.RejectedAttackerCID = RejectedCID;
+	auto Result = ReplayDBLogs(Directory, Target);
+	TestAssert(Result.Segments == Stats.Segments);
+	TestAssert(Result.Rows == KillCount + 1);
+	TestAssert(Result.FailedRows == 1);
+	TestAssert(Result.DamagedSegments == 0);
+	// The kills are inserted in batches, and the batch with the rejected row one at a time.
+	TestAssert(Target.Batches > 0 && Target.Batches < KillCount / 2);
+	TestAssert(Target.Kills.size() == KillCount - 1);
+	for (int i = 0; i < KillCount - 1; ++i)
+	{
+		auto Attacker = u32(i < int(RejectedCID) ? i : i + 1);
+		TestAssert(Target.Kills[i] == std::make_pair(Attacker, Attacker + 1));
+		// Dated at the time they were appended, not the time of the replay.
+		TestAssert(Target.KillTimes[i] >= StartTime && Target.KillTimes[i] <= u64(time(nullptr)));
+	}
+	TestAssert(Target.LogTime == 0);
+
+	// The segment with the rejected row is kept with just that row, and the others aren't
+	// replayed again.
+	TestAssert(CountSegments("*.dblog.replayed") == Stats.Segments - 1);
+	TestAssert(CountSegments("*.dblog") == 1);
+	Target.RejectedAttackerCID = u32(-1);
+	Result = ReplayDBLogs(Directory, Target);
+	TestAssert(Result.Rows == 1);
+	TestAssert(Result.FailedRows == 0);
+	TestAssert(Target.Kills.back() == std::make_pair(RejectedCID, RejectedCID + 1));
+	TestAssert(CountSegments("*.dblog.replayed") == Stats.Segments);
+	TestAssert(ReplayDBLogs(Directory, Target).Rows == 0);
+
+	// Rows that don't fit in the memory budget are dropped rather than blocking.
+	Sink.Stop();
+	Opts.MemoryBudget = 64;
+	Opts.FlushInterval = 60 * 1000;
+	TestAssert(Sink.Start(Opts));
+	int Appended = 0;
+	for (int i = 0; i < 100; ++i)
+		Appended += DB.InsertKillLog(i, i);
+	TestAssert(Appended < 100);
+	Stats = Sink.GetStats();
+	TestAssert(Stats.Dropped == u64(100 - Appended));
+	Sink.Stop();
+	TestAssert(!DB.InsertKillLog(0, 0));
+
+	DeleteSegments();
 }
 
 } // namespace
@@ -638,6 +1040,8 @@ void TestDB()
 			return;
 		}
 
+		TestPool(ConnDetails);
+
 		MSSQLDatabase DB{ConnDetails};
 		if (!DB.DeleteAllRows())
 		{
@@ -646,10 +1050,30 @@ void TestDB()
 		}
 
 		TestDB(&DB);
+		BenchmarkKillLogs(&DB, ConnDetails);
 	}();
 	{
 		Timer timer{"SQLite"};
 		SQLiteDatabase DB{":memory:"};
 		TestDB(&DB);
+		BenchmarkInventory(&DB);
+	}
+	{
+		Timer timer{"Cached SQLite"};
+		DBCache Cache;
+		Cache.SetLimits(64, 0);
+		CachedDatabase DB{std::make_unique<SQLiteDatabase>(":memory:"), Cache};
+		TestDB(&DB);
+
+		// Every read in the tests follows a write, so the results must be the same as without the
+		// cache, but the reads should have gone through it.
+		auto Stats = Cache.GetStats();
+		TestAssert(Stats.Hits + Stats.Misses > 0);
+		TestAssert(Stats.Invalidations > 0);
+	}
+	TestCacheOwnership();
+	{
+		Timer timer{"DB log sink"};
+		TestLogSink();
 	}
 }
\ No newline at end of file
@@ -7,12 +7,16 @@
 #include "Sync.h"
 #include "Log.h"
 #include "File.h"
+#include "FileCache.h"
 
 #include <algorithm>
+#include <chrono>
 #include <numeric>
 #include <random>
+#include <thread>
 
 #include "TestAssert.h"
+#include "TestHTTPServer.h"
 
 namespace TestLauncherInternal {
 namespace {
@@ -94,10 +98,38 @@ void TestRollingHashStream()
 	}
 }
 
+void TestRollingHashMoveWindows()
+{
+	// Check that moving the window over many bytes at once gives the same hashes as moving it one
+	// byte at a time, for counts around the vector width and windows large enough to wrap the sums.
+	for (size_t WindowSize : {size_t(1), size_t(100), LauncherConfig::BlockSize})
+	{
+		for (size_t Count : {0, 1, 7, 8, 9, 1000})
+		{
+			auto Sequence = MakeRandomBytes(WindowSize + Count);
+
+			Hash::Rolling Batched;
+			Batched.HashMemory(Sequence.data(), WindowSize);
+			auto Incremental = Batched;
+
+			std::vector<u32> Hashes(Count);
+			Batched.MoveWindows(Hashes.data(), Sequence.data(), Count, WindowSize);
+
+			for (size_t i = 0; i < Count; ++i)
+			{
+				Incremental.Move(Sequence[i], Sequence[i + WindowSize], WindowSize);
+				TestAssert(Hashes[i] == Incremental.Value);
+			}
+			TestAssert(Batched == Incremental);
+		}
+	}
+}
+
 void TestRollingHash()
 {
 	TestRollingHashMove();
 	TestRollingHashStream();
+	TestRollingHashMoveWindows();
 }
 
 void WriteFile(const char* Path, const void* Buffer, size_t Size)
@@ -111,27 +143,30 @@ void WriteFile(const char* Path, const void* Buffer, size_t Size)
 	TestAssert(!File.error());
 }
 
-void TestFile(const ArrayView<u8>& SrcFileContents,
-	const ArrayView<u8>& DestFileContents,
-	size_t ExpectedNumUnmatchingBlocks)
+// Synchronizes the file at DestFilePath to the one at SrcFilePath, checking the result.
+// If ScanSeconds is passed, it's set to how long it took to find the matching blocks.
+// The files are downloaded from Server if it's passed, and through file URIs otherwise.
+Sync::BlockCounts SyncTestFile(const char* SrcFilePath, const char* DestFilePath,
+	Sync::Memory& SyncMemory,
+	Sync::Format SyncFormat,
+	double* ScanSeconds = nullptr,
+	const TestHTTPServer* Server = nullptr)
 {
-	constexpr auto SrcFilePath = "temp/src.dat";
-	constexpr auto DestFilePath = "temp/dest.dat";
-
-	WriteFile(SrcFilePath, SrcFileContents.data(), SrcFileContents.size());
-	WriteFile(DestFilePath, DestFileContents.data(), DestFileContents.size());
-
 	char SyncPath[MFile::MaxPath];
 	sprintf_safe(SyncPath, "%s.sync", SrcFilePath);
 
-	TestAssert(Sync::MakeSyncFile(SyncPath, SrcFilePath));
+	Hash::Strong SyncPassHash;
+	TestAssert(Sync::MakeSyncFile(SyncPath, SrcFilePath, &SyncPassHash, SyncFormat));
 
 	// Instead of starting a local webserver, just use FILE URIs.
 	char cwd[MFile::MaxPath];
 	TestAssert(MFile::GetCWD(cwd));
 
 	auto MakeFileURI = [&](auto&& Dest, auto&& Src) {
-		sprintf_safe(Dest, "file:///%s/%s", cwd, Src);
+		if (Server)
+			strcpy_safe(Dest, Server->URL(Src).c_str());
+		else
+			sprintf_safe(Dest, "file:///%s/%s", cwd, Src);
 	};
 
 	char SrcURL[MFile::MaxPath];
@@ -144,19 +179,29 @@ void TestFile(const ArrayView<u8>& SrcFileContents,
 
 	Hash::Strong ExpectedHash;
 	ExpectedHash.HashFile(SrcFilePath);
+	TestAssert(SyncPassHash == ExpectedHash);
 
-	const auto ExpectedSize = SrcFileContents.size();
+	const auto ExpectedSize = MFile::GetAttributes(SrcFilePath)->Size;
 
 	Hash::Strong ActualHash;
 	u64 ActualSize;
 	Sync::BlockCounts Counts;
 
-	static Sync::Memory SyncMemory;
+	using Clock = std::chrono::steady_clock;
+	Clock::time_point ScanStart, ScanEnd;
+	auto ProgressCallback = [&](Sync::StatusType Status, u64, u64) {
+		if (Status == Sync::CalculatingBlocks && ScanStart == Clock::time_point{})
+			ScanStart = Clock::now();
+		else if (Status == Sync::DownloadingFile && ScanEnd == Clock::time_point{})
+			ScanEnd = Clock::now();
+	};
 
 	TestAssert(Sync::SynchronizeFile(SyncMemory, DestFilePath, nullptr, SrcURL, SyncURL,
-		SrcFileContents.size(), DownloadManager, {}, &ActualHash, &ActualSize, &Counts).Success);
+		ExpectedSize, DownloadManager, ProgressCallback,
+		&ActualHash, &ActualSize, &Counts).Success);
 
-	TestAssert(Counts.UnmatchingBlocks == ExpectedNumUnmatchingBlocks);
+	if (ScanSeconds)
+		*ScanSeconds = std::chrono::duration<double>(ScanEnd - ScanStart).count();
 
 	TestAssert(ActualHash == ExpectedHash);
 	TestAssert(ActualSize == ExpectedSize);
@@ -166,6 +211,36 @@ void TestFile(const ArrayView<u8>& SrcFileContents,
 
 	TestAssert(ActualHash == ExpectedHash);
 	TestAssert(ActualSize == ExpectedSize);
+
+	return Counts;
+}
+
+// Synchronizes DestFileContents to SrcFileContents, checking the result.
+// If ScanSeconds is passed, it's set to how long it took to find the matching blocks.
+void TestFile(const ArrayView<u8>& SrcFileContents,
+	const ArrayView<u8>& DestFileContents,
+	size_t ExpectedNumUnmatchingBlocks,
+	int ThreadCount = 0,
+	double* ScanSeconds = nullptr,
+	Sync::Format SyncFormat = Sync::Format::Blocks)
+{
+	constexpr auto SrcFilePath = "temp/src.dat";
+	constexpr auto DestFilePath = "temp/dest.dat";
+
+	WriteFile(SrcFilePath, SrcFileContents.data(), SrcFileContents.size());
+	WriteFile(DestFilePath, DestFileContents.data(), DestFileContents.size());
+
+	static Sync::Memory SyncMemory;
+	SyncMemory.ThreadCount = ThreadCount;
+
+	// Every call overwrites the same files, so the chunks of earlier calls are no use.
+	SyncMemory.ChunkFiles.clear();
+	SyncMemory.ChunkIndex.clear();
+
+	const auto Counts = SyncTestFile(SrcFilePath, DestFilePath, SyncMemory, SyncFormat,
+		ScanSeconds);
+
+	TestAssert(Counts.UnmatchingBlocks == ExpectedNumUnmatchingBlocks);
 }
 
 template <size_t FileSize>
@@ -221,6 +296,363 @@ void TestSize()
 		(NumBlocks - 1) / 2);
 }
 
+// Synchronizes a large file with edits spread out over it, on one thread and on several, and
+// logs how fast the blocks were found.
+void TestSyncLargeFile()
+{
+	constexpr auto BlockSize = LauncherConfig::BlockSize;
+	constexpr size_t NumBlocks = 2048; // 64 MiB
+
+	auto Src = MakeRandomBytes(NumBlocks * BlockSize);
+	auto Dest = Src;
+
+	// Each edit is inside a single block, so each one makes exactly one block unmatching.
+	size_t ExpectedNumUnmatchingBlocks = 0;
+
+	// Overwrite a byte in 16 blocks.
+	for (size_t i = 1; i <= 16; ++i)
+	{
+		Dest[i * 100 * BlockSize + 5] ^= 0xFF;
+		++ExpectedNumUnmatchingBlocks;
+	}
+
+	// Delete 50 bytes from the middle of a block near the end, and insert 100 bytes in the middle
+	// of one near the start, shifting the rest of the file across the segment boundaries.
+	const auto DeleteAt = Dest.begin() + 1700 * BlockSize + BlockSize / 2;
+	Dest.erase(DeleteAt, DeleteAt + 50);
+	++ExpectedNumUnmatchingBlocks;
+
+	const auto Inserted = MakeRandomBytes(100);
+	Dest.insert(Dest.begin() + 50 * BlockSize + BlockSize / 2, Inserted.begin(), Inserted.end());
+	++ExpectedNumUnmatchingBlocks;
+
+	// A file that shares nothing with the remote one, where finding the blocks is nothing but
+	// rolling hash lookups.
+	auto Unrelated = MakeRandomBytes(NumBlocks * BlockSize);
+
+	auto MakeView = [&](auto&& c) { return ArrayView<u8>{c.data(), c.size()}; };
+
+	for (int ThreadCount : {1, 3, 0})
+	{
+		const auto NumThreads = ThreadCount > 0 ? ThreadCount :
+			int(std::thread::hardware_concurrency());
+
+		auto Measure = [&](const char* Name, std::vector<u8>& Local, size_t NumUnmatching)
+		{
+			double ScanSeconds;
+			TestFile(MakeView(Src), MakeView(Local), NumUnmatching, ThreadCount, &ScanSeconds);
+
+			const auto MiB = Local.size() / (1024.0 * 1024.0);
+			Log.Info("Sync, %s file, %d threads: Scanned %.0f MiB in %.3f s, %.1f MiB/s\n",
+				Name, NumThreads, MiB, ScanSeconds, MiB / ScanSeconds);
+		};
+
+		Measure("edited", Dest, ExpectedNumUnmatchingBlocks);
+		Measure("unrelated", Unrelated, NumBlocks);
+	}
+}
+
+void TestChunkSize()
+{
+	using namespace LauncherConfig;
+
+	auto Data = MakeRandomBytes(4 * 1024 * 1024);
+
+	auto Chunk = [](const std::vector<u8>& Data) {
+		std::vector<size_t> Boundaries;
+		for (size_t Offset = 0; Offset < Data.size(); )
+		{
+			const auto Size = Sync::ChunkSize(Data.data() + Offset, Data.size() - Offset);
+			TestAssert(Size > 0 && Size <= MaxChunkSize);
+			TestAssert(Size >= MinChunkSize || Offset + Size == Data.size());
+			Offset += Size;
+			Boundaries.push_back(Offset);
+		}
+		return Boundaries;
+	};
+
+	const auto Boundaries = Chunk(Data);
+	const auto AverageSize = Data.size() / Boundaries.size();
+	TestAssert(AverageSize > AverageChunkSize / 2 && AverageSize < AverageChunkSize * 2);
+
+	// Inserting bytes at the start only moves the boundaries that come after it, and only until
+	// they find their way back to the same content.
+	auto Shifted = MakeRandomBytes(1000);
+	Shifted.insert(Shifted.end(), Data.begin(), Data.end());
+	const auto ShiftedBoundaries = Chunk(Shifted);
+
+	size_t NumShared = 0;
+	for (auto Boundary : ShiftedBoundaries)
+		NumShared += std::binary_search(Boundaries.begin(), Boundaries.end(), Boundary - 1000);
+	TestAssert(NumShared + 2 >= Boundaries.size());
+}
+
+// Synchronizes files in the chunk format, with edits that don't depend on where the chunk
+// boundaries end up.
+template <size_t FileSize>
+void TestChunkedSize()
+{
+	auto MakeView = [&](auto&& c) { return ArrayView<u8>{c.data(), c.size()}; };
+	const auto Chunks = Sync::Format::Chunks;
+
+	auto FileBuffer = MakeRandomBytes(FileSize);
+	TestFile(MakeView(FileBuffer), MakeView(FileBuffer), 0, 0, nullptr, Chunks);
+
+	// The hash that picks where a chunk ends starts MinChunkSize bytes into it, so changing the
+	// first byte only changes the first chunk.
+	auto ModifiedBuffer = FileBuffer;
+	ModifiedBuffer[0] += 128;
+	TestFile(MakeView(FileBuffer), MakeView(ModifiedBuffer), 1, 0, nullptr, Chunks);
+
+	// Nothing in common.
+	const auto NumChunks = [&] {
+		size_t Num = 0;
+		for (size_t Offset = 0; Offset < FileSize; ++Num)
+			Offset += Sync::ChunkSize(FileBuffer.data() + Offset, FileSize - Offset);
+		return Num;
+	}();
+	auto Unrelated = FileBuffer;
+	for (auto&& Byte : Unrelated)
+		Byte ^= 0xA5;
+	TestFile(MakeView(FileBuffer), MakeView(Unrelated), NumChunks, 0, nullptr, Chunks);
+}
+
+// Synchronizes made up revisions of asset archives with both formats, and logs how much has to be
+// downloaded for each of them.
+void TestChunkedRevisions()
+{
+	constexpr size_t ArchiveSize = 4 * 1024 * 1024;
+	constexpr auto BlockSize = LauncherConfig::BlockSize;
+
+	auto WriteBytes = [&](const char* Path, const std::vector<u8>& Data) {
+		WriteFile(Path, Data.data(), Data.size());
+	};
+
+	// Each revision is a list of files, in the order they're synchronized, going from the old
+	// contents to the new ones.
+	struct RevisionFile
+	{
+		std::vector<u8> Old;
+		std::vector<u8> New;
+	};
+
+	auto Measure = [&](const char* Name, const std::vector<RevisionFile>& Files) {
+		u64 UnmatchingSize[2]{};
+		u64 SyncFileSize[2]{};
+		for (auto SyncFormat : {Sync::Format::Blocks, Sync::Format::Chunks})
+		{
+			const auto FormatIndex = int(SyncFormat);
+			Sync::Memory SyncMemory;
+			for (size_t i = 0; i < Files.size(); ++i)
+			{
+				char SrcPath[64], DestPath[64], SyncPath[64];
+				sprintf_safe(SrcPath, "temp/revision/src%zu.dat", i);
+				sprintf_safe(DestPath, "temp/revision/dest%zu.dat", i);
+				sprintf_safe(SyncPath, "%s.sync", SrcPath);
+				WriteBytes(SrcPath, Files[i].New);
+				WriteBytes(DestPath, Files[i].Old);
+
+				const auto Counts = SyncTestFile(SrcPath, DestPath, SyncMemory, SyncFormat);
+				UnmatchingSize[FormatIndex] += Counts.UnmatchingSize;
+				SyncFileSize[FormatIndex] += MFile::GetAttributes(SyncPath)->Size;
+			}
+		}
+
+		Log.Info("Sync, %s: Blocks download %llu + %llu KiB, chunks download %llu + %llu KiB\n",
+			Name,
+			UnmatchingSize[0] / 1024, SyncFileSize[0] / 1024,
+			UnmatchingSize[1] / 1024, SyncFileSize[1] / 1024);
+
+		return std::make_pair(UnmatchingSize[0], UnmatchingSize[1]);
+	};
+
+	auto Archive = MakeRandomBytes(ArchiveSize);
+
+	{
+		// A handful of small edits all over an archive, e.g. changed values in XML files.
+		auto Edited = Archive;
+		for (size_t i = 1; i <= 16; ++i)
+			Edited[i * ArchiveSize / 17] ^= 0x55;
+		Measure("scattered edits", {{Archive, Edited}});
+	}
+
+	{
+		// A file grows near the start of an archive, shifting everything after it.
+		auto Grown = Archive;
+		const auto Inserted = MakeRandomBytes(5000);
+		Grown.insert(Grown.begin() + 100 * 1024, Inserted.begin(), Inserted.end());
+		Measure("insertion", {{Archive, Grown}});
+	}
+
+	{
+		// A megabyte of files moves from one archive to another one, at an offset that isn't a
+		// multiple of the block size. Only the chunk format can find them in the other archive.
+		auto Other = MakeRandomBytes(ArchiveSize);
+		auto OtherWithMoved = Other;
+		const auto Moved = Archive.begin() + 2 * 1024 * 1024;
+		OtherWithMoved.insert(OtherWithMoved.begin() + 3 * BlockSize + 123,
+			Moved, Moved + 1024 * 1024);
+
+		const auto Sizes = Measure("moved between archives",
+			{{Archive, Archive}, {Other, OtherWithMoved}});
+		TestAssert(Sizes.second * 4 < Sizes.first);
+	}
+}
+
+// Downloads pieces of files from a server that takes a while to answer, with different limits.
+void TestDownloadQueue()
+{
+	constexpr auto Latency = std::chrono::milliseconds(30);
+	constexpr size_t FileSize = 1024 * 1024;
+	constexpr size_t PieceSize = 64 * 1024;
+
+	const char* const Paths[] = {"temp/http/a.dat", "temp/http/b.dat"};
+	std::vector<u8> Contents[2];
+	for (int i = 0; i < 2; ++i)
+	{
+		Contents[i] = MakeRandomBytes(FileSize);
+		WriteFile(Paths[i], Contents[i].data(), Contents[i].size());
+	}
+
+	using Clock = std::chrono::steady_clock;
+
+	// Returns how long it took to download every piece of both files, plus both files whole and
+	// one that doesn't exist.
+	auto Download = [&](const DownloadLimits& Limits) {
+		TestHTTPServer Server;
+		Server.Latency = Latency;
+		TestAssert(Server.Start());
+
+		struct Piece
+		{
+			int File;
+			size_t Offset;
+			size_t Size;
+			std::vector<u8> Received;
+			bool Done = false;
+		};
+		std::vector<Piece> Pieces;
+		for (int File = 0; File < 2; ++File)
+		{
+			for (size_t Offset = 0; Offset < FileSize; Offset += PieceSize)
+				Pieces.push_back({File, Offset, PieceSize, {}});
+			Pieces.push_back({File, 0, 0, {}});
+		}
+
+		DownloadQueue Queue;
+		Queue.Limits = Limits;
+		for (auto&& Piece : Pieces)
+		{
+			DownloadRequest Request;
+			Request.URL = Server.URL(Paths[Piece.File]);
+			if (Piece.Size != 0)
+				Request.Range = strprintf("%zu-%zu", Piece.Offset, Piece.Offset + Piece.Size - 1);
+			Request.Callback = [&Piece](const u8* Buffer, size_t Size, DownloadInfo& Info) {
+				TestAssert(Info.IsRange() == (Piece.Size != 0));
+				Piece.Received.insert(Piece.Received.end(), Buffer, Buffer + Size);
+				return true;
+			};
+			Request.Done = [&Piece](const DownloadResult&) { Piece.Done = true; };
+			Queue.Add(std::move(Request));
+		}
+
+		DownloadRequest Missing;
+		Missing.URL = Server.URL("temp/http/missing.dat");
+		const auto MissingID = Queue.Add(std::move(Missing));
+
+		const auto Start = Clock::now();
+		TestAssert(!Queue.Run());
+		const auto Seconds = std::chrono::duration<double>(Clock::now() - Start).count();
+
+		TestAssert(!Queue.GetResult(MissingID).Success);
+		for (size_t i = 0; i < Pieces.size(); ++i)
+		{
+			auto&& Piece = Pieces[i];
+			auto&& Result = Queue.GetResult(i);
+			const auto Size = Piece.Size != 0 ? Piece.Size : FileSize;
+			const auto Expected = Contents[Piece.File].data() + Piece.Offset;
+
+			Hash::Strong ExpectedHash;
+			ExpectedHash.HashMemory(Expected, Size);
+
+			TestAssert(Piece.Done);
+			TestAssert(Result.Success);
+			TestAssert(Result.Size == Size);
+			TestAssert(Result.Hash == ExpectedHash);
+			TestAssert(Piece.Received.size() == Size);
+			TestAssert(memcmp(Piece.Received.data(), Expected, Size) == 0);
+		}
+
+		TestAssert(Server.MaxConnections <= Limits.MaxConnections);
+		TestAssert(Server.NumRequests == int(Pieces.size()) + 1);
+
+		Log.Info("Download queue, %d connections, %llu KiB/s limit: %d requests, %d at once, "
+			"%.3f s\n", Limits.MaxConnections, Limits.MaxBytesPerSecond / 1024,
+			Server.NumRequests.load(), Server.MaxRequests.load(), Seconds);
+
+		return Seconds;
+	};
+
+	DownloadLimits Serial;
+	Serial.MaxConnections = 1;
+	DownloadLimits Parallel;
+	Parallel.MaxConnections = 8;
+	DownloadLimits Limited = Parallel;
+	Limited.MaxBytesPerSecond = 8 * 1024 * 1024;
+
+	const auto SerialSeconds = Download(Serial);
+	const auto ParallelSeconds = Download(Parallel);
+	const auto LimitedSeconds = Download(Limited);
+
+	// 35 requests one after another can't take less than 35 times the latency, while eight at a
+	// time takes about a fifth of that.
+	TestAssert(SerialSeconds >= 35 * 0.030);
+	TestAssert(ParallelSeconds * 2 < SerialSeconds);
+
+	// 4 MiB at 8 MiB/s, minus the first burst.
+	TestAssert(LimitedSeconds >= 0.4);
+}
+
+// Synchronizes a file through the test HTTP server, with blocks missing all over it.
+void TestSyncOverHTTP()
+{
+	constexpr auto BlockSize = LauncherConfig::BlockSize;
+
+	TestHTTPServer Server;
+	Server.Latency = std::chrono::milliseconds(10);
+	TestAssert(Server.Start());
+
+	auto Src = MakeRandomBytes(4 * 1024 * 1024);
+	auto Dest = Src;
+	for (size_t i = 0; i < Dest.size(); i += 4 * BlockSize)
+		Dest[i] ^= 0xFF;
+
+	for (auto SyncFormat : {Sync::Format::Blocks, Sync::Format::Chunks})
+	{
+		for (int MaxConnections : {1, 8})
+		{
+			WriteFile("temp/http/src.dat", Src.data(), Src.size());
+			WriteFile("temp/http/dest.dat", Dest.data(), Dest.size());
+
+			Sync::Memory SyncMemory;
+			SyncMemory.Downloads.Limits.MaxConnections = MaxConnections;
+
+			const auto Start = std::chrono::steady_clock::now();
+			const auto Counts = SyncTestFile("temp/http/src.dat", "temp/http/dest.dat",
+				SyncMemory, SyncFormat, nullptr, &Server);
+			const auto Seconds = std::chrono::duration<double>(
+				std::chrono::steady_clock::now() - Start).count();
+
+			if (SyncFormat == Sync::Format::Blocks)
+				TestAssert(Counts.UnmatchingBlocks == Src.size() / (4 * BlockSize));
+
+			Log.Info("Sync, over HTTP, %s, %d connections: %zu unmatching, %.3f s\n",
+				SyncFormat == Sync::Format::Blocks ? "blocks" : "chunks", MaxConnections,
+				Counts.UnmatchingBlocks, Seconds);
+		}
+	}
+}
+
 void TestSyncFile()
 {
 	TestSize<1>(); // 1 byte
@@ -231,7 +663,142 @@ void TestSyncFile()
 #ifndef _DEBUG
 	TestSize<5 * 1024 * 1024>(); // 5 MiB
 	TestSize<60 * 1024 * 1024>(); // 60 MiB
+	TestSyncLargeFile();
 #endif
+
+	TestChunkSize();
+	TestChunkedSize<1>(); // 1 byte
+	TestChunkedSize<LauncherConfig::MinChunkSize + 100>(); // Just over the minimum chunk size
+	TestChunkedSize<1024 * 1024>(); // 1 MiB
+	TestChunkedRevisions();
+	TestDownloadQueue();
+	TestSyncOverHTTP();
+}
+
+// Migrates an XML file cache with a file per entry to the binary format, and checks lookups and
+// updates in both.
+void TestFileCache()
+{
+	constexpr auto NumFiles = 2000;
+	constexpr auto XMLPath = "temp/cache/cache.xml";
+	constexpr auto BinaryPath = "temp/cache/cache.bin";
+
+	struct TestFile
+	{
+		std::string Path;
+		char Hash[Hash::Strong::MinimumStringSize];
+	};
+	std::vector<TestFile> Files(NumFiles);
+	std::string XML;
+	for (int i = 0; i < NumFiles; ++i)
+	{
+		auto&& File = Files[i];
+		File.Path = strprintf("temp/cache/files/%d.dat", i);
+		const auto Contents = MakeRandomBytes(16 + i % 64);
+		WriteFile(File.Path.c_str(), Contents.data(), Contents.size());
+
+		Hash::Strong FileHash;
+		FileHash.HashMemory(Contents.data(), Contents.size());
+		FileHash.ToString(File.Hash);
+
+		Hash::Strong Parsed;
+		TestAssert(Parsed.FromString(File.Hash, strlen(File.Hash)) && Parsed == FileHash);
+
+		const auto Attributes = MFile::GetAttributes(File.Path.c_str());
+		TestAssert(Attributes.has_value());
+		XML += strprintf("<file name=\"%s\" size=\"%llu\" last_modified_time=\"%llu\" "
+			"hash=\"%s\"/>\n", File.Path.c_str(), Attributes->Size, Attributes->LastModifiedTime,
+			File.Hash);
+	}
+
+	auto CheckFiles = [&](const FileCacheType& Cache, size_t Begin, size_t End) {
+		for (auto i = Begin; i < End; ++i)
+		{
+			const auto Result = Cache.GetCachedFileData(Files[i].Path.c_str());
+			TestAssert(Result.Result == FileQueryResult::Found);
+			TestAssert(strcmp(Result.FileData.Hash, Files[i].Hash) == 0);
+		}
+	};
+
+	using Clock = std::chrono::steady_clock;
+	auto Milliseconds = [](Clock::time_point Start) {
+		return std::chrono::duration<double, std::milli>(Clock::now() - Start).count();
+	};
+
+	MFile::Delete(BinaryPath);
+	WriteFile(XMLPath, XML.data(), XML.size());
+	{
+		FileCacheType Cache{BinaryPath, XMLPath};
+		const auto Start = Clock::now();
+		TestAssert(Cache.Load());
+		const auto XMLLoadMS = Milliseconds(Start);
+		CheckFiles(Cache, 0, NumFiles);
+		TestAssert(Cache.Save());
+		TestAssert(MFile::Exists(BinaryPath));
+		TestAssert(!MFile::Exists(XMLPath));
+
+		FileCacheType Mapped{BinaryPath, XMLPath};
+		const auto MappedStart = Clock::now();
+		TestAssert(Mapped.Load());
+		const auto BinaryLoadMS = Milliseconds(MappedStart);
+
+		const auto LookupStart = Clock::now();
+		CheckFiles(Mapped, 0, NumFiles);
+		const auto LookupMS = Milliseconds(LookupStart);
+
+		Log.Info("File cache, %d files: XML load %.2f ms, binary load %.3f ms, "
+			"binary lookups %.2f ms\n", NumFiles, XMLLoadMS, BinaryLoadMS, LookupMS);
+	}
+
+	// A changed file, and a new one.
+	const auto Changed = MakeRandomBytes(200);
+	WriteFile(Files[0].Path.c_str(), Changed.data(), Changed.size());
+	const std::string NewPath = "temp/cache/files/new.dat";
+	WriteFile(NewPath.c_str(), Changed.data(), Changed.size());
+	Hash::Strong ChangedHash;
+	ChangedHash.HashMemory(Changed.data(), Changed.size());
+	ChangedHash.ToString(Files[0].Hash);
+	{
+		FileCacheType Cache{BinaryPath, XMLPath};
+		TestAssert(Cache.Load());
+		TestAssert(Cache.GetCachedFileData(Files[0].Path.c_str()).Result == FileQueryResult::Outdated);
+		TestAssert(Cache.GetCachedFileData(NewPath.c_str()).Result == FileQueryResult::NotFound);
+		TestAssert(Cache.GetCachedFileData("temp/cache/files/zzz.dat").Result ==
+			FileQueryResult::NotFound);
+
+		TestAssert(Cache.Add(Files[0].Path.c_str(), Files[0].Hash));
+		TestAssert(Cache.Add(NewPath.c_str(), Files[0].Hash));
+		CheckFiles(Cache, 0, NumFiles);
+		TestAssert(Cache.GetCachedFileData(NewPath.c_str()).Result == FileQueryResult::Found);
+		TestAssert(Cache.Save());
+
+		// Still there after the file's been replaced.
+		CheckFiles(Cache, 0, NumFiles);
+	}
+	{
+		FileCacheType Cache{BinaryPath, XMLPath};
+		TestAssert(Cache.Load());
+		CheckFiles(Cache, 0, NumFiles);
+		TestAssert(Cache.GetCachedFileData(NewPath.c_str()).Result == FileQueryResult::Found);
+	}
+
+	// A broken cache is treated as empty, and rewritten.
+	WriteFile(BinaryPath, XML.data(), 100);
+	{
+		FileCacheType Cache{BinaryPath, XMLPath};
+		TestAssert(!Cache.Load());
+		TestAssert(Cache.GetCachedFileData(Files[1].Path.c_str()).Result ==
+			FileQueryResult::NotFound);
+		TestAssert(Cache.Add(Files[1].Path.c_str(), Files[1].Hash));
+		TestAssert(Cache.Save());
+	}
+	{
+		FileCacheType Cache{BinaryPath, XMLPath};
+		TestAssert(Cache.Load());
+		CheckFiles(Cache, 1, 2);
+		TestAssert(Cache.GetCachedFileData(Files[2].Path.c_str()).Result ==
+			FileQueryResult::NotFound);
+	}
 }
 
 } // namespace
@@ -243,4 +810,5 @@ void TestLauncher()
 	TestAssert(Log.Init("launcher_log.txt", LogTo::File | LogTo::Debugger));
 	TestRollingHash();
 	TestSyncFile();
+	TestFileCache();
 }
\ No newline at end of file
@@ -0,0 +1,286 @@
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include "MLocatorRateLimiter.h"
+#include "MCountryCodeFilter.h"
+#include "MSafeUDP.h"
+#include "MPacket.h"
+#include "MInetUtil.h"
+#include "MDebug.h"
+#include "TestAssert.h"
+
+namespace {
+
+void TestRateLimiter()
+{
+	constexpr u32 Rate = 10;
+	constexpr u32 Burst = 5;
+	constexpr u32 BlockTime = 1000;
+	const u32 IP = GetIPv4Number("10.0.0.1");
+	const u32 OtherIP = GetIPv4Number("10.0.0.2");
+	u64 Now = 1000000;
+
+	MLocatorRateLimiter Limiter{Rate, Burst, BlockTime};
+
+	// The whole burst is allowed at once, and running out blocks the IP.
+	for (u32 i = 0; i < Burst; ++i)
+		TestAssert(Limiter.Consume(IP, Now));
+	TestAssert(!Limiter.Consume(IP, Now));
+	TestAssert(Limiter.IsBlocked(IP, Now));
+	TestAssert(Limiter.Consume(OtherIP, Now));
+
+	// The block holds even though the bucket refills meanwhile.
+	TestAssert(!Limiter.Consume(IP, Now + BlockTime - 1));
+	Now += BlockTime;
+	for (u32 i = 0; i < Burst; ++i)
+		TestAssert(Limiter.Consume(IP, Now));
+	TestAssert(!Limiter.Consume(IP, Now));
+
+	// Without a block time, tokens come back at Rate per second.
+	MLocatorRateLimiter Unblocked{Rate, Burst, 0};
+	for (u32 i = 0; i < Burst; ++i)
+		TestAssert(Unblocked.Consume(IP, Now));
+	TestAssert(!Unblocked.Consume(IP, Now));
+	TestAssert(!Unblocked.Consume(IP, Now + 1000 / Rate - 1));
+	TestAssert(Unblocked.Consume(IP, Now + 1000 / Rate));
+	TestAssert(!Unblocked.Consume(IP, Now + 1000 / Rate));
+
+	// Blocking by hand, e.g. for invalid commands.
+	Limiter.Block(OtherIP, Now);
+	TestAssert(!Limiter.Consume(OtherIP, Now));
+
+	// Only the buckets that are full and unblocked are cleared.
+	TestAssert(Limiter.size() == 2);
+	TestAssert(Limiter.GetBlockedCount(Now) == 2);
+	Limiter.ClearIdle(Now);
+	TestAssert(Limiter.size() == 2);
+	Limiter.ClearIdle(Now + BlockTime + 1000 * Burst / Rate);
+	TestAssert(Limiter.size() == 0);
+}
+
+void TestIPtoCountryIndex()
+{
+	constexpr int RangeCount = 200000;
+	constexpr int LookupCount = 10000000;
+	constexpr u32 Step = 0xFFFFFFFF / RangeCount;
+
+	// Ranges spread over the whole address space, with gaps between them.
+	std::mt19937 rng{5678};
+	IPtoCountryList Expected;
+	Expected.reserve(RangeCount);
+	for (int i = 0; i < RangeCount; ++i)
+	{
+		IPtoCountry ipc;
+		ipc.nIPFrom = i * Step + rng() % (Step / 4);
+		ipc.nIPTo = ipc.nIPFrom + rng() % (Step / 2);
+		const auto Country = i % 250;
+		ipc.strCountryCode3 = {char('A' + Country / 26 % 26), char('A' + Country % 26), 'X'};
+		Expected.push_back(ipc);
+	}
+
+	auto Shuffled = Expected;
+	std::shuffle(Shuffled.begin(), Shuffled.end(), rng);
+
+	IPtoCountryIndex Index;
+	const auto BuildStart = std::chrono::steady_clock::now();
+	TestAssert(Index.Build(Shuffled));
+	const auto BuildTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - BuildStart);
+	TestAssert(Index.size() == RangeCount);
+
+	for (int i = 0; i < RangeCount; ++i)
+	{
+		auto& ipc = Expected[i];
+		TestAssert(Index.Find(ipc.nIPFrom) == i);
+		TestAssert(Index.Find(ipc.nIPTo) == i);
+		TestAssert(Index.Find(ipc.nIPFrom + (ipc.nIPTo - ipc.nIPFrom) / 2) == i);
+		TestAssert(Index.Find(ipc.nIPTo + 1) == -1);
+		if (ipc.nIPFrom > 0)
+			TestAssert(Index.Find(ipc.nIPFrom - 1) == -1);
+		TestAssert(Index.GetCountryCode(i) == ipc.strCountryCode3);
+	}
+
+	std::uniform_int_distribution<u32> IPDist;
+	std::vector<u32> IPs(LookupCount);
+	for (auto&& IP : IPs)
+		IP = IPDist(rng);
+
+	int Hits = 0;
+	const auto LookupStart = std::chrono::steady_clock::now();
+	for (auto IP : IPs)
+		Hits += Index.Find(IP) != -1;
+	const auto LookupTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - LookupStart);
+
+	MLog("IPtoCountryIndex: built %d ranges in %.3f ms, %.1fM lookups/s (%d%% hit)\n",
+		RangeCount, BuildTime.count() * 1000, LookupCount / LookupTime.count() / 1e6,
+		int(int64_t(Hits) * 100 / LookupCount));
+
+	// Overlapping and inverted ranges fail the whole build.
+	auto Overlapping = Shuffled;
+	Overlapping.push_back({Expected[100].nIPTo, Expected[100].nIPTo + 1, "KOR"});
+	TestAssert(!Index.Build(Overlapping));
+	TestAssert(Index.empty());
+	auto Inverted = Shuffled;
+	Inverted.push_back({Expected[100].nIPTo + 2, Expected[100].nIPTo + 1, "KOR"});
+	TestAssert(!Index.Build(Inverted));
+
+	// Single inserts go where they belong.
+	TestAssert(Index.Insert(300, 400, "USA"));
+	TestAssert(Index.Insert(100, 200, "KOR"));
+	TestAssert(!Index.Insert(150, 250, "JPN"));
+	TestAssert(!Index.Insert(250, 300, "JPN"));
+	TestAssert(!Index.Insert(50, 100, "JPN"));
+	TestAssert(Index.Insert(250, 299, "JPN"));
+	TestAssert(Index.GetCountryCode(Index.Find(150)) == "KOR");
+	TestAssert(Index.GetCountryCode(Index.Find(250)) == "JPN");
+	TestAssert(Index.GetCountryCode(Index.Find(400)) == "USA");
+	TestAssert(Index.Find(201) == -1);
+
+	MCountryCodeFilter Filter;
+	const auto IP = GetIPv4Number("1.2.3.4");
+	TestAssert(Filter.Create({{"KOR", "", false}}, {{IP - 10, IP + 10, "KOR"}}));
+	string Code;
+	TestAssert(Filter.GetIPCountryCode("1.2.3.4", Code) == 0);
+	TestAssert(Code == "KOR");
+}
+
+// Answers server list requests the way MLocator::UDPSocketRecvEvent does: a rate limiter check,
+// then a copy of a prebuilt response.
+struct FloodedLocator
+{
+	std::unique_ptr<MLocatorRateLimiter> Limiter;
+	std::vector<char> Response;
+	MCriticalSection ResponseMutex;
+	MSafeUDP SafeUDP;
+	std::atomic<int> Requests{0};
+	std::atomic<int> Dropped{0};
+};
+
+FloodedLocator* FloodTarget;
+std::atomic<int> FloodResponses{0};
+
+bool OnFloodRequest(u32 dwIP, u16 wRawPort, char* pPacket, u32 dwSize)
+{
+	if (sizeof(MPacketHeader) > dwSize)
+		return false;
+
+	auto& Locator = *FloodTarget;
+	++Locator.Requests;
+	if (!Locator.Limiter->Consume(dwIP, GetGlobalTimeMS()))
+	{
+		++Locator.Dropped;
+		return true;
+	}
+
+	char* Packet;
+	u32 PacketSize;
+	{
+		std::lock_guard<MCriticalSection> Lock{Locator.ResponseMutex};
+		PacketSize = u32(Locator.Response.size());
+		Packet = new char[PacketSize];
+		memcpy(Packet, Locator.Response.data(), PacketSize);
+	}
+	if (!Locator.SafeUDP.Send(dwIP, MSocket::ntohs(wRawPort), Packet, PacketSize))
+		delete[] Packet;
+
+	return true;
+}
+
+bool CountFloodResponse(u32, u16, char*, u32)
+{
+	++FloodResponses;
+	return true;
+}
+
+// Sends RequestsPerSecond server list requests for a second from one client, and returns the
+// number of responses.
+int Flood(u32 Rate, u32 Burst, int RequestsPerSecond)
+{
+	constexpr int LocatorPort = 17980;
+	constexpr int ClientPort = 17981;
+	constexpr int MaxInFlight = 128;
+
+	FloodedLocator Locator;
+	Locator.Limiter = std::make_unique<MLocatorRateLimiter>(Rate, Burst, 0);
+	Locator.Response.resize(sizeof(MPacketHeader) + 256);
+	FloodTarget = &Locator;
+	if (!Locator.SafeUDP.Create(false, LocatorPort))
+	{
+		TestAssert(false);
+		return 0;
+	}
+	Locator.SafeUDP.SetCustomRecvCallback(OnFloodRequest);
+
+	MSafeUDP Client;
+	TestAssert(Client.Create(false, ClientPort));
+	Client.SetCustomRecvCallback(CountFloodResponse);
+	FloodResponses = 0;
+
+	const auto IP = GetIPv4Number("127.0.0.1");
+	const auto Start = std::chrono::steady_clock::now();
+	int Sent = 0;
+	while (Sent < RequestsPerSecond)
+	{
+		// Paced to the requested rate, and to what's been answered or dropped so far so that the
+		// socket buffers don't overflow on loopback in either direction.
+		const auto Elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start);
+		if (Sent >= Elapsed.count() * RequestsPerSecond ||
+			Sent - FloodResponses - Locator.Dropped >= MaxInFlight)
+		{
+			if (Elapsed > std::chrono::seconds(10))
+				break;
+			std::this_thread::yield();
+			continue;
+		}
+
+		auto* Packet = new char[sizeof(MPacketHeader) + 8]{};
+		auto* Header = reinterpret_cast<MPacketHeader*>(Packet);
+		Header->nMsg = MSGID_RAWCOMMAND;
+		Header->nSize = sizeof(MPacketHeader) + 8;
+		if (Client.Send(IP, LocatorPort, Packet, Header->nSize))
+			++Sent;
+		else
+			delete[] Packet;
+	}
+
+	int LastResponses = -1;
+	while (LastResponses != FloodResponses)
+	{
+		LastResponses = FloodResponses;
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	}
+
+	Client.Destroy();
+	Locator.SafeUDP.Destroy();
+
+	const auto Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+	MLog("Locator flood, %u/s burst %u: %d sent, %d received, %d dropped, %d answered, %.0f requests/s\n",
+		Rate, Burst, Sent, int(Locator.Requests), int(Locator.Dropped), LastResponses,
+		Locator.Requests / Seconds);
+
+	TestAssert(Sent == RequestsPerSecond);
+	TestAssert(Locator.Requests > Sent * 9 / 10);
+	return LastResponses;
+}
+
+}
+
+void TestLocator()
+{
+	TestRateLimiter();
+	TestIPtoCountryIndex();
+
+	constexpr int RequestsPerSecond = 100000;
+
+	// A single client flooding the locator only gets its burst and rate answered.
+	const auto Limited = Flood(10, 9, RequestsPerSecond);
+	TestAssert(Limited >= 9 && Limited <= 9 + 10 * 11);
+
+	// Without a limit, every request is answered from the prebuilt response.
+	const auto Unlimited = Flood(RequestsPerSecond, RequestsPerSecond, RequestsPerSecond);
+	TestAssert(Unlimited > RequestsPerSecond * 9 / 10);
+}
@@ -0,0 +1,171 @@
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include "Relevancy.h"
+#include "Config.h"
+#include "TestAssert.h"
+
+namespace {
+
+void TestPriority()
+{
+	RelevancyParams Params;
+	v3 Origin{0, 0, 0};
+
+	TestAssert(GetRelevancy(Params, Origin, {Params.NearDistance, 0, 0}, true) == 1);
+	TestAssert(GetRelevancy(Params, Origin, {Params.NearDistance, 0, 0}, false) == 1);
+	TestAssert(GetRelevancy(Params, Origin, {Params.FarDistance * 2, 0, 0}, true) ==
+		Params.MinPriority);
+
+	auto Middle = (Params.NearDistance + Params.FarDistance) / 2;
+	auto Visible = GetRelevancy(Params, Origin, {0, Middle, 0}, true);
+	auto Occluded = GetRelevancy(Params, Origin, {0, Middle, 0}, false);
+	TestAssert(Visible < 1 && Visible > Params.MinPriority);
+	TestAssert(Occluded < Visible && Occluded >= Params.MinPriority);
+
+	RelevancyAccumulator Accumulator;
+	MUID Subject{0, 1};
+	int Sent = 0;
+	for (int i = 0; i < 100; ++i)
+		Sent += Accumulator.Update(Subject, 0.25f);
+	// The first update, and then every fourth one.
+	TestAssert(Sent == 1 + 99 / 4);
+
+	int Checks = 0;
+	auto Check = [&] { ++Checks; return false; };
+	TestAssert(!Accumulator.IsVisible(Subject, 1000, Check));
+	TestAssert(!Accumulator.IsVisible(Subject, 1000 + RelevancyAccumulator::VisibilityInterval - 1,
+		Check));
+	TestAssert(Checks == 1);
+	Accumulator.IsVisible(Subject, 1000 + RelevancyAccumulator::VisibilityInterval, Check);
+	TestAssert(Checks == 2);
+}
+
+// Simulates a full Deathmatch room spread over a large map split in two by a wall with a door
+// in the middle, and measures how many basic info relays the server sends with and without
+// relevancy filtering.
+constexpr float DoorWidth = 800;
+
+bool WallBetween(const v3& a, const v3& b)
+{
+	if ((a.x < 0) == (b.x < 0))
+		return false;
+	auto t = a.x / (a.x - b.x);
+	auto y = a.y + (b.y - a.y) * t;
+	return std::abs(y) > DoorWidth / 2;
+}
+
+void TestBenchmark()
+{
+	constexpr int PlayerCount = 16;
+	constexpr int TickRate = 1000 / BASICINFO_INTERVAL;
+	constexpr int Seconds = 60;
+	constexpr float MapSize = 10000;
+	// The size of an MC_MATCH_P2P_COMMAND relaying an RG basic info over UDP, including the IP
+	// and UDP headers.
+	constexpr int RelaySize = 28 + 11 + 8 + 4 + 9 + 23;
+
+	std::mt19937 rng{777};
+	std::uniform_real_distribution<float> Uniform{0, 1};
+
+	struct Player
+	{
+		MUID UID;
+		v3 Pos;
+		float Yaw;
+		RelevancyAccumulator Relevancy;
+		// Ticks since each other player was last sent to this one.
+		std::vector<int> Gaps;
+	};
+	std::vector<Player> Players(PlayerCount);
+	for (int i = 0; i < PlayerCount; ++i)
+	{
+		auto& P = Players[i];
+		P.UID = MUID(0, 1 + i);
+		P.Pos = {(Uniform(rng) - 0.5f) * MapSize, (Uniform(rng) - 0.5f) * MapSize, 0};
+		P.Yaw = Uniform(rng) * 6.28f;
+		P.Gaps.resize(PlayerCount);
+	}
+
+	RelevancyParams Params;
+	long long Unfiltered = 0, Filtered = 0;
+	long long NearSkipped = 0;
+	int WorstGap = 0;
+	std::chrono::nanoseconds DecisionTime{};
+
+	for (int Tick = 0; Tick < TickRate * Seconds; ++Tick)
+	{
+		for (auto&& P : Players)
+		{
+			if (Uniform(rng) < 0.05f)
+				P.Yaw += (Uniform(rng) - 0.5f) * 3;
+			P.Pos += v3(cos(P.Yaw), sin(P.Yaw), 0) * (500.f / TickRate);
+			for (auto* Coord : {&P.Pos.x, &P.Pos.y})
+			{
+				if (std::abs(*Coord) > MapSize / 2)
+				{
+					*Coord = (std::max)(-MapSize / 2, (std::min)(*Coord, MapSize / 2));
+					P.Yaw += 3.14f;
+				}
+			}
+		}
+
+		for (auto&& Viewer : Players)
+		{
+			for (int i = 0; i < PlayerCount; ++i)
+			{
+				auto&& Subject = Players[i];
+				if (&Subject == &Viewer)
+					continue;
+
+				++Unfiltered;
+
+				auto Start = std::chrono::steady_clock::now();
+				auto Distance = RealSpace2::Magnitude(Subject.Pos - Viewer.Pos);
+				auto Visible = true;
+				if (Distance > Params.NearDistance)
+					Visible = Viewer.Relevancy.IsVisible(Subject.UID, u64(Tick) * BASICINFO_INTERVAL,
+						[&] { return !WallBetween(Viewer.Pos, Subject.Pos); });
+				auto Priority = GetRelevancy(Params, Viewer.Pos, Subject.Pos, Visible);
+				auto Send = Viewer.Relevancy.Update(Subject.UID, Priority);
+				DecisionTime += std::chrono::steady_clock::now() - Start;
+
+				if (Send)
+				{
+					++Filtered;
+					Viewer.Gaps[i] = 0;
+				}
+				else
+				{
+					if (Distance <= Params.NearDistance)
+						++NearSkipped;
+					WorstGap = (std::max)(WorstGap, ++Viewer.Gaps[i]);
+				}
+			}
+		}
+	}
+
+	auto PerPlayerSecond = [&](long long Relays) {
+		return double(Relays) * RelaySize / PlayerCount / Seconds; };
+	MLog("Relevancy with %d players: %.0f relays/s -> %.0f relays/s (%.0f%%), "
+		"%.0f -> %.0f bytes per player per second, %.0f ns per decision\n",
+		PlayerCount,
+		double(Unfiltered) / Seconds, double(Filtered) / Seconds,
+		double(Filtered) / Unfiltered * 100,
+		PerPlayerSecond(Unfiltered), PerPlayerSecond(Filtered),
+		double(DecisionTime.count()) / Unfiltered);
+
+	TestAssert(Filtered < Unfiltered * 3 / 4);
+	TestAssert(NearSkipped == 0);
+	// Even the least relevant players are updated at MinPriority of the full rate.
+	TestAssert(WorstGap < int(std::ceil(1 / Params.MinPriority)));
+}
+
+}
+
+void TestRelevancy()
+{
+	TestPriority();
+	TestBenchmark();
+}
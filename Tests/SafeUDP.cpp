@@ -0,0 +1,282 @@
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <random>
+#include <vector>
+#include <map>
+#include "MSafeUDP.h"
+#include "MInetUtil.h"
+#include "MDebug.h"
+#include "TestAssert.h"
+
+namespace {
+
+std::atomic<int> ReceivedDatagrams{0};
+
+bool CountDatagram(u32, u16, char*, u32)
+{
+	++ReceivedDatagrams;
+	return true;
+}
+
+// Floods a receiver on loopback from SenderCount senders and returns the number of datagrams
+// received per second.
+double MeasurePPS(bool BatchedIO, int ReceiverThreads, int SenderCount, int DatagramCount)
+{
+	constexpr int ReceiverPort = 17950;
+	constexpr int DatagramSize = 64;
+	constexpr int MaxInFlight = 128;
+
+	auto Receiver = std::make_unique<MSafeUDP>();
+	Receiver->SetBatchedIO(BatchedIO);
+	if (!Receiver->Create(false, ReceiverPort, true, ReceiverThreads))
+	{
+		TestAssert(false);
+		return 0;
+	}
+	Receiver->SetCustomRecvCallback(CountDatagram);
+
+	std::vector<std::unique_ptr<MSafeUDP>> Senders;
+	for (int i = 0; i < SenderCount; ++i)
+	{
+		Senders.push_back(std::make_unique<MSafeUDP>());
+		Senders.back()->SetBatchedIO(BatchedIO);
+		TestAssert(Senders.back()->Create(false, ReceiverPort + 1 + i));
+	}
+
+	ReceivedDatagrams = 0;
+	const auto IP = GetIPv4Number("127.0.0.1");
+	const auto Start = std::chrono::steady_clock::now();
+	for (int i = 0; i < DatagramCount; ++i)
+	{
+		// Keep few enough datagrams in flight that the receiver's socket buffer doesn't overflow,
+		// so that this measures throughput instead of how fast the kernel drops them. If some
+		// were dropped anyway, go on after a while.
+		const auto WaitStart = std::chrono::steady_clock::now();
+		while (i - ReceivedDatagrams >= MaxInFlight &&
+			std::chrono::steady_clock::now() - WaitStart < std::chrono::milliseconds(10))
+			std::this_thread::yield();
+
+		auto* Data = new char[DatagramSize]{};
+		while (!Senders[i % SenderCount]->Send(IP, ReceiverPort, Data, DatagramSize))
+			std::this_thread::yield();
+	}
+
+	// Wait until the receiver stops getting anything.
+	auto End = std::chrono::steady_clock::now();
+	int LastReceived = -1;
+	while (LastReceived != ReceivedDatagrams)
+	{
+		LastReceived = ReceivedDatagrams;
+		End = std::chrono::steady_clock::now();
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	}
+
+	for (auto&& Sender : Senders)
+		Sender->Destroy();
+	Receiver->Destroy();
+
+	const auto Seconds = std::chrono::duration<double>(End - Start).count();
+	MLog("SafeUDP loopback, %s I/O, %d receiver threads: %d/%d datagrams in %.3f s, %.0f pps\n",
+		BatchedIO ? "batched" : "unbatched", ReceiverThreads,
+		LastReceived, DatagramCount, Seconds, LastReceived / Seconds);
+
+	TestAssert(LastReceived > DatagramCount * 9 / 10);
+	return LastReceived / Seconds;
+}
+
+void TestTimerWheel()
+{
+	constexpr u32 TickMS = 10;
+	std::mt19937 rng{1234};
+	u64 Now = 1000000;
+	MTimerWheel<int> Wheel{TickMS, Now};
+
+	struct Timer { u64 Deadline; u64 FiredAt; u64 PreviousAdvance; };
+	std::vector<Timer> Timers;
+	auto GetTick = [&](u64 Deadline) { return (Deadline + TickMS - 1) / TickMS; };
+	std::uniform_int_distribution<u64> DelayDist{0, 100000};
+	std::uniform_int_distribution<u64> StepDist{1, 300};
+	for (int Step = 0; Step < 3000; ++Step)
+	{
+		for (int i = 0; i < 10; ++i)
+		{
+			Timers.push_back({Now + DelayDist(rng), 0, 0});
+			Wheel.Add(Timers.back().Deadline, int(Timers.size() - 1));
+		}
+
+		const auto PreviousAdvance = Now;
+		Now += Step < 2000 ? StepDist(rng) : 100;
+		u64 LastTick = 0;
+		Wheel.Advance(Now, [&](int Index) {
+			auto& Timer = Timers[Index];
+			TestAssert(Timer.FiredAt == 0);
+			// In order of deadline, down to the tick.
+			TestAssert(GetTick(Timer.Deadline) >= LastTick);
+			LastTick = GetTick(Timer.Deadline);
+			Timer.FiredAt = Now;
+			Timer.PreviousAdvance = PreviousAdvance;
+		});
+	}
+
+	const auto PreviousAdvance = Now;
+	Now += 200000;
+	Wheel.Advance(Now, [&](int Index) {
+		Timers[Index].FiredAt = Now;
+		Timers[Index].PreviousAdvance = PreviousAdvance;
+	});
+	TestAssert(Wheel.size() == 0);
+
+	// Every timer fires on the first Advance that reaches its tick.
+	for (auto&& Timer : Timers)
+	{
+		TestAssert(Timer.FiredAt != 0);
+		TestAssert(GetTick(Timer.Deadline) <= Timer.FiredAt / TickMS);
+		TestAssert(GetTick(Timer.Deadline) > Timer.PreviousAdvance / TickMS);
+	}
+}
+
+void TestNetLinkTable()
+{
+	std::mt19937 rng{4321};
+	MNetLinkTable Table;
+	std::map<i64, MNetLink*> Expected;
+
+	// Few distinct ports, so that keys are reused after being erased.
+	std::uniform_int_distribution<u32> IPDist{0, 255};
+	std::uniform_int_distribution<u32> PortDist{7700, 7800};
+	for (int i = 0; i < 100000; ++i)
+	{
+		const auto Key = MNetLink::GetMapKey(0x0100007F + (IPDist(rng) << 24), u16(PortDist(rng)));
+		auto& Shard = Table.GetShard(Key);
+		auto it = Expected.find(Key);
+		TestAssert(Shard.Find(Key) == (it == Expected.end() ? nullptr : it->second));
+
+		if (it == Expected.end())
+		{
+			auto* Link = reinterpret_cast<MNetLink*>(uintptr_t(i + 1));
+			Shard.Insert(Key, Link);
+			Expected.emplace(Key, Link);
+		}
+		else if (rng() % 2)
+		{
+			TestAssert(Shard.Erase(Key) == it->second);
+			Expected.erase(it);
+		}
+	}
+
+	size_t Count = 0;
+	Table.ForEachShard([&](MNetLinkTable::Shard& Shard) {
+		Count += Shard.size();
+		Shard.ForEach([&](MNetLink*) { --Count; });
+	});
+	TestAssert(Count == 0);
+	for (auto&& Pair : Expected)
+		TestAssert(Table.GetShard(Pair.first).Find(Pair.first) == Pair.second);
+}
+
+void TestRTT()
+{
+	constexpr int ServerPort = 17960;
+	constexpr int ClientPort = 17961;
+
+	auto Server = std::make_unique<MSafeUDP>();
+	auto Client = std::make_unique<MSafeUDP>();
+	TestAssert(Server->Create(false, ServerPort));
+	TestAssert(Client->Create(false, ClientPort));
+	// The socket threads take up to 100 ms to start, which would be counted in the RTT.
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+	char IP[] = "127.0.0.1";
+	Client->Connect(IP, ServerPort);
+	const auto LinkKey = MNetLink::GetMapKey(GetIPv4Number(IP), MSocket::htons(ServerPort));
+
+	bool Established = false;
+	float SRTT = -1;
+	u32 Timeout = 0;
+	// The ACK of the SYN may arrive after the server's reply to it.
+	for (int i = 0; i < 100 && (!Established || SRTT < 0); ++i)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		auto Lock = Client->LockNetLink(LinkKey);
+		auto* pNetLink = Client->FindNetLink(LinkKey);
+		if (pNetLink)
+		{
+			Established = pNetLink->GetLinkState() == MNetLink::LINKSTATE_ESTABLISHED;
+			SRTT = pNetLink->GetSmoothedRTT();
+			Timeout = pNetLink->GetRetransmitTimeout();
+		}
+	}
+
+	// The SYN was acknowledged, so there's an RTT sample, and on loopback it's small enough that
+	// the timeout is the minimum.
+	TestAssert(Established);
+	TestAssert(SRTT >= 0 && SRTT < 50);
+	TestAssert(Timeout < 500);
+
+	Client->Destroy();
+	Server->Destroy();
+}
+
+// Opens thousands of links to ports nobody listens on, so that every SYN is retransmitted until
+// the links time out.
+void TestRetransmitStress()
+{
+	constexpr int ClientPort = 17962;
+	constexpr int LinkCount = 2000;
+	constexpr int FirstDeadPort = 20000;
+	constexpr int WaitMS = 3000;
+
+	auto Client = std::make_unique<MSafeUDP>();
+	TestAssert(Client->Create(false, ClientPort));
+
+	char IP[] = "127.0.0.1";
+	for (int i = 0; i < LinkCount; ++i)
+		Client->Connect(IP, FirstDeadPort + i);
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(WaitMS));
+
+	int Links = 0;
+	int Sends = 0;
+	int Waiting = 0;
+	Client->ForEachNetLink([&](MNetLink* pNetLink) {
+		++Links;
+		for (auto&& Item : pNetLink->m_ACKWaits)
+		{
+			if (!Item.pPacket)
+				continue;
+			++Waiting;
+			Sends += Item.nSendCount;
+		}
+	});
+
+	MLog("SafeUDP retransmit stress: %d links, %d unacknowledged packets, %d sends in %d ms "
+		"(%.2f per packet)\n",
+		Links, Waiting, Sends, WaitMS, double(Sends) / (std::max)(Waiting, 1));
+
+	// Sent at 0, and retransmitted after 500 and 1000 ms more, with nothing else due before 3500.
+	TestAssert(Links == LinkCount);
+	TestAssert(Waiting == LinkCount);
+	TestAssert(Sends >= LinkCount * 3 - LinkCount / 10 && Sends <= LinkCount * 3 + LinkCount / 10);
+
+	Client->Destroy();
+}
+
+}
+
+void TestSafeUDP()
+{
+	TestTimerWheel();
+	TestNetLinkTable();
+	TestRTT();
+	TestRetransmitStress();
+
+	constexpr int DatagramCount = 200000;
+
+	MeasurePPS(false, 1, 1, DatagramCount);
+	MeasurePPS(true, 1, 1, DatagramCount);
+#ifdef __linux__
+	MeasurePPS(true, 4, 4, DatagramCount);
+#endif
+}
@@ -0,0 +1,198 @@
+#include <vector>
+#include <algorithm>
+#include <random>
+#include "MSequenceWindow.h"
+#include "TestAssert.h"
+
+namespace {
+
+void TestLatest()
+{
+	MSequenceWindow Window;
+	TestAssert(Window.AcceptLatest(1));
+	TestAssert(!Window.AcceptLatest(1));
+	TestAssert(!Window.AcceptLatest(0));
+	TestAssert(Window.AcceptLatest(5));
+	TestAssert(!Window.AcceptLatest(3));
+	TestAssert(Window.AcceptLatest(6));
+
+	// The counter wrapping around is still newer.
+	Window.Reset();
+	TestAssert(Window.AcceptLatest(0xFFFFFFFF));
+	TestAssert(Window.AcceptLatest(0));
+	TestAssert(!Window.AcceptLatest(0xFFFFFFFE));
+	TestAssert(Window.AcceptLatest(1));
+}
+
+void TestUnique()
+{
+	MSequenceWindow Window;
+	TestAssert(Window.AcceptUnique(10));
+	TestAssert(Window.AcceptUnique(8));
+	TestAssert(!Window.AcceptUnique(8));
+	TestAssert(Window.AcceptUnique(9));
+	TestAssert(!Window.AcceptUnique(10));
+
+	// Moving the window forward keeps what's been seen within it.
+	TestAssert(Window.AcceptUnique(10 + MSequenceWindow::Size - 1));
+	TestAssert(!Window.AcceptUnique(10));
+	TestAssert(Window.AcceptUnique(11));
+	TestAssert(!Window.AcceptUnique(11));
+
+	// Anything before the window is dropped, since it's too late to matter.
+	TestAssert(Window.AcceptUnique(200));
+	TestAssert(!Window.AcceptUnique(200 - MSequenceWindow::Size));
+	TestAssert(Window.AcceptUnique(200 - MSequenceWindow::Size + 1));
+
+	Window.Reset();
+	TestAssert(Window.AcceptUnique(0xFFFFFFFF));
+	TestAssert(Window.AcceptUnique(1));
+	TestAssert(Window.AcceptUnique(0));
+	TestAssert(!Window.AcceptUnique(0xFFFFFFFF));
+}
+
+// Simulates a stream of basic info packets over a link with loss and latency, once delivered
+// like TCP (reliably and in order, so a lost packet holds up everything after it until it's
+// retransmitted) and once like the UDP channel (lost packets stay lost, reordered ones are
+// filtered by MSequenceWindow).
+struct LinkParams
+{
+	// All times are in milliseconds.
+	double Latency;
+	double Jitter;
+	double Loss;
+	double RetransmitTimeout;
+};
+
+struct SimResult
+{
+	// How old the newest state the receiver had was, sampled every millisecond.
+	double AverageAge;
+	double WorstAge;
+	// Times the receiver's state went back to an older one.
+	int Regressions;
+};
+
+constexpr double SendInterval = 1000.0 / 60;
+constexpr int PacketCount = 60 * 30;
+
+SimResult Measure(const std::vector<double>& SendTimes,
+	const std::vector<std::pair<double, int>>& Applied)
+{
+	SimResult Result{};
+	int Current = -1;
+	size_t Next = 0;
+	int Samples = 0;
+	auto End = SendTimes.back();
+	for (double Time = Applied.front().first; Time < End; Time += 1)
+	{
+		for (; Next < Applied.size() && Applied[Next].first <= Time; ++Next)
+		{
+			if (Applied[Next].second < Current)
+				++Result.Regressions;
+			Current = Applied[Next].second;
+		}
+		auto Age = Time - SendTimes[Current];
+		Result.AverageAge += Age;
+		Result.WorstAge = (std::max)(Result.WorstAge, Age);
+		++Samples;
+	}
+	Result.AverageAge /= Samples;
+	return Result;
+}
+
+struct SimResults
+{
+	SimResult TCP;
+	SimResult UDP;
+	SimResult UnfilteredUDP;
+};
+
+SimResults Simulate(const LinkParams& Link, unsigned Seed)
+{
+	std::mt19937 rng{Seed};
+	std::uniform_real_distribution<double> Uniform{0, 1};
+	auto Lost = [&] { return Uniform(rng) < Link.Loss; };
+	auto Delay = [&] { return Link.Latency + Uniform(rng) * Link.Jitter; };
+
+	std::vector<double> SendTimes(PacketCount);
+	for (int i = 0; i < PacketCount; ++i)
+		SendTimes[i] = i * SendInterval;
+
+	SimResults Results;
+
+	// TCP: every packet arrives eventually, but none can be delivered before the ones sent
+	// before it.
+	{
+		std::vector<std::pair<double, int>> Applied;
+		double LastDelivery = 0;
+		for (int i = 0; i < PacketCount; ++i)
+		{
+			auto SendTime = SendTimes[i];
+			while (Lost())
+				SendTime += Link.RetransmitTimeout;
+			LastDelivery = (std::max)(LastDelivery, SendTime + Delay());
+			Applied.emplace_back(LastDelivery, i);
+		}
+		Results.TCP = Measure(SendTimes, Applied);
+	}
+
+	// UDP: packets arrive in whatever order the network delivers them, or not at all.
+	{
+		std::vector<std::pair<double, int>> Arrivals;
+		for (int i = 0; i < PacketCount; ++i)
+			if (!Lost())
+				Arrivals.emplace_back(SendTimes[i] + Delay(), i);
+		std::stable_sort(Arrivals.begin(), Arrivals.end(), [](auto&& a, auto&& b) {
+			return a.first < b.first;
+		});
+
+		Results.UnfilteredUDP = Measure(SendTimes, Arrivals);
+
+		MSequenceWindow Window;
+		std::vector<std::pair<double, int>> Applied;
+		for (auto&& Arrival : Arrivals)
+			if (Window.AcceptLatest(u32(Arrival.second)))
+				Applied.push_back(Arrival);
+		Results.UDP = Measure(SendTimes, Applied);
+	}
+
+	return Results;
+}
+
+void TestLossSimulation()
+{
+	// A perfect link behaves the same either way.
+	auto Perfect = Simulate({50, 0, 0, 200}, 1);
+	TestAssert(Perfect.TCP.AverageAge == Perfect.UDP.AverageAge);
+	TestAssert(Perfect.UDP.Regressions == 0);
+
+	for (auto Loss : {0.01, 0.05, 0.1})
+	{
+		auto Results = Simulate({50, 20, Loss, 200}, 1234);
+
+		MLog("Loss %.0f%%: average state age TCP %.1f ms, UDP %.1f ms; "
+			"worst TCP %.1f ms, UDP %.1f ms\n",
+			Loss * 100,
+			Results.TCP.AverageAge, Results.UDP.AverageAge,
+			Results.TCP.WorstAge, Results.UDP.WorstAge);
+
+		TestAssert(Results.UDP.AverageAge < Results.TCP.AverageAge);
+		TestAssert(Results.UDP.WorstAge < Results.TCP.WorstAge);
+		TestAssert(Results.TCP.Regressions == 0);
+
+		// The jitter reorders packets, which would move players back in time without the
+		// sequence numbers.
+		TestAssert(Results.UnfilteredUDP.Regressions > 0);
+		TestAssert(Results.UDP.Regressions == 0);
+	}
+}
+
+}
+
+void TestSequenceWindow()
+{
+	TestLatest();
+	TestUnique();
+	TestLossSimulation();
+}
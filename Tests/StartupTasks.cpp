@@ -0,0 +1,89 @@
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "MStartupTasks.h"
+#include "MDebug.h"
+#include "TestAssert.h"
+
+namespace {
+
+using TaskState = MStartupTasks::TaskState;
+
+// Tasks that sleep, shaped like startup: a few independent files, and some that need one of them.
+void TestStartupTaskOrder(int ThreadCount)
+{
+	constexpr int SleepMS = 40;
+
+	MStartupTasks Tasks;
+	std::atomic<int> Finished[8]{};
+	std::atomic<bool> OrderHeld{true};
+	auto Sleeper = [&](int Index, std::initializer_list<int> WaitsFor) {
+		return [&, Index, Deps = std::vector<int>(WaitsFor)] {
+			for (auto Dep : Deps)
+				if (!Finished[Dep])
+					OrderHeld = false;
+			std::this_thread::sleep_for(std::chrono::milliseconds(SleepMS));
+			Finished[Index] = 1;
+			return true;
+		};
+	};
+
+	const auto Items = Tasks.Add("items", Sleeper(0, {}));
+	const auto QuestItems = Tasks.Add("quest items", Sleeper(1, {}));
+	Tasks.Add("shop", Sleeper(2, {0, 1}), {Items, QuestItems});
+	Tasks.Add("quests", Sleeper(3, {0, 1}), {Items, QuestItems});
+	const auto WorldItems = Tasks.Add("world items", Sleeper(4, {}));
+	Tasks.Add("world item spawns", Sleeper(5, {4}), {WorldItems});
+	Tasks.Add("channel rules", Sleeper(6, {}));
+	Tasks.Add("gungame", Sleeper(7, {}));
+
+	TestAssert(Tasks.Run(ThreadCount));
+	TestAssert(OrderHeld);
+	for (auto&& Task : Tasks.GetTasks())
+		TestAssert(Task.State == TaskState::Succeeded);
+
+	int Lines = 0;
+	Tasks.Report([&](const char* Line) { MLog("%s\n", Line); ++Lines; });
+	TestAssert(Lines == int(Tasks.GetTasks().size()) + 1);
+
+	// The longest chain is two tasks long, so with enough threads that's all it takes.
+	if (ThreadCount == 1)
+		TestAssert(Tasks.GetElapsedMS() >= 8 * SleepMS);
+	else if (ThreadCount >= 6)
+		TestAssert(Tasks.GetElapsedMS() < 6 * SleepMS);
+}
+
+void TestStartupTaskFailure()
+{
+	MStartupTasks Tasks;
+	std::atomic<int> Ran{0};
+	auto Succeed = [&] { ++Ran; return true; };
+
+	const auto Items = Tasks.Add("items", [&] { ++Ran; return false; });
+	const auto Shop = Tasks.Add("shop", Succeed, {Items});
+	const auto Other = Tasks.Add("other", Succeed);
+	const auto Both = Tasks.Add("both", Succeed, {Other, Shop});
+	const auto Independent = Tasks.Add("independent", Succeed, {Other});
+
+	TestAssert(!Tasks.Run(4));
+	auto& Result = Tasks.GetTasks();
+	TestAssert(Result[Items].State == TaskState::Failed);
+	TestAssert(Result[Shop].State == TaskState::Skipped);
+	TestAssert(Result[Both].State == TaskState::Skipped);
+	TestAssert(Result[Other].State == TaskState::Succeeded);
+	TestAssert(Result[Independent].State == TaskState::Succeeded);
+	TestAssert(Ran == 3);
+}
+
+}
+
+void TestStartupTasks()
+{
+	for (int ThreadCount : {1, 2, 8})
+		TestStartupTaskOrder(ThreadCount);
+	TestStartupTaskFailure();
+
+	MStartupTasks Empty;
+	TestAssert(Empty.Run(0));
+}
@@ -0,0 +1,235 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "GlobalTypes.h"
+#include "MFile.h"
+#include "MSocket.h"
+#include "SafeString.h"
+
+// A small HTTP/1.1 server on 127.0.0.1 for the launcher tests.
+// It serves the files under the working directory, understands single byte ranges and keeps
+// connections alive, and waits Latency before each response to stand in for a distant server.
+class TestHTTPServer
+{
+public:
+	std::chrono::milliseconds Latency{0};
+
+	// The most connections that were open, and requests that were being answered, at once.
+	std::atomic<int> MaxConnections{0};
+	std::atomic<int> MaxRequests{0};
+	std::atomic<int> NumRequests{0};
+
+	~TestHTTPServer() { Stop(); }
+
+	bool Start()
+	{
+#ifndef _WIN32
+		// Writing to a connection the client has closed shouldn't kill the tests.
+		signal(SIGPIPE, SIG_IGN);
+#endif
+
+		if (!MSocket::Startup())
+			return false;
+
+		Listener = MSocket::socket(MSocket::AF::INET, MSocket::SOCK::STREAM, 0);
+		if (Listener == InvalidSocket)
+			return false;
+
+		MSocket::sockaddr_in Address{};
+		Address.sin_family = MSocket::AF::INET;
+		Address.sin_addr.s_addr = MSocket::htonl(0x7F000001);
+		Address.sin_port = 0;
+		int AddressSize = sizeof(Address);
+		if (MSocket::bind(Listener, (MSocket::sockaddr*)&Address, AddressSize) != 0 ||
+			MSocket::listen(Listener, 64) != 0 ||
+			MSocket::getsockname(Listener, (MSocket::sockaddr*)&Address, &AddressSize) != 0)
+		{
+			MSocket::closesocket(Listener);
+			Listener = InvalidSocket;
+			return false;
+		}
+
+		Port = MSocket::ntohs(Address.sin_port);
+		AcceptThread = std::thread{[this] { AcceptLoop(); }};
+		return true;
+	}
+
+	void Stop()
+	{
+		if (Listener == InvalidSocket)
+			return;
+
+		// Shutting the sockets down wakes up the threads blocked on them.
+		Stopping = true;
+		MSocket::shutdown(Listener, MSocket::SD::BOTH);
+		MSocket::closesocket(Listener);
+		Listener = InvalidSocket;
+		AcceptThread.join();
+
+		{
+			std::lock_guard<std::mutex> Lock{Mutex};
+			for (auto Socket : Connections)
+				MSocket::shutdown(Socket, MSocket::SD::BOTH);
+		}
+		for (auto&& Thread : ConnectionThreads)
+			Thread.join();
+		ConnectionThreads.clear();
+	}
+
+	// Returns the URL for a path relative to the working directory.
+	std::string URL(const char* Path) const
+	{
+		return strprintf("http://127.0.0.1:%d/%s", Port, Path);
+	}
+
+private:
+	// MSocket::InvalidSocket is an int outside of Windows, while sockets are unsigned.
+	static constexpr SOCKET InvalidSocket = static_cast<SOCKET>(MSocket::InvalidSocket);
+
+	static void UpdateMax(std::atomic<int>& Max, int Value)
+	{
+		auto Old = Max.load();
+		while (Value > Old && !Max.compare_exchange_weak(Old, Value));
+	}
+
+	void AcceptLoop()
+	{
+		while (!Stopping)
+		{
+			const auto Socket = MSocket::accept(Listener, nullptr, nullptr);
+			if (Socket == InvalidSocket)
+				continue;
+
+			std::lock_guard<std::mutex> Lock{Mutex};
+			if (Stopping)
+			{
+				MSocket::closesocket(Socket);
+				break;
+			}
+			Connections.push_back(Socket);
+			UpdateMax(MaxConnections, int(Connections.size()));
+			ConnectionThreads.emplace_back([this, Socket] { Serve(Socket); });
+		}
+	}
+
+	bool Send(SOCKET Socket, const char* Data, size_t Size)
+	{
+		while (Size > 0)
+		{
+			const auto Sent = MSocket::send(Socket, Data, int(std::min(Size, size_t(64 * 1024))), 0);
+			if (Sent <= 0)
+				return false;
+			Data += Sent;
+			Size -= Sent;
+		}
+		return true;
+	}
+
+	void Serve(SOCKET Socket)
+	{
+		std::string Buffer;
+		char RecvBuffer[4096];
+		while (true)
+		{
+			const auto HeaderEnd = Buffer.find("\r\n\r\n");
+			if (HeaderEnd == std::string::npos)
+			{
+				const auto Received = MSocket::recv(Socket, RecvBuffer, sizeof(RecvBuffer), 0);
+				if (Received <= 0)
+					break;
+				Buffer.append(RecvBuffer, Received);
+				continue;
+			}
+
+			const auto Request = Buffer.substr(0, HeaderEnd);
+			Buffer.erase(0, HeaderEnd + 4);
+
+			++NumRequests;
+			UpdateMax(MaxRequests, ++ActiveRequests);
+			const auto Success = Respond(Socket, Request);
+			--ActiveRequests;
+			if (!Success)
+				break;
+		}
+
+		std::lock_guard<std::mutex> Lock{Mutex};
+		Connections.erase(std::find(Connections.begin(), Connections.end(), Socket));
+		MSocket::closesocket(Socket);
+	}
+
+	bool Respond(SOCKET Socket, const std::string& Request)
+	{
+		std::this_thread::sleep_for(Latency);
+
+		// "GET /path HTTP/1.1"
+		const auto PathBegin = Request.find(' ') + 2;
+		const auto PathEnd = Request.find(' ', PathBegin);
+		const auto Path = Request.substr(PathBegin, PathEnd - PathBegin);
+
+		MFile::File File{Path.c_str()};
+		if (!File.is_open())
+		{
+			const char NotFound[] = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+			return Send(Socket, NotFound, sizeof(NotFound) - 1);
+		}
+
+		const auto FileSize = File.size();
+		u64 Begin = 0;
+		u64 End = FileSize;
+		bool IsRange = false;
+
+		// "Range: bytes=100-200", inclusive, with either end possibly left out.
+		const auto RangeIndex = Request.find("\r\nRange: bytes=");
+		if (RangeIndex != std::string::npos)
+		{
+			unsigned long long First = 0, Last = 0;
+			const auto RangeString = Request.c_str() + RangeIndex + strlen("\r\nRange: bytes=");
+			if (sscanf(RangeString, "%llu-%llu", &First, &Last) == 2 && First <= Last &&
+				First < FileSize)
+			{
+				Begin = First;
+				End = std::min(u64(Last) + 1, FileSize);
+				IsRange = true;
+			}
+		}
+
+		std::vector<char> Body(size_t(End - Begin));
+		if (!File.seek(Begin, MFile::Seek::Begin) || File.read(Body.data(), Body.size()) != Body.size())
+			return false;
+
+		std::string Header;
+		if (IsRange)
+		{
+			Header = strprintf("HTTP/1.1 206 Partial Content\r\n"
+				"Content-Range: bytes %llu-%llu/%llu\r\n",
+				Begin, End - 1, FileSize);
+		}
+		else
+		{
+			Header = "HTTP/1.1 200 OK\r\n";
+		}
+		Header += strprintf("Content-Length: %llu\r\n\r\n", u64(Body.size()));
+
+		// Sent in one go so that Nagle's algorithm doesn't hold the body back.
+		Body.insert(Body.begin(), Header.begin(), Header.end());
+		return Send(Socket, Body.data(), Body.size());
+	}
+
+	SOCKET Listener = InvalidSocket;
+	int Port = 0;
+	std::atomic<bool> Stopping{false};
+	std::atomic<int> ActiveRequests{0};
+	std::thread AcceptThread;
+	std::mutex Mutex;
+	std::vector<SOCKET> Connections;
+	std::vector<std::thread> ConnectionThreads;
+};
@@ -0,0 +1,631 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "MZFileSystem.h"
+#include "MZFile.h"
+#include "MFile.h"
+#include "MDebug.h"
+#include "MLZ4.h"
+#include "MZip.h"
+#include "MZFileCache.h"
+#include "MPathTable.h"
+#include "zip/zlib.h"
+#include "TestAssert.h"
+
+#ifdef CreateFile
+#undef CreateFile
+#endif
+
+namespace {
+
+constexpr auto ZFSTestDir = "zfs_test";
+
+struct ArchiveEntry
+{
+	std::string Name;
+	std::vector<char> Data;
+	bool Compress;
+};
+
+void Put16(std::vector<char>& Out, u16 Value)
+{
+	Out.push_back(char(Value & 0xFF));
+	Out.push_back(char(Value >> 8));
+}
+
+void Put32(std::vector<char>& Out, u32 Value)
+{
+	Put16(Out, u16(Value & 0xFFFF));
+	Put16(Out, u16(Value >> 16));
+}
+
+// The inverse of the header obfuscation MZip undoes for MRS2 archives.
+void ObfuscateMrs2(char* Data, size_t Size)
+{
+	for (size_t i = 0; i < Size; ++i)
+	{
+		const u8 d = u8(Data[i]) ^ 0xFF;
+		Data[i] = char(u8((d << 3) | (d >> 5)));
+	}
+}
+
+std::vector<char> Deflate(const std::vector<char>& Data)
+{
+	z_stream Stream{};
+	TestAssert(deflateInit2(&Stream, Z_BEST_SPEED, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+	std::vector<char> Out(deflateBound(&Stream, uLong(Data.size())));
+	Stream.next_in = (Bytef*)Data.data();
+	Stream.avail_in = uInt(Data.size());
+	Stream.next_out = (Bytef*)Out.data();
+	Stream.avail_out = uInt(Out.size());
+	TestAssert(deflate(&Stream, Z_FINISH) == Z_STREAM_END);
+	Out.resize(Stream.total_out);
+	deflateEnd(&Stream);
+	return Out;
+}
+
+// Builds a zip archive, or an MRS2 archive if Mrs2 is set.
+std::vector<char> MakeArchive(const std::vector<ArchiveEntry>& Entries, bool Mrs2)
+{
+	std::vector<char> Out;
+	std::vector<char> Dir;
+	for (auto&& Entry : Entries)
+	{
+		const auto Stored = Entry.Compress ? Deflate(Entry.Data) : Entry.Data;
+		const auto CRC = u32(crc32(0, (const Bytef*)Entry.Data.data(), uInt(Entry.Data.size())));
+		const auto Method = u16(Entry.Compress ? 8 : 0);
+		const auto HeaderOffset = Out.size();
+
+		Put32(Out, 0x04034b50);
+		for (u16 Field : {u16(20), u16(0), Method, u16(0), u16(0)})
+			Put16(Out, Field);
+		for (u32 Field : {CRC, u32(Stored.size()), u32(Entry.Data.size())})
+			Put32(Out, Field);
+		Put16(Out, u16(Entry.Name.size()));
+		Put16(Out, 0);
+		Out.insert(Out.end(), Entry.Name.begin(), Entry.Name.end());
+		if (Mrs2)
+			ObfuscateMrs2(Out.data() + HeaderOffset, Out.size() - HeaderOffset);
+		Out.insert(Out.end(), Stored.begin(), Stored.end());
+
+		Put32(Dir, 0x02014b50);
+		for (u16 Field : {u16(20), u16(20), u16(0), Method, u16(0), u16(0)})
+			Put16(Dir, Field);
+		for (u32 Field : {CRC, u32(Stored.size()), u32(Entry.Data.size())})
+			Put32(Dir, Field);
+		for (u16 Field : {u16(Entry.Name.size()), u16(0), u16(0), u16(0), u16(0)})
+			Put16(Dir, Field);
+		Put32(Dir, 0);
+		Put32(Dir, u32(HeaderOffset));
+		Dir.insert(Dir.end(), Entry.Name.begin(), Entry.Name.end());
+	}
+
+	std::vector<char> End;
+	Put32(End, 0x06054b50);
+	for (u16 Field : {u16(0), u16(0), u16(Entries.size()), u16(Entries.size())})
+		Put16(End, Field);
+	Put32(End, u32(Dir.size()));
+	Put32(End, u32(Out.size()));
+	Put16(End, 0);
+
+	if (Mrs2)
+	{
+		ObfuscateMrs2(Dir.data(), Dir.size());
+		ObfuscateMrs2(End.data(), End.size());
+	}
+	Out.insert(Out.end(), Dir.begin(), Dir.end());
+	Out.insert(Out.end(), End.begin(), End.end());
+	return Out;
+}
+
+void WriteTestFile(const char* Name, const std::vector<char>& Data)
+{
+	char Path[MFile::MaxPath];
+	sprintf_safe(Path, "%s/%s", ZFSTestDir, Name);
+	MFile::RWFile File{Path, MFile::Clear};
+	TestAssert(File.is_open());
+	TestAssert(File.write(Data.data(), Data.size()) == Data.size());
+}
+
+void DeleteTestFile(const char* Name)
+{
+	char Path[MFile::MaxPath];
+	sprintf_safe(Path, "%s/%s", ZFSTestDir, Name);
+	MFile::Delete(Path);
+}
+
+// Lets the test read the same archives through stdio, the way unmappable archives are read.
+struct UnmappedZFileSystem : MZFileSystem
+{
+	void Unmap()
+	{
+		for (auto&& File : Files)
+			File.ArchiveData = nullptr;
+		Archives.clear();
+	}
+};
+
+std::vector<ArchiveEntry> MakeArchiveEntries(int SmallFileCount)
+{
+	std::mt19937 rng{1357};
+	std::vector<ArchiveEntry> Entries;
+
+	std::string Xml = "<XML>\n";
+	for (int i = 0; i < 200; ++i)
+		Xml += "\t<ITEM id=\"" + std::to_string(i) + "\" name=\"item\"/>\n";
+	Xml += "</XML>\n";
+	Entries.push_back({"system/zitem.xml", {Xml.begin(), Xml.end()}, false});
+
+	std::vector<char> Big(512 * 1024);
+	for (auto&& c : Big)
+		c = char('a' + rng() % 4);
+	Entries.push_back({"model/big.elu", Big, true});
+	Entries.push_back({"model/big_stored.elu", Big, false});
+
+	for (int i = 0; i < SmallFileCount; ++i)
+	{
+		std::vector<char> Small(64 + rng() % 4096);
+		for (auto&& c : Small)
+			c = char('A' + rng() % 16);
+		Entries.push_back({"ani/" + std::to_string(i) + ".ani", Small, i % 2 == 0});
+	}
+
+	return Entries;
+}
+
+// Recompressed is set for archives converted to MRS3, where which entries are compressed depends on
+// the method they were converted with.
+void CheckArchiveFile(MZFileSystem& FS, const char* Archive, const ArchiveEntry& Entry, bool Mapped,
+	bool Recompressed = false)
+{
+	char Path[MFile::MaxPath];
+	sprintf_safe(Path, "%s/%s", Archive, Entry.Name.c_str());
+	auto* Desc = FS.GetFileDesc(Path);
+	TestAssert(Desc && Desc->Size == Entry.Data.size());
+	TestAssert((Desc->ArchiveData != nullptr) == Mapped);
+	if (!Recompressed)
+		TestAssert((Desc->CompressedSize == 0) == !Entry.Compress);
+
+	const auto Size = int(Entry.Data.size());
+	std::vector<char> Data(Size);
+	{
+		// Reads in pieces, with a seek back in between.
+		MZFile File;
+		TestAssert(File.Open(Path, &FS));
+		TestAssert(File.GetLength() == Entry.Data.size());
+		const auto Half = Size / 2;
+		TestAssert(File.Read(Data.data(), Half));
+		TestAssert(File.Seek(0, MZFile::begin));
+		TestAssert(File.Read(Data.data(), Half));
+		TestAssert(File.Read(Data.data() + Half, Size - Half));
+		TestAssert(!File.Read(Data.data(), 1));
+		TestAssert(Data == Entry.Data);
+	}
+	{
+		MZFile File;
+		TestAssert(File.Open(Path, &FS));
+		auto* p = File.GetData();
+		TestAssert(p && memcmp(p, Entry.Data.data(), Size) == 0);
+		// Stored files aren't copied out of the mapping.
+		TestAssert((p == Desc->ArchiveData) == (Mapped && Desc->CompressedSize == 0));
+	}
+	{
+		MZFile File;
+		TestAssert(File.Open(Path, &FS));
+		auto Released = File.Release();
+		TestAssert(Released && memcmp(Released.get(), Entry.Data.data(), Size) == 0);
+		TestAssert(Released[Size] == 0);
+	}
+}
+
+// Opens and reads every file, like loading a server's resources does, and returns the files/s.
+double MeasureArchiveReads(MZFileSystem& FS, const std::vector<ArchiveEntry>& Entries,
+	const char* Archive, const char* Name)
+{
+	constexpr int Repeats = 5;
+
+	std::vector<char> Data;
+	size_t Bytes = 0;
+	const auto Start = std::chrono::steady_clock::now();
+	for (int i = 0; i < Repeats; ++i)
+	{
+		for (auto&& Entry : Entries)
+		{
+			char Path[MFile::MaxPath];
+			sprintf_safe(Path, "%s/%s", Archive, Entry.Name.c_str());
+			MZFile File;
+			TestAssert(File.Open(Path, &FS));
+			Data.resize(File.GetLength());
+			TestAssert(File.Read(Data.data(), int(Data.size())));
+			Bytes += Data.size();
+		}
+	}
+	const auto Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+
+	const auto FilesPerSecond = Entries.size() * Repeats / Seconds;
+	MLog("MZFileSystem, %s archive: %.0f files/s, %.1f MB/s\n",
+		Name, FilesPerSecond, Bytes / Seconds / (1024 * 1024));
+	return FilesPerSecond;
+}
+
+void TestLZ4RoundTrip(const std::vector<char>& Data)
+{
+	std::vector<char> Compressed(MLZ4::CompressBound(Data.size()));
+	const auto CompressedSize = MLZ4::Compress(Data.data(), Data.size(), Compressed.data());
+	TestAssert(CompressedSize > 0 && CompressedSize <= Compressed.size());
+	Compressed.resize(CompressedSize);
+
+	std::vector<char> Decompressed(Data.size());
+	TestAssert(MLZ4::Decompress(Compressed.data(), Compressed.size(), Decompressed.data(), Data.size()));
+	TestAssert(Decompressed == Data);
+
+	// Truncated blocks, or the wrong output size, are caught instead of read past.
+	if (!Data.empty())
+	{
+		TestAssert(!MLZ4::Decompress(Compressed.data(), Compressed.size() - 1,
+			Decompressed.data(), Data.size()));
+		TestAssert(!MLZ4::Decompress(Compressed.data(), Compressed.size(),
+			Decompressed.data(), Data.size() - 1));
+	}
+}
+
+void TestLZ4()
+{
+	std::mt19937 rng{2468};
+	for (size_t Size : {0, 1, 12, 13, 100, 70000})
+	{
+		std::vector<char> Random(Size), Compressible(Size);
+		for (auto&& c : Random)
+			c = char(rng());
+		for (auto&& c : Compressible)
+			c = char('a' + rng() % 4);
+		TestLZ4RoundTrip(Random);
+		TestLZ4RoundTrip(Compressible);
+	}
+
+	std::vector<char> Repeated(100000, 'x');
+	std::vector<char> Compressed(MLZ4::CompressBound(Repeated.size()));
+	TestAssert(MLZ4::Compress(Repeated.data(), Repeated.size(), Compressed.data()) < 1000);
+
+	// A match that points before the start of the output.
+	const unsigned char Corrupt[] = {0x14, 'a', 0x10, 0x00, 0x50, 'a', 'b', 'c', 'd', 'e'};
+	char Output[32];
+	TestAssert(!MLZ4::Decompress(Corrupt, sizeof(Corrupt), Output, 1 + 8 + 5));
+}
+
+// Reads pieces of a framed file at random offsets, which should only decompress the frames they
+// cover.
+void CheckFramedRandomReads(MZFileSystem& FS, const char* Archive, const ArchiveEntry& Entry)
+{
+	char Path[MFile::MaxPath];
+	sprintf_safe(Path, "%s/%s", Archive, Entry.Name.c_str());
+	MZFile File;
+	TestAssert(File.Open(Path, &FS));
+
+	std::mt19937 rng{97531};
+	std::vector<char> Data;
+	for (int i = 0; i < 100; ++i)
+	{
+		const auto Offset = rng() % Entry.Data.size();
+		const auto Size = 1 + rng() % (std::min)(Entry.Data.size() - Offset, size_t(3 * MZipFrameSize));
+		Data.resize(Size);
+		TestAssert(File.Seek(Offset, MZFile::begin));
+		TestAssert(File.Read(Data.data(), int(Size)));
+		TestAssert(memcmp(Data.data(), Entry.Data.data() + Offset, Size) == 0);
+		TestAssert(File.Tell() == i64(Offset + Size));
+	}
+}
+
+constexpr auto ZFSCacheDir = "zfs_test_cache";
+
+void DeleteCacheDir()
+{
+	char Pattern[MFile::MaxPath];
+	sprintf_safe(Pattern, "%s/*", ZFSCacheDir);
+	std::vector<std::string> Names;
+	for (auto&& FileData : MFile::Glob(Pattern))
+		Names.push_back(FileData.Name);
+	for (auto&& Name : Names)
+	{
+		char Path[MFile::MaxPath];
+		sprintf_safe(Path, "%s/%s", ZFSCacheDir, Name.c_str());
+		MFile::Delete(Path);
+	}
+	MFile::Delete(ZFSCacheDir);
+}
+
+// Two file systems with caches of their own in the same directory, like two processes would have.
+void TestFileCacheSharing(const std::vector<ArchiveEntry>& Entries)
+{
+	const auto CompressedEntries = int(std::count_if(Entries.begin(), Entries.end(),
+		[&](auto&& Entry) { return Entry.Compress; }));
+
+	MZFileCache FirstCache, SecondCache;
+	TestAssert(FirstCache.Create(ZFSCacheDir, 64 * 1024 * 1024));
+	TestAssert(FirstCache.GetSize() == 0);
+
+	MZFileSystem Uncached;
+	TestAssert(Uncached.Create(ZFSTestDir));
+	const auto UncachedRate = MeasureArchiveReads(Uncached, Entries, "pack", "uncached");
+
+	{
+		MZFileSystem FS;
+		TestAssert(FS.Create(ZFSTestDir));
+		FS.SetFileCache(&FirstCache);
+		MeasureArchiveReads(FS, Entries, "pack", "cache filling");
+
+		// Only compressed entries are cached.
+		u64 CompressedBytes = 0;
+		for (auto&& Entry : Entries)
+			if (Entry.Compress)
+				CompressedBytes += Entry.Data.size();
+		TestAssert(FirstCache.GetSize() == CompressedBytes);
+	}
+
+	TestAssert(SecondCache.Create(ZFSCacheDir, 64 * 1024 * 1024));
+	TestAssert(SecondCache.GetSize() == FirstCache.GetSize());
+
+	MZFileSystem FS;
+	TestAssert(FS.Create(ZFSTestDir));
+	FS.SetFileCache(&SecondCache);
+	for (auto&& Entry : Entries)
+		CheckArchiveFile(FS, "pack", Entry, true);
+
+	// Hits are read straight from the cache's mapping, without inflating anything.
+	int Hits = 0;
+	for (auto&& Entry : Entries)
+	{
+		char Path[MFile::MaxPath];
+		sprintf_safe(Path, "pack/%s", Entry.Name.c_str());
+		MZFile File;
+		TestAssert(File.Open(Path, &FS));
+		auto* Data = File.GetData();
+		TestAssert(Data && memcmp(Data, Entry.Data.data(), Entry.Data.size()) == 0);
+		MFile::MappedFile Cached;
+		if (Entry.Compress && SecondCache.Find(FS.GetFileDesc(Path)->CRC32, Entry.Data.size(), Cached))
+			++Hits;
+	}
+	TestAssert(Hits == CompressedEntries);
+
+	const auto CachedRate = MeasureArchiveReads(FS, Entries, "pack", "cached");
+	MLog("MZFileSystem, cached reads are %.1fx as fast as uncached\n", CachedRate / UncachedRate);
+
+	// Contents that don't match their CRC32 aren't added.
+	const char Wrong[] = "wrong";
+	TestAssert(!SecondCache.Add(0x12345678, Wrong, sizeof(Wrong)));
+	MFile::MappedFile Missing;
+	TestAssert(!SecondCache.Find(0x12345678, sizeof(Wrong), Missing));
+}
+
+void TestFileCacheEviction()
+{
+	std::vector<char> Old(1000, 'o'), New(1000, 'n'), Third(1000, 't');
+	const auto OldCRC = MGetCRC32(Old.data(), int(Old.size()));
+	const auto NewCRC = MGetCRC32(New.data(), int(New.size()));
+	const auto ThirdCRC = MGetCRC32(Third.data(), int(Third.size()));
+
+	// Modification times on some file systems only have a resolution of a second.
+	auto WaitForNextSecond = [] { std::this_thread::sleep_for(std::chrono::milliseconds(1100)); };
+
+	{
+		MZFileCache Cache;
+		TestAssert(Cache.Create(ZFSCacheDir, 2500));
+		TestAssert(Cache.Add(OldCRC, Old.data(), Old.size()));
+		WaitForNextSecond();
+		TestAssert(Cache.Add(NewCRC, New.data(), New.size()));
+		WaitForNextSecond();
+	}
+
+	// Using the older entry makes the other one the least recently used, so it's the one that
+	// goes when the cache goes over its limit.
+	MZFileCache Cache;
+	TestAssert(Cache.Create(ZFSCacheDir, 2500));
+	TestAssert(Cache.GetSize() == 2000);
+	MFile::MappedFile File;
+	TestAssert(Cache.Find(OldCRC, Old.size(), File));
+	TestAssert(memcmp(File.data(), Old.data(), Old.size()) == 0);
+	File.close();
+	TestAssert(Cache.Add(ThirdCRC, Third.data(), Third.size()));
+
+	TestAssert(!Cache.Find(NewCRC, New.size(), File));
+	TestAssert(Cache.Find(OldCRC, Old.size(), File));
+	TestAssert(Cache.Find(ThirdCRC, Third.size(), File));
+	TestAssert(Cache.GetSize() == 2000);
+
+	Cache.Trim(0);
+	TestAssert(Cache.GetSize() == 0);
+	TestAssert(!Cache.Find(ThirdCRC, Third.size(), File));
+}
+
+void TestPathTable()
+{
+	MPathTable<int> Empty;
+	Empty.Build({});
+	TestAssert(Empty.empty() && !Empty.find("a"));
+
+	std::vector<std::string> Paths;
+	for (int i = 0; i < 1000; ++i)
+		Paths.push_back("Model/Weapon/" + std::to_string(i) + ".elu");
+	std::vector<MPathTable<int>::value_type> Entries;
+	for (int i = 0; i < int(Paths.size()); ++i)
+		Entries.emplace_back(Paths[i], i);
+	// Only the first of the same path is kept.
+	Entries.emplace_back("model\\weapon\\5.ELU", -1);
+
+	MPathTable<int> Table;
+	Table.Build(Entries);
+	TestAssert(Table.size() == Paths.size());
+	for (int i = 0; i < int(Paths.size()); ++i)
+	{
+		auto* Value = Table.find(Paths[i]);
+		TestAssert(Value && *Value == i);
+	}
+
+	auto* Value = Table.find("MODEL\\weapon/5.elu");
+	TestAssert(Value && *Value == 5);
+	TestAssert(!Table.find("model/weapon/1000.elu"));
+	TestAssert(!Table.find("model/weapon/5.el"));
+	TestAssert(!Table.find(""));
+}
+
+// Looks up every path in the file system, in a different case and with backslashes like the game
+// does, and compares it to the hash map the file system used to use.
+void MeasurePathLookups(MZFileSystem& FS)
+{
+	std::vector<std::string> Paths;
+	std::unordered_map<StringView, MZNode, PathHasher, PathComparer> OldMap;
+	for (int i = 0; i < FS.GetFileCount(); ++i)
+	{
+		auto& Name = FS.GetFileName(i);
+		OldMap.emplace(Name, MZNode{FS.GetFileDesc(i), false});
+
+		std::string Path{Name.data(), Name.size()};
+		for (auto&& c : Path)
+			c = c == '/' ? '\\' : char(toupper(u8(c)));
+		Paths.push_back(std::move(Path));
+	}
+
+	constexpr int Repeats = 200;
+	using Clock = std::chrono::steady_clock;
+	auto Measure = [&](auto&& Lookup) {
+		const auto Start = Clock::now();
+		int Found = 0;
+		for (int i = 0; i < Repeats; ++i)
+			for (auto&& Path : Paths)
+				Found += Lookup(Path) ? 1 : 0;
+		const auto Seconds = std::chrono::duration<double>(Clock::now() - Start).count();
+		TestAssert(Found == int(Paths.size()) * Repeats);
+		return Paths.size() * Repeats / Seconds;
+	};
+
+	const auto OldRate = Measure([&](const std::string& Path) {
+		return OldMap.find(Path) != OldMap.end(); });
+	const auto NewRate = Measure([&](const std::string& Path) {
+		return FS.GetFileDesc(Path) != nullptr; });
+	MLog("MZFileSystem, %d paths: %.1f M lookups/s, %.1f M/s with the old hash map (%.1fx)\n",
+		int(Paths.size()), NewRate / 1e6, OldRate / 1e6, NewRate / OldRate);
+}
+
+void CheckMrs3WithMZip(const char* ArchivePath, const std::vector<ArchiveEntry>& Entries)
+{
+	// MZip closes the files it's given.
+	MZip Zip;
+	TestAssert(Zip.Initialize(fopen(ArchivePath, "rb"), MZIPREADFLAG_MRS2 | MZIPREADFLAG_MRS3));
+	TestAssert(Zip.GetFileCount() == int(Entries.size()));
+
+	// Without MZIPREADFLAG_MRS3, MRS3 archives aren't read.
+	MZip OldZip;
+	TestAssert(!OldZip.Initialize(fopen(ArchivePath, "rb"), MZIPREADFLAG_MRS2));
+
+	std::vector<char> Data;
+	for (auto&& Entry : Entries)
+	{
+		Data.resize(Entry.Data.size());
+		TestAssert(Zip.ReadFile(Entry.Name.c_str(), Data.data(), int(Data.size())));
+		TestAssert(Data == Entry.Data);
+	}
+}
+
+}
+
+void TestZFileSystem()
+{
+	MFile::CreateDir(ZFSTestDir);
+
+	const auto Entries = MakeArchiveEntries(500);
+	WriteTestFile("pack.mrs", MakeArchive(Entries, true));
+	WriteTestFile("plain.zip", MakeArchive(Entries, false));
+	WriteTestFile("loose.txt", {'l', 'o', 'o', 's', 'e'});
+
+	{
+		UnmappedZFileSystem FS;
+		TestAssert(FS.Create(ZFSTestDir));
+		TestAssert(FS.GetFileCount() == int(Entries.size() * 2 + 1));
+
+		for (auto&& Entry : Entries)
+		{
+			CheckArchiveFile(FS, "pack", Entry, true);
+			CheckArchiveFile(FS, "plain", Entry, true);
+		}
+
+		MZFile Loose;
+		TestAssert(Loose.Open("loose.txt", &FS));
+		char Buffer[5];
+		TestAssert(Loose.Read(Buffer, sizeof(Buffer)));
+		TestAssert(memcmp(Buffer, "loose", 5) == 0);
+		TestAssert(Loose.GetData() && memcmp(Loose.GetData(), "loose", 5) == 0);
+
+		auto* Dir = FS.GetDirectory("PACK\\");
+		TestAssert(Dir && Dir == FS.GetDirectory("pack/") && Dir->NumFiles == Entries.size());
+		TestAssert(!FS.GetFileDesc("pack/") && !FS.GetDirectory("pack/model/big.elu"));
+		TestAssert(!FS.GetNode("pack/model/missing.elu") && !FS.GetNode(""));
+
+		MeasureArchiveReads(FS, Entries, "pack", "mapped");
+		MeasurePathLookups(FS);
+
+		// Archives that couldn't be mapped are still read through stdio.
+		FS.Unmap();
+		for (auto&& Entry : Entries)
+			CheckArchiveFile(FS, "pack", Entry, false);
+
+		MeasureArchiveReads(FS, Entries, "pack", "stdio");
+	}
+
+	DeleteCacheDir();
+	TestFileCacheSharing(Entries);
+	DeleteCacheDir();
+	TestFileCacheEviction();
+	DeleteCacheDir();
+
+	TestPathTable();
+	TestLZ4();
+
+	char PackPath[MFile::MaxPath], Lz4Path[MFile::MaxPath], DeflatePath[MFile::MaxPath];
+	sprintf_safe(PackPath, "%s/pack.mrs", ZFSTestDir);
+	sprintf_safe(Lz4Path, "%s/pack_lz4.mrs", ZFSTestDir);
+	sprintf_safe(DeflatePath, "%s/pack_deflate.mrs", ZFSTestDir);
+	TestAssert(MZip::ConvertToMrs3(PackPath, Lz4Path, MZipMethod::Lz4Frames));
+	TestAssert(MZip::ConvertToMrs3(PackPath, DeflatePath, MZipMethod::DeflateFrames));
+	CheckMrs3WithMZip(Lz4Path, Entries);
+	CheckMrs3WithMZip(DeflatePath, Entries);
+
+	{
+		UnmappedZFileSystem FS;
+		TestAssert(FS.Create(ZFSTestDir));
+
+		for (auto Archive : {"pack_lz4", "pack_deflate"})
+		{
+			for (auto&& Entry : Entries)
+				CheckArchiveFile(FS, Archive, Entry, true, true);
+			CheckFramedRandomReads(FS, Archive, Entries[1]);
+		}
+
+		auto* Lz4Desc = FS.GetFileDesc("pack_lz4/model/big.elu");
+		auto* DeflateDesc = FS.GetFileDesc("pack_deflate/model/big.elu");
+		TestAssert(Lz4Desc->Method == MZipMethod::Lz4Frames);
+		TestAssert(DeflateDesc->Method == MZipMethod::DeflateFrames);
+		MLog("MZFileSystem, model/big.elu: %zu bytes, %zu as LZ4 frames, %zu as deflate frames\n",
+			Lz4Desc->Size, size_t(Lz4Desc->CompressedSize), size_t(DeflateDesc->CompressedSize));
+
+		const auto DeflateRate = MeasureArchiveReads(FS, Entries, "pack", "deflate");
+		const auto Lz4Rate = MeasureArchiveReads(FS, Entries, "pack_lz4", "MRS3 LZ4");
+		MeasureArchiveReads(FS, Entries, "pack_deflate", "MRS3 deflate");
+		MLog("MZFileSystem, MRS3 LZ4 reads are %.1fx as fast as deflate\n", Lz4Rate / DeflateRate);
+
+		FS.Unmap();
+		for (auto Archive : {"pack_lz4", "pack_deflate"})
+		{
+			for (auto&& Entry : Entries)
+				CheckArchiveFile(FS, Archive, Entry, false, true);
+		}
+	}
+
+	for (auto Name : {"pack.mrs", "plain.zip", "loose.txt", "pack_lz4.mrs", "pack_deflate.mrs"})
+		DeleteTestFile(Name);
+	MFile::Delete(ZFSTestDir);
+}
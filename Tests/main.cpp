@@ -19,7 +19,16 @@ int main()
 	ADD(TestSafeString);
 	ADD(TestConfig);
 	ADD(TestMFile);
+	ADD(TestZFileSystem);
 	ADD(TestMAsyncProxy);
+	ADD(TestSequenceWindow);
+	ADD(TestBasicInfoSnapshot);
+	ADD(TestRelevancy);
+	ADD(TestSafeUDP);
+	ADD(TestLocator);
+	ADD(TestCommandBuilder);
+	ADD(TestCommandBudget);
+	ADD(TestStartupTasks);
 	ADD(TestDB);
 	ADD(TestLauncher);
 #undef ADD
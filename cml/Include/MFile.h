@@ -35,6 +35,8 @@ bool IsFile(const char* Path);
 bool IsDir(const char* Path);
 
 bool CreateFile(const char* Path);
+// Sets the last modified time of an existing file to the current time.
+bool Touch(const char* Path);
 bool CreateDir(const char* Path);
 bool CreateParentDirs(StringView Path);
 
@@ -246,6 +248,41 @@ struct RWFile : public File
 	size_t write(const void* buffer, size_t size);
 };
 
+// A read-only memory mapping of a whole file.
+// The contents stay at the same address until the mapping is closed, even if the object is moved.
+struct MappedFile
+{
+	MappedFile() = default;
+	// Wrapper for open.
+	MappedFile(const char* path) { open(path); }
+	MappedFile(const MappedFile&) = delete;
+	MappedFile(MappedFile&& src);
+	MappedFile& operator=(const MappedFile&) = delete;
+	MappedFile& operator=(MappedFile&& src);
+	~MappedFile() { close(); }
+
+	// Maps a file. Returns true on success, or false on error.
+	// Empty files are opened, but have no data pointer.
+	bool open(const char* path);
+
+	void close();
+
+	bool is_open() const { return opened; }
+	const char* data() const { return view; }
+	size_t size() const { return view_size; }
+
+private:
+	void reset();
+
+	bool opened = false;
+	const char* view = nullptr;
+	size_t view_size = 0;
+#ifdef _WIN32
+	void* file_handle = nullptr;
+	void* mapping_handle = nullptr;
+#endif
+};
+
 struct FileOutputIterator
 {
 	FileOutputIterator(RWFile& file) : file{ &file } {}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+
+// A compressor and decompressor for the LZ4 block format (not the LZ4 frame format).
+// It compresses worse than deflate, but decompresses several times faster, which is what matters
+// for the assets that are read every time the game loads.
+//
+// See https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md. The output follows the
+// format's end of block rules, so it can be read by any LZ4 block decompressor.
+namespace MLZ4
+{
+
+// The most that compressing Size bytes can produce.
+constexpr size_t CompressBound(size_t Size) { return Size + Size / 255 + 16; }
+
+// Compresses Size bytes from Input into Output, which must have room for CompressBound(Size)
+// bytes. Returns the compressed size.
+size_t Compress(const void* Input, size_t Size, void* Output);
+
+// Decompresses a block into Output. Returns false if the block is corrupt, or if it doesn't
+// decompress to exactly OutputSize bytes. Never reads or writes outside of the buffers.
+bool Decompress(const void* Input, size_t InputSize, void* Output, size_t OutputSize);
+
+}
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include "GlobalTypes.h"
+#include "StringView.h"
+
+namespace detail
+{
+// Maps every byte to what it's compared as in a path: lowercase, with backslashes as slashes.
+struct PathCharTable
+{
+	u8 Values[256];
+
+	constexpr PathCharTable() : Values{}
+	{
+		for (int i = 0; i < 256; ++i)
+		{
+			Values[i] = i == '\\' ? u8('/') :
+				i >= 'A' && i <= 'Z' ? u8(i - 'A' + 'a') :
+				u8(i);
+		}
+	}
+};
+
+constexpr PathCharTable PathChars{};
+}
+
+// A read-only map from paths to values, which are compared case insensitively and without telling
+// forward slashes and backslashes apart, like PathHasher and PathComparer do.
+//
+// It's built once from every path it'll ever hold into a minimal perfect hash, using hash and
+// displace: the paths are split into buckets by their hash, and each bucket gets a displacement
+// that sends its paths to slots that no other path is in. A lookup then hashes the path once, and
+// only compares it to the single path in its slot if the stored hashes are equal.
+template <typename T>
+class MPathTable
+{
+public:
+	using value_type = std::pair<StringView, T>;
+
+	static u64 Hash(StringView Path, u64 Seed)
+	{
+		// 64-bit FNV-1a, so that different paths essentially never collide, even with
+		// a 32-bit size_t.
+		u64 ret = 14695981039346656037ULL ^ Seed;
+		for (auto c : Path)
+		{
+			ret ^= detail::PathChars.Values[u8(c)];
+			ret *= 1099511628211ULL;
+		}
+		return ret;
+	}
+
+	static bool Equals(StringView a, StringView b)
+	{
+		return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](char x, char y) {
+			return detail::PathChars.Values[u8(x)] == detail::PathChars.Values[u8(y)]; });
+	}
+
+	// Replaces the contents with Entries. If a path is in there more than once, only the first
+	// one is kept, like with emplace on a map.
+	void Build(const std::vector<value_type>& Entries)
+	{
+		for (u64 Seed = 0; ; ++Seed)
+			if (TryBuild(Entries, Seed))
+				return;
+	}
+
+	const T* find(StringView Path) const
+	{
+		if (Slots.empty())
+			return nullptr;
+
+		const auto PathHash = Hash(Path, Seed);
+		auto& Found = Slots[GetSlot(PathHash)];
+		if (Found.Hash != PathHash || !Equals(Found.Path, Path))
+			return nullptr;
+
+		return &Found.Value;
+	}
+
+	size_t size() const { return Slots.size(); }
+	bool empty() const { return Slots.empty(); }
+
+	void clear()
+	{
+		Slots.clear();
+		Displacements.clear();
+		NumSlots = 0;
+	}
+
+private:
+	// Displacements with this bit set are the slot of the bucket's only path.
+	static constexpr u32 DirectSlot = 0x80000000;
+	// Buckets that can't be placed with any displacement below this get a new seed instead.
+	static constexpr u32 MaxDisplacement = 1 << 20;
+
+	struct Node
+	{
+		u64 Hash;
+		StringView Path;
+		T Value;
+	};
+
+	// Maps a 32-bit value to [0, Range) without a division.
+	static u32 Reduce(u32 Value, size_t Range) {
+		return u32((u64(Value) * Range) >> 32); }
+
+	static u32 Mix(u64 Hash, u32 Displacement)
+	{
+		auto x = Hash + (u64(Displacement) + 1) * 0x9E3779B97F4A7C15ULL;
+		x = (x ^ (x >> 31)) * 0xBF58476D1CE4E5B9ULL;
+		return u32(x >> 32);
+	}
+
+	u32 GetBucket(u64 PathHash) const { return Reduce(u32(PathHash >> 32), Displacements.size()); }
+
+	u32 GetSlot(u64 PathHash, u32 Displacement) const {
+		return Reduce(Mix(PathHash, Displacement), NumSlots); }
+
+	u32 GetSlot(u64 PathHash) const
+	{
+		const auto Displacement = Displacements[GetBucket(PathHash)];
+		if (Displacement & DirectSlot)
+			return Displacement & ~DirectSlot;
+		return GetSlot(PathHash, Displacement);
+	}
+
+	bool TryBuild(const std::vector<value_type>& Entries, u64 NewSeed)
+	{
+		clear();
+		Seed = NewSeed;
+
+		struct Key
+		{
+			u64 Hash;
+			u32 Index;
+		};
+		std::vector<Key> Keys;
+		Keys.reserve(Entries.size());
+		for (u32 i = 0; i < u32(Entries.size()); ++i)
+			Keys.push_back({Hash(Entries[i].first, Seed), i});
+
+		// Sorting by hash puts duplicates next to each other, with the first one first.
+		std::sort(Keys.begin(), Keys.end(), [&](const Key& a, const Key& b) {
+			return a.Hash != b.Hash ? a.Hash < b.Hash : a.Index < b.Index; });
+		auto KeysEnd = Keys.begin();
+		for (auto it = Keys.begin(); it != Keys.end(); ++it)
+		{
+			if (KeysEnd != Keys.begin() && (KeysEnd - 1)->Hash == it->Hash)
+			{
+				// Different paths with the same hash can't be told apart, so a new seed is needed.
+				if (!Equals(Entries[(KeysEnd - 1)->Index].first, Entries[it->Index].first))
+					return false;
+				continue;
+			}
+			*KeysEnd++ = *it;
+		}
+		Keys.erase(KeysEnd, Keys.end());
+
+		NumSlots = Keys.size();
+		if (NumSlots == 0)
+			return true;
+
+		// Four paths per bucket on average.
+		Displacements.resize((NumSlots + 3) / 4);
+		std::vector<std::vector<u32>> Buckets(Displacements.size());
+		for (u32 i = 0; i < u32(Keys.size()); ++i)
+			Buckets[GetBucket(Keys[i].Hash)].push_back(i);
+
+		// The biggest buckets are the hardest to place, so they go while most slots are free.
+		std::vector<u32> Order(Buckets.size());
+		for (u32 i = 0; i < u32(Order.size()); ++i)
+			Order[i] = i;
+		std::stable_sort(Order.begin(), Order.end(), [&](u32 a, u32 b) {
+			return Buckets[a].size() > Buckets[b].size(); });
+
+		constexpr u32 Unused = u32(-1);
+		std::vector<u32> SlotKeys(NumSlots, Unused);
+		std::vector<u32> BucketSlots;
+		size_t NextFreeSlot = 0;
+		for (auto BucketIndex : Order)
+		{
+			auto& Bucket = Buckets[BucketIndex];
+			if (Bucket.empty())
+				break;
+
+			// Buckets with a single path just get the next free slot.
+			if (Bucket.size() == 1)
+			{
+				while (SlotKeys[NextFreeSlot] != Unused)
+					++NextFreeSlot;
+				SlotKeys[NextFreeSlot] = Bucket[0];
+				Displacements[BucketIndex] = u32(NextFreeSlot) | DirectSlot;
+				continue;
+			}
+
+			bool Placed = false;
+			for (u32 Displacement = 0; Displacement < MaxDisplacement && !Placed; ++Displacement)
+			{
+				BucketSlots.clear();
+				Placed = true;
+				for (auto KeyIndex : Bucket)
+				{
+					const auto Slot = GetSlot(Keys[KeyIndex].Hash, Displacement);
+					if (SlotKeys[Slot] != Unused ||
+						std::find(BucketSlots.begin(), BucketSlots.end(), Slot) != BucketSlots.end())
+					{
+						Placed = false;
+						break;
+					}
+					BucketSlots.push_back(Slot);
+				}
+
+				if (Placed)
+				{
+					for (size_t i = 0; i < Bucket.size(); ++i)
+						SlotKeys[BucketSlots[i]] = Bucket[i];
+					Displacements[BucketIndex] = Displacement;
+				}
+			}
+
+			if (!Placed)
+				return false;
+		}
+
+		Slots.reserve(NumSlots);
+		for (auto KeyIndex : SlotKeys)
+		{
+			auto& Entry = Entries[Keys[KeyIndex].Index];
+			Slots.push_back({Keys[KeyIndex].Hash, Entry.first, Entry.second});
+		}
+
+		return true;
+	}
+
+	std::vector<Node> Slots;
+	std::vector<u32> Displacements;
+	size_t NumSlots{};
+	u64 Seed{};
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "MZFileSystem.h"
+#include "MZipFrames.h"
 
 class MZFile
 {
@@ -31,12 +32,20 @@ public:
 	i64 Tell() const;
 
 	auto GetLength() const { return FileSize; }
+
+	// Files in MRS3 archives that are stored in frames only decompress the frames that are read.
 	bool Read(void* pBuffer, int nMaxSize);
 	template <typename T>
 	bool Read(T& dest) {
 		return Read(&dest, sizeof(dest));
 	}
 
+	// Returns the whole contents of the file, or null on error.
+	// Unlike Release, this doesn't copy files that are stored uncompressed in a mapped archive, or
+	// that were found in the file system's MZFileCache, but the data isn't null-terminated, and is
+	// only valid while the file is open.
+	const char* GetData();
+
 	DataPtr Release();
 
 	static void SetReadMode(u32 mode) { ReadMode = mode; }
@@ -46,7 +55,16 @@ public:
 protected:
 	bool IsArchive() const { return Desc != nullptr; }
 	bool OpenArchive(const MZFileDesc& Desc, MZFileSystem& FS);
+	bool IsStoredInMappedArchive() const {
+		return Desc && Desc->ArchiveData && Desc->CompressedSize == 0; }
+	bool IsFramedInMappedArchive() const {
+		return Desc && Desc->ArchiveData && Frames.GetFrameSize() != 0; }
+	bool ReadFrames(void* pBuffer, size_t Size);
+	// Returns the decompressed contents from the file cache, or null if they aren't in it.
+	const char* FindCachedData();
 	bool LoadFile();
+	bool LoadArchivedFile();
+	bool LoadMappedFile();
 	void SetData(char* ptr, bool ShouldDelete) {
 		Data = DataPtr{ ptr, MaybeArrayDeleter{ShouldDelete} }; }
 	void SetData(nullptr_t) {
@@ -59,5 +77,16 @@ protected:
 	i64 Pos{};
 	size_t FileSize{};
 
+	// The frame index of a framed file in a mapped archive, and the last frame that was read.
+	MZipFrames Frames;
+	std::unique_ptr<char[]> FrameBuffer;
+	u32 BufferedFrame{};
+
+	// The file cache of the file system the file was opened in, and the file's entry in it once
+	// it's been found.
+	MZFileCache* Cache{};
+	MFile::MappedFile CachedFile;
+	bool CacheMissed{};
+
 	static u32 ReadMode;
 };
\ No newline at end of file
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <mutex>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include "GlobalTypes.h"
+#include "MFile.h"
+
+// An on-disk cache of decompressed archive entries, which can be shared by any number of
+// MZFileSystems, in this process and others, through MZFileSystem::SetFileCache.
+//
+// Entries are keyed by the CRC32 of their contents, which the archive directory already stores,
+// and their size, so the same asset in different archives is only cached once. Each one is a file
+// in the cache directory, and hits are mapped instead of read, so every process reading it shares
+// the same pages.
+//
+// The total size is kept under a limit by deleting the least recently used files, which are the
+// ones with the oldest modification times, since hits touch the file the first time a
+// cache object sees them.
+class MZFileCache
+{
+public:
+	// Uses Dir as the cache directory, and creates it if it doesn't exist.
+	bool Create(std::string Dir, u64 MaxSize);
+
+	// Maps the cached contents of the entry with the given CRC32 and size into File.
+	// Returns false if they aren't cached.
+	bool Find(u32 CRC32, size_t Size, MFile::MappedFile& File);
+
+	// Adds the contents of an entry, unless their CRC32 doesn't match, and then deletes the
+	// least recently used files if the cache went over its limit.
+	bool Add(u32 CRC32, const char* Data, size_t Size);
+
+	// Deletes the least recently used files until the cache is at most MaxSize bytes.
+	void Trim(u64 MaxSize);
+
+	// The size of the cache, as of the last time it was trimmed plus what this object has added
+	// since then. Other processes can make it out of date.
+	u64 GetSize() const { return Size; }
+	u64 GetMaxSize() const { return MaxSize; }
+
+private:
+	template <size_t size>
+	void GetEntryPath(char(&Output)[size], u32 CRC32, size_t EntrySize) const;
+	void TrimLocked(u64 MaxSize);
+
+	std::mutex Mutex;
+	std::string Dir;
+	u64 MaxSize{};
+	u64 Size{};
+	// The entries that have already been touched.
+	std::unordered_set<u64> Touched;
+	std::mt19937_64 TempNameGenerator;
+};
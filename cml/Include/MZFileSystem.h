@@ -8,6 +8,9 @@
 #include "MUtil.h"
 #include "StringView.h"
 #include "MHash.h"
+#include "MFile.h"
+#include "MZFileCache.h"
+#include "MPathTable.h"
 
 #define DEF_EXT	"mrs"
 
@@ -30,8 +33,19 @@ struct MZFileDesc
 	// Zero if not compressed, or not in archive.
 	size_t CompressedSize;
 
+	// How the data is stored in the archive. Stored if not in archive.
+	MZipMethod Method;
+
 	// The uncompressed size of the file, in bytes.
 	size_t Size;
+
+	// The CRC32 of the uncompressed data, from the archive's directory.
+	// Zero if not in archive.
+	u32 CRC32;
+
+	// Where the (possibly compressed) data starts in the mapped archive.
+	// Null if not in archive, or if the archive couldn't be mapped.
+	const char* ArchiveData;
 };
 
 struct MZDirDesc
@@ -109,13 +123,20 @@ public:
 	void CacheArchive(const StringView& Filename);
 	void ReleaseCachedArchives();
 
+	// Makes files read from compressed archive entries go through Cache, which can be shared with
+	// other file systems, and must outlive this one. Null turns it off.
+	void SetFileCache(MZFileCache* Cache) { FileCache = Cache; }
+	MZFileCache* GetFileCache() const { return FileCache; }
+
 protected:
 	friend class MZFile;
 
 	void MakeDirectoryTree(PreprocessedFileTree& Tree, const StringView& FullPath, PreprocessedDir& Dir);
-	void AddFilesInArchive(PreprocessedFileTree& Tree, PreprocessedDir& ArchiveDir, MZip& Zip);
+	void AddFilesInArchive(PreprocessedFileTree& Tree, PreprocessedDir& ArchiveDir, MZip& Zip,
+		const MFile::MappedFile* Archive);
 
-	void UpdateFileList(PreprocessedDir& SrcNode, MZDirDesc& DestNode);
+	void UpdateFileList(PreprocessedDir& SrcNode, MZDirDesc& DestNode,
+		std::vector<MPathTable<MZNode>::value_type>& Nodes);
 	void ClearFileList();
 	StringView AllocateString(const StringView& Src);
 
@@ -126,11 +147,17 @@ protected:
 
 	// Maps paths (relative to BasePath) to indices into FileNodeList.
 	// The paths are case insensitive and do not differentiate between forward slashes and backslashes.
-	std::unordered_map<StringView, MZNode, PathHasher, PathComparer> NodeMap;
+	// Built once every path is known at the end of Create, and never changed after that.
+	MPathTable<MZNode> NodeMap;
 
 	std::vector<std::unique_ptr<char[]>> Strings;
 
+	// Every archive is mapped once, and the files in it are read straight from the mapping.
+	std::vector<MFile::MappedFile> Archives;
+
 	std::unordered_map<const MZFileDesc*, std::unique_ptr<char[]>> CachedFileMap;
+
+	MZFileCache* FileCache{};
 };
 
 #include "MZFile.h"
@@ -16,14 +16,28 @@
 #define MZIPREADFLAG_MRS		1<<1
 #define MZIPREADFLAG_MRS2		1<<2
 #define MZIPREADFLAG_FILE		1<<3
+#define MZIPREADFLAG_MRS3		1<<4
 
 enum MZipMode{
 	ZMode_Zip = 0,
 	ZMode_Mrs,
 	ZMode_Mrs2,
+	ZMode_Mrs3,
 	ZMode_End
 };
 
+// How an entry's data is stored.
+enum class MZipMethod
+{
+	Stored,
+	Deflate,
+	// MRS3 only. The data is split into frames that can be decompressed on their own, with an
+	// index in front. See MZipFrames.h.
+	Lz4Frames,
+	DeflateFrames,
+	Unknown,
+};
+
 struct MZIPDIRHEADER;
 struct MZIPDIRFILEHEADER;
 struct MZIPLOCALHEADER;
@@ -62,6 +76,7 @@ public:
 	size_t GetFileArchiveOffset(int i);
 	size_t GetFileCompressedSize(int i) const;
 	bool IsFileCompressed(int i) const;
+	MZipMethod GetFileMethod(int i) const;
 
 	// Read File Raw Data by Index
 	bool ReadFile(int i, void* pBuffer, int nMaxSize);
@@ -75,6 +90,11 @@ public:
 	static bool ConvertZip(char* zip_name);
 	static bool UpgradeMrs(char* mrs_name);//MrsToMrs2
 
+	// Writes every file in the zip, MRS or MRS2 archive at src_name into a new MRS3 archive at
+	// dest_name. The files are compressed with Method, which is Lz4Frames for the fastest loading,
+	// or DeflateFrames for smaller archives; files that don't get smaller are stored.
+	static bool ConvertToMrs3(const char* src_name, const char* dest_name, MZipMethod Method);
+
 	static bool RecoveryZip(char* zip_name);
 	static bool RecoveryMrs(FILE* fp);
 	static bool RecoveryMrs2(FILE* fp);
@@ -124,6 +144,7 @@ public:
 	void UpgradeMrs();
 
 	void ConvertZip();
+	void ConvertToMrs3(MZipMethod Method);
 	void RecoveryZip();
 	void ConvertVtf();
 
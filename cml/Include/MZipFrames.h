@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+#include "GlobalTypes.h"
+#include "MZip.h"
+
+// MRS3 entries stored with MZipMethod::Lz4Frames or MZipMethod::DeflateFrames are split into
+// frames of MZipFrameSize uncompressed bytes that are compressed separately, so that any part of a
+// large entry can be read without decompressing everything before it.
+//
+// The entry's data starts with a frame index:
+//     u32 FrameSize
+//     u32 NumFrames
+//     u32 FrameEnds[NumFrames]    Where each compressed frame ends, relative to the end of the index.
+// followed by the frames. Frames that didn't get any smaller are stored as they are.
+// All integers are little-endian, and the index isn't aligned.
+
+constexpr u32 MZipFrameSize = 64 * 1024;
+
+class MZipFrames
+{
+public:
+	// Reads the frame index at the start of an entry's data. Returns false if it's invalid.
+	bool Parse(MZipMethod Method, const char* Data, size_t DataSize, size_t UncompressedSize);
+
+	u32 GetFrameSize() const { return FrameSize; }
+	u32 GetNumFrames() const { return NumFrames; }
+
+	// The uncompressed size of a frame. Every frame but the last is FrameSize bytes long.
+	size_t GetUncompressedSize(u32 Frame) const;
+
+	// Decompresses a frame into Output, which must have room for GetUncompressedSize(Frame) bytes.
+	bool Decode(u32 Frame, char* Output) const;
+
+	// Decompresses every frame into Output, which must have room for the whole entry.
+	bool DecodeAll(char* Output) const;
+
+	// Splits Data into frames and compresses each one with Method, and returns the entry's data,
+	// starting with the frame index.
+	static std::vector<char> Encode(MZipMethod Method, const char* Data, size_t Size);
+
+private:
+	u32 GetFrameEnd(u32 Frame) const;
+
+	MZipMethod Method{};
+	u32 FrameSize{};
+	u32 NumFrames{};
+	size_t UncompressedSize{};
+	const char* FrameEnds{};
+	const char* Frames{};
+};
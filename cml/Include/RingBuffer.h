@@ -96,6 +96,12 @@ struct RingBuffer
 	void push_back(const T& Src) { emplace_back(Src); }
 	void push_back(T&& Src) { emplace_back(std::move(Src)); }
 
+	void pop_front() {
+		get(0)->~T();
+		Cursor = (Cursor + 1) % N;
+		--Size;
+	}
+
 	void clear()
 	{
 		destroy();
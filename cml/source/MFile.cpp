@@ -16,6 +16,7 @@ static bool IsDots(StringView Name) { return equals(Name, ".") || equals(Name, "
 #include <sys/types.h>
 #include <dirent.h>
 #include <fcntl.h>
+#include <sys/mman.h>
 #endif
 
 namespace MFile
@@ -80,6 +81,20 @@ bool CreateFile(const char* Path)
 	return true;
 }
 
+bool Touch(const char* Path)
+{
+	auto FileHandle = ::CreateFileA(Path, FILE_WRITE_ATTRIBUTES,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, 0, nullptr);
+	if (FileHandle == INVALID_HANDLE_VALUE)
+		return false;
+
+	FILETIME Now;
+	GetSystemTimeAsFileTime(&Now);
+	const auto Ret = SetFileTime(FileHandle, nullptr, nullptr, &Now);
+	CloseHandle(FileHandle);
+	return Ret != FALSE;
+}
+
 bool CreateDir(const char* Path)
 {
 	return ::CreateDirectoryA(Path, nullptr) != FALSE;
@@ -233,6 +248,11 @@ bool CreateFile(const char* Path)
 	return creat(Path, 0777) != -1;
 }
 
+bool Touch(const char* Path)
+{
+	return utimensat(AT_FDCWD, Path, nullptr, 0) == 0;
+}
+
 bool CreateDir(const char* Path)
 {
 	return mkdir(Path, 0777) != -1;
@@ -349,9 +369,11 @@ bool CreateParentDirs(StringView PathArgument)
 		// Capture by value to ignore the change to p at the end.
 		DEFER([=] { *p = OldValue; });
 
+		// Another thread may create the directory between the check and the creation, so check
+		// again if it fails.
 		if (!MFile::IsDir(Path))
 		{
-			if (!MFile::CreateDir(Path))
+			if (!MFile::CreateDir(Path) && !MFile::IsDir(Path))
 			{
 				return false;
 			}
@@ -564,4 +586,136 @@ size_t RWFile::write(const void* buffer, size_t size)
 	return fwrite_ret;
 }
 
+MappedFile::MappedFile(MappedFile&& src)
+{
+	*this = std::move(src);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& src)
+{
+	if (this == &src)
+		return *this;
+
+	close();
+	opened = src.opened;
+	view = src.view;
+	view_size = src.view_size;
+#ifdef _WIN32
+	file_handle = src.file_handle;
+	mapping_handle = src.mapping_handle;
+#endif
+	src.reset();
+	return *this;
+}
+
+void MappedFile::reset()
+{
+	opened = false;
+	view = nullptr;
+	view_size = 0;
+#ifdef _WIN32
+	file_handle = nullptr;
+	mapping_handle = nullptr;
+#endif
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const char* path)
+{
+	close();
+
+	const auto file = ::CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	file_handle = file;
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) || u64(file_size.QuadPart) > SIZE_MAX)
+	{
+		close();
+		return false;
+	}
+
+	view_size = size_t(file_size.QuadPart);
+	if (view_size == 0)
+	{
+		opened = true;
+		return true;
+	}
+
+	mapping_handle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping_handle)
+	{
+		close();
+		return false;
+	}
+
+	view = static_cast<const char*>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+	if (!view)
+	{
+		close();
+		return false;
+	}
+
+	opened = true;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (view)
+		UnmapViewOfFile(view);
+	if (mapping_handle)
+		CloseHandle(mapping_handle);
+	if (file_handle)
+		CloseHandle(file_handle);
+	reset();
+}
+
+#else
+
+bool MappedFile::open(const char* path)
+{
+	close();
+
+	const auto fd = ::open(path, O_RDONLY);
+	if (fd == -1)
+		return false;
+	DEFER([&] { ::close(fd); });
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || u64(st.st_size) > SIZE_MAX)
+		return false;
+
+	view_size = size_t(st.st_size);
+	if (view_size == 0)
+	{
+		opened = true;
+		return true;
+	}
+
+	// The mapping keeps the file alive after the descriptor is closed.
+	const auto ptr = mmap(nullptr, view_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (ptr == MAP_FAILED)
+	{
+		view_size = 0;
+		return false;
+	}
+
+	view = static_cast<const char*>(ptr);
+	opened = true;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (view)
+		munmap(const_cast<char*>(view), view_size);
+	reset();
+}
+
+#endif
+
 }
\ No newline at end of file
@@ -0,0 +1,206 @@
+#include "stdafx.h"
+#include "MLZ4.h"
+#include "GlobalTypes.h"
+#include <algorithm>
+#include <cstring>
+
+namespace MLZ4
+{
+
+// The shortest match that can be encoded.
+constexpr size_t MinMatch = 4;
+// The last five bytes are always literals, and the last match has to start at least twelve bytes
+// before the end.
+constexpr size_t LastLiterals = 5;
+constexpr size_t MFLimit = 12;
+constexpr size_t MaxOffset = 65535;
+constexpr int HashLog = 12;
+
+static u32 Read32(const u8* p)
+{
+	u32 Value;
+	memcpy(&Value, p, sizeof(Value));
+	return Value;
+}
+
+static u32 Hash(u32 Sequence)
+{
+	return (Sequence * 2654435761u) >> (32 - HashLog);
+}
+
+// Writes the part of a length that didn't fit in the token.
+static u8* WriteLength(u8* Out, size_t Length)
+{
+	while (Length >= 255)
+	{
+		*Out++ = 255;
+		Length -= 255;
+	}
+	*Out++ = u8(Length);
+	return Out;
+}
+
+// Writes a sequence of literals followed by a match, or just the literals if MatchLength is 0.
+static u8* WriteSequence(u8* Out, const u8* Literals, size_t NumLiterals,
+	size_t Offset, size_t MatchLength)
+{
+	auto* Token = Out++;
+	*Token = u8((std::min)(NumLiterals, size_t(15)) << 4);
+	if (NumLiterals >= 15)
+		Out = WriteLength(Out, NumLiterals - 15);
+	if (NumLiterals > 0)
+		memcpy(Out, Literals, NumLiterals);
+	Out += NumLiterals;
+
+	if (MatchLength == 0)
+		return Out;
+
+	*Out++ = u8(Offset);
+	*Out++ = u8(Offset >> 8);
+	const auto MatchCode = MatchLength - MinMatch;
+	*Token |= u8((std::min)(MatchCode, size_t(15)));
+	if (MatchCode >= 15)
+		Out = WriteLength(Out, MatchCode - 15);
+	return Out;
+}
+
+size_t Compress(const void* InputArg, size_t Size, void* OutputArg)
+{
+	const auto Input = static_cast<const u8*>(InputArg);
+	const auto End = Input + Size;
+	const auto Output = static_cast<u8*>(OutputArg);
+	auto Out = Output;
+
+	// Literals since the end of the last match.
+	auto Anchor = Input;
+
+	if (Size > MFLimit)
+	{
+		// The last position that was seen with each hash, relative to Input.
+		u32 Table[1 << HashLog] = {};
+
+		const auto MatchLimit = End - LastLiterals;
+		const auto SearchLimit = End - MFLimit;
+
+		// Skips ahead faster the longer it's been since the last match, so that data that doesn't
+		// compress doesn't take long.
+		u32 Misses = 0;
+
+		auto p = Input;
+		while (p <= SearchLimit)
+		{
+			const auto Sequence = Read32(p);
+			auto& Slot = Table[Hash(Sequence)];
+			auto Candidate = Input + Slot;
+			Slot = u32(p - Input);
+
+			if (Candidate >= p || size_t(p - Candidate) > MaxOffset || Read32(Candidate) != Sequence)
+			{
+				p += 1 + (Misses++ >> 6);
+				continue;
+			}
+
+			while (p > Anchor && Candidate > Input && p[-1] == Candidate[-1])
+			{
+				--p;
+				--Candidate;
+			}
+
+			auto MatchEnd = p + MinMatch;
+			auto CandidateEnd = Candidate + MinMatch;
+			while (MatchEnd < MatchLimit && *MatchEnd == *CandidateEnd)
+			{
+				++MatchEnd;
+				++CandidateEnd;
+			}
+
+			Out = WriteSequence(Out, Anchor, p - Anchor, p - Candidate, MatchEnd - p);
+			p = Anchor = MatchEnd;
+			Misses = 0;
+
+			// The end of the match is a good place to look for the next one.
+			if (p <= SearchLimit)
+				Table[Hash(Read32(p - 2))] = u32(p - 2 - Input);
+		}
+	}
+
+	Out = WriteSequence(Out, Anchor, End - Anchor, 0, 0);
+	return Out - Output;
+}
+
+bool Decompress(const void* InputArg, size_t InputSize, void* OutputArg, size_t OutputSize)
+{
+	auto In = static_cast<const u8*>(InputArg);
+	const auto InEnd = In + InputSize;
+	const auto Output = static_cast<u8*>(OutputArg);
+	auto Out = Output;
+	const auto OutEnd = Output + OutputSize;
+
+	auto ReadLength = [&](size_t& Length) {
+		u8 Byte;
+		do
+		{
+			if (In == InEnd)
+				return false;
+			Byte = *In++;
+			Length += Byte;
+		} while (Byte == 255);
+		return true;
+	};
+
+	while (In < InEnd)
+	{
+		const auto Token = *In++;
+
+		size_t NumLiterals = Token >> 4;
+		if (NumLiterals == 15 && !ReadLength(NumLiterals))
+			return false;
+		if (NumLiterals > size_t(InEnd - In) || NumLiterals > size_t(OutEnd - Out))
+			return false;
+
+		// Short runs are copied 16 bytes at once when there's room.
+		if (NumLiterals <= 16 && InEnd - In >= 16 && OutEnd - Out >= 16)
+			memcpy(Out, In, 16);
+		else if (NumLiterals > 0)
+			memcpy(Out, In, NumLiterals);
+		In += NumLiterals;
+		Out += NumLiterals;
+
+		// The last sequence has no match.
+		if (In == InEnd)
+			break;
+
+		if (InEnd - In < 2)
+			return false;
+		const size_t Offset = In[0] | (In[1] << 8);
+		In += 2;
+		if (Offset == 0 || Offset > size_t(Out - Output))
+			return false;
+
+		size_t MatchLength = Token & 15;
+		if (MatchLength == 15 && !ReadLength(MatchLength))
+			return false;
+		MatchLength += MinMatch;
+		if (MatchLength > size_t(OutEnd - Out))
+			return false;
+
+		const auto* Match = Out - Offset;
+		if (Offset >= 8 && size_t(OutEnd - Out) >= MatchLength + 8)
+		{
+			// Each eight bytes only reads bytes that were written before them, so overlapping
+			// matches work too. This can write up to seven bytes past the match.
+			for (size_t i = 0; i < MatchLength; i += 8)
+				memcpy(Out + i, Match + i, 8);
+		}
+		else
+		{
+			for (size_t i = 0; i < MatchLength; ++i)
+				Out[i] = Match[i];
+		}
+		Out += MatchLength;
+	}
+
+	return Out == OutEnd;
+}
+
+}
@@ -3,7 +3,8 @@
 #include "MDebug.h"
 #include "zlib_util.h"
 
-u32 MZFile::ReadMode = MZIPREADFLAG_ZIP | MZIPREADFLAG_MRS | MZIPREADFLAG_MRS2 | MZIPREADFLAG_FILE;
+u32 MZFile::ReadMode = MZIPREADFLAG_ZIP | MZIPREADFLAG_MRS | MZIPREADFLAG_MRS2 | MZIPREADFLAG_MRS3 |
+	MZIPREADFLAG_FILE;
 
 constexpr auto val = sizeof(MZFile);
 
@@ -91,6 +92,23 @@ bool MZFile::Open(const char* szFileName, MZFileSystem* pZFS)
 
 bool MZFile::OpenArchive(const MZFileDesc& Desc, MZFileSystem& FS)
 {
+	// Files in mapped archives are read straight from the mapping.
+	if (Desc.ArchiveData)
+	{
+		if ((Desc.Method == MZipMethod::Lz4Frames || Desc.Method == MZipMethod::DeflateFrames) &&
+			!Frames.Parse(Desc.Method, Desc.ArchiveData, Desc.CompressedSize, Desc.Size))
+		{
+			MLog("MZFile::OpenArchive -- Invalid frame index in %.*s\n",
+				Desc.Path.size(), Desc.Path.data());
+			return false;
+		}
+
+		this->Desc = &Desc;
+		FileSize = Desc.Size;
+		Cache = FS.GetFileCache();
+		return true;
+	}
+
 	char FullArchivePath[MFile::MaxPath];
 	GetFullArchivePath(FullArchivePath, Desc, FS);
 
@@ -104,6 +122,7 @@ bool MZFile::OpenArchive(const MZFileDesc& Desc, MZFileSystem& FS)
 	
 	this->Desc = &Desc;
 	FileSize = Desc.Size;
+	Cache = FS.GetFileCache();
 
 	return true;
 }
@@ -115,6 +134,12 @@ void MZFile::Close()
 	Desc = nullptr;
 	Pos = 0;
 	FileSize = 0;
+	Frames = {};
+	BufferedFrame = 0;
+	FrameBuffer = nullptr;
+	Cache = nullptr;
+	CachedFile.close();
+	CacheMissed = false;
 }
 
 // Converts a MZFile::SeekPos value to an origin value for fseek.
@@ -197,6 +222,22 @@ bool MZFile::Read(void* pBuffer, int nMaxSize)
 		return false;
 
 	if (!Data) {
+		if (IsStoredInMappedArchive()) {
+			memcpy(pBuffer, Desc->ArchiveData + Pos, nMaxSize);
+			Pos += nMaxSize;
+			return true;
+		}
+
+		if (IsFramedInMappedArchive()) {
+			return ReadFrames(pBuffer, nMaxSize);
+		}
+
+		if (auto* CachedData = FindCachedData()) {
+			memcpy(pBuffer, CachedData + Pos, nMaxSize);
+			Pos += nMaxSize;
+			return true;
+		}
+
 		if (!LoadFile()) {
 			return false;
 		}
@@ -209,15 +250,95 @@ bool MZFile::Read(void* pBuffer, int nMaxSize)
 	return true;
 }
 
+bool MZFile::ReadFrames(void* pBuffer, size_t Size)
+{
+	const auto FrameSize = Frames.GetFrameSize();
+	auto Output = static_cast<char*>(pBuffer);
+	while (Size > 0)
+	{
+		const auto Frame = u32(Pos / FrameSize);
+		const auto Offset = size_t(Pos % FrameSize);
+		const auto FrameLength = Frames.GetUncompressedSize(Frame);
+		const auto NumBytes = (std::min)(Size, FrameLength - Offset);
+
+		// Whole frames go straight to the output, and the rest through the frame buffer, which is
+		// kept for the reads after it.
+		if (Offset == 0 && NumBytes == FrameLength)
+		{
+			if (!Frames.Decode(Frame, Output))
+				return false;
+		}
+		else
+		{
+			if (!FrameBuffer || BufferedFrame != Frame)
+			{
+				if (!FrameBuffer)
+					FrameBuffer = std::make_unique<char[]>(FrameSize);
+				if (!Frames.Decode(Frame, FrameBuffer.get()))
+				{
+					FrameBuffer = nullptr;
+					return false;
+				}
+				BufferedFrame = Frame;
+			}
+			memcpy(Output, FrameBuffer.get() + Offset, NumBytes);
+		}
+
+		Output += NumBytes;
+		Size -= NumBytes;
+		Pos += NumBytes;
+	}
+
+	return true;
+}
+
+const char* MZFile::FindCachedData()
+{
+	if (CachedFile.is_open())
+		return CachedFile.data();
+
+	// Stored files have nothing to gain from it.
+	if (!Cache || CacheMissed || !Desc || Desc->CompressedSize == 0 || Desc->Size == 0)
+		return nullptr;
+
+	if (!Cache->Find(Desc->CRC32, Desc->Size, CachedFile))
+	{
+		CacheMissed = true;
+		return nullptr;
+	}
+
+	return CachedFile.data();
+}
+
 bool MZFile::LoadFile()
 {
 	SetData(new char[FileSize + 1], true);
 	Data[FileSize] = 0;
 
 	if (!IsArchive()) {
-		return fread(Data.get(), GetLength(), 1, fp.get()) == 1;
+		// Loads the whole file, wherever reads through fp have gotten to.
+		const auto PrevPos = ftell(fp.get());
+		fseek(fp.get(), 0, SEEK_SET);
+		const auto Success = fread(Data.get(), GetLength(), 1, fp.get()) == 1;
+		fseek(fp.get(), PrevPos, SEEK_SET);
+		return Success;
+	}
+
+	if (auto* CachedData = FindCachedData())
+	{
+		memcpy(Data.get(), CachedData, FileSize);
+		return true;
 	}
 
+	const auto Success = Desc->ArchiveData ? LoadMappedFile() : LoadArchivedFile();
+	if (Success && Cache && Desc->CompressedSize != 0 && Desc->Size != 0)
+		Cache->Add(Desc->CRC32, Data.get(), Desc->Size);
+
+	return Success;
+}
+
+bool MZFile::LoadArchivedFile()
+{
 	// Seek to the start of the DEFLATE data.
 	auto err = fseek(fp.get(), Desc->ArchiveOffset, SEEK_SET);
 	if (err != 0)
@@ -232,6 +353,15 @@ bool MZFile::LoadFile()
 		return fread(Data.get(), Desc->Size, 1, fp.get()) == 1;
 	}
 
+	if (Desc->Method == MZipMethod::Lz4Frames || Desc->Method == MZipMethod::DeflateFrames)
+	{
+		std::vector<char> Compressed(Desc->CompressedSize);
+		MZipFrames FileFrames;
+		return fread(Compressed.data(), Compressed.size(), 1, fp.get()) == 1 &&
+			FileFrames.Parse(Desc->Method, Compressed.data(), Compressed.size(), Desc->Size) &&
+			FileFrames.DecodeAll(Data.get());
+	}
+
 	// Compressed. Read and inflate the data.
 	auto ret = InflateFile(Data.get(), Desc->Size, fp.get(), Desc->CompressedSize, -MAX_WBITS);
 	if (ret.ErrorCode < 0)
@@ -260,6 +390,56 @@ bool MZFile::LoadFile()
 	return true;
 }
 
+bool MZFile::LoadMappedFile()
+{
+	if (Desc->CompressedSize == 0)
+	{
+		memcpy(Data.get(), Desc->ArchiveData, Desc->Size);
+		return true;
+	}
+
+	if (Frames.GetFrameSize() != 0)
+	{
+		if (!Frames.DecodeAll(Data.get()))
+		{
+			MLog("MZFile::LoadMappedFile -- Failed to decompress %.*s\n",
+				Desc->Path.size(), Desc->Path.data());
+			assert(false);
+			return false;
+		}
+		return true;
+	}
+
+	// Inflate straight from the mapped pages.
+	auto ret = InflateMemory(Data.get(), Desc->Size,
+		Desc->ArchiveData, Desc->CompressedSize, -MAX_WBITS);
+	if (ret.ErrorCode < 0 || ret.BytesWritten != Desc->Size)
+	{
+		MLog("MZFile::LoadMappedFile -- InflateMemory failed with error code %d, error message: %s, "
+			"written %d, read %d\n",
+			ret.ErrorCode, ret.ErrorMessage, ret.BytesWritten, ret.BytesRead);
+		assert(false);
+		return false;
+	}
+
+	return true;
+}
+
+const char* MZFile::GetData()
+{
+	if (!Data && IsStoredInMappedArchive())
+		return Desc->ArchiveData;
+
+	if (!Data)
+		if (auto* CachedData = FindCachedData())
+			return CachedData;
+
+	if (!Data && !LoadFile())
+		return nullptr;
+
+	return Data.get();
+}
+
 MZFile::DataPtr MZFile::Release()
 {
 	if (!Data) {
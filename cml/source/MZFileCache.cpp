@@ -0,0 +1,162 @@
+#include "stdafx.h"
+#include "MZFileCache.h"
+#include <algorithm>
+#include <vector>
+#include "MDebug.h"
+#include "zip/zlib.h"
+
+template <size_t size>
+void MZFileCache::GetEntryPath(char(&Output)[size], u32 CRC32, size_t EntrySize) const
+{
+	sprintf_safe(Output, "%s/%08X-%llX.bin", Dir.c_str(), CRC32, u64(EntrySize));
+}
+
+bool MZFileCache::Create(std::string DirArgument, u64 MaxSizeArgument)
+{
+	std::lock_guard<std::mutex> Lock{Mutex};
+
+	Dir = std::move(DirArgument);
+	while (!Dir.empty() && (Dir.back() == '/' || Dir.back() == '\\'))
+		Dir.pop_back();
+	MaxSize = MaxSizeArgument;
+	Touched.clear();
+	TempNameGenerator.seed(std::random_device{}());
+
+	if (!MFile::IsDir(Dir.c_str()) && !MFile::CreateDir(Dir.c_str()))
+	{
+		MLog("MZFileCache::Create -- Failed to create %s\n", Dir.c_str());
+		return false;
+	}
+
+	// Finds the current size, and applies the limit if it's lower than it was last time.
+	TrimLocked(MaxSize);
+	return true;
+}
+
+bool MZFileCache::Find(u32 CRC32, size_t EntrySize, MFile::MappedFile& File)
+{
+	char Path[MFile::MaxPath];
+	GetEntryPath(Path, CRC32, EntrySize);
+	if (!File.open(Path))
+		return false;
+
+	if (File.size() != EntrySize)
+	{
+		File.close();
+		return false;
+	}
+
+	const auto Key = u64(EntrySize) << 32 | CRC32;
+	bool FirstHit;
+	{
+		std::lock_guard<std::mutex> Lock{Mutex};
+		FirstHit = Touched.insert(Key).second;
+	}
+	if (FirstHit)
+		MFile::Touch(Path);
+
+	return true;
+}
+
+bool MZFileCache::Add(u32 CRC32, const char* Data, size_t EntrySize)
+{
+	if (Dir.empty())
+		return false;
+
+	// The entry would be found under the wrong contents otherwise.
+	if (crc32(0, reinterpret_cast<const Bytef*>(Data), uInt(EntrySize)) != CRC32)
+		return false;
+
+	char Path[MFile::MaxPath], TempPath[MFile::MaxPath];
+	GetEntryPath(Path, CRC32, EntrySize);
+	{
+		std::lock_guard<std::mutex> Lock{Mutex};
+		sprintf_safe(TempPath, "%s/%016llX.tmp", Dir.c_str(), TempNameGenerator());
+	}
+
+	// Written under a name of its own and then moved into place, so that Find never sees part of
+	// an entry, even if another process is adding it at the same time.
+	{
+		MFile::RWFile File{TempPath, MFile::Clear};
+		if (!File.is_open() || File.write(Data, EntrySize) != EntrySize)
+		{
+			File.close();
+			MFile::Delete(TempPath);
+			return false;
+		}
+	}
+
+	if (!MFile::Move(TempPath, Path))
+	{
+		// Another process got there first.
+		MFile::Delete(TempPath);
+		return MFile::Exists(Path);
+	}
+
+	std::lock_guard<std::mutex> Lock{Mutex};
+	Touched.insert(u64(EntrySize) << 32 | CRC32);
+	Size += EntrySize;
+	// Trimming a little further than needed so that every add after this one doesn't rescan the
+	// directory.
+	if (Size > MaxSize)
+		TrimLocked(MaxSize - MaxSize / 8);
+
+	return true;
+}
+
+void MZFileCache::Trim(u64 TrimSize)
+{
+	std::lock_guard<std::mutex> Lock{Mutex};
+	TrimLocked(TrimSize);
+}
+
+void MZFileCache::TrimLocked(u64 TrimSize)
+{
+	struct Entry
+	{
+		u64 LastModifiedTime;
+		u64 Size;
+		std::string Name;
+	};
+	std::vector<Entry> Entries;
+
+	char Pattern[MFile::MaxPath];
+	sprintf_safe(Pattern, "%s/*", Dir.c_str());
+	Size = 0;
+	for (auto&& FileData : MFile::Glob(Pattern))
+	{
+		if (FileData.Attributes & MFile::Attributes::Subdir)
+			continue;
+		Entries.push_back({FileData.LastModifiedTime, FileData.Size, FileData.Name});
+		Size += FileData.Size;
+	}
+
+	if (Size <= TrimSize)
+		return;
+
+	std::sort(Entries.begin(), Entries.end(), [&](const Entry& a, const Entry& b) {
+		return a.LastModifiedTime < b.LastModifiedTime;
+	});
+
+	int NumDeleted = 0;
+	for (auto&& OldEntry : Entries)
+	{
+		if (Size <= TrimSize)
+			break;
+
+		// Files that are mapped somewhere can't be deleted on Windows, but they're in use anyway.
+		char Path[MFile::MaxPath];
+		sprintf_safe(Path, "%s/%s", Dir.c_str(), OldEntry.Name.c_str());
+		if (!MFile::Delete(Path))
+			continue;
+
+		Size -= OldEntry.Size;
+		++NumDeleted;
+	}
+
+	// The entries that were deleted need to be touched again if they come back.
+	Touched.clear();
+
+	DMLog("MZFileCache: Deleted %d files from %s, %llu bytes left\n",
+		NumDeleted, Dir.c_str(), Size);
+}
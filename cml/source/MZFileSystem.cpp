@@ -53,6 +53,7 @@ void MZFileSystem::ClearFileList()
 	Files.clear();
 	Dirs.clear();
 	NodeMap.clear();
+	Archives.clear();
 }
 
 StringView MZFileSystem::AllocateString(const StringView& Src)
@@ -110,7 +111,8 @@ struct PreprocessedFileTree
 	PreprocessedDir Root;
 };
 
-void MZFileSystem::AddFilesInArchive(PreprocessedFileTree& Tree, PreprocessedDir& ArchiveDir, MZip& Zip)
+void MZFileSystem::AddFilesInArchive(PreprocessedFileTree& Tree, PreprocessedDir& ArchiveDir, MZip& Zip,
+	const MFile::MappedFile* Archive)
 {
 	const auto Count = int(Zip.GetFileCount());
 
@@ -140,6 +142,15 @@ void MZFileSystem::AddFilesInArchive(PreprocessedFileTree& Tree, PreprocessedDir
 		Child.Size = Zip.GetFileLength(i);
 		Child.ArchiveOffset = Zip.GetFileArchiveOffset(i);
 		Child.CompressedSize = Zip.IsFileCompressed(i) ? Zip.GetFileCompressedSize(i) : 0;
+		Child.Method = Zip.GetFileMethod(i);
+		Child.CRC32 = Zip.GetFileCRC32(i);
+
+		const auto StoredSize = Child.CompressedSize ? Child.CompressedSize : Child.Size;
+		if (Archive && Child.ArchiveOffset <= Archive->size() &&
+			StoredSize <= Archive->size() - Child.ArchiveOffset)
+			Child.ArchiveData = Archive->data() + Child.ArchiveOffset;
+		else
+			Child.ArchiveData = nullptr;
 	}
 }
 
@@ -203,18 +214,28 @@ void MZFileSystem::MakeDirectoryTree(PreprocessedFileTree& Tree,
 				BasePath.c_str(),
 				Subdir.ArchivePath.size(), Subdir.ArchivePath.data());
 
-			auto fp = fopen(FullArchivePath, "rb");
-			if (!fp)
+			MZip Zip;
+			MFile::MappedFile Archive{FullArchivePath};
+			if (Archive.is_open())
 			{
-				MLog("fopen on %s failed\n", FullArchivePath);
-				assert(false);
-				continue;
+				Zip.Initialize(Archive.data(), Archive.size(), MZFile::GetReadMode());
+				AddFilesInArchive(Tree, Subdir, Zip, &Archive);
+				Archives.push_back(std::move(Archive));
+			}
+			else
+			{
+				// Fall back to reading through stdio, e.g. if there's no address space left.
+				auto fp = fopen(FullArchivePath, "rb");
+				if (!fp)
+				{
+					MLog("fopen on %s failed\n", FullArchivePath);
+					assert(false);
+					continue;
+				}
+
+				Zip.Initialize(fp, MZFile::GetReadMode());
+				AddFilesInArchive(Tree, Subdir, Zip, nullptr);
 			}
-
-			MZip Zip;
-			Zip.Initialize(fp, MZFile::GetReadMode());
-
-			AddFilesInArchive(Tree, Subdir, Zip);
 
 			++Tree.NumArchives;
 		}
@@ -231,15 +252,19 @@ void MZFileSystem::MakeDirectoryTree(PreprocessedFileTree& Tree,
 			File.Path = AllocateString(Path);
 			File.ArchiveOffset = 0;
 			File.CompressedSize = 0;
+			File.Method = MZipMethod::Stored;
+			File.CRC32 = 0;
 			assert(FileData.Size <= SIZE_MAX);
 			File.Size = static_cast<size_t>(FileData.Size);
+			File.ArchiveData = nullptr;
 
 			++Tree.NumFiles;
 		}
 	}
 }
 
-void MZFileSystem::UpdateFileList(PreprocessedDir& Src, MZDirDesc& Dest)
+void MZFileSystem::UpdateFileList(PreprocessedDir& Src, MZDirDesc& Dest,
+	std::vector<MPathTable<MZNode>::value_type>& Nodes)
 {
 	if (Src.Subdirs.empty() && Src.Files.empty())
 		return;
@@ -250,7 +275,7 @@ void MZFileSystem::UpdateFileList(PreprocessedDir& Src, MZDirDesc& Dest)
 	Dest.Path = Src.Path;
 
 	auto AddNode = [&](auto& x, bool IsDirectory) {
-		NodeMap.emplace(x.Path, MZNode{ &x, IsDirectory });
+		Nodes.emplace_back(x.Path, MZNode{ &x, IsDirectory });
 	};
 
 	if (Src.Files.empty())
@@ -286,7 +311,7 @@ void MZFileSystem::UpdateFileList(PreprocessedDir& Src, MZDirDesc& Dest)
 			auto&& SrcSubdir = Src.Subdirs[i];
 			auto&& DestSubdir = Dirs[SubdirsIndex + i];
 			DestSubdir.Parent = &Dest;
-			UpdateFileList(SrcSubdir, DestSubdir);
+			UpdateFileList(SrcSubdir, DestSubdir, Nodes);
 		}
 
 		for (auto&& Subdir : Dest.SubdirsRange())
@@ -326,7 +351,8 @@ bool MZFileSystem::Create(std::string BasePathArgument)
 
 	const auto NumNodes = Tree.NumArchives + Tree.NumDirectories + Tree.NumFiles;
 	const auto NumDirs = Tree.NumArchives + Tree.NumDirectories;
-	NodeMap.reserve(NumNodes);
+	std::vector<MPathTable<MZNode>::value_type> Nodes;
+	Nodes.reserve(NumNodes);
 	Files.reserve(Tree.NumFiles);
 	Dirs.reserve(NumDirs);
 
@@ -334,7 +360,8 @@ bool MZFileSystem::Create(std::string BasePathArgument)
 
 	Dirs.emplace_back();
 	auto&& Root = Dirs.back();
-	UpdateFileList(Tree.Root, Root);
+	UpdateFileList(Tree.Root, Root, Nodes);
+	NodeMap.Build(Nodes);
 
 	return true;
 }
@@ -376,11 +403,7 @@ const MZDirDesc* MZFileSystem::GetDirectory(const StringView& Path) const
 
 const MZNode* MZFileSystem::GetNode(const StringView& Path) const
 {
-	auto it = NodeMap.find(Path);
-	if (it == NodeMap.end())
-		return nullptr;
-
-	return &it->second;
+	return NodeMap.find(Path);
 }
 
 int MZFileSystem::GetFileLength(int i)
@@ -401,39 +424,6 @@ int MZFileSystem::GetFileLength(const StringView& szFileName)
 	return pDesc->Size;
 }
 
-#ifdef WIN32
-class MMappedFile
-{
-public:
-	MMappedFile() {}
-	MMappedFile(const char* Filename);
-	MMappedFile(const MMappedFile&) = delete;
-	MMappedFile(MMappedFile&&);
-	~MMappedFile();
-	MMappedFile& operator =(MMappedFile&& src)
-	{
-		this->~MMappedFile();
-		new (this) MMappedFile(std::move(src));
-		return *this;
-	}
-
-	bool Dead() const { return bDead; }
-	auto GetPointer() const { return reinterpret_cast<const char*>(View); }
-	auto GetSize() const { return Size; }
-
-private:
-	bool bDead = true;
-	HANDLE File = INVALID_HANDLE_VALUE;
-	HANDLE Mapping = INVALID_HANDLE_VALUE;
-	HANDLE View = INVALID_HANDLE_VALUE;
-	size_t Size = 0;
-};
-#endif
-
-#ifdef WIN32
-#define ARCHIVE_CACHE_MMAP
-#endif
-
 void MZFileSystem::CacheArchive(const StringView& Filename)
 {
 	char FilenameWithExtension[MFile::MaxPath];
@@ -441,25 +431,14 @@ void MZFileSystem::CacheArchive(const StringView& Filename)
 
 	MZip Zip;
 
-#ifdef ARCHIVE_CACHE_MMAP
-	MMappedFile File{ FilenameWithExtension };
-	if (File.Dead())
+	MFile::MappedFile File{ FilenameWithExtension };
+	if (!File.is_open())
 	{
-		MLog("MZFileSystem::CacheArchive -- Failed to load file %s!\n", FilenameWithExtension);
+		MLog("MZFileSystem::CacheArchive -- Failed to map file %s!\n", FilenameWithExtension);
 		return;
 	}
 
-	const auto ZipInitialized = Zip.Initialize(File.GetPointer(), File.GetSize(), MZFile::GetReadMode());
-#else
-	auto fp = fopen(FilenameWithExtension, "rb");
-	if (!fp)
-	{
-		MLog("MZFileSystem::CacheArchive -- fopen_s failed on %s\n", Filename);
-		return;
-	}
-
-	const auto ZipInitialized = Zip.Initialize(fp, MZFile::GetReadMode());
-#endif
+	const auto ZipInitialized = Zip.Initialize(File.data(), File.size(), MZFile::GetReadMode());
 
 	if (!ZipInitialized)
 	{
@@ -501,64 +480,6 @@ void MZFileSystem::ReleaseCachedArchives()
 	CachedFileMap.clear();
 }
 
-#ifdef WIN32
-MMappedFile::MMappedFile(const char * Filename)
-{
-	File = CreateFileA(Filename, GENERIC_READ, 0, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
-	if (File == INVALID_HANDLE_VALUE)
-	{
-		MLog("MMappedFile::MMappedFile - CreateFile failed on %s! GetLastError() = %d\n",
-			Filename, GetLastError());
-		return;
-	}
-
-	Size = GetFileSize(File, nullptr);
-
-	char FileMappingName[256];
-	sprintf_safe(FileMappingName, "GunzCache_%s", Filename);
-	Mapping = CreateFileMapping(File, 0, PAGE_READONLY, 0, 0, FileMappingName);
-	if (Mapping == NULL)
-	{
-		assert(false);
-		return;
-	}
-
-	View = MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, 0);
-	if (View == NULL)
-	{
-		assert(false);
-		return;
-	}
-
-	bDead = false;
-}
-
-MMappedFile::~MMappedFile()
-{
-	if (View != INVALID_HANDLE_VALUE) {
-		auto Success = UnmapViewOfFile(View);
-		assert(Success);
-	}
-	if (Mapping != INVALID_HANDLE_VALUE) {
-		auto Success = CloseHandle(Mapping);
-		assert(Success);
-	}
-	if (File != INVALID_HANDLE_VALUE) {
-		auto Success = CloseHandle(File);
-		assert(Success);
-	}
-}
-
-MMappedFile::MMappedFile(MMappedFile && src)
-	: bDead(src.bDead), View(src.View), Mapping(src.Mapping), File(src.File)
-{
-	src.bDead = true;
-	src.View = INVALID_HANDLE_VALUE;
-	src.Mapping = INVALID_HANDLE_VALUE;
-	src.File = INVALID_HANDLE_VALUE;
-}
-#endif
-
 static const MZDirDesc* Down(const MZDirDesc* Dir);
 
 static const MZDirDesc* DownThroughRange(Range<const MZDirDesc*> range)
@@ -7,13 +7,16 @@
 #include "MDebug.h"
 #include <cassert>
 #include "zlib_util.h"
+#include "MZipFrames.h"
 #include <algorithm>
+#include <vector>
 
-typedef unsigned long dword;
+typedef u32 dword;
 typedef unsigned short word;
 
 #define MRS_ZIP_CODE	0x05030207
 #define MRS2_ZIP_CODE	0x05030208
+#define MRS3_ZIP_CODE	0x05030209
 
 #pragma pack(2)
 struct MZIPLOCALHEADER{
@@ -22,6 +25,9 @@ struct MZIPLOCALHEADER{
 		SIGNATURE2  = 0x85840000,
 		COMP_STORE  = 0,
 		COMP_DEFLAT = 8,
+		// MRS3 only. These aren't assigned to anything in the zip format.
+		COMP_LZ4_FRAMES = 0x4D31,
+		COMP_DEFLATE_FRAMES = 0x4D32,
 	};
 
 	dword   sig;
@@ -58,6 +64,8 @@ struct MZIPDIRFILEHEADER{
 		SIGNATURE2  = 0x05024b80,
 		COMP_STORE  = 0,
 		COMP_DEFLAT = 8,
+		COMP_LZ4_FRAMES = MZIPLOCALHEADER::COMP_LZ4_FRAMES,
+		COMP_DEFLATE_FRAMES = MZIPLOCALHEADER::COMP_DEFLATE_FRAMES,
 	};
 
 	dword   sig;
@@ -140,6 +148,9 @@ bool MZip::isReadAble(u32 mode)
 	else if (m_nZipMode == ZMode_Mrs2) {
 		return (MZIPREADFLAG_MRS2 & mode) != 0;
 	}
+	else if (m_nZipMode == ZMode_Mrs3) {
+		return (MZIPREADFLAG_MRS3 & mode) != 0;
+	}
 	return false;
 }
 
@@ -176,9 +187,8 @@ bool MZip::InitializeImpl()
 			return false;
 	}
 	else {
+		// MRS3 archives are obfuscated the same way, and only differ in the directory header.
 		m_nZipMode = ZMode_Mrs2;
-		if (!isMode(MZIPREADFLAG_MRS2))
-			return false;
 	}
 
 	MZIPDIRHEADER dh{};
@@ -190,7 +200,16 @@ bool MZip::InitializeImpl()
 	if (m_nZipMode >= ZMode_Mrs2)
 		RecoveryChar(reinterpret_cast<char*>(&dh), sizeof(MZIPDIRHEADER));
 
-	if (dh.sig != MRS2_ZIP_CODE && dh.sig != MRS_ZIP_CODE && dh.sig != MZIPDIRHEADER::SIGNATURE) {
+	if (m_nZipMode == ZMode_Mrs2 && dh.sig == MRS3_ZIP_CODE)
+		m_nZipMode = ZMode_Mrs3;
+
+	if (m_nZipMode == ZMode_Mrs2 && !isMode(MZIPREADFLAG_MRS2))
+		return false;
+	if (m_nZipMode == ZMode_Mrs3 && !isMode(MZIPREADFLAG_MRS3))
+		return false;
+
+	if (dh.sig != MRS3_ZIP_CODE && dh.sig != MRS2_ZIP_CODE && dh.sig != MRS_ZIP_CODE &&
+		dh.sig != MZIPDIRHEADER::SIGNATURE) {
 		DMLog("MZip::InitializeImpl - Directory header signature %08X is wrong\n", dh.sig);
 		assert(false);
 		return false;
@@ -400,7 +419,27 @@ bool MZip::IsFileCompressed(int i) const
 	if (i < 0 || i >= m_nDirEntries)
 		return 0;
 
-	return m_ppDir[i]->compression == MZIPDIRFILEHEADER::COMP_DEFLAT;
+	return GetFileMethod(i) != MZipMethod::Stored;
+}
+
+MZipMethod MZip::GetFileMethod(int i) const
+{
+	if (i < 0 || i >= m_nDirEntries)
+		return MZipMethod::Unknown;
+
+	switch (m_ppDir[i]->compression)
+	{
+	case MZIPDIRFILEHEADER::COMP_STORE:
+		return MZipMethod::Stored;
+	case MZIPDIRFILEHEADER::COMP_DEFLAT:
+		return MZipMethod::Deflate;
+	case MZIPDIRFILEHEADER::COMP_LZ4_FRAMES:
+		return m_nZipMode == ZMode_Mrs3 ? MZipMethod::Lz4Frames : MZipMethod::Unknown;
+	case MZIPDIRFILEHEADER::COMP_DEFLATE_FRAMES:
+		return m_nZipMode == ZMode_Mrs3 ? MZipMethod::DeflateFrames : MZipMethod::Unknown;
+	default:
+		return MZipMethod::Unknown;
+	}
 }
 
 void MZip::Seek(i64 Offset, u32 Origin)
@@ -432,7 +471,11 @@ void MZip::ReadN(void* Out, size_t Size)
 {
 	if (FileBuffer)
 	{
-		memcpy(Out, FileBuffer + Pos, Size);
+		// Truncated archives read as zeroes past the end instead of past the mapping.
+		const auto Available = Pos >= 0 && size_t(Pos) < FileSize ?
+			(std::min)(Size, FileSize - size_t(Pos)) : 0;
+		memcpy(Out, FileBuffer + Pos, Available);
+		memset(static_cast<char*>(Out) + Available, 0, Size - Available);
 		Pos += Size;
 		return;
 	}
@@ -463,6 +506,30 @@ bool MZip::ReadFile(int i, void* pBuffer, int nMaxSize)
 		ReadN(pBuffer, h.cSize);
 		return true;
 	}
+	else if (m_nZipMode == ZMode_Mrs3 && (h.compression == MZIPLOCALHEADER::COMP_LZ4_FRAMES ||
+		h.compression == MZIPLOCALHEADER::COMP_DEFLATE_FRAMES))
+	{
+		std::vector<char> Compressed(h.cSize);
+		ReadN(Compressed.data(), Compressed.size());
+
+		const auto Method = h.compression == MZIPLOCALHEADER::COMP_LZ4_FRAMES ?
+			MZipMethod::Lz4Frames : MZipMethod::DeflateFrames;
+		MZipFrames Frames;
+		if (!Frames.Parse(Method, Compressed.data(), Compressed.size(), h.ucSize))
+		{
+			MLog("MZip::ReadFile - Invalid frame index\n");
+			return false;
+		}
+
+		if (dword(nMaxSize) >= h.ucSize)
+			return Frames.DecodeAll(static_cast<char*>(pBuffer));
+
+		std::vector<char> Output(h.ucSize);
+		if (!Frames.DecodeAll(Output.data()))
+			return false;
+		memcpy(pBuffer, Output.data(), nMaxSize);
+		return true;
+	}
 	else if(h.compression!=MZIPLOCALHEADER::COMP_DEFLAT)
 		return false;
 
@@ -709,6 +776,113 @@ bool MZip::ConvertZip(char* zip_name)
 	return true;
 }
 
+bool MZip::ConvertToMrs3(const char* src_name, const char* dest_name, MZipMethod Method)
+{
+	assert(Method == MZipMethod::Lz4Frames || Method == MZipMethod::DeflateFrames);
+
+	MFile::MappedFile Src{ src_name };
+	MZip Zip;
+	if (!Src.is_open() || !Zip.Initialize(Src.data(), Src.size(),
+		MZIPREADFLAG_ZIP | MZIPREADFLAG_MRS | MZIPREADFLAG_MRS2 | MZIPREADFLAG_MRS3))
+	{
+		mlog("MZip::ConvertToMrs3 - Failed to open %s\n", src_name);
+		return false;
+	}
+
+	MFile::RWFile Dest{ dest_name, MFile::Clear };
+	if (Dest.error())
+	{
+		mlog("MZip::ConvertToMrs3 - Failed to open %s for writing\n", dest_name);
+		return false;
+	}
+
+	// The headers are obfuscated like MRS2's, and the directory is written at the end.
+	std::vector<char> DirData;
+	dword Offset = 0;
+	std::vector<char> Data;
+	for (int i = 0; i < Zip.GetFileCount(); ++i)
+	{
+		// Initialize turned the slashes into backslashes.
+		const auto FileName = Zip.GetFileName(i);
+		char Name[1024];
+		const auto NameLen = word((std::min)(FileName.size(), sizeof(Name)));
+		for (word j = 0; j < NameLen; ++j)
+			Name[j] = FileName[j] == '\\' ? '/' : FileName[j];
+
+		Data.resize(Zip.GetFileLength(i));
+		if (!Data.empty() && !Zip.ReadFile(i, Data.data(), int(Data.size())))
+		{
+			mlog("MZip::ConvertToMrs3 - Failed to read %.*s from %s\n", NameLen, Name, src_name);
+			return false;
+		}
+
+		auto Encoded = MZipFrames::Encode(Method, Data.data(), Data.size());
+		const auto Compress = Encoded.size() < Data.size();
+		const auto& Stored = Compress ? Encoded : Data;
+
+		const auto Time = Zip.GetFileTime(i);
+
+		MZIPLOCALHEADER h{};
+		h.sig = MZIPLOCALHEADER::SIGNATURE;
+		h.version = 20;
+		h.compression = !Compress ? MZIPLOCALHEADER::COMP_STORE :
+			Method == MZipMethod::Lz4Frames ? MZIPLOCALHEADER::COMP_LZ4_FRAMES :
+			MZIPLOCALHEADER::COMP_DEFLATE_FRAMES;
+		h.modTime = word(Time);
+		h.modDate = word(Time >> 16);
+		h.crc32 = dword(crc32(0, reinterpret_cast<const Bytef*>(Data.data()), uInt(Data.size())));
+		h.cSize = dword(Stored.size());
+		h.ucSize = dword(Data.size());
+		h.fnameLen = NameLen;
+
+		MZIPDIRFILEHEADER fh{};
+		fh.sig = MZIPDIRFILEHEADER::SIGNATURE;
+		fh.verMade = 20;
+		fh.verNeeded = 20;
+		fh.compression = h.compression;
+		fh.modTime = h.modTime;
+		fh.modDate = h.modDate;
+		fh.crc32 = h.crc32;
+		fh.cSize = h.cSize;
+		fh.ucSize = h.ucSize;
+		fh.fnameLen = NameLen;
+		fh.hdrOffset = Offset;
+
+		char Header[sizeof(h) + sizeof(Name)];
+		memcpy(Header, &h, sizeof(h));
+		memcpy(Header + sizeof(h), Name, NameLen);
+		ConvertChar(Header, sizeof(h) + NameLen);
+		Dest.write(Header, sizeof(h) + NameLen);
+		Dest.write(Stored.data(), Stored.size());
+		Offset += dword(sizeof(h) + NameLen + Stored.size());
+
+		const auto DirOffset = DirData.size();
+		DirData.resize(DirOffset + sizeof(fh) + NameLen);
+		memcpy(&DirData[DirOffset], &fh, sizeof(fh));
+		memcpy(&DirData[DirOffset + sizeof(fh)], Name, NameLen);
+	}
+
+	MZIPDIRHEADER dh{};
+	dh.sig = MRS3_ZIP_CODE;
+	dh.nDirEntries = word(Zip.GetFileCount());
+	dh.totalDirEntries = dh.nDirEntries;
+	dh.dirSize = dword(DirData.size());
+	dh.dirOffset = Offset;
+
+	ConvertChar(DirData.data(), int(DirData.size()));
+	ConvertChar(reinterpret_cast<char*>(&dh), sizeof(dh));
+	Dest.write(DirData.data(), DirData.size());
+	Dest.write(&dh, sizeof(dh));
+
+	if (Dest.error())
+	{
+		mlog("MZip::ConvertToMrs3 - Failed to write %s\n", dest_name);
+		return false;
+	}
+
+	return true;
+}
+
 bool MZip::RecoveryMrs(FILE* fp)
 {
 	fseek(fp, 0, SEEK_SET);
@@ -985,6 +1159,29 @@ void FFileList::ConvertZip()
 	}
 }
 
+void FFileList::ConvertToMrs3(MZipMethod Method)
+{
+	for (auto* pNode : *this)
+	{
+		char TempName[sizeof(pNode->m_name) + 8];
+		sprintf_safe(TempName, "%s_mrs3", pNode->m_name);
+
+		if (!MZip::ConvertToMrs3(pNode->m_name, TempName, Method))
+		{
+			MFile::Delete(TempName);
+			continue;
+		}
+
+		if (!MFile::Delete(pNode->m_name) || !MFile::Move(TempName, pNode->m_name))
+		{
+			mlog("Failed to replace %s with %s\n", pNode->m_name, TempName);
+			continue;
+		}
+
+		mlog("convert mrs3 : %s\n", pNode->m_name);
+	}
+}
+
 void FFileList::RecoveryZip() 
 {
 	iterator node;
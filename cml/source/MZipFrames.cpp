@@ -0,0 +1,155 @@
+#include "stdafx.h"
+#include "MZipFrames.h"
+#include "MLZ4.h"
+#include "MDebug.h"
+#include "zlib_util.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+static u32 ReadU32(const char* p)
+{
+	u32 Value;
+	memcpy(&Value, p, sizeof(Value));
+	return Value;
+}
+
+static void WriteU32(char* p, u32 Value)
+{
+	memcpy(p, &Value, sizeof(Value));
+}
+
+static bool IsFramed(MZipMethod Method)
+{
+	return Method == MZipMethod::Lz4Frames || Method == MZipMethod::DeflateFrames;
+}
+
+bool MZipFrames::Parse(MZipMethod MethodArg, const char* Data, size_t DataSize,
+	size_t UncompressedSizeArg)
+{
+	if (!IsFramed(MethodArg) || DataSize < 8)
+		return false;
+
+	Method = MethodArg;
+	FrameSize = ReadU32(Data);
+	NumFrames = ReadU32(Data + 4);
+	UncompressedSize = UncompressedSizeArg;
+
+	if (FrameSize == 0 ||
+		u64(NumFrames) != (u64(UncompressedSize) + FrameSize - 1) / FrameSize ||
+		(DataSize - 8) / 4 < NumFrames)
+		return false;
+
+	FrameEnds = Data + 8;
+	Frames = FrameEnds + NumFrames * 4;
+
+	// The frames must be in order, and inside the entry.
+	const auto FramesSize = DataSize - 8 - NumFrames * 4;
+	u32 PrevEnd = 0;
+	for (u32 i = 0; i < NumFrames; ++i)
+	{
+		const auto End = GetFrameEnd(i);
+		if (End < PrevEnd || End > FramesSize)
+			return false;
+		PrevEnd = End;
+	}
+
+	return true;
+}
+
+u32 MZipFrames::GetFrameEnd(u32 Frame) const
+{
+	return ReadU32(FrameEnds + Frame * 4);
+}
+
+size_t MZipFrames::GetUncompressedSize(u32 Frame) const
+{
+	const auto Begin = size_t(Frame) * FrameSize;
+	return (std::min)(size_t(FrameSize), UncompressedSize - Begin);
+}
+
+bool MZipFrames::Decode(u32 Frame, char* Output) const
+{
+	if (Frame >= NumFrames)
+		return false;
+
+	const auto Begin = Frame == 0 ? 0 : GetFrameEnd(Frame - 1);
+	const auto Input = Frames + Begin;
+	const auto InputSize = GetFrameEnd(Frame) - Begin;
+	const auto OutputSize = GetUncompressedSize(Frame);
+
+	if (InputSize == OutputSize)
+	{
+		memcpy(Output, Input, OutputSize);
+		return true;
+	}
+
+	if (Method == MZipMethod::Lz4Frames)
+		return MLZ4::Decompress(Input, InputSize, Output, OutputSize);
+
+	const auto ret = InflateMemory(Output, OutputSize, Input, InputSize, -MAX_WBITS);
+	return ret.ErrorCode == Z_STREAM_END && ret.BytesWritten == OutputSize;
+}
+
+bool MZipFrames::DecodeAll(char* Output) const
+{
+	for (u32 i = 0; i < NumFrames; ++i)
+		if (!Decode(i, Output + size_t(i) * FrameSize))
+			return false;
+	return true;
+}
+
+// Compresses a frame into Output, and returns the compressed size, or 0 if it didn't get smaller.
+static size_t CompressFrame(MZipMethod Method, const char* Input, size_t Size, char* Output)
+{
+	if (Method == MZipMethod::Lz4Frames)
+	{
+		const auto CompressedSize = MLZ4::Compress(Input, Size, Output);
+		return CompressedSize < Size ? CompressedSize : 0;
+	}
+
+	z_stream Stream{};
+	if (deflateInit2(&Stream, Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8,
+		Z_DEFAULT_STRATEGY) != Z_OK)
+		return 0;
+
+	Stream.next_in = (Bytef*)Input;
+	Stream.avail_in = uInt(Size);
+	Stream.next_out = (Bytef*)Output;
+	// Anything that isn't smaller is stored instead.
+	Stream.avail_out = uInt(Size > 0 ? Size - 1 : 0);
+	const auto err = deflate(&Stream, Z_FINISH);
+	const auto CompressedSize = size_t(Stream.total_out);
+	deflateEnd(&Stream);
+
+	return err == Z_STREAM_END ? CompressedSize : 0;
+}
+
+std::vector<char> MZipFrames::Encode(MZipMethod Method, const char* Data, size_t Size)
+{
+	assert(IsFramed(Method));
+
+	const auto NumFrames = u32((Size + MZipFrameSize - 1) / MZipFrameSize);
+	const auto IndexSize = 8 + size_t(NumFrames) * 4;
+
+	std::vector<char> Out(IndexSize);
+	WriteU32(Out.data(), MZipFrameSize);
+	WriteU32(Out.data() + 4, NumFrames);
+
+	std::vector<char> Buffer(MLZ4::CompressBound(MZipFrameSize));
+	for (u32 i = 0; i < NumFrames; ++i)
+	{
+		const auto Input = Data + size_t(i) * MZipFrameSize;
+		const auto InputSize = (std::min)(size_t(MZipFrameSize), Size - size_t(i) * MZipFrameSize);
+
+		const auto CompressedSize = CompressFrame(Method, Input, InputSize, Buffer.data());
+		if (CompressedSize != 0)
+			Out.insert(Out.end(), Buffer.data(), Buffer.data() + CompressedSize);
+		else
+			Out.insert(Out.end(), Input, Input + InputSize);
+
+		WriteU32(Out.data() + 8 + i * 4, u32(Out.size() - IndexSize));
+	}
+
+	return Out;
+}
@@ -1,9 +1,11 @@
 #include "MUtil.h"
 #include "Log.h"
+#include "Download.h"
 
 struct Options
 {
 	bool IgnoreSelfUpdate{};
+	DownloadLimits Limits;
 };
 
 struct HandleArgumentsResult
@@ -21,6 +23,8 @@ HandleArgumentsResult HandleArguments(Options& Opt, const T& Args)
 	{
 		static const StringView VerbosityOpt = "--verbosity=";
 		static const StringView IgnoreSelfUpdateOpt = "--ignore-self-update";
+		static const StringView MaxConnectionsOpt = "--max-connections=";
+		static const StringView MaxDownloadSpeedOpt = "--max-download-speed=";
 
 		auto& Arg = Args[i];
 
@@ -51,6 +55,33 @@ HandleArgumentsResult HandleArguments(Options& Opt, const T& Args)
 		{
 			Opt.IgnoreSelfUpdate = true;
 		}
+		else if (CheckSubset(MaxConnectionsOpt))
+		{
+			auto Value = Arg.substr(MaxConnectionsOpt.size());
+			auto MaybeConnections = StringToInt<int>(Value);
+			if (!MaybeConnections.has_value() || *MaybeConnections < 1)
+			{
+				return {false, strprintf("Invalid --max-connections option value. "
+					"Expected a positive integral value, got \"%.*s\"\n",
+					Value.size(), Value.data())};
+			}
+
+			Opt.Limits.MaxConnections = *MaybeConnections;
+		}
+		else if (CheckSubset(MaxDownloadSpeedOpt))
+		{
+			// In KiB/s, 0 for unlimited.
+			auto Value = Arg.substr(MaxDownloadSpeedOpt.size());
+			auto MaybeSpeed = StringToInt<u64>(Value);
+			if (!MaybeSpeed.has_value())
+			{
+				return {false, strprintf("Invalid --max-download-speed option value. "
+					"Expected integral value in KiB/s, got \"%.*s\"\n",
+					Value.size(), Value.data())};
+			}
+
+			Opt.Limits.MaxBytesPerSecond = *MaybeSpeed * 1024;
+		}
 		else
 		{
 			return {false, strprintf("Unknown option %.*s\n", Arg.size(), Arg.data())};
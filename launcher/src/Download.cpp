@@ -6,6 +6,9 @@
 
 #include "sodium.h"
 
+#include <algorithm>
+#include <thread>
+
 // Include MWindows.h to undefine all the Windows macros that curl.h brought in.
 #include "MWindows.h"
 #include "curl/curl.h"
@@ -166,6 +169,30 @@ static bool SetProtocol(ProtocolType& Protocol, const char* URL)
 	return true;
 }
 
+// Returns the port that the URL has in it, or Port if it has none.
+static long GetPort(const char* URL, int Port)
+{
+	auto URLView = StringView{ URL };
+	auto HostBegin = URLView.find("://");
+	if (HostBegin == URLView.npos)
+		return Port;
+	HostBegin += 3;
+
+	auto Host = URLView.substr(HostBegin);
+	Host = Host.substr(0, std::min(Host.find_first_of('/'), Host.size()));
+
+	// Skip over the brackets around IPv6 addresses.
+	const auto BracketIndex = Host.find_first_of(']');
+	if (BracketIndex != Host.npos)
+		Host = Host.substr(BracketIndex);
+
+	const auto ColonIndex = Host.find_first_of(':');
+	if (ColonIndex == Host.npos)
+		return Port;
+
+	return StringToInt<long>(Host.substr(ColonIndex + 1)).value_or(Port);
+}
+
 void FormatError(DownloadError* ErrorOutput, const char* Format, ...)
 {
 	constexpr auto Size = DownloadError::Size;
@@ -220,7 +247,7 @@ bool DownloadFile(const DownloadManagerType& DownloadManager,
 	} while (false);
 
 	curl_easy_setopt_v(curl, CURLOPT_URL, URL);
-	curl_easy_setopt_v(curl, CURLOPT_PORT, Port);
+	curl_easy_setopt_v(curl, CURLOPT_PORT, GetPort(URL, Port));
 	curl_easy_setopt_v(curl, CURLOPT_WRITEFUNCTION, CurlWriteFunction);
 	curl_easy_setopt_v(curl, CURLOPT_WRITEDATA, &WriteData);
 	curl_easy_setopt_v(curl, CURLOPT_RANGE, Range);
@@ -271,4 +298,309 @@ bool DownloadFile(const DownloadManagerType& DownloadManager,
 	}
 
 	return true;
-}
\ No newline at end of file
+}
+
+struct DownloadQueue::Transfer
+{
+	DownloadQueue* Queue;
+	DownloadRequest Request;
+	DownloadResult Result;
+	DownloadInfoContext Context;
+	Hash::Strong::Stream HashStream;
+	CURL* curl = nullptr;
+	bool Paused = false;
+	bool Aborted = false;
+};
+
+extern "C" size_t CurlQueueWriteFunction(void* buffer, size_t size, size_t nmemb, void* stream)
+{
+	assert(stream != nullptr);
+
+	auto& Transfer = *static_cast<DownloadQueue::Transfer*>(stream);
+	auto& Queue = *Transfer.Queue;
+
+	const auto total_size = size * nmemb;
+
+	if (Queue.Limits.MaxBytesPerSecond != 0)
+	{
+		// Over budget, so curl holds on to the data until Run unpauses the transfer.
+		if (Queue.ConsumeTokens(total_size))
+		{
+			Transfer.Paused = true;
+			return CURL_WRITEFUNC_PAUSE;
+		}
+	}
+
+	Transfer.HashStream.Update(buffer, total_size);
+	Transfer.Result.Size += total_size;
+	Queue.Received += total_size;
+
+	if (Transfer.Request.Callback)
+	{
+		DownloadInfo Info{ &Transfer.Context };
+		if (!Transfer.Request.Callback(static_cast<const u8*>(buffer), total_size, Info))
+		{
+			Transfer.Aborted = true;
+			return 0;
+		}
+	}
+
+	return total_size;
+}
+
+DownloadQueue::DownloadQueue() = default;
+
+DownloadQueue::~DownloadQueue()
+{
+	for (auto* Transfer : Active)
+	{
+		curl_multi_remove_handle(Multi, Transfer->curl);
+		curl_easy_cleanup(Transfer->curl);
+	}
+
+	for (auto* Handle : IdleHandles)
+		curl_easy_cleanup(Handle);
+
+	if (Multi)
+	{
+		curl_multi_cleanup(Multi);
+		curl_global_cleanup();
+	}
+}
+
+DownloadQueue::ID DownloadQueue::Add(DownloadRequest Request)
+{
+	auto NewTransfer = std::make_unique<Transfer>();
+	NewTransfer->Queue = this;
+	NewTransfer->Request = std::move(Request);
+	Transfers.push_back(std::move(NewTransfer));
+	return Transfers.size() - 1;
+}
+
+const DownloadResult& DownloadQueue::GetResult(ID Download) const
+{
+	return Transfers[Download]->Result;
+}
+
+void DownloadQueue::Clear()
+{
+	assert(Active.empty());
+	Transfers.clear();
+	NextTransfer = 0;
+}
+
+bool DownloadQueue::ConsumeTokens(size_t Size)
+{
+	const auto Now = std::chrono::steady_clock::now();
+	const auto Rate = double(Limits.MaxBytesPerSecond);
+
+	// Allow bursts of a tenth of a second's worth, but at least one read's worth.
+	const auto Capacity = std::max(Rate / 10, double(CURL_MAX_WRITE_SIZE));
+	const auto Seconds = std::chrono::duration<double>(Now - LastRefill).count();
+	Tokens = std::min(Capacity, Tokens + Rate * Seconds);
+	LastRefill = Now;
+
+	if (Tokens <= 0)
+		return true;
+
+	// The data's taken even if it's more than what's left, and the debt is paid off before the
+	// next piece.
+	if (Size != 0)
+		Tokens -= double(Size);
+	return false;
+}
+
+bool DownloadQueue::Start(Transfer& t)
+{
+	CURL* curl;
+	if (!IdleHandles.empty())
+	{
+		curl = IdleHandles.back();
+		IdleHandles.pop_back();
+		curl_easy_reset(curl);
+	}
+	else
+	{
+		curl = curl_easy_init();
+	}
+
+	auto Fail = [&](const char* Format, auto... Args) {
+		FormatError(&t.Result.Error, Format, Args...);
+		if (curl)
+			IdleHandles.push_back(curl);
+		if (t.Request.Done)
+			t.Request.Done(t.Result);
+		return false;
+	};
+
+	if (!curl)
+		return Fail("curl_easy_init failed");
+
+	const auto URL = t.Request.URL.c_str();
+	const auto Range = t.Request.Range.empty() ? nullptr : t.Request.Range.c_str();
+
+	t.Context.curl = curl;
+	t.Context.Range = Range;
+	if (!SetProtocol(t.Context.Protocol, URL))
+		return Fail("Unrecognized protocol in URL \"%s\"", URL);
+
+	const std::pair<CURLoption, CURLcode> Results[] = {
+		{CURLOPT_URL, curl_easy_setopt(curl, CURLOPT_URL, URL)},
+		{CURLOPT_PORT, curl_easy_setopt(curl, CURLOPT_PORT, GetPort(URL, t.Request.Port))},
+		{CURLOPT_WRITEFUNCTION, curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION,
+			CurlQueueWriteFunction)},
+		{CURLOPT_WRITEDATA, curl_easy_setopt(curl, CURLOPT_WRITEDATA, &t)},
+		{CURLOPT_PRIVATE, curl_easy_setopt(curl, CURLOPT_PRIVATE, &t)},
+		{CURLOPT_RANGE, curl_easy_setopt(curl, CURLOPT_RANGE, Range)},
+		{CURLOPT_FAILONERROR, curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1l)},
+		{CURLOPT_ERRORBUFFER, curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, t.Result.Error.String)},
+		{CURLOPT_NOPROGRESS, curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1l)},
+	};
+	for (auto&& Result : Results)
+	{
+		if (Result.second != CURLE_OK)
+		{
+			return Fail("curl_easy_setopt(%d) returned %d for URL %s",
+				int(Result.first), int(Result.second), URL);
+		}
+	}
+
+	const auto AddResult = curl_multi_add_handle(Multi, curl);
+	if (AddResult != CURLM_OK)
+		return Fail("curl_multi_add_handle returned %d", int(AddResult));
+
+	t.curl = curl;
+	Active.push_back(&t);
+	return true;
+}
+
+void DownloadQueue::Finish(Transfer& t, int Code)
+{
+	const auto res = CURLcode(Code);
+	auto curl = t.curl;
+
+	t.Result.Success = res == CURLE_OK && !t.Aborted;
+	t.HashStream.Final(t.Result.Hash);
+
+	if (!t.Result.Success && !t.Aborted)
+	{
+		if (res == CURLE_HTTP_RETURNED_ERROR)
+		{
+			FormatError(&t.Result.Error, "Received HTTP error code %d when trying to "
+				"download from URL %s", GetCurlResponseCode(curl), t.Request.URL.c_str());
+		}
+		else
+		{
+			Log.Error("Curl error when downloading from URL %s: %s\n",
+				t.Request.URL.c_str(), t.Result.Error.String[0] ?
+				t.Result.Error.String : curl_easy_strerror(res));
+		}
+	}
+	else if (t.Aborted)
+	{
+		strcpy_safe(t.Result.Error.String, "Download stopped by the callback");
+	}
+
+	curl_multi_remove_handle(Multi, curl);
+	IdleHandles.push_back(curl);
+	t.curl = nullptr;
+	Active.erase(std::find(Active.begin(), Active.end(), &t));
+
+	if (t.Request.Done)
+		t.Request.Done(t.Result);
+}
+
+bool DownloadQueue::Run(function_view<ProgressCallbackType> ProgressCallback)
+{
+	const auto FirstTransfer = NextTransfer;
+
+	if (!Multi)
+	{
+		if (curl_global_init(CURL_GLOBAL_DEFAULT) != CURLE_OK)
+		{
+			Log.Error("curl_global_init failed\n");
+			return false;
+		}
+
+		Multi = curl_multi_init();
+		if (!Multi)
+		{
+			Log.Error("curl_multi_init failed\n");
+			curl_global_cleanup();
+			return false;
+		}
+	}
+
+	const auto MaxConnections = std::max(Limits.MaxConnections, 1);
+	curl_multi_setopt(Multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, long(MaxConnections));
+
+	u64 TotalSize = 0;
+	for (auto i = FirstTransfer; i < Transfers.size(); ++i)
+		TotalSize += Transfers[i]->Request.ExpectedSize;
+
+	Tokens = 0;
+	LastRefill = std::chrono::steady_clock::now();
+	Received = 0;
+
+	while (true)
+	{
+		while (Active.size() < size_t(MaxConnections) && NextTransfer < Transfers.size())
+			Start(*Transfers[NextTransfer++]);
+
+		if (Active.empty())
+			break;
+
+		int Running;
+		curl_multi_perform(Multi, &Running);
+
+		bool AnyFinished = false;
+		CURLMsg* Message;
+		int MessagesLeft;
+		while ((Message = curl_multi_info_read(Multi, &MessagesLeft)))
+		{
+			if (Message->msg != CURLMSG_DONE)
+				continue;
+
+			Transfer* Done;
+			curl_easy_getinfo(Message->easy_handle, CURLINFO_PRIVATE, &Done);
+			Finish(*Done, Message->data.result);
+			AnyFinished = true;
+		}
+
+		if (ProgressCallback)
+			ProgressCallback(size_t(TotalSize), size_t(Received));
+
+		// Unpausing may hand the held data to the callback right away, and pause it again.
+		bool AnyPaused = false;
+		for (size_t i = 0; i < Active.size(); ++i)
+		{
+			auto* t = Active[i];
+			if (t->Paused && !ConsumeTokens(0))
+			{
+				t->Paused = false;
+				curl_easy_pause(t->curl, CURLPAUSE_CONT);
+			}
+			AnyPaused |= t->Paused;
+		}
+
+		// Start the next transfers on the connections that were freed up right away.
+		if (AnyFinished)
+			continue;
+
+		long TimeoutMS = AnyPaused ? 1 : 100;
+		long CurlTimeoutMS;
+		if (curl_multi_timeout(Multi, &CurlTimeoutMS) == CURLM_OK && CurlTimeoutMS >= 0)
+			TimeoutMS = std::min(TimeoutMS, CurlTimeoutMS);
+
+		int NumFds = 0;
+		curl_multi_wait(Multi, nullptr, 0, int(TimeoutMS), &NumFds);
+
+		// curl_multi_wait returns right away if there's nothing to wait on, e.g. when everything
+		// is paused, so this waits for the timeout instead of spinning.
+		if (NumFds == 0)
+			std::this_thread::sleep_for(std::chrono::milliseconds(TimeoutMS));
+	}
+
+	return std::all_of(Transfers.begin() + FirstTransfer, Transfers.end(), [](auto&& t) {
+		return t->Result.Success; });
+}
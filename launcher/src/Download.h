@@ -1,6 +1,10 @@
 #pragma once
 
 #include <memory>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
 #include "Hash.h"
 #include "GlobalTypes.h"
 #include "optional.h"
@@ -67,6 +71,8 @@ struct DownloadError
 // The last value in the pair can be left out, which implies that the range extends to the end of
 // the file.
 //
+// The port is only used if the URL doesn't have one in it.
+//
 // Note that HTTP servers are not required to support range requests, and you may not get a range
 // back.
 // Single range example: "100-200"
@@ -77,4 +83,96 @@ bool DownloadFile(const DownloadManagerType& DownloadManager,
 	function_view<DownloadCallbackType> Callback,
 	function_view<ProgressCallbackType> ProgressCallback = {},
 	const char* Range = nullptr,
-	DownloadError* ErrorOutput = nullptr);
\ No newline at end of file
+	DownloadError* ErrorOutput = nullptr);
+
+struct DownloadLimits
+{
+	// How many transfers are in flight at once. Each one has a connection of its own, which is
+	// kept open for the next transfer to the same host.
+	int MaxConnections = 8;
+
+	// The combined speed of all the transfers, in bytes per second. 0 is unlimited.
+	u64 MaxBytesPerSecond = 0;
+};
+
+struct DownloadResult
+{
+	bool Success = false;
+
+	// The strong hash and the size of everything that was received, hashed as it came in.
+	Hash::Strong Hash;
+	u64 Size = 0;
+
+	DownloadError Error{};
+};
+
+struct DownloadRequest
+{
+	// Must already be URL-encoded.
+	std::string URL;
+	int Port = 0;
+
+	// Same as for DownloadFile. Empty downloads the whole file.
+	std::string Range;
+
+	// Called with each piece of data as it comes in. Returning false fails the download.
+	std::function<DownloadCallbackType> Callback;
+
+	// Called once the download has finished, successfully or not.
+	std::function<void(const DownloadResult&)> Done;
+
+	// How many bytes the download is expected to be, only used for progress. 0 if unknown.
+	u64 ExpectedSize = 0;
+};
+
+// Downloads many files, or ranges of files, at once, keeping up to Limits.MaxConnections
+// transfers in flight, so that a high latency link isn't idle while it waits for each response.
+//
+// Everything happens on the thread that calls Run, including the callbacks, which are called in
+// whatever order the data arrives in.
+class DownloadQueue
+{
+public:
+	using ID = size_t;
+
+	DownloadLimits Limits;
+
+	DownloadQueue();
+	~DownloadQueue();
+	DownloadQueue(const DownloadQueue&) = delete;
+	DownloadQueue& operator=(const DownloadQueue&) = delete;
+
+	ID Add(DownloadRequest Request);
+
+	// Downloads everything that's been added since the last call, and returns true if all of it
+	// succeeded. The progress is the expected size and received size of all of it together.
+	bool Run(function_view<ProgressCallbackType> ProgressCallback = {});
+
+	const DownloadResult& GetResult(ID Download) const;
+
+	// Forgets every download, keeping the connections open for the next ones.
+	void Clear();
+
+	// Internal.
+	struct Transfer;
+
+	// Internal. Takes Size bytes out of the bandwidth budget, or returns true if there's nothing
+	// left, in which case the transfer has to wait.
+	bool ConsumeTokens(size_t Size);
+	u64 Received = 0;
+
+private:
+	bool Start(Transfer&);
+	void Finish(Transfer&, int Code);
+
+	std::vector<std::unique_ptr<Transfer>> Transfers;
+	size_t NextTransfer = 0;
+	std::vector<Transfer*> Active;
+
+	void* Multi = nullptr;
+	std::vector<void*> IdleHandles;
+
+	// Bandwidth budget, in bytes. Transfers are paused while it's negative.
+	double Tokens = 0;
+	std::chrono::steady_clock::time_point LastRefill;
+};
@@ -1,7 +1,8 @@
 // FileCache.h
 //
 // The file cache stores cached data about files that have previously been
-// included in the patch set into an XML file named launcher_cache.xml.
+// included in the patch set into a binary file, named launcher_cache.bin for
+// the launcher and patch_cache.bin for PatchCreator.
 //
 // The data it stores about files are the last recorded ...
 // 1) size
@@ -16,6 +17,19 @@
 // This is not designed to be secure against malicious people trying to
 // intentionally get the game to use the incorrect files; it assumes
 // good faith on part of the user.
+//
+// # Format
+//
+// The file is a FileCacheHeader, followed by an array of FileCacheRecords sorted by path, and then
+// the paths of all the records back to back. All integers are little-endian.
+//
+// The file is mapped into memory instead of being parsed, and lookups binary search the records,
+// so only the pages that are looked at are ever read, and loading takes the same time no matter
+// how many files there are. Changes are kept in a hash map on the side until the file is rewritten
+// by Save.
+//
+// Earlier versions stored the cache as XML, in launcher_cache.xml and patch_cache.xml. If there's
+// no binary cache, the XML one is loaded instead, and deleted once Save has replaced it.
 
 #pragma once
 
@@ -28,6 +42,8 @@
 #include "File.h"
 #include "XML.h"
 
+#include <algorithm>
+#include <cstring>
 #include <unordered_map>
 
 struct CachedFileData
@@ -45,54 +61,58 @@ struct FileQueryResult
 		Outdated,
 		Error,
 	} Result;
-	const CachedFileData* FileData;
+	CachedFileData FileData;
+};
+
+struct FileCacheHeader
+{
+	char Magic[8];
+	u32 NumRecords;
+	u32 PathTableSize;
+};
+
+struct FileCacheRecord
+{
+	u64 Size;
+	u64 LastModifiedTime;
+	// Where the path is in the path table, which comes after the records.
+	u32 PathOffset;
+	u32 PathSize;
+	u8 Hash[Hash::Strong::Size];
 };
 
+static_assert(sizeof(FileCacheHeader) == 16, "FileCacheHeader must have no padding");
+static_assert(sizeof(FileCacheRecord) == 56, "FileCacheRecord must have no padding");
+
+constexpr char FileCacheMagic[8] = {'R', 'G', 'F', 'C', 'A', 'C', 'H', '1'};
+
 struct FileCacheType
 {
+	explicit FileCacheType(const char* CacheFilename = "launcher_cache.bin",
+		const char* LegacyCacheFilename = "launcher_cache.xml")
+		: CacheFilename{CacheFilename}, LegacyCacheFilename{LegacyCacheFilename}
+	{}
+
 	bool Load()
 	{
-		auto CacheFilename = "launcher_cache.xml";
-
-		if (!MFile::Exists(CacheFilename))
+		if (MFile::Exists(CacheFilename))
 		{
-			Log.Info("Cache does not exist\n");
-			return true;
-		}
+			if (MapFile())
+				return true;
 
-		XMLFile xml;
-		if (!xml.CreateFromFile(CacheFilename))
-		{
-			Log.Error("Failed to read and parse %s!\n", CacheFilename);
+			// Rewrite it with whatever can be found out this time.
+			Changed = true;
 			return false;
 		}
 
-		for (auto&& node : GetFileNodeRange(xml.Doc))
+		if (LegacyCacheFilename && MFile::Exists(LegacyCacheFilename))
 		{
-			auto Filename = xml.GetName(node);
-			if (Filename.empty())
-				continue;
-
-			auto Hash = xml.GetHash(node, Filename);
-			auto Size = xml.GetSize(node, Filename);
-			auto LastModifiedTime = xml.GetLastModifiedTime(node, Filename);
-
-			if (Hash.empty() || !Size.has_value() || !LastModifiedTime.has_value())
-				continue;
-
-			CachedFileData NewFile;
-			NewFile.Size = Size.value();
-			NewFile.LastModifiedTime = LastModifiedTime.value();
-			strcpy_safe(NewFile.Hash, Hash);
-			Map.emplace(Filename, NewFile);
-
-			LOG_DEBUG("Mapped %.*s to {Size: %llu, LastModifiedTime: %llu, Hash: %s}\n",
-				Filename.size(), Filename.data(), NewFile.Size, NewFile.LastModifiedTime, NewFile.Hash);
+			Log.Info("Migrating %s to %s\n", LegacyCacheFilename, CacheFilename);
+			Changed = true;
+			return LoadXML();
 		}
 
-		// Save the file data.
-		CacheXMLFileData.swap(xml.FileData);
-
+		Log.Info("Cache does not exist\n");
 		return true;
 	}
 
@@ -101,63 +121,122 @@ struct FileCacheType
 		if (!Changed)
 			return true;
 
-		rapidxml::xml_document<> doc;
-
-		for (auto&& pair : Map)
+		// Everything that's been added, and then whatever in the old file wasn't replaced.
+		struct Entry
 		{
-			// allocate_node can never return null.
-			auto&& node = *doc.allocate_node(rapidxml::node_element, "file");
-			AppendAttribute(doc, node, "name", pair.first);
-			AppendAttribute(doc, node, "size", pair.second.Size);
-			AppendAttribute(doc, node, "last_modified_time", pair.second.LastModifiedTime);
-			AppendAttribute(doc, node, "hash", pair.second.Hash);
-			doc.append_node(&node);
+			StringView Path;
+			const CachedFileData* Data;
+			const FileCacheRecord* Record;
+		};
+		std::vector<Entry> Entries;
+		Entries.reserve(Added.size() + NumRecords);
+		for (auto&& Pair : Added)
+			Entries.push_back({Pair.first, &Pair.second, nullptr});
+		for (u32 i = 0; i < NumRecords; ++i)
+		{
+			const auto Path = GetPath(Records[i]);
+			if (!Path.empty() && Added.find(Path) == Added.end())
+				Entries.push_back({Path, nullptr, &Records[i]});
 		}
 
-		auto&& Filename = "launcher_cache.xml";
-
-		MFile::RWFile File{ Filename, MFile::Clear };
+		std::sort(Entries.begin(), Entries.end(), [](const Entry& a, const Entry& b) {
+			return a.Path < b.Path; });
+		Entries.erase(std::unique(Entries.begin(), Entries.end(), [](const Entry& a, const Entry& b) {
+			return a.Path == b.Path; }), Entries.end());
 
-		if (File.error())
+		std::vector<FileCacheRecord> NewRecords;
+		NewRecords.reserve(Entries.size());
+		std::vector<char> PathTable;
+		for (auto&& Entry : Entries)
 		{
-			Log.Error("Failed to open file %s for writing cache\n", Filename);
-			return false;
+			FileCacheRecord Record;
+			if (Entry.Record)
+			{
+				Record = *Entry.Record;
+			}
+			else
+			{
+				Record.Size = Entry.Data->Size;
+				Record.LastModifiedTime = Entry.Data->LastModifiedTime;
+				Hash::Strong Hash;
+				if (!Hash.FromString(Entry.Data->Hash, strlen(Entry.Data->Hash)))
+					continue;
+				memcpy(Record.Hash, Hash.Value, sizeof(Record.Hash));
+			}
+			Record.PathOffset = u32(PathTable.size());
+			Record.PathSize = u32(Entry.Path.size());
+			PathTable.insert(PathTable.end(), Entry.Path.begin(), Entry.Path.end());
+			NewRecords.push_back(Record);
 		}
 
-		rapidxml::print(MFile::FileOutputIterator{ File }, doc);
+		FileCacheHeader Header;
+		memcpy(Header.Magic, FileCacheMagic, sizeof(Header.Magic));
+		Header.NumRecords = u32(NewRecords.size());
+		Header.PathTableSize = u32(PathTable.size());
 
-		if (File.error())
+		// The new file is written next to the old one, which is still mapped, and then replaces it.
+		char NewFilename[MFile::MaxPath];
+		sprintf_safe(NewFilename, "%s_new", CacheFilename);
 		{
-			Log.Error("Failed to write cache to %s\n", Filename);
+			MFile::RWFile File{ NewFilename, MFile::Clear };
+			if (File.error())
+			{
+				Log.Error("Failed to open file %s for writing cache\n", NewFilename);
+				return false;
+			}
+
+			File.write(&Header, sizeof(Header));
+			File.write(NewRecords.data(), NewRecords.size() * sizeof(NewRecords[0]));
+			File.write(PathTable.data(), PathTable.size());
+
+			if (File.error())
+			{
+				Log.Error("Failed to write cache to %s\n", NewFilename);
+				return false;
+			}
+		}
+
+		UnmapFile();
+		MFile::Delete(CacheFilename);
+		if (!MFile::Move(NewFilename, CacheFilename))
+		{
+			Log.Error("Failed to move %s to %s\n", NewFilename, CacheFilename);
 			return false;
 		}
 
-		Log.Info("Saved file cache to %s\n", Filename);
+		if (LegacyCacheFilename && MFile::Exists(LegacyCacheFilename))
+			MFile::Delete(LegacyCacheFilename);
+
+		Log.Info("Saved file cache with %zu files to %s\n", NewRecords.size(), CacheFilename);
+
+		// Everything that was added is in the file now.
+		Added.clear();
+		CacheXMLFileData.clear();
+		Changed = false;
+		MapFile();
 
 		return true;
 	}
 
 	FileQueryResult GetCachedFileData(const char* Path) const
 	{
-		auto it = Map.find(Path);
-		if (it == Map.end())
-			return {FileQueryResult::NotFound};
-
-		auto& CachedData = it->second;
+		CachedFileData CachedData;
+		if (!Find(CachedData, Path))
+			return {FileQueryResult::NotFound, {}};
 
 		CachedFileData CurrentData;
 		if (!GetFileSizeAndTime(CurrentData, Path))
-			return {FileQueryResult::Error};
+			return {FileQueryResult::Error, {}};
 
 		bool Unchanged = CachedData.LastModifiedTime == CurrentData.LastModifiedTime &&
 			CachedData.Size == CurrentData.Size;
 
 		if (!Unchanged)
 		{
-			return {FileQueryResult::Outdated};
+			return {FileQueryResult::Outdated, {}};
 		}
 
-		return {FileQueryResult::Found, &CachedData};
+		return {FileQueryResult::Found, CachedData};
 	}
 
 	// Note: The Path pointer is saved in the map, so the caller is responsible for
@@ -172,7 +251,7 @@ struct FileCacheType
 		}
 
 		strcpy_safe(Data.Hash, Hash);
-		Map[Path] = Data;
+		Added[Path] = Data;
 
 		Changed = true;
 
@@ -201,37 +280,143 @@ private:
 		return true;
 	}
 
-	bool ConfirmUnchangedFileSizeAndTime(const char* Path, const CachedFileData& CachedData) const
+	// Maps the binary cache file. Returns false if it can't be mapped or isn't a valid cache.
+	bool MapFile()
 	{
-		CachedFileData CurrentData;
+		if (!Mapping.open(CacheFilename))
+		{
+			Log.Error("Failed to map %s\n", CacheFilename);
+			return false;
+		}
 
-		if (!GetFileSizeAndTime(CurrentData, Path))
+		FileCacheHeader Header{};
+		if (Mapping.size() >= sizeof(Header))
+			memcpy(&Header, Mapping.data(), sizeof(Header));
+
+		const auto RecordsSize = u64(Header.NumRecords) * sizeof(FileCacheRecord);
+		if (memcmp(Header.Magic, FileCacheMagic, sizeof(Header.Magic)) != 0 ||
+			Mapping.size() != sizeof(Header) + RecordsSize + Header.PathTableSize)
+		{
+			Log.Error("%s is not a valid cache file\n", CacheFilename);
+			Mapping.close();
+			return false;
+		}
+
+		Records = reinterpret_cast<const FileCacheRecord*>(Mapping.data() + sizeof(Header));
+		NumRecords = Header.NumRecords;
+		PathTable = Mapping.data() + sizeof(Header) + RecordsSize;
+		PathTableSize = Header.PathTableSize;
+
+		Log.Info("Mapped file cache with %u files\n", NumRecords);
+
+		return true;
+	}
+
+	void UnmapFile()
+	{
+		Mapping.close();
+		Records = nullptr;
+		NumRecords = 0;
+		PathTable = nullptr;
+		PathTableSize = 0;
+	}
+
+	// Returns an empty path for records that point outside of the path table.
+	StringView GetPath(const FileCacheRecord& Record) const
+	{
+		if (u64(Record.PathOffset) + Record.PathSize > PathTableSize)
+			return {};
+		return {PathTable + Record.PathOffset, Record.PathSize};
+	}
+
+	bool Find(CachedFileData& Output, StringView Path) const
+	{
+		auto it = Added.find(Path);
+		if (it != Added.end())
+		{
+			Output = it->second;
+			return true;
+		}
+
+		const auto End = Records + NumRecords;
+		const auto Record = std::lower_bound(Records, End, Path,
+			[&](const FileCacheRecord& Record, const StringView& Path) {
+				return GetPath(Record) < Path; });
+		if (Record == End || GetPath(*Record) != Path)
+			return false;
+
+		Output.Size = Record->Size;
+		Output.LastModifiedTime = Record->LastModifiedTime;
+		Hash::detail::bin2str(Output.Hash, Record->Hash, sizeof(Record->Hash));
+		return true;
+	}
+
+	bool LoadXML()
+	{
+		XMLFile xml;
+		if (!xml.CreateFromFile(LegacyCacheFilename))
+		{
+			Log.Error("Failed to read and parse %s!\n", LegacyCacheFilename);
 			return false;
+		}
+
+		for (auto&& node : GetFileNodeRange(xml.Doc))
+		{
+			auto Filename = xml.GetName(node);
+			if (Filename.empty())
+				continue;
+
+			auto Hash = xml.GetHash(node, Filename);
+			auto Size = xml.GetSize(node, Filename);
+			auto LastModifiedTime = xml.GetLastModifiedTime(node, Filename);
 
-		LOG_DEBUG("Cur.Size = %llu, Cur.LastModifiedTime = %llu\n"
-			"Last.Size = %llu, Last.LastModifiedTime = %llu\n",
-			CurrentData.Size, CurrentData.LastModifiedTime,
-			CachedData.Size, CachedData.LastModifiedTime);
+			if (Hash.empty() || !Size.has_value() || !LastModifiedTime.has_value())
+				continue;
 
-		return CurrentData.Size == CachedData.Size &&
-			CurrentData.LastModifiedTime == CachedData.LastModifiedTime;
+			CachedFileData NewFile;
+			NewFile.Size = Size.value();
+			NewFile.LastModifiedTime = LastModifiedTime.value();
+			strcpy_safe(NewFile.Hash, Hash);
+			Added.emplace(Filename, NewFile);
+
+			LOG_DEBUG("Mapped %.*s to {Size: %llu, LastModifiedTime: %llu, Hash: %s}\n",
+				Filename.size(), Filename.data(), NewFile.Size, NewFile.LastModifiedTime, NewFile.Hash);
+		}
+
+		// Save the file data.
+		CacheXMLFileData.swap(xml.FileData);
+
+		return true;
 	}
 
-	// Maps file paths to CachedFileDatas.
+	// The paths of the cache file, and of the XML cache it replaces. Must be string literals, or
+	// otherwise outlive the cache. LegacyCacheFilename may be null.
+	const char* CacheFilename;
+	const char* LegacyCacheFilename;
+
+	// The mapped cache file, and where its records and paths are.
+	MFile::MappedFile Mapping;
+	const FileCacheRecord* Records = nullptr;
+	u32 NumRecords = 0;
+	const char* PathTable = nullptr;
+	u32 PathTableSize = 0;
+
+	// Maps file paths to CachedFileDatas that aren't in the file yet, which take precedence over
+	// the ones that are.
 	// The keys in this map are references to strings; they don't own the memory.
-	// The paths that are inserted by FileCache::Load are references to strings
-	// contained within the launcher_cache.xml string.
+	// The paths that are inserted when migrating from the XML cache are references to strings
+	// contained within its data.
 	// The lifetimes of paths inserted by calling FileCache::Add are tracked by
 	// the caller.
 	using MapType = std::unordered_map<StringView, CachedFileData>;
-	MapType Map;
+	MapType Added;
 
-	// Tracks whether the map was changed.
+	// Tracks whether the cache was changed.
 	// If there are no changes, FileCache::Save does nothing.
 	bool Changed = false;
 
-	// Data from the launcher_cache.xml file.
-	// The vector is moved from XMLFile into this after FileCache::Load has
+	// Data from the XML cache file.
+	// The vector is moved from XMLFile into this after FileCache::LoadXML has
 	// finished to preserve the validity of string pointers that point into it.
 	// std::vector is used instead of std::string because std::vector::swap
 	// guarantees that no iterators will be invalidated, which std::string::swap
@@ -32,6 +32,11 @@
 #include "SafeString.h"
 #include "sodium.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define HASH_ROLLING_SSE2
+#endif
+
 namespace Hash
 {
 
@@ -42,16 +47,41 @@ inline void bin2str(ArrayView<char> Output, const u8* Data, size_t Size)
 {
 	assert(Output.size() >= Size * 2 + 1 && "Output is too small!");
 
+	static const char Digits[] = "0123456789ABCDEF";
+
 	auto* CurOutput = Output.data();
-	auto RemainingSize = Output.size();
 	for (size_t i = 0; i < Size; ++i)
 	{
-		// sprintf_safe null-terminates at every step,
-		// so we don't need to do that after the loop.
-		sprintf_safe(CurOutput, RemainingSize, "%02X", Data[i]);
-		CurOutput += 2;
-		RemainingSize -= 2;
+		*CurOutput++ = Digits[Data[i] >> 4];
+		*CurOutput++ = Digits[Data[i] & 0xF];
 	}
+	*CurOutput = 0;
+}
+
+// The inverse of bin2str. Accepts both upper and lower case digits.
+// Returns false if Input isn't exactly Size * 2 hexadecimal digits.
+inline bool str2bin(u8* Output, size_t Size, const char* Input, size_t InputSize)
+{
+	if (InputSize != Size * 2)
+		return false;
+
+	auto Digit = [](char c) -> int {
+		if (c >= '0' && c <= '9') return c - '0';
+		if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+		if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+		return -1;
+	};
+
+	for (size_t i = 0; i < Size; ++i)
+	{
+		const auto High = Digit(Input[i * 2]);
+		const auto Low = Digit(Input[i * 2 + 1]);
+		if (High < 0 || Low < 0)
+			return false;
+		Output[i] = u8((High << 4) | Low);
+	}
+
+	return true;
 }
 
 template <typename HashType>
@@ -108,6 +138,11 @@ struct Strong
 		detail::bin2str(Output, Value, Size);
 	}
 
+	// Parses the output of ToString. Returns false if String isn't a valid hash.
+	bool FromString(const char* String, size_t StringSize) {
+		return detail::str2bin(Value, Size, String, StringSize);
+	}
+
 	inline void HashMemory(const void* Buffer, size_t Size)
 	{
 		crypto_generichash_blake2b(
@@ -201,6 +236,66 @@ struct Rolling
 		Value = (u32(NewUpper) << 16) | NewLower;
 	}
 
+	// Does the same as calling Move Count times, writing the hash after each move to Output.
+	// Data points to the first byte of the current window, and Data + Size + Count - 1 is the last
+	// byte that ends up in the window.
+	//
+	// The moves depend on each other, but they can still be done eight at a time: Over a run of
+	// moves, a is the running sum of the differences between the bytes entering and leaving the
+	// window, and b is the running sum of the a values minus Size times the running sum of the
+	// bytes leaving. With one 16-bit lane per move, those are three prefix sums over a vector, and
+	// the lanes wrap around at M by themselves.
+	void MoveWindows(u32* Output, const u8* Data, size_t Count, size_t Size)
+	{
+		size_t i = 0;
+
+#ifdef HASH_ROLLING_SSE2
+		const auto Zero = _mm_setzero_si128();
+		const auto SizeVec = _mm_set1_epi16(short(Size));
+		auto Lower = _mm_set1_epi16(short(Value & 0xFFFF));
+		auto Upper = _mm_set1_epi16(short(Value >> 16));
+
+		auto PrefixSum = [](__m128i x) {
+			x = _mm_add_epi16(x, _mm_slli_si128(x, 2));
+			x = _mm_add_epi16(x, _mm_slli_si128(x, 4));
+			return _mm_add_epi16(x, _mm_slli_si128(x, 8));
+		};
+		auto BroadcastLast = [](__m128i x) {
+			x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(3, 3, 3, 3));
+			return _mm_unpackhi_epi64(x, x);
+		};
+
+		for (; i + 8 <= Count; i += 8)
+		{
+			const auto Leaving = _mm_unpacklo_epi8(
+				_mm_loadl_epi64(reinterpret_cast<const __m128i*>(Data + i)), Zero);
+			const auto Entering = _mm_unpacklo_epi8(
+				_mm_loadl_epi64(reinterpret_cast<const __m128i*>(Data + i + Size)), Zero);
+
+			const auto NewLower = _mm_add_epi16(Lower, PrefixSum(_mm_sub_epi16(Entering, Leaving)));
+			const auto NewUpper = _mm_sub_epi16(_mm_add_epi16(Upper, PrefixSum(NewLower)),
+				_mm_mullo_epi16(SizeVec, PrefixSum(Leaving)));
+
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(Output + i),
+				_mm_unpacklo_epi16(NewLower, NewUpper));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(Output + i + 4),
+				_mm_unpackhi_epi16(NewLower, NewUpper));
+
+			Lower = BroadcastLast(NewLower);
+			Upper = BroadcastLast(NewUpper);
+		}
+
+		if (i > 0)
+			Value = Output[i - 1];
+#endif
+
+		for (; i < Count; ++i)
+		{
+			Move(Data[i], Data[i + Size], Size);
+			Output[i] = Value;
+		}
+	}
+
 	struct Stream
 	{
 		u32 Value = 0;
@@ -265,4 +360,14 @@ struct hash<Hash::Rolling> {
 		return x.Value;
 	}
 };
+
+template <>
+struct hash<Hash::Strong> {
+	size_t operator()(const Hash::Strong& x) const {
+		// Same as above, any part of the digest is as good as a hash of the whole thing.
+		size_t Value;
+		memcpy(&Value, x.Value, sizeof(Value));
+		return Value;
+	}
+};
 }
\ No newline at end of file
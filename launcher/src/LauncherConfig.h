@@ -11,4 +11,12 @@ constexpr char PatchDomain[] = "http://refinedgunz.com";
 constexpr u16 PatchPort = 80; // 80 is the default http port.
 constexpr size_t BlockSize = 32 * 1024; // 32 KiB
 
+// Bounds and target for the sizes of content-defined chunks in chunk format .sync files.
+constexpr size_t MinChunkSize = 8 * 1024; // 8 KiB
+constexpr size_t AverageChunkSize = 32 * 1024; // 32 KiB
+constexpr size_t MaxChunkSize = 128 * 1024; // 128 KiB
+
+// Adjacent missing blocks or chunks are downloaded with a single range request up to this size.
+constexpr size_t MaxRangeSize = 1024 * 1024; // 1 MiB
+
 }
\ No newline at end of file
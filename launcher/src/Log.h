@@ -5,6 +5,7 @@
 #include "defer.h"
 #include <cstdarg>
 #include <cassert>
+#include <mutex>
 
 // This macro is here since MSVC does not seem willing to optimize out a normal call, even though
 // the first line of Logger::Debug is a return statement when _DEBUG is off.
@@ -142,6 +143,9 @@ struct Logger
 			}
 		}();
 
+		// Lines from different threads are kept whole.
+		std::lock_guard<std::mutex> Lock{Mutex};
+
 		Print(Prefix);
 
 		int LastNewline = -1;
@@ -222,6 +226,7 @@ private:
 	void OutputDbgString(const char*);
 
 	MFile::RWFile LogFile;
+	std::mutex Mutex;
 };
 
 extern Logger Log;
\ No newline at end of file
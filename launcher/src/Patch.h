@@ -241,8 +241,8 @@ inline NeedsUpdateResult NeedsUpdate(const char* Filename,
 		bool FoundInCache = CachedData.Result == FileQueryResult::Found;
 		if (FoundInCache)
 		{
-			strcpy_safe(Ret.Hash, CachedData.FileData->Hash);
-			Ret.Size = CachedData.FileData->Size;
+			strcpy_safe(Ret.Hash, CachedData.FileData.Hash);
+			Ret.Size = CachedData.FileData.Size;
 			ActualHashString = Ret.Hash;
 			Ret.NeedsUpdate = Ret.Size != WantedSize || ActualHashString != WantedHashString;
 			return Ret;
@@ -306,41 +306,28 @@ struct PatchFileResult
 	std::string ErrorMessage;
 };
 
-inline PatchFileResult PatchFile(PatchInternalState& State,
-	DownloadManagerType& DownloadManager,
-	const char* Filename,
-	const char* OutputFilename,
-	const StringView& WantedHashString,
-	u64 WantedSize,
-	bool FileExistsLocally,
-	FileCacheType& FileCache)
+// Sets the progress of the current step, and samples the download speed.
+struct ProgressUpdater
 {
-	assert(Filename != nullptr);
-	if (OutputFilename == nullptr)
-		OutputFilename = Filename;
-
-	State.TargetFile = Filename;
+	using Clock = std::chrono::steady_clock;
 
-	MFile::CreateParentDirs(OutputFilename);
-
-	Hash::Strong NewHash;
-	u64 NewFileSize;
-
-	char FileURL[4096];
-	GetPatchFileURL(FileURL, Filename);
-
-	auto GetTime = [] { return std::chrono::steady_clock::now(); };
-	auto LastStep = GetTime();
+	PatchInternalState& State;
+	Clock::time_point LastStep = Clock::now();
 	u64 LastStepDLNow{};
-	State.BytesPerSecond = 0;
 
-	auto UpdateProgress = [&](u64 DLTotal, u64 DLNow, bool StateChange = false) {
+	explicit ProgressUpdater(PatchInternalState& State) : State{State}
+	{
+		State.BytesPerSecond = 0;
+	}
+
+	void operator()(u64 DLTotal, u64 DLNow, bool StateChange = false)
+	{
 		State.BytesMissing = DLTotal;
 		State.BytesDone = DLNow;
 
 		if (StateChange)
 		{
-			LastStep = GetTime();
+			LastStep = Clock::now();
 			LastStepDLNow = DLNow;
 			State.BytesPerSecond = 0;
 			State.Samples = 0;
@@ -348,7 +335,7 @@ inline PatchFileResult PatchFile(PatchInternalState& State,
 		}
 
 		using namespace std::chrono;
-		const auto Now = GetTime();
+		const auto Now = Clock::now();
 		if (Now - LastStep < State.DownloadSpeedSampleTime)
 		{
 			return;
@@ -373,7 +360,33 @@ inline PatchFileResult PatchFile(PatchInternalState& State,
 		State.BytesPerSecond = Avg;
 		LastStepDLNow = DLNow - size_t(StepDLDeltaForFractional);
 		LastStep += TimeIntegralPart;
-	};
+	}
+};
+
+inline PatchFileResult PatchFile(PatchInternalState& State,
+	DownloadManagerType& DownloadManager,
+	const char* Filename,
+	const char* OutputFilename,
+	const StringView& WantedHashString,
+	u64 WantedSize,
+	bool FileExistsLocally,
+	FileCacheType& FileCache)
+{
+	assert(Filename != nullptr);
+	if (OutputFilename == nullptr)
+		OutputFilename = Filename;
+
+	State.TargetFile = Filename;
+
+	MFile::CreateParentDirs(OutputFilename);
+
+	Hash::Strong NewHash;
+	u64 NewFileSize;
+
+	char FileURL[4096];
+	GetPatchFileURL(FileURL, Filename);
+
+	ProgressUpdater UpdateProgress{State};
 
 	if (FileExistsLocally && State.CanSync)
 	{
@@ -462,6 +475,103 @@ inline PatchFileResult PatchFile(PatchInternalState& State,
 	return {true, ""};
 }
 
+struct WholeFileDownload
+{
+	StringView Filename;
+	StringView WantedHash;
+	u64 WantedSize;
+};
+
+// Downloads files that can't be synchronized, several at a time.
+inline PatchFileResult DownloadWholeFiles(PatchInternalState& State,
+	const DownloadLimits& Limits,
+	const std::vector<WholeFileDownload>& Files,
+	FileCacheType& FileCache)
+{
+	if (Files.empty())
+		return {true, ""};
+
+	Log.Info("Downloading %zu whole files\n", Files.size());
+
+	DownloadQueue Downloads;
+	Downloads.Limits = Limits;
+
+	std::vector<MFile::RWFile> Outputs(Files.size());
+	u32 NumFinished = 0;
+	const auto FirstFileIndex = State.FileIndex.load();
+
+	for (size_t i = 0; i < Files.size(); ++i)
+	{
+		auto&& File = Files[i];
+		MFile::CreateParentDirs(File.Filename);
+
+		char URL[4096];
+		GetPatchFileURL(URL, File.Filename);
+
+		DownloadRequest Request;
+		Request.URL = URL;
+		Request.Port = LauncherConfig::PatchPort;
+		Request.ExpectedSize = File.WantedSize;
+
+		// The files are only opened once their data arrives, so that there aren't more of them
+		// open than there are transfers.
+		Request.Callback = [&, i](const u8* Buffer, size_t Size, DownloadInfo&)
+		{
+			auto&& Output = Outputs[i];
+			if (!Output.is_open() && !Output.open(Files[i].Filename.data(), MFile::Clear))
+			{
+				Log.Error("Couldn't open file \"%s\" for writing\n", Files[i].Filename.data());
+				return false;
+			}
+			return Output.write(Buffer, Size) == Size;
+		};
+
+		Request.Done = [&, i](const DownloadResult& Result)
+		{
+			// Empty files never get any data.
+			if (Result.Success && !Outputs[i].is_open())
+				Outputs[i].open(Files[i].Filename.data(), MFile::Clear);
+			Outputs[i].close();
+
+			State.FileIndex = FirstFileIndex + ++NumFinished;
+			State.TargetFile = Files[i].Filename;
+		};
+
+		Downloads.Add(std::move(Request));
+	}
+
+	State.Status = PatchStatus::Downloading;
+	ProgressUpdater UpdateProgress{State};
+	Downloads.Run([&](size_t DLTotal, size_t DLNow) { UpdateProgress(DLTotal, DLNow); });
+
+	for (size_t i = 0; i < Files.size(); ++i)
+	{
+		auto&& File = Files[i];
+		auto&& Result = Downloads.GetResult(i);
+		if (!Result.Success)
+		{
+			return {false, strprintf("Downloading new file \"%s\" failed. Error message: \"%s\"",
+				File.Filename.data(), Result.Error.String)};
+		}
+
+		char ActualHashString[Hash::Strong::MinimumStringSize];
+		Result.Hash.ToString(ActualHashString);
+		if (File.WantedHash != ActualHashString || File.WantedSize != Result.Size)
+		{
+			return {false, strprintf("Downloaded file \"%s\" is corrupt\n"
+				"Expected hash: %.*s, size: %llu\n"
+				"Actual hash:   %s, size: %llu",
+				File.Filename.data(),
+				File.WantedHash.size(), File.WantedHash.data(), File.WantedSize,
+				ActualHashString, Result.Size)};
+		}
+
+		FileCache.Add(File.Filename.data(), ActualHashString);
+	}
+
+	return {true, ""};
+}
+
 // Deletes any temporary files left over from a previous run of the program.
 inline void DeleteResidualTemporaryFiles()
 {
@@ -604,6 +714,9 @@ inline void Patch(PatchInternalState& State, const Options& Opt)
 
 	DeleteResidualTemporaryFiles();
 
+	State.SyncMemory.emplace();
+	State.SyncMemory->Downloads.Limits = Opt.Limits;
+
 	// The patch.xml file's memory must be in scope for the rest of the program,
 	// since references to parts of it are retained in many places.
 	if (!GetPatchXML(State.PatchXML, DownloadManager))
@@ -696,10 +809,30 @@ inline void Patch(PatchInternalState& State, const Options& Opt)
 	
 	State.FileCount = FilesToUpdate.size();
 
-	for (size_t FileIndex = 0, End = FilesToUpdate.size(); FileIndex < End; ++FileIndex)
+	// The files that there's nothing to synchronize with are downloaded first, all at once.
+	std::vector<WholeFileDownload> WholeFiles;
+	for (auto&& File : FilesToUpdate)
 	{
-		State.FileIndex = FileIndex + 1;
-		auto&& File = FilesToUpdate[FileIndex];
+		if (!File.FileExistsLocally || !State.CanSync)
+			WholeFiles.push_back({File.Filename, File.WantedHash, File.WantedSize});
+	}
+
+	{
+		auto ret = DownloadWholeFiles(State, Opt.Limits, WholeFiles, FileCache);
+		if (!ret.Success)
+		{
+			Fatal(strprintf("Failed to download files\nError: %s", ret.ErrorMessage.c_str()));
+			return;
+		}
+	}
+
+	u32 FileIndex = u32(WholeFiles.size());
+	for (auto&& File : FilesToUpdate)
+	{
+		if (!File.FileExistsLocally || !State.CanSync)
+			continue;
+
+		State.FileIndex = ++FileIndex;
 		State.TargetFile = File.Filename;
 		Log.Info("Patching file...\n"
 			"Name: %s\n"
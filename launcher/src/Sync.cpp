@@ -52,11 +52,29 @@
 // If the strong hash also matches, we set the block data to indicate that it can be found in the
 // local file at that offset.
 //
+// The local file is split into segments that are scanned on separate threads. Each thread reads
+// its segment along with the first block size - 1 bytes of the next one, so that every offset is
+// looked at exactly once, and the matches are merged in file order once every segment is done.
+//
 // When the file is reconstructed, the client iterates over the list of blocks, grabbing blocks
 // from the local file if they were found, or downloading new blocks if not.
 //
 // To download blocks, the HTTP range request header is used. Thus, the webserver serving the files
-// must support it (the feature is optional).
+// must support it (the feature is optional). Adjacent blocks that are missing are downloaded with
+// one request, and several requests are in flight at once, each block being written to its place
+// in the new file as it arrives.
+//
+// ## Chunk format
+//
+// A .sync file can instead split the file into content-defined chunks (see ChunkSize), in which
+// case it starts with an eight byte magic value, and each entry is a 32-bit chunk size followed by
+// the strong hash of the chunk.
+//
+// Since the chunk boundaries only depend on the bytes around them, the client finds the chunks by
+// splitting its own file the same way and looking up the strong hashes, without any rolling hash.
+// The hashes of the chunks of every file synchronized so far are kept in the Memory, so a chunk
+// that moved from one file to another, e.g. an asset moved between two archives, is copied from
+// the file it's now in instead of being downloaded.
 //
 // ## Hash algorithms
 //
@@ -100,8 +118,11 @@
 #include "File.h"
 
 #include <vector>
-#include <unordered_map>
 #include <algorithm>
+#include <atomic>
+#include <thread>
+#include <array>
+#include <unordered_map>
 using std::min;
 using std::max;
 
@@ -138,17 +159,111 @@ struct LastRemoteBlock : RemoteBlock
 	u32 Size;
 };
 
+// An open addressing hash table from rolling hashes to indices into RemoteFile::RemoteBlocks.
+// Due to how weak the rolling hash is, each value might map to multiple blocks.
+//
+// It's looked up at every byte of the local file, and nearly every lookup misses, so it's kept
+// flat and cache friendly: Each slot is eight bytes, the table is at most half full, and a lookup
+// probes linearly from the home slot until it hits an empty one. In front of the slots is a bitmap
+// with 32 bits per slot, set for the hashes in the table, so that a miss is usually one well
+// predicted branch on a bit instead of a walk through the slots.
+struct RollingHashTable
+{
+	static constexpr u32 EmptySlot = UINT32_MAX;
+
+	struct Slot
+	{
+		u32 Hash;
+		u32 Block;
+	};
+
+	std::vector<Slot> Slots;
+	std::vector<u64> Filter;
+
+	void Build(const std::vector<RemoteBlock>& Blocks)
+	{
+		int Bits = 4;
+		while ((size_t(1) << Bits) < Blocks.size() * 2)
+			++Bits;
+		const auto FilterBits = min(Bits + 5, 32);
+
+		Slots.assign(size_t(1) << Bits, Slot{0, EmptySlot});
+		Filter.assign((u64(1) << FilterBits) / 64, 0);
+		Mask = u32(Slots.size() - 1);
+		Shift = 32 - Bits;
+		FilterShift = 32 - FilterBits;
+
+		for (u32 i = 0; i < u32(Blocks.size()); ++i)
+		{
+			const auto Hash = Blocks[i].RollingHash.Value;
+			const auto FilterIndex = Mix(Hash) >> FilterShift;
+			Filter[FilterIndex / 64] |= u64(1) << (FilterIndex % 64);
+
+			auto Index = Mix(Hash) >> Shift;
+			while (Slots[Index].Block != EmptySlot)
+				Index = (Index + 1) & Mask;
+			Slots[Index] = {Hash, i};
+		}
+	}
+
+	// Calls Fn with the index of every block that has this rolling hash.
+	template <typename FnType>
+	void ForEach(u32 Hash, FnType&& Fn) const
+	{
+		const auto Mixed = Mix(Hash);
+		const auto FilterIndex = Mixed >> FilterShift;
+		if (!(Filter[FilterIndex / 64] & (u64(1) << (FilterIndex % 64))))
+			return;
+
+		for (auto Index = Mixed >> Shift; Slots[Index].Block != EmptySlot; Index = (Index + 1) & Mask)
+		{
+			if (Slots[Index].Hash == Hash)
+				Fn(Slots[Index].Block);
+		}
+	}
+
+private:
+	// The lower half of the rolling hash is just the sum of the bytes, so it's mixed before it
+	// picks a slot.
+	static u32 Mix(u32 Hash) { return u32(Hash * 0x9E3779B9u); }
+
+	u32 Mask = 0;
+	int Shift = 32;
+	int FilterShift = 32;
+};
+
+// A piece of the remote file, as it's put together by CreateNewFile.
+// In the block format, these are made from the blocks after they've been looked for in the local
+// file. In the chunk format, these are the chunks themselves.
+struct RemoteChunk
+{
+	Hash::Strong StrongHash;
+
+	// Where the chunk is located in the remote file.
+	u64 RemoteOffset;
+	u32 Size;
+
+	// The file and offset the chunk can be copied from, or null if it has to be downloaded.
+	const char* SourcePath;
+	u64 SourceOffset;
+};
+
 struct RemoteFile
 {
+	// Which format the sync file was in. Only the members for that format are filled out.
+	Format SyncFormat;
+
 	// A contiguous list of remote blocks.
 	// Each block is located at i * LauncherConfig::BlockSize in the remote file, where i is its
 	// index in this list.
 	std::vector<RemoteBlock> RemoteBlocks;
 
 	// Maps rolling hashes to indices into the above list.
-	// Due to how weak the rolling hash is, each value might map to multiple blocks. Therefore,
-	// the map is a multimap.
-	std::unordered_multimap<Hash::Rolling, size_t> RollingHashToBlockMap;
+	// The last block isn't in it, since it can only be found at the end of the local file.
+	RollingHashTable BlockTable;
+
+	// The content-defined chunks of the remote file, in order.
+	std::vector<RemoteChunk> Chunks;
 
 	// The total size of the remote file.
 	u64 Size;
@@ -157,14 +272,6 @@ struct RemoteFile
 	u64 UnmatchingSize;
 
 	LastRemoteBlock LastBlock;
-
-	RemoteBlock& MapValueToBlock(size_t Index)
-	{
-		if (Index == size_t(-1))
-			return LastBlock;
-
-		return RemoteBlocks[Index];
-	}
 };
 
 // Same as ceil(float(a) / b), except without involving floats.
@@ -174,84 +281,107 @@ constexpr auto ceildiv(T1 a, T2 b)
 	return a / b + int(a % b > 0);
 }
 
-static bool DownloadSyncFile(RemoteFile& Remote, const char* SyncFileURL,
-	DownloadManagerType& DownloadManager,
-	function_view<ProgressCallbackType> ProgressCallback)
-{
-	// Each entry contains one rolling hash value and one strong hash value.
-	static constexpr auto EntrySize = Hash::Rolling::Size + Hash::Strong::Size;
-
-	if (ProgressCallback)
-		ProgressCallback(StatusType::DownloadingSyncFile, 0, 0);
+// Each entry contains one rolling hash value and one strong hash value in the block format, and
+// one 32-bit chunk size and one strong hash value in the chunk format.
+static constexpr auto EntrySize = Hash::Rolling::Size + Hash::Strong::Size;
+static_assert(EntrySize == sizeof(u32) + Hash::Strong::Size, "Entries must be the same size");
 
-	// An incomplete entry left over from a previous call to the Callback.
-	// This would occur when the content length is not a multiple of the entry size.
-	u8 PartialData[EntrySize];
-	size_t PartialDataSize = 0;
+// Chunk format .sync files start with this.
+// Block format files have no header, so one could only be mistaken for a chunk format file if its
+// first rolling hash and the start of its first strong hash happened to spell this out.
+static constexpr char ChunkSyncFileMagic[8] = {'R', 'G', 'C', 'D', 'C', 'S', 'Y', '1'};
 
-	size_t EntriesProcessed = 0;
+static bool ParseBlockSyncFile(RemoteFile& Remote, const u8* Data, size_t Size)
+{
 	const auto NumEntries = ceildiv(Remote.Size, BlockSize);
-	
-	// Deserializes a remote block starting at the Begin address and adds it to Remote.
-	auto AddRemoteBlock = [&](const u8* Begin)
+	if (Size != NumEntries * EntrySize)
+	{
+		Log.Error("Sync file is %zu bytes, expected %llu entries of %zu bytes for a %llu byte "
+			"file\n", Size, u64(NumEntries), size_t(EntrySize), Remote.Size);
+		return false;
+	}
+
+	Remote.RemoteBlocks.reserve(size_t(NumEntries));
+	for (u64 i = 0; i < NumEntries; ++i)
 	{
 		RemoteBlock* NewBlock;
-		size_t MapValue;
-		if (!Remote.LastBlock.Empty && EntriesProcessed == NumEntries - 1)
-		{
+		if (!Remote.LastBlock.Empty && i == NumEntries - 1)
 			NewBlock = &Remote.LastBlock;
-			MapValue = size_t(-1);
-		}
 		else
-		{
 			NewBlock = &emplace_back(Remote.RemoteBlocks);
-			MapValue = NewBlock - Remote.RemoteBlocks.data();
-		}
 
-		const auto RollingHashSrc = Begin;
+		const auto RollingHashSrc = Data + i * EntrySize;
 		memcpy(&NewBlock->RollingHash.Value, RollingHashSrc, sizeof(NewBlock->RollingHash.Value));
 
 		const auto StrongHashSrc = RollingHashSrc + Hash::Rolling::Size;
 		memcpy(&NewBlock->StrongHash.Value, StrongHashSrc, sizeof(NewBlock->StrongHash.Value));
 
-		Remote.RollingHashToBlockMap.emplace(NewBlock->RollingHash, MapValue);
-
 		NewBlock->LocalFileOffset = -1;
+	}
 
-		++EntriesProcessed;
-	};
+	Remote.BlockTable.Build(Remote.RemoteBlocks);
 
-	auto Callback = [&](const u8* Buffer, size_t Size, DownloadInfo& Info)
+	return true;
+}
+
+static bool ParseChunkSyncFile(RemoteFile& Remote, const u8* Data, size_t Size)
+{
+	if (Size % EntrySize != 0)
 	{
-		LOG_DEBUG("Callback invoked -- Buffer = %p, Size = %zu\n",
-			Buffer, Size);
+		Log.Error("Chunk sync file has a partial entry\n");
+		return false;
+	}
 
-		if (PartialDataSize > 0)
+	u64 Offset = 0;
+	Remote.Chunks.resize(Size / EntrySize);
+	for (size_t i = 0; i < Remote.Chunks.size(); ++i)
+	{
+		auto&& Chunk = Remote.Chunks[i];
+		const auto Entry = Data + i * EntrySize;
+		memcpy(&Chunk.Size, Entry, sizeof(Chunk.Size));
+		memcpy(Chunk.StrongHash.Value, Entry + sizeof(Chunk.Size), sizeof(Chunk.StrongHash.Value));
+		Chunk.RemoteOffset = Offset;
+		Chunk.SourcePath = nullptr;
+		Chunk.SourceOffset = 0;
+
+		if (Chunk.Size == 0 || Chunk.Size > LauncherConfig::MaxChunkSize)
 		{
-			const auto MissingSize = EntrySize - PartialDataSize;
-			memcpy(PartialData + PartialDataSize, Buffer, min(MissingSize, Size));
-			if (Size < MissingSize)
-			{
-				PartialDataSize += min(MissingSize, Size);
-				return true;
-			}
-
-			AddRemoteBlock(PartialData);
-			Buffer += MissingSize;
-			Size -= MissingSize;
+			Log.Error("Chunk %zu has an invalid size of %u\n", i, Chunk.Size);
+			return false;
 		}
 
-		PartialDataSize = Size % EntrySize;
-		const auto UsableDataSize = Size - PartialDataSize;
-		if (PartialDataSize > 0)
-		{
-			memcpy(PartialData, Buffer + UsableDataSize, PartialDataSize);
-		}
+		Offset += Chunk.Size;
+	}
 
-		for (int i = 0; i < int(Size / EntrySize); ++i)
-		{
-			AddRemoteBlock(Buffer + i * EntrySize);
-		}
+	if (Offset != Remote.Size)
+	{
+		Log.Error("Chunks add up to %llu bytes, but the remote file is %llu bytes\n",
+			Offset, Remote.Size);
+		return false;
+	}
+
+	return true;
+}
+
+// Downloads the .sync file and fills out Remote with either its blocks or its chunks.
+static bool DownloadSyncFile(RemoteFile& Remote, const char* SyncFileURL,
+	DownloadManagerType& DownloadManager,
+	function_view<ProgressCallbackType> ProgressCallback)
+{
+	if (ProgressCallback)
+		ProgressCallback(StatusType::DownloadingSyncFile, 0, 0);
+
+	// Sync files are about a thousandth of the size of the file they describe, so they're kept
+	// whole until the format is known.
+	std::vector<u8> SyncData;
+	SyncData.reserve(size_t(ceildiv(Remote.Size, BlockSize) * EntrySize));
+
+	auto Callback = [&](const u8* Buffer, size_t Size, DownloadInfo& Info)
+	{
+		LOG_DEBUG("Callback invoked -- Buffer = %p, Size = %zu\n",
+			Buffer, Size);
+
+		SyncData.insert(SyncData.end(), Buffer, Buffer + Size);
 
 		return true;
 	};
@@ -265,27 +395,117 @@ static bool DownloadSyncFile(RemoteFile& Remote, const char* SyncFileURL,
 	if (ProgressCallback)
 		ProgressCallbackArg = ProgressCallbackWrapper;
 
-	const auto ret = DownloadFile(DownloadManager, SyncFileURL, LauncherConfig::PatchPort,
-		std::ref(Callback), ProgressCallbackArg);
+	if (!DownloadFile(DownloadManager, SyncFileURL, LauncherConfig::PatchPort,
+		std::ref(Callback), ProgressCallbackArg))
+		return false;
 
-	if (Remote.LastBlock.Empty)
-		assert(Remote.RemoteBlocks.size() == NumEntries);
-	else
-		assert(Remote.RemoteBlocks.size() == NumEntries - 1);
+	constexpr auto MagicSize = sizeof(ChunkSyncFileMagic);
+	if (SyncData.size() >= MagicSize &&
+		memcmp(SyncData.data(), ChunkSyncFileMagic, MagicSize) == 0)
+	{
+		Remote.SyncFormat = Format::Chunks;
+		return ParseChunkSyncFile(Remote, SyncData.data() + MagicSize,
+			SyncData.size() - MagicSize);
+	}
+
+	Remote.SyncFormat = Format::Blocks;
+	return ParseBlockSyncFile(Remote, SyncData.data(), SyncData.size());
+}
 
-	assert(PartialDataSize == 0);
+size_t ChunkSize(const u8* Data, size_t Size)
+{
+	using namespace LauncherConfig;
+
+	// FastCDC: A Gear hash over the bytes decides where chunks end, so the boundaries move along
+	// with the content when bytes are inserted or removed before them. Nothing before MinChunkSize
+	// is looked at, and the mask is harder to match before AverageChunkSize than after it, which
+	// keeps the chunk sizes close to the average.
+	//
+	// Bit n of the Gear hash only depends on the last n + 1 bytes, so the masks use the top bits.
+	constexpr u64 HardMask = ~(~u64(0) >> 17);
+	constexpr u64 EasyMask = ~(~u64(0) >> 13);
+
+	static const auto Gear = [] {
+		// The table only has to be random-looking and the same everywhere, so it's generated
+		// from SplitMix64.
+		std::array<u64, 256> Table;
+		u64 State = 0x5247756E7A436863;
+		for (auto&& Value : Table)
+		{
+			State += 0x9E3779B97F4A7C15;
+			auto z = State;
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+			Value = z ^ (z >> 31);
+		}
+		return Table;
+	}();
 
-	return ret;
+	if (Size <= MinChunkSize)
+		return Size;
+
+	const auto End = min(Size, MaxChunkSize);
+	const auto Normal = min(End, AverageChunkSize);
+
+	u64 Fingerprint = 0;
+	size_t i = MinChunkSize;
+	for (; i < Normal; ++i)
+	{
+		Fingerprint = (Fingerprint << 1) + Gear[Data[i]];
+		if (!(Fingerprint & HardMask))
+			return i + 1;
+	}
+	for (; i < End; ++i)
+	{
+		Fingerprint = (Fingerprint << 1) + Gear[Data[i]];
+		if (!(Fingerprint & EasyMask))
+			return i + 1;
+	}
+
+	return End;
 }
 
-// Calculates the relation between a local file and a remote file,
-// filling out a list of Blocks with the result.
-static bool CalculateBlocks(Memory& memory, RemoteFile& Remote, BlockCounts& Counts,
+// Splits the rest of a file into content-defined chunks and calls Fn(Data, Size) for each of them,
+// in order. Returns false if the file couldn't be read.
+template <typename FnType>
+static bool ForEachChunk(MFile::File& File, u64 FileSize, std::vector<u8>& Buffer, FnType&& Fn)
+{
+	// Read a megabyte at a time, keeping at least a maximum size chunk buffered until the end.
+	Buffer.resize(1024 * 1024 + LauncherConfig::MaxChunkSize);
+
+	u64 Remaining = FileSize;
+	size_t Begin = 0;
+	size_t End = 0;
+	while (true)
+	{
+		if (End - Begin < LauncherConfig::MaxChunkSize && Remaining > 0)
+		{
+			memmove(Buffer.data(), Buffer.data() + Begin, End - Begin);
+			End -= Begin;
+			Begin = 0;
+
+			const auto NumBytesToRead = size_t(min(Remaining, u64(Buffer.size() - End)));
+			if (File.read(Buffer.data() + End, NumBytesToRead) != NumBytesToRead)
+				return false;
+			End += NumBytesToRead;
+			Remaining -= NumBytesToRead;
+		}
+
+		if (Begin == End)
+			return true;
+
+		const auto Size = ChunkSize(Buffer.data() + Begin, End - Begin);
+		Fn(Buffer.data() + Begin, Size);
+		Begin += Size;
+	}
+}
+
+// Finds the chunks of a remote file that are already in the local file, and then looks for the
+// rest in the files synchronized earlier in the patch.
+static bool CalculateChunks(Memory& memory, RemoteFile& Remote, BlockCounts& Counts,
 	const char* LocalFilePath,
 	function_view<ProgressCallbackType> ProgressCallback)
 {
-	using namespace detail;
-
 	if (ProgressCallback)
 		ProgressCallback(StatusType::CalculatingBlocks, 0, 0);
 
@@ -299,363 +519,344 @@ static bool CalculateBlocks(Memory& memory, RemoteFile& Remote, BlockCounts& Cou
 	const auto LocalFileSize = LocalFile.size();
 	assert(!LocalFile.error());
 
-	if (LocalFileSize == 0)
+	std::unordered_multimap<Hash::Strong, size_t> ChunkMap;
+	for (size_t i = 0; i < Remote.Chunks.size(); ++i)
+		ChunkMap.emplace(Remote.Chunks[i].StrongHash, i);
+
+	u64 LocalOffset = 0;
+	const auto Success = ForEachChunk(LocalFile, LocalFileSize, memory.ChunkBuffer,
+		[&](const u8* Data, size_t Size)
 	{
-		Counts.UnmatchingBlocks = Remote.RemoteBlocks.size() + size_t(!Remote.LastBlock.Empty);
-		Counts.MatchingBlocks = 0;
-		Remote.UnmatchingSize = Remote.Size;
-		return true;
-	}
+		Hash::Strong StrongHash;
+		StrongHash.HashMemory(Data, Size);
 
-	// This is used as a circular buffer, so arithmetic on indices into it should be wrapped with
-	// Wrap.
-	constexpr auto FileBufferSize = Memory::FileBufferSize;
-	const auto FileBuffer = memory.FileBuffer.get();
+		for (auto&& Pair : MakeRange(ChunkMap.equal_range(StrongHash)))
+		{
+			auto&& Chunk = Remote.Chunks[Pair.second];
+			if (Chunk.SourcePath || Chunk.Size != Size)
+				continue;
 
-	// Wraps an index a such that it fits within the bounds of FileData.
-	auto Wrap = [&](int a) {
-		return mod(a, FileBufferSize);
-	};
+			Chunk.SourcePath = LocalFilePath;
+			Chunk.SourceOffset = LocalOffset;
+		}
+
+		LocalOffset += Size;
 
-	const auto InitialReadSize = size_t(std::min(LocalFileSize, u64(FileBufferSize)));
-	const auto BytesRead = LocalFile.read(FileBuffer, InitialReadSize);
-	if (BytesRead != InitialReadSize)
+		if (ProgressCallback)
+			ProgressCallback(StatusType::CalculatingBlocks, LocalFileSize, LocalOffset);
+	});
+	if (!Success)
 	{
-		Log(LogLevel::Error, "Failed to read bytes 0 to %zu from file %s\n",
-			InitialReadSize, LocalFilePath);
+		Log(LogLevel::Error, "Failed to read file %s\n", LocalFilePath);
 		return false;
 	}
 
-	// Most types from here on just use int for index and size types, which is ok because the
-	// FileData buffer couldn't reasonably be larger than that.
+	size_t NumLocalChunks = 0;
+	size_t NumSharedChunks = 0;
+	Counts.UnmatchingBlocks = 0;
+	Remote.UnmatchingSize = 0;
+	for (auto&& Chunk : Remote.Chunks)
+	{
+		if (Chunk.SourcePath)
+		{
+			++NumLocalChunks;
+			continue;
+		}
 
-	// The index of the start of the window relative to FileBuffer.
-	// The window is BlockSize bytes large, so the end index is Wrap(WindowStartIndex + BlockSize).
-	int WindowStartIndex = 0;
+		auto it = memory.ChunkIndex.find(Chunk.StrongHash);
+		if (it != memory.ChunkIndex.end())
+		{
+			Chunk.SourcePath = memory.ChunkFiles[it->second.File].c_str();
+			Chunk.SourceOffset = it->second.Offset;
+			++NumSharedChunks;
+			continue;
+		}
 
-	// The index of the start of the window relative to the file.
-	u64 WindowStartFileIndex = 0;
+		++Counts.UnmatchingBlocks;
+		Remote.UnmatchingSize += Chunk.Size;
+	}
+	Counts.MatchingBlocks = NumLocalChunks + NumSharedChunks;
 
-	// The number of bytes skipped over by the window, that haven't yet been consumed.
-	int SkippedBytes = 0;
+	Log.Debug("%zu chunks found in the local file, %zu in other files\n",
+		NumLocalChunks, NumSharedChunks);
 
-	// Stores the last index at which data was loaded from the file.
-	int LastLoadEndIndex = InitialReadSize - 1;
+	return true;
+}
 
-	size_t NumFoundBlocks = 0;
+// Remembers where the chunks of a file that has just been synchronized are, so that later files
+// in the patch can copy them instead of downloading them again.
+static void IndexChunks(Memory& memory, const RemoteFile& Remote, const char* FilePath)
+{
+	const auto File = memory.ChunkFiles.size();
+	memory.ChunkFiles.emplace_back(FilePath);
+	for (auto&& Chunk : Remote.Chunks)
+		memory.ChunkIndex[Chunk.StrongHash] = {File, Chunk.RemoteOffset};
+}
 
-	// Attempts to read new data into the range given.
-	// If the indices are the same, it refreshes the entire buffer.
-	// Returns the actual number of bytes read.
-	// Only used in AdvanceWindow.
-	auto Read = [&](int StartIndex, int OnePastEndIndex)
+// Turns the blocks, now that the ones in the local file have been found, into the list of pieces
+// that CreateNewFile puts the new file together from.
+static void MakeChunksFromBlocks(RemoteFile& Remote, const char* LocalFilePath)
+{
+	auto Add = [&](const RemoteBlock& Block, u64 RemoteOffset, u32 Size)
 	{
-		LOG_DEBUG(4, "Reading %d-%d, LocalFile.tell() = %llu\n",
-			StartIndex, OnePastEndIndex, LocalFile.tell());
-
-		assert(StartIndex >= 0 && StartIndex < FileBufferSize);
-		assert(OnePastEndIndex >= 0 && OnePastEndIndex <= FileBufferSize);
-
-		const auto Size = StartIndex == OnePastEndIndex ? FileBufferSize : Wrap(OnePastEndIndex - StartIndex);
-
-		const auto FirstReadSize = min(Size, int(FileBufferSize) - StartIndex);
-		const auto ActualFirstReadSize = LocalFile.read(&FileBuffer[StartIndex], FirstReadSize);
-		if (ActualFirstReadSize != FirstReadSize)
-		{
-			if (LocalFile.error())
-			{
-				Log.Error("CalculateBlocks -- File IO error on %s\n", LocalFilePath);
-			}
+		const auto Found = Block.LocalFileOffset != u64(-1);
+		Remote.Chunks.push_back({Block.StrongHash, RemoteOffset, Size,
+			Found ? LocalFilePath : nullptr, Found ? Block.LocalFileOffset : 0});
+	};
 
-			LastLoadEndIndex = Wrap(StartIndex + (ActualFirstReadSize - 1));
+	Remote.Chunks.reserve(Remote.RemoteBlocks.size() + 1);
+	for (size_t i = 0; i < Remote.RemoteBlocks.size(); ++i)
+		Add(Remote.RemoteBlocks[i], u64(i) * BlockSize, u32(BlockSize));
 
-			LOG_DEBUG(4,
-				"FirstReadSize = %d\n"
-				"ActualFirstReadSize = %d\n"
-				"LastLoadEndIndex = %d\n",
-				FirstReadSize,
-				ActualFirstReadSize,
-				LastLoadEndIndex);
+	if (!Remote.LastBlock.Empty)
+	{
+		Add(Remote.LastBlock, u64(Remote.RemoteBlocks.size()) * BlockSize,
+			Remote.LastBlock.Size);
+	}
+}
 
-			return int(ActualFirstReadSize);
-		} 
+// The local file is scanned in segments of this many window offsets, each one by a single thread.
+// Segments don't share any state while they're being scanned, and their matches are merged in file
+// order afterwards, so the result doesn't depend on how many threads there are.
+constexpr u64 SegmentSize = 64 * BlockSize;
 
-		auto ret = FirstReadSize;
+// The rolling hashes are computed in batches with Hash::Rolling::MoveWindows.
+// A window right after a match most likely matches too, so the batches that start there are small,
+// and then grow while the windows keep moving one byte at a time.
+constexpr size_t MinHashBatchSize = 64;
+constexpr size_t MaxHashBatchSize = 4096;
 
-		const auto SecondReadSize = int(Size) - (int(FileBufferSize) - StartIndex);
-		if (SecondReadSize > 0)
-		{
-			const auto ActualSecondReadSize = LocalFile.read(&FileBuffer[0], SecondReadSize);
-			ret += ActualSecondReadSize;
-			if (ActualSecondReadSize != SecondReadSize)
-			{
-				if (LocalFile.error())
-				{
-					Log.Error("CalculateBlocks -- File IO error on %s\n", LocalFilePath);
-				}
-
-				LastLoadEndIndex = Wrap(0 + (ActualSecondReadSize - 1));
-
-				LOG_DEBUG(4,
-					"SecondReadSize = %d\n"
-					"ActualSecondReadSize = %d\n"
-					"ret = %d\n",
-					"LastLoadEndIndex = %d\n",
-					SecondReadSize,
-					ActualSecondReadSize,
-					ret,
-					LastLoadEndIndex);
-
-				return ret;
-			}
-		}
+struct SegmentMatch
+{
+	u32 Block;
+	u64 LocalFileOffset;
+};
 
-		LastLoadEndIndex = Wrap(OnePastEndIndex - 1);
+// Looks for remote blocks at every window offset from Segment * SegmentSize up to, but not
+// including, the next segment or NumWindows, and adds the ones it finds to Matches.
+// The data read reaches BlockSize - 1 bytes into the next segment, so that its windows are whole.
+static bool ScanSegment(Memory::ThreadBuffers& Buffers, MFile::File& LocalFile,
+	const RemoteFile& Remote, u64 Segment, u64 NumWindows,
+	std::vector<SegmentMatch>& Matches)
+{
+	const auto Begin = Segment * SegmentSize;
+	const auto NumPositions = size_t(min(SegmentSize, NumWindows - Begin));
+	const auto DataSize = NumPositions + BlockSize - 1;
 
-		LOG_DEBUG(4,
-			"ret = %d\n"
-			"LastLoadEndIndex = %d\n",
-			ret,
-			LastLoadEndIndex);
+	Buffers.Data.resize(size_t(SegmentSize) + BlockSize - 1);
+	Buffers.Hashes.resize(MaxHashBatchSize);
+	Buffers.Found.resize(Remote.RemoteBlocks.size());
 
-		return ret;
-	};
+	if (!LocalFile.seek(Begin, MFile::Seek::Begin) ||
+		LocalFile.read(Buffers.Data.data(), DataSize) != DataSize)
+		return false;
 
-	// Attempts to advance the window by AdvanceOffset bytes, reading in more data if necessary.
-	// Returns the actual number of bytes advanced by, which is less than requested if the end of
-	// the file was reached or if there was an IO error.
-	// If this happens, we can't advance again.
-	auto AdvanceWindow = [&](int AdvanceOffset)
+	const auto Data = Buffers.Data.data();
+	Hash::Rolling RollingHash;
+	size_t BatchBegin = 0;
+	size_t BatchEnd = 0;
+	size_t BatchSize = MinHashBatchSize;
+	size_t Pos = 0;
+	while (Pos < NumPositions)
 	{
-		// Visual for BlockSize = 4, OldWindowStartIndex = 0,
-		// LastLoadEndIndex = 5, AdvanceOffset = 2.
-		//
-		// [ x | x | - | - | - | - | x | x ]
-		//       ^   ^       ^   ^   ^
-		//       |   |       |   |   WindowEndIndex
-		//       |   |       |   LastLoadEndIndex
-		//       |   |       OldWindowEndIndex
-		//       |   WindowStartIndex
-		//       LastLoadStartIndex
-		//
-		// Bytes marked x should be updated.
-
-		assert(AdvanceOffset > 0 && AdvanceOffset <= BlockSize);
-
-		const auto OldWindowStartIndex = WindowStartIndex;
-		WindowStartIndex = Wrap(WindowStartIndex + AdvanceOffset);
-
-		const auto OldWindowEndIndex = Wrap(OldWindowStartIndex + BlockSize - 1);
-		const auto WindowEndIndex = Wrap(WindowStartIndex + BlockSize - 1);
-
-		// We want to read new data in if the window end moved past the last load end.
-		// That is, if the old window end was behind or equal to the last load end, and the new
-		// window end is ahead of it.
-
-		// Move LoadEnd and WindowEnd so that they're relative to OldWindowEnd.
-		const auto OldWindowEndToLoadEnd = Wrap(LastLoadEndIndex - OldWindowEndIndex);
-		const auto WindowEndToOldWindowEnd = AdvanceOffset;
-
-		int ret;
-
-		if (OldWindowEndToLoadEnd >= 0 && OldWindowEndToLoadEnd < WindowEndToOldWindowEnd)
+		if (Pos >= BatchEnd)
 		{
-			LOG_DEBUG(4, "AdvanceWindow -- Reading\n"
-				"OldWindowStartIndex = %d, WindowStartIndex = %d\n"
-				"OldWindowEndIndex = %d, WindowEndIndex = %d\n"
-				"OldWindowEndToLoadEnd = %d, WindowEndToOldWindowEnd = %d\n"
-				"LastLoadEndIndex = %d\n",
-				OldWindowStartIndex, WindowStartIndex,
-				OldWindowEndIndex, WindowEndIndex,
-				OldWindowEndToLoadEnd, WindowEndToOldWindowEnd,
-				LastLoadEndIndex);
-
-			const auto NumBytesRead = Read(Wrap(LastLoadEndIndex + 1), WindowStartIndex);
-			const auto MaxAdvance = NumBytesRead + OldWindowEndToLoadEnd;
-			const auto ActualAdvance = min(AdvanceOffset, MaxAdvance);
-
-			LOG_DEBUG(4, "NumBytesRead = %d\n"
-				"MaxAdvance = %d\n"
-				"ActualAdvance = %d\n",
-				NumBytesRead,
-				MaxAdvance,
-				ActualAdvance);
-
-			ret = ActualAdvance;
-			if (ret < AdvanceOffset)
-				WindowStartIndex -= AdvanceOffset - ret;
-
-			if (ProgressCallback)
+			// RollingHash is at the last window of the previous batch, so if this one starts right
+			// after it, we can move on from there. Otherwise, we jumped, and hash the window anew.
+			if (Pos == BatchEnd && Pos > 0)
 			{
-				ProgressCallback(Sync::CalculatingBlocks, LocalFileSize,
-					WindowStartFileIndex + ret);
+				RollingHash.Move(Data[Pos - 1], Data[Pos + BlockSize - 1], BlockSize);
+				BatchSize = min(BatchSize * 2, MaxHashBatchSize);
 			}
-		}
-		else
-		{
-			ret = AdvanceOffset;
+			else
+			{
+				RollingHash.HashMemory(Data + Pos, BlockSize);
+				BatchSize = MinHashBatchSize;
+			}
+
+			BatchBegin = Pos;
+			BatchEnd = min(Pos + BatchSize, NumPositions);
+			Buffers.Hashes[0] = RollingHash.Value;
+			RollingHash.MoveWindows(&Buffers.Hashes[1], Data + Pos, BatchEnd - BatchBegin - 1,
+				BlockSize);
 		}
 
-		WindowStartFileIndex += ret;
+		// Check if the hash from the current window matches a block in the remote file.
+		bool StrongHashed = false;
+		Hash::Strong StrongHash;
+		bool Found = false;
+		Remote.BlockTable.ForEach(Buffers.Hashes[Pos - BatchBegin], [&](u32 Index)
+		{
+			if (Buffers.Found[Index])
+				return;
 
-		return ret;
-	};
+			if (!StrongHashed)
+			{
+				StrongHash.HashMemory(Data + Pos, BlockSize);
+				StrongHashed = true;
+			}
 
-	auto HashBlock = [&](auto&& Stream, auto&& HashOutput, int StartIndex, int Size)
-	{
-		const auto EndIndex = Wrap(StartIndex + BlockSize);
+			if (Remote.RemoteBlocks[Index].StrongHash != StrongHash)
+				return;
 
-		const auto FirstSrc = &FileBuffer[StartIndex];
-		const auto FirstSize = min(Size, int(FileBufferSize) - StartIndex);
-		Stream.Update(FirstSrc, FirstSize);
+			Buffers.Found[Index] = true;
+			Matches.push_back({Index, Begin + Pos});
+			Found = true;
+		});
 
-		const auto SecondSrc = &FileBuffer[0];
-		const auto SecondSize = Size - (int(FileBufferSize) - StartIndex);
-		if (SecondSize > 0)
-			Stream.Update(SecondSrc, SecondSize);
+		// Jump ahead by one block on match, since we probably won't be able to find new matches
+		// inside it.
+		Pos += Found ? BlockSize : 1;
+	}
 
-		Stream.Final(HashOutput);
-	};
+	for (auto&& Match : Matches)
+		Buffers.Found[Match.Block] = false;
 
-	auto RollingHashBlock = [&](auto&& HashOutput, int StartIndex, int Size = BlockSize) {
-		 HashBlock(Hash::Rolling::Stream{}, HashOutput, StartIndex, Size);
-	};
+	return true;
+}
 
-	auto StrongHashBlock = [&](auto&& HashOutput, int StartIndex, int Size = BlockSize) {
-		HashBlock(Hash::Strong::Stream{}, HashOutput, StartIndex, Size);
-	};
+// Calculates the relation between a local file and a remote file,
+// filling out a list of Blocks with the result.
+static bool CalculateBlocks(Memory& memory, RemoteFile& Remote, BlockCounts& Counts,
+	const char* LocalFilePath,
+	function_view<ProgressCallbackType> ProgressCallback)
+{
+	if (ProgressCallback)
+		ProgressCallback(StatusType::CalculatingBlocks, 0, 0);
 
-	// Adds the final block when the end of the file has been reached.
-	auto OnReachedEnd = [&]
+	MFile::File LocalFile{ LocalFilePath };
+	if (LocalFile.error())
 	{
-		if (Remote.LastBlock.Empty)
-			return;
+		Log(LogLevel::Error, "Failed to open file %s\n", LocalFilePath);
+		return false;
+	}
 
-		const auto LastBlockStartIndex = LastLoadEndIndex + 1 - Remote.LastBlock.Size;
+	const auto LocalFileSize = LocalFile.size();
+	assert(!LocalFile.error());
 
-		Hash::Strong StrongHash;
-		StrongHashBlock(StrongHash, LastBlockStartIndex, Remote.LastBlock.Size);
+	// The number of offsets that a whole block can start at in the local file.
+	const u64 NumWindows = LocalFileSize >= BlockSize ? LocalFileSize - BlockSize + 1 : 0;
+	const auto NumSegments = size_t(ceildiv(NumWindows, SegmentSize));
 
-		if (StrongHash != Remote.LastBlock.StrongHash)
-			return;
+	auto ThreadCount = memory.ThreadCount > 0 ? memory.ThreadCount :
+		max(1, int(std::thread::hardware_concurrency()));
+	ThreadCount = int(min(size_t(ThreadCount), max(NumSegments, size_t(1))));
+	if (memory.Threads.size() < size_t(ThreadCount))
+		memory.Threads.resize(ThreadCount);
 
-		Remote.LastBlock.LocalFileOffset = LocalFileSize - Remote.LastBlock.Size;
+	LOG_DEBUG("LocalFileSize = %llu, NumSegments = %zu, ThreadCount = %d\n",
+		LocalFileSize, NumSegments, ThreadCount);
 
-		LOG_DEBUG(4, "Last block found at local file offset %llu\n", Remote.LastBlock.LocalFileOffset);
-	};
+	std::vector<std::vector<SegmentMatch>> SegmentMatches(NumSegments);
+	std::atomic<size_t> NextSegment{0};
+	std::atomic<u64> ScannedSize{0};
+	std::atomic<bool> Failed{false};
 
-	auto SetCounts = [&]
+	auto Worker = [&](int Thread)
 	{
-		bool LastBlockFound = Remote.LastBlock.LocalFileOffset != -1;
+		// The calling thread uses the file that's already open, the others open their own.
+		MFile::File OwnFile;
+		auto* File = &LocalFile;
+		if (Thread != 0)
+		{
+			if (!OwnFile.open(LocalFilePath))
+			{
+				Failed = true;
+				return;
+			}
+			File = &OwnFile;
+		}
 
-		if (!LastBlockFound)
-			LOG_DEBUG(4, "Last block was not found\n");
+		while (!Failed)
+		{
+			const auto Segment = NextSegment++;
+			if (Segment >= NumSegments)
+				break;
+
+			if (!ScanSegment(memory.Threads[Thread], *File, Remote, Segment, NumWindows,
+				SegmentMatches[Segment]))
+			{
+				Failed = true;
+				break;
+			}
+
+			ScannedSize += min(SegmentSize, NumWindows - Segment * SegmentSize);
 
-		Counts.MatchingBlocks = NumFoundBlocks +
-			size_t(LastBlockFound && !Remote.LastBlock.Empty);
-		Counts.UnmatchingBlocks = Remote.RemoteBlocks.size() - NumFoundBlocks + 
-			size_t(!LastBlockFound && !Remote.LastBlock.Empty);
-		Remote.UnmatchingSize = (Remote.RemoteBlocks.size() - NumFoundBlocks) * BlockSize +
-			(LastBlockFound ? 0 : Remote.LastBlock.Size);
+			// The progress callback isn't thread safe, so only the calling thread reports.
+			if (Thread == 0 && ProgressCallback)
+				ProgressCallback(Sync::CalculatingBlocks, LocalFileSize, ScannedSize);
+		}
 	};
 
-	Hash::Rolling RollingHash;
+	std::vector<std::thread> Threads;
+	for (int i = 1; i < ThreadCount; ++i)
+		Threads.emplace_back(Worker, i);
+	Worker(0);
+	for (auto&& Thread : Threads)
+		Thread.join();
 
-	if (InitialReadSize < BlockSize)
+	if (Failed)
 	{
-		if (InitialReadSize >= Remote.LastBlock.Size)
-			OnReachedEnd();
-		SetCounts();
-		return true;
+		Log(LogLevel::Error, "Failed to read file %s\n", LocalFilePath);
+		return false;
 	}
 
-	RollingHash.HashMemory(FileBuffer, BlockSize);
-
-	while (true)
+	// A block found in several segments is taken from the first one.
+	size_t NumFoundBlocks = 0;
+	for (auto&& Matches : SegmentMatches)
 	{
-#ifdef _DEBUG
-		char RollingString[Hash::Rolling::MinimumStringSize];
-		RollingHash.ToString(RollingString);
-		Log.Debug(5, "WindowStartIndex = %llu -- Rolling = %s\n",
-			WindowStartFileIndex, RollingString);
-#endif
-
-		// Check if the hash from the current window matches a block in the remote file.
-		auto&& Map = Remote.RollingHashToBlockMap;
-		auto Range = MakeRange(Map.equal_range(RollingHash));
-		if (Range.first != Map.end())
+		for (auto&& Match : Matches)
 		{
-			LOG_DEBUG("Rolling hash matches a block\n");
-
-			bool StrongHashed = false;
-			Hash::Strong StrongHash;
-
-			bool Found = false;
-
-			for (auto&& Pair : Range)
-			{
-				auto&& Block = Remote.MapValueToBlock(Pair.second);
-				if (Block.LocalFileOffset != -1)
-					continue;
-
-				if (!StrongHashed)
-				{
-					StrongHashBlock(StrongHash, WindowStartIndex);
-					StrongHashed = true;
-				}
-
-				if (Block.StrongHash != StrongHash)
-					continue;
-
-				++NumFoundBlocks;
-
-				Block.LocalFileOffset = WindowStartFileIndex;
+			auto&& Block = Remote.RemoteBlocks[Match.Block];
+			if (Block.LocalFileOffset != -1)
+				continue;
 
-				LOG_DEBUG(4, "Block value %zu found at local file offset %llu\n",
-					Pair.second, Block.LocalFileOffset);
+			Block.LocalFileOffset = Match.LocalFileOffset;
+			++NumFoundBlocks;
 
-				Found = true;
-			}
+			LOG_DEBUG(4, "Block value %u found at local file offset %llu\n",
+				Match.Block, Block.LocalFileOffset);
+		}
+	}
 
-			if (Found)
-			{
-				// Jump ahead by one block on match, since we probably won't be able to find new
-				// matches inside it.
-				const auto Advanced = AdvanceWindow(BlockSize);
-				if (Advanced != BlockSize)
-				{
-					OnReachedEnd();
-					break;
-				}
-				SkippedBytes = 0;
-
-				RollingHashBlock(RollingHash, WindowStartIndex);
+	// The last block can only be at the end of the file.
+	if (!Remote.LastBlock.Empty && LocalFileSize >= Remote.LastBlock.Size)
+	{
+		const auto LastBlockOffset = LocalFileSize - Remote.LastBlock.Size;
 
-				continue;
-			}
-			else
-			{
-				LOG_DEBUG(4, "False positive\n");
-			}
+		u8 LastBlockData[BlockSize];
+		if (!LocalFile.seek(LastBlockOffset, MFile::Seek::Begin) ||
+			LocalFile.read(LastBlockData, Remote.LastBlock.Size) != Remote.LastBlock.Size)
+		{
+			Log(LogLevel::Error, "Failed to read file %s\n", LocalFilePath);
+			return false;
 		}
 
-		// Advance the window.
-		const auto OldByte = FileBuffer[WindowStartIndex];
+		Hash::Strong StrongHash;
+		StrongHash.HashMemory(LastBlockData, Remote.LastBlock.Size);
 
-		const auto Advanced = AdvanceWindow(1);
-		if (Advanced != 1)
+		if (StrongHash == Remote.LastBlock.StrongHash)
 		{
-			OnReachedEnd();
-			break;
+			Remote.LastBlock.LocalFileOffset = LastBlockOffset;
+
+			LOG_DEBUG(4, "Last block found at local file offset %llu\n", Remote.LastBlock.LocalFileOffset);
 		}
+	}
 
-		const auto WindowEndIndex = Wrap(WindowStartIndex + BlockSize - 1);
-		const auto NewByte = FileBuffer[WindowEndIndex];
+	if (ProgressCallback)
+		ProgressCallback(Sync::CalculatingBlocks, LocalFileSize, LocalFileSize);
 
-		RollingHash.Move(OldByte, NewByte, BlockSize);
-	}
+	bool LastBlockFound = Remote.LastBlock.LocalFileOffset != -1;
 
-	SetCounts();
+	if (!LastBlockFound)
+		LOG_DEBUG(4, "Last block was not found\n");
+
+	Counts.MatchingBlocks = NumFoundBlocks +
+		size_t(LastBlockFound && !Remote.LastBlock.Empty);
+	Counts.UnmatchingBlocks = Remote.RemoteBlocks.size() - NumFoundBlocks + 
+		size_t(!LastBlockFound && !Remote.LastBlock.Empty);
+	Remote.UnmatchingSize = (Remote.RemoteBlocks.size() - NumFoundBlocks) * BlockSize +
+		(LastBlockFound ? 0 : Remote.LastBlock.Size);
 
 	return true;
 }
@@ -666,10 +867,19 @@ static void MakeNewFilePath(char(&OutputFilePath)[OutputSize], const char* Local
 	sprintf_safe(OutputFilePath, "%s_new", LocalFilePath);
 }
 
+// A run of adjacent chunks that have to be downloaded, which is done with a single range request.
+struct MissingRange
+{
+	size_t FirstChunk;
+	size_t NumChunks;
+	u64 Offset;
+	u64 Size;
+};
+
 static bool CreateNewFile(const char* LocalFilePath,
 	const char* SynchronizedFilePath,
 	const char* RemoteFileURL,
-	DownloadManagerType& DownloadManager,
+	DownloadQueue& Downloads,
 	const RemoteFile& Remote,
 	function_view<ProgressCallbackType> ProgressCallback,
 	Hash::Strong* HashOutput,
@@ -694,173 +904,326 @@ static bool CreateNewFile(const char* LocalFilePath,
 		return false;
 	}
 
-	Hash::Strong::Stream Hash;
+	// The file that chunks found in other files are currently being copied from.
+	const char* SharedFilePath = nullptr;
+	MFile::File SharedFile;
 
-	if (SizeOutput)
-		*SizeOutput = 0;
+	Log.Debug("Remote.Chunks.size() = %zu\n", Remote.Chunks.size());
 
-	Log.Debug("Blocks.size() = %zu, Remote.LastBlock.Empty = %d\n",
-		Remote.RemoteBlocks.size(), Remote.LastBlock.Empty);
+	std::unique_ptr<u8[]> InputBuffer{new u8[max(BlockSize, LauncherConfig::MaxChunkSize)]};
 
-	const u64 DLTotal = Remote.UnmatchingSize;
-	u64 DLedSoFar = 0;
-	u64 TotalSize = 0;
+	// Chunks are written where they go in the new file as soon as they're at hand, so the ones
+	// that are already here go in first, and the downloaded ones fill in the gaps in whatever order
+	// they arrive in.
+	auto Write = [&](u64 Offset, const void* Buffer, size_t Size)
+	{
+		return OutputFile.seek(Offset, MFile::Seek::Begin) &&
+			OutputFile.write(Buffer, Size) == Size;
+	};
 
-	auto HandleBlock = [&](const RemoteBlock& Block, size_t ThisBlockSize,
-		u64 OutputOffset) // The offset in the remote/new file.
+	// Copies a chunk from a file synchronized earlier in the patch. Returns false if it's no longer
+	// there, in which case it's downloaded instead.
+	auto CopySharedChunk = [&](const RemoteChunk& Chunk)
 	{
-#ifdef _DEBUG
-		char RollingHashString[Hash::Rolling::MinimumStringSize];
-		Block.RollingHash.ToString(RollingHashString);
-		char StrongHashString[Hash::Strong::MinimumStringSize];
-		Block.StrongHash.ToString(StrongHashString);
+		if (SharedFilePath != Chunk.SourcePath)
+		{
+			SharedFilePath = Chunk.SourcePath;
+			SharedFile.open(SharedFilePath);
+		}
 
-		Log.Debug(4, "Handling block\n"
-			"RollingHash = %s\n"
-			"StrongHash = %s\n"
-			"LocalFileOffset = %llu\n"
-			"Size = %zu\n",
-			RollingHashString,
-			StrongHashString,
-			Block.LocalFileOffset,
-			ThisBlockSize);
-#endif
+		if (!SharedFile.is_open() ||
+			!SharedFile.seek(Chunk.SourceOffset, MFile::Seek::Begin) ||
+			SharedFile.read(InputBuffer.get(), Chunk.Size) != Chunk.Size)
+			return false;
 
-		if (Block.LocalFileOffset != -1)
+		Hash::Strong StrongHash;
+		StrongHash.HashMemory(InputBuffer.get(), Chunk.Size);
+		if (StrongHash != Chunk.StrongHash)
 		{
-			InputFile.seek(Block.LocalFileOffset, MFile::Seek::Begin);
-
-			char InputBuffer[BlockSize];
-			const auto NumBytesRead = InputFile.read(InputBuffer, ThisBlockSize);
+			Log.Debug("Chunk at %llu in %s has changed, downloading it instead\n",
+				Chunk.SourceOffset, Chunk.SourcePath);
+			return false;
+		}
 
-			OutputFile.write(InputBuffer, NumBytesRead);
+		return Write(Chunk.RemoteOffset, InputBuffer.get(), Chunk.Size);
+	};
 
-			if (HashOutput)
-				Hash.Update(InputBuffer, NumBytesRead);
+	std::vector<MissingRange> Missing;
+	u64 MissingSize = 0;
+	auto AddMissing = [&](size_t Index)
+	{
+		auto&& Chunk = Remote.Chunks[Index];
+		MissingSize += Chunk.Size;
 
-			if (InputFile.error())
+		if (!Missing.empty())
+		{
+			auto&& Last = Missing.back();
+			if (Last.FirstChunk + Last.NumChunks == Index &&
+				Last.Size + Chunk.Size <= LauncherConfig::MaxRangeSize)
 			{
-				Log.Error("Sync::SynchronizeFile -- Failed to read %llu bytes from file %s\n",
-					ThisBlockSize, LocalFilePath);
-				return false;
+				++Last.NumChunks;
+				Last.Size += Chunk.Size;
+				return;
 			}
 		}
-		else
-		{
-			size_t DownloadedBlockSize = 0;
-			Hash::Strong::Stream DownloadedBlockHashStream;
 
-			auto Callback = [&](const void* Buffer, size_t Size, DownloadInfo& Info)
-			{
-				Log.Debug(4, "CreateNewFile -- Callback invoked with Buffer = %p, Size = %zu\n",
-					Buffer, Size);
+		Missing.push_back({Index, 1, Chunk.RemoteOffset, Chunk.Size});
+	};
 
-				if (!Info.IsRange())
-				{
-					assert(false);
-					return false;
-				}
+	for (size_t i = 0; i < Remote.Chunks.size(); ++i)
+	{
+		auto&& Chunk = Remote.Chunks[i];
 
-				DownloadedBlockSize += Size;
-				DownloadedBlockHashStream.Update(Buffer, Size);
+#ifdef _DEBUG
+		char StrongHashString[Hash::Strong::MinimumStringSize];
+		Chunk.StrongHash.ToString(StrongHashString);
 
-				if (HashOutput)
-					Hash.Update(Buffer, Size);
+		Log.Debug(4, "Handling chunk\n"
+			"StrongHash = %s\n"
+			"RemoteOffset = %llu\n"
+			"Size = %u\n"
+			"SourcePath = %s\n"
+			"SourceOffset = %llu\n",
+			StrongHashString,
+			Chunk.RemoteOffset,
+			Chunk.Size,
+			Chunk.SourcePath ? Chunk.SourcePath : "(none)",
+			Chunk.SourceOffset);
+#endif
 
-				OutputFile.write(Buffer, Size);
+		if (Chunk.SourcePath == LocalFilePath)
+		{
+			InputFile.seek(Chunk.SourceOffset, MFile::Seek::Begin);
 
-				return true;
-			};
+			const auto NumBytesRead = InputFile.read(InputBuffer.get(), Chunk.Size);
+			if (InputFile.error() || NumBytesRead != Chunk.Size)
+			{
+				Log.Error("Sync::SynchronizeFile -- Failed to read %u bytes from file %s\n",
+					Chunk.Size, LocalFilePath);
+				return false;
+			}
 
-			auto ProgressCallbackWrapper = [&](size_t BlockDLTotal, size_t BlockDLNow)
+			if (!Write(Chunk.RemoteOffset, InputBuffer.get(), Chunk.Size))
 			{
-				ProgressCallback(StatusType::DownloadingFile, DLTotal, DLedSoFar + BlockDLNow);
-			};
+				Log.Error("Sync::SynchronizeFile -- Failed to write %u bytes to file %s\n",
+					Chunk.Size, SynchronizedFilePath);
+				return false;
+			}
+		}
+		else if (!Chunk.SourcePath || !CopySharedChunk(Chunk))
+		{
+			AddMissing(i);
+		}
+	}
 
-			const auto StartOffset = OutputOffset;
-			// The range is inclusive so we need to subtract one.
-			const auto EndOffset = StartOffset + ThisBlockSize - 1;
+	Log.Debug("Downloading %llu bytes in %zu ranges\n", MissingSize, Missing.size());
 
-			char Range[64];
-			sprintf_safe(Range, "%llu-%llu", StartOffset, EndOffset);
+	// Where each range is at. The chunks in a range are checked one by one as they come in.
+	struct RangeProgress
+	{
+		u64 Received = 0;
+		size_t Chunk = 0;
+		u32 ChunkReceived = 0;
+		Hash::Strong::Stream ChunkHash;
+	};
+	std::vector<RangeProgress> Progress(Missing.size());
 
-			Log.Debug(3, "CreateNewFile -- Calling DownloadFile with URL = %s, "
-				"Port = %d, Range = %s\n",
-				RemoteFileURL,
-				LauncherConfig::PatchPort, Range);
+	auto ReceiveRange = [&](size_t RangeIndex, const u8* Buffer, size_t Size, DownloadInfo& Info)
+	{
+		Log.Debug(4, "CreateNewFile -- Callback invoked with Buffer = %p, Size = %zu\n",
+			Buffer, Size);
 
-			function_view<::ProgressCallbackType> ProgressCallbackArg;
-			if (ProgressCallback)
-				ProgressCallbackArg = ProgressCallbackWrapper;
+		if (!Info.IsRange())
+		{
+			assert(false);
+			return false;
+		}
 
-			DownloadFile(DownloadManager, RemoteFileURL, LauncherConfig::PatchPort,
-				std::ref(Callback), ProgressCallbackArg, Range);
+		auto&& Range = Missing[RangeIndex];
+		auto&& State = Progress[RangeIndex];
+		if (State.Received + Size > Range.Size)
+		{
+			Log.Error("Expected size %llu, got more\n", Range.Size);
+			return false;
+		}
 
-			Hash::Strong DownloadedBlockHash;
-			DownloadedBlockHashStream.Final(DownloadedBlockHash);
+		if (!Write(Range.Offset + State.Received, Buffer, Size))
+		{
+			Log.Error("Sync::SynchronizeFile -- Failed to write %zu bytes to file %s\n",
+				Size, SynchronizedFilePath);
+			return false;
+		}
+		State.Received += Size;
+
+		while (Size > 0)
+		{
+			auto&& Chunk = Remote.Chunks[Range.FirstChunk + State.Chunk];
+			const auto NumBytes = min(size_t(Chunk.Size - State.ChunkReceived), Size);
+			State.ChunkHash.Update(Buffer, NumBytes);
+			State.ChunkReceived += u32(NumBytes);
+			Buffer += NumBytes;
+			Size -= NumBytes;
+
+			if (State.ChunkReceived < Chunk.Size)
+				continue;
 
-			const auto WrongSize = DownloadedBlockSize != ThisBlockSize;
-			const auto WrongHash = DownloadedBlockHash != Block.StrongHash;
-			if (WrongSize || WrongHash)
+			Hash::Strong DownloadedBlockHash;
+			State.ChunkHash.Final(DownloadedBlockHash);
+			if (DownloadedBlockHash != Chunk.StrongHash)
 			{
 				Log.Error("Downloaded block integrity fail\n");
 
-				if (WrongSize)
-				{
-					Log.Error("Expected size %zu, got %zu\n", ThisBlockSize, DownloadedBlockSize);
-				}
-				if (WrongHash)
-				{
-					char ExpectedHashString[Hash::Strong::MinimumStringSize];
-					Block.StrongHash.ToString(ExpectedHashString);
-					char ActualHashString[Hash::Strong::MinimumStringSize];
-					DownloadedBlockHash.ToString(ActualHashString);
-
-					Log.Error("Expected hash %s, got %s\n", ExpectedHashString, ActualHashString);
-				}
+				char ExpectedHashString[Hash::Strong::MinimumStringSize];
+				Chunk.StrongHash.ToString(ExpectedHashString);
+				char ActualHashString[Hash::Strong::MinimumStringSize];
+				DownloadedBlockHash.ToString(ActualHashString);
 
+				Log.Error("Expected hash %s, got %s\n", ExpectedHashString, ActualHashString);
 				return false;
 			}
 
-			DLedSoFar += ThisBlockSize;
+			State.ChunkHash = {};
+			State.ChunkReceived = 0;
+			++State.Chunk;
 		}
 
-		TotalSize += ThisBlockSize;
-
 		return true;
 	};
 
-	for (size_t i = 0; i < Remote.RemoteBlocks.size(); ++i)
+	Downloads.Clear();
+	for (size_t i = 0; i < Missing.size(); ++i)
 	{
-		auto&& Block = Remote.RemoteBlocks[i];
+		auto&& Range = Missing[i];
+
+		// The range is inclusive so we need to subtract one.
+		char RangeString[64];
+		sprintf_safe(RangeString, "%llu-%llu", Range.Offset, Range.Offset + Range.Size - 1);
+
+		Log.Debug(3, "CreateNewFile -- Downloading URL = %s, Port = %d, Range = %s\n",
+			RemoteFileURL, LauncherConfig::PatchPort, RangeString);
+
+		DownloadRequest Request;
+		Request.URL = RemoteFileURL;
+		Request.Port = LauncherConfig::PatchPort;
+		Request.Range = RangeString;
+		Request.ExpectedSize = Range.Size;
+		Request.Callback = [&ReceiveRange, i](const u8* Buffer, size_t Size, DownloadInfo& Info) {
+			return ReceiveRange(i, Buffer, Size, Info);
+		};
+		Downloads.Add(std::move(Request));
+	}
+
+	auto ProgressCallbackWrapper = [&](size_t DLTotal, size_t DLNow)
+	{
+		ProgressCallback(StatusType::DownloadingFile, DLTotal, DLNow);
+	};
+
+	function_view<::ProgressCallbackType> ProgressCallbackArg;
+	if (ProgressCallback)
+		ProgressCallbackArg = ProgressCallbackWrapper;
+
+	const auto DownloadSuccess = Downloads.Run(ProgressCallbackArg);
+	Downloads.Clear();
 
-		const auto OutputOffset = i * BlockSize;
-		if (!HandleBlock(Block, BlockSize, OutputOffset))
+	for (size_t i = 0; i < Missing.size(); ++i)
+	{
+		if (Progress[i].Chunk != Missing[i].NumChunks)
 		{
+			Log.Error("Failed to download range %llu-%llu of %s, got %llu of %llu bytes\n",
+				Missing[i].Offset, Missing[i].Offset + Missing[i].Size - 1, RemoteFileURL,
+				Progress[i].Received, Missing[i].Size);
 			return false;
 		}
 	}
 
-	if (!Remote.LastBlock.Empty)
+	if (!DownloadSuccess)
+		return false;
+
+	// The pieces were written out of order, so the whole file is hashed once it's complete.
+	if (HashOutput || SizeOutput)
 	{
-		if (!HandleBlock(Remote.LastBlock, Remote.LastBlock.Size,
-			u64(Remote.RemoteBlocks.size()) * BlockSize))
+		Hash::Strong::Stream Hash;
+		u64 TotalSize = 0;
+
+		OutputFile.seek(0, MFile::Seek::Begin);
+		while (true)
 		{
-			return false;
+			const auto NumBytesRead = OutputFile.read(InputBuffer.get(), LauncherConfig::MaxChunkSize);
+			if (NumBytesRead == 0)
+				break;
+
+			Hash.Update(InputBuffer.get(), NumBytesRead);
+			TotalSize += NumBytesRead;
 		}
+
+		if (HashOutput)
+			Hash.Final(*HashOutput);
+
+		if (SizeOutput)
+			*SizeOutput = TotalSize;
+	}
+
+	return true;
+}
+
+// Writes the magic and then one entry per chunk of the input file.
+static bool MakeChunkSyncFile(MFile::RWFile& OutputFile, MFile::File& InputFile,
+	const char* OutputFilePath, const char* InputFilePath,
+	Hash::Strong* FileHashOutput)
+{
+	OutputFile.write(ChunkSyncFileMagic, sizeof(ChunkSyncFileMagic));
+
+	const auto InputFileSize = InputFile.size();
+	assert(!InputFile.error());
+
+	std::vector<u8> Buffer;
+	Hash::Strong::Stream FileHash;
+	size_t NumChunks = 0;
+
+	const auto Success = ForEachChunk(InputFile, InputFileSize, Buffer,
+		[&](const u8* Data, size_t Size)
+	{
+		if (FileHashOutput)
+			FileHash.Update(Data, Size);
+
+		u8 Entry[EntrySize];
+		const auto ChunkSize = u32(Size);
+		memcpy(Entry, &ChunkSize, sizeof(ChunkSize));
+
+		Hash::Strong StrongHash;
+		StrongHash.HashMemory(Data, Size);
+		memcpy(Entry + sizeof(ChunkSize), StrongHash.Value, sizeof(StrongHash.Value));
+
+		OutputFile.write(Entry, sizeof(Entry));
+		++NumChunks;
+	});
+	if (!Success)
+	{
+		Log(LogLevel::Error, "Sync::MakeSyncFile -- Failed to read file %s\n", InputFilePath);
+		return false;
+	}
+
+	if (OutputFile.error())
+	{
+		Log(LogLevel::Error, "Sync::MakeSyncFile -- Failed to write to file %s\n",
+			OutputFilePath);
+		return false;
 	}
 
-	if (HashOutput)
-		Hash.Final(*HashOutput);
+	Log.Debug("NumChunks = %zu\n", NumChunks);
 
-	if (SizeOutput)
-		*SizeOutput = TotalSize;
+	if (FileHashOutput)
+		FileHash.Final(*FileHashOutput);
 
 	return true;
 }
 
-bool MakeSyncFile(const char* OutputFilePath, const char* InputFilePath)
+bool MakeSyncFile(const char* OutputFilePath, const char* InputFilePath,
+	Hash::Strong* FileHashOutput, Format SyncFormat)
 {
+	// The file is read this many blocks at a time, and the entries for them are written at once.
+	static constexpr size_t BlocksPerRead = 32;
+
 	MFile::CreateParentDirs(OutputFilePath);
 
 	MFile::RWFile OutputFile{ OutputFilePath, MFile::Clear};
@@ -879,6 +1242,12 @@ bool MakeSyncFile(const char* OutputFilePath, const char* InputFilePath)
 		return false;
 	}
 
+	if (SyncFormat == Format::Chunks)
+	{
+		return MakeChunkSyncFile(OutputFile, InputFile, OutputFilePath, InputFilePath,
+			FileHashOutput);
+	}
+
 	const auto InputFileSize = InputFile.size();
 	assert(!InputFile.error());
 
@@ -886,46 +1255,56 @@ bool MakeSyncFile(const char* OutputFilePath, const char* InputFilePath)
 
 	Log.Debug("NumBlocks = %llu\n", NumBlocks);
 
-	u8 InputBuffer[BlockSize];
-	for (u64 i = 0; i < NumBlocks; ++i)
+	std::unique_ptr<u8[]> InputBuffer{new u8[BlocksPerRead * BlockSize]};
+	u8 OutputBuffer[BlocksPerRead * EntrySize];
+	Hash::Strong::Stream FileHash;
+
+	for (u64 i = 0; i < NumBlocks; i += BlocksPerRead)
 	{
-		// Read one block from the file.
-		constexpr auto NumBytesToTryRead = sizeof(InputBuffer);
-		const auto NumBytesRead = InputFile.read(InputBuffer, NumBytesToTryRead);
-		if (NumBytesRead != NumBytesToTryRead && i != NumBlocks - 1)
+		// Read up to BlocksPerRead blocks from the file. Only the last one may be short.
+		const auto NumBytesToTryRead = size_t(min(InputFileSize - i * BlockSize,
+			u64(BlocksPerRead * BlockSize)));
+		const auto NumBytesRead = InputFile.read(InputBuffer.get(), NumBytesToTryRead);
+		if (NumBytesRead != NumBytesToTryRead)
 		{
 			Log(LogLevel::Error, "Sync::MakeSyncFile -- Failed to read %zu bytes from file %s\n",
 				NumBytesToTryRead, InputFilePath);
 			return false;
 		}
 
-		// Compute and write weak rolling hash.
+		if (FileHashOutput)
+			FileHash.Update(InputBuffer.get(), NumBytesRead);
+
+		// Compute the weak rolling hash and the strong hash of each block.
+		size_t OutputSize = 0;
+		for (size_t Offset = 0; Offset < NumBytesRead; Offset += BlockSize)
 		{
+			const auto Block = InputBuffer.get() + Offset;
+			const auto Size = min(BlockSize, NumBytesRead - Offset);
+
 			Hash::Rolling RollingHash;
-			RollingHash.HashMemory(InputBuffer, NumBytesRead);
-			OutputFile.write(&RollingHash.Value, sizeof(RollingHash.Value));
-			if (OutputFile.error())
-			{
-				Log(LogLevel::Error, "Sync::MakeSyncFile -- Failed to write %zu bytes to file %s\n",
-					sizeof(RollingHash.Value), OutputFilePath);
-				return false;
-			}
+			RollingHash.HashMemory(Block, Size);
+			memcpy(OutputBuffer + OutputSize, &RollingHash.Value, sizeof(RollingHash.Value));
+			OutputSize += sizeof(RollingHash.Value);
+
+			Hash::Strong StrongHash;
+			StrongHash.HashMemory(Block, Size);
+			memcpy(OutputBuffer + OutputSize, StrongHash.Value, sizeof(StrongHash.Value));
+			OutputSize += sizeof(StrongHash.Value);
 		}
 
-		// Compute and write strong hash.
+		OutputFile.write(OutputBuffer, OutputSize);
+		if (OutputFile.error())
 		{
-			Hash::Strong StrongHash;
-			StrongHash.HashMemory(InputBuffer, NumBytesRead);
-			OutputFile.write(&StrongHash.Value, sizeof(StrongHash.Value));
-			if (OutputFile.error())
-			{
-				Log(LogLevel::Error, "Sync::MakeSyncFile -- Failed to write %zu bytes to file %s\n",
-					sizeof(StrongHash.Value), OutputFilePath);
-				return false;
-			}
+			Log(LogLevel::Error, "Sync::MakeSyncFile -- Failed to write %zu bytes to file %s\n",
+				OutputSize, OutputFilePath);
+			return false;
 		}
 	}
 
+	if (FileHashOutput)
+		FileHash.Final(*FileHashOutput);
+
 	return true;
 }
 
@@ -963,8 +1342,8 @@ SyncResult SynchronizeFile(Memory& memory,
 		return {false, strprintf("Failed to download sync file \"%s\"", SyncFileURL)};
 	}
 
-	Log.Debug("Remote.RemoteBlocks.size() = %zu\n",
-		Remote.RemoteBlocks.size());
+	Log.Debug("Remote.RemoteBlocks.size() = %zu, Remote.Chunks.size() = %zu\n",
+		Remote.RemoteBlocks.size(), Remote.Chunks.size());
 
 #ifdef _DEBUG
 	for (size_t i = 0; i < Remote.RemoteBlocks.size(); ++i)
@@ -978,36 +1357,27 @@ SyncResult SynchronizeFile(Memory& memory,
 			i, RollingString, StrongString);
 	}
 
-	int i = 0;
-	for (auto&& Pair : Remote.RollingHashToBlockMap)
-	{
-		auto&& Key = Pair.first;
-		auto&& Value = Pair.second;
-		auto&& Block = Remote.MapValueToBlock(Value);
-		char KeyString[Hash::Rolling::MinimumStringSize];
-		Key.ToString(KeyString);
-		char RollingString[Hash::Rolling::MinimumStringSize];
-		Block.RollingHash.ToString(RollingString);
-		char StrongString[Hash::Strong::MinimumStringSize];
-		Block.StrongHash.ToString(StrongString);
-		Log.Debug(4, "Map block %d: Key = %s, Rolling = %s, Strong = %s\n",
-			i, KeyString, RollingString, StrongString);
-		++i;
-	}
+	Log.Debug(4, "Block table has %zu slots\n", Remote.BlockTable.Slots.size());
 #endif
 
 	Log.Debug("Calculating blocks\n");
 
 	BlockCounts Counts;
 
-	Success = CalculateBlocks(memory, Remote, Counts, LocalFilePath, ProgressCallback);
+	if (Remote.SyncFormat == Format::Chunks)
+		Success = CalculateChunks(memory, Remote, Counts, LocalFilePath, ProgressCallback);
+	else
+		Success = CalculateBlocks(memory, Remote, Counts, LocalFilePath, ProgressCallback);
 	if (!Success)
 	{
 		return {false, strprintf("Failed to calculate blocks for file \"%s\"", LocalFilePath)};
 	}
 
-	Log.Info("%zu unmatching blocks, %zu matching blocks, %zu unmatching size\n",
-		Counts.UnmatchingBlocks, Counts.MatchingBlocks, Remote.UnmatchingSize);
+	Counts.UnmatchingSize = Remote.UnmatchingSize;
+
+	Log.Info("%zu unmatching %s, %zu matching, %llu unmatching size\n",
+		Counts.UnmatchingBlocks, Remote.SyncFormat == Format::Chunks ? "chunks" : "blocks",
+		Counts.MatchingBlocks, Remote.UnmatchingSize);
 
 	if (BlockCountsOutput)
 		*BlockCountsOutput = Counts;
@@ -1024,6 +1394,9 @@ SyncResult SynchronizeFile(Memory& memory,
 	PrintBlock(Remote.RemoteBlocks.size(), Remote.LastBlock);
 #endif
 
+	if (Remote.SyncFormat == Format::Blocks)
+		MakeChunksFromBlocks(Remote, LocalFilePath);
+
 	Log.Debug("Creating new file\n");
 
 	char SynchronizedFilePath[MFile::MaxPath];
@@ -1032,7 +1405,7 @@ SyncResult SynchronizeFile(Memory& memory,
 	Success = CreateNewFile(LocalFilePath,
 		SynchronizedFilePath,
 		RemoteFileURL,
-		DownloadManager,
+		memory.Downloads,
 		Remote, ProgressCallback,
 		HashOutput, SizeOutput);
 	if (!Success)
@@ -1041,6 +1414,9 @@ SyncResult SynchronizeFile(Memory& memory,
 			"remote \"%s\"", LocalFilePath, RemoteFileURL)};
 	}
 
+	if (Remote.SyncFormat == Format::Chunks)
+		IndexChunks(memory, Remote, OutputFilePath);
+
 	// Delete the output file if it exists and move the synchronized file over the output file.
 	if (MFile::Exists(OutputFilePath))
 	{
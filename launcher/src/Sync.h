@@ -2,23 +2,46 @@
 
 #include <string>
 #include <memory>
+#include <vector>
+#include <deque>
+#include <unordered_map>
 #include "GlobalTypes.h"
 #include "Download.h"
 #include "LauncherConfig.h"
+#include "Hash.h"
 #include "function_view.h"
 
 struct PatchInternalState;
-namespace Hash { struct Strong; }
 
 namespace Sync
 {
 
-bool MakeSyncFile(const char* OutputFilePath, const char* InputFilePath);
+enum class Format
+{
+	// The file is split into blocks of LauncherConfig::BlockSize bytes, which are looked for at
+	// every offset of the local file.
+	Blocks,
+
+	// The file is split into chunks wherever its content says so (see ChunkSize), which are
+	// looked for in the local file and in the files synchronized before it.
+	Chunks,
+};
+
+// Writes the .sync file for the file at InputFilePath.
+// If FileHashOutput is passed, the strong hash of the whole file is calculated in the same pass.
+bool MakeSyncFile(const char* OutputFilePath, const char* InputFilePath,
+	Hash::Strong* FileHashOutput = nullptr, Format SyncFormat = Format::Blocks);
+
+// Returns the size of the content-defined chunk at the start of Data, which is Size bytes large.
+// The same data gives the same chunk boundaries regardless of what comes before it.
+size_t ChunkSize(const u8* Data, size_t Size);
 
+// In the chunk format, these count chunks instead of blocks.
 struct BlockCounts
 {
 	size_t MatchingBlocks;
 	size_t UnmatchingBlocks;
+	u64 UnmatchingSize;
 };
 
 enum StatusType
@@ -38,8 +61,35 @@ struct SyncResult
 
 struct Memory
 {
-	static constexpr auto FileBufferSize = int(4 * LauncherConfig::BlockSize);
-	std::unique_ptr<u8[]> FileBuffer{new u8[FileBufferSize]};
+	// How many threads the local file is scanned for blocks with.
+	// 0 or less uses one per core.
+	int ThreadCount = 0;
+
+	// Scratch space for each scanning thread, kept around between files.
+	struct ThreadBuffers
+	{
+		std::vector<u8> Data;
+		std::vector<u32> Hashes;
+		std::vector<u8> Found;
+	};
+	std::vector<ThreadBuffers> Threads;
+
+	// Where the chunks of the files synchronized so far in the chunk format are, so that a chunk
+	// that moved to another file isn't downloaded again.
+	struct ChunkLocation
+	{
+		size_t File;
+		u64 Offset;
+	};
+	std::deque<std::string> ChunkFiles;
+	std::unordered_map<Hash::Strong, ChunkLocation> ChunkIndex;
+
+	// Scratch space for splitting the local file into chunks.
+	std::vector<u8> ChunkBuffer;
+
+	// Downloads the missing parts of each file. It's kept between files so that its connections
+	// are reused, and its limits apply to all of them.
+	DownloadQueue Downloads;
 };
 
 SyncResult SynchronizeFile(Memory&,